@@ -0,0 +1,50 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+using System.IO;
+using UnrealBuildTool;
+
+// 与引擎无关的推理核心：只依赖ONNX Runtime和C++标准库，同一份源码也由CMakeLists.txt在Linux上独立构建。
+// ONNX Runtime的包含路径和链接库在这里统一配置，cloth模块通过公共依赖继承
+public class OnnxCore : ModuleRules
+{
+	public OnnxCore(ReadOnlyTargetRules Target) : base(Target)
+	{
+        PCHUsage = ModuleRules.PCHUsageMode.UseExplicitOrSharedPCHs;
+        bEnableExceptions = true;
+
+        // 使用自带的ONNX Runtime 1.20版本（与NNE版本匹配）
+        string OnnxRuntimePath = Path.Combine(PluginDirectory, "ThirdParty", "OnnxRuntime");
+        PublicIncludePaths.Add(Path.Combine(OnnxRuntimePath, "include"));
+
+        // C++ API默认在静态初始化时调用OrtGetApiBase()，会在模块加载时就加载延迟加载的DLL。
+        // 手动初始化后由FOnnxRuntime::LoadApi在第一次使用时加载（独立构建不定义，仍使用静态初始化）
+        PublicDefinitions.Add("ORT_API_MANUAL_INIT");
+
+        string libPath = Path.Combine(OnnxRuntimePath, "lib");
+        if (Target.Platform == UnrealTargetPlatform.Win64)
+        {
+            PublicAdditionalLibraries.Add(Path.Combine(libPath, "onnxruntime.lib"));
+
+            // 运行时DLL依赖
+            RuntimeDependencies.Add(Path.Combine(libPath, "onnxruntime.dll"));
+            RuntimeDependencies.Add(Path.Combine(libPath, "onnxruntime_providers_shared.dll"));
+
+            // 延迟加载DLL
+            PublicDelayLoadDLLs.Add("onnxruntime.dll");
+            PublicDelayLoadDLLs.Add("onnxruntime_providers_shared.dll");
+        }
+        else if (Target.Platform == UnrealTargetPlatform.Linux)
+        {
+            // 官方Linux发行包的libonnxruntime.so是指向libonnxruntime.so.1（SONAME）的符号链接
+            PublicAdditionalLibraries.Add(Path.Combine(libPath, "libonnxruntime.so"));
+            PublicRuntimeLibraryPaths.Add(libPath);
+            RuntimeDependencies.Add(Path.Combine(libPath, "libonnxruntime.so.1"));
+
+            // 工作进程通道的共享内存（shm_open在旧版glibc中位于librt）
+            PublicSystemLibraries.Add("rt");
+        }
+
+        // 只用于IMPLEMENT_MODULE，核心源码本身不包含UE头文件
+        PrivateDependencyModuleNames.Add("Core");
+    }
+}
@@ -0,0 +1,410 @@
+// OnnxCoreBenchmark.cpp
+
+#include "OnnxCoreBenchmark.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+    // Run需要的C字符串数组
+    std::vector<const char*> MakeNamePointers(const std::vector<std::string>& Names)
+    {
+        std::vector<const char*> Pointers;
+        Pointers.reserve(Names.size());
+        for (const std::string& Name : Names)
+        {
+            Pointers.push_back(Name.c_str());
+        }
+        return Pointers;
+    }
+}
+
+namespace OnnxCore
+{
+    double GetSeconds()
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    double GetProcessCpuSeconds()
+    {
+#ifdef _WIN32
+        FILETIME CreationTime, ExitTime, KernelTime, UserTime;
+        if (GetProcessTimes(GetCurrentProcess(), &CreationTime, &ExitTime, &KernelTime, &UserTime))
+        {
+            const uint64_t Kernel = (uint64_t(KernelTime.dwHighDateTime) << 32) | KernelTime.dwLowDateTime;
+            const uint64_t User = (uint64_t(UserTime.dwHighDateTime) << 32) | UserTime.dwLowDateTime;
+            return double(Kernel + User) * 1e-7;
+        }
+        return -1.0;
+#else
+        struct rusage Usage;
+        if (getrusage(RUSAGE_SELF, &Usage) == 0)
+        {
+            return double(Usage.ru_utime.tv_sec + Usage.ru_stime.tv_sec) + double(Usage.ru_utime.tv_usec + Usage.ru_stime.tv_usec) * 1e-6;
+        }
+        return -1.0;
+#endif
+    }
+
+    size_t GetElementSize(ONNXTensorElementDataType Type)
+    {
+        switch (Type)
+        {
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:    return sizeof(float);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE:   return sizeof(double);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16:  return sizeof(uint16_t);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_BFLOAT16: return sizeof(uint16_t);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64:    return sizeof(int64_t);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT64:   return sizeof(uint64_t);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32:    return sizeof(int32_t);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT32:   return sizeof(uint32_t);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT16:    return sizeof(int16_t);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT16:   return sizeof(uint16_t);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT8:     return sizeof(int8_t);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8:    return sizeof(uint8_t);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL:     return sizeof(bool);
+        default:                                     return 0;
+        }
+    }
+
+    double Percentile(std::vector<double> Values, double Fraction)
+    {
+        if (Values.empty())
+        {
+            return 0.0;
+        }
+        std::sort(Values.begin(), Values.end());
+        const int64_t Last = static_cast<int64_t>(Values.size()) - 1;
+        const int64_t Index = std::min(std::max(static_cast<int64_t>(std::floor(Fraction * Last + 0.5)), int64_t(0)), Last);
+        return Values[Index];
+    }
+
+    FLatencySummary SummarizeLatencies(std::vector<double> LatenciesMs)
+    {
+        FLatencySummary Summary;
+        if (LatenciesMs.empty())
+        {
+            return Summary;
+        }
+
+        // 排序一次，之后的分位数直接按下标读取
+        std::sort(LatenciesMs.begin(), LatenciesMs.end());
+        const int64_t Last = static_cast<int64_t>(LatenciesMs.size()) - 1;
+        auto At = [&](double Fraction)
+        {
+            return LatenciesMs[std::min(static_cast<int64_t>(std::floor(Fraction * Last + 0.5)), Last)];
+        };
+
+        double SumMs = 0.0;
+        for (double Latency : LatenciesMs)
+        {
+            SumMs += Latency;
+        }
+
+        Summary.Count = static_cast<int64_t>(LatenciesMs.size());
+        Summary.MeanMs = SumMs / Summary.Count;
+        Summary.P50Ms = At(0.5);
+        Summary.P90Ms = At(0.9);
+        Summary.P95Ms = At(0.95);
+        Summary.P99Ms = At(0.99);
+        Summary.MaxMs = LatenciesMs.back();
+        return Summary;
+    }
+
+    Ort::Value* FInputSet::FindInput(const char* Name)
+    {
+        for (size_t i = 0; i < InputNames.size(); ++i)
+        {
+            if (InputNames[i] == Name)
+            {
+                return &InputValues[i];
+            }
+        }
+        return nullptr;
+    }
+
+    bool MakeSyntheticInputs(Ort::Session& Session, const FSyntheticInputParams& Params, FInputSet& OutInputs, std::string& OutError)
+    {
+        OutInputs = FInputSet();
+
+        try
+        {
+            Ort::AllocatorWithDefaultOptions allocator;
+            std::mt19937 Random(Params.Seed);
+            std::uniform_real_distribution<float> Fraction(0.0f, 1.0f);
+
+            for (size_t i = 0; i < Session.GetInputCount(); ++i)
+            {
+                auto inputName = Session.GetInputNameAllocated(i, allocator);
+                const std::string Name = inputName.get();
+
+                Ort::TypeInfo typeInfo = Session.GetInputTypeInfo(i);
+                auto tensorInfo = typeInfo.GetTensorTypeAndShapeInfo();
+                const ONNXTensorElementDataType elementType = tensorInfo.GetElementType();
+                std::vector<int64_t> shape = tensorInfo.GetShape();
+
+                const auto Override = Params.ShapeOverrides.find(Name);
+                if (Override != Params.ShapeOverrides.end())
+                {
+                    shape = Override->second;
+                }
+                for (int64_t& dim : shape)
+                {
+                    if (dim < 0)
+                    {
+                        dim = Params.DynamicDimValue;
+                    }
+                }
+
+                const size_t elementSize = GetElementSize(elementType);
+                if (elementSize == 0)
+                {
+                    OutError = "unsupported element type " + std::to_string(static_cast<int>(elementType)) + " for input " + Name;
+                    return false;
+                }
+
+                Ort::Value value = Ort::Value::CreateTensor(allocator, shape.data(), shape.size(), elementType);
+                const size_t elementCount = value.GetTensorTypeAndShapeInfo().GetElementCount();
+                void* rawData = value.GetTensorMutableRawData();
+
+                if (elementType == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT)
+                {
+                    float* floatData = static_cast<float*>(rawData);
+                    for (size_t j = 0; j < elementCount; ++j)
+                    {
+                        floatData[j] = Fraction(Random);
+                    }
+                }
+                else if (elementType == ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32)
+                {
+                    std::fill_n(static_cast<int32_t*>(rawData), elementCount, 1);
+                }
+                else if (elementType == ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64)
+                {
+                    std::fill_n(static_cast<int64_t*>(rawData), elementCount, int64_t(1));
+                }
+                else
+                {
+                    std::memset(rawData, 0, elementCount * elementSize);
+                }
+
+                OutInputs.InputNames.push_back(Name);
+                OutInputs.InputValues.push_back(std::move(value));
+            }
+
+            for (size_t i = 0; i < Session.GetOutputCount(); ++i)
+            {
+                auto outputName = Session.GetOutputNameAllocated(i, allocator);
+                OutInputs.OutputNames.push_back(outputName.get());
+            }
+        }
+        catch (const Ort::Exception& e)
+        {
+            OutError = std::string("failed to create synthetic inputs: ") + e.what();
+            return false;
+        }
+
+        return true;
+    }
+
+    bool LoadInputData(FInputSet& Inputs, const std::string& Name, const std::string& FilePath, std::string& OutError)
+    {
+        Ort::Value* Value = Inputs.FindInput(Name.c_str());
+        if (!Value)
+        {
+            OutError = "model has no input named " + Name;
+            return false;
+        }
+
+        auto info = Value->GetTensorTypeAndShapeInfo();
+        const size_t expectedBytes = info.GetElementCount() * GetElementSize(info.GetElementType());
+
+        std::ifstream File(FilePath, std::ios::binary | std::ios::ate);
+        if (!File)
+        {
+            OutError = "cannot open " + FilePath;
+            return false;
+        }
+        const std::streamoff fileBytes = File.tellg();
+        if (fileBytes < 0 || static_cast<size_t>(fileBytes) != expectedBytes)
+        {
+            OutError = FilePath + " has " + std::to_string(static_cast<long long>(fileBytes)) + " bytes, input " + Name +
+                       " needs " + std::to_string(expectedBytes) + " (check the shape override)";
+            return false;
+        }
+
+        File.seekg(0);
+        File.read(static_cast<char*>(Value->GetTensorMutableRawData()), static_cast<std::streamsize>(expectedBytes));
+        if (!File)
+        {
+            OutError = "failed to read " + FilePath;
+            return false;
+        }
+        return true;
+    }
+
+    FBenchmarkResult RunBenchmark(Ort::Session& Session, FInputSet& Inputs, const FBenchmarkParams& Params)
+    {
+        FBenchmarkResult Result;
+
+        const std::vector<const char*> inputNames = MakeNamePointers(Inputs.InputNames);
+        const std::vector<const char*> outputNames = MakeNamePointers(Inputs.OutputNames);
+
+        try
+        {
+            Ort::RunOptions runOptions{nullptr};
+
+            for (int32_t i = 0; i < Params.WarmupIterations; ++i)
+            {
+                Session.Run(runOptions, inputNames.data(), Inputs.InputValues.data(), inputNames.size(), outputNames.data(), outputNames.size());
+            }
+
+            std::vector<double> LatenciesMs;
+            LatenciesMs.reserve(std::max(0, Params.Iterations));
+
+            const auto ReadCpuSeconds = [&Params]() { return Params.CpuClock ? Params.CpuClock() : GetProcessCpuSeconds(); };
+
+            double RunCpuSeconds = 0.0;
+            double RunWallSeconds = 0.0;
+            double IdleWallSeconds = 0.0;
+            const double CpuStart = ReadCpuSeconds();
+
+            for (int32_t i = 0; i < Params.Iterations; ++i)
+            {
+                const double RunCpuBegin = ReadCpuSeconds();
+                const double RunBegin = GetSeconds();
+                Session.Run(runOptions, inputNames.data(), Inputs.InputValues.data(), inputNames.size(), outputNames.data(), outputNames.size());
+                const double RunEnd = GetSeconds();
+                RunCpuSeconds += ReadCpuSeconds() - RunCpuBegin;
+
+                LatenciesMs.push_back((RunEnd - RunBegin) * 1000.0);
+                RunWallSeconds += RunEnd - RunBegin;
+
+                // 模拟交互式请求之间的空闲；自旋的线程会在这段时间继续消耗CPU
+                if (Params.IdleGapSeconds > 0.0)
+                {
+                    const double IdleBegin = GetSeconds();
+                    std::this_thread::sleep_for(std::chrono::duration<double>(Params.IdleGapSeconds));
+                    IdleWallSeconds += GetSeconds() - IdleBegin;
+                }
+            }
+
+            const double CpuTotal = ReadCpuSeconds() - CpuStart;
+
+            Result.Latency = SummarizeLatencies(std::move(LatenciesMs));
+            Result.RunsPerSecond = RunWallSeconds > 0.0 ? Params.Iterations / RunWallSeconds : 0.0;
+            Result.CpuMsPerRequest = Params.Iterations > 0 ? CpuTotal * 1000.0 / Params.Iterations : 0.0;
+            Result.IdleCpuPercent = IdleWallSeconds > 0.0 ? std::max(0.0, CpuTotal - RunCpuSeconds) / IdleWallSeconds * 100.0 : 0.0;
+            Result.bSucceeded = true;
+        }
+        catch (const Ort::Exception& e)
+        {
+            Result.Error = e.what();
+        }
+
+        return Result;
+    }
+
+    FBenchmarkResult RunConcurrentBenchmark(const std::vector<Ort::Session*>& Sessions, FInputSet& Inputs, const FBenchmarkParams& Params)
+    {
+        FBenchmarkResult Result;
+        if (Sessions.empty())
+        {
+            Result.Error = "no sessions";
+            return Result;
+        }
+
+        // 输入张量在Run中只读，所有线程共享同一组输入
+        const std::vector<const char*> inputNames = MakeNamePointers(Inputs.InputNames);
+        const std::vector<const char*> outputNames = MakeNamePointers(Inputs.OutputNames);
+
+        std::vector<std::vector<double>> LatenciesPerStream(Sessions.size());
+        std::vector<std::string> Errors(Sessions.size());
+        std::atomic<bool> bFailed(false);
+
+        const double CpuStart = GetProcessCpuSeconds();
+        const double WallStart = GetSeconds();
+
+        std::vector<std::thread> Streams;
+        Streams.reserve(Sessions.size());
+        for (size_t Index = 0; Index < Sessions.size(); ++Index)
+        {
+            Streams.emplace_back([&, Index]()
+            {
+                try
+                {
+                    Ort::RunOptions runOptions{nullptr};
+                    for (int32_t i = 0; i < Params.WarmupIterations + Params.Iterations && !bFailed; ++i)
+                    {
+                        const double RunBegin = GetSeconds();
+                        Sessions[Index]->Run(runOptions, inputNames.data(), Inputs.InputValues.data(), inputNames.size(),
+                                             outputNames.data(), outputNames.size());
+                        if (i >= Params.WarmupIterations)
+                        {
+                            LatenciesPerStream[Index].push_back((GetSeconds() - RunBegin) * 1000.0);
+                        }
+                    }
+                }
+                catch (const Ort::Exception& e)
+                {
+                    Errors[Index] = e.what();
+                    bFailed = true;
+                }
+            });
+        }
+        for (std::thread& Stream : Streams)
+        {
+            Stream.join();
+        }
+
+        const double WallSeconds = GetSeconds() - WallStart;
+        const double CpuTotal = GetProcessCpuSeconds() - CpuStart;
+
+        if (bFailed)
+        {
+            for (const std::string& Error : Errors)
+            {
+                if (!Error.empty())
+                {
+                    Result.Error = Error;
+                    break;
+                }
+            }
+            return Result;
+        }
+
+        std::vector<double> LatenciesMs;
+        for (const std::vector<double>& StreamLatencies : LatenciesPerStream)
+        {
+            LatenciesMs.insert(LatenciesMs.end(), StreamLatencies.begin(), StreamLatencies.end());
+        }
+
+        // 墙钟时间包含了预热，吞吐量按全部Run计算
+        const double TotalRuns = double(Sessions.size()) * (Params.WarmupIterations + Params.Iterations);
+        Result.Latency = SummarizeLatencies(std::move(LatenciesMs));
+        Result.RunsPerSecond = WallSeconds > 0.0 ? TotalRuns / WallSeconds : 0.0;
+        Result.CpuMsPerRequest = TotalRuns > 0.0 ? CpuTotal * 1000.0 / TotalRuns : 0.0;
+        Result.bSucceeded = true;
+        return Result;
+    }
+}
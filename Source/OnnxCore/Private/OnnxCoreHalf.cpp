@@ -0,0 +1,146 @@
+// OnnxCoreHalf.cpp
+
+#include "OnnxCoreHalf.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define ONNX_HALF_F16C 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define ONNX_HALF_F16C_TARGET
+#else
+#include <cpuid.h>
+// GCC/Clang需要为使用F16C指令的函数单独开启目标特性，其余代码仍按基线指令集编译
+#define ONNX_HALF_F16C_TARGET __attribute__((target("avx,f16c")))
+#endif
+#else
+#define ONNX_HALF_F16C 0
+#endif
+
+namespace
+{
+    static_assert(sizeof(Ort::Float16_t) == sizeof(uint16_t), "Ort::Float16_t must be a plain 16-bit value");
+
+    void ConvertToHalfScalar(const float* Src, uint16_t* Dst, int64_t Count)
+    {
+        for (int64_t i = 0; i < Count; ++i)
+        {
+            Dst[i] = Ort::Float16_t(Src[i]).val;
+        }
+    }
+
+    void ConvertToFloatScalar(const uint16_t* Src, float* Dst, int64_t Count)
+    {
+        for (int64_t i = 0; i < Count; ++i)
+        {
+            Dst[i] = Ort::Float16_t::FromBits(Src[i]).ToFloat();
+        }
+    }
+
+#if ONNX_HALF_F16C
+    bool DetectF16C()
+    {
+        // CPUID.1:ECX  bit 27 OSXSAVE, bit 28 AVX, bit 29 F16C
+        uint32_t Ecx = 0;
+#if defined(_MSC_VER) && !defined(__clang__)
+        int Info[4] = {};
+        __cpuid(Info, 1);
+        Ecx = static_cast<uint32_t>(Info[2]);
+#else
+        unsigned int Eax = 0, Ebx = 0, EcxValue = 0, Edx = 0;
+        if (!__get_cpuid(1, &Eax, &Ebx, &EcxValue, &Edx))
+        {
+            return false;
+        }
+        Ecx = EcxValue;
+#endif
+        const uint32_t Required = (1u << 27) | (1u << 28) | (1u << 29);
+        if ((Ecx & Required) != Required)
+        {
+            return false;
+        }
+
+        // 操作系统必须保存XMM和YMM状态（XCR0 bit 1和2）
+#if defined(_MSC_VER) && !defined(__clang__)
+        const uint64_t Xcr0 = _xgetbv(0);
+#else
+        uint32_t XcrLow = 0, XcrHigh = 0;
+        __asm__ volatile("xgetbv" : "=a"(XcrLow), "=d"(XcrHigh) : "c"(0));
+        const uint64_t Xcr0 = (uint64_t(XcrHigh) << 32) | XcrLow;
+#endif
+        return (Xcr0 & 0x6) == 0x6;
+    }
+
+    ONNX_HALF_F16C_TARGET void ConvertToHalfF16C(const float* Src, uint16_t* Dst, int64_t Count)
+    {
+        int64_t i = 0;
+        // 每次16个元素，两条独立的转换链可以重叠延迟
+        for (; i + 16 <= Count; i += 16)
+        {
+            const __m128i Low = _mm256_cvtps_ph(_mm256_loadu_ps(Src + i), _MM_FROUND_TO_NEAREST_INT);
+            const __m128i High = _mm256_cvtps_ph(_mm256_loadu_ps(Src + i + 8), _MM_FROUND_TO_NEAREST_INT);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(Dst + i), Low);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(Dst + i + 8), High);
+        }
+        for (; i + 8 <= Count; i += 8)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(Dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(Src + i), _MM_FROUND_TO_NEAREST_INT));
+        }
+        ConvertToHalfScalar(Src + i, Dst + i, Count - i);
+    }
+
+    ONNX_HALF_F16C_TARGET void ConvertToFloatF16C(const uint16_t* Src, float* Dst, int64_t Count)
+    {
+        int64_t i = 0;
+        for (; i + 16 <= Count; i += 16)
+        {
+            const __m256 Low = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(Src + i)));
+            const __m256 High = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(Src + i + 8)));
+            _mm256_storeu_ps(Dst + i, Low);
+            _mm256_storeu_ps(Dst + i + 8, High);
+        }
+        for (; i + 8 <= Count; i += 8)
+        {
+            _mm256_storeu_ps(Dst + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(Src + i))));
+        }
+        ConvertToFloatScalar(Src + i, Dst + i, Count - i);
+    }
+#endif
+}
+
+namespace OnnxCore
+{
+    bool IsF16CSupported()
+    {
+#if ONNX_HALF_F16C
+        static const bool bSupported = DetectF16C();
+        return bSupported;
+#else
+        return false;
+#endif
+    }
+
+    void ConvertToHalf(const float* Src, uint16_t* Dst, int64_t Count)
+    {
+#if ONNX_HALF_F16C
+        if (IsF16CSupported())
+        {
+            ConvertToHalfF16C(Src, Dst, Count);
+            return;
+        }
+#endif
+        ConvertToHalfScalar(Src, Dst, Count);
+    }
+
+    void ConvertToFloat(const uint16_t* Src, float* Dst, int64_t Count)
+    {
+#if ONNX_HALF_F16C
+        if (IsF16CSupported())
+        {
+            ConvertToFloatF16C(Src, Dst, Count);
+            return;
+        }
+#endif
+        ConvertToFloatScalar(Src, Dst, Count);
+    }
+}
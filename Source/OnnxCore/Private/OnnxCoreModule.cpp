@@ -0,0 +1,6 @@
+// OnnxCoreModule.cpp
+// 只在作为UE模块编译时使用，CMake独立构建不包含这个文件
+
+#include "Modules/ModuleManager.h"
+
+IMPLEMENT_MODULE(FDefaultModuleImpl, OnnxCore)
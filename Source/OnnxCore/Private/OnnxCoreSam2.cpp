@@ -0,0 +1,123 @@
+// OnnxCoreSam2.cpp
+
+#include "OnnxCoreSam2.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // 与FMath::RoundToInt相同：0.5向上舍入
+    int32_t RoundToInt(float Value)
+    {
+        return static_cast<int32_t>(std::floor(Value + 0.5f));
+    }
+}
+
+namespace OnnxCore
+{
+    namespace Sam2
+    {
+        FLetterbox ComputeLetterbox(int32_t Width, int32_t Height)
+        {
+            // 保持宽高比缩放，并居中放置
+            FLetterbox Letterbox;
+            Letterbox.Scale = std::min(float(ImageSize) / float(Width), float(ImageSize) / float(Height));
+            Letterbox.ScaledWidth = RoundToInt(Width * Letterbox.Scale);
+            Letterbox.ScaledHeight = RoundToInt(Height * Letterbox.Scale);
+            Letterbox.XOffset = (ImageSize - Letterbox.ScaledWidth) / 2;
+            Letterbox.YOffset = (ImageSize - Letterbox.ScaledHeight) / 2;
+            return Letterbox;
+        }
+
+        void PreprocessImage(const float* Rgb, int32_t Width, int32_t Height, const FLetterbox& Letterbox, float* OutPlanes)
+        {
+            // ImageNet标准化参数
+            const float Mean[3] = {0.485f, 0.456f, 0.406f};
+            const float Std[3] = {0.229f, 0.224f, 0.225f};
+
+            // 直接写入NCHW格式，不经过HWC中间画布。画布的填充区域是0，标准化后为-Mean/Std
+            const int32_t PlaneSize = ImageSize * ImageSize;
+            for (int32_t c = 0; c < 3; ++c)
+            {
+                std::fill_n(OutPlanes + c * PlaneSize, PlaneSize, -Mean[c] / Std[c]);
+            }
+
+            // 双线性插值缩放并放置到画布中央
+            for (int32_t y = 0; y < Letterbox.ScaledHeight; ++y)
+            {
+                for (int32_t x = 0; x < Letterbox.ScaledWidth; ++x)
+                {
+                    // 源坐标
+                    const float SrcX = x / Letterbox.Scale;
+                    const float SrcY = y / Letterbox.Scale;
+
+                    const int32_t SrcX0 = static_cast<int32_t>(std::floor(SrcX));
+                    const int32_t SrcY0 = static_cast<int32_t>(std::floor(SrcY));
+                    const int32_t SrcX1 = std::min(SrcX0 + 1, Width - 1);
+                    const int32_t SrcY1 = std::min(SrcY0 + 1, Height - 1);
+
+                    const float WeightX = SrcX - SrcX0;
+                    const float WeightY = SrcY - SrcY0;
+
+                    // 目标坐标
+                    const int32_t DstX = x + Letterbox.XOffset;
+                    const int32_t DstY = y + Letterbox.YOffset;
+                    if (DstX < 0 || DstX >= ImageSize || DstY < 0 || DstY >= ImageSize)
+                    {
+                        continue;
+                    }
+
+                    const int32_t DstIndex = DstY * ImageSize + DstX;
+                    for (int32_t c = 0; c < 3; ++c)
+                    {
+                        const float P00 = Rgb[(SrcY0 * Width + SrcX0) * 3 + c];
+                        const float P01 = Rgb[(SrcY0 * Width + SrcX1) * 3 + c];
+                        const float P10 = Rgb[(SrcY1 * Width + SrcX0) * 3 + c];
+                        const float P11 = Rgb[(SrcY1 * Width + SrcX1) * 3 + c];
+
+                        const float InterpolatedValue = P00 * (1 - WeightX) * (1 - WeightY) +
+                                                        P01 * WeightX * (1 - WeightY) +
+                                                        P10 * (1 - WeightX) * WeightY +
+                                                        P11 * WeightX * WeightY;
+
+                        OutPlanes[c * PlaneSize + DstIndex] = (InterpolatedValue - Mean[c]) / Std[c];
+                    }
+                }
+            }
+        }
+
+        void TransformPoint(float X, float Y, int32_t Width, int32_t Height, const FLetterbox& Letterbox, float& OutX, float& OutY)
+        {
+            // 确保坐标在画布范围内
+            OutX = std::min(std::max(Letterbox.XOffset + X * Width * Letterbox.Scale, 0.0f), float(ImageSize));
+            OutY = std::min(std::max(Letterbox.YOffset + Y * Height * Letterbox.Scale, 0.0f), float(ImageSize));
+        }
+
+        void ApplySigmoid(float* Data, int64_t Count)
+        {
+            for (int64_t i = 0; i < Count; ++i)
+            {
+                Data[i] = 1.0f / (1.0f + std::exp(-Data[i]));
+            }
+        }
+
+        void PostprocessMask(const float* Mask, int32_t Width, int32_t Height, const FLetterbox& Letterbox, uint8_t* OutMask)
+        {
+            // 最近邻缩放回原始尺寸，每个像素直接从画布上取值并二值化，不生成中间掩码
+            const float InvScaleX = float(Letterbox.ScaledWidth) / float(Width);
+            const float InvScaleY = float(Letterbox.ScaledHeight) / float(Height);
+
+            for (int32_t y = 0; y < Height; ++y)
+            {
+                const int32_t CanvasY = std::min(RoundToInt(y * InvScaleY), Letterbox.ScaledHeight - 1) + Letterbox.YOffset;
+                for (int32_t x = 0; x < Width; ++x)
+                {
+                    const int32_t CanvasX = std::min(RoundToInt(x * InvScaleX), Letterbox.ScaledWidth - 1) + Letterbox.XOffset;
+                    const bool bInCanvas = CanvasX >= 0 && CanvasX < ImageSize && CanvasY >= 0 && CanvasY < ImageSize;
+                    OutMask[y * Width + x] = (bInCanvas && Mask[CanvasY * ImageSize + CanvasX] > 0.5f) ? 255 : 0;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,138 @@
+// OnnxCoreSessionConfig.cpp
+
+#include "OnnxCoreSessionConfig.h"
+#include "onnxruntime_session_options_config_keys.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#include <filesystem>
+#endif
+
+namespace OnnxCore
+{
+    const char* GetSpinModeName(ESpinMode Mode)
+    {
+        switch (Mode)
+        {
+        case ESpinMode::SpinThenStop: return "stop";
+        case ESpinMode::NoSpin:       return "none";
+        case ESpinMode::Default:
+        default:                      return "default";
+        }
+    }
+
+    bool ParseSpinMode(const std::string& Name, ESpinMode& OutMode)
+    {
+        if (Name == "default")
+        {
+            OutMode = ESpinMode::Default;
+        }
+        else if (Name == "stop")
+        {
+            OutMode = ESpinMode::SpinThenStop;
+        }
+        else if (Name == "none")
+        {
+            OutMode = ESpinMode::NoSpin;
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    void FSessionConfig::ApplyTo(Ort::SessionOptions& SessionOptions) const
+    {
+        SessionOptions.SetIntraOpNumThreads(std::max(1, IntraOpThreads));
+
+        if (bParallel)
+        {
+            SessionOptions.SetExecutionMode(ORT_PARALLEL);
+            SessionOptions.SetInterOpNumThreads(std::max(0, InterOpThreads));
+        }
+        else
+        {
+            SessionOptions.SetExecutionMode(ORT_SEQUENTIAL);
+        }
+
+        // 逐线程亲和性只有在有线程池时才有意义（ORT要求恰好IntraOpThreads-1项）
+        if (IntraOpThreads > 1 && !IntraOpThreadAffinities.empty())
+        {
+            SessionOptions.AddConfigEntry(kOrtSessionOptionsConfigIntraOpThreadAffinities, IntraOpThreadAffinities.c_str());
+        }
+
+        switch (SpinMode)
+        {
+        case ESpinMode::SpinThenStop:
+            // 突发期间保持自旋，最后一个Run返回后立即停止
+            SessionOptions.AddConfigEntry(kOrtSessionOptionsConfigForceSpinningStop, "1");
+            break;
+
+        case ESpinMode::NoSpin:
+            SessionOptions.AddConfigEntry(kOrtSessionOptionsConfigAllowIntraOpSpinning, "0");
+            SessionOptions.AddConfigEntry(kOrtSessionOptionsConfigAllowInterOpSpinning, "0");
+            break;
+
+        case ESpinMode::Default:
+        default:
+            break;
+        }
+
+        if (bDisableQDQFusion)
+        {
+            SessionOptions.AddConfigEntry(kOrtSessionOptionsDisableQuantQDQ, "1");
+        }
+        if (bEnableQDQCleanup)
+        {
+            SessionOptions.AddConfigEntry(kOrtSessionOptionsEnableQuantQDQCleanup, "1");
+        }
+        if (bDisableDoubleQDQRemover)
+        {
+            SessionOptions.AddConfigEntry(kOrtSessionOptionsDisableDoubleQDQRemover, "1");
+        }
+        if (bAvx2PrecisionMode)
+        {
+            SessionOptions.AddConfigEntry(kOrtSessionOptionsAvx2PrecisionMode, "1");
+        }
+        if (MatMulNBitsAccuracyLevel > 0)
+        {
+            const std::string Level = std::to_string(std::min(std::max(MatMulNBitsAccuracyLevel, 1), 4));
+            SessionOptions.AddConfigEntry(kOrtSessionOptionsQDQMatMulNBitsAccuracyLevel, Level.c_str());
+        }
+    }
+
+    std::string FSessionConfig::ToString() const
+    {
+        std::string Result = "intra=" + std::to_string(IntraOpThreads);
+        if (bParallel)
+        {
+            Result += ", inter=" + std::to_string(InterOpThreads) + ", parallel";
+        }
+        Result += std::string(", spin=") + GetSpinModeName(SpinMode);
+        return Result;
+    }
+
+    Ort::Session CreateSession(Ort::Env& Env, const std::string& ModelPath, const FSessionConfig& Config)
+    {
+        Ort::SessionOptions SessionOptions;
+        Config.ApplyTo(SessionOptions);
+
+#ifdef _WIN32
+        const std::wstring WidePath = std::filesystem::u8path(ModelPath).wstring();
+        return Ort::Session(Env, WidePath.c_str(), SessionOptions);
+#else
+        return Ort::Session(Env, ModelPath.c_str(), SessionOptions);
+#endif
+    }
+
+    void InitializeApi(const OrtApi* Api)
+    {
+#ifdef ORT_API_MANUAL_INIT
+        Ort::InitApi(Api);
+#else
+        (void)Api;
+#endif
+    }
+}
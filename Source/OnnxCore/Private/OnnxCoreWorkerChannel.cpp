@@ -0,0 +1,589 @@
+// OnnxCoreWorkerChannel.cpp
+
+#include "OnnxCoreWorkerChannel.h"
+#include "OnnxCoreBenchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+namespace
+{
+    uint64_t AlignUp(uint64_t Value, uint64_t Alignment)
+    {
+        return (Value + Alignment - 1) / Alignment * Alignment;
+    }
+
+    uint64_t GetSlotsOffset()
+    {
+        return AlignUp(sizeof(OnnxCore::FWorkerChannelHeader), OnnxCore::WorkerTensorAlignment);
+    }
+
+    uint64_t GetDataOffset(uint32_t NumSlots)
+    {
+        return AlignUp(GetSlotsOffset() + uint64_t(NumSlots) * sizeof(OnnxCore::FWorkerSlot), 4096);
+    }
+
+#ifndef _WIN32
+    std::string MakeErrnoMessage(const char* What)
+    {
+        return std::string(What) + " failed: " + std::strerror(errno);
+    }
+#endif
+}
+
+namespace OnnxCore
+{
+    FSharedMemoryRegion::~FSharedMemoryRegion()
+    {
+        Close();
+    }
+
+    bool FSharedMemoryRegion::Create(const std::string& Name, uint64_t Bytes, std::string& OutError)
+    {
+        Close();
+
+#ifdef _WIN32
+        const std::string MappingName = "Local\\" + Name;
+        HANDLE Mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                            static_cast<DWORD>(Bytes >> 32), static_cast<DWORD>(Bytes & 0xFFFFFFFFu), MappingName.c_str());
+        if (!Mapping)
+        {
+            OutError = "CreateFileMapping failed: " + std::to_string(GetLastError());
+            return false;
+        }
+        void* Mapped = MapViewOfFile(Mapping, FILE_MAP_ALL_ACCESS, 0, 0, Bytes);
+        if (!Mapped)
+        {
+            OutError = "MapViewOfFile failed: " + std::to_string(GetLastError());
+            CloseHandle(Mapping);
+            return false;
+        }
+        HANDLE Semaphore = CreateSemaphoreA(nullptr, 0, LONG_MAX, (MappingName + "-wake").c_str());
+        if (!Semaphore)
+        {
+            OutError = "CreateSemaphore failed: " + std::to_string(GetLastError());
+            UnmapViewOfFile(Mapped);
+            CloseHandle(Mapping);
+            return false;
+        }
+        Mapping_ = Mapping;
+        WakeSemaphore_ = Semaphore;
+#else
+        // 上次崩溃残留的同名区域先删除
+        const std::string PosixName = "/" + Name;
+        shm_unlink(PosixName.c_str());
+
+        const int Fd = shm_open(PosixName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (Fd < 0)
+        {
+            OutError = MakeErrnoMessage("shm_open");
+            return false;
+        }
+        if (ftruncate(Fd, static_cast<off_t>(Bytes)) != 0)
+        {
+            OutError = MakeErrnoMessage("ftruncate");
+            close(Fd);
+            shm_unlink(PosixName.c_str());
+            return false;
+        }
+        void* Mapped = mmap(nullptr, Bytes, PROT_READ | PROT_WRITE, MAP_SHARED, Fd, 0);
+        close(Fd);
+        if (Mapped == MAP_FAILED)
+        {
+            OutError = MakeErrnoMessage("mmap");
+            shm_unlink(PosixName.c_str());
+            return false;
+        }
+#endif
+
+        Name_ = Name;
+        Data_ = Mapped;
+        Size_ = Bytes;
+        bOwner_ = true;
+        return true;
+    }
+
+    bool FSharedMemoryRegion::Open(const std::string& Name, std::string& OutError)
+    {
+        Close();
+
+#ifdef _WIN32
+        const std::string MappingName = "Local\\" + Name;
+        HANDLE Mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, MappingName.c_str());
+        if (!Mapping)
+        {
+            OutError = "OpenFileMapping failed: " + std::to_string(GetLastError());
+            return false;
+        }
+        void* Mapped = MapViewOfFile(Mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+        MEMORY_BASIC_INFORMATION Info = {};
+        if (!Mapped || !VirtualQuery(Mapped, &Info, sizeof(Info)))
+        {
+            OutError = "MapViewOfFile failed: " + std::to_string(GetLastError());
+            if (Mapped)
+            {
+                UnmapViewOfFile(Mapped);
+            }
+            CloseHandle(Mapping);
+            return false;
+        }
+        HANDLE Semaphore = OpenSemaphoreA(SYNCHRONIZE | SEMAPHORE_MODIFY_STATE, FALSE, (MappingName + "-wake").c_str());
+        if (!Semaphore)
+        {
+            OutError = "OpenSemaphore failed: " + std::to_string(GetLastError());
+            UnmapViewOfFile(Mapped);
+            CloseHandle(Mapping);
+            return false;
+        }
+        Mapping_ = Mapping;
+        WakeSemaphore_ = Semaphore;
+        Size_ = Info.RegionSize;
+#else
+        const std::string PosixName = "/" + Name;
+        const int Fd = shm_open(PosixName.c_str(), O_RDWR, 0600);
+        if (Fd < 0)
+        {
+            OutError = MakeErrnoMessage("shm_open");
+            return false;
+        }
+        struct stat Stat;
+        if (fstat(Fd, &Stat) != 0)
+        {
+            OutError = MakeErrnoMessage("fstat");
+            close(Fd);
+            return false;
+        }
+        void* Mapped = mmap(nullptr, static_cast<size_t>(Stat.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, Fd, 0);
+        close(Fd);
+        if (Mapped == MAP_FAILED)
+        {
+            OutError = MakeErrnoMessage("mmap");
+            return false;
+        }
+        Size_ = static_cast<uint64_t>(Stat.st_size);
+#endif
+
+        Name_ = Name;
+        Data_ = Mapped;
+        bOwner_ = false;
+        return true;
+    }
+
+    void FSharedMemoryRegion::Close()
+    {
+        if (!Data_)
+        {
+            return;
+        }
+
+#ifdef _WIN32
+        // 文件映射在最后一个句柄关闭时删除
+        UnmapViewOfFile(Data_);
+        CloseHandle(static_cast<HANDLE>(Mapping_));
+        CloseHandle(static_cast<HANDLE>(WakeSemaphore_));
+        Mapping_ = nullptr;
+        WakeSemaphore_ = nullptr;
+#else
+        munmap(Data_, Size_);
+        Unlink();
+#endif
+
+        Data_ = nullptr;
+        Size_ = 0;
+        bOwner_ = false;
+        Name_.clear();
+    }
+
+    void* FSharedMemoryRegion::GetWakeHandle() const
+    {
+#ifdef _WIN32
+        return WakeSemaphore_;
+#else
+        return nullptr;
+#endif
+    }
+
+    void FSharedMemoryRegion::Unlink()
+    {
+#ifndef _WIN32
+        if (bOwner_ && !Name_.empty())
+        {
+            shm_unlink(("/" + Name_).c_str());
+        }
+#endif
+        bOwner_ = false;
+    }
+
+    uint64_t GetWorkerChannelBytes(uint32_t NumSlots, uint64_t SlotDataBytes)
+    {
+        return GetDataOffset(NumSlots) + uint64_t(NumSlots) * AlignUp(SlotDataBytes, WorkerTensorAlignment);
+    }
+
+    FWorkerChannelHeader* InitializeWorkerChannel(void* Memory, uint32_t NumSlots, uint64_t SlotDataBytes)
+    {
+        // 新创建的共享内存已经清零，这里只需要构造原子变量并写入布局
+        FWorkerChannelHeader* Header = new (Memory) FWorkerChannelHeader();
+        Header->Magic = WorkerChannelMagic;
+        Header->Version = WorkerChannelVersion;
+        Header->NumSlots = NumSlots;
+        Header->SlotDataBytes = AlignUp(SlotDataBytes, WorkerTensorAlignment);
+        Header->TotalBytes = GetWorkerChannelBytes(NumSlots, SlotDataBytes);
+        Header->WorkerState.store(static_cast<uint32_t>(EWorkerState::Starting));
+
+        uint8_t* Slots = static_cast<uint8_t*>(Memory) + GetSlotsOffset();
+        for (uint32_t i = 0; i < NumSlots; ++i)
+        {
+            FWorkerSlot* Slot = new (Slots + i * sizeof(FWorkerSlot)) FWorkerSlot();
+            Slot->State.store(static_cast<uint32_t>(EWorkerSlotState::Free));
+        }
+        return Header;
+    }
+
+    FWorkerChannelHeader* ValidateWorkerChannel(void* Memory, uint64_t Bytes, std::string& OutError)
+    {
+        FWorkerChannelHeader* Header = static_cast<FWorkerChannelHeader*>(Memory);
+        if (Bytes < sizeof(FWorkerChannelHeader) || Header->Magic != WorkerChannelMagic)
+        {
+            OutError = "not a worker channel";
+            return nullptr;
+        }
+        if (Header->Version != WorkerChannelVersion)
+        {
+            OutError = "worker channel version " + std::to_string(Header->Version) + ", expected " + std::to_string(WorkerChannelVersion);
+            return nullptr;
+        }
+        if (Header->TotalBytes > Bytes || GetWorkerChannelBytes(Header->NumSlots, Header->SlotDataBytes) != Header->TotalBytes)
+        {
+            OutError = "worker channel layout does not match its size";
+            return nullptr;
+        }
+        return Header;
+    }
+
+    FWorkerSlot* GetWorkerSlot(FWorkerChannelHeader* Header, uint32_t Index)
+    {
+        uint8_t* Slots = reinterpret_cast<uint8_t*>(Header) + GetSlotsOffset();
+        return reinterpret_cast<FWorkerSlot*>(Slots + Index * sizeof(FWorkerSlot));
+    }
+
+    uint8_t* GetWorkerSlotData(FWorkerChannelHeader* Header, uint32_t Index)
+    {
+        return reinterpret_cast<uint8_t*>(Header) + GetDataOffset(Header->NumSlots) + Index * Header->SlotDataBytes;
+    }
+
+    bool AllocateWorkerTensor(uint64_t SlotDataBytes, uint64_t& InOutUsed, ONNXTensorElementDataType Type,
+                              const int64_t* Dims, int32_t NumDims, FWorkerTensorDesc& OutDesc)
+    {
+        const size_t ElementSize = GetElementSize(Type);
+        if (ElementSize == 0 || NumDims < 0 || NumDims > MaxWorkerTensorDims)
+        {
+            return false;
+        }
+
+        uint64_t Count = 1;
+        for (int32_t i = 0; i < NumDims; ++i)
+        {
+            if (Dims[i] < 0)
+            {
+                return false;
+            }
+            Count *= static_cast<uint64_t>(Dims[i]);
+        }
+
+        const uint64_t Offset = AlignUp(InOutUsed, WorkerTensorAlignment);
+        const uint64_t Bytes = Count * ElementSize;
+        if (Offset + Bytes > SlotDataBytes)
+        {
+            return false;
+        }
+
+        OutDesc = FWorkerTensorDesc();
+        OutDesc.Index = -1;
+        OutDesc.ElementType = static_cast<int32_t>(Type);
+        OutDesc.NumDims = NumDims;
+        std::copy(Dims, Dims + NumDims, OutDesc.Dims);
+        OutDesc.Offset = Offset;
+        OutDesc.Bytes = Bytes;
+        InOutUsed = Offset + Bytes;
+        return true;
+    }
+
+    void CopyWorkerString(char* Dest, size_t Capacity, const char* Src)
+    {
+        if (Capacity == 0)
+        {
+            return;
+        }
+        const size_t Length = std::min(std::strlen(Src), Capacity - 1);
+        std::memcpy(Dest, Src, Length);
+        Dest[Length] = '\0';
+    }
+
+#if defined(__linux__)
+    void WaitForChange(const FSharedMemoryRegion&, std::atomic<uint32_t>& Value, uint32_t Expected, int32_t TimeoutMs)
+    {
+        if (Value.load(std::memory_order_acquire) != Expected)
+        {
+            return;
+        }
+
+        // 非私有futex：等待者和唤醒者在不同的进程中映射同一页面
+        timespec Timeout;
+        Timeout.tv_sec = TimeoutMs / 1000;
+        Timeout.tv_nsec = static_cast<long>(TimeoutMs % 1000) * 1000000L;
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&Value), FUTEX_WAIT, Expected, &Timeout, nullptr, 0);
+    }
+
+    void WakeAll(const FSharedMemoryRegion&, std::atomic<uint32_t>& Value)
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&Value), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+#elif defined(_WIN32)
+    void WaitForChange(const FSharedMemoryRegion& Region, std::atomic<uint32_t>& Value, uint32_t Expected, int32_t TimeoutMs)
+    {
+        FWorkerChannelHeader* Header = static_cast<FWorkerChannelHeader*>(Region.GetData());
+        HANDLE Semaphore = static_cast<HANDLE>(Region.GetWakeHandle());
+        if (!Header || !Semaphore)
+        {
+            return;
+        }
+
+        // 先登记再检查：WakeAll在改变Value之后读取Waiters，两者至少有一方看到对方，唤醒不会丢失
+        Header->Waiters.fetch_add(1, std::memory_order_seq_cst);
+        if (Value.load(std::memory_order_seq_cst) == Expected)
+        {
+            WaitForSingleObject(Semaphore, static_cast<DWORD>(std::max(TimeoutMs, 0)));
+        }
+        Header->Waiters.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    void WakeAll(const FSharedMemoryRegion& Region, std::atomic<uint32_t>&)
+    {
+        FWorkerChannelHeader* Header = static_cast<FWorkerChannelHeader*>(Region.GetData());
+        HANDLE Semaphore = static_cast<HANDLE>(Region.GetWakeHandle());
+        if (!Header || !Semaphore)
+        {
+            return;
+        }
+
+        // 超时离开的等待者留下的计数只会让之后的一次等待提前返回
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const uint32_t Waiters = Header->Waiters.load(std::memory_order_seq_cst);
+        if (Waiters > 0)
+        {
+            ReleaseSemaphore(Semaphore, static_cast<LONG>(Waiters), nullptr);
+        }
+    }
+#else
+    void WaitForChange(const FSharedMemoryRegion&, std::atomic<uint32_t>& Value, uint32_t Expected, int32_t TimeoutMs)
+    {
+        // 没有跨进程的地址等待：先让出时间片轮询一小段时间，再短暂休眠
+        for (int32_t i = 0; i < 64; ++i)
+        {
+            if (Value.load(std::memory_order_acquire) != Expected)
+            {
+                return;
+            }
+            std::this_thread::yield();
+        }
+        if (TimeoutMs > 0 && Value.load(std::memory_order_acquire) == Expected)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(std::min(TimeoutMs * 1000, 200)));
+        }
+    }
+
+    void WakeAll(const FSharedMemoryRegion&, std::atomic<uint32_t>&)
+    {
+    }
+#endif
+
+    bool PublishWorkerModel(Ort::Session& Session, FWorkerChannelHeader* Header, std::string& OutError)
+    {
+        const size_t NumInputs = Session.GetInputCount();
+        const size_t NumOutputs = Session.GetOutputCount();
+        if (NumInputs > size_t(MaxWorkerTensors) || NumOutputs > size_t(MaxWorkerTensors))
+        {
+            OutError = "model has more than " + std::to_string(MaxWorkerTensors) + " inputs or outputs";
+            return false;
+        }
+
+        Ort::AllocatorWithDefaultOptions Allocator;
+        auto Publish = [&](FWorkerNodeInfo& Info, const char* Name, Ort::TypeInfo TypeInfo)
+        {
+            CopyWorkerString(Info.Name, sizeof(Info.Name), Name);
+            Info.ElementType = ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+            Info.NumDims = 0;
+            if (TypeInfo.GetONNXType() != ONNX_TYPE_TENSOR)
+            {
+                return;
+            }
+            Ort::ConstTensorTypeAndShapeInfo TensorInfo = TypeInfo.GetTensorTypeAndShapeInfo();
+            const std::vector<int64_t> Shape = TensorInfo.GetShape();
+            Info.ElementType = TensorInfo.GetElementType();
+            Info.NumDims = static_cast<int32_t>(std::min(Shape.size(), size_t(MaxWorkerTensorDims)));
+            std::copy(Shape.begin(), Shape.begin() + Info.NumDims, Info.Dims);
+        };
+
+        for (size_t i = 0; i < NumInputs; ++i)
+        {
+            Publish(Header->Inputs[i], Session.GetInputNameAllocated(i, Allocator).get(), Session.GetInputTypeInfo(i));
+        }
+        for (size_t i = 0; i < NumOutputs; ++i)
+        {
+            Publish(Header->Outputs[i], Session.GetOutputNameAllocated(i, Allocator).get(), Session.GetOutputTypeInfo(i));
+        }
+        Header->NumInputs = static_cast<int32_t>(NumInputs);
+        Header->NumOutputs = static_cast<int32_t>(NumOutputs);
+        return true;
+    }
+
+    int32_t AcquireSubmittedSlot(FWorkerChannelHeader* Header)
+    {
+        // 槽数很少，直接扫描找最早提交的一个；每个通道只有一个工作进程，占用不会失败
+        int32_t Best = -1;
+        uint64_t BestSequence = 0;
+        for (uint32_t i = 0; i < Header->NumSlots; ++i)
+        {
+            FWorkerSlot* Slot = GetWorkerSlot(Header, i);
+            if (Slot->State.load(std::memory_order_acquire) == static_cast<uint32_t>(EWorkerSlotState::Submitted) &&
+                (Best < 0 || Slot->Sequence < BestSequence))
+            {
+                Best = static_cast<int32_t>(i);
+                BestSequence = Slot->Sequence;
+            }
+        }
+
+        if (Best >= 0)
+        {
+            uint32_t Expected = static_cast<uint32_t>(EWorkerSlotState::Submitted);
+            if (!GetWorkerSlot(Header, Best)->State.compare_exchange_strong(Expected, static_cast<uint32_t>(EWorkerSlotState::Running),
+                                                                             std::memory_order_acq_rel))
+            {
+                return -1;
+            }
+        }
+        return Best;
+    }
+
+    void ProcessWorkerSlot(Ort::Session& Session, const FSharedMemoryRegion& Region, FWorkerChannelHeader* Header, int32_t SlotIndex)
+    {
+        FWorkerSlot* Slot = GetWorkerSlot(Header, SlotIndex);
+        uint8_t* Data = GetWorkerSlotData(Header, SlotIndex);
+        const double StartTime = GetSeconds();
+
+        std::string Error;
+        Slot->NumOutputs = 0;
+        Slot->Error[0] = '\0';
+
+        try
+        {
+            // 输入张量直接引用共享内存中宿主写入的数据
+            Ort::MemoryInfo MemoryInfo = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU);
+            std::vector<Ort::Value> InputValues;
+            std::vector<const char*> InputNames;
+            const uint32_t NumInputs = std::min(Slot->NumInputs, uint32_t(MaxWorkerTensors));
+            for (uint32_t i = 0; i < NumInputs && Error.empty(); ++i)
+            {
+                // 描述来自另一个进程，按同样的规则重新计算一遍，保证不会越出数据区
+                const FWorkerTensorDesc& Desc = Slot->Inputs[i];
+                uint64_t Used = Desc.Offset;
+                FWorkerTensorDesc Check;
+                const bool bValid = Desc.Index >= 0 && Desc.Index < Header->NumInputs &&
+                    AllocateWorkerTensor(Header->SlotDataBytes, Used, static_cast<ONNXTensorElementDataType>(Desc.ElementType), Desc.Dims, Desc.NumDims, Check) &&
+                    Check.Offset == Desc.Offset && Check.Bytes == Desc.Bytes;
+                if (!bValid)
+                {
+                    Error = "invalid input tensor " + std::to_string(i);
+                    break;
+                }
+                InputValues.push_back(Ort::Value::CreateTensor(MemoryInfo, Data + Desc.Offset, Desc.Bytes, Desc.Dims, Desc.NumDims,
+                                                               static_cast<ONNXTensorElementDataType>(Desc.ElementType)));
+                InputNames.push_back(Header->Inputs[Desc.Index].Name);
+            }
+
+            std::vector<const char*> OutputNames;
+            std::vector<int32_t> OutputIndices;
+            for (int32_t i = 0; i < Header->NumOutputs; ++i)
+            {
+                if (Slot->OutputMask == 0 || (Slot->OutputMask & (uint64_t(1) << i)) != 0)
+                {
+                    OutputNames.push_back(Header->Outputs[i].Name);
+                    OutputIndices.push_back(i);
+                }
+            }
+
+            if (Error.empty())
+            {
+                std::vector<Ort::Value> Outputs = Session.Run(Ort::RunOptions{nullptr}, InputNames.data(), InputValues.data(), InputValues.size(),
+                                                              OutputNames.data(), OutputNames.size());
+
+                // 输入已经用完，输出从数据区起始位置写回，宿主在原地读取
+                InputValues.clear();
+                uint64_t Used = 0;
+                for (size_t i = 0; i < Outputs.size() && Error.empty(); ++i)
+                {
+                    if (!Outputs[i].IsTensor())
+                    {
+                        Error = std::string("output ") + OutputNames[i] + " is not a tensor";
+                        break;
+                    }
+                    Ort::TensorTypeAndShapeInfo Info = Outputs[i].GetTensorTypeAndShapeInfo();
+                    const std::vector<int64_t> Shape = Info.GetShape();
+                    FWorkerTensorDesc& Desc = Slot->Outputs[i];
+                    if (!AllocateWorkerTensor(Header->SlotDataBytes, Used, Info.GetElementType(), Shape.data(), static_cast<int32_t>(Shape.size()), Desc))
+                    {
+                        Error = std::string("output ") + OutputNames[i] + " does not fit into the worker slot";
+                        break;
+                    }
+                    Desc.Index = OutputIndices[i];
+                    std::memcpy(Data + Desc.Offset, Outputs[i].GetTensorRawData(), Desc.Bytes);
+                }
+                if (Error.empty())
+                {
+                    Slot->NumOutputs = static_cast<uint32_t>(Outputs.size());
+                }
+            }
+        }
+        catch (const Ort::Exception& e)
+        {
+            Error = e.what();
+        }
+
+        if (!Error.empty())
+        {
+            CopyWorkerString(Slot->Error, sizeof(Slot->Error), Error.c_str());
+        }
+        Slot->RunMs = (GetSeconds() - StartTime) * 1000.0;
+        Header->CompletedRequests.fetch_add(1, std::memory_order_relaxed);
+
+        const EWorkerSlotState Result = Error.empty() ? EWorkerSlotState::Done : EWorkerSlotState::Failed;
+        Slot->State.store(static_cast<uint32_t>(Result), std::memory_order_release);
+        WakeAll(Region, Slot->State);
+    }
+}
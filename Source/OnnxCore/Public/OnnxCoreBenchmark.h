@@ -0,0 +1,117 @@
+// OnnxCoreBenchmark.h
+
+#pragma once
+
+#include "OnnxCoreDefines.h"
+
+#include <functional>
+#include <map>
+
+namespace OnnxCore
+{
+	// 单调时钟（秒）
+	ONNXCORE_API double GetSeconds();
+
+	// 当前进程累计消耗的CPU时间（秒），不支持的平台返回-1
+	ONNXCORE_API double GetProcessCpuSeconds();
+
+	// 张量元素的字节大小，不支持的类型返回0
+	ONNXCORE_API size_t GetElementSize(ONNXTensorElementDataType Type);
+
+	// 延迟样本的分位数（Fraction为0~1，取最近的样本），没有样本时返回0
+	ONNXCORE_API double Percentile(std::vector<double> Values, double Fraction);
+
+	/**
+	 * 一组延迟样本（毫秒）的统计
+	 */
+	struct FLatencySummary
+	{
+		int64_t Count = 0;
+		double MeanMs = 0.0;
+		double P50Ms = 0.0;
+		double P90Ms = 0.0;
+		double P95Ms = 0.0;
+		double P99Ms = 0.0;
+		double MaxMs = 0.0;
+	};
+
+	ONNXCORE_API FLatencySummary SummarizeLatencies(std::vector<double> LatenciesMs);
+
+	/**
+	 * 一次Run的输入张量和要取回的输出名称
+	 */
+	struct ONNXCORE_API FInputSet
+	{
+		std::vector<std::string> InputNames;
+		std::vector<std::string> OutputNames;
+		std::vector<Ort::Value> InputValues;
+
+		// 按名称查找输入张量，找不到时返回nullptr
+		Ort::Value* FindInput(const char* Name);
+	};
+
+	/**
+	 * 合成输入的生成参数
+	 */
+	struct FSyntheticInputParams
+	{
+		// 动态维度（-1）的替换值
+		int64_t DynamicDimValue = 1;
+
+		// 按输入名称覆盖形状
+		std::map<std::string, std::vector<int64_t>> ShapeOverrides;
+
+		// 浮点输入随机数的种子
+		uint32_t Seed = 1234;
+	};
+
+	// 按会话的输入元数据生成合成输入（浮点为[0,1)随机数，整数为1，其他类型为0），失败时写入OutError
+	ONNXCORE_API bool MakeSyntheticInputs(Ort::Session& Session, const FSyntheticInputParams& Params, FInputSet& OutInputs, std::string& OutError);
+
+	// 用原始二进制文件（按输入的元素类型连续存放）替换一个输入张量的内容，文件大小必须与张量一致
+	ONNXCORE_API bool LoadInputData(FInputSet& Inputs, const std::string& Name, const std::string& FilePath, std::string& OutError);
+
+	/**
+	 * 基准测试参数
+	 */
+	struct FBenchmarkParams
+	{
+		// 预热次数（不计时）
+		int32_t WarmupIterations = 5;
+
+		// 计时次数
+		int32_t Iterations = 50;
+
+		// 两次请求之间的空闲间隔（秒），模拟交互式请求；自旋的CPU开销就体现在这段时间里
+		double IdleGapSeconds = 0.0;
+
+		// RunBenchmark读取CPU时间（秒）的方式，例如只统计会话自己的线程；为空时使用GetProcessCpuSeconds
+		std::function<double()> CpuClock;
+	};
+
+	/**
+	 * 基准测试结果
+	 */
+	struct FBenchmarkResult
+	{
+		bool bSucceeded = false;
+		std::string Error;
+
+		FLatencySummary Latency;
+
+		// 吞吐量（每秒Run次数，不含空闲间隔）
+		double RunsPerSecond = 0.0;
+
+		// 每次请求（Run加上之后的空闲间隔）消耗的CPU时间（毫秒），按CpuClock（默认为整个进程）计
+		double CpuMsPerRequest = 0.0;
+
+		// 空闲间隔中被消耗的CPU时间占比（自旋浪费的CPU），以单核百分比计
+		double IdleCpuPercent = 0.0;
+	};
+
+	// 在一个会话上顺序测试
+	ONNXCORE_API FBenchmarkResult RunBenchmark(Ort::Session& Session, FInputSet& Inputs, const FBenchmarkParams& Params);
+
+	// 每个会话一个线程同时运行（不含空闲间隔），RunsPerSecond为总吞吐量；Sessions可以重复同一个会话
+	ONNXCORE_API FBenchmarkResult RunConcurrentBenchmark(const std::vector<Ort::Session*>& Sessions, FInputSet& Inputs, const FBenchmarkParams& Params);
+}
@@ -0,0 +1,16 @@
+// OnnxCoreDefines.h
+
+#pragma once
+
+// OnnxCore是与引擎无关的推理核心，只依赖ONNX Runtime和C++标准库，不能包含任何UE头文件。
+// 作为UE模块编译时ONNXCORE_API由UBT定义；用CMakeLists.txt独立构建（Linux CI、OnnxPerf）时为空。
+#ifndef ONNXCORE_API
+#define ONNXCORE_API
+#endif
+
+// ORT的头文件不包含windows.h，这里不需要UE的Windows类型保护
+#include "onnxruntime_cxx_api.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
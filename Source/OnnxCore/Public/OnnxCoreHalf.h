@@ -0,0 +1,16 @@
+// OnnxCoreHalf.h
+
+#pragma once
+
+#include "OnnxCoreDefines.h"
+
+namespace OnnxCore
+{
+	// 当前CPU是否支持F16C（以及保存YMM寄存器所需的AVX/OSXSAVE），结果在首次调用时缓存
+	ONNXCORE_API bool IsF16CSupported();
+
+	// float32与float16（按uint16存储）之间的批量转换，Src与Dst不能重叠。
+	// 支持F16C时每次转换8个元素，否则逐元素使用Ort::Float16_t（舍入到最近偶数，与F16C一致）
+	ONNXCORE_API void ConvertToHalf(const float* Src, uint16_t* Dst, int64_t Count);
+	ONNXCORE_API void ConvertToFloat(const uint16_t* Src, float* Dst, int64_t Count);
+}
@@ -0,0 +1,41 @@
+// OnnxCoreSam2.h
+
+#pragma once
+
+#include "OnnxCoreDefines.h"
+
+namespace OnnxCore
+{
+	namespace Sam2
+	{
+		// 导出的SAM2编码器/解码器使用的正方形画布边长
+		constexpr int32_t ImageSize = 1024;
+
+		/**
+		 * 原图按比例缩放后居中放置到画布上的位置
+		 */
+		struct FLetterbox
+		{
+			float Scale = 1.0f;
+			int32_t XOffset = 0;
+			int32_t YOffset = 0;
+			int32_t ScaledWidth = 0;
+			int32_t ScaledHeight = 0;
+		};
+
+		ONNXCORE_API FLetterbox ComputeLetterbox(int32_t Width, int32_t Height);
+
+		// 将HWC的RGB图像（Width*Height*3个float，0~1）双线性缩放到画布上并按ImageNet参数标准化，
+		// 直接写入NCHW格式的OutPlanes（3*ImageSize*ImageSize个float），填充区域为标准化后的0
+		ONNXCORE_API void PreprocessImage(const float* Rgb, int32_t Width, int32_t Height, const FLetterbox& Letterbox, float* OutPlanes);
+
+		// 将相对坐标（0~1）转换为画布坐标
+		ONNXCORE_API void TransformPoint(float X, float Y, int32_t Width, int32_t Height, const FLetterbox& Letterbox, float& OutX, float& OutY);
+
+		// 原地应用sigmoid
+		ONNXCORE_API void ApplySigmoid(float* Data, int64_t Count);
+
+		// 将画布大小的掩码概率（ImageSize*ImageSize）按0.5二值化并用最近邻缩放回原图尺寸（Width*Height个字节，0或255）
+		ONNXCORE_API void PostprocessMask(const float* Mask, int32_t Width, int32_t Height, const FLetterbox& Letterbox, uint8_t* OutMask);
+	}
+}
@@ -0,0 +1,69 @@
+// OnnxCoreSessionConfig.h
+
+#pragma once
+
+#include "OnnxCoreDefines.h"
+
+namespace OnnxCore
+{
+	/**
+	 * ORT线程池在Run结束后的自旋策略（与EOnnxSpinMode一一对应）
+	 */
+	enum class ESpinMode : uint8_t
+	{
+		// 工作线程在Run之后继续自旋等待
+		Default,
+
+		// Run期间允许自旋，最后一个并发Run返回后立即停止（session.force_spinning_stop）
+		SpinThenStop,
+
+		// 空闲线程立即阻塞
+		NoSpin
+	};
+
+	// 用于日志和命令行参数的名称：default / stop / none
+	ONNXCORE_API const char* GetSpinModeName(ESpinMode Mode);
+	ONNXCORE_API bool ParseSpinMode(const std::string& Name, ESpinMode& OutMode);
+
+	/**
+	 * FSessionConfig
+	 * 会话选项中与引擎无关的部分：线程、执行模式、自旋策略和量化选项。
+	 * UE层的FOnnxSessionSettings解析全局配置后转换为它，执行提供程序由UE层单独追加。
+	 */
+	struct ONNXCORE_API FSessionConfig
+	{
+		// 算子内并行线程数（1表示不创建线程池）
+		int32_t IntraOpThreads = 1;
+
+		// 算子间并行线程数，仅在并行模式下生效，0表示由ORT决定
+		int32_t InterOpThreads = 0;
+
+		// 并行执行图中相互独立的分支
+		bool bParallel = false;
+
+		ESpinMode SpinMode = ESpinMode::Default;
+
+		// 逐线程亲和性（session.intra_op_thread_affinities），为空时不设置
+		std::string IntraOpThreadAffinities;
+
+		// 量化模型选项，含义见FOnnxQuantizationSettings
+		bool bDisableQDQFusion = false;
+		bool bEnableQDQCleanup = false;
+		bool bDisableDoubleQDQRemover = false;
+		bool bAvx2PrecisionMode = false;
+		int32_t MatMulNBitsAccuracyLevel = 0;
+
+		// 将配置应用到会话选项（只写入与ORT默认值不同的项）
+		void ApplyTo(Ort::SessionOptions& SessionOptions) const;
+
+		// 用于日志和报告的简短描述
+		std::string ToString() const;
+	};
+
+	// 按UTF-8路径创建会话（Windows上转换为宽字符路径），失败时抛出Ort::Exception
+	ONNXCORE_API Ort::Session CreateSession(Ort::Env& Env, const std::string& ModelPath, const FSessionConfig& Config);
+
+	// 定义了ORT_API_MANUAL_INIT时设置本模块的C++ API指针（每个二进制各有一份），宿主加载ORT后调用；
+	// 否则C++ API在静态初始化时已就绪，这里不做任何事
+	ONNXCORE_API void InitializeApi(const OrtApi* Api);
+}
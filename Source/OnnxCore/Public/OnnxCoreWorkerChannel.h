@@ -0,0 +1,219 @@
+// OnnxCoreWorkerChannel.h
+
+#pragma once
+
+#include "OnnxCoreDefines.h"
+
+#include <atomic>
+
+namespace OnnxCore
+{
+	// 工作进程通道：宿主进程创建的一块命名共享内存，布局为
+	//   FWorkerChannelHeader | FWorkerSlot[NumSlots] | 每个槽SlotDataBytes字节的张量数据区
+	// 宿主把输入张量直接写进槽的数据区，工作进程在原地把它们包装成Ort::Value运行，
+	// 输出写回同一个数据区，宿主再在原地读取。请求和结果都不经过序列化。
+
+	constexpr uint32_t WorkerChannelMagic = 0x4B574E4F; // "ONWK"
+	constexpr uint32_t WorkerChannelVersion = 2;
+	constexpr int32_t MaxWorkerTensors = 16;
+	constexpr int32_t MaxWorkerTensorDims = 8;
+	constexpr int32_t MaxWorkerNameLength = 128;
+	constexpr int32_t MaxWorkerErrorLength = 256;
+
+	// 槽数据区内每个张量的起始对齐（缓存行，也满足ORT对CPU张量的对齐要求）
+	constexpr uint64_t WorkerTensorAlignment = 64;
+
+	/**
+	 * 工作进程的状态（FWorkerChannelHeader::WorkerState）
+	 */
+	enum class EWorkerState : uint32_t
+	{
+		// 正在加载模型
+		Starting,
+
+		// 模型元数据已发布，可以提交请求
+		Ready,
+
+		// 加载失败，原因在FWorkerChannelHeader::Error中
+		Failed,
+
+		// 已退出（收到关闭请求或宿主进程不存在）
+		Exited
+	};
+
+	/**
+	 * 请求槽的状态：Free -> Writing（宿主占用并写入输入）-> Submitted -> Running（工作进程）-> Done/Failed -> Free
+	 */
+	enum class EWorkerSlotState : uint32_t
+	{
+		Free,
+		Writing,
+		Submitted,
+		Running,
+		Done,
+		Failed
+	};
+
+	/**
+	 * 槽数据区中的一个张量
+	 */
+	struct FWorkerTensorDesc
+	{
+		// 模型输入/输出的序号（对应FWorkerChannelHeader::Inputs/Outputs）
+		int32_t Index;
+		int32_t ElementType;
+		int32_t NumDims;
+		int32_t Padding;
+		int64_t Dims[MaxWorkerTensorDims];
+
+		// 相对槽数据区起始位置的偏移和字节数
+		uint64_t Offset;
+		uint64_t Bytes;
+	};
+
+	/**
+	 * 工作进程发布的模型输入/输出元数据（动态维度为-1）
+	 */
+	struct FWorkerNodeInfo
+	{
+		char Name[MaxWorkerNameLength];
+		int32_t ElementType;
+		int32_t NumDims;
+		int64_t Dims[MaxWorkerTensorDims];
+	};
+
+	struct alignas(64) FWorkerSlot
+	{
+		std::atomic<uint32_t> State;
+		uint32_t NumInputs;
+		uint32_t NumOutputs;
+		uint32_t Padding;
+
+		// 提交顺序，工作进程总是先处理最早提交的槽
+		uint64_t Sequence;
+
+		// 要计算的模型输出（按序号的位掩码），0表示全部
+		uint64_t OutputMask;
+
+		// 工作进程内Run的耗时
+		double RunMs;
+
+		FWorkerTensorDesc Inputs[MaxWorkerTensors];
+		FWorkerTensorDesc Outputs[MaxWorkerTensors];
+		char Error[MaxWorkerErrorLength];
+	};
+
+	struct alignas(64) FWorkerChannelHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t NumSlots;
+		uint32_t Padding;
+		uint64_t SlotDataBytes;
+		uint64_t TotalBytes;
+
+		// EWorkerState，变化时唤醒
+		std::atomic<uint32_t> WorkerState;
+
+		// 宿主请求工作进程退出
+		std::atomic<uint32_t> bShutdown;
+
+		// 每次提交加一并唤醒，空闲的工作进程在它上面等待
+		std::atomic<uint32_t> Doorbell;
+
+		// 正在WaitForChange中等待的线程数（Windows按它释放通道的信号量）
+		std::atomic<uint32_t> Waiters;
+
+		std::atomic<uint64_t> NextSequence;
+		std::atomic<uint64_t> CompletedRequests;
+
+		// 工作进程的进程ID和模型元数据（进入Ready之前写入）
+		int32_t WorkerPid;
+		int32_t NumInputs;
+		int32_t NumOutputs;
+		int32_t Padding3;
+		FWorkerNodeInfo Inputs[MaxWorkerTensors];
+		FWorkerNodeInfo Outputs[MaxWorkerTensors];
+		char Error[MaxWorkerErrorLength];
+	};
+
+	static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+				  "Worker channels require lock-free atomics in shared memory");
+
+	/**
+	 * FSharedMemoryRegion
+	 * 跨进程的命名共享内存（POSIX shm_open / Windows文件映射）。
+	 * 创建者关闭时删除名称（如果还没有Unlink），已经映射的进程不受影响。
+	 * Windows上同时创建/打开同名的信号量，供WaitForChange/WakeAll跨进程唤醒。
+	 */
+	class ONNXCORE_API FSharedMemoryRegion
+	{
+	public:
+		FSharedMemoryRegion() = default;
+		~FSharedMemoryRegion();
+
+		FSharedMemoryRegion(const FSharedMemoryRegion&) = delete;
+		FSharedMemoryRegion& operator=(const FSharedMemoryRegion&) = delete;
+
+		// Name只包含字母、数字和'-'，平台前缀（"/"、"Local\"）在内部添加。同名的旧区域被替换。
+		bool Create(const std::string& Name, uint64_t Bytes, std::string& OutError);
+		bool Open(const std::string& Name, std::string& OutError);
+		void Close();
+
+		// Windows上的唤醒信号量（其他平台为空）
+		void* GetWakeHandle() const;
+
+		// 创建者提前删除名称（对方已经映射之后调用），之后任何一方崩溃都不会在/dev/shm中留下残留
+		void Unlink();
+
+		bool IsOpen() const { return Data_ != nullptr; }
+		void* GetData() const { return Data_; }
+		uint64_t GetSize() const { return Size_; }
+		const std::string& GetName() const { return Name_; }
+
+	private:
+		std::string Name_;
+		void* Data_ = nullptr;
+		uint64_t Size_ = 0;
+		bool bOwner_ = false;
+#ifdef _WIN32
+		void* Mapping_ = nullptr;
+		void* WakeSemaphore_ = nullptr;
+#endif
+	};
+
+	// 通道的总字节数
+	ONNXCORE_API uint64_t GetWorkerChannelBytes(uint32_t NumSlots, uint64_t SlotDataBytes);
+
+	// 宿主：在新创建的区域上初始化通道（Memory至少GetWorkerChannelBytes字节）
+	ONNXCORE_API FWorkerChannelHeader* InitializeWorkerChannel(void* Memory, uint32_t NumSlots, uint64_t SlotDataBytes);
+
+	// 工作进程：检查打开的区域是同一版本的通道，失败时写入OutError
+	ONNXCORE_API FWorkerChannelHeader* ValidateWorkerChannel(void* Memory, uint64_t Bytes, std::string& OutError);
+
+	ONNXCORE_API FWorkerSlot* GetWorkerSlot(FWorkerChannelHeader* Header, uint32_t Index);
+	ONNXCORE_API uint8_t* GetWorkerSlotData(FWorkerChannelHeader* Header, uint32_t Index);
+
+	// 在槽数据区中按对齐为张量分配空间（InOutUsed为已用字节数），填写Desc；空间不足或类型不支持时返回false
+	ONNXCORE_API bool AllocateWorkerTensor(uint64_t SlotDataBytes, uint64_t& InOutUsed, ONNXTensorElementDataType Type,
+										   const int64_t* Dims, int32_t NumDims, FWorkerTensorDesc& OutDesc);
+
+	// 截断复制到固定长度的字符数组（总是以'\0'结尾）
+	ONNXCORE_API void CopyWorkerString(char* Dest, size_t Capacity, const char* Src);
+
+	// 通道中32位原子变量上的跨进程等待/唤醒，Region是Value所在的通道。
+	// Linux在Value上使用futex。Windows的WaitOnAddress只能唤醒同一进程内的线程，改为在通道的命名信号量上等待，
+	// WakeAll按FWorkerChannelHeader::Waiters释放信号量（同一通道中等待其他变量的线程也会醒来）。
+	// 其他平台退化为让出时间片和短暂休眠的轮询。Value不等于Expected、被唤醒或超时后返回，调用方需要重新检查条件。
+	ONNXCORE_API void WaitForChange(const FSharedMemoryRegion& Region, std::atomic<uint32_t>& Value, uint32_t Expected, int32_t TimeoutMs);
+	ONNXCORE_API void WakeAll(const FSharedMemoryRegion& Region, std::atomic<uint32_t>& Value);
+
+	// 工作进程：发布会话的输入/输出元数据
+	ONNXCORE_API bool PublishWorkerModel(Ort::Session& Session, FWorkerChannelHeader* Header, std::string& OutError);
+
+	// 工作进程：找到最早提交的槽并占用（Submitted -> Running），没有时返回-1
+	ONNXCORE_API int32_t AcquireSubmittedSlot(FWorkerChannelHeader* Header);
+
+	// 工作进程：运行一个已占用的槽，输入在原地包装，输出写回数据区，完成后设为Done或Failed并唤醒宿主
+	ONNXCORE_API void ProcessWorkerSlot(Ort::Session& Session, const FSharedMemoryRegion& Region, FWorkerChannelHeader* Header, int32_t SlotIndex);
+}
@@ -0,0 +1,435 @@
+// OnnxAutotuner.cpp
+
+#include "OnnxAutotuner.h"
+#include "OnnxNuma.h"
+#include "OnnxExecutionProviders.h"
+#include "HAL/PlatformMisc.h"
+#include "Misc/ConfigCacheIni.h"
+#include "Misc/DateTime.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+
+FCriticalSection FOnnxAutotuner::Mutex;
+
+namespace
+{
+    // 只保留字母数字，其余替换为下划线，用作文件名和ini段名
+    FString SanitizeKey(const FString& Key)
+    {
+        FString Result;
+        Result.Reserve(Key.Len());
+        for (TCHAR Char : Key.TrimStartAndEnd())
+        {
+            Result.AppendChar(FChar::IsAlnum(Char) ? Char : TEXT('_'));
+        }
+        return Result;
+    }
+
+    template <typename TEnum>
+    FString EnumToString(TEnum Value)
+    {
+        const UEnum* Enum = StaticEnum<TEnum>();
+        return Enum ? Enum->GetNameStringByValue(static_cast<int64>(Value)) : FString();
+    }
+
+    template <typename TEnum>
+    bool StringToEnum(const FString& Name, TEnum& OutValue)
+    {
+        const UEnum* Enum = StaticEnum<TEnum>();
+        const int64 Value = Enum ? Enum->GetValueByNameString(Name) : INDEX_NONE;
+        if (Value == INDEX_NONE)
+        {
+            return false;
+        }
+        OutValue = static_cast<TEnum>(Value);
+        return true;
+    }
+}
+
+TArray<int32> FOnnxAutotuneGrid::GetIntraOpCandidates() const
+{
+    if (IntraOpThreads.Num() > 0)
+    {
+        return IntraOpThreads;
+    }
+
+    const int32 PhysicalCores = FMath::Max(1, FPlatformMisc::NumberOfCores());
+
+    TArray<int32> Candidates;
+    for (int32 Threads = 1; Threads < PhysicalCores; Threads *= 2)
+    {
+        Candidates.Add(Threads);
+    }
+    Candidates.Add(PhysicalCores);
+    return Candidates;
+}
+
+FString FOnnxAutotuner::GetMachineKey()
+{
+    return SanitizeKey(FString::Printf(TEXT("%s_%dc%dt"), *FPlatformMisc::GetCPUBrand(),
+                                       FPlatformMisc::NumberOfCores(), FPlatformMisc::NumberOfCoresIncludingHyperthreads()));
+}
+
+FString FOnnxAutotuner::GetResultsFilePath()
+{
+    return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Onnx"), TEXT("Autotune"), GetMachineKey() + TEXT(".ini"));
+}
+
+FString FOnnxAutotuner::MakeModelKey(const FString& ModelName, const FString& ModelHash)
+{
+    return SanitizeKey(ModelHash.IsEmpty() ? ModelName : FString::Printf(TEXT("%s_%s"), *ModelName, *ModelHash));
+}
+
+bool FOnnxAutotuner::FindTunedSettings(const FString& ModelKey, FOnnxSessionSettings& InOutSettings)
+{
+    FScopeLock Lock(&Mutex);
+
+    const FString FilePath = GetResultsFilePath();
+    if (ModelKey.IsEmpty() || !FPaths::FileExists(FilePath))
+    {
+        return false;
+    }
+
+    FConfigFile ConfigFile;
+    ConfigFile.Read(FilePath);
+
+    int32 IntraOpThreads = 0;
+    if (!ConfigFile.GetInt(*ModelKey, TEXT("IntraOpThreads"), IntraOpThreads))
+    {
+        return false;
+    }
+
+    FOnnxSessionSettings Tuned = InOutSettings;
+    Tuned.IntraOpThreads = FMath::Max(1, IntraOpThreads);
+    ConfigFile.GetInt(*ModelKey, TEXT("InterOpThreads"), Tuned.InterOpThreads);
+    ConfigFile.GetInt(*ModelKey, TEXT("ReplicasPerNumaNode"), Tuned.ReplicasPerNumaNode);
+
+    FString EnumName;
+    if (ConfigFile.GetString(*ModelKey, TEXT("ExecutionMode"), EnumName))
+    {
+        StringToEnum(EnumName, Tuned.ExecutionMode);
+    }
+    if (ConfigFile.GetString(*ModelKey, TEXT("SpinMode"), EnumName))
+    {
+        StringToEnum(EnumName, Tuned.SpinMode);
+    }
+
+    InOutSettings = Tuned;
+    return true;
+}
+
+bool FOnnxAutotuner::SaveTunedSettings(const FString& ModelKey, const FOnnxSessionSettings& Settings, const FOnnxBenchmarkResult& Result)
+{
+    FScopeLock Lock(&Mutex);
+
+    const FString FilePath = GetResultsFilePath();
+
+    FConfigFile ConfigFile;
+    if (FPaths::FileExists(FilePath))
+    {
+        ConfigFile.Read(FilePath);
+    }
+
+    ConfigFile.SetString(TEXT("Machine"), TEXT("CPUBrand"), *FPlatformMisc::GetCPUBrand().TrimStartAndEnd());
+    ConfigFile.SetInt64(TEXT("Machine"), TEXT("PhysicalCores"), FPlatformMisc::NumberOfCores());
+    ConfigFile.SetInt64(TEXT("Machine"), TEXT("LogicalCores"), FPlatformMisc::NumberOfCoresIncludingHyperthreads());
+    ConfigFile.SetInt64(TEXT("Machine"), TEXT("NumaNodes"), FOnnxNumaTopology::Get().GetNumNodes());
+
+    ConfigFile.SetInt64(*ModelKey, TEXT("IntraOpThreads"), Settings.IntraOpThreads);
+    ConfigFile.SetInt64(*ModelKey, TEXT("InterOpThreads"), Settings.InterOpThreads);
+    ConfigFile.SetString(*ModelKey, TEXT("ExecutionMode"), *EnumToString(Settings.ExecutionMode));
+    ConfigFile.SetString(*ModelKey, TEXT("SpinMode"), *EnumToString(Settings.SpinMode));
+    ConfigFile.SetInt64(*ModelKey, TEXT("ReplicasPerNumaNode"), Settings.ReplicasPerNumaNode);
+    ConfigFile.SetString(*ModelKey, TEXT("MeanLatencyMs"), *FString::SanitizeFloat(Result.MeanLatencyMs));
+    ConfigFile.SetString(*ModelKey, TEXT("RunsPerSecond"), *FString::SanitizeFloat(Result.RunsPerSecond));
+    ConfigFile.SetString(*ModelKey, TEXT("TunedAt"), *FDateTime::UtcNow().ToIso8601());
+
+    if (!ConfigFile.Write(FilePath))
+    {
+        UE_LOG(LogTemp, Error, TEXT("Autotune: failed to write %s"), *FilePath);
+        return false;
+    }
+
+    UE_LOG(LogTemp, Log, TEXT("Autotune: saved [%s] %s to %s"), *ModelKey, *Settings.ToString(), *FilePath);
+    return true;
+}
+
+bool FOnnxAutotuner::FindSelectedProvider(const FString& ModelKey, EOnnxExecutionProvider& OutProvider)
+{
+    FScopeLock Lock(&Mutex);
+
+    const FString FilePath = GetResultsFilePath();
+    if (ModelKey.IsEmpty() || !FPaths::FileExists(FilePath))
+    {
+        return false;
+    }
+
+    FConfigFile ConfigFile;
+    ConfigFile.Read(FilePath);
+
+    FString ProviderName;
+    return ConfigFile.GetString(*ModelKey, TEXT("ExecutionProvider"), ProviderName) && StringToEnum(ProviderName, OutProvider);
+}
+
+bool FOnnxAutotuner::SaveSelectedProvider(const FString& ModelKey, EOnnxExecutionProvider Provider, const FOnnxBenchmarkResult& Result)
+{
+    if (ModelKey.IsEmpty())
+    {
+        return false;
+    }
+
+    FScopeLock Lock(&Mutex);
+
+    const FString FilePath = GetResultsFilePath();
+
+    FConfigFile ConfigFile;
+    if (FPaths::FileExists(FilePath))
+    {
+        ConfigFile.Read(FilePath);
+    }
+
+    ConfigFile.SetString(*ModelKey, TEXT("ExecutionProvider"), *EnumToString(Provider));
+    ConfigFile.SetString(*ModelKey, TEXT("ExecutionProviderMeanLatencyMs"), *FString::SanitizeFloat(Result.MeanLatencyMs));
+
+    if (!ConfigFile.Write(FilePath))
+    {
+        UE_LOG(LogTemp, Error, TEXT("Autotune: failed to write %s"), *FilePath);
+        return false;
+    }
+    return true;
+}
+
+bool FOnnxAutotuner::FindSelectedVariant(const FString& Key, EOnnxModelPrecision& OutPrecision)
+{
+    FScopeLock Lock(&Mutex);
+
+    const FString FilePath = GetResultsFilePath();
+    if (Key.IsEmpty() || !FPaths::FileExists(FilePath))
+    {
+        return false;
+    }
+
+    FConfigFile ConfigFile;
+    ConfigFile.Read(FilePath);
+
+    FString PrecisionName;
+    return ConfigFile.GetString(*Key, TEXT("Precision"), PrecisionName) && StringToEnum(PrecisionName, OutPrecision);
+}
+
+bool FOnnxAutotuner::SaveSelectedVariant(const FString& Key, const FOnnxVariantReport& Report)
+{
+    if (Key.IsEmpty())
+    {
+        return false;
+    }
+
+    FScopeLock Lock(&Mutex);
+
+    const FString FilePath = GetResultsFilePath();
+
+    FConfigFile ConfigFile;
+    if (FPaths::FileExists(FilePath))
+    {
+        ConfigFile.Read(FilePath);
+    }
+
+    ConfigFile.SetString(*Key, TEXT("Precision"), *EnumToString(Report.Precision));
+    ConfigFile.SetString(*Key, TEXT("Speedup"), *FString::SanitizeFloat(Report.Speedup));
+    ConfigFile.SetString(*Key, TEXT("MaxRelativeL2"), *FString::SanitizeFloat(Report.MaxRelativeL2));
+    ConfigFile.SetString(*Key, TEXT("ComparedAt"), *FDateTime::UtcNow().ToIso8601());
+
+    if (!ConfigFile.Write(FilePath))
+    {
+        UE_LOG(LogTemp, Error, TEXT("Autotune: failed to write %s"), *FilePath);
+        return false;
+    }
+    return true;
+}
+
+FOnnxAutotuneResult FOnnxAutotuner::Tune(const FOnnxSessionFactory& Factory, const FOnnxSessionSettings& BaseSettings,
+                                         const FOnnxAutotuneGrid& Grid, const FOnnxBenchmarkParams& Params, const FString& Label)
+{
+    FOnnxAutotuneResult Tuned;
+
+    // 单会话的延迟：线程数 x 执行模式
+    TArray<FOnnxSessionSettings> Configurations;
+    for (int32 IntraOpThreads : Grid.GetIntraOpCandidates())
+    {
+        for (EOnnxExecutionMode Mode : Grid.ExecutionModes)
+        {
+            FOnnxSessionSettings Settings = BaseSettings;
+            Settings.IntraOpThreads = FMath::Max(1, IntraOpThreads);
+            Settings.ExecutionMode = Mode;
+            Settings.ReplicasPerNumaNode = 0;
+            Settings.IntraOpThreadAffinities.Empty();
+
+            if (Mode == EOnnxExecutionMode::Parallel)
+            {
+                for (int32 InterOpThreads : Grid.InterOpThreads)
+                {
+                    Settings.InterOpThreads = InterOpThreads;
+                    Configurations.Add(Settings);
+                }
+            }
+            else
+            {
+                Settings.InterOpThreads = 0;
+                Configurations.Add(Settings);
+            }
+        }
+    }
+
+    UE_LOG(LogTemp, Log, TEXT("Autotune %s: testing %d configurations on %s"), *Label, Configurations.Num(), *GetMachineKey());
+
+    Tuned.Results = FOnnxBenchmark::RunConfigurations(Factory, Configurations, Params, Label);
+
+    const FOnnxBenchmarkResult* Best = nullptr;
+    for (const FOnnxBenchmarkResult& Result : Tuned.Results)
+    {
+        if (Result.bSucceeded && (!Best || Result.MeanLatencyMs < Best->MeanLatencyMs))
+        {
+            Best = &Result;
+        }
+    }
+
+    if (!Best)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Autotune %s: no configuration succeeded"), *Label);
+        return Tuned;
+    }
+
+    Tuned.bSucceeded = true;
+    Tuned.BestResult = *Best;
+    Tuned.BestSettings = Best->Settings;
+    Tuned.BestSettings.ReplicasPerNumaNode = BaseSettings.ReplicasPerNumaNode;
+    Tuned.BestSettings.IntraOpThreadAffinities = BaseSettings.IntraOpThreadAffinities;
+
+    // 副本数：按并发吞吐量评估，每个副本分到节点CPU的一部分
+    if (Grid.ReplicasPerNumaNode.Num() > 0)
+    {
+        const FOnnxNumaTopology& Topology = FOnnxNumaTopology::Get();
+        const int32 NodeCpus = Topology.GetNodes()[0].Cpus.Num();
+
+        float BestThroughput = Best->RunsPerSecond;
+        Tuned.BestSettings.ReplicasPerNumaNode = 0;
+
+        for (int32 Replicas : Grid.ReplicasPerNumaNode)
+        {
+            if (Replicas <= 0)
+            {
+                continue;
+            }
+
+            FOnnxSessionSettings Settings = Best->Settings;
+            Settings.IntraOpThreads = FMath::Max(1, NodeCpus / Replicas);
+            Settings.ReplicasPerNumaNode = Replicas;
+
+            TArray<TUniquePtr<Ort::Session>> Sessions;
+            TArray<Ort::Session*> SessionPtrs;
+            for (int32 i = 0; i < Replicas * Topology.GetNumNodes(); ++i)
+            {
+                TUniquePtr<Ort::Session> Session = Factory(Settings);
+                if (!Session)
+                {
+                    break;
+                }
+                SessionPtrs.Add(Session.Get());
+                Sessions.Add(MoveTemp(Session));
+            }
+            if (Sessions.Num() != Replicas * Topology.GetNumNodes())
+            {
+                continue;
+            }
+
+            FOnnxBenchmarkResult Result = FOnnxBenchmark::RunConcurrent(SessionPtrs, Params,
+                FString::Printf(TEXT("%s [%s]"), *Label, *Settings.ToString()));
+            Result.Settings = Settings;
+            Tuned.Results.Add(Result);
+            UE_LOG(LogTemp, Log, TEXT("Autotune %s"), *Result.ToString());
+
+            if (Result.bSucceeded && Result.RunsPerSecond > BestThroughput * Grid.MinReplicaSpeedup)
+            {
+                BestThroughput = Result.RunsPerSecond;
+                Tuned.BestSettings = Settings;
+                Tuned.BestSettings.IntraOpThreadAffinities.Empty();
+            }
+        }
+    }
+
+    UE_LOG(LogTemp, Log, TEXT("Autotune %s: best configuration %s (mean %.2fms)"), *Label, *Tuned.BestSettings.ToString(), Best->MeanLatencyMs);
+    return Tuned;
+}
+
+FOnnxAutotuneResult FOnnxAutotuner::TuneAndSave(const FOnnxSessionFactory& Factory, const FOnnxSessionSettings& BaseSettings,
+                                                const FOnnxAutotuneGrid& Grid, const FOnnxBenchmarkParams& Params, const FString& ModelKey)
+{
+    FOnnxAutotuneResult Tuned = Tune(Factory, BaseSettings, Grid, Params, ModelKey);
+    if (Tuned.bSucceeded)
+    {
+        SaveTunedSettings(ModelKey, Tuned.BestSettings, Tuned.BestResult);
+    }
+    return Tuned;
+}
+
+FOnnxSessionSettings FOnnxAutotuner::ResolveCachedSettings(const FString& ModelKey, const FOnnxSessionSettings& Settings, bool& bOutNeedsTuning)
+{
+    bool bNeedsBenchmark = false;
+    FOnnxSessionSettings Resolved = FOnnxExecutionProviders::SelectCachedProvider(ModelKey, Settings, bNeedsBenchmark);
+    bOutNeedsTuning = bNeedsBenchmark;
+
+    if (Settings.AutotuneMode == EOnnxAutotuneMode::Off || ModelKey.IsEmpty())
+    {
+        return Resolved;
+    }
+
+    if (FindTunedSettings(ModelKey, Resolved))
+    {
+        UE_LOG(LogTemp, Log, TEXT("Autotune: applying tuned settings for %s (%s)"), *ModelKey, *Resolved.ToString());
+    }
+    else if (Settings.AutotuneMode == EOnnxAutotuneMode::TuneOnFirstLaunch)
+    {
+        bOutNeedsTuning = true;
+    }
+    return Resolved;
+}
+
+FOnnxSessionSettings FOnnxAutotuner::ResolveSettings(const FString& ModelKey, const FOnnxSessionSettings& Settings,
+                                                     const FOnnxSessionFactory& Factory, const FOnnxBenchmarkParams& Params)
+{
+    // 线程调优在选定的执行提供程序上进行
+    const FOnnxSessionSettings BaseSettings = FOnnxExecutionProviders::SelectProvider(ModelKey, Settings, Factory, Params);
+
+    if (Settings.AutotuneMode == EOnnxAutotuneMode::Off || ModelKey.IsEmpty())
+    {
+        return BaseSettings;
+    }
+
+    FOnnxSessionSettings Resolved = BaseSettings;
+    if (FindTunedSettings(ModelKey, Resolved))
+    {
+        UE_LOG(LogTemp, Log, TEXT("Autotune: applying tuned settings for %s (%s)"), *ModelKey, *Resolved.ToString());
+        return Resolved;
+    }
+
+    if (Settings.AutotuneMode == EOnnxAutotuneMode::TuneOnFirstLaunch)
+    {
+        UE_LOG(LogTemp, Log, TEXT("Autotune: no tuned settings for %s on this machine, tuning now"), *ModelKey);
+
+        FOnnxAutotuneResult Tuned = TuneAndSave(Factory, BaseSettings, FOnnxAutotuneGrid(), Params, ModelKey);
+        if (Tuned.bSucceeded)
+        {
+            return Tuned.BestSettings;
+        }
+    }
+
+    return BaseSettings;
+}
+
+FOnnxBenchmarkParams FOnnxAutotuner::MakeDefaultParams()
+{
+    FOnnxBenchmarkParams Params;
+    Params.WarmupIterations = 3;
+    Params.Iterations = 20;
+    Params.IdleGapSeconds = 0.0;
+    return Params;
+}
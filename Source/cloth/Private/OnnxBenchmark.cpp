@@ -0,0 +1,295 @@
+// OnnxBenchmark.cpp
+
+#include "OnnxBenchmark.h"
+#include "OnnxRuntime.h"
+#include "Async/ParallelFor.h"
+#include "HAL/PlatformTime.h"
+
+#include <atomic>
+
+namespace
+{
+    // 会话的CPU时钟：调用线程加上创建会话时新建的ORT工作线程（编号在[FirstThread, EndThread)内）。
+    // 线程统计不可用时返回空，由调用方回退到进程CPU时间
+    TFunction<double()> MakeSessionCpuClock(const FOnnxSessionSettings& Settings, int32 FirstThread, int32 EndThread)
+    {
+        FOnnxRuntime& Runtime = FOnnxRuntime::Get();
+
+        // 其他EP有自己的线程池，不经过插件的线程钩子
+        if (!Runtime.IsAvailable() || Settings.ExecutionProvider != EOnnxExecutionProvider::CPU)
+        {
+            return nullptr;
+        }
+
+        // 全局线程池由所有会话共用，只能统计整个线程池
+        if (Runtime.GetThreadingSettings().bUseGlobalThreadPools)
+        {
+            FirstThread = 0;
+            EndThread = MAX_int32;
+        }
+        // 会话需要线程池却没有经由钩子创建线程（亲和性无法用掩码表示时不使用钩子）
+        else if (EndThread == FirstThread && Settings.IntraOpThreads != 1)
+        {
+            return nullptr;
+        }
+
+        if (FOnnxRuntime::GetCurrentThreadCpuSeconds() < 0.0 || Runtime.GetWorkerCpuSeconds(FirstThread, EndThread) < 0.0)
+        {
+            return nullptr;
+        }
+
+        return [&Runtime, FirstThread, EndThread]()
+        {
+            return FOnnxRuntime::GetCurrentThreadCpuSeconds() + Runtime.GetWorkerCpuSeconds(FirstThread, EndThread);
+        };
+    }
+}
+
+size_t FOnnxBenchmark::GetElementSize(ONNXTensorElementDataType Type)
+{
+    return OnnxCore::GetElementSize(Type);
+}
+
+float FOnnxBenchmark::Percentile(TArray<double> Values, double Fraction)
+{
+    return static_cast<float>(OnnxCore::Percentile(std::vector<double>(Values.GetData(), Values.GetData() + Values.Num()), Fraction));
+}
+
+FString FOnnxBenchmarkResult::ToString() const
+{
+    if (!bSucceeded)
+    {
+        return FString::Printf(TEXT("%s: FAILED"), *Label);
+    }
+    return FString::Printf(TEXT("%s: mean=%.2fms p50=%.2fms p95=%.2fms runs/s=%.1f cpu/request=%.2fms idle-cpu=%.1f%%%s"),
+                           *Label, MeanLatencyMs, P50LatencyMs, P95LatencyMs, RunsPerSecond, CpuMsPerRequest, IdleCpuPercent,
+                           bPerThreadCpu ? TEXT("") : TEXT(" (process cpu)"));
+}
+
+double FOnnxBenchmark::GetProcessCpuSeconds()
+{
+    return OnnxCore::GetProcessCpuSeconds();
+}
+
+bool FOnnxBenchmark::MakeSyntheticInputs(Ort::Session& Session, const FOnnxBenchmarkParams& Params, FOnnxBenchmarkInputs& OutInputs)
+{
+    OnnxCore::FSyntheticInputParams CoreParams;
+    CoreParams.DynamicDimValue = Params.DynamicDimValue;
+    for (const TPair<FString, TArray<int64>>& Override : Params.ShapeOverrides)
+    {
+        CoreParams.ShapeOverrides[TCHAR_TO_UTF8(*Override.Key)] = std::vector<int64_t>(Override.Value.GetData(), Override.Value.GetData() + Override.Value.Num());
+    }
+
+    std::string Error;
+    if (!OnnxCore::MakeSyntheticInputs(Session, CoreParams, OutInputs, Error))
+    {
+        UE_LOG(LogTemp, Error, TEXT("Benchmark: %s"), UTF8_TO_TCHAR(Error.c_str()));
+        return false;
+    }
+
+    if (Params.InputCustomizer)
+    {
+        Params.InputCustomizer(OutInputs);
+    }
+    return true;
+}
+
+FOnnxBenchmarkResult FOnnxBenchmark::RunSession(Ort::Session& Session, const FOnnxBenchmarkParams& Params, const FString& Label,
+                                                TFunction<double()> CpuClock)
+{
+    FOnnxBenchmarkResult Result;
+    Result.Label = Label;
+
+    FOnnxBenchmarkInputs Inputs;
+    if (!MakeSyntheticInputs(Session, Params, Inputs))
+    {
+        return Result;
+    }
+
+    OnnxCore::FBenchmarkParams CoreParams;
+    CoreParams.WarmupIterations = Params.WarmupIterations;
+    CoreParams.Iterations = Params.Iterations;
+    CoreParams.IdleGapSeconds = Params.IdleGapSeconds;
+    if (CpuClock)
+    {
+        CoreParams.CpuClock = [&CpuClock]() { return CpuClock(); };
+    }
+
+    const OnnxCore::FBenchmarkResult CoreResult = OnnxCore::RunBenchmark(Session, Inputs, CoreParams);
+    if (!CoreResult.bSucceeded)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Benchmark %s failed: %s"), *Label, UTF8_TO_TCHAR(CoreResult.Error.c_str()));
+        return Result;
+    }
+
+    Result.Iterations = Params.Iterations;
+    Result.MeanLatencyMs = static_cast<float>(CoreResult.Latency.MeanMs);
+    Result.P50LatencyMs = static_cast<float>(CoreResult.Latency.P50Ms);
+    Result.P95LatencyMs = static_cast<float>(CoreResult.Latency.P95Ms);
+    Result.RunsPerSecond = static_cast<float>(CoreResult.RunsPerSecond);
+    Result.CpuMsPerRequest = static_cast<float>(CoreResult.CpuMsPerRequest);
+    Result.IdleCpuPercent = static_cast<float>(CoreResult.IdleCpuPercent);
+    Result.bPerThreadCpu = static_cast<bool>(CpuClock);
+    Result.bSucceeded = true;
+    return Result;
+}
+
+FOnnxBenchmarkResult FOnnxBenchmark::RunConcurrent(const TArray<Ort::Session*>& Sessions, const FOnnxBenchmarkParams& Params, const FString& Label)
+{
+    FOnnxBenchmarkResult Result;
+    Result.Label = Label;
+
+    if (Sessions.Num() == 0)
+    {
+        return Result;
+    }
+
+    TArray<FOnnxBenchmarkInputs> Inputs;
+    Inputs.SetNum(Sessions.Num());
+    for (int32 i = 0; i < Sessions.Num(); ++i)
+    {
+        if (!MakeSyntheticInputs(*Sessions[i], Params, Inputs[i]))
+        {
+            return Result;
+        }
+    }
+
+    TArray<TArray<double>> LatenciesPerSession;
+    LatenciesPerSession.SetNum(Sessions.Num());
+    std::atomic<bool> bFailed(false);
+
+    const double CpuStart = GetProcessCpuSeconds();
+    const double WallStart = FPlatformTime::Seconds();
+
+    // 每个会话一个任务；Unbalanced保证各会话真正并发而不是被合并到同一个工作线程
+    ParallelFor(Sessions.Num(), [&](int32 Index)
+    {
+        FOnnxBenchmarkInputs& SessionInputs = Inputs[Index];
+        std::vector<const char*> inputNames;
+        std::vector<const char*> outputNames;
+        for (const std::string& Name : SessionInputs.InputNames)
+        {
+            inputNames.push_back(Name.c_str());
+        }
+        for (const std::string& Name : SessionInputs.OutputNames)
+        {
+            outputNames.push_back(Name.c_str());
+        }
+
+        try
+        {
+            Ort::RunOptions runOptions{nullptr};
+            for (int32 i = 0; i < Params.WarmupIterations + Params.Iterations; ++i)
+            {
+                const double RunBegin = FPlatformTime::Seconds();
+                Sessions[Index]->Run(runOptions, inputNames.data(), SessionInputs.InputValues.data(), inputNames.size(),
+                                     outputNames.data(), outputNames.size());
+                if (i >= Params.WarmupIterations)
+                {
+                    LatenciesPerSession[Index].Add((FPlatformTime::Seconds() - RunBegin) * 1000.0);
+                }
+            }
+        }
+        catch (const Ort::Exception& e)
+        {
+            UE_LOG(LogTemp, Error, TEXT("Benchmark %s failed: %s"), *Label, UTF8_TO_TCHAR(e.what()));
+            bFailed = true;
+        }
+    }, EParallelForFlags::Unbalanced);
+
+    const double WallSeconds = FPlatformTime::Seconds() - WallStart;
+    const double CpuTotal = GetProcessCpuSeconds() - CpuStart;
+
+    if (bFailed)
+    {
+        return Result;
+    }
+
+    TArray<double> LatenciesMs;
+    double SumMs = 0.0;
+    for (const TArray<double>& SessionLatencies : LatenciesPerSession)
+    {
+        for (double Latency : SessionLatencies)
+        {
+            LatenciesMs.Add(Latency);
+            SumMs += Latency;
+        }
+    }
+
+    // 墙钟时间包含了预热，吞吐量按全部Run计算
+    const int32 TotalRuns = Sessions.Num() * (Params.WarmupIterations + Params.Iterations);
+    Result.Iterations = LatenciesMs.Num();
+    Result.MeanLatencyMs = LatenciesMs.Num() > 0 ? static_cast<float>(SumMs / LatenciesMs.Num()) : 0.0f;
+    Result.P50LatencyMs = Percentile(LatenciesMs, 0.5);
+    Result.P95LatencyMs = Percentile(LatenciesMs, 0.95);
+    Result.RunsPerSecond = WallSeconds > 0.0 ? static_cast<float>(TotalRuns / WallSeconds) : 0.0f;
+    Result.CpuMsPerRequest = TotalRuns > 0 ? static_cast<float>(CpuTotal * 1000.0 / TotalRuns) : 0.0f;
+    Result.bSucceeded = true;
+    return Result;
+}
+
+TArray<FOnnxBenchmarkResult> FOnnxBenchmark::RunConfigurations(const FOnnxSessionFactory& Factory, const TArray<FOnnxSessionSettings>& Configurations,
+                                                               const FOnnxBenchmarkParams& Params, const FString& LabelPrefix)
+{
+    TArray<FOnnxBenchmarkResult> Results;
+    if (!FOnnxRuntime::Get().IsAvailable())
+    {
+        UE_LOG(LogTemp, Error, TEXT("Cannot run the benchmark: ONNX Runtime is not available"));
+        return Results;
+    }
+
+    for (const FOnnxSessionSettings& Settings : Configurations)
+    {
+        const FString Label = LabelPrefix.IsEmpty() ? Settings.ToString() : FString::Printf(TEXT("%s [%s]"), *LabelPrefix, *Settings.ToString());
+
+        // 会话的线程池在创建时启动线程；同时在其他线程上创建的会话的线程也会落在这个区间内
+        FOnnxRuntime& Runtime = FOnnxRuntime::Get();
+        const int32 FirstThread = Runtime.GetNextWorkerThreadIndex();
+        TUniquePtr<Ort::Session> Session = Factory(Settings);
+        const int32 EndThread = Runtime.GetNextWorkerThreadIndex();
+        if (!Session)
+        {
+            FOnnxBenchmarkResult Failed;
+            Failed.Label = Label;
+            Failed.Settings = Settings;
+            Results.Add(Failed);
+            continue;
+        }
+
+        FOnnxBenchmarkResult Result = RunSession(*Session, Params, Label, MakeSessionCpuClock(Settings, FirstThread, EndThread));
+        Result.Settings = Settings;
+        Results.Add(Result);
+
+        UE_LOG(LogTemp, Log, TEXT("Benchmark %s"), *Result.ToString());
+    }
+
+    return Results;
+}
+
+TArray<FOnnxBenchmarkResult> FOnnxBenchmark::BenchmarkSpinModes(const FOnnxSessionFactory& Factory, const FOnnxSessionSettings& BaseSettings,
+                                                                const FOnnxBenchmarkParams& Params, const FString& LabelPrefix)
+{
+    TArray<FOnnxSessionSettings> Configurations;
+    for (EOnnxSpinMode Mode : {EOnnxSpinMode::Default, EOnnxSpinMode::SpinThenStop, EOnnxSpinMode::NoSpin})
+    {
+        FOnnxSessionSettings Settings = BaseSettings;
+        Settings.SpinMode = Mode;
+        Configurations.Add(Settings);
+    }
+
+    if (BaseSettings.IntraOpThreads <= 1)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Spin benchmark with IntraOpThreads=1: no thread pool is created, all spin modes will behave the same"));
+    }
+
+    return RunConfigurations(Factory, Configurations, Params, LabelPrefix);
+}
+
+void FOnnxBenchmark::LogResults(const TArray<FOnnxBenchmarkResult>& Results)
+{
+    UE_LOG(LogTemp, Log, TEXT("=== ONNX benchmark results (%d configurations) ==="), Results.Num());
+    for (const FOnnxBenchmarkResult& Result : Results)
+    {
+        UE_LOG(LogTemp, Log, TEXT("%s"), *Result.ToString());
+    }
+}
@@ -0,0 +1,774 @@
+// OnnxCapture.cpp
+
+#include "OnnxCapture.h"
+#include "OnnxBenchmark.h"
+#include "OnnxHalf.h"
+#include "OnnxModelAsset.h"
+#include "OnnxModelInstance.h"
+#include "OnnxScratch.h"
+#include "Async/MappedFileHandle.h"
+#include "HAL/PlatformFileManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/DateTime.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+
+#include <string>
+#include <vector>
+
+namespace
+{
+    // 文件头："ONNXCAP1" + 版本 + 模型表，之后是按64字节对齐的记录
+    const char FileMagic[8] = {'O', 'N', 'N', 'X', 'C', 'A', 'P', '1'};
+    constexpr uint32 FileVersion = 1;
+    constexpr uint32 RecordMagic = 0x44524352; // "RCRD"
+    constexpr int64 DataAlignment = 64;
+
+    enum ECaptureRecordFlags : uint32
+    {
+        RecordFlag_Succeeded = 1 << 0
+    };
+
+    // 记录头，后面依次是每个输入的FTensorHeader + 形状 + 名称（8字节对齐），然后是64字节对齐的数据块
+    struct FRecordHeader
+    {
+        uint32 Magic;
+        uint32 NumInputs;
+        int32 ModelIndex;
+        uint32 Flags;
+        double TimestampSeconds;
+        double LatencyMs;
+        uint64 RecordBytes;
+    };
+    static_assert(sizeof(FRecordHeader) == 40, "Capture record header layout changed");
+
+    struct FTensorHeader
+    {
+        int32 Type;
+        uint32 NumDims;
+        uint32 NameBytes;
+        uint32 Reserved;
+
+        // 数据相对记录起点的偏移
+        uint64 DataOffset;
+        uint64 DataBytes;
+    };
+    static_assert(sizeof(FTensorHeader) == 32, "Capture tensor header layout changed");
+
+    const uint8 ZeroPadding[DataAlignment] = {};
+
+    template <typename T>
+    void WritePod(TArray<uint8>& Buffer, const T& Value)
+    {
+        Buffer.Append(reinterpret_cast<const uint8*>(&Value), sizeof(T));
+    }
+
+    void PadTo(TArray<uint8>& Buffer, int64 Alignment)
+    {
+        Buffer.AddZeroed(Align(Buffer.Num(), Alignment) - Buffer.Num());
+    }
+
+    // 长度 + UTF-8字节 + 结尾的0
+    void WriteString(TArray<uint8>& Buffer, const FString& Value)
+    {
+        FTCHARToUTF8 utf8(*Value);
+        WritePod(Buffer, static_cast<uint32>(utf8.Length()));
+        Buffer.Append(reinterpret_cast<const uint8*>(utf8.Get()), utf8.Length());
+        Buffer.Add(0);
+    }
+
+    int64 GetNameBytes(const char* Name)
+    {
+        return Align(static_cast<int64>(FCStringAnsi::Strlen(Name)) + 1, 8);
+    }
+
+    /**
+     * 映射内存上的顺序读取，越界时返回false
+     */
+    struct FCaptureCursor
+    {
+        const uint8* Data;
+        int64 Size;
+        int64 Pos = 0;
+
+        template <typename T>
+        bool Read(T& OutValue)
+        {
+            if (Pos + static_cast<int64>(sizeof(T)) > Size)
+            {
+                return false;
+            }
+            FMemory::Memcpy(&OutValue, Data + Pos, sizeof(T));
+            Pos += sizeof(T);
+            return true;
+        }
+
+        bool ReadString(FString& OutValue)
+        {
+            uint32 length = 0;
+            if (!Read(length) || Pos + static_cast<int64>(length) + 1 > Size || Data[Pos + length] != 0)
+            {
+                return false;
+            }
+            OutValue = UTF8_TO_TCHAR(reinterpret_cast<const ANSICHAR*>(Data + Pos));
+            Pos += length + 1;
+            return true;
+        }
+    };
+
+    FString ExportSettings(const FOnnxSessionSettings& Settings)
+    {
+        FString text;
+        FOnnxSessionSettings::StaticStruct()->ExportText(text, &Settings, nullptr, nullptr, PPF_None, nullptr);
+        return text;
+    }
+
+    bool ImportSettings(const FString& Text, FOnnxSessionSettings& OutSettings)
+    {
+        UScriptStruct* settingsStruct = FOnnxSessionSettings::StaticStruct();
+        return settingsStruct->ImportText(*Text, &OutSettings, nullptr, PPF_None, GLog, settingsStruct->GetName()) != nullptr;
+    }
+}
+
+FString FOnnxReplayResult::ToString() const
+{
+    return FString::Printf(TEXT("%s (%s): runs=%d failed=%d mean=%.2fms p50=%.2fms p90=%.2fms p99=%.2fms max=%.2fms | recorded mean=%.2fms p50=%.2fms p99=%.2fms"),
+                           *Role, *FPaths::GetCleanFilename(Source), NumRuns, NumFailed, MeanLatencyMs, P50LatencyMs, P90LatencyMs,
+                           P99LatencyMs, MaxLatencyMs, RecordedMeanLatencyMs, RecordedP50LatencyMs, RecordedP99LatencyMs);
+}
+
+FOnnxCaptureWriter::~FOnnxCaptureWriter()
+{
+    Close();
+}
+
+FString FOnnxCaptureWriter::ResolvePath(const FString& FilePath, const FString& BaseName)
+{
+    const FString captureDir = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Onnx"), TEXT("Captures"));
+    if (FilePath.IsEmpty())
+    {
+        const FString safeName = FPaths::MakeValidFileName(BaseName.IsEmpty() ? FString(TEXT("Capture")) : BaseName, TEXT('_'));
+        return FPaths::Combine(captureDir, FString::Printf(TEXT("%s_%s.onnxcap"), *safeName, *FDateTime::Now().ToString()));
+    }
+    return FPaths::IsRelative(FilePath) ? FPaths::Combine(captureDir, FilePath) : FilePath;
+}
+
+bool FOnnxCaptureWriter::Open(const FString& FilePath, const TArray<FOnnxCaptureModel>& Models, const FOnnxCaptureConfig& InConfig)
+{
+    Close();
+
+    FScopeLock Lock(&mutex_);
+
+    IPlatformFile& platformFile = FPlatformFileManager::Get().GetPlatformFile();
+    platformFile.CreateDirectoryTree(*FPaths::GetPath(FilePath));
+    file_ = platformFile.OpenWrite(*FilePath);
+    if (!file_)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to create ONNX capture file: %s"), *FilePath);
+        return false;
+    }
+
+    TArray<uint8> header;
+    header.Append(reinterpret_cast<const uint8*>(FileMagic), sizeof(FileMagic));
+    WritePod(header, FileVersion);
+    WritePod(header, static_cast<uint32>(Models.Num()));
+    for (const FOnnxCaptureModel& model : Models)
+    {
+        WriteString(header, model.Role);
+        WriteString(header, model.Source);
+        WritePod(header, static_cast<uint32>(model.bSourceIsAsset ? 1 : 0));
+        WriteString(header, ExportSettings(model.Settings));
+        WritePod(header, static_cast<uint32>(model.OutputNames.Num()));
+        for (const FString& outputName : model.OutputNames)
+        {
+            WriteString(header, outputName);
+        }
+    }
+    PadTo(header, DataAlignment);
+
+    if (!file_->Write(header.GetData(), header.Num()))
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to write ONNX capture header: %s"), *FilePath);
+        delete file_;
+        file_ = nullptr;
+        return false;
+    }
+
+    filePath_ = FilePath;
+    config_ = InConfig;
+    startTime_ = FPlatformTime::Seconds();
+    numRecords_ = 0;
+    numBytes_ = header.Num();
+    bOpen_ = true;
+
+    UE_LOG(LogTemp, Log, TEXT("ONNX capture started: %s (sample rate %.2f, max %d records / %d MB)"),
+           *FilePath, InConfig.SampleRate, InConfig.MaxRecords, InConfig.MaxFileMB);
+    return true;
+}
+
+void FOnnxCaptureWriter::Close()
+{
+    FScopeLock Lock(&mutex_);
+    bOpen_ = false;
+    if (file_)
+    {
+        file_->Flush();
+        delete file_;
+        file_ = nullptr;
+        UE_LOG(LogTemp, Log, TEXT("ONNX capture finished: %s (%d records, %.1f MB)"),
+               *filePath_, numRecords_.load(), numBytes_.load() / (1024.0 * 1024.0));
+    }
+}
+
+FString FOnnxCaptureWriter::GetFilePath() const
+{
+    FScopeLock Lock(&mutex_);
+    return filePath_;
+}
+
+bool FOnnxCaptureWriter::ShouldSample()
+{
+    if (!bOpen_)
+    {
+        return false;
+    }
+    if (numRecords_ >= config_.MaxRecords || numBytes_ >= static_cast<int64>(config_.MaxFileMB) * 1024 * 1024)
+    {
+        return false;
+    }
+    return config_.SampleRate >= 1.0f || FMath::FRand() < config_.SampleRate;
+}
+
+void FOnnxCaptureWriter::Append(int32 ModelIndex, TConstArrayView<FOnnxCaptureTensorView> Inputs, double LatencyMs, bool bSucceeded)
+{
+    // 录制本身的分配不属于请求
+    FOnnxAllocationCounter::FUntrackedScope untracked;
+
+    // 先计算描述部分的大小，数据块从其后的64字节边界开始
+    int64 descriptorBytes = sizeof(FRecordHeader);
+    for (const FOnnxCaptureTensorView& input : Inputs)
+    {
+        descriptorBytes += sizeof(FTensorHeader) + input.Shape.Num() * sizeof(int64) + GetNameBytes(input.Name);
+    }
+
+    int64 dataOffset = Align(descriptorBytes, DataAlignment);
+    TArray<uint8> descriptor;
+    descriptor.Reserve(dataOffset);
+
+    FRecordHeader header;
+    header.Magic = RecordMagic;
+    header.NumInputs = Inputs.Num();
+    header.ModelIndex = ModelIndex;
+    header.Flags = bSucceeded ? RecordFlag_Succeeded : 0;
+    header.TimestampSeconds = FPlatformTime::Seconds() - startTime_;
+    header.LatencyMs = LatencyMs;
+    header.RecordBytes = 0;
+    WritePod(descriptor, header);
+
+    for (const FOnnxCaptureTensorView& input : Inputs)
+    {
+        FTensorHeader tensorHeader;
+        tensorHeader.Type = static_cast<int32>(input.Type);
+        tensorHeader.NumDims = input.Shape.Num();
+        tensorHeader.NameBytes = GetNameBytes(input.Name);
+        tensorHeader.Reserved = 0;
+        tensorHeader.DataOffset = dataOffset;
+        tensorHeader.DataBytes = input.NumBytes;
+        WritePod(descriptor, tensorHeader);
+
+        descriptor.Append(reinterpret_cast<const uint8*>(input.Shape.GetData()), input.Shape.Num() * sizeof(int64));
+        const int32 nameStart = descriptor.Num();
+        descriptor.Append(reinterpret_cast<const uint8*>(input.Name), FCStringAnsi::Strlen(input.Name));
+        descriptor.AddZeroed(nameStart + tensorHeader.NameBytes - descriptor.Num());
+
+        dataOffset += Align(input.NumBytes, DataAlignment);
+    }
+    PadTo(descriptor, DataAlignment);
+
+    const uint64 recordBytes = dataOffset;
+    FMemory::Memcpy(descriptor.GetData() + STRUCT_OFFSET(FRecordHeader, RecordBytes), &recordBytes, sizeof(recordBytes));
+
+    FScopeLock Lock(&mutex_);
+    if (!file_)
+    {
+        return;
+    }
+
+    // 张量数据直接从调用方的缓冲区写入文件，不额外复制
+    bool bWritten = file_->Write(descriptor.GetData(), descriptor.Num());
+    for (const FOnnxCaptureTensorView& input : Inputs)
+    {
+        const int64 padding = Align(input.NumBytes, DataAlignment) - input.NumBytes;
+        bWritten = bWritten && (input.NumBytes == 0 || file_->Write(static_cast<const uint8*>(input.Data), input.NumBytes));
+        bWritten = bWritten && (padding == 0 || file_->Write(ZeroPadding, padding));
+    }
+
+    if (!bWritten)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to write ONNX capture record, stopping capture: %s"), *filePath_);
+        bOpen_ = false;
+        delete file_;
+        file_ = nullptr;
+        return;
+    }
+
+    ++numRecords_;
+    numBytes_ += recordBytes;
+}
+
+FOnnxCaptureWriter::FRunScope::FRunScope(FOnnxCaptureWriter& InWriter, int32 InModelIndex, const char* const* InNames, const Ort::Value* InValues, int32 InNumInputs)
+    : Writer(InWriter.ShouldSample() ? &InWriter : nullptr)
+    , ModelIndex(InModelIndex)
+    , Names(InNames)
+    , Values(InValues)
+    , NumInputs(InNumInputs)
+{
+    if (Writer)
+    {
+        StartTime = FPlatformTime::Seconds();
+    }
+}
+
+FOnnxCaptureWriter::FRunScope::FRunScope(FOnnxCaptureWriter& InWriter, int32 InModelIndex, TConstArrayView<FOnnxCaptureTensorView> InTensors)
+    : Writer(InWriter.ShouldSample() ? &InWriter : nullptr)
+    , ModelIndex(InModelIndex)
+    , Tensors(InTensors)
+{
+    if (Writer)
+    {
+        StartTime = FPlatformTime::Seconds();
+    }
+}
+
+FOnnxCaptureWriter::FRunScope::~FRunScope()
+{
+    if (!Writer)
+    {
+        return;
+    }
+
+    const double latencyMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+    if (!Values)
+    {
+        Writer->Append(ModelIndex, Tensors, latencyMs, bSucceeded);
+        return;
+    }
+
+    // 可能在异常展开期间析构，这里的ORT异常不能继续抛出
+    FOnnxAllocationCounter::FUntrackedScope untracked;
+    try
+    {
+        TArray<FOnnxInlineShape, TInlineAllocator<8>> shapes;
+        TArray<FOnnxCaptureTensorView, TInlineAllocator<8>> views;
+        shapes.SetNum(NumInputs);
+        views.SetNum(NumInputs);
+
+        for (int32 i = 0; i < NumInputs; ++i)
+        {
+            Ort::TensorTypeAndShapeInfo info = Values[i].GetTensorTypeAndShapeInfo();
+            for (int64_t dim : info.GetShape())
+            {
+                shapes[i].Add(dim);
+            }
+
+            FOnnxCaptureTensorView& view = views[i];
+            view.Name = Names[i];
+            view.Type = info.GetElementType();
+            view.Shape = shapes[i];
+            view.Data = Values[i].GetTensorRawData();
+            view.NumBytes = static_cast<int64>(info.GetElementCount() * FOnnxBenchmark::GetElementSize(view.Type));
+        }
+
+        Writer->Append(ModelIndex, views, latencyMs, bSucceeded);
+    }
+    catch (const Ort::Exception& e)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Failed to capture ONNX inputs: %s"), UTF8_TO_TCHAR(e.what()));
+    }
+}
+
+FOnnxCaptureReader::~FOnnxCaptureReader()
+{
+    Close();
+}
+
+bool FOnnxCaptureReader::Open(const FString& FilePath)
+{
+    Close();
+
+    IPlatformFile& platformFile = FPlatformFileManager::Get().GetPlatformFile();
+    const int64 fileSize = platformFile.FileSize(*FilePath);
+    handle_ = fileSize > 0 ? platformFile.OpenMapped(*FilePath) : nullptr;
+    region_ = handle_ ? handle_->MapRegion(0, fileSize) : nullptr;
+    if (!region_)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to map ONNX capture: %s"), *FilePath);
+        Close();
+        return false;
+    }
+
+    FCaptureCursor cursor{region_->GetMappedPtr(), region_->GetMappedSize()};
+
+    char magic[8];
+    uint32 version = 0;
+    uint32 numModels = 0;
+    if (!cursor.Read(magic) || FMemory::Memcmp(magic, FileMagic, sizeof(FileMagic)) != 0 ||
+        !cursor.Read(version) || version != FileVersion || !cursor.Read(numModels))
+    {
+        UE_LOG(LogTemp, Error, TEXT("Not an ONNX capture file (or unsupported version): %s"), *FilePath);
+        Close();
+        return false;
+    }
+
+    for (uint32 i = 0; i < numModels; ++i)
+    {
+        FOnnxCaptureModel& model = models_.AddDefaulted_GetRef();
+        FString settingsText;
+        uint32 bAsset = 0;
+        uint32 numOutputs = 0;
+        bool bValid = cursor.ReadString(model.Role) && cursor.ReadString(model.Source) && cursor.Read(bAsset) &&
+                      cursor.ReadString(settingsText) && cursor.Read(numOutputs);
+        for (uint32 j = 0; bValid && j < numOutputs; ++j)
+        {
+            bValid = cursor.ReadString(model.OutputNames.AddDefaulted_GetRef());
+        }
+        if (!bValid)
+        {
+            UE_LOG(LogTemp, Error, TEXT("Corrupted model table in ONNX capture: %s"), *FilePath);
+            Close();
+            return false;
+        }
+
+        model.bSourceIsAsset = bAsset != 0;
+        if (!ImportSettings(settingsText, model.Settings))
+        {
+            UE_LOG(LogTemp, Warning, TEXT("Could not parse session settings of %s in capture, using defaults"), *model.Role);
+        }
+    }
+
+    // 记录依次排列，每条记录都以64字节对齐
+    cursor.Pos = Align(cursor.Pos, DataAlignment);
+    while (cursor.Pos < cursor.Size)
+    {
+        const int64 recordStart = cursor.Pos;
+        FRecordHeader header;
+        if (!cursor.Read(header) || header.Magic != RecordMagic || header.RecordBytes < sizeof(FRecordHeader) ||
+            recordStart + static_cast<int64>(header.RecordBytes) > cursor.Size || header.ModelIndex < 0 || header.ModelIndex >= models_.Num())
+        {
+            UE_LOG(LogTemp, Warning, TEXT("ONNX capture %s ends with a truncated or corrupted record, ignoring the rest"), *FilePath);
+            break;
+        }
+
+        FOnnxCaptureRecord record;
+        record.ModelIndex = header.ModelIndex;
+        record.TimestampSeconds = header.TimestampSeconds;
+        record.LatencyMs = header.LatencyMs;
+        record.bSucceeded = (header.Flags & RecordFlag_Succeeded) != 0;
+
+        bool bValid = true;
+        for (uint32 i = 0; bValid && i < header.NumInputs; ++i)
+        {
+            FTensorHeader tensorHeader;
+            bValid = cursor.Read(tensorHeader) &&
+                     cursor.Pos + static_cast<int64>(tensorHeader.NumDims * sizeof(int64) + tensorHeader.NameBytes) <= recordStart + static_cast<int64>(header.RecordBytes) &&
+                     tensorHeader.DataOffset + tensorHeader.DataBytes <= header.RecordBytes;
+            if (!bValid)
+            {
+                break;
+            }
+
+            FOnnxCaptureTensorView& view = record.Inputs.AddDefaulted_GetRef();
+            view.Type = static_cast<ONNXTensorElementDataType>(tensorHeader.Type);
+            view.Shape = TConstArrayView<int64>(reinterpret_cast<const int64*>(cursor.Data + cursor.Pos), tensorHeader.NumDims);
+            cursor.Pos += tensorHeader.NumDims * sizeof(int64);
+
+            view.Name = reinterpret_cast<const char*>(cursor.Data + cursor.Pos);
+            bValid = tensorHeader.NameBytes > 0 && cursor.Data[cursor.Pos + tensorHeader.NameBytes - 1] == 0;
+            cursor.Pos += tensorHeader.NameBytes;
+
+            view.Data = cursor.Data + recordStart + tensorHeader.DataOffset;
+            view.NumBytes = tensorHeader.DataBytes;
+        }
+
+        if (!bValid)
+        {
+            UE_LOG(LogTemp, Warning, TEXT("Corrupted record in ONNX capture %s, ignoring the rest"), *FilePath);
+            break;
+        }
+
+        records_.Add(MoveTemp(record));
+        cursor.Pos = recordStart + header.RecordBytes;
+    }
+
+    UE_LOG(LogTemp, Log, TEXT("Opened ONNX capture %s: %d models, %d records"), *FilePath, models_.Num(), records_.Num());
+    return true;
+}
+
+void FOnnxCaptureReader::Close()
+{
+    records_.Reset();
+    models_.Reset();
+    delete region_;
+    region_ = nullptr;
+    delete handle_;
+    handle_ = nullptr;
+}
+
+TArray<FOnnxReplayResult> FOnnxCaptureReplay::Replay(const FString& CapturePath, const FOnnxReplayParams& Params)
+{
+    // 张量直接引用映射的文件，Reader最后释放
+    FOnnxCaptureReader reader;
+    if (!reader.Open(CapturePath))
+    {
+        return TArray<FOnnxReplayResult>();
+    }
+
+    const TArray<FOnnxCaptureModel>& models = reader.GetModels();
+    TArray<FOnnxReplayResult> results;
+
+    // 实例负责解析模型来源（资产字节、外部数据、预打包权重），必须比会话活得更久
+    TArray<TUniquePtr<FOnnxModelInstance>> instances;
+    TArray<TUniquePtr<Ort::Session>> sessions;
+    TArray<std::vector<std::string>> outputNames;
+    TArray<std::vector<const char*>> outputNamePtrs;
+
+    for (const FOnnxCaptureModel& model : models)
+    {
+        FOnnxReplayResult& result = results.AddDefaulted_GetRef();
+        result.Role = model.Role;
+        result.Source = model.Source;
+        result.Settings = Params.bUseRecordedSettings ? model.Settings : Params.Settings;
+        if (Params.IntraOpThreads > 0)
+        {
+            result.Settings.IntraOpThreads = Params.IntraOpThreads;
+        }
+
+        UOnnxModelAsset* asset = model.bSourceIsAsset ? LoadObject<UOnnxModelAsset>(nullptr, *model.Source) : nullptr;
+        if (model.bSourceIsAsset && !asset)
+        {
+            UE_LOG(LogTemp, Error, TEXT("Replay: model asset %s not found"), *model.Source);
+        }
+
+        TUniquePtr<Ort::Session> session;
+        if (asset || !model.bSourceIsAsset)
+        {
+            TUniquePtr<FOnnxModelInstance> instance = MakeUnique<FOnnxModelInstance>(asset, asset ? FString() : model.Source);
+            session = instance->IsInitialized() ? instance->CreateSession(result.Settings) : nullptr;
+            instances.Add(MoveTemp(instance));
+        }
+
+        std::vector<std::string>& names = outputNames.AddDefaulted_GetRef();
+        if (session)
+        {
+            for (const FString& name : model.OutputNames)
+            {
+                names.push_back(TCHAR_TO_UTF8(*name));
+            }
+            if (names.empty())
+            {
+                Ort::AllocatorWithDefaultOptions allocator;
+                for (size_t i = 0; i < session->GetOutputCount(); ++i)
+                {
+                    names.push_back(session->GetOutputNameAllocated(i, allocator).get());
+                }
+            }
+        }
+        else
+        {
+            UE_LOG(LogTemp, Error, TEXT("Replay: failed to create a session for %s (%s)"), *model.Role, *model.Source);
+        }
+
+        std::vector<const char*>& namePtrs = outputNamePtrs.AddDefaulted_GetRef();
+        for (const std::string& name : names)
+        {
+            namePtrs.push_back(name.c_str());
+        }
+        sessions.Add(MoveTemp(session));
+    }
+
+    // 在计时之前准备好所有输入张量：直接引用映射的数据，只有类型与会话不一致（fp16/float）时转换
+    struct FPreparedRun
+    {
+        int32 ModelIndex = 0;
+        TArray<const char*> InputNames;
+        std::vector<Ort::Value> InputValues;
+        TArray<TArray<uint16>> HalfScratch;
+        TArray<TArray<float>> FloatScratch;
+    };
+
+    const TArray<FOnnxCaptureRecord>& records = reader.GetRecords();
+    const int32 numRecords = Params.MaxRecords > 0 ? FMath::Min(Params.MaxRecords, records.Num()) : records.Num();
+    Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+
+    TArray<TUniquePtr<FPreparedRun>> runs;
+    for (int32 r = 0; r < numRecords; ++r)
+    {
+        const FOnnxCaptureRecord& record = records[r];
+        FOnnxReplayResult& result = results[record.ModelIndex];
+        ++result.NumRecords;
+
+        Ort::Session* session = sessions[record.ModelIndex].Get();
+        if (!session)
+        {
+            ++result.NumFailed;
+            continue;
+        }
+
+        TUniquePtr<FPreparedRun> run = MakeUnique<FPreparedRun>();
+        run->ModelIndex = record.ModelIndex;
+        run->HalfScratch.SetNum(record.Inputs.Num());
+        run->FloatScratch.SetNum(record.Inputs.Num());
+
+        bool bValid = true;
+        try
+        {
+            for (int32 i = 0; bValid && i < record.Inputs.Num(); ++i)
+            {
+                const FOnnxCaptureTensorView& input = record.Inputs[i];
+                const int64_t* shape = reinterpret_cast<const int64_t*>(input.Shape.GetData());
+                const size_t elementSize = FOnnxBenchmark::GetElementSize(input.Type);
+                const int64 count = elementSize > 0 ? input.NumBytes / static_cast<int64>(elementSize) : 0;
+                const ONNXTensorElementDataType expected = FOnnxHalf::GetInputElementType(*session, input.Name);
+
+                run->InputNames.Add(input.Name);
+                if (expected == input.Type || expected == ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED)
+                {
+                    run->InputValues.push_back(Ort::Value::CreateTensor(memoryInfo, const_cast<void*>(input.Data), input.NumBytes,
+                                                                        shape, input.Shape.Num(), input.Type));
+                }
+                else if (input.Type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT && expected == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16)
+                {
+                    run->InputValues.push_back(FOnnxHalf::CreateTensor(memoryInfo, static_cast<const float*>(input.Data), count,
+                                                                       shape, input.Shape.Num(), expected, run->HalfScratch[i]));
+                }
+                else if (input.Type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16 && expected == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT)
+                {
+                    run->InputValues.push_back(FOnnxHalf::CreateTensor(memoryInfo, static_cast<const uint16*>(input.Data), count,
+                                                                       shape, input.Shape.Num(), expected, run->FloatScratch[i]));
+                }
+                else
+                {
+                    UE_LOG(LogTemp, Error, TEXT("Replay: input %s of record %d has type %d, session expects %d"),
+                           UTF8_TO_TCHAR(input.Name), r, static_cast<int32>(input.Type), static_cast<int32>(expected));
+                    bValid = false;
+                }
+            }
+        }
+        catch (const Ort::Exception& e)
+        {
+            UE_LOG(LogTemp, Error, TEXT("Replay: failed to prepare record %d: %s"), r, UTF8_TO_TCHAR(e.what()));
+            bValid = false;
+        }
+
+        if (!bValid)
+        {
+            ++result.NumFailed;
+            continue;
+        }
+        runs.Add(MoveTemp(run));
+    }
+
+    auto RunOnce = [&](const FPreparedRun& Run) -> bool
+    {
+        const std::vector<const char*>& names = outputNamePtrs[Run.ModelIndex];
+        try
+        {
+            sessions[Run.ModelIndex]->Run(Ort::RunOptions{nullptr}, Run.InputNames.GetData(), Run.InputValues.data(), Run.InputValues.size(),
+                                          names.data(), names.size());
+            return true;
+        }
+        catch (const Ort::Exception& e)
+        {
+            UE_LOG(LogTemp, Verbose, TEXT("Replay: run failed: %s"), UTF8_TO_TCHAR(e.what()));
+            return false;
+        }
+    };
+
+    // 预热：每个模型先运行前几条记录（内存池增长、首次执行的初始化）
+    TArray<int32> warmupCounts;
+    warmupCounts.SetNumZeroed(models.Num());
+    for (const TUniquePtr<FPreparedRun>& run : runs)
+    {
+        if (warmupCounts[run->ModelIndex] < Params.WarmupRuns)
+        {
+            RunOnce(*run);
+            ++warmupCounts[run->ModelIndex];
+        }
+    }
+
+    // 全速回放：按录制顺序运行，记录之间没有间隔
+    TArray<TArray<double>> latencies;
+    latencies.SetNum(models.Num());
+    for (int32 pass = 0; pass < FMath::Max(1, Params.Passes); ++pass)
+    {
+        for (const TUniquePtr<FPreparedRun>& run : runs)
+        {
+            const double start = FPlatformTime::Seconds();
+            if (RunOnce(*run))
+            {
+                latencies[run->ModelIndex].Add((FPlatformTime::Seconds() - start) * 1000.0);
+            }
+            else
+            {
+                ++results[run->ModelIndex].NumFailed;
+            }
+        }
+    }
+
+    for (int32 m = 0; m < models.Num(); ++m)
+    {
+        FOnnxReplayResult& result = results[m];
+        const TArray<double>& samples = latencies[m];
+        result.NumRuns = samples.Num();
+        if (samples.Num() > 0)
+        {
+            double sum = 0.0;
+            double maxLatency = 0.0;
+            for (double sample : samples)
+            {
+                sum += sample;
+                maxLatency = FMath::Max(maxLatency, sample);
+            }
+            result.MeanLatencyMs = static_cast<float>(sum / samples.Num());
+            result.MaxLatencyMs = static_cast<float>(maxLatency);
+            result.P50LatencyMs = FOnnxBenchmark::Percentile(samples, 0.5);
+            result.P90LatencyMs = FOnnxBenchmark::Percentile(samples, 0.9);
+            result.P99LatencyMs = FOnnxBenchmark::Percentile(samples, 0.99);
+        }
+
+        TArray<double> recorded;
+        for (int32 r = 0; r < numRecords; ++r)
+        {
+            if (records[r].ModelIndex == m && records[r].bSucceeded)
+            {
+                recorded.Add(records[r].LatencyMs);
+            }
+        }
+        if (recorded.Num() > 0)
+        {
+            double sum = 0.0;
+            for (double sample : recorded)
+            {
+                sum += sample;
+            }
+            result.RecordedMeanLatencyMs = static_cast<float>(sum / recorded.Num());
+            result.RecordedP50LatencyMs = FOnnxBenchmark::Percentile(recorded, 0.5);
+            result.RecordedP99LatencyMs = FOnnxBenchmark::Percentile(recorded, 0.99);
+        }
+    }
+
+    // 会话先于实例释放
+    runs.Reset();
+    sessions.Reset();
+    instances.Reset();
+    return results;
+}
+
+void FOnnxCaptureReplay::LogResults(const TArray<FOnnxReplayResult>& Results)
+{
+    UE_LOG(LogTemp, Log, TEXT("=== ONNX capture replay (%d models) ==="), Results.Num());
+    for (const FOnnxReplayResult& Result : Results)
+    {
+        UE_LOG(LogTemp, Log, TEXT("%s"), *Result.ToString());
+    }
+}
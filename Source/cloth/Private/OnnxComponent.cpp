@@ -2,7 +2,9 @@
 
 #include "OnnxComponent.h"
 #include "OnnxModelInstance.h"
+#include "Async/Async.h"
 #include "HAL/PlatformFilemanager.h"
+#include "HAL/PlatformTime.h"
 
 UONNXComponent::UONNXComponent()
 {
@@ -14,7 +16,7 @@ UONNXComponent::UONNXComponent()
 
 UONNXComponent::~UONNXComponent()
 {
-    // TUniquePtr自动清理
+    // 模型句柄自动释放
 }
 
 void UONNXComponent::BeginPlay()
@@ -60,10 +62,13 @@ bool UONNXComponent::InitializeModel()
 {
     try
     {
+        // 有状态模型的状态绑定在实例内部，不能与其他组件共享
+        const bool bShared = bShareModelInstance && StateTensors.Num() == 0;
+
         if (ModelAsset)
         {
             // 使用UOnnxModelAsset
-            ModelInstance = MakeUnique<FOnnxModelInstance>(ModelAsset);
+            ModelInstance = AcquireModelInstance(ModelAsset, FString(), bShared);
             UE_LOG(LogTemp, Log, TEXT("Loading ONNX model from asset"));
         }
         else if (!ModelFilePath.IsEmpty())
@@ -75,8 +80,8 @@ bool UONNXComponent::InitializeModel()
                 return false;
             }
 
-            // 创建临时的空资产来初始化实例
-            ModelInstance = MakeUnique<FOnnxModelInstance>(nullptr);
+            // 没有资产时直接按文件路径创建实例
+            ModelInstance = AcquireModelInstance(nullptr, ModelFilePath, bShared);
             UE_LOG(LogTemp, Log, TEXT("Loading ONNX model from file path: %s"), *ModelFilePath);
         }
         else
@@ -87,8 +92,18 @@ bool UONNXComponent::InitializeModel()
 
         if (ModelInstance && ModelInstance->IsInitialized())
         {
+            // 绑定状态张量
+            if (StateTensors.Num() > 0 && !ModelInstance->SetStateTensors(StateTensors))
+            {
+                UE_LOG(LogTemp, Error, TEXT("Failed to bind ONNX state tensors"));
+                ModelInstance.Reset();
+                return false;
+            }
+
             bIsInitialized = true;
             UE_LOG(LogTemp, Log, TEXT("ONNX Model Instance created successfully"));
+
+            InitializeShadow();
             return true;
         }
         else
@@ -106,6 +121,24 @@ bool UONNXComponent::InitializeModel()
     }
 }
 
+FOnnxModelHandle UONNXComponent::AcquireModelInstance(UOnnxModelAsset* Asset, const FString& Path, bool bShared) const
+{
+    UOnnxModelRegistry* Registry = bShared ? UOnnxModelRegistry::Get() : nullptr;
+    if (Registry)
+    {
+        return Registry->Acquire(Asset, Path);
+    }
+    return MakeShared<FOnnxModelInstance, ESPMode::ThreadSafe>(Asset, Path);
+}
+
+void UONNXComponent::InvalidateSharedInstance() const
+{
+    if (UOnnxModelRegistry* Registry = UOnnxModelRegistry::Get())
+    {
+        Registry->Invalidate(ModelAsset, ModelAsset ? FString() : ModelFilePath);
+    }
+}
+
 bool UONNXComponent::RunInference(const TArray<float>& InputData, TArray<float>& OutputData)
 {
     if (!IsInitialized())
@@ -120,7 +153,99 @@ bool UONNXComponent::RunInference(const TArray<float>& InputData, TArray<float>&
         return false;
     }
 
-    return ModelInstance->Run(InputData, OutputData);
+    const double StartTime = FPlatformTime::Seconds();
+    if (!ModelInstance->Run(InputData, OutputData))
+    {
+        return false;
+    }
+
+    if (ShadowRunner && ShadowRunner->ShouldMirror())
+    {
+        // 影子任务持有输入和生产输出的副本，调用方可以立即复用自己的缓冲区
+        const double ProductionSeconds = FPlatformTime::Seconds() - StartTime;
+        FOnnxModelInstance* Candidate = ShadowInstance.Get();
+        ShadowRunner->Submit(ProductionSeconds, [Candidate, Input = InputData, Production = OutputData](FOnnxShadowSample& Sample)
+        {
+            TArray<float> CandidateOutput;
+            const double CandidateStart = FPlatformTime::Seconds();
+            Sample.bSucceeded = Candidate->Run(Input, CandidateOutput);
+            Sample.CandidateSeconds = FPlatformTime::Seconds() - CandidateStart;
+            if (Sample.bSucceeded)
+            {
+                Sample.RelativeL2 = FOnnxShadowRunner::ComputeRelativeL2(CandidateOutput, Production);
+            }
+        });
+    }
+    return true;
+}
+
+bool UONNXComponent::RunInferenceTensor(const FOnnxTensor& Input, FOnnxTensor& Output)
+{
+    if (!IsInitialized())
+    {
+        UE_LOG(LogTemp, Error, TEXT("ONNX Component not initialized"));
+        return false;
+    }
+
+    if (!ModelInstance)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Model instance is null"));
+        return false;
+    }
+
+    const double StartTime = FPlatformTime::Seconds();
+    if (!ModelInstance->Run(Input, Output))
+    {
+        return false;
+    }
+
+    if (ShadowRunner && ShadowRunner->ShouldMirror())
+    {
+        // 张量共享存储，调用方之后可能改写它们，影子任务持有各自的副本
+        const double ProductionSeconds = FPlatformTime::Seconds() - StartTime;
+        FOnnxModelInstance* Candidate = ShadowInstance.Get();
+        ShadowRunner->Submit(ProductionSeconds, [Candidate, InputCopy = Input.Clone(), ProductionCopy = Output.Clone()](FOnnxShadowSample& Sample)
+        {
+            FOnnxTensor CandidateOutput;
+            const double CandidateStart = FPlatformTime::Seconds();
+            Sample.bSucceeded = Candidate->Run(InputCopy, CandidateOutput);
+            Sample.CandidateSeconds = FPlatformTime::Seconds() - CandidateStart;
+
+            if (!Sample.bSucceeded)
+            {
+                return;
+            }
+
+            // 无法转换为float的输出（整数、布尔等）没法比较，记为失败而不是误差为0
+            TArray<float> CandidateData;
+            TArray<float> ProductionData;
+            if (!CandidateOutput.CopyToFloat(CandidateData) || !ProductionCopy.CopyToFloat(ProductionData))
+            {
+                Sample.bSucceeded = false;
+                return;
+            }
+            Sample.RelativeL2 = FOnnxShadowRunner::ComputeRelativeL2(CandidateData, ProductionData);
+        });
+    }
+    return true;
+}
+
+bool UONNXComponent::RunInferenceForOutput(const TArray<float>& InputData, const FString& OutputName, TArray<float>& OutputData)
+{
+    if (!IsInitialized())
+    {
+        UE_LOG(LogTemp, Error, TEXT("ONNX Component not initialized"));
+        return false;
+    }
+
+    TArray<TArray<float>> Outputs;
+    if (!ModelInstance->RunOutputs(InputData, ModelInstance->InferInputShape(InputData.Num()), { OutputName }, Outputs))
+    {
+        return false;
+    }
+
+    OutputData = MoveTemp(Outputs[0]);
+    return true;
 }
 
 bool UONNXComponent::IsInitialized() const
@@ -190,7 +315,276 @@ TArray<FOnnxTensorInfo> UONNXComponent::GetModelOutputInfo() const
 
 void UONNXComponent::Reset()
 {
+    ResetShadow();
+    Generator.Reset();
     ModelInstance.Reset();
     bIsInitialized = false;
     UE_LOG(LogTemp, Log, TEXT("ONNX Component reset"));
-}
\ No newline at end of file
+}
+
+TArray<FOnnxVariantReport> UONNXComponent::CompareModelVariants(const FString& SampleFolder, int32 Iterations)
+{
+    if (!ModelAsset)
+    {
+        UE_LOG(LogTemp, Error, TEXT("CompareModelVariants: variants are declared on the model asset"));
+        return TArray<FOnnxVariantReport>();
+    }
+
+    // 比较期间释放当前实例，避免两份模型同时驻留、同时占用线程
+    const bool bWasInitialized = bIsInitialized;
+    Reset();
+
+    TArray<FOnnxVariantReport> Reports = FOnnxModelVariants::Compare(ModelAsset, SampleFolder, Iterations, true);
+
+    if (bWasInitialized)
+    {
+        InvalidateSharedInstance();
+        Initialize();
+    }
+    return Reports;
+}
+
+EOnnxModelPrecision UONNXComponent::GetModelPrecision() const
+{
+    return ModelInstance ? ModelInstance->GetPrecision() : EOnnxModelPrecision::FP32;
+}
+
+void UONNXComponent::InitializeShadow()
+{
+    if (!ShadowConfig.bEnabled)
+    {
+        return;
+    }
+
+    // 有状态模型的状态在两个模型之间会分叉，比较没有意义
+    if (ModelInstance->IsStateful())
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Shadow mode is not supported for stateful models"));
+        return;
+    }
+
+    if (!ShadowConfig.CandidateModel && ShadowConfig.CandidateModelPath.IsEmpty())
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Shadow mode enabled but no candidate model specified"));
+        return;
+    }
+
+    try
+    {
+        // 候选实例不经过共享注册表：它使用低优先级的小线程池，不能与同一模型的生产实例共用
+        FOnnxModelHandle Candidate = MakeShared<FOnnxModelInstance, ESPMode::ThreadSafe>(ShadowConfig.CandidateModel, ShadowConfig.CandidateModelPath,
+            TOptional<EOnnxModelPrecision>(), true);
+        if (!Candidate || !Candidate->IsInitialized())
+        {
+            UE_LOG(LogTemp, Warning, TEXT("Failed to initialize shadow candidate model"));
+            return;
+        }
+
+        ShadowInstance = MoveTemp(Candidate);
+        ShadowRunner = MakeUnique<FOnnxShadowRunner>(ShadowConfig);
+        UE_LOG(LogTemp, Log, TEXT("Shadow mode enabled (sample rate %.2f, max in flight %d)"), ShadowConfig.SampleRate, ShadowConfig.MaxInFlight);
+    }
+    catch (const std::exception& e)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Exception creating shadow candidate model: %s"), UTF8_TO_TCHAR(e.what()));
+        ShadowInstance.Reset();
+    }
+}
+
+void UONNXComponent::ResetShadow()
+{
+    if (ShadowRunner)
+    {
+        ShadowRunner->LogReport();
+        ShadowRunner.Reset();
+    }
+    ShadowInstance.Reset();
+}
+
+FOnnxShadowReport UONNXComponent::GetShadowReport() const
+{
+    return ShadowRunner ? ShadowRunner->GetReport() : FOnnxShadowReport();
+}
+
+void UONNXComponent::ResetShadowReport()
+{
+    if (ShadowRunner)
+    {
+        ShadowRunner->ResetReport();
+    }
+}
+
+FOnnxGenerator* UONNXComponent::GetGenerator()
+{
+    if (!IsInitialized())
+    {
+        return nullptr;
+    }
+
+    if (!Generator)
+    {
+        TUniquePtr<FOnnxGenerator> NewGenerator = MakeUnique<FOnnxGenerator>(*ModelInstance, GenerationConfig);
+        if (!NewGenerator->Initialize())
+        {
+            return nullptr;
+        }
+        Generator = MoveTemp(NewGenerator);
+    }
+    return Generator.Get();
+}
+
+bool UONNXComponent::GenerateTokens(const TArray<int64>& PromptTokens, const FOnnxGenerationParams& Params, TArray<int64>& OutTokens, FOnnxGenerationStats& OutStats)
+{
+    FOnnxGenerator* TokenGenerator = GetGenerator();
+    if (!TokenGenerator)
+    {
+        UE_LOG(LogTemp, Error, TEXT("GenerateTokens: model is not initialized or does not support generation"));
+        return false;
+    }
+    return TokenGenerator->Generate(PromptTokens, Params, OutTokens, &OutStats);
+}
+
+void UONNXComponent::ResetState()
+{
+    if (ModelInstance)
+    {
+        ModelInstance->ResetState();
+    }
+}
+
+FOnnxStateSnapshot UONNXComponent::SnapshotState() const
+{
+    return ModelInstance ? ModelInstance->SnapshotState() : FOnnxStateSnapshot();
+}
+
+bool UONNXComponent::RestoreState(const FOnnxStateSnapshot& Snapshot)
+{
+    if (!ModelInstance || !ModelInstance->IsStateful())
+    {
+        UE_LOG(LogTemp, Error, TEXT("RestoreState: model has no state tensors"));
+        return false;
+    }
+    return ModelInstance->RestoreState(Snapshot);
+}
+
+TArray<FOnnxBenchmarkResult> UONNXComponent::BenchmarkSpinModes(int32 Iterations, float IdleGapMs, int32 IntraOpThreads)
+{
+    FOnnxBenchmarkParams Params;
+    Params.Iterations = FMath::Max(1, Iterations);
+    Params.IdleGapSeconds = FMath::Max(0.0f, IdleGapMs) / 1000.0;
+
+    TFunction<TArray<FOnnxBenchmarkResult>()> Job = MakeSpinBenchmarkJob(Params, IntraOpThreads);
+    return Job ? Job() : TArray<FOnnxBenchmarkResult>();
+}
+
+void UONNXComponent::BenchmarkSpinModesAsync(const FOnOnnxBenchmarkCompleted& OnCompleted, int32 Iterations, float IdleGapMs, int32 IntraOpThreads)
+{
+    if (bBenchmarkRunning)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("A spin mode benchmark is already running on this component"));
+        OnCompleted.ExecuteIfBound(TArray<FOnnxBenchmarkResult>());
+        return;
+    }
+
+    FOnnxBenchmarkParams Params;
+    Params.Iterations = FMath::Max(1, Iterations);
+    Params.IdleGapSeconds = FMath::Max(0.0f, IdleGapMs) / 1000.0;
+
+    TFunction<TArray<FOnnxBenchmarkResult>()> Job = MakeSpinBenchmarkJob(Params, IntraOpThreads);
+    if (!Job)
+    {
+        OnCompleted.ExecuteIfBound(TArray<FOnnxBenchmarkResult>());
+        return;
+    }
+
+    bBenchmarkRunning = true;
+    TWeakObjectPtr<UONNXComponent> WeakThis(this);
+    AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [WeakThis, OnCompleted, Job = MoveTemp(Job)]() mutable
+    {
+        TArray<FOnnxBenchmarkResult> Results = Job();
+
+        // 任务持有的实例引用在游戏线程上释放：组件可能已经换了实例，这是最后一个引用
+        AsyncTask(ENamedThreads::GameThread, [WeakThis, OnCompleted, Job = MoveTemp(Job), Results = MoveTemp(Results)]() mutable
+        {
+            Job = nullptr;
+            if (UONNXComponent* Component = WeakThis.Get())
+            {
+                Component->bBenchmarkRunning = false;
+            }
+            OnCompleted.ExecuteIfBound(Results);
+        });
+    });
+}
+
+TFunction<TArray<FOnnxBenchmarkResult>()> UONNXComponent::MakeSpinBenchmarkJob(const FOnnxBenchmarkParams& Params, int32 IntraOpThreads) const
+{
+    if (!IsInitialized())
+    {
+        UE_LOG(LogTemp, Error, TEXT("ONNX Component not initialized"));
+        return nullptr;
+    }
+
+    FOnnxModelHandle Instance = ModelInstance;
+    return [Instance, Params, IntraOpThreads]() { return Instance->BenchmarkSpinModes(Params, IntraOpThreads); };
+}
+FOnnxResidencyStats UONNXComponent::GetResidencyStats() const
+{
+    return ModelInstance ? ModelInstance->GetResidencyStats() : FOnnxResidencyStats();
+}
+
+FOnnxAllocationStats UONNXComponent::GetAllocationStats() const
+{
+    return ModelInstance ? ModelInstance->GetAllocationStats() : FOnnxAllocationStats();
+}
+
+bool UONNXComponent::StartCapture(const FString& FilePath, const FOnnxCaptureConfig& Config)
+{
+    if (!IsInitialized())
+    {
+        UE_LOG(LogTemp, Error, TEXT("ONNX Component not initialized"));
+        return false;
+    }
+    return ModelInstance->StartCapture(FilePath, Config);
+}
+
+void UONNXComponent::StopCapture()
+{
+    if (ModelInstance)
+    {
+        ModelInstance->StopCapture();
+    }
+}
+
+EOnnxExecutionProvider UONNXComponent::GetExecutionProvider() const
+{
+    return ModelInstance ? ModelInstance->GetSessionSettings().ExecutionProvider : EOnnxExecutionProvider::CPU;
+}
+
+TArray<FOnnxBenchmarkResult> UONNXComponent::AutotuneThreading(int32 Iterations, bool bTuneReplicas)
+{
+    if (!IsInitialized())
+    {
+        UE_LOG(LogTemp, Error, TEXT("ONNX Component not initialized"));
+        return TArray<FOnnxBenchmarkResult>();
+    }
+
+    FOnnxBenchmarkParams Params = FOnnxAutotuner::MakeDefaultParams();
+    Params.Iterations = FMath::Max(1, Iterations);
+
+    FOnnxAutotuneGrid Grid;
+    if (bTuneReplicas)
+    {
+        Grid.ReplicasPerNumaNode = { 1, 2, 4 };
+    }
+
+    FOnnxAutotuneResult Result = ModelInstance->Autotune(Grid, Params);
+
+    // 重新创建实例以应用保存的配置
+    if (Result.bSucceeded)
+    {
+        Reset();
+        InvalidateSharedInstance();
+        Initialize();
+    }
+    return Result.Results;
+}
@@ -0,0 +1,245 @@
+// OnnxExecutionProviders.cpp
+
+#include "OnnxExecutionProviders.h"
+#include "OnnxAutotuner.h"
+#include "OnnxRuntime.h"
+#include "Misc/ScopeLock.h"
+#include "onnxruntime_session_options_config_keys.h"
+
+#include <string>
+#include <unordered_map>
+
+namespace
+{
+    // Ort::GetAvailableProviders()的结果在进程内不会变化，只查询一次
+    const TArray<FString>& GetOrtAvailableProviders()
+    {
+        static FCriticalSection Mutex;
+        static TArray<FString> Providers;
+        static bool bQueried = false;
+
+        FScopeLock Lock(&Mutex);
+        if (!bQueried && FOnnxRuntime::LoadApi())
+        {
+            bQueried = true;
+            try
+            {
+                for (const std::string& Provider : Ort::GetAvailableProviders())
+                {
+                    Providers.Add(UTF8_TO_TCHAR(Provider.c_str()));
+                }
+            }
+            catch (const Ort::Exception& e)
+            {
+                UE_LOG(LogTemp, Error, TEXT("Failed to query ONNX Runtime execution providers: %s"), UTF8_TO_TCHAR(e.what()));
+            }
+            UE_LOG(LogTemp, Log, TEXT("ONNX Runtime execution providers: %s"), *FString::Join(Providers, TEXT(", ")));
+        }
+        return Providers;
+    }
+
+    // 偏好列表中可用的EP，默认CPU EP始终作为最后的回退
+    TArray<EOnnxExecutionProvider> GetCandidates(const FOnnxSessionSettings& Settings)
+    {
+        TArray<EOnnxExecutionProvider> Candidates;
+        for (EOnnxExecutionProvider Provider : Settings.ExecutionProviderPreference)
+        {
+            if (!FOnnxExecutionProviders::IsAvailable(Provider))
+            {
+                UE_LOG(LogTemp, Log, TEXT("Execution provider %s is not available in this ONNX Runtime build, skipping"),
+                       FOnnxExecutionProviders::GetDisplayName(Provider));
+                continue;
+            }
+            Candidates.AddUnique(Provider);
+        }
+        Candidates.AddUnique(EOnnxExecutionProvider::CPU);
+        return Candidates;
+    }
+}
+
+const TCHAR* FOnnxExecutionProviders::GetDisplayName(EOnnxExecutionProvider Provider)
+{
+    switch (Provider)
+    {
+    case EOnnxExecutionProvider::XNNPACK:  return TEXT("XNNPACK");
+    case EOnnxExecutionProvider::OneDNN:   return TEXT("oneDNN");
+    case EOnnxExecutionProvider::OpenVINO: return TEXT("OpenVINO");
+    case EOnnxExecutionProvider::CPU:
+    default:                               return TEXT("CPU");
+    }
+}
+
+const char* FOnnxExecutionProviders::GetOrtProviderName(EOnnxExecutionProvider Provider)
+{
+    switch (Provider)
+    {
+    case EOnnxExecutionProvider::XNNPACK:  return "XnnpackExecutionProvider";
+    case EOnnxExecutionProvider::OneDNN:   return "DnnlExecutionProvider";
+    case EOnnxExecutionProvider::OpenVINO: return "OpenVINOExecutionProvider";
+    case EOnnxExecutionProvider::CPU:
+    default:                               return "CPUExecutionProvider";
+    }
+}
+
+bool FOnnxExecutionProviders::IsAvailable(EOnnxExecutionProvider Provider)
+{
+    if (Provider == EOnnxExecutionProvider::CPU)
+    {
+        return true;
+    }
+    return GetOrtAvailableProviders().Contains(UTF8_TO_TCHAR(GetOrtProviderName(Provider)));
+}
+
+void FOnnxExecutionProviders::AppendTo(Ort::SessionOptions& SessionOptions, EOnnxExecutionProvider Provider, int32 NumThreads)
+{
+    const std::string threads = std::to_string(FMath::Max(1, NumThreads));
+
+    switch (Provider)
+    {
+    case EOnnxExecutionProvider::XNNPACK:
+    {
+        // XNNPACK有自己的线程池，ORT线程池不再自旋以免两者争抢CPU
+        std::unordered_map<std::string, std::string> options{{"intra_op_num_threads", threads}};
+        SessionOptions.AppendExecutionProvider("XNNPACK", options);
+        SessionOptions.AddConfigEntry(kOrtSessionOptionsConfigAllowIntraOpSpinning, "0");
+        break;
+    }
+
+    case EOnnxExecutionProvider::OneDNN:
+    {
+        const OrtApi& api = Ort::GetApi();
+        OrtDnnlProviderOptions* dnnlOptions = nullptr;
+        Ort::ThrowOnError(api.CreateDnnlProviderOptions(&dnnlOptions));
+
+        const char* keys[] = {"use_arena"};
+        const char* values[] = {"1"};
+        OrtStatus* status = api.UpdateDnnlProviderOptions(dnnlOptions, keys, values, 1);
+        if (!status)
+        {
+            status = api.SessionOptionsAppendExecutionProvider_Dnnl(SessionOptions, dnnlOptions);
+        }
+        api.ReleaseDnnlProviderOptions(dnnlOptions);
+        Ort::ThrowOnError(status);
+        break;
+    }
+
+    case EOnnxExecutionProvider::OpenVINO:
+    {
+        std::unordered_map<std::string, std::string> options{{"device_type", "CPU"}, {"num_of_threads", threads}};
+        SessionOptions.AppendExecutionProvider_OpenVINO_V2(options);
+        break;
+    }
+
+    case EOnnxExecutionProvider::CPU:
+    default:
+        break;
+    }
+}
+
+FOnnxSessionSettings FOnnxExecutionProviders::SelectCachedProvider(const FString& ModelKey, const FOnnxSessionSettings& Settings, bool& bOutNeedsBenchmark)
+{
+    bOutNeedsBenchmark = false;
+
+    FOnnxSessionSettings Selected = Settings;
+    if (!IsAvailable(Settings.ExecutionProvider))
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Execution provider %s is not available in this ONNX Runtime build, using CPU"),
+               GetDisplayName(Settings.ExecutionProvider));
+        Selected.ExecutionProvider = EOnnxExecutionProvider::CPU;
+    }
+    if (Settings.ExecutionProviderPreference.Num() == 0)
+    {
+        return Selected;
+    }
+
+    const TArray<EOnnxExecutionProvider> Candidates = GetCandidates(Settings);
+    if (Candidates.Num() == 1)
+    {
+        Selected.ExecutionProvider = Candidates[0];
+        return Selected;
+    }
+
+    EOnnxExecutionProvider Saved = EOnnxExecutionProvider::CPU;
+    if (FOnnxAutotuner::FindSelectedProvider(ModelKey, Saved) && Candidates.Contains(Saved))
+    {
+        UE_LOG(LogTemp, Log, TEXT("Using previously selected execution provider %s for %s"), GetDisplayName(Saved), *ModelKey);
+        Selected.ExecutionProvider = Saved;
+        return Selected;
+    }
+
+    bOutNeedsBenchmark = true;
+    return Selected;
+}
+
+FOnnxSessionSettings FOnnxExecutionProviders::SelectProvider(const FString& ModelKey, const FOnnxSessionSettings& Settings,
+                                                             const FOnnxSessionFactory& Factory, const FOnnxBenchmarkParams& Params,
+                                                             bool bIgnoreSaved, TArray<FOnnxBenchmarkResult>* OutResults)
+{
+    FOnnxSessionSettings Selected = Settings;
+
+    // 没有偏好列表时只检查固定的EP是否可用
+    if (Settings.ExecutionProviderPreference.Num() == 0)
+    {
+        if (!IsAvailable(Settings.ExecutionProvider))
+        {
+            UE_LOG(LogTemp, Warning, TEXT("Execution provider %s is not available in this ONNX Runtime build, using CPU"),
+                   GetDisplayName(Settings.ExecutionProvider));
+            Selected.ExecutionProvider = EOnnxExecutionProvider::CPU;
+        }
+        return Selected;
+    }
+
+    const TArray<EOnnxExecutionProvider> Candidates = GetCandidates(Settings);
+    if (Candidates.Num() == 1)
+    {
+        Selected.ExecutionProvider = Candidates[0];
+        return Selected;
+    }
+
+    // 本机已经为该模型选过EP
+    EOnnxExecutionProvider Saved = EOnnxExecutionProvider::CPU;
+    if (!bIgnoreSaved && FOnnxAutotuner::FindSelectedProvider(ModelKey, Saved) && Candidates.Contains(Saved))
+    {
+        UE_LOG(LogTemp, Log, TEXT("Using previously selected execution provider %s for %s"), GetDisplayName(Saved), *ModelKey);
+        Selected.ExecutionProvider = Saved;
+        return Selected;
+    }
+
+    TArray<FOnnxSessionSettings> Configurations;
+    for (EOnnxExecutionProvider Provider : Candidates)
+    {
+        FOnnxSessionSettings Candidate = Settings;
+        Candidate.ExecutionProvider = Provider;
+        Configurations.Add(Candidate);
+    }
+
+    TArray<FOnnxBenchmarkResult> Results = FOnnxBenchmark::RunConfigurations(Factory, Configurations, Params, ModelKey);
+
+    const FOnnxBenchmarkResult* Best = nullptr;
+    for (const FOnnxBenchmarkResult& Result : Results)
+    {
+        if (Result.bSucceeded && (!Best || Result.MeanLatencyMs < Best->MeanLatencyMs))
+        {
+            Best = &Result;
+        }
+    }
+
+    if (Best)
+    {
+        Selected.ExecutionProvider = Best->Settings.ExecutionProvider;
+        FOnnxAutotuner::SaveSelectedProvider(ModelKey, Selected.ExecutionProvider, *Best);
+        UE_LOG(LogTemp, Log, TEXT("Selected execution provider %s for %s (mean %.2fms)"),
+               GetDisplayName(Selected.ExecutionProvider), *ModelKey, Best->MeanLatencyMs);
+    }
+    else
+    {
+        UE_LOG(LogTemp, Warning, TEXT("No execution provider succeeded for %s, using CPU"), *ModelKey);
+        Selected.ExecutionProvider = EOnnxExecutionProvider::CPU;
+    }
+
+    if (OutResults)
+    {
+        *OutResults = MoveTemp(Results);
+    }
+    return Selected;
+}
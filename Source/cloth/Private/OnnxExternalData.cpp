@@ -0,0 +1,190 @@
+// OnnxExternalData.cpp
+
+#include "OnnxExternalData.h"
+#include "OnnxRuntime.h"
+#include "Async/MappedFileHandle.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+
+#include <string>
+#include <vector>
+
+FCriticalSection FOnnxExternalDataRegistry::Mutex;
+TMap<FString, TWeakPtr<FOnnxMappedExternalFile, ESPMode::ThreadSafe>> FOnnxExternalDataRegistry::MappedFiles;
+
+FOnnxMappedExternalFile::FOnnxMappedExternalFile(const FString& InFullPath, IMappedFileHandle* InHandle, IMappedFileRegion* InRegion)
+    : fullPath_(InFullPath)
+    , handle_(InHandle)
+    , region_(InRegion)
+{
+}
+
+FOnnxMappedExternalFile::~FOnnxMappedExternalFile()
+{
+    // 区域必须先于句柄释放
+    delete region_;
+    region_ = nullptr;
+    delete handle_;
+    handle_ = nullptr;
+
+    UE_LOG(LogTemp, Log, TEXT("Unmapped ONNX external data: %s"), *fullPath_);
+}
+
+const uint8* FOnnxMappedExternalFile::GetData() const
+{
+    return region_ ? region_->GetMappedPtr() : nullptr;
+}
+
+int64 FOnnxMappedExternalFile::GetSize() const
+{
+    return region_ ? region_->GetMappedSize() : 0;
+}
+
+FOnnxMappedExternalFilePtr FOnnxExternalDataRegistry::FindOrMap(const FString& FilePath)
+{
+    const FString FullPath = FPaths::ConvertRelativePathToFull(FilePath);
+
+    FScopeLock Lock(&Mutex);
+
+    if (TWeakPtr<FOnnxMappedExternalFile, ESPMode::ThreadSafe>* Existing = MappedFiles.Find(FullPath))
+    {
+        FOnnxMappedExternalFilePtr Pinned = Existing->Pin();
+        if (Pinned.IsValid())
+        {
+            UE_LOG(LogTemp, Log, TEXT("Reusing mapped ONNX external data: %s"), *FullPath);
+            return Pinned;
+        }
+    }
+
+    IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+    const int64 FileSize = PlatformFile.FileSize(*FullPath);
+    if (FileSize <= 0)
+    {
+        UE_LOG(LogTemp, Error, TEXT("ONNX external data file not found or empty: %s"), *FullPath);
+        return nullptr;
+    }
+
+    IMappedFileHandle* Handle = PlatformFile.OpenMapped(*FullPath);
+    if (!Handle)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to memory-map ONNX external data: %s"), *FullPath);
+        return nullptr;
+    }
+
+    IMappedFileRegion* Region = Handle->MapRegion(0, FileSize);
+    if (!Region)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to map region of ONNX external data: %s"), *FullPath);
+        delete Handle;
+        return nullptr;
+    }
+
+    FOnnxMappedExternalFilePtr NewMapping = MakeShared<FOnnxMappedExternalFile, ESPMode::ThreadSafe>(FullPath, Handle, Region);
+    MappedFiles.Add(FullPath, NewMapping);
+
+    UE_LOG(LogTemp, Log, TEXT("Mapped ONNX external data: %s (%lld bytes)"), *FullPath, FileSize);
+    return NewMapping;
+}
+
+TArray<FString> FOnnxExternalDataRegistry::FindExternalDataFiles(const FString& ModelPath)
+{
+    TArray<FString> Result;
+    if (ModelPath.IsEmpty())
+    {
+        return Result;
+    }
+
+    const FString Directory = FPaths::GetPath(ModelPath);
+    const FString CleanName = FPaths::GetCleanFilename(ModelPath);
+    const FString BaseName = FPaths::GetBaseFilename(ModelPath);
+
+    // torch.onnx/onnx.save_model常见的外部数据命名方式
+    const FString Candidates[] = {
+        CleanName + TEXT(".data"),
+        CleanName + TEXT("_data"),
+        BaseName + TEXT(".data"),
+    };
+
+    for (const FString& Candidate : Candidates)
+    {
+        const FString CandidatePath = FPaths::Combine(Directory, Candidate);
+        if (FPaths::FileExists(CandidatePath))
+        {
+            Result.AddUnique(CandidatePath);
+        }
+    }
+
+    return Result;
+}
+
+bool FOnnxExternalDataRegistry::ApplyToSessionOptions(Ort::SessionOptions& SessionOptions, const TArray<FString>& FilePaths,
+                                                      TArray<FOnnxMappedExternalFilePtr>& OutMappings)
+{
+    if (FilePaths.Num() == 0)
+    {
+        return true;
+    }
+
+    std::vector<std::basic_string<ORTCHAR_T>> FileNames;
+    std::vector<char*> FileBuffers;
+    std::vector<size_t> FileLengths;
+
+    for (const FString& FilePath : FilePaths)
+    {
+        FOnnxMappedExternalFilePtr Mapping = FindOrMap(FilePath);
+        if (!Mapping.IsValid())
+        {
+            return false;
+        }
+
+        // 模型中记录的location是相对于模型文件的文件名
+        FileNames.push_back(FOnnxRuntime::ToOrtString(FPaths::GetCleanFilename(FilePath)));
+        // ORT只读取这块内存，这里的const_cast只是为了匹配C API签名
+        FileBuffers.push_back(reinterpret_cast<char*>(const_cast<uint8*>(Mapping->GetData())));
+        FileLengths.push_back(static_cast<size_t>(Mapping->GetSize()));
+        OutMappings.Add(Mapping);
+    }
+
+    try
+    {
+        SessionOptions.AddExternalInitializersFromFilesInMemory(FileNames, FileBuffers, FileLengths);
+    }
+    catch (const Ort::Exception& e)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to add external initializers: %s"), UTF8_TO_TCHAR(e.what()));
+        return false;
+    }
+
+    return true;
+}
+
+int32 FOnnxExternalDataRegistry::GetNumMappedFiles()
+{
+    FScopeLock Lock(&Mutex);
+
+    int32 NumMapped = 0;
+    for (const auto& Pair : MappedFiles)
+    {
+        if (Pair.Value.IsValid())
+        {
+            ++NumMapped;
+        }
+    }
+    return NumMapped;
+}
+
+int64 FOnnxExternalDataRegistry::GetMappedBytes()
+{
+    FScopeLock Lock(&Mutex);
+
+    int64 TotalBytes = 0;
+    for (const auto& Pair : MappedFiles)
+    {
+        if (FOnnxMappedExternalFilePtr Pinned = Pair.Value.Pin())
+        {
+            TotalBytes += Pinned->GetSize();
+        }
+    }
+    return TotalBytes;
+}
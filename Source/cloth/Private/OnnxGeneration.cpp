@@ -0,0 +1,510 @@
+// OnnxGeneration.cpp
+
+#include "OnnxGeneration.h"
+#include "OnnxModelInstance.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/ScopeLock.h"
+
+#include <algorithm>
+
+FString FOnnxGenerationStats::ToString() const
+{
+    return FString::Printf(TEXT("batch=%d prompt=%d generated=%d ttft=%.1fms %.1f tok/s total=%.1fms"),
+                           BatchSize, PromptTokens, GeneratedTokens, TimeToFirstTokenMs, TokensPerSecond, TotalMs);
+}
+
+FOnnxGenerator::FOnnxGenerator(FOnnxModelInstance& InInstance, const FOnnxGeneratorConfig& InConfig)
+    : instance_(InInstance)
+    , config_(InConfig)
+{
+}
+
+bool FOnnxGenerator::Initialize()
+{
+    FScopeLock Lock(&mutex_);
+
+    inputIdsName_.clear();
+    attentionMaskName_.clear();
+    positionIdsName_.clear();
+    logitsName_.clear();
+    kvTensors_.Reset();
+    capacityBatch_ = 0;
+    vocabSize_ = 0;
+    bInitialized_ = false;
+
+    bool bValid = true;
+    try
+    {
+        const bool bHasSession = instance_.WithSession([this, &bValid](Ort::Session& Session)
+        {
+            Ort::AllocatorWithDefaultOptions allocator;
+
+            TSet<FString> outputNames;
+            for (size_t i = 0; i < Session.GetOutputCount(); ++i)
+            {
+                auto outputName = Session.GetOutputNameAllocated(i, allocator);
+                const FString name = UTF8_TO_TCHAR(outputName.get());
+                outputNames.Add(name);
+
+                if (name == config_.LogitsName)
+                {
+                    logitsName_ = outputName.get();
+                    const std::vector<int64_t> shape = Session.GetOutputTypeInfo(i).GetTensorTypeAndShapeInfo().GetShape();
+                    vocabSize_ = shape.empty() ? 0 : FMath::Max<int64>(0, shape.back()); // 动态时在预填充后确定
+                }
+            }
+
+            for (size_t i = 0; i < Session.GetInputCount(); ++i)
+            {
+                auto inputName = Session.GetInputNameAllocated(i, allocator);
+                const FString name = UTF8_TO_TCHAR(inputName.get());
+
+                Ort::TypeInfo typeInfo = Session.GetInputTypeInfo(i);
+                auto tensorInfo = typeInfo.GetTensorTypeAndShapeInfo();
+
+                if (name == config_.InputIdsName || name == config_.AttentionMaskName || name == config_.PositionIdsName)
+                {
+                    if (tensorInfo.GetElementType() != ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64)
+                    {
+                        UE_LOG(LogTemp, Error, TEXT("Generator: input %s must be int64"), *name);
+                        bValid = false;
+                        continue;
+                    }
+
+                    std::string& target = name == config_.InputIdsName ? inputIdsName_
+                        : name == config_.AttentionMaskName ? attentionMaskName_ : positionIdsName_;
+                    target = inputName.get();
+                }
+                else if (name.StartsWith(config_.PastPrefix))
+                {
+                    const FString presentName = config_.PresentPrefix + name.RightChop(config_.PastPrefix.Len());
+                    const std::vector<int64_t> shape = tensorInfo.GetShape();
+                    if (!outputNames.Contains(presentName) || shape.size() != 4 || shape[1] <= 0 || shape[3] <= 0
+                        || tensorInfo.GetElementType() != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT)
+                    {
+                        UE_LOG(LogTemp, Error, TEXT("Generator: unsupported KV input %s (expected float [batch, heads, seq, head_dim] with output %s)"),
+                               *name, *presentName);
+                        bValid = false;
+                        continue;
+                    }
+
+                    TUniquePtr<FKvTensor> kv = MakeUnique<FKvTensor>();
+                    kv->PastName = inputName.get();
+                    kv->PresentName = TCHAR_TO_UTF8(*presentName);
+                    kv->NumHeads = shape[1];
+                    kv->HeadDim = shape[3];
+                    kvTensors_.Add(MoveTemp(kv));
+                }
+                else
+                {
+                    UE_LOG(LogTemp, Error, TEXT("Generator: unexpected model input %s"), *name);
+                    bValid = false;
+                }
+            }
+        });
+
+        if (!bHasSession)
+        {
+            UE_LOG(LogTemp, Error, TEXT("Generator: session not ready"));
+            return false;
+        }
+    }
+    catch (const Ort::Exception& e)
+    {
+        UE_LOG(LogTemp, Error, TEXT("ONNX Runtime error in Generator::Initialize: %s"), UTF8_TO_TCHAR(e.what()));
+        return false;
+    }
+
+    if (!bValid || inputIdsName_.empty() || attentionMaskName_.empty() || logitsName_.empty() || kvTensors_.Num() == 0)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Generator: model is not a decoder-only transformer with KV cache inputs"));
+        kvTensors_.Reset();
+        return false;
+    }
+
+    UE_LOG(LogTemp, Log, TEXT("Generator: %d KV tensors, vocab %lld, max sequence length %d"),
+           kvTensors_.Num(), vocabSize_, config_.MaxSequenceLength);
+    bInitialized_ = true;
+    return true;
+}
+
+void FOnnxGenerator::EnsureCapacity(int32 BatchSize)
+{
+    if (BatchSize <= capacityBatch_)
+    {
+        return;
+    }
+
+    for (const TUniquePtr<FKvTensor>& kv : kvTensors_)
+    {
+        const int64 elementCount = int64(BatchSize) * kv->NumHeads * config_.MaxSequenceLength * kv->HeadDim;
+        kv->Buffers[0].SetNumUninitialized(elementCount);
+        kv->Buffers[1].SetNumUninitialized(elementCount);
+    }
+    capacityBatch_ = BatchSize;
+
+    UE_LOG(LogTemp, Log, TEXT("Generator: KV cache resized for batch %d (%.1f MB)"), BatchSize, GetCacheBytes() / (1024.0 * 1024.0));
+}
+
+int64 FOnnxGenerator::GetCacheBytes() const
+{
+    int64 bytes = 0;
+    for (const TUniquePtr<FKvTensor>& kv : kvTensors_)
+    {
+        bytes += (kv->Buffers[0].Num() + kv->Buffers[1].Num()) * sizeof(float);
+    }
+    return bytes;
+}
+
+FOnnxGenerationStats FOnnxGenerator::GetLastStats() const
+{
+    FScopeLock Lock(&mutex_);
+    return lastStats_;
+}
+
+bool FOnnxGenerator::Generate(const TArray<int64>& PromptTokens, const FOnnxGenerationParams& Params, TArray<int64>& OutTokens,
+                              FOnnxGenerationStats* OutStats, const FOnnxTokenCallback& OnToken)
+{
+    TArray<FOnnxGenerationRequest> requests;
+    FOnnxGenerationRequest& request = requests.AddDefaulted_GetRef();
+    request.PromptTokens = PromptTokens;
+    request.Params = Params;
+
+    const bool bSucceeded = Generate(requests, OnToken);
+    OutTokens = MoveTemp(requests[0].OutputTokens);
+    if (OutStats)
+    {
+        *OutStats = requests[0].Stats;
+    }
+    return bSucceeded;
+}
+
+bool FOnnxGenerator::Generate(TArray<FOnnxGenerationRequest>& Requests, const FOnnxTokenCallback& OnToken)
+{
+    if (Requests.Num() == 0)
+    {
+        return true;
+    }
+
+    if (!IsInitialized() && !Initialize())
+    {
+        return false;
+    }
+
+    FScopeLock Lock(&mutex_);
+
+    bool bSucceeded = false;
+    try
+    {
+        const bool bHasSession = instance_.WithSession([&](Ort::Session& Session)
+        {
+            bSucceeded = GenerateBatch(Session, Requests, OnToken);
+        });
+        if (!bHasSession)
+        {
+            UE_LOG(LogTemp, Error, TEXT("Generator: session not ready"));
+        }
+    }
+    catch (const Ort::Exception& e)
+    {
+        UE_LOG(LogTemp, Error, TEXT("ONNX Runtime error in Generate: %s"), UTF8_TO_TCHAR(e.what()));
+        bSucceeded = false;
+    }
+    return bSucceeded;
+}
+
+bool FOnnxGenerator::GenerateBatch(Ort::Session& Session, TArray<FOnnxGenerationRequest>& Requests, const FOnnxTokenCallback& OnToken)
+{
+    const double startTime = FPlatformTime::Seconds();
+    const int32 batchSize = Requests.Num();
+    const int32 maxSequence = config_.MaxSequenceLength;
+
+    int32 promptLength = 0;
+    int32 maxNewTokens = 0;
+    for (FOnnxGenerationRequest& request : Requests)
+    {
+        if (request.PromptTokens.Num() == 0)
+        {
+            UE_LOG(LogTemp, Error, TEXT("Generator: empty prompt"));
+            return false;
+        }
+        promptLength = FMath::Max(promptLength, request.PromptTokens.Num());
+        maxNewTokens = FMath::Max(maxNewTokens, request.Params.MaxNewTokens);
+        request.OutputTokens.Reset();
+        request.Stats = FOnnxGenerationStats();
+    }
+
+    if (promptLength >= maxSequence)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Generator: prompt length %d exceeds MaxSequenceLength %d"), promptLength, maxSequence);
+        return false;
+    }
+    maxNewTokens = FMath::Min(maxNewTokens, maxSequence - promptLength);
+
+    EnsureCapacity(batchSize);
+
+    // 左填充：所有序列的最后一个提示词对齐在同一位置，填充位置的注意力掩码为0
+    TArray<int64> inputIds;
+    TArray<int64> positions;
+    TArray<int64> maskRows; // [Batch, MaxSequenceLength]
+    TArray<int64> nextPosition;
+    inputIds.SetNumUninitialized(batchSize * promptLength);
+    positions.SetNumUninitialized(batchSize * promptLength);
+    maskRows.SetNumZeroed(batchSize * maxSequence);
+    nextPosition.SetNumUninitialized(batchSize);
+
+    TArray<FRandomStream> randoms;
+    for (int32 b = 0; b < batchSize; ++b)
+    {
+        const FOnnxGenerationRequest& request = Requests[b];
+        const int32 padding = promptLength - request.PromptTokens.Num();
+        for (int32 t = 0; t < promptLength; ++t)
+        {
+            const bool bPad = t < padding;
+            inputIds[b * promptLength + t] = bPad ? request.Params.PadTokenId : request.PromptTokens[t - padding];
+            positions[b * promptLength + t] = bPad ? 1 : t - padding;
+            maskRows[b * maxSequence + t] = bPad ? 0 : 1;
+        }
+        nextPosition[b] = request.PromptTokens.Num();
+
+        randoms.Emplace(request.Params.Seed != 0 ? request.Params.Seed : static_cast<int32>(FPlatformTime::Cycles() + b));
+    }
+
+    Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+    Ort::IoBinding binding(Session);
+    TArray<int64> attention;
+    int32 current = 0;
+
+    // 运行一步：SeqLength个新词，PastLength个已缓存的位置
+    auto runStep = [&](int32 SeqLength, int32 PastLength, bool bPrefill)
+    {
+        binding.ClearBoundInputs();
+        binding.ClearBoundOutputs();
+
+        const int32 totalLength = PastLength + SeqLength;
+        attention.SetNumUninitialized(batchSize * totalLength);
+        for (int32 b = 0; b < batchSize; ++b)
+        {
+            FMemory::Memcpy(&attention[b * totalLength], &maskRows[b * maxSequence], totalLength * sizeof(int64));
+        }
+
+        // 绑定期间这些张量必须保持有效
+        std::vector<Ort::Value> values;
+        values.reserve(3 + kvTensors_.Num() * 2 + 1);
+
+        const int64_t idsShape[] = { batchSize, SeqLength };
+        values.push_back(Ort::Value::CreateTensor<int64_t>(memoryInfo, reinterpret_cast<int64_t*>(inputIds.GetData()), inputIds.Num(), idsShape, 2));
+        binding.BindInput(inputIdsName_.c_str(), values.back());
+
+        const int64_t maskShape[] = { batchSize, totalLength };
+        values.push_back(Ort::Value::CreateTensor<int64_t>(memoryInfo, reinterpret_cast<int64_t*>(attention.GetData()), attention.Num(), maskShape, 2));
+        binding.BindInput(attentionMaskName_.c_str(), values.back());
+
+        if (!positionIdsName_.empty())
+        {
+            values.push_back(Ort::Value::CreateTensor<int64_t>(memoryInfo, reinterpret_cast<int64_t*>(positions.GetData()), positions.Num(), idsShape, 2));
+            binding.BindInput(positionIdsName_.c_str(), values.back());
+        }
+
+        // past引用当前缓冲区的前 B*H*Past*D 个元素，present直接写入另一个缓冲区
+        for (const TUniquePtr<FKvTensor>& kv : kvTensors_)
+        {
+            const int64_t pastShape[] = { batchSize, kv->NumHeads, PastLength, kv->HeadDim };
+            const int64_t presentShape[] = { batchSize, kv->NumHeads, totalLength, kv->HeadDim };
+            float* pastData = kv->Buffers[current].GetData();
+            float* presentData = kv->Buffers[1 - current].GetData();
+
+            values.push_back(Ort::Value::CreateTensor<float>(memoryInfo, pastData, int64(batchSize) * kv->NumHeads * PastLength * kv->HeadDim, pastShape, 4));
+            binding.BindInput(kv->PastName.c_str(), values.back());
+
+            values.push_back(Ort::Value::CreateTensor<float>(memoryInfo, presentData, int64(batchSize) * kv->NumHeads * totalLength * kv->HeadDim, presentShape, 4));
+            binding.BindOutput(kv->PresentName.c_str(), values.back());
+        }
+
+        // 预填充的logits形状随提示长度变化，由ORT分配；解码阶段写入预分配的缓冲区
+        if (bPrefill)
+        {
+            binding.BindOutput(logitsName_.c_str(), memoryInfo);
+        }
+        else
+        {
+            const int64_t logitsShape[] = { batchSize, 1, vocabSize_ };
+            values.push_back(Ort::Value::CreateTensor<float>(memoryInfo, logitsBuffer_.GetData(), logitsBuffer_.Num(), logitsShape, 3));
+            binding.BindOutput(logitsName_.c_str(), values.back());
+        }
+
+        Session.Run(Ort::RunOptions{nullptr}, binding);
+        current = 1 - current;
+    };
+
+    TArray<bool> finished;
+    finished.Init(false, batchSize);
+    TArray<TPair<float, int32>> scratch;
+    int32 numActive = batchSize;
+
+    // 对每个未结束的序列采样，并准备下一步的输入
+    auto sampleStep = [&](const float* Logits, int64 RowStride, int32 TotalLength)
+    {
+        inputIds.SetNumUninitialized(batchSize);
+        positions.SetNumUninitialized(batchSize);
+
+        for (int32 b = 0; b < batchSize; ++b)
+        {
+            FOnnxGenerationRequest& request = Requests[b];
+            int64 token = request.Params.PadTokenId;
+
+            if (!finished[b])
+            {
+                token = SampleToken(Logits + b * RowStride, vocabSize_, request.Params, randoms[b], scratch);
+
+                bool bStop = request.Params.StopTokens.Contains(token);
+                if (!bStop)
+                {
+                    request.OutputTokens.Add(token);
+                    bStop = (OnToken && !OnToken(b, token)) || request.OutputTokens.Num() >= request.Params.MaxNewTokens;
+                }
+                if (bStop)
+                {
+                    finished[b] = true;
+                    --numActive;
+                }
+            }
+
+            inputIds[b] = finished[b] ? request.Params.PadTokenId : token;
+            positions[b] = nextPosition[b]++;
+            if (TotalLength < maxSequence)
+            {
+                maskRows[b * maxSequence + TotalLength] = 1;
+            }
+        }
+    };
+
+    // 预填充
+    runStep(promptLength, 0, true);
+    {
+        std::vector<Ort::Value> outputs = binding.GetOutputValues();
+        Ort::Value& logits = outputs[0];
+        const std::vector<int64_t> logitsShape = logits.GetTensorTypeAndShapeInfo().GetShape();
+        if (logitsShape.size() != 3 || logitsShape[1] != promptLength)
+        {
+            UE_LOG(LogTemp, Error, TEXT("Generator: unexpected logits shape"));
+            return false;
+        }
+        vocabSize_ = logitsShape[2];
+        logitsBuffer_.SetNumUninitialized(batchSize * vocabSize_);
+
+        // 每行最后一个位置的logits
+        sampleStep(logits.GetTensorData<float>() + (promptLength - 1) * vocabSize_, promptLength * vocabSize_, promptLength);
+    }
+    const double firstTokenTime = FPlatformTime::Seconds();
+
+    // 解码
+    int32 totalLength = promptLength;
+    for (int32 step = 1; step < maxNewTokens && numActive > 0; ++step)
+    {
+        runStep(1, totalLength, false);
+        ++totalLength;
+        sampleStep(logitsBuffer_.GetData(), vocabSize_, totalLength);
+    }
+    const double endTime = FPlatformTime::Seconds();
+
+    // 统计
+    const double decodeSeconds = endTime - firstTokenTime;
+    lastStats_ = FOnnxGenerationStats();
+    lastStats_.BatchSize = batchSize;
+    lastStats_.TimeToFirstTokenMs = static_cast<float>((firstTokenTime - startTime) * 1000.0);
+    lastStats_.TotalMs = static_cast<float>((endTime - startTime) * 1000.0);
+
+    int32 decodedTokens = 0;
+    for (FOnnxGenerationRequest& request : Requests)
+    {
+        request.Stats.BatchSize = batchSize;
+        request.Stats.PromptTokens = request.PromptTokens.Num();
+        request.Stats.GeneratedTokens = request.OutputTokens.Num();
+        request.Stats.TimeToFirstTokenMs = lastStats_.TimeToFirstTokenMs;
+        request.Stats.TotalMs = lastStats_.TotalMs;
+        request.Stats.TokensPerSecond = decodeSeconds > 0.0 ? static_cast<float>(FMath::Max(0, request.OutputTokens.Num() - 1) / decodeSeconds) : 0.0f;
+
+        lastStats_.PromptTokens += request.Stats.PromptTokens;
+        lastStats_.GeneratedTokens += request.Stats.GeneratedTokens;
+        decodedTokens += FMath::Max(0, request.OutputTokens.Num() - 1);
+    }
+    lastStats_.TokensPerSecond = decodeSeconds > 0.0 ? static_cast<float>(decodedTokens / decodeSeconds) : 0.0f;
+
+    UE_LOG(LogTemp, Log, TEXT("Generator: %s"), *lastStats_.ToString());
+    return true;
+}
+
+int64 FOnnxGenerator::SampleToken(const float* Logits, int64 VocabSize, const FOnnxGenerationParams& Params,
+                                  FRandomStream& Random, TArray<TPair<float, int32>>& Scratch)
+{
+    // 贪心
+    if (Params.Temperature <= 0.0f || Params.TopK == 1)
+    {
+        int64 best = 0;
+        for (int64 i = 1; i < VocabSize; ++i)
+        {
+            if (Logits[i] > Logits[best])
+            {
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    Scratch.SetNumUninitialized(VocabSize);
+    const float invTemperature = 1.0f / Params.Temperature;
+    for (int64 i = 0; i < VocabSize; ++i)
+    {
+        Scratch[i] = TPair<float, int32>(Logits[i] * invTemperature, static_cast<int32>(i));
+    }
+
+    auto byScoreDescending = [](const TPair<float, int32>& A, const TPair<float, int32>& B) { return A.Key > B.Key; };
+    TPair<float, int32>* begin = Scratch.GetData();
+    int64 count = VocabSize;
+
+    // Top-k：只保留分数最高的k个
+    if (Params.TopK > 0 && Params.TopK < count)
+    {
+        std::nth_element(begin, begin + Params.TopK, begin + count, byScoreDescending);
+        count = Params.TopK;
+    }
+
+    // 按分数降序，softmax（减去最大值保证数值稳定）
+    std::sort(begin, begin + count, byScoreDescending);
+    const float maxScore = begin[0].Key;
+    double sum = 0.0;
+    for (int64 i = 0; i < count; ++i)
+    {
+        begin[i].Key = FMath::Exp(begin[i].Key - maxScore);
+        sum += begin[i].Key;
+    }
+
+    // Top-p：保留累计概率达到TopP的最小前缀
+    if (Params.TopP < 1.0f)
+    {
+        const double threshold = FMath::Max(0.0f, Params.TopP) * sum;
+        double cumulative = 0.0;
+        for (int64 i = 0; i < count; ++i)
+        {
+            cumulative += begin[i].Key;
+            if (cumulative >= threshold)
+            {
+                count = i + 1;
+                break;
+            }
+        }
+        sum = cumulative;
+    }
+
+    double r = Random.FRand() * sum;
+    for (int64 i = 0; i < count; ++i)
+    {
+        r -= begin[i].Key;
+        if (r <= 0.0)
+        {
+            return begin[i].Value;
+        }
+    }
+    return begin[count - 1].Value;
+}
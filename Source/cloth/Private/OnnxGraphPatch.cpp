@@ -0,0 +1,799 @@
+// OnnxGraphPatch.cpp
+
+#include "OnnxGraphPatch.h"
+
+namespace
+{
+    // onnx.proto中用到的字段号
+    constexpr int32 ModelGraphField = 7;
+    constexpr int32 GraphNodeField = 1;
+    constexpr int32 GraphInitializerField = 5;
+    constexpr int32 GraphInputField = 11;
+    constexpr int32 GraphOutputField = 12;
+    constexpr int32 GraphValueInfoField = 13;
+    constexpr int32 NodeInputField = 1;
+    constexpr int32 NodeOutputField = 2;
+    constexpr int32 NodeNameField = 3;
+    constexpr int32 NodeAttributeField = 5;
+    constexpr int32 AttributeGraphField = 6;
+    constexpr int32 AttributeGraphsField = 11;
+    constexpr int32 TensorNameField = 8;
+    constexpr int32 ValueInfoNameField = 1;
+    constexpr int32 ValueInfoTypeField = 2;
+    constexpr int32 TypeTensorField = 1;
+    constexpr int32 TensorTypeElemTypeField = 1;
+    constexpr int32 TensorTypeShapeField = 2;
+    constexpr int32 ShapeDimField = 1;
+    constexpr int32 DimValueField = 1;
+    constexpr int32 DimParamField = 2;
+
+    constexpr int32 WireVarint = 0;
+    constexpr int32 Wire64Bit = 1;
+    constexpr int32 WireLengthDelimited = 2;
+    constexpr int32 Wire32Bit = 5;
+
+    // 一个已解析字段在缓冲区中的位置
+    struct FWireField
+    {
+        int32 Number = 0;
+        int32 WireType = 0;
+        int64 Start = 0;        // 包含标签
+        int64 End = 0;
+        int64 PayloadStart = 0; // 仅长度限定字段
+        int64 PayloadEnd = 0;
+    };
+
+    bool ReadVarint(const uint8* Data, int64 End, int64& Pos, uint64& OutValue)
+    {
+        OutValue = 0;
+        for (int32 Shift = 0; Shift < 64 && Pos < End; Shift += 7)
+        {
+            const uint8 Byte = Data[Pos++];
+            OutValue |= uint64(Byte & 0x7f) << Shift;
+            if ((Byte & 0x80) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 解析[Begin, End)范围内的一层消息字段
+    bool ParseFields(const uint8* Data, int64 Begin, int64 End, TArray<FWireField>& OutFields)
+    {
+        int64 Pos = Begin;
+        while (Pos < End)
+        {
+            FWireField Field;
+            Field.Start = Pos;
+
+            uint64 Tag = 0;
+            if (!ReadVarint(Data, End, Pos, Tag))
+            {
+                return false;
+            }
+            Field.Number = static_cast<int32>(Tag >> 3);
+            Field.WireType = static_cast<int32>(Tag & 7);
+
+            uint64 Value = 0;
+            switch (Field.WireType)
+            {
+            case WireVarint:
+                if (!ReadVarint(Data, End, Pos, Value))
+                {
+                    return false;
+                }
+                break;
+            case Wire64Bit:
+                Pos += 8;
+                break;
+            case Wire32Bit:
+                Pos += 4;
+                break;
+            case WireLengthDelimited:
+                if (!ReadVarint(Data, End, Pos, Value) || Value > uint64(End - Pos))
+                {
+                    return false;
+                }
+                Field.PayloadStart = Pos;
+                Field.PayloadEnd = Pos + static_cast<int64>(Value);
+                Pos = Field.PayloadEnd;
+                break;
+            default:
+                // ONNX不使用已废弃的group
+                return false;
+            }
+
+            if (Pos > End)
+            {
+                return false;
+            }
+            Field.End = Pos;
+            OutFields.Add(Field);
+        }
+        return true;
+    }
+
+    FString ReadString(const uint8* Data, const FWireField& Field)
+    {
+        const FUTF8ToTCHAR Converted(reinterpret_cast<const ANSICHAR*>(Data + Field.PayloadStart), static_cast<int32>(Field.PayloadEnd - Field.PayloadStart));
+        return FString(Converted.Length(), Converted.Get());
+    }
+
+    void AppendVarint(TArray<uint8>& Out, uint64 Value)
+    {
+        while (Value >= 0x80)
+        {
+            Out.Add(static_cast<uint8>(Value | 0x80));
+            Value >>= 7;
+        }
+        Out.Add(static_cast<uint8>(Value));
+    }
+
+    void AppendLengthDelimited(TArray<uint8>& Out, int32 Number, const uint8* Payload, int64 Length)
+    {
+        AppendVarint(Out, (uint64(Number) << 3) | WireLengthDelimited);
+        AppendVarint(Out, Length);
+        Out.Append(Payload, Length);
+    }
+
+    void AppendVarintField(TArray<uint8>& Out, int32 Number, uint64 Value)
+    {
+        AppendVarint(Out, (uint64(Number) << 3) | WireVarint);
+        AppendVarint(Out, Value);
+    }
+
+    void AppendStringField(TArray<uint8>& Out, int32 Number, const FString& Value)
+    {
+        const FTCHARToUTF8 Utf8(*Value);
+        AppendLengthDelimited(Out, Number, reinterpret_cast<const uint8*>(Utf8.Get()), Utf8.Length());
+    }
+
+    void AppendRaw(TArray<uint8>& Out, const uint8* Data, const FWireField& Field)
+    {
+        Out.Append(Data + Field.Start, Field.End - Field.Start);
+    }
+
+    // 消息中第一个指定编号的字符串字段
+    FString ReadStringField(const uint8* Data, const FWireField& Field, int32 Number)
+    {
+        TArray<FWireField> Fields;
+        if (ParseFields(Data, Field.PayloadStart, Field.PayloadEnd, Fields))
+        {
+            for (const FWireField& Child : Fields)
+            {
+                if (Child.Number == Number && Child.WireType == WireLengthDelimited)
+                {
+                    return ReadString(Data, Child);
+                }
+            }
+        }
+        return FString();
+    }
+
+    // ValueInfoProto（图输入/输出）的名称
+    FString ReadValueInfoName(const uint8* Data, const FWireField& Field)
+    {
+        return ReadStringField(Data, Field, ValueInfoNameField);
+    }
+
+    // 只带名称和张量类型的ValueInfoProto，动态维度写成dim_param
+    void AppendTypedValueInfo(TArray<uint8>& Out, int32 Number, const FString& Name, const FOnnxGraphTensorType& Type)
+    {
+        TArray<uint8> Shape;
+        for (int32 i = 0; i < Type.Shape.Num(); ++i)
+        {
+            TArray<uint8> Dim;
+            if (Type.Shape[i] >= 0)
+            {
+                AppendVarintField(Dim, DimValueField, static_cast<uint64>(Type.Shape[i]));
+            }
+            else
+            {
+                AppendStringField(Dim, DimParamField, FString::Printf(TEXT("%s_dim%d"), *Name, i));
+            }
+            AppendLengthDelimited(Shape, ShapeDimField, Dim.GetData(), Dim.Num());
+        }
+
+        TArray<uint8> TensorType;
+        AppendVarintField(TensorType, TensorTypeElemTypeField, static_cast<uint64>(Type.ElementType));
+        AppendLengthDelimited(TensorType, TensorTypeShapeField, Shape.GetData(), Shape.Num());
+
+        TArray<uint8> TypeProto;
+        AppendLengthDelimited(TypeProto, TypeTensorField, TensorType.GetData(), TensorType.Num());
+
+        TArray<uint8> ValueInfo;
+        AppendStringField(ValueInfo, ValueInfoNameField, Name);
+        AppendLengthDelimited(ValueInfo, ValueInfoTypeField, TypeProto.GetData(), TypeProto.Num());
+        AppendLengthDelimited(Out, Number, ValueInfo.GetData(), ValueInfo.Num());
+    }
+
+    struct FNodeInfo
+    {
+        FWireField Field;
+        FString Name;
+        TArray<FString> Inputs;
+        TArray<FString> Outputs;
+        bool bHasSubgraph = false;
+    };
+
+    bool ParseNode(const uint8* Data, const FWireField& Field, FNodeInfo& OutNode)
+    {
+        OutNode.Field = Field;
+
+        TArray<FWireField> Fields;
+        if (!ParseFields(Data, Field.PayloadStart, Field.PayloadEnd, Fields))
+        {
+            return false;
+        }
+
+        for (const FWireField& Child : Fields)
+        {
+            if (Child.WireType != WireLengthDelimited)
+            {
+                continue;
+            }
+
+            if (Child.Number == NodeInputField)
+            {
+                OutNode.Inputs.Add(ReadString(Data, Child));
+            }
+            else if (Child.Number == NodeOutputField)
+            {
+                OutNode.Outputs.Add(ReadString(Data, Child));
+            }
+            else if (Child.Number == NodeNameField)
+            {
+                OutNode.Name = ReadString(Data, Child);
+            }
+            else if (Child.Number == NodeAttributeField)
+            {
+                TArray<FWireField> AttributeFields;
+                if (ParseFields(Data, Child.PayloadStart, Child.PayloadEnd, AttributeFields))
+                {
+                    OutNode.bHasSubgraph |= AttributeFields.ContainsByPredicate([](const FWireField& Attribute)
+                    {
+                        return Attribute.Number == AttributeGraphField || Attribute.Number == AttributeGraphsField;
+                    });
+                }
+            }
+        }
+        return true;
+    }
+
+    // 解析后的模型：ModelProto和GraphProto的顶层字段，以及节点、初始值和图输入/输出
+    struct FParsedModel
+    {
+        TArray<FWireField> ModelFields;
+        int32 GraphFieldIndex = INDEX_NONE;
+        TArray<FWireField> GraphFields;
+
+        TArray<FNodeInfo> Nodes;
+        TMap<FString, int32> Producers;
+        TMap<FString, int64> InitializerBytes;
+        TMap<FString, const FWireField*> Inputs;
+        TMap<FString, const FWireField*> ExistingOutputs;
+        TArray<FString> InputOrder;
+        TArray<FString> OutputOrder;
+        bool bHasSubgraphs = false;
+
+        const FWireField& GetGraphField() const { return ModelFields[GraphFieldIndex]; }
+    };
+
+    bool ParseModel(const TArray<uint8>& ModelData, FParsedModel& Out, FString& OutError)
+    {
+        const uint8* Data = ModelData.GetData();
+
+        // ModelProto -> GraphProto
+        if (!ParseFields(Data, 0, ModelData.Num(), Out.ModelFields))
+        {
+            OutError = TEXT("model is not a valid ONNX protobuf");
+            return false;
+        }
+
+        for (int32 i = 0; i < Out.ModelFields.Num(); ++i)
+        {
+            const FWireField& Field = Out.ModelFields[i];
+            if (Field.Number == ModelGraphField && Field.WireType == WireLengthDelimited)
+            {
+                if (Out.GraphFieldIndex != INDEX_NONE)
+                {
+                    OutError = TEXT("model has more than one graph field");
+                    return false;
+                }
+                Out.GraphFieldIndex = i;
+            }
+        }
+        if (Out.GraphFieldIndex == INDEX_NONE)
+        {
+            OutError = TEXT("model has no graph");
+            return false;
+        }
+
+        const FWireField& GraphField = Out.GetGraphField();
+        if (!ParseFields(Data, GraphField.PayloadStart, GraphField.PayloadEnd, Out.GraphFields))
+        {
+            OutError = TEXT("graph is not a valid protobuf message");
+            return false;
+        }
+
+        // 收集节点、初始值和图输入/输出
+        for (const FWireField& Field : Out.GraphFields)
+        {
+            if (Field.WireType != WireLengthDelimited)
+            {
+                continue;
+            }
+
+            if (Field.Number == GraphNodeField)
+            {
+                FNodeInfo& Node = Out.Nodes.AddDefaulted_GetRef();
+                if (!ParseNode(Data, Field, Node))
+                {
+                    OutError = TEXT("graph contains an invalid node");
+                    return false;
+                }
+                for (const FString& Output : Node.Outputs)
+                {
+                    Out.Producers.Add(Output, Out.Nodes.Num() - 1);
+                }
+                Out.bHasSubgraphs |= Node.bHasSubgraph;
+            }
+            else if (Field.Number == GraphInitializerField)
+            {
+                Out.InitializerBytes.Add(ReadStringField(Data, Field, TensorNameField), Field.PayloadEnd - Field.PayloadStart);
+            }
+            else if (Field.Number == GraphInputField)
+            {
+                const FString Name = ReadValueInfoName(Data, Field);
+                Out.Inputs.Add(Name, &Field);
+                Out.InputOrder.Add(Name);
+            }
+            else if (Field.Number == GraphOutputField)
+            {
+                const FString Name = ReadValueInfoName(Data, Field);
+                Out.ExistingOutputs.Add(Name, &Field);
+                Out.OutputOrder.Add(Name);
+            }
+        }
+        return true;
+    }
+
+    // 用新的GraphProto重新编码ModelProto，其余字段原样保留
+    void EncodeModel(const uint8* Data, const FParsedModel& Model, const TArray<uint8>& NewGraph, TArray<uint8>& OutData)
+    {
+        OutData.Reset(NewGraph.Num() + 1024);
+        for (int32 i = 0; i < Model.ModelFields.Num(); ++i)
+        {
+            if (i == Model.GraphFieldIndex)
+            {
+                AppendLengthDelimited(OutData, ModelGraphField, NewGraph.GetData(), NewGraph.Num());
+            }
+            else
+            {
+                AppendRaw(OutData, Data, Model.ModelFields[i]);
+            }
+        }
+    }
+}
+
+bool FOnnxGraphPatch::ExposeOutputs(const TArray<uint8>& ModelData, const TArray<FString>& OutputNames, bool bReplaceOutputs,
+                                    TArray<uint8>& OutPatchedData, FString& OutError)
+{
+    const uint8* Data = ModelData.GetData();
+
+    FParsedModel Model;
+    if (!ParseModel(ModelData, Model, OutError))
+    {
+        return false;
+    }
+    const TArray<FNodeInfo>& Nodes = Model.Nodes;
+    const TMap<FString, int32>& Producers = Model.Producers;
+    const TMap<FString, const FWireField*>& ExistingOutputs = Model.ExistingOutputs;
+    const FWireField* GraphField = &Model.GetGraphField();
+    const bool bHasSubgraphs = Model.bHasSubgraphs;
+
+    TArray<FString> Missing;
+    for (const FString& Name : OutputNames)
+    {
+        if (!Producers.Contains(Name) && !ExistingOutputs.Contains(Name))
+        {
+            Missing.Add(Name);
+        }
+    }
+    if (Missing.Num() > 0)
+    {
+        OutError = FString::Printf(TEXT("no node produces %s"), *FString::Join(Missing, TEXT(", ")));
+        return false;
+    }
+
+    // 特征提取模式：从请求的输出反向遍历，只保留参与计算它们的节点
+    const bool bPrune = bReplaceOutputs && !bHasSubgraphs;
+    TBitArray<> KeepNode(!bPrune, Nodes.Num());
+    TSet<FString> UsedNames(OutputNames);
+    if (bPrune)
+    {
+        TArray<FString> Pending = OutputNames;
+        while (Pending.Num() > 0)
+        {
+            const FString Name = Pending.Pop();
+            const int32* Producer = Producers.Find(Name);
+            if (!Producer || KeepNode[*Producer])
+            {
+                continue;
+            }
+
+            KeepNode[*Producer] = true;
+            for (const FString& Input : Nodes[*Producer].Inputs)
+            {
+                if (!Input.IsEmpty())
+                {
+                    UsedNames.Add(Input);
+                    Pending.Add(Input);
+                }
+            }
+        }
+    }
+    else if (bReplaceOutputs)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Graph patch: graph contains subgraphs, outputs are replaced but nodes are not pruned"));
+    }
+
+    // 重新编码GraphProto：其余字段原样保留
+    TArray<uint8> NewGraph;
+    NewGraph.Reserve(GraphField->PayloadEnd - GraphField->PayloadStart + OutputNames.Num() * 64);
+
+    int32 NodeIndex = 0;
+    int32 NumKeptNodes = 0;
+    for (const FWireField& Field : Model.GraphFields)
+    {
+        if (Field.Number == GraphNodeField && Field.WireType == WireLengthDelimited)
+        {
+            if (KeepNode[NodeIndex++])
+            {
+                AppendRaw(NewGraph, Data, Field);
+                ++NumKeptNodes;
+            }
+        }
+        else if (Field.Number == GraphInputField && Field.WireType == WireLengthDelimited)
+        {
+            // 裁剪后不再使用的图输入也一并移除，调用方不需要再提供它们
+            if (!bPrune || UsedNames.Contains(ReadValueInfoName(Data, Field)))
+            {
+                AppendRaw(NewGraph, Data, Field);
+            }
+        }
+        else if (Field.Number == GraphOutputField && Field.WireType == WireLengthDelimited)
+        {
+            if (!bReplaceOutputs)
+            {
+                AppendRaw(NewGraph, Data, Field);
+            }
+        }
+        else
+        {
+            AppendRaw(NewGraph, Data, Field);
+        }
+    }
+
+    // 新增的输出只带名称，类型由ORT从产生它的节点推断；已经是图输出的保留原有的类型信息
+    for (const FString& Name : OutputNames)
+    {
+        const FWireField* const* Existing = ExistingOutputs.Find(Name);
+        if (Existing && bReplaceOutputs)
+        {
+            AppendRaw(NewGraph, Data, **Existing);
+        }
+        else if (!Existing)
+        {
+            const FTCHARToUTF8 NameUtf8(*Name);
+            TArray<uint8> ValueInfo;
+            AppendLengthDelimited(ValueInfo, ValueInfoNameField, reinterpret_cast<const uint8*>(NameUtf8.Get()), NameUtf8.Length());
+            AppendLengthDelimited(NewGraph, GraphOutputField, ValueInfo.GetData(), ValueInfo.Num());
+        }
+    }
+
+    // 重新编码ModelProto
+    EncodeModel(Data, Model, NewGraph, OutPatchedData);
+
+    UE_LOG(LogTemp, Log, TEXT("Graph patch: exposed %d outputs, kept %d of %d nodes"), OutputNames.Num(), NumKeptNodes, Nodes.Num());
+    return true;
+}
+
+bool FOnnxGraphPatch::PlanStages(const TArray<uint8>& ModelData, const TArray<FString>& SplitNodes, int32 NumStages,
+                                 FOnnxGraphStagePlan& OutPlan, FString& OutError)
+{
+    OutPlan = FOnnxGraphStagePlan();
+
+    FParsedModel Model;
+    if (!ParseModel(ModelData, Model, OutError))
+    {
+        return false;
+    }
+    if (Model.bHasSubgraphs)
+    {
+        OutError = TEXT("graphs with subgraphs (If/Loop) cannot be split into stages");
+        return false;
+    }
+
+    const int32 NumNodes = Model.Nodes.Num();
+    if (NumNodes < 2)
+    {
+        OutError = TEXT("model has too few nodes to split");
+        return false;
+    }
+
+    // 每个节点用到的初始值字节数（共享的初始值只记在第一个使用它的节点上）
+    TArray<int64> NodeWeights;
+    NodeWeights.SetNumZeroed(NumNodes);
+    TSet<FString> CountedInitializers;
+    for (int32 i = 0; i < NumNodes; ++i)
+    {
+        for (const FString& Input : Model.Nodes[i].Inputs)
+        {
+            const int64* Bytes = Model.InitializerBytes.Find(Input);
+            bool bAlreadyCounted = false;
+            if (Bytes)
+            {
+                CountedInitializers.Add(Input, &bAlreadyCounted);
+                NodeWeights[i] += bAlreadyCounted ? 0 : *Bytes;
+            }
+        }
+    }
+
+    // 每个阶段的最后一个节点
+    TArray<int32> StageEnds;
+    if (SplitNodes.Num() > 0)
+    {
+        for (const FString& Name : SplitNodes)
+        {
+            int32 Index = Model.Nodes.IndexOfByPredicate([&Name](const FNodeInfo& Node) { return Node.Name == Name; });
+            if (Index == INDEX_NONE)
+            {
+                const int32* Producer = Model.Producers.Find(Name);
+                Index = Producer ? *Producer : INDEX_NONE;
+            }
+            if (Index == INDEX_NONE)
+            {
+                OutError = FString::Printf(TEXT("no node is named or produces %s"), *Name);
+                return false;
+            }
+            if (Index < NumNodes - 1)
+            {
+                StageEnds.AddUnique(Index);
+            }
+        }
+        StageEnds.Sort();
+    }
+    else
+    {
+        // 按权重均分；没有初始值的模型按节点数均分
+        NumStages = FMath::Clamp(NumStages, 2, NumNodes);
+        int64 TotalWeight = 0;
+        for (int64 Weight : NodeWeights)
+        {
+            TotalWeight += Weight;
+        }
+
+        int64 Accumulated = 0;
+        for (int32 i = 0; i < NumNodes - 1 && StageEnds.Num() < NumStages - 1; ++i)
+        {
+            Accumulated += TotalWeight > 0 ? NodeWeights[i] : 1;
+            const int64 Total = TotalWeight > 0 ? TotalWeight : NumNodes;
+            if (Accumulated * NumStages >= Total * (StageEnds.Num() + 1))
+            {
+                StageEnds.Add(i);
+            }
+        }
+    }
+    StageEnds.Add(NumNodes - 1);
+    if (StageEnds.Num() < 2)
+    {
+        OutError = TEXT("split points leave a single stage");
+        return false;
+    }
+
+    // 节点所属的阶段，以及每个张量最后被使用的阶段（原模型的输出一直保留到最后）
+    TArray<int32> NodeStage;
+    NodeStage.SetNum(NumNodes);
+    for (int32 i = 0, StageIndex = 0; i < NumNodes; ++i)
+    {
+        NodeStage[i] = StageIndex;
+        if (i == StageEnds[StageIndex])
+        {
+            ++StageIndex;
+        }
+    }
+
+    TMap<FString, int32> LastUse;
+    for (int32 i = 0; i < NumNodes; ++i)
+    {
+        for (const FString& Input : Model.Nodes[i].Inputs)
+        {
+            if (!Input.IsEmpty())
+            {
+                int32& Last = LastUse.FindOrAdd(Input, INDEX_NONE);
+                Last = FMath::Max(Last, NodeStage[i]);
+            }
+        }
+    }
+    for (const FString& Output : Model.OutputOrder)
+    {
+        LastUse.Add(Output, MAX_int32);
+    }
+
+    // 作为图输入列出的初始值（IR版本<4）不是真正的输入
+    for (const FString& Name : Model.InputOrder)
+    {
+        if (!Model.InitializerBytes.Contains(Name))
+        {
+            OutPlan.Inputs.Add(Name);
+        }
+    }
+    OutPlan.Outputs = Model.OutputOrder;
+
+    int32 FirstNode = 0;
+    for (int32 StageIndex = 0; StageIndex < StageEnds.Num(); ++StageIndex)
+    {
+        FOnnxGraphStage& Stage = OutPlan.Stages.AddDefaulted_GetRef();
+        Stage.FirstNode = FirstNode;
+        Stage.LastNode = StageEnds[StageIndex];
+
+        TSet<FString> Produced;
+        for (int32 i = Stage.FirstNode; i <= Stage.LastNode; ++i)
+        {
+            const FNodeInfo& Node = Model.Nodes[i];
+            Stage.WeightBytes += NodeWeights[i];
+
+            for (const FString& Input : Node.Inputs)
+            {
+                if (Input.IsEmpty() || Produced.Contains(Input) || Model.InitializerBytes.Contains(Input))
+                {
+                    continue;
+                }
+
+                const int32* Producer = Model.Producers.Find(Input);
+                if (Producer && *Producer >= i)
+                {
+                    OutError = FString::Printf(TEXT("graph is not topologically sorted (%s is used before it is produced)"), *Input);
+                    return false;
+                }
+                if (!Producer && !Model.Inputs.Contains(Input))
+                {
+                    OutError = FString::Printf(TEXT("no node or graph input provides %s"), *Input);
+                    return false;
+                }
+                Stage.Inputs.AddUnique(Input);
+            }
+
+            for (const FString& Output : Node.Outputs)
+            {
+                const int32* Last = Output.IsEmpty() ? nullptr : LastUse.Find(Output);
+                if (Last && *Last > StageIndex)
+                {
+                    Stage.Outputs.Add(Output);
+                }
+                Produced.Add(Output);
+            }
+        }
+
+        if (Stage.Outputs.Num() == 0)
+        {
+            OutError = FString::Printf(TEXT("stage %d produces nothing that later stages or the model outputs use"), StageIndex);
+            return false;
+        }
+        FirstNode = Stage.LastNode + 1;
+    }
+
+    UE_LOG(LogTemp, Log, TEXT("Graph patch: planned %d stages over %d nodes"), OutPlan.Stages.Num(), NumNodes);
+    return true;
+}
+
+bool FOnnxGraphPatch::ExtractStage(const TArray<uint8>& ModelData, const FOnnxGraphStage& Stage, const TMap<FString, FOnnxGraphTensorType>& InputTypes,
+                                   TArray<uint8>& OutStageData, FString& OutError)
+{
+    const uint8* Data = ModelData.GetData();
+
+    FParsedModel Model;
+    if (!ParseModel(ModelData, Model, OutError))
+    {
+        return false;
+    }
+    if (Stage.FirstNode < 0 || Stage.LastNode >= Model.Nodes.Num() || Stage.FirstNode > Stage.LastNode)
+    {
+        OutError = TEXT("stage node range does not match the model");
+        return false;
+    }
+
+    // 阶段内节点引用或产生的名称，用于筛选初始值和value_info
+    TSet<FString> UsedNames;
+    for (int32 i = Stage.FirstNode; i <= Stage.LastNode; ++i)
+    {
+        UsedNames.Append(Model.Nodes[i].Inputs);
+        UsedNames.Append(Model.Nodes[i].Outputs);
+    }
+    const TSet<FString> StageInputs(Stage.Inputs);
+
+    // 重新编码GraphProto：节点、初始值和图输入/输出按阶段筛选，其余字段原样保留
+    TArray<uint8> NewGraph;
+    NewGraph.Reserve(Stage.WeightBytes + (Stage.LastNode - Stage.FirstNode + 1) * 256);
+
+    int32 NodeIndex = 0;
+    for (const FWireField& Field : Model.GraphFields)
+    {
+        if (Field.WireType != WireLengthDelimited)
+        {
+            AppendRaw(NewGraph, Data, Field);
+        }
+        else if (Field.Number == GraphNodeField)
+        {
+            if (NodeIndex >= Stage.FirstNode && NodeIndex <= Stage.LastNode)
+            {
+                AppendRaw(NewGraph, Data, Field);
+            }
+            ++NodeIndex;
+        }
+        else if (Field.Number == GraphInitializerField)
+        {
+            if (UsedNames.Contains(ReadStringField(Data, Field, TensorNameField)))
+            {
+                AppendRaw(NewGraph, Data, Field);
+            }
+        }
+        else if (Field.Number == GraphInputField)
+        {
+            // 原模型的输入沿用原有的类型信息；作为图输入列出的初始值按是否使用保留
+            const FString Name = ReadValueInfoName(Data, Field);
+            if (StageInputs.Contains(Name) || (Model.InitializerBytes.Contains(Name) && UsedNames.Contains(Name)))
+            {
+                AppendRaw(NewGraph, Data, Field);
+            }
+        }
+        else if (Field.Number == GraphValueInfoField)
+        {
+            if (UsedNames.Contains(ReadValueInfoName(Data, Field)))
+            {
+                AppendRaw(NewGraph, Data, Field);
+            }
+        }
+        else if (Field.Number != GraphOutputField)
+        {
+            AppendRaw(NewGraph, Data, Field);
+        }
+    }
+
+    // 之前阶段产生的张量成为带类型的图输入
+    for (const FString& Name : Stage.Inputs)
+    {
+        if (Model.Inputs.Contains(Name))
+        {
+            continue;
+        }
+
+        const FOnnxGraphTensorType* Type = InputTypes.Find(Name);
+        if (!Type)
+        {
+            OutError = FString::Printf(TEXT("type of stage input %s is unknown"), *Name);
+            return false;
+        }
+        AppendTypedValueInfo(NewGraph, GraphInputField, Name, *Type);
+    }
+
+    // 阶段的输出：原模型的输出保留类型信息，中间张量只带名称，类型由ORT推断
+    for (const FString& Name : Stage.Outputs)
+    {
+        if (const FWireField* const* Existing = Model.ExistingOutputs.Find(Name))
+        {
+            AppendRaw(NewGraph, Data, **Existing);
+        }
+        else
+        {
+            TArray<uint8> ValueInfo;
+            AppendStringField(ValueInfo, ValueInfoNameField, Name);
+            AppendLengthDelimited(NewGraph, GraphOutputField, ValueInfo.GetData(), ValueInfo.Num());
+        }
+    }
+
+    EncodeModel(Data, Model, NewGraph, OutStageData);
+    return true;
+}
@@ -0,0 +1,117 @@
+// OnnxHalf.cpp
+
+#include "OnnxHalf.h"
+#include "OnnxCoreHalf.h"
+
+// 批量转换由引擎无关的OnnxCore实现，这里只保留TArray和Ort::Value相关的封装
+
+bool FOnnxHalf::IsF16CSupported()
+{
+    return OnnxCore::IsF16CSupported();
+}
+
+void FOnnxHalf::ConvertToHalf(const float* Src, uint16* Dst, int64 Count)
+{
+    OnnxCore::ConvertToHalf(Src, Dst, Count);
+}
+
+void FOnnxHalf::ConvertToFloat(const uint16* Src, float* Dst, int64 Count)
+{
+    OnnxCore::ConvertToFloat(Src, Dst, Count);
+}
+
+void FOnnxHalf::ConvertToHalf(const TArray<float>& Src, TArray<uint16>& Dst)
+{
+    Dst.SetNumUninitialized(Src.Num());
+    ConvertToHalf(Src.GetData(), Dst.GetData(), Src.Num());
+}
+
+void FOnnxHalf::ConvertToFloat(const TArray<uint16>& Src, TArray<float>& Dst)
+{
+    Dst.SetNumUninitialized(Src.Num());
+    ConvertToFloat(Src.GetData(), Dst.GetData(), Src.Num());
+}
+
+ONNXTensorElementDataType FOnnxHalf::GetInputElementType(const Ort::Session& Session, const char* Name)
+{
+    Ort::AllocatorWithDefaultOptions allocator;
+    for (size_t i = 0; i < Session.GetInputCount(); ++i)
+    {
+        if (FCStringAnsi::Strcmp(Session.GetInputNameAllocated(i, allocator).get(), Name) == 0)
+        {
+            Ort::TypeInfo typeInfo = Session.GetInputTypeInfo(i);
+            return typeInfo.GetONNXType() == ONNX_TYPE_TENSOR
+                ? typeInfo.GetTensorTypeAndShapeInfo().GetElementType()
+                : ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+        }
+    }
+    return ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+}
+
+Ort::Value FOnnxHalf::CreateTensor(const Ort::MemoryInfo& MemoryInfo, const float* Data, int64 Count,
+                                   const int64_t* Shape, size_t NumDims, ONNXTensorElementDataType Type, TArray<uint16>& Scratch)
+{
+    if (Type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16)
+    {
+        Scratch.SetNumUninitialized(Count);
+        ConvertToHalf(Data, Scratch.GetData(), Count);
+        return Ort::Value::CreateTensor(MemoryInfo, Scratch.GetData(), Count * sizeof(uint16), Shape, NumDims, ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16);
+    }
+    return Ort::Value::CreateTensor<float>(MemoryInfo, const_cast<float*>(Data), Count, Shape, NumDims);
+}
+
+Ort::Value FOnnxHalf::CreateTensor(const Ort::MemoryInfo& MemoryInfo, const uint16* Data, int64 Count,
+                                   const int64_t* Shape, size_t NumDims, ONNXTensorElementDataType Type, TArray<float>& Scratch)
+{
+    if (Type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16)
+    {
+        return Ort::Value::CreateTensor(MemoryInfo, const_cast<uint16*>(Data), Count * sizeof(uint16), Shape, NumDims, ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16);
+    }
+    Scratch.SetNumUninitialized(Count);
+    ConvertToFloat(Data, Scratch.GetData(), Count);
+    return Ort::Value::CreateTensor<float>(MemoryInfo, Scratch.GetData(), Count, Shape, NumDims);
+}
+
+bool FOnnxHalf::CopyToFloat(const Ort::Value& Tensor, TArray<float>& OutData)
+{
+    Ort::TensorTypeAndShapeInfo info = Tensor.GetTensorTypeAndShapeInfo();
+    const int64 count = static_cast<int64>(info.GetElementCount());
+    switch (info.GetElementType())
+    {
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
+        OutData.SetNumUninitialized(count);
+        FMemory::Memcpy(OutData.GetData(), Tensor.GetTensorData<float>(), count * sizeof(float));
+        return true;
+
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16:
+        OutData.SetNumUninitialized(count);
+        ConvertToFloat(reinterpret_cast<const uint16*>(Tensor.GetTensorRawData()), OutData.GetData(), count);
+        return true;
+
+    default:
+        UE_LOG(LogTemp, Error, TEXT("Unsupported tensor element type %d (expected float or float16)"), static_cast<int32>(info.GetElementType()));
+        return false;
+    }
+}
+
+bool FOnnxHalf::CopyToHalf(const Ort::Value& Tensor, TArray<uint16>& OutData)
+{
+    Ort::TensorTypeAndShapeInfo info = Tensor.GetTensorTypeAndShapeInfo();
+    const int64 count = static_cast<int64>(info.GetElementCount());
+    switch (info.GetElementType())
+    {
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16:
+        OutData.SetNumUninitialized(count);
+        FMemory::Memcpy(OutData.GetData(), Tensor.GetTensorRawData(), count * sizeof(uint16));
+        return true;
+
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
+        OutData.SetNumUninitialized(count);
+        ConvertToHalf(Tensor.GetTensorData<float>(), OutData.GetData(), count);
+        return true;
+
+    default:
+        UE_LOG(LogTemp, Error, TEXT("Unsupported tensor element type %d (expected float or float16)"), static_cast<int32>(info.GetElementType()));
+        return false;
+    }
+}
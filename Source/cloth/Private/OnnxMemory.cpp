@@ -0,0 +1,544 @@
+// OnnxMemory.cpp
+
+#include "OnnxMemory.h"
+#include "OnnxTuning.h"
+#include "OnnxScratch.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/LowLevelMemTracker.h"
+#include "Misc/ConfigCacheIni.h"
+#include "Misc/OutputDevice.h"
+#include "Misc/ScopeLock.h"
+
+#include <atomic>
+
+#if PLATFORM_LINUX
+#include <sys/mman.h>
+#endif
+
+// 插件分配器的所有内存在LLM中归入"ONNX"标签
+LLM_DEFINE_TAG(ONNX);
+
+namespace
+{
+    // 每个分配之前的块头占用一个对齐单位，返回给ORT的指针按64字节对齐（与ORT自己的CPU分配器一致）
+    constexpr SIZE_T BlockAlignment = 64;
+
+    // 非大页的缓存块按64KB取整，大页块按2MB取整并对齐
+    constexpr SIZE_T ChunkGranularity = 64 * 1024;
+    constexpr SIZE_T HugePageSize = 2 * 1024 * 1024;
+
+    // 登记项的数量上限，第0项为共享部分
+    constexpr int32 MaxOwners = 256;
+
+    const TCHAR* const MemReportCommand = TEXT("onnx.MemReport");
+
+    enum EOnnxBlockFlags : uint32
+    {
+        BlockFlag_Chunk = 1 << 0,
+        BlockFlag_HugePages = 1 << 1
+    };
+
+    struct FBlockHeader
+    {
+        // 请求的大小
+        SIZE_T Size;
+
+        // 缓存块的大小（含块头），直接来自FMemory时为0
+        SIZE_T ChunkSize;
+
+        int32 OwnerId;
+        uint32 Flags;
+    };
+    static_assert(sizeof(FBlockHeader) <= BlockAlignment, "Block header must fit in one alignment unit");
+
+    struct FOwnerSlot
+    {
+        std::atomic<int64> CurrentBytes{0};
+        std::atomic<int64> PeakBytes{0};
+        std::atomic<int64> NumAllocations{0};
+
+        // 以下字段由OwnerMutex保护
+        FString Name;
+        bool bInUse = false;
+    };
+
+    struct FFreeChunk
+    {
+        uint8* Ptr;
+        bool bHugePages;
+    };
+
+    // 当前线程上的分配归属
+    thread_local int32 GCurrentOwnerId = 0;
+
+    /**
+     * 分配器的全局状态。有意不析构：ORT可能在模块的静态对象析构之后才释放最后的张量。
+     */
+    struct FOnnxMemoryState
+    {
+        OrtAllocator Allocator = {};
+        Ort::MemoryInfo MemoryInfo{nullptr};
+        FOnnxMemorySettings Settings;
+        std::atomic<bool> bRegistered{false};
+
+        FOwnerSlot Owners[MaxOwners];
+        FCriticalSection OwnerMutex;
+
+        FCriticalSection ChunkMutex;
+        TMap<SIZE_T, TArray<FFreeChunk>> FreeChunks;
+
+        std::atomic<int64> TotalBytes{0};
+        std::atomic<int64> CachedChunkBytes{0};
+        std::atomic<int64> HugePageBytes{0};
+
+        FOnnxMemoryState()
+        {
+            Owners[0].Name = TEXT("Shared (outside model scopes / ORT worker threads)");
+            Owners[0].bInUse = true;
+        }
+
+        SIZE_T GetLargeBlockBytes() const
+        {
+            return static_cast<SIZE_T>(FMath::Max(Settings.LargeBlockKB, 64)) * 1024;
+        }
+
+        void Account(int32 OwnerId, int64 Delta)
+        {
+            FOwnerSlot& slot = Owners[OwnerId];
+            const int64 current = slot.CurrentBytes.fetch_add(Delta) + Delta;
+            TotalBytes += Delta;
+            if (Delta <= 0)
+            {
+                return;
+            }
+
+            ++slot.NumAllocations;
+            int64 peak = slot.PeakBytes.load();
+            while (current > peak && !slot.PeakBytes.compare_exchange_weak(peak, current))
+            {
+            }
+        }
+
+        uint8* MapHugePages(SIZE_T Size)
+        {
+#if PLATFORM_LINUX
+            // 多映射一个大页再裁掉两端，使块按2MB对齐，内核才能用大页支撑整个块
+            const SIZE_T mappedSize = Size + HugePageSize;
+            void* raw = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (raw == MAP_FAILED)
+            {
+                return nullptr;
+            }
+
+            uint8* rawStart = static_cast<uint8*>(raw);
+            uint8* aligned = Align(rawStart, HugePageSize);
+            uint8* rawEnd = rawStart + mappedSize;
+            if (aligned > rawStart)
+            {
+                munmap(rawStart, aligned - rawStart);
+            }
+            if (rawEnd > aligned + Size)
+            {
+                munmap(aligned + Size, rawEnd - (aligned + Size));
+            }
+
+            // 透明大页被禁用时建议无效，块仍然可用（按普通页支撑）
+            madvise(aligned, Size, MADV_HUGEPAGE);
+
+            LLM_IF_ENABLED(FLowLevelMemTracker::Get().OnLowLevelAlloc(ELLMTracker::Default, aligned, Size));
+            HugePageBytes += Size;
+            return aligned;
+#else
+            return nullptr;
+#endif
+        }
+
+        void ReleaseChunkMemory(const FFreeChunk& Chunk, SIZE_T Size)
+        {
+#if PLATFORM_LINUX
+            if (Chunk.bHugePages)
+            {
+                LLM_IF_ENABLED(FLowLevelMemTracker::Get().OnLowLevelFree(ELLMTracker::Default, Chunk.Ptr));
+                munmap(Chunk.Ptr, Size);
+                HugePageBytes -= Size;
+                return;
+            }
+#endif
+            FMemory::Free(Chunk.Ptr);
+        }
+
+        FFreeChunk AcquireChunk(SIZE_T Size, bool bWantHugePages)
+        {
+            {
+                FScopeLock Lock(&ChunkMutex);
+                if (TArray<FFreeChunk>* chunks = FreeChunks.Find(Size))
+                {
+                    if (chunks->Num() > 0)
+                    {
+                        CachedChunkBytes -= Size;
+                        return chunks->Pop();
+                    }
+                }
+            }
+
+            if (bWantHugePages)
+            {
+                if (uint8* ptr = MapHugePages(Size))
+                {
+                    return {ptr, true};
+                }
+            }
+            return {static_cast<uint8*>(FMemory::Malloc(Size, BlockAlignment)), false};
+        }
+
+        void ReleaseChunk(const FFreeChunk& Chunk, SIZE_T Size)
+        {
+            {
+                FScopeLock Lock(&ChunkMutex);
+                const int64 maxCachedBytes = static_cast<int64>(FMath::Max(Settings.MaxCachedChunkMB, 0)) * 1024 * 1024;
+                if (CachedChunkBytes + static_cast<int64>(Size) <= maxCachedBytes)
+                {
+                    FreeChunks.FindOrAdd(Size).Add(Chunk);
+                    CachedChunkBytes += Size;
+                    return;
+                }
+            }
+            ReleaseChunkMemory(Chunk, Size);
+        }
+
+        void* Allocate(SIZE_T Size)
+        {
+            // 分配器内部的分配（FMemory、缓存的TMap）不属于请求本身
+            FOnnxAllocationCounter::FUntrackedScope untracked;
+            LLM_SCOPE_BYTAG(ONNX);
+
+            const SIZE_T totalSize = Size + BlockAlignment;
+            uint8* base = nullptr;
+            SIZE_T chunkSize = 0;
+            uint32 flags = 0;
+
+            if (totalSize >= GetLargeBlockBytes())
+            {
+                // 大块按取整后的大小缓存复用，稳定状态下不再向FMemory或系统申请
+                const bool bWantHugePages = PLATFORM_LINUX && Settings.bUseHugePages && totalSize >= HugePageSize;
+                chunkSize = Align(totalSize, bWantHugePages ? HugePageSize : ChunkGranularity);
+                const FFreeChunk chunk = AcquireChunk(chunkSize, bWantHugePages);
+                base = chunk.Ptr;
+                flags = BlockFlag_Chunk | (chunk.bHugePages ? BlockFlag_HugePages : 0);
+            }
+            else
+            {
+                base = static_cast<uint8*>(FMemory::Malloc(totalSize, BlockAlignment));
+            }
+
+            if (!base)
+            {
+                return nullptr;
+            }
+
+            FBlockHeader* header = reinterpret_cast<FBlockHeader*>(base);
+            header->Size = Size;
+            header->ChunkSize = chunkSize;
+            header->OwnerId = GCurrentOwnerId;
+            header->Flags = flags;
+
+            Account(header->OwnerId, static_cast<int64>(Size));
+            return base + BlockAlignment;
+        }
+
+        void Free(void* Ptr)
+        {
+            if (!Ptr)
+            {
+                return;
+            }
+
+            FOnnxAllocationCounter::FUntrackedScope untracked;
+            LLM_SCOPE_BYTAG(ONNX);
+
+            uint8* base = static_cast<uint8*>(Ptr) - BlockAlignment;
+            const FBlockHeader header = *reinterpret_cast<const FBlockHeader*>(base);
+
+            // 可能在其他线程上释放，按分配时记录的归属扣除
+            Account(header.OwnerId, -static_cast<int64>(header.Size));
+
+            if (header.Flags & BlockFlag_Chunk)
+            {
+                ReleaseChunk({base, (header.Flags & BlockFlag_HugePages) != 0}, header.ChunkSize);
+            }
+            else
+            {
+                FMemory::Free(base);
+            }
+        }
+
+        void TrimCache()
+        {
+            TMap<SIZE_T, TArray<FFreeChunk>> chunks;
+            {
+                FScopeLock Lock(&ChunkMutex);
+                chunks = MoveTemp(FreeChunks);
+                FreeChunks.Reset();
+                CachedChunkBytes = 0;
+            }
+
+            LLM_SCOPE_BYTAG(ONNX);
+            for (const TPair<SIZE_T, TArray<FFreeChunk>>& pair : chunks)
+            {
+                for (const FFreeChunk& chunk : pair.Value)
+                {
+                    ReleaseChunkMemory(chunk, pair.Key);
+                }
+            }
+        }
+
+        int32 RegisterOwner(const FString& Name)
+        {
+            FScopeLock Lock(&OwnerMutex);
+
+            // 复用已注销且内存已全部释放的登记项
+            for (int32 i = 1; i < MaxOwners; ++i)
+            {
+                FOwnerSlot& slot = Owners[i];
+                if (!slot.bInUse && slot.CurrentBytes.load() == 0)
+                {
+                    slot.Name = Name;
+                    slot.bInUse = true;
+                    slot.PeakBytes = 0;
+                    slot.NumAllocations = 0;
+                    return i;
+                }
+            }
+
+            UE_LOG(LogTemp, Warning, TEXT("Too many ONNX memory owners, %s is reported as shared memory"), *Name);
+            return 0;
+        }
+
+        void UnregisterOwner(int32 Id)
+        {
+            if (Id <= 0 || Id >= MaxOwners)
+            {
+                return;
+            }
+
+            FScopeLock Lock(&OwnerMutex);
+            Owners[Id].bInUse = false;
+        }
+
+        FOnnxMemoryStats GetOwnerStats(int32 Id)
+        {
+            FScopeLock Lock(&OwnerMutex);
+            const FOwnerSlot& slot = Owners[Id];
+
+            FOnnxMemoryStats stats;
+            stats.Name = slot.bInUse ? slot.Name : slot.Name + TEXT(" (released)");
+            stats.CurrentBytes = slot.CurrentBytes;
+            stats.PeakBytes = slot.PeakBytes;
+            stats.NumAllocations = slot.NumAllocations;
+            return stats;
+        }
+    };
+
+    FOnnxMemoryState& GetState()
+    {
+        static FOnnxMemoryState* State = new FOnnxMemoryState();
+        return *State;
+    }
+
+    void* ORT_API_CALL AllocCallback(OrtAllocator* /*This*/, size_t Size)
+    {
+        return GetState().Allocate(Size);
+    }
+
+    void ORT_API_CALL FreeCallback(OrtAllocator* /*This*/, void* Ptr)
+    {
+        GetState().Free(Ptr);
+    }
+
+    const OrtMemoryInfo* ORT_API_CALL InfoCallback(const OrtAllocator* /*This*/)
+    {
+        return GetState().MemoryInfo;
+    }
+
+    // memreport执行的[MemReportCommands]由插件的Config/DefaultEngine.ini加入这个命令，运行时不修改引擎配置
+    FAutoConsoleCommandWithOutputDevice GOnnxMemReportCommand(
+        MemReportCommand,
+        TEXT("Lists memory held by ONNX Runtime through the plugin allocator, per model."),
+        FConsoleCommandWithOutputDeviceDelegate::CreateStatic(&FOnnxMemory::Dump));
+}
+
+void FOnnxMemorySettings::LoadFromConfig()
+{
+    if (!GConfig)
+    {
+        return;
+    }
+
+    const TCHAR* Section = TEXT("OnnxRuntime");
+    GConfig->GetBool(Section, TEXT("bUseUnrealAllocator"), bUseUnrealAllocator, GEngineIni);
+    GConfig->GetBool(Section, TEXT("bUseHugePages"), bUseHugePages, GEngineIni);
+    GConfig->GetInt(Section, TEXT("LargeBlockKB"), LargeBlockKB, GEngineIni);
+    GConfig->GetInt(Section, TEXT("MaxCachedChunkMB"), MaxCachedChunkMB, GEngineIni);
+
+    // onnx.MaxCachedChunkMB优先（设备配置文件可能在插件加载前设置）
+    MaxCachedChunkMB = FOnnxTuning::GetMaxCachedChunkMB(MaxCachedChunkMB);
+}
+
+FOnnxMemoryOwner::~FOnnxMemoryOwner()
+{
+    Unregister();
+}
+
+void FOnnxMemoryOwner::Register(const FString& Name)
+{
+    Unregister();
+    id_ = GetState().RegisterOwner(Name);
+}
+
+void FOnnxMemoryOwner::Unregister()
+{
+    GetState().UnregisterOwner(id_);
+    id_ = 0;
+}
+
+FOnnxMemoryStats FOnnxMemoryOwner::GetStats() const
+{
+    return GetState().GetOwnerStats(id_);
+}
+
+FOnnxMemoryOwner::FScope::FScope(const FOnnxMemoryOwner& Owner)
+    : PreviousId(GCurrentOwnerId)
+{
+    GCurrentOwnerId = Owner.id_;
+}
+
+FOnnxMemoryOwner::FScope::~FScope()
+{
+    GCurrentOwnerId = PreviousId;
+}
+
+bool FOnnxMemory::RegisterWithEnv(Ort::Env& Env, const FOnnxMemorySettings& Settings)
+{
+    FOnnxMemoryState& state = GetState();
+
+    // 设置只影响之后的分配，已有块的来源记录在块头中
+    state.Settings = Settings;
+#if !PLATFORM_LINUX
+    if (Settings.bUseHugePages)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("ONNX huge page arenas are only supported on Linux, ignoring bUseHugePages"));
+    }
+#endif
+
+    try
+    {
+        if (!state.MemoryInfo)
+        {
+            // Env按内存信息匹配分配器，必须与会话的CPU设备一致
+            state.MemoryInfo = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeDefault);
+            state.Allocator.version = ORT_API_VERSION;
+            state.Allocator.Alloc = &AllocCallback;
+            state.Allocator.Free = &FreeCallback;
+            state.Allocator.Info = &InfoCallback;
+            state.Allocator.Reserve = &AllocCallback;
+        }
+
+        Ort::ThrowOnError(Ort::GetApi().RegisterAllocator(Env, &state.Allocator));
+    }
+    catch (const Ort::Exception& e)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to register the ONNX Unreal allocator: %s"), UTF8_TO_TCHAR(e.what()));
+        return false;
+    }
+
+    state.bRegistered = true;
+
+    UE_LOG(LogTemp, Log, TEXT("ONNX Runtime allocations routed through FMemory (LLM tag ONNX, large blocks >= %d KB, huge pages: %s)"),
+           Settings.LargeBlockKB, (PLATFORM_LINUX && Settings.bUseHugePages) ? TEXT("on") : TEXT("off"));
+    return true;
+}
+
+bool FOnnxMemory::IsRegistered()
+{
+    return GetState().bRegistered;
+}
+
+TArray<FOnnxMemoryStats> FOnnxMemory::GetOwnerStats()
+{
+    FOnnxMemoryState& state = GetState();
+
+    TArray<FOnnxMemoryStats> stats;
+    for (int32 i = 0; i < MaxOwners; ++i)
+    {
+        bool bListed;
+        {
+            FScopeLock Lock(&state.OwnerMutex);
+            bListed = i == 0 || state.Owners[i].bInUse || state.Owners[i].CurrentBytes.load() != 0;
+        }
+        if (bListed)
+        {
+            stats.Add(state.GetOwnerStats(i));
+        }
+    }
+    return stats;
+}
+
+int64 FOnnxMemory::GetTotalBytes()
+{
+    return GetState().TotalBytes;
+}
+
+int64 FOnnxMemory::GetCachedChunkBytes()
+{
+    return GetState().CachedChunkBytes;
+}
+
+int64 FOnnxMemory::GetHugePageBytes()
+{
+    return GetState().HugePageBytes;
+}
+
+void FOnnxMemory::TrimCache()
+{
+    GetState().TrimCache();
+}
+
+void FOnnxMemory::SetMaxCachedChunkMB(int32 MaxCachedChunkMB)
+{
+    FOnnxMemoryState& state = GetState();
+    int64 maxCachedBytes = 0;
+    {
+        FScopeLock Lock(&state.ChunkMutex);
+        state.Settings.MaxCachedChunkMB = FMath::Max(MaxCachedChunkMB, 0);
+        maxCachedBytes = static_cast<int64>(state.Settings.MaxCachedChunkMB) * 1024 * 1024;
+    }
+
+    // 缓存超出新的上限时全部归还，之后按新上限重新积累
+    if (state.CachedChunkBytes > maxCachedBytes)
+    {
+        state.TrimCache();
+    }
+}
+
+int32 FOnnxMemory::GetMaxCachedChunkMB()
+{
+    return GetState().Settings.MaxCachedChunkMB;
+}
+
+void FOnnxMemory::Dump(FOutputDevice& Ar)
+{
+    const double toMB = 1.0 / (1024.0 * 1024.0);
+
+    Ar.Logf(TEXT("=== ONNX Runtime memory (plugin allocator: %s) ==="), IsRegistered() ? TEXT("registered") : TEXT("not registered"));
+    Ar.Logf(TEXT("In use: %.2f MB, cached chunks: %.2f MB, huge page chunks: %.2f MB"),
+            GetTotalBytes() * toMB, GetCachedChunkBytes() * toMB, GetHugePageBytes() * toMB);
+
+    TArray<FOnnxMemoryStats> stats = GetOwnerStats();
+    stats.Sort([](const FOnnxMemoryStats& A, const FOnnxMemoryStats& B) { return A.CurrentBytes > B.CurrentBytes; });
+
+    Ar.Logf(TEXT("%12s %12s %12s  %s"), TEXT("Current MB"), TEXT("Peak MB"), TEXT("Allocs"), TEXT("Model"));
+    for (const FOnnxMemoryStats& stat : stats)
+    {
+        Ar.Logf(TEXT("%12.2f %12.2f %12lld  %s"), stat.CurrentBytes * toMB, stat.PeakBytes * toMB, stat.NumAllocations, *stat.Name);
+    }
+}
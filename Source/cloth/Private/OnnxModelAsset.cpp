@@ -16,11 +16,19 @@
 #if PLATFORM_WINDOWS && PLATFORM_64BITS
 #include "Windows/HideWindowsPlatformTypes.h"
 #endif
+#include "OnnxRuntime.h"
+#include "OnnxModelRegistry.h"
 
 void UOnnxModelAsset::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
 {
     Super::PostEditChangeProperty(PropertyChangedEvent);
 
+    // 已共享的实例按旧的模型和配置创建，之后获取的组件重新创建
+    if (UOnnxModelRegistry* Registry = UOnnxModelRegistry::Get())
+    {
+        Registry->Invalidate(this);
+    }
+
     // 获取被修改的属性的名称。
 	const FName PropertyName = (PropertyChangedEvent.Property != nullptr) ? PropertyChangedEvent.Property->GetFName() : NAME_None;
 
@@ -41,12 +49,20 @@ void UOnnxModelAsset::PostEditChangeProperty(FPropertyChangedEvent& PropertyChan
         const FString absolutePath = FPaths::ConvertRelativePathToFull(FPaths::ProjectDir(), modelFile_.FilePath);
         try
         {
-            // 创建一个临时的环境和会话来检查模型。
-            Ort::Env TempEnv(ORT_LOGGING_LEVEL_WARNING, "ModelAsset_Editor_Parse");
+            // 使用插件共享的环境创建一个临时会话来检查模型。
+            // ORT的Env是进程级单例，单独创建的临时Env会绕开插件的线程配置。
+            // 先获取运行时：ORT在第一次使用时才加载，之后才能创建会话选项。
+            FOnnxRuntime& Runtime = FOnnxRuntime::Get();
+            if (!Runtime.IsAvailable())
+            {
+                UE_LOG(LogTemp, Error, TEXT("Cannot read model metadata for %s: ONNX Runtime is not available"), *GetName());
+                return;
+            }
+            Ort::Env& Env = Runtime.GetEnv();
             Ort::SessionOptions SessionOptions;
             
-            // ONNX Runtime期望一个宽字符字符串作为路径。
-            Ort::Session TempSession(TempEnv, TCHAR_TO_WCHAR(*absolutePath), SessionOptions);
+            // ONNX Runtime的路径在Windows上是宽字符，其他平台是UTF-8。
+            Ort::Session TempSession(Env, FOnnxRuntime::ToOrtString(absolutePath).c_str(), SessionOptions);
 
             // 使用分配器来管理名称的内存。
 			Ort::AllocatorWithDefaultOptions Allocator;
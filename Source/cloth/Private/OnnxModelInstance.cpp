@@ -2,6 +2,17 @@
 
 #include "OnnxModelInstance.h"
 #include "OnnxModelAsset.h"
+#include "OnnxRuntime.h"
+#include "OnnxAutotuner.h"
+#include "OnnxExecutionProviders.h"
+#include "OnnxGraphPatch.h"
+#include "OnnxHalf.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+#include "Misc/ScopeTryLock.h"
 
 // 包含ONNX Runtime的实现头文件
 #if PLATFORM_WINDOWS && PLATFORM_64BITS
@@ -12,63 +23,258 @@
 #include "Windows/HideWindowsPlatformTypes.h"
 #endif
 
-FOnnxModelInstance::FOnnxModelInstance(UOnnxModelAsset* InModelAsset): env_(nullptr), session_(nullptr), bIsInitialized_(false)
+FOnnxModelInstance::FOnnxModelInstance(UOnnxModelAsset* InModelAsset, const FString& InModelPath, TOptional<EOnnxModelPrecision> InPrecision, bool bInLowPriority): session_(nullptr), bIsInitialized_(false)
 {
     UE_LOG(LogTemp, Log, TEXT("Creating FOnnxModelInstance..."));
+
+    // 预打包权重容器等在会话之前创建的Ort对象同样需要ORT已加载
+    if (!FOnnxRuntime::LoadApi())
+    {
+        return;
+    }
     
     try
     {
-        // 创建ONNX环境
-        env_ = MakeUnique<Ort::Env>(ORT_LOGGING_LEVEL_WARNING, "ClothModel");
-        UE_LOG(LogTemp, Log, TEXT("ONNX Environment created"));
-        
-        // 硬编码加载multiply_by_two.onnx模型
-        FString ProjectDir = FPaths::ProjectDir();
-        FString ModelPath = FPaths::Combine(ProjectDir, TEXT("Content"), TEXT("Model"), TEXT("sam2_hiera_tiny_decoder.onnx"));
-        
-        UE_LOG(LogTemp, Log, TEXT("Attempting to load model: %s"), *ModelPath);
-        
-        // 检查文件是否存在
-        if (FPaths::FileExists(ModelPath))
+        modelAsset_ = InModelAsset;
+
+        FString variantPath;
+        if (InModelAsset)
         {
-            
-            // 创建会话选项
-            Ort::SessionOptions sessionOptions;
-            sessionOptions.SetIntraOpNumThreads(1);
-            
-            // 创建会话
-            session_ = MakeUnique<Ort::Session>(*env_, *ModelPath, sessionOptions);
-            UE_LOG(LogTemp, Log, TEXT("ONNX Session created successfully"));
-            
-            // 获取模型输入输出信息
-            size_t numInputNodes = session_->GetInputCount();
-            size_t numOutputNodes = session_->GetOutputCount();
-            
-            UE_LOG(LogTemp, Log, TEXT("Model info - Inputs: %d, Outputs: %d"), numInputNodes, numOutputNodes);
-            
-            if (numInputNodes > 0)
+            settings_ = InModelAsset->sessionSettings_;
+
+            // 按选择策略（或强制指定的精度）加载量化变体
+            precision_ = InPrecision.IsSet() ? InPrecision.GetValue() : FOnnxModelVariants::ResolvePrecision(*InModelAsset);
+            if (const FOnnxModelVariant* variant = FOnnxModelVariants::FindVariant(*InModelAsset, precision_))
             {
-                Ort::AllocatorWithDefaultOptions allocator;
-                auto inputName = session_->GetInputNameAllocated(0, allocator);
-                inputNodeName_ = FString(UTF8_TO_TCHAR(inputName.get()));
-                UE_LOG(LogTemp, Log, TEXT("Input node name: %s"), *inputNodeName_);
+                variantPath = FOnnxModelVariants::GetFullPath(variant->ModelPath);
+                UE_LOG(LogTemp, Log, TEXT("Using %s variant of %s: %s"), FOnnxModelVariants::GetDisplayName(precision_), *InModelAsset->GetName(), *variantPath);
             }
-            
-            if (numOutputNodes > 0)
+            else
             {
-                Ort::AllocatorWithDefaultOptions allocator;
-                auto outputName = session_->GetOutputNameAllocated(0, allocator);
-                outputNodeName_ = FString(UTF8_TO_TCHAR(outputName.get()));
-                UE_LOG(LogTemp, Log, TEXT("Output node name: %s"), *outputNodeName_);
+                if (precision_ != EOnnxModelPrecision::FP32)
+                {
+                    UE_LOG(LogTemp, Warning, TEXT("%s variant of %s not found, using the reference model"), FOnnxModelVariants::GetDisplayName(precision_), *InModelAsset->GetName());
+                }
+                precision_ = EOnnxModelPrecision::FP32;
+
+                // 资产中显式声明的外部数据文件（相对项目目录），只属于基准模型
+                for (const FString& externalFile : InModelAsset->externalDataFiles_)
+                {
+                    externalDataFiles_.Add(FPaths::IsRelative(externalFile) ? FPaths::Combine(FPaths::ProjectDir(), externalFile) : externalFile);
+                }
             }
-            
-            bIsInitialized_ = true;
-            UE_LOG(LogTemp, Log, TEXT("FOnnxModelInstance initialized successfully with sam2_hiera_tiny_decoder.onnx"));
+        }
+
+        if (bInLowPriority)
+        {
+            // 后台实例不做首次调优：低优先级线程上的测量结果不能写入生产模型共用的本机调优缓存
+            settings_.bLowPriorityThreads = true;
+            if (settings_.AutotuneMode == EOnnxAutotuneMode::TuneOnFirstLaunch)
+            {
+                settings_.AutotuneMode = EOnnxAutotuneMode::ApplyIfAvailable;
+            }
+        }
+
+        if (InModelAsset && InModelAsset->modelData_.Num() > 0 && variantPath.IsEmpty())
+        {
+            // 从资产中的模型字节创建会话，同一内容的模型共享预打包权重
+            const FString modelHash = FOnnxPrepackedWeightsRegistry::ComputeModelHash(InModelAsset->modelData_);
+            prepackedWeights_ = FOnnxPrepackedWeightsRegistry::FindOrCreate(modelHash);
+            modelKey_ = FOnnxAutotuner::MakeModelKey(InModelAsset->GetName(), modelHash);
+            modelHash_ = modelHash;
+            displayName_ = InModelAsset->GetName();
+            modelBytes_ = InModelAsset->modelData_.Num();
+            UE_LOG(LogTemp, Log, TEXT("Loading ONNX model from asset data: %s"), *InModelAsset->GetName());
         }
         else
         {
-            UE_LOG(LogTemp, Warning, TEXT("Model file not found: %s - only Env created"), *ModelPath);
-            bIsInitialized_ = true; // 至少环境创建成功了
+            // 没有指定路径时回退到默认的sam2_hiera_tiny_decoder.onnx模型
+            modelPath_ = !variantPath.IsEmpty() ? variantPath : InModelPath.IsEmpty()
+                ? FPaths::Combine(FPaths::ProjectDir(), TEXT("Content"), TEXT("Model"), TEXT("sam2_hiera_tiny_decoder.onnx"))
+                : InModelPath;
+
+            UE_LOG(LogTemp, Log, TEXT("Attempting to load model: %s"), *modelPath_);
+
+            // 检查文件是否存在
+            if (!FPaths::FileExists(modelPath_))
+            {
+                UE_LOG(LogTemp, Warning, TEXT("Model file not found: %s - only Env available"), *modelPath_);
+                bIsInitialized_ = true; // 至少环境创建成功了
+                return;
+            }
+
+            // 未声明外部数据时在模型文件旁自动查找
+            if (externalDataFiles_.Num() == 0)
+            {
+                externalDataFiles_ = FOnnxExternalDataRegistry::FindExternalDataFiles(modelPath_);
+            }
+
+            const FString modelHash = FOnnxPrepackedWeightsRegistry::ComputeModelHash(modelPath_);
+            prepackedWeights_ = FOnnxPrepackedWeightsRegistry::FindOrCreate(modelHash);
+            modelKey_ = FOnnxAutotuner::MakeModelKey(FPaths::GetBaseFilename(modelPath_), modelHash);
+            modelHash_ = modelHash;
+            displayName_ = FPaths::GetBaseFilename(modelPath_);
+            modelBytes_ = IFileManager::Get().FileSize(*modelPath_);
+        }
+
+        // 外部数据以内存映射方式注入，多个会话共享同一份映射
+        for (const FString& externalFile : externalDataFiles_)
+        {
+            FOnnxMappedExternalFilePtr mapping = FOnnxExternalDataRegistry::FindOrMap(externalFile);
+            if (!mapping.IsValid())
+            {
+                UE_LOG(LogTemp, Error, TEXT("Failed to map external data: %s"), *externalFile);
+                return;
+            }
+            externalData_.Add(mapping);
+        }
+
+        // 加载时修改图，把资产声明的内部张量暴露为输出
+        if (InModelAsset && InModelAsset->extraOutputs_.Num() > 0)
+        {
+            TArray<uint8> fileData;
+            if (!modelPath_.IsEmpty() && !FFileHelper::LoadFileToArray(fileData, *modelPath_))
+            {
+                UE_LOG(LogTemp, Error, TEXT("Failed to read model for graph patching: %s"), *modelPath_);
+                return;
+            }
+
+            FString error;
+            const TArray<uint8>& sourceData = modelPath_.IsEmpty() ? InModelAsset->modelData_ : fileData;
+            if (!FOnnxGraphPatch::ExposeOutputs(sourceData, InModelAsset->extraOutputs_, InModelAsset->bExtraOutputsOnly_, patchedModelData_, error))
+            {
+                UE_LOG(LogTemp, Error, TEXT("Failed to expose outputs of %s: %s"), *displayName_, *error);
+                return;
+            }
+
+            // 修改后的图（尤其是裁剪后）与原模型的调优结果不通用
+            const FString outputsKey = FString::Join(InModelAsset->extraOutputs_, TEXT(",")) + (InModelAsset->bExtraOutputsOnly_ ? TEXT("|only") : TEXT(""));
+            modelKey_ += FString::Printf(TEXT("_out%08x"), GetTypeHash(outputsKey));
+        }
+
+        // 之后创建会话（包括调优时的临时会话）的ORT分配都记到本模型名下
+        memoryOwner_.Register(displayName_);
+
+        // 进程外推理：会话在工作进程中创建，本进程不加载模型（不做自动调优，也不登记驻留管理）
+        if (InModelAsset && InModelAsset->workerSettings_.bEnabled)
+        {
+            if (InModelAsset->pipelineSettings_.bEnabled)
+            {
+                UE_LOG(LogTemp, Warning, TEXT("%s: pipelineSettings_ is ignored, ONNX workers take precedence"), *displayName_);
+            }
+            externalData_.Reset();
+            prepackedWeights_.Reset();
+            baseSettings_ = settings_;
+            settings_ = FOnnxTuning::ApplySessionOverrides(baseSettings_);
+            if (!StartWorkers(InModelAsset->workerSettings_))
+            {
+                workers_.Reset();
+                return;
+            }
+
+            bIsInitialized_ = true;
+            UE_LOG(LogTemp, Log, TEXT("FOnnxModelInstance initialized with ONNX workers"));
+
+            // 控制台变量变化时按新配置逐个替换工作进程
+            tuning_.Register(displayName_, [this](bool bForce)
+            {
+                const FOnnxSessionSettings newSettings = ComputeOverriddenSettings();
+                if (bForce || !FOnnxTuning::SessionSettingsEqual(newSettings, GetSessionSettings()))
+                {
+                    SetSessionSettings(newSettings);
+                    workers_->Restart(newSettings);
+                }
+            }, [this]() { return GetSessionSettings().ToString(); });
+            return;
+        }
+
+        // 流水线模式：阶段会话由切分后的子模型创建（不做自动调优，也不登记驻留管理）
+        if (InModelAsset && InModelAsset->pipelineSettings_.bEnabled)
+        {
+            baseSettings_ = settings_;
+            settings_ = FOnnxTuning::ApplySessionOverrides(baseSettings_);
+            if (!StartPipeline(InModelAsset->pipelineSettings_))
+            {
+                pipeline_.Reset();
+                return;
+            }
+
+            bIsInitialized_ = true;
+            UE_LOG(LogTemp, Log, TEXT("FOnnxModelInstance initialized with a %d-stage pipeline"), pipeline_->GetNumStages());
+
+            // 控制台变量变化时按新配置建好新的流水线再换入，进行中的请求在旧流水线上完成
+            tuning_.Register(displayName_, [this](bool bForce)
+            {
+                const FOnnxSessionSettings newSettings = ComputeOverriddenSettings();
+                if (!bForce && FOnnxTuning::SessionSettingsEqual(newSettings, GetSessionSettings()))
+                {
+                    return;
+                }
+
+                TSharedPtr<FOnnxPipeline, ESPMode::ThreadSafe> newPipeline = BuildPipeline(newSettings);
+                if (!newPipeline)
+                {
+                    UE_LOG(LogTemp, Error, TEXT("Failed to rebuild the pipeline of %s, keeping the current one"), *displayName_);
+                    return;
+                }
+
+                SetSessionSettings(newSettings);
+                TSharedPtr<FOnnxPipeline, ESPMode::ThreadSafe> oldPipeline;
+                {
+                    FScopeLock Lock(&pipelineMutex_);
+                    oldPipeline = MoveTemp(pipeline_);
+                    pipeline_ = MoveTemp(newPipeline);
+                }
+
+                // 最后一个引用释放时旧流水线排空并停止
+                oldPipeline.Reset();
+            }, [this]() { return GetSessionSettings().ToString(); });
+            return;
+        }
+
+        // 应用本机已保存的EP选择和调优结果；还需要测试时先用当前配置创建会话，测试在后台进行
+        bool bNeedsTuning = false;
+        settings_ = FOnnxAutotuner::ResolveCachedSettings(modelKey_, settings_, bNeedsTuning);
+
+        // 运行时的onnx.*控制台变量覆盖资产和调优的配置
+        baseSettings_ = settings_;
+        settings_ = FOnnxTuning::ApplySessionOverrides(baseSettings_);
+
+        if (!LoadSessions())
+        {
+            return;
+        }
+        UE_LOG(LogTemp, Log, TEXT("ONNX Session created successfully (%s)"), *settings_.ToString());
+            
+        // 获取模型输入输出信息
+        CacheNodeMetadata();
+
+        // 动态形状的分桶策略（掩码输入的类型从会话元数据中查询，非float32的模型关闭分桶）
+        if (InModelAsset)
+        {
+            bucketCache_.Initialize(InModelAsset->shapeBucketing_, *session_, inputElementType_, outputElementType_);
+        }
+
+        bIsInitialized_ = true;
+        UE_LOG(LogTemp, Log, TEXT("FOnnxModelInstance initialized successfully"));
+
+        // 登记到驻留管理器：超出内存预算时空闲的会话会被释放，下次Run时重新加载
+        residency_.Register(displayName_, [this]() { return LoadSessions(); }, [this]() { ReleaseSessions(); }, residentBytes_);
+
+        // 会话级控制台变量变化时在后台按新配置重建会话
+        tuning_.Register(displayName_, [this](bool bForce)
+        {
+            RunPendingAutotune();
+            RebuildSessions(bForce);
+        }, [this]() { return GetSessionSettings().ToString(); });
+
+        // EP选择和首次调优在同一个后台任务中进行，选出的配置不同时经由RebuildSessions换入
+        if (bNeedsTuning)
+        {
+            UE_LOG(LogTemp, Log, TEXT("%s: selecting the execution provider / tuning in the background, using %s until then"),
+                   *displayName_, *settings_.ToString());
+            bAutotunePending_ = true;
+            tuning_.RequestRebuild(false);
         }
     }
     catch (const Ort::Exception& e)
@@ -85,14 +291,1361 @@ FOnnxModelInstance::FOnnxModelInstance(UOnnxModelAsset* InModelAsset): env_(null
 
 FOnnxModelInstance::~FOnnxModelInstance()
 {
-    ;
+    // 先停止后台重建，它引用了会话和驻留句柄；进行中的调优不再创建新会话
+    bShuttingDown_ = true;
+    tuning_.Unregister();
+    workers_.Reset();
+    pipeline_.Reset();
 }
 bool FOnnxModelInstance::IsInitialized() const
 {
     return bIsInitialized_;
 }
 
-bool FOnnxModelInstance::Run(const TArray<float>& InputData, TArray<float>& OutputData)
+bool FOnnxModelInstance::LoadSessions()
+{
+    const int64 memoryBefore = FOnnxResidencyManager::GetProcessUsedPhysical();
+
+    // 驱逐时释放了对预打包权重的引用，重新加载时重新获取（其他会话仍在使用时直接复用）
+    if (!prepackedWeights_.IsValid() && !modelHash_.IsEmpty())
+    {
+        prepackedWeights_ = FOnnxPrepackedWeightsRegistry::FindOrCreate(modelHash_);
+    }
+
+    FOnnxSessionSettings settings = GetSessionSettings();
+    session_ = CreateSession(settings);
+    if (!session_ && settings.ExecutionProvider != EOnnxExecutionProvider::CPU)
+    {
+        // 选中的EP在本机无法创建会话（例如缺少依赖库）时回退到默认CPU EP
+        UE_LOG(LogTemp, Warning, TEXT("Falling back to the default CPU execution provider"));
+        settings.ExecutionProvider = EOnnxExecutionProvider::CPU;
+        {
+            FScopeLock Lock(&settingsMutex_);
+            settings_.ExecutionProvider = EOnnxExecutionProvider::CPU;
+            baseSettings_.ExecutionProvider = EOnnxExecutionProvider::CPU;
+        }
+        session_ = CreateSession(settings);
+    }
+    if (!session_)
+    {
+        return false;
+    }
+
+    // 按NUMA节点创建会话副本组
+    if (settings.ReplicasPerNumaNode > 0)
+    {
+        numaPool_ = MakeUnique<FOnnxNumaSessionPool>();
+        if (!numaPool_->Initialize([this](const FOnnxSessionSettings& Settings) { return CreateSession(Settings); },
+                                   settings, settings.ReplicasPerNumaNode, FOnnxBenchmarkParams(), displayName_))
+        {
+            UE_LOG(LogTemp, Warning, TEXT("NUMA replicas unavailable, falling back to a single session"));
+            numaPool_.Reset();
+        }
+    }
+
+    // 进程物理内存的增量包含了权重、预打包缓冲区和内存池；其他线程同时分配时会有误差，至少按模型大小计
+    residentBytes_ = FMath::Max(FOnnxResidencyManager::GetProcessUsedPhysical() - memoryBefore, modelBytes_);
+    residency_.SetResidentBytes(residentBytes_);
+    return true;
+}
+
+void FOnnxModelInstance::ReleaseSessions()
+{
+    numaPool_.Reset();
+    session_.Reset();
+    prepackedWeights_.Reset();
+    bucketCache_.Reset();
+    allocations_.RestartWarmup();
+    UE_LOG(LogTemp, Log, TEXT("Released ONNX sessions of %s"), *displayName_);
+}
+
+void FOnnxModelInstance::RebuildSessions(bool bForce)
+{
+    const FOnnxSessionSettings newSettings = ComputeOverriddenSettings();
+    if (!bForce && FOnnxTuning::SessionSettingsEqual(newSettings, GetSessionSettings()))
+    {
+        return;
+    }
+
+    // 被驱逐的模型只更新配置，下次加载时按新配置创建
+    bool bUpdated = false;
+    if (!residency_.GetStats().bResident)
+    {
+        residency_.RunExclusive([&](bool bResident)
+        {
+            if (!bResident)
+            {
+                SetSessionSettings(newSettings);
+                bUpdated = true;
+            }
+        });
+        if (bUpdated)
+        {
+            UE_LOG(LogTemp, Log, TEXT("%s is not resident, new session settings apply on reload (%s)"), *displayName_, *newSettings.ToString());
+            return;
+        }
+    }
+
+    UE_LOG(LogTemp, Log, TEXT("Rebuilding ONNX sessions of %s in the background (%s)"), *displayName_, *newSettings.ToString());
+    const double startTime = FPlatformTime::Seconds();
+
+    // 创建期间持有驻留作用域，防止预打包权重被驱逐释放；请求照常使用旧会话
+    TUniquePtr<Ort::Session> newSession;
+    TUniquePtr<FOnnxNumaSessionPool> newPool;
+    {
+        FOnnxResidencyHandle::FScope residencyScope(residency_);
+        if (!residencyScope.IsResident())
+        {
+            return;
+        }
+
+        newSession = CreateSession(newSettings);
+        if (!newSession)
+        {
+            UE_LOG(LogTemp, Error, TEXT("Failed to rebuild the ONNX session of %s, keeping the current one"), *displayName_);
+
+            // 新选出的EP无法创建会话时留在当前EP上，之后的重建不再尝试它
+            const EOnnxExecutionProvider currentProvider = GetSessionSettings().ExecutionProvider;
+            if (newSettings.ExecutionProvider != currentProvider)
+            {
+                FScopeLock Lock(&settingsMutex_);
+                baseSettings_.ExecutionProvider = currentProvider;
+            }
+            return;
+        }
+
+        if (newSettings.ReplicasPerNumaNode > 0)
+        {
+            newPool = MakeUnique<FOnnxNumaSessionPool>();
+            if (!newPool->Initialize([this](const FOnnxSessionSettings& Settings) { return CreateSession(Settings); },
+                                     newSettings, newSettings.ReplicasPerNumaNode, FOnnxBenchmarkParams(), displayName_))
+            {
+                UE_LOG(LogTemp, Warning, TEXT("NUMA replicas unavailable, falling back to a single session"));
+                newPool.Reset();
+            }
+        }
+    }
+
+    const EOnnxExecutionProvider oldProvider = GetSessionSettings().ExecutionProvider;
+    if (newSettings.ExecutionProvider != oldProvider)
+    {
+        UE_LOG(LogTemp, Log, TEXT("Switching %s from the %s to the %s execution provider"), *displayName_,
+               FOnnxExecutionProviders::GetDisplayName(oldProvider), FOnnxExecutionProviders::GetDisplayName(newSettings.ExecutionProvider));
+    }
+
+    // 排空进行中的请求后换入新会话，预分配的缓冲区按新会话重新预热
+    residency_.RunExclusive([&](bool bResident)
+    {
+        SetSessionSettings(newSettings);
+        if (bResident)
+        {
+            Swap(session_, newSession);
+            Swap(numaPool_, newPool);
+            bucketCache_.Reset();
+            outputSlot_.Reset();
+            allocations_.RestartWarmup();
+        }
+    });
+
+    // 旧会话在锁外释放
+    newPool.Reset();
+    newSession.Reset();
+    UE_LOG(LogTemp, Log, TEXT("Rebuilt ONNX sessions of %s in %.2f s"), *displayName_, FPlatformTime::Seconds() - startTime);
+}
+
+FOnnxSessionSettings FOnnxModelInstance::GetSessionSettings() const
+{
+    FScopeLock Lock(&settingsMutex_);
+    return settings_;
+}
+
+void FOnnxModelInstance::SetSessionSettings(const FOnnxSessionSettings& Settings)
+{
+    FScopeLock Lock(&settingsMutex_);
+    settings_ = Settings;
+}
+
+FOnnxSessionSettings FOnnxModelInstance::ComputeOverriddenSettings() const
+{
+    FOnnxSessionSettings baseSettings;
+    {
+        FScopeLock Lock(&settingsMutex_);
+        baseSettings = baseSettings_;
+    }
+    return FOnnxTuning::ApplySessionOverrides(baseSettings);
+}
+
+void FOnnxModelInstance::RunPendingAutotune()
+{
+    if (!bAutotunePending_.exchange(false))
+    {
+        return;
+    }
+
+    FOnnxSessionSettings baseSettings;
+    {
+        FScopeLock Lock(&settingsMutex_);
+        baseSettings = baseSettings_;
+    }
+
+    const FOnnxSessionSettings resolved = FOnnxAutotuner::ResolveSettings(modelKey_, baseSettings,
+        [this](const FOnnxSessionSettings& Settings)
+        {
+            return bShuttingDown_ ? TUniquePtr<Ort::Session>() : CreateSession(Settings);
+        }, FOnnxAutotuner::MakeDefaultParams());
+    if (bShuttingDown_)
+    {
+        return;
+    }
+
+    FScopeLock Lock(&settingsMutex_);
+    baseSettings_ = resolved;
+}
+
+void FOnnxModelInstance::CacheNodeMetadata()
+{
+    size_t numInputNodes = session_->GetInputCount();
+    size_t numOutputNodes = session_->GetOutputCount();
+
+    UE_LOG(LogTemp, Log, TEXT("Model info - Inputs: %d, Outputs: %d"), numInputNodes, numOutputNodes);
+
+    // 普通输入/输出是第一个不属于状态张量的节点
+    Ort::AllocatorWithDefaultOptions allocator;
+    std::vector<const char*> inputSymbols;
+    for (size_t i = 0; i < numInputNodes; ++i)
+    {
+        auto inputName = session_->GetInputNameAllocated(i, allocator);
+        const FString name = UTF8_TO_TCHAR(inputName.get());
+        if (stateBindings_.IsStateInput(name))
+        {
+            continue;
+        }
+
+        inputNodeName_ = name;
+        inputNodeNameUtf8_ = inputName.get();
+        UE_LOG(LogTemp, Log, TEXT("Input node name: %s"), *inputNodeName_);
+
+        Ort::TypeInfo typeInfo = session_->GetInputTypeInfo(i);
+        Ort::ConstTensorTypeAndShapeInfo tensorInfo = typeInfo.GetTensorTypeAndShapeInfo();
+        inputElementType_ = tensorInfo.GetElementType();
+
+        std::vector<int64_t> dims = tensorInfo.GetShape();
+        inputNodeDims_.Reset();
+        for (int64_t dim : dims)
+        {
+            inputNodeDims_.Add(dim);
+        }
+        inputSymbols.resize(dims.size());
+        if (!dims.empty())
+        {
+            tensorInfo.GetSymbolicDimensions(inputSymbols.data(), inputSymbols.size());
+        }
+        break;
+    }
+
+    for (size_t i = 0; i < numOutputNodes; ++i)
+    {
+        auto outputName = session_->GetOutputNameAllocated(i, allocator);
+        const FString name = UTF8_TO_TCHAR(outputName.get());
+        if (stateBindings_.IsStateOutput(name))
+        {
+            continue;
+        }
+
+        outputNodeName_ = name;
+        outputNodeNameUtf8_ = outputName.get();
+        UE_LOG(LogTemp, Log, TEXT("Output node name: %s"), *outputNodeName_);
+
+        Ort::TypeInfo typeInfo = session_->GetOutputTypeInfo(i);
+        Ort::ConstTensorTypeAndShapeInfo tensorInfo = typeInfo.GetTensorTypeAndShapeInfo();
+        outputElementType_ = tensorInfo.GetElementType();
+
+        std::vector<int64_t> dims = tensorInfo.GetShape();
+        outputNodeDims_.Reset();
+        for (int64_t dim : dims)
+        {
+            outputNodeDims_.Add(dim);
+        }
+
+        // 输出的动态维度与输入的同名维度一致时，输出形状只取决于输入形状，可以预先分配
+        std::vector<const char*> outputSymbols(dims.size());
+        if (!dims.empty())
+        {
+            tensorInfo.GetSymbolicDimensions(outputSymbols.data(), outputSymbols.size());
+        }
+        outputDimInputAxes_.Reset();
+        for (size_t axis = 0; axis < dims.size(); ++axis)
+        {
+            int32 inputAxis = INDEX_NONE;
+            if (dims[axis] < 0)
+            {
+                const char* symbol = outputSymbols[axis];
+                for (size_t j = 0; symbol && symbol[0] && j < inputSymbols.size(); ++j)
+                {
+                    if (inputSymbols[j] && FCStringAnsi::Strcmp(symbol, inputSymbols[j]) == 0)
+                    {
+                        inputAxis = static_cast<int32>(j);
+                        break;
+                    }
+                }
+                if (inputAxis == INDEX_NONE)
+                {
+                    outputDimInputAxes_.Reset();
+                    break;
+                }
+            }
+            outputDimInputAxes_.Add(inputAxis);
+        }
+        break;
+    }
+}
+
+bool FOnnxModelInstance::PredictOutputShape(TConstArrayView<int64> InputShape, FOnnxInlineShape& OutShape) const
+{
+    if (outputDimInputAxes_.Num() != outputNodeDims_.Num() || outputNodeDims_.Num() == 0)
+    {
+        return false;
+    }
+
+    OutShape.Reset();
+    for (int32 axis = 0; axis < outputNodeDims_.Num(); ++axis)
+    {
+        const int32 inputAxis = outputDimInputAxes_[axis];
+        if (inputAxis == INDEX_NONE)
+        {
+            OutShape.Add(outputNodeDims_[axis]);
+        }
+        else if (InputShape.IsValidIndex(inputAxis))
+        {
+            OutShape.Add(InputShape[inputAxis]);
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FOnnxModelInstance::SetStateTensors(const TArray<FOnnxStateTensorPair>& Pairs)
+{
+    if (workers_)
+    {
+        UE_LOG(LogTemp, Error, TEXT("SetStateTensors: stateful models are not supported with ONNX workers"));
+        return false;
+    }
+    if (GetPipeline())
+    {
+        UE_LOG(LogTemp, Error, TEXT("SetStateTensors: stateful models are not supported in pipeline mode"));
+        return false;
+    }
+
+    FOnnxResidencyHandle::FScope residencyScope(residency_);
+    if (!residencyScope.IsResident() || !session_)
+    {
+        UE_LOG(LogTemp, Error, TEXT("SetStateTensors: session not ready"));
+        return false;
+    }
+
+    try
+    {
+        if (!stateBindings_.Initialize(Pairs, *session_))
+        {
+            stateBindings_.Initialize(TArray<FOnnxStateTensorPair>(), *session_);
+            CacheNodeMetadata();
+            return false;
+        }
+        CacheNodeMetadata();
+        return true;
+    }
+    catch (const Ort::Exception& e)
+    {
+        UE_LOG(LogTemp, Error, TEXT("ONNX Runtime error in SetStateTensors: %s"), UTF8_TO_TCHAR(e.what()));
+        return false;
+    }
+}
+
+void FOnnxModelInstance::ResetState()
+{
+    stateBindings_.Reset();
+}
+
+FOnnxStateSnapshot FOnnxModelInstance::SnapshotState() const
+{
+    return stateBindings_.Snapshot();
+}
+
+bool FOnnxModelInstance::RestoreState(const FOnnxStateSnapshot& Snapshot)
+{
+    return stateBindings_.Restore(Snapshot);
+}
+
+bool FOnnxModelInstance::WithSession(TFunctionRef<void(Ort::Session&)> Fn)
+{
+    FOnnxMemoryOwner::FScope memoryScope(memoryOwner_);
+    FOnnxResidencyHandle::FScope residencyScope(residency_);
+    if (!residencyScope.IsResident() || !session_)
+    {
+        return false;
+    }
+
+    TOptional<FOnnxNumaSessionPool::FLease> lease;
+    if (numaPool_)
+    {
+        lease.Emplace(numaPool_->Acquire());
+    }
+    Fn(lease.IsSet() ? lease->GetSession() : *session_);
+    return true;
+}
+
+FOnnxResidencyStats FOnnxModelInstance::GetResidencyStats() const
+{
+    return residency_.GetStats();
+}
+
+TUniquePtr<Ort::Session> FOnnxModelInstance::CreateSession(const FOnnxSessionSettings& Settings, const TArray<uint8>* ModelData) const
 {
-    return false;
-}
\ No newline at end of file
+    try
+    {
+        FOnnxMemoryOwner::FScope memoryScope(memoryOwner_);
+
+        // 共享运行时必须先于任何Ort对象创建（第一次使用时在这里加载ORT）
+        FOnnxRuntime& runtime = FOnnxRuntime::Get();
+        if (!runtime.IsAvailable())
+        {
+            return nullptr;
+        }
+
+        // 创建会话选项：插件线程策略 + 模型自身的配置
+        Ort::SessionOptions sessionOptions;
+        runtime.ConfigureSessionOptions(sessionOptions, Settings);
+        Settings.ApplyTo(sessionOptions);
+
+        // 映射已经由externalData_持有，这里只是把它们注入新的会话选项
+        TArray<FOnnxMappedExternalFilePtr> mappings;
+        if (!FOnnxExternalDataRegistry::ApplyToSessionOptions(sessionOptions, externalDataFiles_, mappings))
+        {
+            return nullptr;
+        }
+
+        Ort::Env& env = runtime.GetEnv();
+        OrtPrepackedWeightsContainer* container = prepackedWeights_.IsValid() ? prepackedWeights_->Get() : nullptr;
+        const UOnnxModelAsset* asset = modelAsset_.Get();
+        const double startTime = FPlatformTime::Seconds();
+
+        TUniquePtr<Ort::Session> session;
+        if (ModelData)
+        {
+            session = container
+                ? MakeUnique<Ort::Session>(env, ModelData->GetData(), ModelData->Num(), sessionOptions, container)
+                : MakeUnique<Ort::Session>(env, ModelData->GetData(), ModelData->Num(), sessionOptions);
+        }
+        else if (patchedModelData_.Num() > 0)
+        {
+            session = container
+                ? MakeUnique<Ort::Session>(env, patchedModelData_.GetData(), patchedModelData_.Num(), sessionOptions, container)
+                : MakeUnique<Ort::Session>(env, patchedModelData_.GetData(), patchedModelData_.Num(), sessionOptions);
+        }
+        else if (asset && asset->modelData_.Num() > 0)
+        {
+            session = container
+                ? MakeUnique<Ort::Session>(env, asset->modelData_.GetData(), asset->modelData_.Num(), sessionOptions, container)
+                : MakeUnique<Ort::Session>(env, asset->modelData_.GetData(), asset->modelData_.Num(), sessionOptions);
+        }
+        else if (!modelPath_.IsEmpty())
+        {
+            const std::basic_string<ORTCHAR_T> ortPath = FOnnxRuntime::ToOrtString(modelPath_);
+            session = container
+                ? MakeUnique<Ort::Session>(env, ortPath.c_str(), sessionOptions, container)
+                : MakeUnique<Ort::Session>(env, ortPath.c_str(), sessionOptions);
+        }
+        else
+        {
+            UE_LOG(LogTemp, Error, TEXT("No model source available to create a session"));
+            return nullptr;
+        }
+
+        FOnnxRuntime::ReportSessionCreated(displayName_, FPlatformTime::Seconds() - startTime);
+        return session;
+    }
+    catch (const Ort::Exception& e)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to create ONNX session (%s): %s"), *Settings.ToString(), UTF8_TO_TCHAR(e.what()));
+        return nullptr;
+    }
+}
+
+TArray<FOnnxBenchmarkResult> FOnnxModelInstance::BenchmarkSpinModes(const FOnnxBenchmarkParams& Params, int32 IntraOpThreads) const
+{
+    FOnnxSessionSettings baseSettings = GetSessionSettings();
+    if (IntraOpThreads > 0)
+    {
+        baseSettings.IntraOpThreads = IntraOpThreads;
+    }
+
+    TArray<FOnnxBenchmarkResult> results = FOnnxBenchmark::BenchmarkSpinModes(
+        [this](const FOnnxSessionSettings& Settings) { return CreateSession(Settings); }, baseSettings, Params);
+    FOnnxBenchmark::LogResults(results);
+    return results;
+}
+
+FOnnxAutotuneResult FOnnxModelInstance::Autotune(const FOnnxAutotuneGrid& Grid, const FOnnxBenchmarkParams& Params) const
+{
+    if (modelKey_.IsEmpty())
+    {
+        UE_LOG(LogTemp, Error, TEXT("Autotune: no model loaded"));
+        return FOnnxAutotuneResult();
+    }
+
+    FOnnxAutotuneResult result = FOnnxAutotuner::TuneAndSave(
+        [this](const FOnnxSessionSettings& Settings) { return CreateSession(Settings); }, GetSessionSettings(), Grid, Params, modelKey_);
+    FOnnxBenchmark::LogResults(result.Results);
+    return result;
+}
+
+TArray<FOnnxNumaNodeStats> FOnnxModelInstance::GetNumaNodeStats() const
+{
+    return numaPool_ ? numaPool_->GetNodeStats() : TArray<FOnnxNumaNodeStats>();
+}
+
+void FOnnxModelInstance::LogNumaNodeStats() const
+{
+    if (numaPool_)
+    {
+        numaPool_->LogNodeStats();
+    }
+}
+
+TArray<int64> FOnnxModelInstance::InferInputShape(int32 NumElements) const
+{
+    FOnnxInlineShape shape;
+    InferInputShape(NumElements, shape);
+    return TArray<int64>(shape.GetData(), shape.Num());
+}
+
+void FOnnxModelInstance::InferInputShape(int32 NumElements, FOnnxInlineShape& OutShape) const
+{
+    OutShape.Reset();
+    OutShape.Append(inputNodeDims_);
+
+    int64 knownElements = 1;
+    int32 dynamicIndex = INDEX_NONE;
+    for (int32 i = 0; i < OutShape.Num(); ++i)
+    {
+        if (OutShape[i] < 0)
+        {
+            if (dynamicIndex == INDEX_NONE)
+            {
+                dynamicIndex = i;
+                continue;
+            }
+            OutShape[i] = 1;
+        }
+        knownElements *= OutShape[i];
+    }
+    if (dynamicIndex != INDEX_NONE)
+    {
+        OutShape[dynamicIndex] = knownElements > 0 ? NumElements / knownElements : 0;
+    }
+}
+
+bool FOnnxModelInstance::Run(const TArray<float>& InputData, TArray<float>& OutputData)
+{
+    FOnnxAllocationCounter::FRunScope allocationScope(allocations_, TEXT("FOnnxModelInstance::Run"));
+    FOnnxMemoryOwner::FScope memoryScope(memoryOwner_);
+
+    FOnnxInlineShape shape;
+    InferInputShape(InputData.Num(), shape);
+
+    const FOnnxCaptureTensorView captureInput = MakeCaptureInput(InputData, shape);
+    FOnnxCaptureWriter::FRunScope captureScope(capture_, 0, MakeArrayView(&captureInput, 1));
+    const bool bSucceeded = RunInternal(InputData, shape, OutputData, nullptr);
+    captureScope.SetSucceeded(bSucceeded);
+    return bSucceeded;
+}
+
+bool FOnnxModelInstance::RunOutputs(const TArray<float>& InputData, const TArray<int64>& InputShape, const TArray<FString>& OutputNames,
+                                    TArray<TArray<float>>& OutOutputs, TArray<TArray<int64>>* OutShapes)
+{
+    int64 elementCount = 1;
+    for (int64 dim : InputShape)
+    {
+        elementCount *= dim;
+    }
+    if (elementCount != InputData.Num() || OutputNames.Num() == 0)
+    {
+        UE_LOG(LogTemp, Error, TEXT("FOnnxModelInstance::RunOutputs: invalid input or no outputs requested"));
+        return false;
+    }
+
+    if (workers_)
+    {
+        TArray<int32> outputIndices;
+        for (const FString& name : OutputNames)
+        {
+            const int32 index = workers_->FindOutput(TCHAR_TO_UTF8(*name));
+            if (index == INDEX_NONE)
+            {
+                UE_LOG(LogTemp, Error, TEXT("FOnnxModelInstance::RunOutputs: unknown output %s"), *name);
+                return false;
+            }
+            outputIndices.Add(index);
+        }
+
+        OutOutputs.SetNum(outputIndices.Num());
+        if (OutShapes)
+        {
+            OutShapes->SetNum(outputIndices.Num());
+        }
+        return RunOnWorker(InputData, InputShape, outputIndices, [&](int32 Position, const Ort::Value& Output)
+        {
+            if (OutShapes)
+            {
+                (*OutShapes)[Position].Reset();
+                for (int64_t dim : Output.GetTensorTypeAndShapeInfo().GetShape())
+                {
+                    (*OutShapes)[Position].Add(dim);
+                }
+            }
+            return FOnnxHalf::CopyToFloat(Output, OutOutputs[Position]);
+        });
+    }
+
+    if (TSharedPtr<FOnnxPipeline, ESPMode::ThreadSafe> pipeline = GetPipeline())
+    {
+        TArray<int32> outputIndices;
+        for (const FString& name : OutputNames)
+        {
+            const int32 index = pipeline->FindOutput(TCHAR_TO_UTF8(*name));
+            if (index == INDEX_NONE)
+            {
+                UE_LOG(LogTemp, Error, TEXT("FOnnxModelInstance::RunOutputs: unknown output %s"), *name);
+                return false;
+            }
+            outputIndices.Add(index);
+        }
+
+        OutOutputs.SetNum(outputIndices.Num());
+        if (OutShapes)
+        {
+            OutShapes->SetNum(outputIndices.Num());
+        }
+        return RunOnPipeline(InputData, InputShape, outputIndices, [&](int32 Position, const Ort::Value& Output)
+        {
+            if (OutShapes)
+            {
+                (*OutShapes)[Position].Reset();
+                for (int64_t dim : Output.GetTensorTypeAndShapeInfo().GetShape())
+                {
+                    (*OutShapes)[Position].Add(dim);
+                }
+            }
+            return FOnnxHalf::CopyToFloat(Output, OutOutputs[Position]);
+        });
+    }
+
+    std::vector<std::string> outputNamesUtf8;
+    std::vector<const char*> outputNames;
+    for (const FString& name : OutputNames)
+    {
+        outputNamesUtf8.push_back(TCHAR_TO_UTF8(*name));
+    }
+    for (const std::string& name : outputNamesUtf8)
+    {
+        outputNames.push_back(name.c_str());
+    }
+
+    try
+    {
+        bool bSucceeded = false;
+        const bool bHasSession = WithSession([&](Ort::Session& session)
+        {
+            Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+            TArray<uint16> halfInput;
+            Ort::Value inputTensor = FOnnxHalf::CreateTensor(memoryInfo, InputData.GetData(), InputData.Num(),
+                                                             reinterpret_cast<const int64_t*>(InputShape.GetData()), InputShape.Num(), inputElementType_, halfInput);
+
+            // 只取回请求的输出；要让不需要的头部网络不再计算，在资产上启用bExtraOutputsOnly_裁剪图
+            const char* inputNames[] = { inputNodeNameUtf8_.c_str() };
+            std::vector<Ort::Value> outputs = session.Run(Ort::RunOptions{nullptr}, inputNames, &inputTensor, 1, outputNames.data(), outputNames.size());
+
+            OutOutputs.SetNum(outputs.size());
+            if (OutShapes)
+            {
+                OutShapes->SetNum(outputs.size());
+            }
+            for (size_t i = 0; i < outputs.size(); ++i)
+            {
+                if (!FOnnxHalf::CopyToFloat(outputs[i], OutOutputs[i]))
+                {
+                    return;
+                }
+
+                Ort::TensorTypeAndShapeInfo info = outputs[i].GetTensorTypeAndShapeInfo();
+                if (OutShapes)
+                {
+                    (*OutShapes)[i].Reset();
+                    for (int64_t dim : info.GetShape())
+                    {
+                        (*OutShapes)[i].Add(dim);
+                    }
+                }
+            }
+            bSucceeded = true;
+        });
+
+        if (!bHasSession)
+        {
+            UE_LOG(LogTemp, Error, TEXT("FOnnxModelInstance::RunOutputs: session not ready"));
+        }
+        return bSucceeded;
+    }
+    catch (const Ort::Exception& e)
+    {
+        UE_LOG(LogTemp, Error, TEXT("ONNX Runtime error in RunOutputs: %s"), UTF8_TO_TCHAR(e.what()));
+        return false;
+    }
+}
+
+bool FOnnxModelInstance::Run(const TArray<float>& InputData, const TArray<int64>& InputShape, TArray<float>& OutputData, TArray<int64>* OutOutputShape)
+{
+    FOnnxAllocationCounter::FRunScope allocationScope(allocations_, TEXT("FOnnxModelInstance::Run"));
+    FOnnxMemoryOwner::FScope memoryScope(memoryOwner_);
+
+    const FOnnxCaptureTensorView captureInput = MakeCaptureInput(InputData, InputShape);
+    FOnnxCaptureWriter::FRunScope captureScope(capture_, 0, MakeArrayView(&captureInput, 1));
+    const bool bSucceeded = RunInternal(InputData, InputShape, OutputData, OutOutputShape);
+    captureScope.SetSucceeded(bSucceeded);
+    return bSucceeded;
+}
+
+bool FOnnxModelInstance::Run(const FOnnxTensor& Input, FOnnxTensor& OutOutput)
+{
+    if (!Input.IsValid())
+    {
+        UE_LOG(LogTemp, Error, TEXT("FOnnxModelInstance::Run: invalid input tensor"));
+        return false;
+    }
+
+    // 这些模式按float数组交换数据，张量经由数组运行
+    if (workers_ || stateBindings_.IsEnabled() || bucketCache_.IsEnabled() || GetPipeline())
+    {
+        TArray<float> inputData;
+        if (!Input.CopyToFloat(inputData))
+        {
+            UE_LOG(LogTemp, Error, TEXT("FOnnxModelInstance::Run: only Float and Half tensors are supported in this mode"));
+            return false;
+        }
+
+        const TArray<int64> inputShape(Input.GetShape());
+        TArray<float> outputData;
+        TArray<int64> outputShape;
+        if (!Run(inputData, inputShape, outputData, &outputShape))
+        {
+            return false;
+        }
+        OutOutput = FOnnxTensor::FromArray(outputData, outputShape);
+        return OutOutput.IsValid();
+    }
+
+    FOnnxAllocationCounter::FRunScope allocationScope(allocations_, TEXT("FOnnxModelInstance::Run"));
+    FOnnxMemoryOwner::FScope memoryScope(memoryOwner_);
+    FOnnxResidencyHandle::FScope residencyScope(residency_);
+
+    if (!residencyScope.IsResident() || !session_ || inputNodeNameUtf8_.empty() || outputNodeNameUtf8_.empty())
+    {
+        UE_LOG(LogTemp, Error, TEXT("FOnnxModelInstance::Run: session not ready"));
+        return false;
+    }
+
+    // 类型与模型输入相同时直接引用调用方的存储
+    EOnnxTensorType inputType;
+    if (!FOnnxTensor::FromOrtType(inputElementType_, inputType))
+    {
+        UE_LOG(LogTemp, Error, TEXT("FOnnxModelInstance::Run: unsupported model input type %d"), static_cast<int32>(inputElementType_));
+        return false;
+    }
+    const FOnnxTensor input = Input.ConvertTo(inputType);
+    if (!input.IsValid())
+    {
+        return false;
+    }
+
+    FOnnxCaptureTensorView captureInput;
+    captureInput.Name = inputNodeNameUtf8_.c_str();
+    captureInput.Type = input.GetOrtType();
+    captureInput.Shape = input.GetShape();
+    captureInput.Data = input.GetRawData();
+    captureInput.NumBytes = input.GetSizeBytes();
+    FOnnxCaptureWriter::FRunScope captureScope(capture_, 0, MakeArrayView(&captureInput, 1));
+
+    try
+    {
+        TOptional<FOnnxNumaSessionPool::FLease> lease;
+        if (numaPool_)
+        {
+            lease.Emplace(numaPool_->Acquire());
+        }
+        Ort::Session& session = lease.IsSet() ? lease->GetSession() : *session_;
+
+        Ort::Value inputTensor = input.ToOrtValue();
+        const char* inputNames[] = { inputNodeNameUtf8_.c_str() };
+        const char* outputNames[] = { outputNodeNameUtf8_.c_str() };
+
+        // 输出形状静态时ORT直接写入池化的张量
+        EOnnxTensorType outputType;
+        if (FOnnxTensor::GetElementCount(outputNodeDims_) >= 0 && FOnnxTensor::FromOrtType(outputElementType_, outputType))
+        {
+            FOnnxTensor output = FOnnxTensor::Allocate(outputType, outputNodeDims_);
+            Ort::Value outputTensor = output.ToOrtValue();
+            session.Run(Ort::RunOptions{nullptr}, inputNames, &inputTensor, 1, outputNames, &outputTensor, 1);
+            OutOutput = MoveTemp(output);
+        }
+        else
+        {
+            std::vector<Ort::Value> outputs = session.Run(Ort::RunOptions{nullptr}, inputNames, &inputTensor, 1, outputNames, 1);
+            OutOutput = outputs.empty() ? FOnnxTensor() : FOnnxTensor::AdoptOrtValue(outputs[0]);
+        }
+
+        captureScope.SetSucceeded(OutOutput.IsValid());
+        return OutOutput.IsValid();
+    }
+    catch (const Ort::Exception& e)
+    {
+        UE_LOG(LogTemp, Error, TEXT("ONNX Runtime error in Run: %s"), UTF8_TO_TCHAR(e.what()));
+        return false;
+    }
+}
+
+void FOnnxModelInstance::RunAsync(const TArray<float>& InputData, const TArray<int64>& InputShape, FOnnxRunCallback&& OnComplete)
+{
+    TSharedPtr<FOnnxPipeline, ESPMode::ThreadSafe> pipeline = GetPipeline();
+    if (!pipeline)
+    {
+        TArray<float> outputData;
+        TArray<int64> outputShape;
+        const bool bSucceeded = Run(InputData, InputShape, outputData, &outputShape);
+        OnComplete(bSucceeded, outputData, outputShape);
+        return;
+    }
+
+    std::vector<Ort::Value> inputs;
+    bool bCreated = false;
+    try
+    {
+        bCreated = CreatePipelineInput(InputData, InputShape, inputs);
+    }
+    catch (const Ort::Exception& e)
+    {
+        UE_LOG(LogTemp, Error, TEXT("ONNX Runtime error in RunAsync: %s"), UTF8_TO_TCHAR(e.what()));
+    }
+    if (!bCreated)
+    {
+        TArray<float> outputData;
+        TArray<int64> outputShape;
+        OnComplete(false, outputData, outputShape);
+        return;
+    }
+
+    // 回调在最后一个阶段的线程上执行，只引用请求自己的输出
+    const int32 outputIndex = pipeline->FindOutput(outputNodeNameUtf8_.c_str());
+    pipeline->Submit(std::move(inputs), [outputIndex, OnComplete = MoveTemp(OnComplete)](bool bSucceeded, std::vector<Ort::Value>& Outputs)
+    {
+        TArray<float> outputData;
+        TArray<int64> outputShape;
+        bSucceeded = bSucceeded && outputIndex != INDEX_NONE && outputIndex < static_cast<int32>(Outputs.size());
+        if (bSucceeded)
+        {
+            try
+            {
+                bSucceeded = FOnnxHalf::CopyToFloat(Outputs[outputIndex], outputData);
+                for (int64_t dim : Outputs[outputIndex].GetTensorTypeAndShapeInfo().GetShape())
+                {
+                    outputShape.Add(dim);
+                }
+            }
+            catch (const Ort::Exception& e)
+            {
+                UE_LOG(LogTemp, Error, TEXT("ONNX Runtime error in RunAsync: %s"), UTF8_TO_TCHAR(e.what()));
+                bSucceeded = false;
+            }
+        }
+        OnComplete(bSucceeded, outputData, outputShape);
+    });
+}
+
+FOnnxCaptureTensorView FOnnxModelInstance::MakeCaptureInput(const TArray<float>& InputData, TConstArrayView<int64> InputShape) const
+{
+    // 录制调用方的输入：fp16转换和分桶填充在回放时按会话的输入类型重新完成
+    FOnnxCaptureTensorView view;
+    view.Name = inputNodeNameUtf8_.c_str();
+    view.Type = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+    view.Shape = InputShape;
+    view.Data = InputData.GetData();
+    view.NumBytes = InputData.Num() * sizeof(float);
+    return view;
+}
+
+bool FOnnxModelInstance::StartCapture(const FString& FilePath, const FOnnxCaptureConfig& Config)
+{
+    if (!bIsInitialized_ || inputNodeNameUtf8_.empty())
+    {
+        UE_LOG(LogTemp, Error, TEXT("%s: cannot capture, model is not initialized"), *displayName_);
+        return false;
+    }
+    if (stateBindings_.IsEnabled())
+    {
+        UE_LOG(LogTemp, Error, TEXT("%s: capture of stateful models is not supported (state tensors are not recorded)"), *displayName_);
+        return false;
+    }
+
+    // 变体和文件来源按文件路径回放，内存中的资产字节按资产路径重新加载
+    FOnnxCaptureModel model;
+    model.Role = TEXT("model");
+    model.bSourceIsAsset = modelPath_.IsEmpty() && modelAsset_.IsValid();
+    model.Source = model.bSourceIsAsset ? modelAsset_->GetPathName() : FPaths::ConvertRelativePathToFull(modelPath_);
+    model.Settings = GetSessionSettings();
+    model.OutputNames.Add(outputNodeName_);
+
+    TArray<FOnnxCaptureModel> models;
+    models.Add(MoveTemp(model));
+    return capture_.Open(FOnnxCaptureWriter::ResolvePath(FilePath, displayName_), models, Config);
+}
+
+void FOnnxModelInstance::StopCapture()
+{
+    capture_.Close();
+}
+
+bool FOnnxModelInstance::RunInternal(const TArray<float>& InputData, TConstArrayView<int64> InputShape, TArray<float>& OutputData, TArray<int64>* OutOutputShape)
+{
+    if (workers_)
+    {
+        const int32 outputIndex = workers_->FindOutput(outputNodeNameUtf8_.c_str());
+        return RunOnWorker(InputData, InputShape, MakeArrayView(&outputIndex, 1), [&](int32 Position, const Ort::Value& Output)
+        {
+            if (OutOutputShape)
+            {
+                const std::vector<int64_t> dims = Output.GetTensorTypeAndShapeInfo().GetShape();
+                OutOutputShape->Reset();
+                for (int64_t dim : dims)
+                {
+                    OutOutputShape->Add(dim);
+                }
+            }
+            return FOnnxHalf::CopyToFloat(Output, OutputData);
+        });
+    }
+
+    if (TSharedPtr<FOnnxPipeline, ESPMode::ThreadSafe> pipeline = GetPipeline())
+    {
+        const int32 outputIndex = pipeline->FindOutput(outputNodeNameUtf8_.c_str());
+        return RunOnPipeline(InputData, InputShape, MakeArrayView(&outputIndex, 1), [&](int32 Position, const Ort::Value& Output)
+        {
+            if (OutOutputShape)
+            {
+                const std::vector<int64_t> dims = Output.GetTensorTypeAndShapeInfo().GetShape();
+                OutOutputShape->Reset();
+                for (int64_t dim : dims)
+                {
+                    OutOutputShape->Add(dim);
+                }
+            }
+            return FOnnxHalf::CopyToFloat(Output, OutputData);
+        });
+    }
+
+    // 确保会话驻留（被驱逐过时重新加载），作用域内不会被驱逐
+    FOnnxResidencyHandle::FScope residencyScope(residency_);
+
+    if (!residencyScope.IsResident() || !session_ || inputNodeNameUtf8_.empty() || outputNodeNameUtf8_.empty())
+    {
+        UE_LOG(LogTemp, Error, TEXT("FOnnxModelInstance::Run: session not ready"));
+        return false;
+    }
+
+    int64 elementCount = 1;
+    for (int64 dim : InputShape)
+    {
+        elementCount *= dim;
+    }
+    if (elementCount != InputData.Num())
+    {
+        UE_LOG(LogTemp, Error, TEXT("FOnnxModelInstance::Run: input has %d elements, model expects %lld"), InputData.Num(), elementCount);
+        return false;
+    }
+
+    try
+    {
+        // NUMA副本组启用时使用调用线程所在节点的副本
+        TOptional<FOnnxNumaSessionPool::FLease> lease;
+        if (numaPool_)
+        {
+            lease.Emplace(numaPool_->Acquire());
+        }
+        Ort::Session& session = lease.IsSet() ? lease->GetSession() : *session_;
+
+        // 暂存区被其他请求占用时使用临时缓冲区
+        FScopeTryLock scratchLock(&scratchMutex_);
+        TArray<uint16> localHalfInput;
+        TArray<uint16>& halfInput = scratchLock.IsLocked() ? halfInputScratch_ : localHalfInput;
+
+        const int64_t* inputShape = reinterpret_cast<const int64_t*>(InputShape.GetData());
+        Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+
+        // 有状态模式：状态张量保持绑定，只传入新的输入
+        if (stateBindings_.IsEnabled())
+        {
+            Ort::Value inputTensor = FOnnxHalf::CreateTensor(memoryInfo, InputData.GetData(), InputData.Num(),
+                                                             inputShape, InputShape.Num(), inputElementType_, halfInput);
+            return stateBindings_.Run(session, inputNodeNameUtf8_.c_str(), inputTensor, outputNodeNameUtf8_.c_str(), OutputData, OutOutputShape);
+        }
+
+        // 形状落在某个桶内时填充到桶大小运行，复用该桶预分配的输入/输出张量
+        TArray<int64> localOutputShape;
+        if (bucketCache_.TryRun(session, inputNodeNameUtf8_.c_str(), outputNodeNameUtf8_.c_str(), InputData, InputShape, OutputData,
+                                OutOutputShape ? *OutOutputShape : localOutputShape))
+        {
+            return true;
+        }
+
+        // fp16模型的输入在这里转换，输出在读取时转换回float
+        Ort::Value inputTensor = FOnnxHalf::CreateTensor(memoryInfo, InputData.GetData(), InputData.Num(),
+                                                         inputShape, InputShape.Num(), inputElementType_, halfInput);
+
+        const char* inputNames[] = { inputNodeNameUtf8_.c_str() };
+        const char* outputNames[] = { outputNodeNameUtf8_.c_str() };
+
+        // 由输入形状推算的输出形状与预热记录的一致时，输出直接写入OutputData，预热之后不再分配。
+        // 推算不出（数据相关的输出维度）或形状变化时由ORT分配输出
+        FOnnxInlineShape expectedOutputShape;
+        const bool bUseOutputSlot = scratchLock.IsLocked() && outputSlot_.IsReady() &&
+            PredictOutputShape(InputShape, expectedOutputShape) &&
+            expectedOutputShape.Num() == outputSlot_.Shape.Num() &&
+            FMemory::Memcmp(expectedOutputShape.GetData(), outputSlot_.Shape.GetData(), outputSlot_.Shape.Num() * sizeof(int64)) == 0;
+        if (bUseOutputSlot)
+        {
+            Ort::Value outputTensor = outputSlot_.Bind(memoryInfo, OutputData);
+            session.Run(Ort::RunOptions{nullptr}, inputNames, &inputTensor, 1, outputNames, &outputTensor, 1);
+            outputSlot_.Finish(OutputData);
+
+            if (OutOutputShape)
+            {
+                OutOutputShape->Reset();
+                OutOutputShape->Append(outputSlot_.Shape);
+            }
+            return true;
+        }
+
+        std::vector<Ort::Value> outputs = session.Run(Ort::RunOptions{nullptr}, inputNames, &inputTensor, 1, outputNames, 1);
+        if (outputs.empty() || !outputs[0].IsTensor() || !FOnnxHalf::CopyToFloat(outputs[0], OutputData))
+        {
+            return false;
+        }
+
+        // 只有输出形状能由输入形状推算时才预分配，之后的请求按推算结果判断是否适用
+        if (scratchLock.IsLocked() && outputDimInputAxes_.Num() > 0)
+        {
+            outputSlot_.Capture(outputs[0]);
+        }
+
+        if (OutOutputShape)
+        {
+            const std::vector<int64_t> dims = outputs[0].GetTensorTypeAndShapeInfo().GetShape();
+            OutOutputShape->Reset();
+            for (int64_t dim : dims)
+            {
+                OutOutputShape->Add(dim);
+            }
+        }
+        return true;
+    }
+    catch (const Ort::Exception& e)
+    {
+        UE_LOG(LogTemp, Error, TEXT("ONNX Runtime error in Run: %s"), UTF8_TO_TCHAR(e.what()));
+        return false;
+    }
+}
+
+bool FOnnxModelInstance::StartWorkers(const FOnnxWorkerSettings& WorkerSettings)
+{
+    // 工作进程按路径加载模型：内存中的资产字节和修改后的图先写到Saved/Onnx/Workers（按内容命名，只写一次）
+    FString workerModelPath = modelPath_;
+    const UOnnxModelAsset* asset = modelAsset_.Get();
+    const TArray<uint8>* modelData = patchedModelData_.Num() > 0 ? &patchedModelData_ : (asset && modelPath_.IsEmpty() ? &asset->modelData_ : nullptr);
+    if (modelData)
+    {
+        if (externalDataFiles_.Num() > 0)
+        {
+            UE_LOG(LogTemp, Error, TEXT("%s: ONNX workers cannot load in-memory models with external data, disable workerSettings_ or export the model with its data"),
+                   *displayName_);
+            return false;
+        }
+
+        workerModelPath = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Onnx"), TEXT("Workers"), modelKey_ + TEXT(".onnx"));
+        if (IFileManager::Get().FileSize(*workerModelPath) != modelData->Num() && !FFileHelper::SaveArrayToFile(*modelData, *workerModelPath))
+        {
+            UE_LOG(LogTemp, Error, TEXT("%s: failed to write the model for ONNX workers: %s"), *displayName_, *workerModelPath);
+            return false;
+        }
+    }
+    if (workerModelPath.IsEmpty())
+    {
+        UE_LOG(LogTemp, Error, TEXT("%s: no model source available for ONNX workers"), *displayName_);
+        return false;
+    }
+
+    workers_ = MakeUnique<FOnnxWorkerPool>();
+    if (!workers_->Start(workerModelPath, GetSessionSettings(), WorkerSettings, displayName_) || workers_->GetNumInputs() == 0 || workers_->GetNumOutputs() == 0)
+    {
+        return false;
+    }
+
+    // 普通输入/输出为第一个输入/输出，与进程内模式一致
+    const OnnxCore::FWorkerNodeInfo& input = workers_->GetInputInfo(0);
+    inputNodeNameUtf8_ = input.Name;
+    inputNodeName_ = UTF8_TO_TCHAR(input.Name);
+    inputElementType_ = static_cast<ONNXTensorElementDataType>(input.ElementType);
+    inputNodeDims_.Reset();
+    inputNodeDims_.Append(input.Dims, input.NumDims);
+
+    const OnnxCore::FWorkerNodeInfo& output = workers_->GetOutputInfo(0);
+    outputNodeNameUtf8_ = output.Name;
+    outputNodeName_ = UTF8_TO_TCHAR(output.Name);
+    UE_LOG(LogTemp, Log, TEXT("Worker model info - Input: %s, Output: %s"), *inputNodeName_, *outputNodeName_);
+
+    if (asset && asset->shapeBucketing_.bEnabled)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Shape bucketing of %s is disabled: not supported with ONNX workers"), *displayName_);
+    }
+    if (GetSessionSettings().ReplicasPerNumaNode > 0)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("NUMA replicas of %s are disabled: use CpuSets to partition ONNX workers instead"), *displayName_);
+    }
+    return true;
+}
+
+bool FOnnxModelInstance::RunOnWorker(const TArray<float>& InputData, TConstArrayView<int64> InputShape, TConstArrayView<int32> OutputIndices,
+                                     TFunctionRef<bool(int32 Position, const Ort::Value& Output)> OnOutput)
+{
+    int64 elementCount = 1;
+    for (int64 dim : InputShape)
+    {
+        elementCount *= dim;
+    }
+    if (elementCount != InputData.Num())
+    {
+        UE_LOG(LogTemp, Error, TEXT("FOnnxModelInstance::Run: input has %d elements, model expects %lld"), InputData.Num(), elementCount);
+        return false;
+    }
+    if (inputElementType_ != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT && inputElementType_ != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16)
+    {
+        UE_LOG(LogTemp, Error, TEXT("FOnnxModelInstance::Run: unsupported input type %d"), static_cast<int32>(inputElementType_));
+        return false;
+    }
+
+    const int32 inputIndex = workers_->FindInput(inputNodeNameUtf8_.c_str());
+    uint64 outputMask = 0;
+    for (int32 index : OutputIndices)
+    {
+        if (index == INDEX_NONE || index >= 64)
+        {
+            UE_LOG(LogTemp, Error, TEXT("FOnnxModelInstance::Run: invalid worker output"));
+            return false;
+        }
+        outputMask |= uint64(1) << index;
+    }
+
+    try
+    {
+        FOnnxWorkerPool::FRequest request(*workers_);
+        if (!request.IsValid())
+        {
+            return false;
+        }
+
+        // 输入直接写入共享内存，fp16模型在写入时转换
+        void* input = request.AddInput(inputIndex, inputElementType_, InputShape);
+        if (!input)
+        {
+            return false;
+        }
+        if (inputElementType_ == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16)
+        {
+            FOnnxHalf::ConvertToHalf(InputData.GetData(), static_cast<uint16*>(input), InputData.Num());
+        }
+        else
+        {
+            FMemory::Memcpy(input, InputData.GetData(), InputData.Num() * sizeof(float));
+        }
+
+        request.SetOutputMask(outputMask);
+        if (!request.Execute())
+        {
+            return false;
+        }
+
+        for (int32 i = 0; i < OutputIndices.Num(); ++i)
+        {
+            const int32 position = request.FindOutput(OutputIndices[i]);
+            if (position == INDEX_NONE || !OnOutput(i, request.GetOutput(position)))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    catch (const Ort::Exception& e)
+    {
+        UE_LOG(LogTemp, Error, TEXT("ONNX Runtime error in worker Run: %s"), UTF8_TO_TCHAR(e.what()));
+        return false;
+    }
+}
+
+FOnnxWorkerPoolStats FOnnxModelInstance::GetWorkerStats() const
+{
+    return workers_ ? workers_->GetStats() : FOnnxWorkerPoolStats();
+}
+
+bool FOnnxModelInstance::StartPipeline(const FOnnxPipelineSettings& PipelineSettings)
+{
+    pipelineSettings_ = PipelineSettings;
+    pipeline_ = BuildPipeline(GetSessionSettings());
+    if (!pipeline_ || pipeline_->GetNumInputs() == 0 || pipeline_->GetNumOutputs() == 0)
+    {
+        return false;
+    }
+
+    // Run只提供一个输入，与进程内模式一致
+    if (pipeline_->GetNumInputs() > 1)
+    {
+        UE_LOG(LogTemp, Error, TEXT("%s: pipeline mode supports single-input models only (model has %d inputs)"), *displayName_, pipeline_->GetNumInputs());
+        return false;
+    }
+
+    const FOnnxGraphTensorType& inputType = pipeline_->GetInputType(0);
+    inputNodeNameUtf8_ = pipeline_->GetInputName(0);
+    inputNodeName_ = UTF8_TO_TCHAR(inputNodeNameUtf8_.c_str());
+    inputElementType_ = static_cast<ONNXTensorElementDataType>(inputType.ElementType);
+    inputNodeDims_ = inputType.Shape;
+
+    outputNodeNameUtf8_ = pipeline_->GetOutputName(0);
+    outputNodeName_ = UTF8_TO_TCHAR(outputNodeNameUtf8_.c_str());
+    UE_LOG(LogTemp, Log, TEXT("Pipeline model info - Input: %s, Output: %s"), *inputNodeName_, *outputNodeName_);
+
+    const UOnnxModelAsset* asset = modelAsset_.Get();
+    if (asset && asset->shapeBucketing_.bEnabled)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Shape bucketing of %s is disabled: not supported in pipeline mode"), *displayName_);
+    }
+    if (GetSessionSettings().ReplicasPerNumaNode > 0)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("NUMA replicas of %s are disabled: not supported in pipeline mode"), *displayName_);
+    }
+    return true;
+}
+
+TSharedPtr<FOnnxPipeline, ESPMode::ThreadSafe> FOnnxModelInstance::BuildPipeline(const FOnnxSessionSettings& Settings) const
+{
+    // 在内存中的模型上切分：修改后的图或资产字节，文件来源时读入整个文件
+    TArray<uint8> fileData;
+    const UOnnxModelAsset* asset = modelAsset_.Get();
+    const TArray<uint8>* modelData = patchedModelData_.Num() > 0 ? &patchedModelData_ : (asset && modelPath_.IsEmpty() ? &asset->modelData_ : nullptr);
+    if (!modelData)
+    {
+        if (modelPath_.IsEmpty() || !FFileHelper::LoadFileToArray(fileData, *modelPath_))
+        {
+            UE_LOG(LogTemp, Error, TEXT("%s: failed to read the model for pipeline splitting"), *displayName_);
+            return nullptr;
+        }
+        modelData = &fileData;
+    }
+
+    TSharedPtr<FOnnxPipeline, ESPMode::ThreadSafe> pipeline = MakeShared<FOnnxPipeline, ESPMode::ThreadSafe>();
+    if (!pipeline->Start(*modelData, Settings, pipelineSettings_, displayName_,
+                         [this](const FOnnxSessionSettings& StageSettings, const TArray<uint8>& StageData) { return CreateSession(StageSettings, &StageData); }))
+    {
+        return nullptr;
+    }
+    return pipeline;
+}
+
+TSharedPtr<FOnnxPipeline, ESPMode::ThreadSafe> FOnnxModelInstance::GetPipeline() const
+{
+    FScopeLock Lock(&pipelineMutex_);
+    return pipeline_;
+}
+
+bool FOnnxModelInstance::CreatePipelineInput(const TArray<float>& InputData, TConstArrayView<int64> InputShape, std::vector<Ort::Value>& OutInputs) const
+{
+    int64 elementCount = 1;
+    for (int64 dim : InputShape)
+    {
+        elementCount *= dim;
+    }
+    if (elementCount != InputData.Num())
+    {
+        UE_LOG(LogTemp, Error, TEXT("FOnnxModelInstance::Run: input has %d elements, model expects %lld"), InputData.Num(), elementCount);
+        return false;
+    }
+    if (inputElementType_ != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT && inputElementType_ != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16)
+    {
+        UE_LOG(LogTemp, Error, TEXT("FOnnxModelInstance::Run: unsupported input type %d"), static_cast<int32>(inputElementType_));
+        return false;
+    }
+
+    // fp16模型在复制时转换
+    Ort::AllocatorWithDefaultOptions allocator;
+    Ort::Value input = Ort::Value::CreateTensor(allocator, reinterpret_cast<const int64_t*>(InputShape.GetData()), InputShape.Num(), inputElementType_);
+    if (inputElementType_ == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16)
+    {
+        FOnnxHalf::ConvertToHalf(InputData.GetData(), static_cast<uint16*>(input.GetTensorMutableRawData()), InputData.Num());
+    }
+    else
+    {
+        FMemory::Memcpy(input.GetTensorMutableRawData(), InputData.GetData(), InputData.Num() * sizeof(float));
+    }
+    OutInputs.push_back(std::move(input));
+    return true;
+}
+
+bool FOnnxModelInstance::RunOnPipeline(const TArray<float>& InputData, TConstArrayView<int64> InputShape, TConstArrayView<int32> OutputIndices,
+                                       TFunctionRef<bool(int32 Position, const Ort::Value& Output)> OnOutput)
+{
+    TSharedPtr<FOnnxPipeline, ESPMode::ThreadSafe> pipeline = GetPipeline();
+    try
+    {
+        std::vector<Ort::Value> inputs;
+        if (!CreatePipelineInput(InputData, InputShape, inputs))
+        {
+            return false;
+        }
+
+        std::vector<Ort::Value> outputs;
+        if (!pipeline->Run(std::move(inputs), outputs))
+        {
+            return false;
+        }
+
+        for (int32 i = 0; i < OutputIndices.Num(); ++i)
+        {
+            const int32 index = OutputIndices[i];
+            if (index == INDEX_NONE || index >= static_cast<int32>(outputs.size()) || !OnOutput(i, outputs[index]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    catch (const Ort::Exception& e)
+    {
+        UE_LOG(LogTemp, Error, TEXT("ONNX Runtime error in pipeline Run: %s"), UTF8_TO_TCHAR(e.what()));
+        return false;
+    }
+}
+
+FOnnxPipelineStats FOnnxModelInstance::GetPipelineStats() const
+{
+    TSharedPtr<FOnnxPipeline, ESPMode::ThreadSafe> pipeline = GetPipeline();
+    return pipeline ? pipeline->GetStats() : FOnnxPipelineStats();
+}
@@ -0,0 +1,335 @@
+// OnnxModelRegistry.cpp
+
+#include "OnnxModelRegistry.h"
+#include "OnnxModelAsset.h"
+#include "OnnxModelInstance.h"
+#include "OnnxPrepackedWeights.h"
+#include "OnnxTuning.h"
+#include "Engine/Engine.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/ConfigCacheIni.h"
+#include "Misc/OutputDevice.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+
+namespace
+{
+    // 检查空闲实例的间隔（秒）
+    constexpr float RegistryTickInterval = 1.0f;
+
+    // 把USTRUCT的所有属性追加到键中
+    template <typename StructType>
+    void AppendStructText(FString& Key, const StructType& Value)
+    {
+        FString text;
+        StructType::StaticStruct()->ExportText(text, &Value, nullptr, nullptr, PPF_None, nullptr);
+        Key += TEXT("|");
+        Key += text;
+    }
+
+    FAutoConsoleCommandWithOutputDevice GOnnxRegistryCommand(
+        TEXT("onnx.Registry"),
+        TEXT("Lists the shared model instances of the model registry with their handle counts and idle time."),
+        FConsoleCommandWithOutputDeviceDelegate::CreateLambda([](FOutputDevice& Ar)
+        {
+            if (const UOnnxModelRegistry* registry = UOnnxModelRegistry::Get())
+            {
+                registry->Dump(Ar);
+            }
+            else
+            {
+                Ar.Logf(TEXT("ONNX model registry is not available"));
+            }
+        }));
+}
+
+UOnnxModelRegistry* UOnnxModelRegistry::Get()
+{
+    return GEngine ? GEngine->GetEngineSubsystem<UOnnxModelRegistry>() : nullptr;
+}
+
+void UOnnxModelRegistry::Initialize(FSubsystemCollectionBase& Collection)
+{
+    Super::Initialize(Collection);
+
+    if (GConfig)
+    {
+        GConfig->GetFloat(TEXT("OnnxRuntime"), TEXT("ModelRegistryGraceSeconds"), graceSeconds_, GEngineIni);
+    }
+
+    tickerHandle_ = FTSTicker::GetCoreTicker().AddTicker(
+        FTickerDelegate::CreateUObject(this, &UOnnxModelRegistry::Tick), RegistryTickInterval);
+}
+
+void UOnnxModelRegistry::Deinitialize()
+{
+    FTSTicker::GetCoreTicker().RemoveTicker(tickerHandle_);
+    tickerHandle_.Reset();
+
+    TArray<FOnnxModelHandle> released;
+    {
+        FScopeLock Lock(&mutex_);
+        for (TPair<FString, FEntry>& pair : entries_)
+        {
+            const int32 numHandles = pair.Value.Instance.GetSharedReferenceCount() - 1;
+            if (numHandles > 0)
+            {
+                // 持有者的句柄继续有效，实例在最后一个句柄释放时销毁
+                UE_LOG(LogTemp, Warning, TEXT("Model registry shutting down while %s still has %d handle(s)"), *pair.Value.DisplayName, numHandles);
+            }
+            released.Add(MoveTemp(pair.Value.Instance));
+        }
+        entries_.Empty();
+    }
+    released.Empty();
+
+    Super::Deinitialize();
+}
+
+FString UOnnxModelRegistry::GetModelDataHash(UOnnxModelAsset* Asset)
+{
+    const uint8* data = Asset->modelData_.GetData();
+    const int32 num = Asset->modelData_.Num();
+    {
+        FScopeLock Lock(&mutex_);
+        const FModelDataHash* cached = modelDataHashes_.Find(Asset);
+        if (cached && cached->Data == data && cached->Num == num)
+        {
+            return cached->Hash;
+        }
+    }
+
+    // 在锁外哈希，大模型不阻塞Tick和其他模型的获取
+    const FString hash = FOnnxPrepackedWeightsRegistry::ComputeModelHash(Asset->modelData_);
+
+    FScopeLock Lock(&mutex_);
+    FModelDataHash& entry = modelDataHashes_.FindOrAdd(Asset);
+    entry.Data = data;
+    entry.Num = num;
+    entry.Hash = hash;
+    return hash;
+}
+
+FString UOnnxModelRegistry::MakeKey(UOnnxModelAsset* Asset, const FString& ModelPath)
+{
+    // 文件的哈希按大小和修改时间缓存，文件被替换后得到新的键
+    const FString fullPath = ModelPath.IsEmpty() ? FString() : FPaths::ConvertRelativePathToFull(ModelPath);
+    const FString fileHash = fullPath.IsEmpty() ? FString() : FOnnxPrepackedWeightsRegistry::ComputeModelHash(fullPath);
+    if (!Asset)
+    {
+        return FString::Printf(TEXT("file:%s|%s"), *fullPath, *fileHash);
+    }
+
+    // 资产身份、模型字节的内容哈希（重新导入同样大小的模型也会得到新的键）加上所有影响实例的配置
+    FString key = FString::Printf(TEXT("asset:%s|%s|%s|%s"), *Asset->GetPathName(), *GetModelDataHash(Asset), *fullPath, *fileHash);
+    AppendStructText(key, Asset->sessionSettings_);
+    AppendStructText(key, Asset->shapeBucketing_);
+    AppendStructText(key, Asset->variantSelection_);
+    AppendStructText(key, Asset->workerSettings_);
+    AppendStructText(key, Asset->pipelineSettings_);
+    for (const FOnnxModelVariant& variant : Asset->variants_)
+    {
+        AppendStructText(key, variant);
+    }
+    key += FString::Printf(TEXT("|%s|%d"), *FString::Join(Asset->extraOutputs_, TEXT(",")), Asset->bExtraOutputsOnly_ ? 1 : 0);
+    return key;
+}
+
+FOnnxModelHandle UOnnxModelRegistry::Acquire(UOnnxModelAsset* Asset, const FString& ModelPath)
+{
+    const FString key = MakeKey(Asset, ModelPath);
+
+    TPromise<FOnnxModelHandle> promise;
+    {
+        FScopeLock Lock(&mutex_);
+        if (FEntry* existing = entries_.Find(key))
+        {
+            ++hits_;
+            existing->IdleSince = 0.0;
+            return existing->Instance;
+        }
+
+        // 同一模型正在由其他线程创建：在锁外等待它完成后共享
+        if (const FPendingEntry* pending = pending_.Find(key))
+        {
+            ++hits_;
+            const TSharedFuture<FOnnxModelHandle> future = pending->Future;
+            Lock.Unlock();
+            return future.Get();
+        }
+
+        ++misses_;
+        FPendingEntry& pending = pending_.Add(key);
+        pending.Future = promise.GetFuture().Share();
+        pending.Asset = Asset;
+        pending.ModelPath = ModelPath;
+    }
+
+    // 创建（加载模型、创建会话）不持有锁：Tick、统计和其他模型的获取不会被阻塞
+    FOnnxModelHandle instance = MakeShared<FOnnxModelInstance, ESPMode::ThreadSafe>(Asset, ModelPath);
+    if (!instance->IsInitialized())
+    {
+        instance.Reset();
+    }
+
+    {
+        FScopeLock Lock(&mutex_);
+        FPendingEntry pending;
+        pending_.RemoveAndCopyValue(key, pending);
+        if (instance && !pending.bInvalidated)
+        {
+            FEntry& entry = entries_.Add(key);
+            entry.Instance = instance;
+            entry.DisplayName = Asset ? Asset->GetName() : FPaths::GetBaseFilename(ModelPath);
+            entry.Asset = Asset;
+            entry.ModelPath = ModelPath;
+
+            UE_LOG(LogTemp, Log, TEXT("Model registry: created shared instance of %s (%d models)"), *entry.DisplayName, entries_.Num());
+        }
+    }
+
+    // 等待者拿到同一个实例（创建失败时为nullptr）
+    promise.SetValue(instance);
+    return instance;
+}
+
+void UOnnxModelRegistry::Invalidate(UOnnxModelAsset* Asset, const FString& ModelPath)
+{
+    const FString fullPath = ModelPath.IsEmpty() ? FString() : FPaths::ConvertRelativePathToFull(ModelPath);
+
+    TArray<FOnnxModelHandle> released;
+    {
+        FScopeLock Lock(&mutex_);
+        const auto matches = [Asset, &fullPath](const TWeakObjectPtr<UOnnxModelAsset>& EntryAsset, const FString& EntryPath)
+        {
+            return Asset
+                ? EntryAsset.Get() == Asset
+                : !EntryAsset.IsValid() && FPaths::ConvertRelativePathToFull(EntryPath) == fullPath;
+        };
+
+        for (auto it = entries_.CreateIterator(); it; ++it)
+        {
+            const FEntry& entry = it.Value();
+            if (matches(entry.Asset, entry.ModelPath))
+            {
+                UE_LOG(LogTemp, Log, TEXT("Model registry: invalidated %s"), *entry.DisplayName);
+                released.Add(MoveTemp(it.Value().Instance));
+                it.RemoveCurrent();
+            }
+        }
+
+        // 正在按旧的模型和配置创建的实例不再共享
+        for (TPair<FString, FPendingEntry>& pair : pending_)
+        {
+            if (matches(pair.Value.Asset, pair.Value.ModelPath))
+            {
+                pair.Value.bInvalidated = true;
+            }
+        }
+
+        if (Asset)
+        {
+            modelDataHashes_.Remove(Asset);
+        }
+    }
+
+    // 没有其他句柄时实例在这里析构（锁外，会话析构可能需要等待后台重建）
+    released.Empty();
+}
+
+void UOnnxModelRegistry::TrimIdle()
+{
+    TArray<FOnnxModelHandle> expired;
+    CollectExpired(FPlatformTime::Seconds(), 0.0f, expired);
+}
+
+bool UOnnxModelRegistry::Tick(float /*DeltaTime*/)
+{
+    TArray<FOnnxModelHandle> expired;
+    CollectExpired(FPlatformTime::Seconds(), FMath::Max(0.0f, FOnnxTuning::GetRegistryGraceSeconds(graceSeconds_)), expired);
+    return true;
+}
+
+void UOnnxModelRegistry::CollectExpired(double Now, float GraceSeconds, TArray<FOnnxModelHandle>& OutExpired)
+{
+    FScopeLock Lock(&mutex_);
+
+    // 已销毁资产的哈希缓存
+    for (auto it = modelDataHashes_.CreateIterator(); it; ++it)
+    {
+        if (!it.Key().IsValid())
+        {
+            it.RemoveCurrent();
+        }
+    }
+
+    for (auto it = entries_.CreateIterator(); it; ++it)
+    {
+        FEntry& entry = it.Value();
+
+        // 句柄只能通过Acquire（持有同一把锁）或复制已有句柄获得，引用计数为1时确实没有持有者
+        if (entry.Instance.GetSharedReferenceCount() > 1)
+        {
+            entry.IdleSince = 0.0;
+            continue;
+        }
+
+        if (entry.IdleSince == 0.0)
+        {
+            entry.IdleSince = Now;
+        }
+
+        if (Now - entry.IdleSince >= GraceSeconds)
+        {
+            UE_LOG(LogTemp, Log, TEXT("Model registry: released %s after %.1f s without handles"), *entry.DisplayName, Now - entry.IdleSince);
+            OutExpired.Add(MoveTemp(entry.Instance));
+            it.RemoveCurrent();
+            ++expired_;
+        }
+    }
+}
+
+FOnnxModelRegistryStats UOnnxModelRegistry::GetStats() const
+{
+    FScopeLock Lock(&mutex_);
+
+    FOnnxModelRegistryStats stats;
+    stats.NumModels = entries_.Num();
+    for (const TPair<FString, FEntry>& pair : entries_)
+    {
+        const int32 numHandles = pair.Value.Instance.GetSharedReferenceCount() - 1;
+        stats.NumHandles += numHandles;
+        stats.NumIdle += numHandles == 0 ? 1 : 0;
+    }
+    stats.Hits = hits_;
+    stats.Misses = misses_;
+    stats.Expired = expired_;
+    return stats;
+}
+
+void UOnnxModelRegistry::Dump(FOutputDevice& Ar) const
+{
+    const double now = FPlatformTime::Seconds();
+    const FOnnxModelRegistryStats stats = GetStats();
+
+    FScopeLock Lock(&mutex_);
+    Ar.Logf(TEXT("=== ONNX model registry: %d models, %d handles, %lld hits, %lld misses, %d expired (grace %.1f s) ==="),
+            stats.NumModels, stats.NumHandles, stats.Hits, stats.Misses, stats.Expired,
+            FOnnxTuning::GetRegistryGraceSeconds(graceSeconds_));
+
+    for (const TPair<FString, FEntry>& pair : entries_)
+    {
+        const FEntry& entry = pair.Value;
+        const int32 numHandles = entry.Instance.GetSharedReferenceCount() - 1;
+        if (numHandles > 0)
+        {
+            Ar.Logf(TEXT("%s: %d handle(s), %s"), *entry.DisplayName, numHandles, *entry.Instance->GetSessionSettings().ToString());
+        }
+        else
+        {
+            Ar.Logf(TEXT("%s: idle for %.1f s, %s"), *entry.DisplayName, entry.IdleSince > 0.0 ? now - entry.IdleSince : 0.0,
+                    *entry.Instance->GetSessionSettings().ToString());
+        }
+    }
+}
@@ -0,0 +1,410 @@
+// OnnxModelVariants.cpp
+
+#include "OnnxModelVariants.h"
+#include "OnnxModelAsset.h"
+#include "OnnxModelInstance.h"
+#include "OnnxAutotuner.h"
+#include "OnnxPrepackedWeights.h"
+#include "OnnxShadow.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+namespace
+{
+    // 解析.npy文件：只支持小端float32、C顺序
+    bool ParseNpy(const TArray<uint8>& FileData, TArray<float>& OutData, TArray<int64>& OutShape, FString& OutError)
+    {
+        static const uint8 Magic[] = { 0x93, 'N', 'U', 'M', 'P', 'Y' };
+        if (FileData.Num() < 10 || FMemory::Memcmp(FileData.GetData(), Magic, sizeof(Magic)) != 0)
+        {
+            OutError = TEXT("not an .npy file");
+            return false;
+        }
+
+        // 1.0版本头长度为2字节，2.0/3.0为4字节
+        const uint8 MajorVersion = FileData[6];
+        const int32 LengthBytes = MajorVersion >= 2 ? 4 : 2;
+        if (FileData.Num() < 8 + LengthBytes)
+        {
+            OutError = TEXT("truncated header");
+            return false;
+        }
+
+        uint32 HeaderLength = 0;
+        FMemory::Memcpy(&HeaderLength, FileData.GetData() + 8, LengthBytes);
+        const int64 DataOffset = 8 + LengthBytes + int64(HeaderLength);
+        if (DataOffset > FileData.Num())
+        {
+            OutError = TEXT("truncated header");
+            return false;
+        }
+
+        const FString Header(FUTF8ToTCHAR(reinterpret_cast<const ANSICHAR*>(FileData.GetData() + 8 + LengthBytes), HeaderLength).Get());
+        if (!Header.Contains(TEXT("'<f4'")) || Header.Contains(TEXT("'fortran_order': True")))
+        {
+            OutError = FString::Printf(TEXT("only little-endian float32 in C order is supported (%s)"), *Header.TrimStartAndEnd());
+            return false;
+        }
+
+        // 'shape': (1, 3, 224, 224),
+        const int32 ShapeStart = Header.Find(TEXT("'shape'"));
+        const int32 OpenParen = ShapeStart == INDEX_NONE ? INDEX_NONE : Header.Find(TEXT("("), ESearchCase::CaseSensitive, ESearchDir::FromStart, ShapeStart);
+        const int32 CloseParen = OpenParen == INDEX_NONE ? INDEX_NONE : Header.Find(TEXT(")"), ESearchCase::CaseSensitive, ESearchDir::FromStart, OpenParen);
+        if (CloseParen == INDEX_NONE)
+        {
+            OutError = TEXT("header has no shape");
+            return false;
+        }
+
+        TArray<FString> Dims;
+        Header.Mid(OpenParen + 1, CloseParen - OpenParen - 1).ParseIntoArray(Dims, TEXT(","));
+        OutShape.Reset();
+        int64 NumElements = 1;
+        for (const FString& Dim : Dims)
+        {
+            const int64 Value = FCString::Atoi64(*Dim.TrimStartAndEnd());
+            OutShape.Add(Value);
+            NumElements *= Value;
+        }
+
+        if (NumElements * int64(sizeof(float)) != FileData.Num() - DataOffset)
+        {
+            OutError = TEXT("data size does not match the shape");
+            return false;
+        }
+
+        OutData.SetNumUninitialized(NumElements);
+        FMemory::Memcpy(OutData.GetData(), FileData.GetData() + DataOffset, NumElements * sizeof(float));
+        return true;
+    }
+}
+
+FString FOnnxVariantReport::ToString() const
+{
+    if (!bSucceeded)
+    {
+        return FString::Printf(TEXT("%-32s FAILED (%s)"), FOnnxModelVariants::GetDisplayName(Precision), *ModelPath);
+    }
+
+    FString Result = FString::Printf(TEXT("%-32s %8.2fms  x%.2f  relL2 mean=%.4f max=%.4f  maxAbs=%.4f"),
+                                     FOnnxModelVariants::GetDisplayName(Precision), MeanLatencyMs, Speedup,
+                                     MeanRelativeL2, MaxRelativeL2, MaxAbsError);
+    if (MeanMaskIoU >= 0.0f)
+    {
+        Result += FString::Printf(TEXT("  maskIoU mean=%.4f min=%.4f"), MeanMaskIoU, MinMaskIoU);
+    }
+    Result += bPassed ? TEXT("  PASS") : TEXT("  FAIL");
+    return Result;
+}
+
+bool FOnnxVariantErrorStats::AddOutput(const TArray<float>& Output, const TArray<float>& Reference)
+{
+    const float RelativeL2 = FOnnxShadowRunner::ComputeRelativeL2(Output, Reference);
+    if (RelativeL2 < 0.0f)
+    {
+        return false;
+    }
+
+    SumRelativeL2 += RelativeL2;
+    MaxRelativeL2 = FMath::Max(MaxRelativeL2, RelativeL2);
+    for (int32 i = 0; i < Output.Num(); ++i)
+    {
+        MaxAbsError = FMath::Max(MaxAbsError, FMath::Abs(Output[i] - Reference[i]));
+    }
+    return true;
+}
+
+void FOnnxVariantErrorStats::AddMask(const TArray<float>& Mask, const TArray<float>& Reference, float Threshold)
+{
+    const float IoU = FOnnxShadowRunner::ComputeMaskIoU(Mask, Reference, Threshold);
+    ++NumMasks;
+    SumMaskIoU += IoU;
+    MinMaskIoU = FMath::Min(MinMaskIoU, IoU);
+}
+
+void FOnnxVariantErrorStats::FillReport(FOnnxVariantReport& Report) const
+{
+    Report.NumSamples = NumSamples;
+    if (NumSamples > 0)
+    {
+        Report.MeanLatencyMs = static_cast<float>(SumSeconds * 1000.0 / NumSamples);
+        Report.MeanRelativeL2 = static_cast<float>(SumRelativeL2 / NumSamples);
+        Report.MaxRelativeL2 = MaxRelativeL2;
+        Report.MaxAbsError = MaxAbsError;
+    }
+    if (NumMasks > 0)
+    {
+        Report.MeanMaskIoU = static_cast<float>(SumMaskIoU / NumMasks);
+        Report.MinMaskIoU = MinMaskIoU;
+    }
+}
+
+const TCHAR* FOnnxModelVariants::GetDisplayName(EOnnxModelPrecision Precision)
+{
+    switch (Precision)
+    {
+    case EOnnxModelPrecision::QDQInt8:      return TEXT("QDQ int8");
+    case EOnnxModelPrecision::Int4Weights:  return TEXT("4-bit weight-only");
+    case EOnnxModelPrecision::FP32:
+    default:                                return TEXT("FP32");
+    }
+}
+
+FString FOnnxModelVariants::GetFullPath(const FString& Path)
+{
+    return FPaths::IsRelative(Path) ? FPaths::Combine(FPaths::ProjectDir(), Path) : Path;
+}
+
+const FOnnxModelVariant* FOnnxModelVariants::FindVariant(const UOnnxModelAsset& Asset, EOnnxModelPrecision Precision)
+{
+    if (Precision == EOnnxModelPrecision::FP32)
+    {
+        return nullptr;
+    }
+
+    for (const FOnnxModelVariant& Variant : Asset.variants_)
+    {
+        if (Variant.Precision == Precision && !Variant.ModelPath.IsEmpty() && FPaths::FileExists(GetFullPath(Variant.ModelPath)))
+        {
+            return &Variant;
+        }
+    }
+    return nullptr;
+}
+
+EOnnxModelPrecision FOnnxModelVariants::ResolvePrecision(const FOnnxVariantSelection& Selection, const TArray<EOnnxModelPrecision>& Available, const FString& Key)
+{
+    switch (Selection.Policy)
+    {
+    case EOnnxVariantPolicy::Preferred:
+        for (EOnnxModelPrecision Precision : Selection.PreferredPrecisions)
+        {
+            if (Precision == EOnnxModelPrecision::FP32 || Available.Contains(Precision))
+            {
+                return Precision;
+            }
+        }
+        break;
+
+    case EOnnxVariantPolicy::Validated:
+    {
+        // 变体文件被删除后回退到基准模型
+        EOnnxModelPrecision Saved = EOnnxModelPrecision::FP32;
+        if (FOnnxAutotuner::FindSelectedVariant(Key, Saved) && Available.Contains(Saved))
+        {
+            return Saved;
+        }
+        break;
+    }
+
+    case EOnnxVariantPolicy::Reference:
+    default:
+        break;
+    }
+    return EOnnxModelPrecision::FP32;
+}
+
+EOnnxModelPrecision FOnnxModelVariants::ResolvePrecision(const UOnnxModelAsset& Asset)
+{
+    if (Asset.variants_.Num() == 0 || Asset.variantSelection_.Policy == EOnnxVariantPolicy::Reference)
+    {
+        return EOnnxModelPrecision::FP32;
+    }
+
+    TArray<EOnnxModelPrecision> Available;
+    for (const FOnnxModelVariant& Variant : Asset.variants_)
+    {
+        if (FindVariant(Asset, Variant.Precision))
+        {
+            Available.AddUnique(Variant.Precision);
+        }
+    }
+
+    // 只有Validated策略需要键（计算基准模型的哈希）
+    const FString Key = Asset.variantSelection_.Policy == EOnnxVariantPolicy::Validated ? MakeSelectionKey(Asset) : FString();
+    return ResolvePrecision(Asset.variantSelection_, Available, Key);
+}
+
+FString FOnnxModelVariants::MakeSelectionKey(const UOnnxModelAsset& Asset)
+{
+    return FOnnxAutotuner::MakeModelKey(Asset.GetName() + TEXT("_Variant"), FOnnxPrepackedWeightsRegistry::ComputeModelHash(Asset.modelData_));
+}
+
+bool FOnnxModelVariants::LoadSamples(const FString& Folder, TArray<FOnnxSampleInput>& OutSamples)
+{
+    const FString FullFolder = GetFullPath(Folder);
+
+    TArray<FString> Files;
+    IFileManager::Get().FindFiles(Files, *FPaths::Combine(FullFolder, TEXT("*.npy")), true, false);
+    IFileManager::Get().FindFiles(Files, *FPaths::Combine(FullFolder, TEXT("*.bin")), true, false);
+    Files.Sort();
+
+    for (const FString& File : Files)
+    {
+        TArray<uint8> FileData;
+        if (!FFileHelper::LoadFileToArray(FileData, *FPaths::Combine(FullFolder, File)))
+        {
+            UE_LOG(LogTemp, Warning, TEXT("Failed to read sample %s"), *File);
+            continue;
+        }
+
+        FOnnxSampleInput Sample;
+        Sample.Name = File;
+        if (File.EndsWith(TEXT(".npy")))
+        {
+            FString Error;
+            if (!ParseNpy(FileData, Sample.Data, Sample.Shape, Error))
+            {
+                UE_LOG(LogTemp, Warning, TEXT("Skipping sample %s: %s"), *File, *Error);
+                continue;
+            }
+        }
+        else
+        {
+            Sample.Data.SetNumUninitialized(FileData.Num() / sizeof(float));
+            FMemory::Memcpy(Sample.Data.GetData(), FileData.GetData(), Sample.Data.Num() * sizeof(float));
+        }
+        OutSamples.Add(MoveTemp(Sample));
+    }
+
+    if (OutSamples.Num() == 0)
+    {
+        UE_LOG(LogTemp, Error, TEXT("No .npy or .bin samples found in %s"), *FullFolder);
+        return false;
+    }
+    return true;
+}
+
+TArray<FOnnxVariantReport> FOnnxModelVariants::Compare(UOnnxModelAsset* Asset, const FString& SampleFolder, int32 Iterations, bool bSaveSelection)
+{
+    TArray<FOnnxVariantReport> Reports;
+    if (!Asset)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Variant comparison requires a model asset"));
+        return Reports;
+    }
+
+    TArray<FOnnxSampleInput> Samples;
+    if (!LoadSamples(SampleFolder, Samples))
+    {
+        return Reports;
+    }
+
+    // 基准模型在前，其次是每个存在的变体
+    TArray<EOnnxModelPrecision> Precisions = { EOnnxModelPrecision::FP32 };
+    for (const FOnnxModelVariant& Variant : Asset->variants_)
+    {
+        if (FindVariant(*Asset, Variant.Precision))
+        {
+            Precisions.AddUnique(Variant.Precision);
+        }
+    }
+
+    Iterations = FMath::Max(1, Iterations);
+    TArray<TArray<float>> ReferenceOutputs;
+
+    for (EOnnxModelPrecision Precision : Precisions)
+    {
+        FOnnxVariantReport& Report = Reports.AddDefaulted_GetRef();
+        Report.Precision = Precision;
+        const FOnnxModelVariant* Variant = FindVariant(*Asset, Precision);
+        Report.ModelPath = Variant ? Variant->ModelPath : Asset->GetName();
+
+        // 每个变体按自己的会话配置（包括本机调优结果）加载，同一时刻只保留一个实例
+        FOnnxModelInstance Instance(Asset, FString(), Precision);
+        if (!Instance.IsInitialized())
+        {
+            UE_LOG(LogTemp, Error, TEXT("Failed to load %s variant"), GetDisplayName(Precision));
+            continue;
+        }
+
+        FOnnxVariantErrorStats Stats;
+        bool bSucceeded = true;
+        for (int32 SampleIndex = 0; SampleIndex < Samples.Num() && bSucceeded; ++SampleIndex)
+        {
+            const FOnnxSampleInput& Sample = Samples[SampleIndex];
+            const TArray<int64> Shape = Sample.Shape.Num() > 0 ? Sample.Shape : Instance.InferInputShape(Sample.Data.Num());
+
+            // 第一次运行同时作为预热并获取输出
+            TArray<float> Output;
+            if (!Instance.Run(Sample.Data, Shape, Output))
+            {
+                UE_LOG(LogTemp, Error, TEXT("%s variant failed on sample %s"), GetDisplayName(Precision), *Sample.Name);
+                bSucceeded = false;
+                break;
+            }
+
+            const double StartTime = FPlatformTime::Seconds();
+            for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+            {
+                TArray<float> Discarded;
+                Instance.Run(Sample.Data, Shape, Discarded);
+            }
+            Stats.SumSeconds += (FPlatformTime::Seconds() - StartTime) / Iterations;
+            ++Stats.NumSamples;
+
+            if (Precision == EOnnxModelPrecision::FP32)
+            {
+                ReferenceOutputs.Add(MoveTemp(Output));
+            }
+            else if (!ReferenceOutputs.IsValidIndex(SampleIndex) || !Stats.AddOutput(Output, ReferenceOutputs[SampleIndex]))
+            {
+                UE_LOG(LogTemp, Error, TEXT("%s variant output does not match the reference on sample %s"), GetDisplayName(Precision), *Sample.Name);
+                bSucceeded = false;
+            }
+        }
+
+        Report.bSucceeded = bSucceeded;
+        Stats.FillReport(Report);
+    }
+
+    FinalizeReports(Reports, Asset->variantSelection_, MakeSelectionKey(*Asset), bSaveSelection);
+    LogReports(Reports);
+    return Reports;
+}
+
+void FOnnxModelVariants::FinalizeReports(TArray<FOnnxVariantReport>& Reports, const FOnnxVariantSelection& Selection, const FString& Key, bool bSaveSelection)
+{
+    if (Reports.Num() == 0 || !Reports[0].bSucceeded)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Variant comparison: reference model failed, no variant can be validated"));
+        return;
+    }
+
+    const float ReferenceMs = Reports[0].MeanLatencyMs;
+    Reports[0].bPassed = true;
+
+    const FOnnxVariantReport* Fastest = &Reports[0];
+    for (FOnnxVariantReport& Report : Reports)
+    {
+        if (&Report == &Reports[0] || !Report.bSucceeded)
+        {
+            continue;
+        }
+
+        Report.Speedup = Report.MeanLatencyMs > 0.0f ? ReferenceMs / Report.MeanLatencyMs : 0.0f;
+        Report.bPassed = Report.MaxRelativeL2 <= Selection.MaxRelativeL2
+            && (Report.MinMaskIoU < 0.0f || Report.MinMaskIoU >= Selection.MinMaskIoU);
+
+        if (Report.bPassed && Report.MeanLatencyMs < Fastest->MeanLatencyMs)
+        {
+            Fastest = &Report;
+        }
+    }
+
+    if (bSaveSelection && FOnnxAutotuner::SaveSelectedVariant(Key, *Fastest))
+    {
+        UE_LOG(LogTemp, Log, TEXT("Variant comparison: selected %s (x%.2f) for [%s]"), GetDisplayName(Fastest->Precision), Fastest->Speedup, *Key);
+    }
+}
+
+void FOnnxModelVariants::LogReports(const TArray<FOnnxVariantReport>& Reports)
+{
+    UE_LOG(LogTemp, Log, TEXT("=== ONNX variant comparison (%d variants) ==="), Reports.Num());
+    for (const FOnnxVariantReport& Report : Reports)
+    {
+        UE_LOG(LogTemp, Log, TEXT("%s"), *Report.ToString());
+    }
+}
@@ -0,0 +1,369 @@
+// OnnxNuma.cpp
+
+#include "OnnxNuma.h"
+#include "HAL/PlatformMisc.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+
+#if PLATFORM_LINUX
+#include <sched.h>
+#endif
+
+namespace
+{
+    // 解析"0-3,8,10-11"格式的CPU列表
+    TArray<int32> ParseCpuList(const FString& CpuList)
+    {
+        TArray<int32> Cpus;
+        TArray<FString> Ranges;
+        CpuList.TrimStartAndEnd().ParseIntoArray(Ranges, TEXT(","));
+
+        for (const FString& Range : Ranges)
+        {
+            FString Left, Right;
+            if (Range.Split(TEXT("-"), &Left, &Right))
+            {
+                const int32 First = FCString::Atoi(*Left);
+                const int32 Last = FCString::Atoi(*Right);
+                for (int32 Cpu = First; Cpu <= Last; ++Cpu)
+                {
+                    Cpus.Add(Cpu);
+                }
+            }
+            else if (!Range.IsEmpty())
+            {
+                Cpus.Add(FCString::Atoi(*Range));
+            }
+        }
+        return Cpus;
+    }
+
+    /**
+     * 在指定亲和性的线程上执行一个函数并等待完成
+     */
+    class FPinnedTask : public FRunnable
+    {
+    public:
+        explicit FPinnedTask(TFunction<void()> InTask) : Task(MoveTemp(InTask)) {}
+
+        virtual uint32 Run() override
+        {
+            Task();
+            return 0;
+        }
+
+        static void RunOn(const FString& ThreadName, uint64 AffinityMask, TFunction<void()> InTask)
+        {
+            FPinnedTask Runnable(MoveTemp(InTask));
+            FRunnableThread* Thread = FRunnableThread::Create(&Runnable, *ThreadName, 0, TPri_Normal,
+                                                              AffinityMask != 0 ? AffinityMask : FPlatformAffinity::GetNoAffinityMask());
+            if (Thread)
+            {
+                Thread->WaitForCompletion();
+                delete Thread;
+            }
+            else
+            {
+                // 无法创建线程时退化为在当前线程执行（失去节点绑定，但功能不受影响）
+                Runnable.Run();
+            }
+        }
+
+    private:
+        TFunction<void()> Task;
+    };
+}
+
+uint64 FOnnxNumaNode::GetAffinityMask() const
+{
+    uint64 Mask = 0;
+    for (int32 Cpu : Cpus)
+    {
+        if (Cpu >= 0 && Cpu < 64)
+        {
+            Mask |= (uint64(1) << Cpu);
+        }
+    }
+    return Mask;
+}
+
+FString FOnnxNumaNode::MakeIntraOpThreadAffinities(int32 NumThreads) const
+{
+    if (NumThreads <= 1 || Cpus.Num() == 0)
+    {
+        return FString();
+    }
+
+    // ORT的处理器编号从1开始
+    TArray<FString> CpuStrings;
+    for (int32 Cpu : Cpus)
+    {
+        CpuStrings.Add(FString::FromInt(Cpu + 1));
+    }
+    const FString NodeCpus = FString::Join(CpuStrings, TEXT(","));
+
+    TArray<FString> PerThread;
+    for (int32 i = 0; i < NumThreads - 1; ++i)
+    {
+        PerThread.Add(NodeCpus);
+    }
+    return FString::Join(PerThread, TEXT(";"));
+}
+
+const FOnnxNumaTopology& FOnnxNumaTopology::Get()
+{
+    static FOnnxNumaTopology Topology;
+    return Topology;
+}
+
+FOnnxNumaTopology::FOnnxNumaTopology()
+{
+#if PLATFORM_LINUX
+    FString OnlineNodes;
+    if (FFileHelper::LoadFileToString(OnlineNodes, TEXT("/sys/devices/system/node/online")))
+    {
+        for (int32 NodeId : ParseCpuList(OnlineNodes))
+        {
+            FString CpuList;
+            const FString CpuListPath = FString::Printf(TEXT("/sys/devices/system/node/node%d/cpulist"), NodeId);
+            if (!FFileHelper::LoadFileToString(CpuList, *CpuListPath))
+            {
+                continue;
+            }
+
+            FOnnxNumaNode Node;
+            Node.NodeId = NodeId;
+            Node.Cpus = ParseCpuList(CpuList);
+            if (Node.Cpus.Num() > 0)
+            {
+                nodes_.Add(MoveTemp(Node));
+            }
+        }
+    }
+#endif
+
+    // 非Linux平台或探测失败时视为单节点
+    if (nodes_.Num() == 0)
+    {
+        FOnnxNumaNode Node;
+        Node.NodeId = 0;
+        for (int32 Cpu = 0; Cpu < FPlatformMisc::NumberOfCoresIncludingHyperthreads(); ++Cpu)
+        {
+            Node.Cpus.Add(Cpu);
+        }
+        nodes_.Add(MoveTemp(Node));
+    }
+
+    for (int32 NodeIndex = 0; NodeIndex < nodes_.Num(); ++NodeIndex)
+    {
+        for (int32 Cpu : nodes_[NodeIndex].Cpus)
+        {
+            cpuToNodeIndex_.Add(Cpu, NodeIndex);
+        }
+        UE_LOG(LogTemp, Log, TEXT("NUMA node %d: %d CPUs"), nodes_[NodeIndex].NodeId, nodes_[NodeIndex].Cpus.Num());
+    }
+}
+
+int32 FOnnxNumaTopology::GetCurrentNodeIndex() const
+{
+#if PLATFORM_LINUX
+    const int32 Cpu = sched_getcpu();
+    if (const int32* NodeIndex = cpuToNodeIndex_.Find(Cpu))
+    {
+        return *NodeIndex;
+    }
+#endif
+    return 0;
+}
+
+FOnnxNumaSessionPool::FLease::FLease(FOnnxNumaSessionPool* InPool, FReplica* InReplica, int32 InCallerNode)
+    : pool_(InPool)
+    , replica_(InReplica)
+    , callerNode_(InCallerNode)
+    , startTime_(FPlatformTime::Seconds())
+{
+}
+
+FOnnxNumaSessionPool::FLease::FLease(FLease&& Other)
+    : pool_(Other.pool_)
+    , replica_(Other.replica_)
+    , callerNode_(Other.callerNode_)
+    , startTime_(Other.startTime_)
+{
+    Other.pool_ = nullptr;
+    Other.replica_ = nullptr;
+}
+
+FOnnxNumaSessionPool::FLease::~FLease()
+{
+    if (pool_ && replica_)
+    {
+        pool_->Release(replica_, callerNode_, FPlatformTime::Seconds() - startTime_);
+    }
+}
+
+FOnnxNumaSessionPool::~FOnnxNumaSessionPool()
+{
+    if (IsInitialized())
+    {
+        LogNodeStats();
+    }
+}
+
+bool FOnnxNumaSessionPool::Initialize(const FOnnxSessionFactory& Factory, const FOnnxSessionSettings& BaseSettings,
+                                      int32 ReplicasPerNode, const FOnnxBenchmarkParams& WarmupParams, const FString& PoolName)
+{
+    poolName_ = PoolName;
+    replicas_.Empty();
+    replicasByNode_.Empty();
+    nextReplica_.Empty();
+    nodeStats_.Empty();
+
+    const FOnnxNumaTopology& Topology = FOnnxNumaTopology::Get();
+    ReplicasPerNode = FMath::Max(1, ReplicasPerNode);
+
+    for (int32 NodeIndex = 0; NodeIndex < Topology.GetNumNodes(); ++NodeIndex)
+    {
+        const FOnnxNumaNode& Node = Topology.GetNodes()[NodeIndex];
+
+        // 未指定线程数时把节点的CPU平均分给各个副本
+        FOnnxSessionSettings NodeSettings = BaseSettings;
+        NodeSettings.ReplicasPerNumaNode = 0;
+        if (NodeSettings.IntraOpThreads <= 1)
+        {
+            NodeSettings.IntraOpThreads = FMath::Max(1, Node.Cpus.Num() / ReplicasPerNode);
+        }
+        NodeSettings.IntraOpThreadAffinities = Node.MakeIntraOpThreadAffinities(NodeSettings.IntraOpThreads);
+
+        // 编号>=64的CPU无法用线程亲和性掩码表示：初始化线程只能绑定到较低的CPU（全部较高时不绑定），
+        // 工作线程的亲和性此时由ORT自己应用（见FOnnxRuntime::ConfigureSessionOptions）
+        const uint64 NodeMask = Node.GetAffinityMask();
+        if (Node.Cpus.ContainsByPredicate([](int32 Cpu) { return Cpu >= 64; }))
+        {
+            UE_LOG(LogTemp, Warning, TEXT("%s: NUMA node %d has CPUs above 63; %s"), *PoolName, Node.NodeId,
+                   NodeMask != 0 ? TEXT("replica initialization is pinned to its lower CPUs only") : TEXT("replica initialization is not pinned to the node"));
+        }
+
+        replicasByNode_.AddDefaulted();
+        nextReplica_.Add(MakeUnique<std::atomic<uint32>>(0));
+
+        FOnnxNumaNodeStats& Stats = nodeStats_.AddDefaulted_GetRef();
+        Stats.NodeId = Node.NodeId;
+
+        for (int32 ReplicaIndex = 0; ReplicaIndex < ReplicasPerNode; ++ReplicaIndex)
+        {
+            TUniquePtr<FReplica> Replica = MakeUnique<FReplica>();
+            Replica->NodeIndex = NodeIndex;
+
+            // 在绑定到该节点的线程上创建并预热会话，使权重和内存池在本节点内存上首次触碰
+            FReplica* ReplicaPtr = Replica.Get();
+            FPinnedTask::RunOn(FString::Printf(TEXT("ONNX NUMA Init %d"), Node.NodeId), NodeMask,
+                [&Factory, &NodeSettings, &WarmupParams, ReplicaPtr, &PoolName]()
+                {
+                    ReplicaPtr->Session = Factory(NodeSettings);
+                    if (ReplicaPtr->Session)
+                    {
+                        FOnnxBenchmarkParams Warmup = WarmupParams;
+                        Warmup.WarmupIterations = 1;
+                        Warmup.Iterations = 1;
+                        Warmup.IdleGapSeconds = 0.0;
+                        FOnnxBenchmark::RunSession(*ReplicaPtr->Session, Warmup, PoolName + TEXT(" warmup"));
+                    }
+                });
+
+            if (!Replica->Session)
+            {
+                UE_LOG(LogTemp, Error, TEXT("%s: failed to create replica on NUMA node %d"), *PoolName, Node.NodeId);
+                replicas_.Empty();
+                return false;
+            }
+
+            replicasByNode_[NodeIndex].Add(replicas_.Num());
+            replicas_.Add(MoveTemp(Replica));
+            ++Stats.NumReplicas;
+        }
+
+        UE_LOG(LogTemp, Log, TEXT("%s: %d replicas on NUMA node %d (%s)"), *PoolName, ReplicasPerNode, Node.NodeId, *NodeSettings.ToString());
+    }
+
+    creationTime_ = FPlatformTime::Seconds();
+    return true;
+}
+
+FOnnxNumaSessionPool::FLease FOnnxNumaSessionPool::Acquire()
+{
+    if (!IsInitialized())
+    {
+        return FLease();
+    }
+
+    const int32 NumNodes = replicasByNode_.Num();
+    const int32 CallerNode = FMath::Clamp(FOnnxNumaTopology::Get().GetCurrentNodeIndex(), 0, NumNodes - 1);
+
+    // 依次尝试本节点、再其他节点的空闲副本
+    for (int32 NodeOffset = 0; NodeOffset < NumNodes; ++NodeOffset)
+    {
+        const int32 NodeIndex = (CallerNode + NodeOffset) % NumNodes;
+        const TArray<int32>& NodeReplicas = replicasByNode_[NodeIndex];
+        const uint32 Start = nextReplica_[NodeIndex]->fetch_add(1);
+
+        for (int32 i = 0; i < NodeReplicas.Num(); ++i)
+        {
+            FReplica* Replica = replicas_[NodeReplicas[(Start + i) % NodeReplicas.Num()]].Get();
+            if (Replica->InUse.TryLock())
+            {
+                return FLease(this, Replica, CallerNode);
+            }
+        }
+    }
+
+    // 全部忙碌时在本节点的副本上排队
+    const TArray<int32>& LocalReplicas = replicasByNode_[CallerNode];
+    FReplica* Replica = replicas_[LocalReplicas[nextReplica_[CallerNode]->fetch_add(1) % LocalReplicas.Num()]].Get();
+    Replica->InUse.Lock();
+    return FLease(this, Replica, CallerNode);
+}
+
+void FOnnxNumaSessionPool::Release(FReplica* Replica, int32 CallerNode, double Seconds)
+{
+    {
+        FScopeLock Lock(&statsMutex_);
+        FOnnxNumaNodeStats& Stats = nodeStats_[Replica->NodeIndex];
+        ++Stats.NumRequests;
+        if (CallerNode != Replica->NodeIndex)
+        {
+            ++Stats.NumRemoteRequests;
+        }
+        Stats.BusySeconds += Seconds;
+    }
+
+    Replica->InUse.Unlock();
+}
+
+TArray<FOnnxNumaNodeStats> FOnnxNumaSessionPool::GetNodeStats() const
+{
+    FScopeLock Lock(&statsMutex_);
+
+    TArray<FOnnxNumaNodeStats> Result = nodeStats_;
+    const double Elapsed = FPlatformTime::Seconds() - creationTime_;
+    for (FOnnxNumaNodeStats& Stats : Result)
+    {
+        Stats.RequestsPerSecond = Elapsed > 0.0 ? Stats.NumRequests / Elapsed : 0.0;
+        Stats.MeanLatencyMs = Stats.NumRequests > 0 ? Stats.BusySeconds * 1000.0 / Stats.NumRequests : 0.0;
+    }
+    return Result;
+}
+
+void FOnnxNumaSessionPool::LogNodeStats() const
+{
+    UE_LOG(LogTemp, Log, TEXT("=== %s NUMA node stats ==="), *poolName_);
+    for (const FOnnxNumaNodeStats& Stats : GetNodeStats())
+    {
+        UE_LOG(LogTemp, Log, TEXT("Node %d: replicas=%d, requests=%lld (remote=%lld), throughput=%.2f req/s, mean=%.2fms"),
+               Stats.NodeId, Stats.NumReplicas, Stats.NumRequests, Stats.NumRemoteRequests, Stats.RequestsPerSecond, Stats.MeanLatencyMs);
+    }
+}
@@ -0,0 +1,535 @@
+// OnnxPipeline.cpp
+
+#include "OnnxPipeline.h"
+#include "OnnxRuntime.h"
+#include "HAL/PlatformMisc.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+
+// 一个请求在流水线中的状态：所有张量槽随请求在阶段之间传递
+struct FOnnxPipeline::FRequest
+{
+    std::vector<Ort::Value> Values;
+    FOnnxPipelineCallback OnComplete;
+    double SubmitTime = 0.0;
+};
+
+/**
+ * FStageThread
+ * 承载一个阶段主循环的FRunnable
+ */
+class FOnnxPipeline::FStageThread : public FRunnable
+{
+public:
+    FStageThread(FOnnxPipeline& InOwner, int32 InStageIndex)
+        : Owner(InOwner)
+        , StageIndex(InStageIndex)
+    {
+    }
+
+    virtual uint32 Run() override
+    {
+        Owner.RunStage(StageIndex);
+        return 0;
+    }
+
+    FOnnxPipeline& Owner;
+    int32 StageIndex;
+    FRunnableThread* Thread = nullptr;
+};
+
+struct FOnnxPipeline::FStage
+{
+    TUniquePtr<Ort::Session> Session;
+
+    // 会话的输入/输出名称和它们在请求中的槽
+    std::vector<std::string> InputNames;
+    std::vector<std::string> OutputNames;
+    std::vector<const char*> InputNamePtrs;
+    std::vector<const char*> OutputNamePtrs;
+    TArray<int32> InputSlots;
+    TArray<int32> OutputSlots;
+
+    // 之后的阶段（或模型输出）仍然需要的输入，其余输入在本阶段之后释放
+    TArray<bool> KeepInput;
+
+    TQueue<TUniquePtr<FRequest>, EQueueMode::Mpsc> Queue;
+    FEvent* WorkEvent = nullptr;
+    TUniquePtr<FStageThread> Thread;
+
+    int32 NumNodes = 0;
+    int64 WeightBytes = 0;
+    int32 IntraOpThreads = 0;
+
+    std::atomic<int64> Completed{0};
+    std::atomic<int64> BusyMicros{0};
+};
+
+FOnnxPipeline::~FOnnxPipeline()
+{
+    Stop();
+}
+
+bool FOnnxPipeline::Start(const TArray<uint8>& ModelData, const FOnnxSessionSettings& Settings, const FOnnxPipelineSettings& PipelineSettings,
+                          const FString& InDisplayName, const FOnnxPipelineSessionFactory& CreateSession)
+{
+    check(!bRunning_ && stages_.Num() == 0);
+    displayName_ = InDisplayName;
+
+    FOnnxGraphStagePlan plan;
+    FString error;
+    if (!FOnnxGraphPatch::PlanStages(ModelData, PipelineSettings.SplitNodes, PipelineSettings.NumStages, plan, error))
+    {
+        UE_LOG(LogTemp, Error, TEXT("%s: cannot split the model into pipeline stages: %s"), *displayName_, *error);
+        return false;
+    }
+    const int32 numStages = plan.Stages.Num();
+
+    FOnnxRuntime& runtime = FOnnxRuntime::Get();
+    if (!runtime.IsAvailable())
+    {
+        UE_LOG(LogTemp, Error, TEXT("%s: cannot start the pipeline: ONNX Runtime is not available"), *displayName_);
+        return false;
+    }
+    if (runtime.GetThreadingSettings().bUseGlobalThreadPools)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("%s: pipeline stages share the global thread pools, StageIntraOpThreads has no effect"), *displayName_);
+    }
+
+    // 张量槽：模型输入在前，之后是各阶段的输出；记录每个槽最后被使用的阶段（模型输出保留到最后）
+    TMap<FString, int32> slots;
+    for (const FString& name : plan.Inputs)
+    {
+        slots.Add(name, slots.Num());
+    }
+    for (const FOnnxGraphStage& stage : plan.Stages)
+    {
+        for (const FString& name : stage.Outputs)
+        {
+            if (!slots.Contains(name))
+            {
+                slots.Add(name, slots.Num());
+            }
+        }
+    }
+    numSlots_ = slots.Num();
+
+    TArray<int32> lastUse;
+    lastUse.Init(INDEX_NONE, numSlots_);
+    for (int32 stageIndex = 0; stageIndex < numStages; ++stageIndex)
+    {
+        for (const FString& name : plan.Stages[stageIndex].Inputs)
+        {
+            lastUse[slots[name]] = stageIndex;
+        }
+    }
+
+    inputSlots_.Reset();
+    for (const FString& name : plan.Inputs)
+    {
+        inputNames_.push_back(TCHAR_TO_UTF8(*name));
+        inputSlots_.Add(slots[name]);
+    }
+    inputTypes_.SetNum(plan.Inputs.Num());
+
+    outputSlots_.Reset();
+    for (const FString& name : plan.Outputs)
+    {
+        const int32* slot = slots.Find(name);
+        if (!slot)
+        {
+            UE_LOG(LogTemp, Error, TEXT("%s: model output %s is not produced by any pipeline stage"), *displayName_, *name);
+            return false;
+        }
+        outputNames_.push_back(TCHAR_TO_UTF8(*name));
+        outputSlots_.Add(*slot);
+        lastUse[*slot] = numStages;
+    }
+
+    // 未指定的阶段平分线程预算（会话只配置了1个线程时按物理核心数）
+    const int32 totalThreads = Settings.IntraOpThreads > 1 ? Settings.IntraOpThreads : FPlatformMisc::NumberOfCores();
+
+    try
+    {
+        // 依次创建阶段会话：之前阶段会话的输出类型就是之后阶段中间输入的类型
+        TMap<FString, FOnnxGraphTensorType> knownTypes;
+        Ort::AllocatorWithDefaultOptions allocator;
+        for (int32 stageIndex = 0; stageIndex < numStages; ++stageIndex)
+        {
+            const FOnnxGraphStage& stagePlan = plan.Stages[stageIndex];
+
+            TArray<uint8> stageData;
+            if (!FOnnxGraphPatch::ExtractStage(ModelData, stagePlan, knownTypes, stageData, error))
+            {
+                UE_LOG(LogTemp, Error, TEXT("%s: failed to extract pipeline stage %d: %s"), *displayName_, stageIndex, *error);
+                stages_.Reset();
+                return false;
+            }
+
+            // 每个阶段有自己的线程池，逐线程亲和性和NUMA副本只适用于整个模型的单个会话
+            FOnnxSessionSettings stageSettings = Settings;
+            stageSettings.IntraOpThreads = PipelineSettings.StageIntraOpThreads.IsValidIndex(stageIndex) && PipelineSettings.StageIntraOpThreads[stageIndex] > 0
+                ? PipelineSettings.StageIntraOpThreads[stageIndex]
+                : FMath::Max(1, totalThreads / numStages);
+            stageSettings.IntraOpThreadAffinities.Empty();
+            stageSettings.ReplicasPerNumaNode = 0;
+
+            TUniquePtr<FStage> stage = MakeUnique<FStage>();
+            stage->NumNodes = stagePlan.LastNode - stagePlan.FirstNode + 1;
+            stage->WeightBytes = stagePlan.WeightBytes;
+            stage->IntraOpThreads = stageSettings.IntraOpThreads;
+            stage->Session = CreateSession(stageSettings, stageData);
+            if (!stage->Session)
+            {
+                UE_LOG(LogTemp, Error, TEXT("%s: failed to create the session of pipeline stage %d"), *displayName_, stageIndex);
+                stages_.Reset();
+                return false;
+            }
+
+            for (size_t i = 0; i < stage->Session->GetInputCount(); ++i)
+            {
+                auto inputName = stage->Session->GetInputNameAllocated(i, allocator);
+                const int32* slot = slots.Find(UTF8_TO_TCHAR(inputName.get()));
+                if (!slot)
+                {
+                    UE_LOG(LogTemp, Error, TEXT("%s: pipeline stage %d has an unexpected input %s"), *displayName_, stageIndex, UTF8_TO_TCHAR(inputName.get()));
+                    stages_.Reset();
+                    return false;
+                }
+
+                stage->InputNames.push_back(inputName.get());
+                stage->InputSlots.Add(*slot);
+                stage->KeepInput.Add(lastUse[*slot] > stageIndex);
+
+                // 模型输入的类型从第一个使用它的阶段查询
+                if (*slot < inputTypes_.Num() && inputTypes_[*slot].ElementType == ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED)
+                {
+                    Ort::TypeInfo typeInfo = stage->Session->GetInputTypeInfo(i);
+                    Ort::ConstTensorTypeAndShapeInfo tensorInfo = typeInfo.GetTensorTypeAndShapeInfo();
+                    inputTypes_[*slot].ElementType = tensorInfo.GetElementType();
+                    for (int64_t dim : tensorInfo.GetShape())
+                    {
+                        inputTypes_[*slot].Shape.Add(dim);
+                    }
+                }
+            }
+
+            for (size_t i = 0; i < stage->Session->GetOutputCount(); ++i)
+            {
+                auto outputName = stage->Session->GetOutputNameAllocated(i, allocator);
+                const FString name = UTF8_TO_TCHAR(outputName.get());
+                stage->OutputNames.push_back(outputName.get());
+                stage->OutputSlots.Add(slots[name]);
+
+                Ort::TypeInfo typeInfo = stage->Session->GetOutputTypeInfo(i);
+                if (typeInfo.GetONNXType() == ONNX_TYPE_TENSOR)
+                {
+                    Ort::ConstTensorTypeAndShapeInfo tensorInfo = typeInfo.GetTensorTypeAndShapeInfo();
+                    FOnnxGraphTensorType& type = knownTypes.Add(name);
+                    type.ElementType = tensorInfo.GetElementType();
+                    for (int64_t dim : tensorInfo.GetShape())
+                    {
+                        type.Shape.Add(dim);
+                    }
+                }
+            }
+
+            for (const std::string& name : stage->InputNames)
+            {
+                stage->InputNamePtrs.push_back(name.c_str());
+            }
+            for (const std::string& name : stage->OutputNames)
+            {
+                stage->OutputNamePtrs.push_back(name.c_str());
+            }
+
+            UE_LOG(LogTemp, Log, TEXT("%s: pipeline stage %d - nodes %d-%d, %.1f MB weights, %d inputs, %d outputs, %d threads"),
+                   *displayName_, stageIndex, stagePlan.FirstNode, stagePlan.LastNode, stagePlan.WeightBytes / (1024.0 * 1024.0),
+                   static_cast<int32>(stage->InputNames.size()), static_cast<int32>(stage->OutputNames.size()), stage->IntraOpThreads);
+            stages_.Add(MoveTemp(stage));
+        }
+    }
+    catch (const Ort::Exception& e)
+    {
+        UE_LOG(LogTemp, Error, TEXT("ONNX Runtime error while building the pipeline of %s: %s"), *displayName_, UTF8_TO_TCHAR(e.what()));
+        stages_.Reset();
+        return false;
+    }
+
+    maxInFlight_ = FMath::Max(1, PipelineSettings.MaxInFlight);
+    slotFreedEvent_ = FPlatformProcess::GetSynchEventFromPool(false);
+    startTime_ = FPlatformTime::Seconds();
+    bStopping_ = false;
+    bRunning_ = true;
+
+    for (int32 stageIndex = 0; stageIndex < stages_.Num(); ++stageIndex)
+    {
+        FStage& stage = *stages_[stageIndex];
+        stage.WorkEvent = FPlatformProcess::GetSynchEventFromPool(false);
+        stage.Thread = MakeUnique<FStageThread>(*this, stageIndex);
+        stage.Thread->Thread = FRunnableThread::Create(stage.Thread.Get(), *FString::Printf(TEXT("ONNX Pipeline %s %d"), *displayName_, stageIndex));
+        if (!stage.Thread->Thread)
+        {
+            UE_LOG(LogTemp, Error, TEXT("%s: failed to create the thread of pipeline stage %d"), *displayName_, stageIndex);
+            Stop();
+            return false;
+        }
+    }
+
+    UE_LOG(LogTemp, Log, TEXT("%s: started a %d-stage pipeline (%d requests in flight)"), *displayName_, stages_.Num(), maxInFlight_);
+    return true;
+}
+
+void FOnnxPipeline::Stop()
+{
+    // 先拒绝新请求，再等待进行中的请求离开流水线
+    if (bRunning_.exchange(false))
+    {
+        while (numInFlight_ > 0)
+        {
+            slotFreedEvent_->Wait(10);
+        }
+    }
+
+    bStopping_ = true;
+    for (TUniquePtr<FStage>& stage : stages_)
+    {
+        if (stage->Thread && stage->Thread->Thread)
+        {
+            stage->WorkEvent->Trigger();
+            stage->Thread->Thread->WaitForCompletion();
+            delete stage->Thread->Thread;
+        }
+        stage->Thread.Reset();
+
+        if (stage->WorkEvent)
+        {
+            FPlatformProcess::ReturnSynchEventToPool(stage->WorkEvent);
+            stage->WorkEvent = nullptr;
+        }
+    }
+    stages_.Reset();
+
+    if (slotFreedEvent_)
+    {
+        FPlatformProcess::ReturnSynchEventToPool(slotFreedEvent_);
+        slotFreedEvent_ = nullptr;
+    }
+}
+
+int32 FOnnxPipeline::FindInput(const char* Name) const
+{
+    for (int32 i = 0; i < static_cast<int32>(inputNames_.size()); ++i)
+    {
+        if (inputNames_[i] == Name)
+        {
+            return i;
+        }
+    }
+    return INDEX_NONE;
+}
+
+int32 FOnnxPipeline::FindOutput(const char* Name) const
+{
+    for (int32 i = 0; i < static_cast<int32>(outputNames_.size()); ++i)
+    {
+        if (outputNames_[i] == Name)
+        {
+            return i;
+        }
+    }
+    return INDEX_NONE;
+}
+
+void FOnnxPipeline::Submit(std::vector<Ort::Value>&& Inputs, FOnnxPipelineCallback&& OnComplete)
+{
+    std::vector<Ort::Value> noOutputs;
+    if (Inputs.size() != inputNames_.size())
+    {
+        UE_LOG(LogTemp, Error, TEXT("%s: pipeline request has %d inputs, model expects %d"), *displayName_, static_cast<int32>(Inputs.size()), static_cast<int32>(inputNames_.size()));
+        OnComplete(false, noOutputs);
+        return;
+    }
+
+    // 先占用名额再检查是否在运行，与Stop的顺序相反，保证Stop排空时不会漏掉请求
+    bool bReserved = false;
+    int32 inFlight = numInFlight_.load();
+    while (bRunning_)
+    {
+        if (inFlight >= maxInFlight_)
+        {
+            slotFreedEvent_->Wait(10);
+            inFlight = numInFlight_.load();
+        }
+        else if (numInFlight_.compare_exchange_weak(inFlight, inFlight + 1))
+        {
+            bReserved = true;
+            break;
+        }
+    }
+    if (!bRunning_)
+    {
+        if (bReserved)
+        {
+            --numInFlight_;
+            slotFreedEvent_->Trigger();
+        }
+        ++failedRequests_;
+        OnComplete(false, noOutputs);
+        return;
+    }
+
+    TUniquePtr<FRequest> request = MakeUnique<FRequest>();
+    request->Values.reserve(numSlots_);
+    for (int32 i = 0; i < numSlots_; ++i)
+    {
+        request->Values.emplace_back(nullptr);
+    }
+    for (int32 i = 0; i < inputSlots_.Num(); ++i)
+    {
+        request->Values[inputSlots_[i]] = std::move(Inputs[i]);
+    }
+    request->OnComplete = MoveTemp(OnComplete);
+    request->SubmitTime = FPlatformTime::Seconds();
+
+    FStage& firstStage = *stages_[0];
+    firstStage.Queue.Enqueue(MoveTemp(request));
+    firstStage.WorkEvent->Trigger();
+}
+
+bool FOnnxPipeline::Run(std::vector<Ort::Value>&& Inputs, std::vector<Ort::Value>& OutOutputs)
+{
+    FEvent* doneEvent = FPlatformProcess::GetSynchEventFromPool(true);
+    bool bResult = false;
+    Submit(MoveTemp(Inputs), [&](bool bSucceeded, std::vector<Ort::Value>& Outputs)
+    {
+        bResult = bSucceeded;
+        OutOutputs = std::move(Outputs);
+        doneEvent->Trigger();
+    });
+    doneEvent->Wait();
+    FPlatformProcess::ReturnSynchEventToPool(doneEvent);
+    return bResult;
+}
+
+void FOnnxPipeline::RunStage(int32 StageIndex)
+{
+    FStage& stage = *stages_[StageIndex];
+    FStage* nextStage = StageIndex + 1 < stages_.Num() ? stages_[StageIndex + 1].Get() : nullptr;
+    std::vector<Ort::Value> inputs;
+    inputs.reserve(stage.InputSlots.Num());
+
+    while (true)
+    {
+        TUniquePtr<FRequest> request;
+        if (!stage.Queue.Dequeue(request))
+        {
+            if (bStopping_)
+            {
+                break;
+            }
+            stage.WorkEvent->Wait();
+            continue;
+        }
+
+        const double startTime = FPlatformTime::Seconds();
+        bool bSucceeded = false;
+        try
+        {
+            // 输入从槽中移出（只是交换句柄），之后还需要的再放回
+            inputs.clear();
+            for (int32 slot : stage.InputSlots)
+            {
+                inputs.push_back(std::move(request->Values[slot]));
+            }
+
+            std::vector<Ort::Value> outputs = stage.Session->Run(Ort::RunOptions{nullptr}, stage.InputNamePtrs.data(), inputs.data(), inputs.size(),
+                                                                 stage.OutputNamePtrs.data(), stage.OutputNamePtrs.size());
+
+            for (int32 i = 0; i < stage.InputSlots.Num(); ++i)
+            {
+                if (stage.KeepInput[i])
+                {
+                    request->Values[stage.InputSlots[i]] = std::move(inputs[i]);
+                }
+            }
+            for (int32 i = 0; i < stage.OutputSlots.Num(); ++i)
+            {
+                request->Values[stage.OutputSlots[i]] = std::move(outputs[i]);
+            }
+            bSucceeded = true;
+        }
+        catch (const Ort::Exception& e)
+        {
+            UE_LOG(LogTemp, Error, TEXT("ONNX Runtime error in pipeline stage %d of %s: %s"), StageIndex, *displayName_, UTF8_TO_TCHAR(e.what()));
+        }
+
+        // 不再需要的中间张量在这里释放
+        inputs.clear();
+        stage.BusyMicros += static_cast<int64>((FPlatformTime::Seconds() - startTime) * 1e6);
+        ++stage.Completed;
+
+        if (bSucceeded && nextStage)
+        {
+            nextStage->Queue.Enqueue(MoveTemp(request));
+            nextStage->WorkEvent->Trigger();
+        }
+        else
+        {
+            Complete(request.Release(), bSucceeded);
+        }
+    }
+}
+
+void FOnnxPipeline::Complete(FRequest* Request, bool bSucceeded)
+{
+    TUniquePtr<FRequest> request(Request);
+
+    std::vector<Ort::Value> outputs;
+    if (bSucceeded)
+    {
+        outputs.reserve(outputSlots_.Num());
+        for (int32 slot : outputSlots_)
+        {
+            outputs.push_back(std::move(request->Values[slot]));
+        }
+        ++completedRequests_;
+        totalLatencyMicros_ += static_cast<int64>((FPlatformTime::Seconds() - request->SubmitTime) * 1e6);
+    }
+    else
+    {
+        ++failedRequests_;
+    }
+
+    request->OnComplete(bSucceeded, outputs);
+    request.Reset();
+
+    --numInFlight_;
+    slotFreedEvent_->Trigger();
+}
+
+FOnnxPipelineStats FOnnxPipeline::GetStats() const
+{
+    FOnnxPipelineStats stats;
+    const double elapsedSeconds = FMath::Max(FPlatformTime::Seconds() - startTime_, 1e-6);
+    for (const TUniquePtr<FStage>& stage : stages_)
+    {
+        FOnnxPipelineStageStats& stageStats = stats.Stages.AddDefaulted_GetRef();
+        stageStats.NumNodes = stage->NumNodes;
+        stageStats.WeightMB = stage->WeightBytes / (1024.0f * 1024.0f);
+        stageStats.IntraOpThreads = stage->IntraOpThreads;
+        stageStats.Completed = stage->Completed;
+        const double busySeconds = stage->BusyMicros / 1e6;
+        stageStats.MeanRunMs = stageStats.Completed > 0 ? busySeconds * 1000.0 / stageStats.Completed : 0.0f;
+        stageStats.Utilization = busySeconds / elapsedSeconds;
+    }
+
+    stats.NumInFlight = numInFlight_;
+    stats.CompletedRequests = completedRequests_;
+    stats.FailedRequests = failedRequests_;
+    stats.MeanLatencyMs = stats.CompletedRequests > 0 ? totalLatencyMicros_ / 1000.0 / stats.CompletedRequests : 0.0f;
+    stats.RequestsPerSecond = stats.CompletedRequests / elapsedSeconds;
+    return stats;
+}
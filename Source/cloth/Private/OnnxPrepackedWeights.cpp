@@ -0,0 +1,132 @@
+// OnnxPrepackedWeights.cpp
+
+#include "OnnxPrepackedWeights.h"
+#include "HAL/FileManager.h"
+#include "Misc/ScopeLock.h"
+#include "Misc/SecureHash.h"
+
+FCriticalSection FOnnxPrepackedWeightsRegistry::Mutex;
+TMap<FString, TWeakPtr<FOnnxPrepackedWeightsContainer, ESPMode::ThreadSafe>> FOnnxPrepackedWeightsRegistry::Containers;
+TMap<FString, FOnnxPrepackedWeightsRegistry::FFileHashEntry> FOnnxPrepackedWeightsRegistry::FileHashCache;
+
+FOnnxPrepackedWeightsContainer::FOnnxPrepackedWeightsContainer()
+{
+    Ort::ThrowOnError(Ort::GetApi().CreatePrepackedWeightsContainer(&container_));
+}
+
+FOnnxPrepackedWeightsContainer::~FOnnxPrepackedWeightsContainer()
+{
+    if (container_)
+    {
+        Ort::GetApi().ReleasePrepackedWeightsContainer(container_);
+        container_ = nullptr;
+    }
+}
+
+FString FOnnxPrepackedWeightsRegistry::ComputeModelHash(const FString& ModelPath)
+{
+    const FString FullPath = FPaths::ConvertRelativePathToFull(ModelPath);
+    const int64 FileSize = IFileManager::Get().FileSize(*FullPath);
+    if (FileSize < 0)
+    {
+        return FString();
+    }
+    const FDateTime TimeStamp = IFileManager::Get().GetTimeStamp(*FullPath);
+
+    {
+        FScopeLock Lock(&Mutex);
+        const FFileHashEntry* Entry = FileHashCache.Find(FullPath);
+        if (Entry && Entry->FileSize == FileSize && Entry->TimeStamp == TimeStamp)
+        {
+            return Entry->Hash;
+        }
+    }
+
+    // 在锁外读取文件，避免大模型阻塞其他线程
+    const FMD5Hash FileHash = FMD5Hash::HashFile(*FullPath);
+    if (!FileHash.IsValid())
+    {
+        return FString();
+    }
+
+    FFileHashEntry NewEntry;
+    NewEntry.FileSize = FileSize;
+    NewEntry.TimeStamp = TimeStamp;
+    NewEntry.Hash = LexToString(FileHash);
+
+    FScopeLock Lock(&Mutex);
+    FileHashCache.Add(FullPath, NewEntry);
+    return NewEntry.Hash;
+}
+
+FString FOnnxPrepackedWeightsRegistry::ComputeModelHash(const TArray<uint8>& ModelData)
+{
+    if (ModelData.Num() == 0)
+    {
+        return FString();
+    }
+
+    FMD5 Md5;
+    Md5.Update(ModelData.GetData(), ModelData.Num());
+    FMD5Hash Hash;
+    Hash.Set(Md5);
+    return LexToString(Hash);
+}
+
+FOnnxPrepackedWeightsPtr FOnnxPrepackedWeightsRegistry::FindOrCreate(const FString& ModelHash)
+{
+    if (ModelHash.IsEmpty())
+    {
+        return nullptr;
+    }
+
+    FScopeLock Lock(&Mutex);
+
+    if (TWeakPtr<FOnnxPrepackedWeightsContainer, ESPMode::ThreadSafe>* Existing = Containers.Find(ModelHash))
+    {
+        FOnnxPrepackedWeightsPtr Pinned = Existing->Pin();
+        if (Pinned.IsValid())
+        {
+            UE_LOG(LogTemp, Log, TEXT("Reusing prepacked weights container for model %s"), *ModelHash);
+            return Pinned;
+        }
+    }
+
+    try
+    {
+        FOnnxPrepackedWeightsPtr NewContainer = MakeShared<FOnnxPrepackedWeightsContainer, ESPMode::ThreadSafe>();
+        Containers.Add(ModelHash, NewContainer);
+
+        // 顺便清理已经失效的条目
+        for (auto It = Containers.CreateIterator(); It; ++It)
+        {
+            if (!It->Value.IsValid())
+            {
+                It.RemoveCurrent();
+            }
+        }
+
+        UE_LOG(LogTemp, Log, TEXT("Created prepacked weights container for model %s"), *ModelHash);
+        return NewContainer;
+    }
+    catch (const Ort::Exception& e)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to create prepacked weights container: %s"), UTF8_TO_TCHAR(e.what()));
+        return nullptr;
+    }
+}
+
+int32 FOnnxPrepackedWeightsRegistry::GetNumLiveContainers()
+{
+    FScopeLock Lock(&Mutex);
+
+    int32 NumLive = 0;
+    for (const auto& Pair : Containers)
+    {
+        if (Pair.Value.IsValid())
+        {
+            ++NumLive;
+        }
+    }
+    return NumLive;
+}
@@ -0,0 +1,61 @@
+// OnnxReplayCommandlet.cpp
+
+#include "OnnxReplayCommandlet.h"
+#include "OnnxCapture.h"
+#include "Misc/Paths.h"
+
+UOnnxReplayCommandlet::UOnnxReplayCommandlet()
+{
+    IsClient = false;
+    IsServer = false;
+    IsEditor = true;
+    LogToConsole = true;
+}
+
+int32 UOnnxReplayCommandlet::Main(const FString& Params)
+{
+    TArray<FString> tokens;
+    TArray<FString> switches;
+    TMap<FString, FString> values;
+    ParseCommandLine(*Params, tokens, switches, values);
+
+    FString capturePath = values.FindRef(TEXT("Capture"));
+    if (capturePath.IsEmpty())
+    {
+        UE_LOG(LogTemp, Error, TEXT("Usage: -run=OnnxReplay -Capture=<file> [-Passes=N] [-Warmup=N] [-MaxRecords=N] [-Threads=N]"));
+        return 1;
+    }
+    if (!FPaths::FileExists(capturePath))
+    {
+        capturePath = FOnnxCaptureWriter::ResolvePath(capturePath, FString());
+    }
+
+    FOnnxReplayParams replayParams;
+    if (const FString* value = values.Find(TEXT("Passes")))
+    {
+        replayParams.Passes = FMath::Max(1, FCString::Atoi(**value));
+    }
+    if (const FString* value = values.Find(TEXT("Warmup")))
+    {
+        replayParams.WarmupRuns = FMath::Max(0, FCString::Atoi(**value));
+    }
+    if (const FString* value = values.Find(TEXT("MaxRecords")))
+    {
+        replayParams.MaxRecords = FMath::Max(0, FCString::Atoi(**value));
+    }
+    if (const FString* value = values.Find(TEXT("Threads")))
+    {
+        replayParams.IntraOpThreads = FMath::Max(0, FCString::Atoi(**value));
+    }
+
+    UE_LOG(LogTemp, Display, TEXT("Replaying ONNX capture %s (%d passes, %d warmup runs)"), *capturePath, replayParams.Passes, replayParams.WarmupRuns);
+    const TArray<FOnnxReplayResult> results = FOnnxCaptureReplay::Replay(capturePath, replayParams);
+    FOnnxCaptureReplay::LogResults(results);
+
+    bool bSucceeded = results.Num() > 0;
+    for (const FOnnxReplayResult& result : results)
+    {
+        bSucceeded = bSucceeded && result.NumRuns > 0 && result.NumFailed == 0;
+    }
+    return bSucceeded ? 0 : 1;
+}
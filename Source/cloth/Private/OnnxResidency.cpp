@@ -0,0 +1,288 @@
+// OnnxResidency.cpp
+
+#include "OnnxResidency.h"
+#include "OnnxTuning.h"
+#include "HAL/PlatformMemory.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/ConfigCacheIni.h"
+#include "Misc/ScopeLock.h"
+
+FOnnxResidencyHandle::FScope::FScope(FOnnxResidencyHandle& InHandle)
+    : Handle(InHandle)
+{
+    bResident = Handle.Acquire();
+}
+
+FOnnxResidencyHandle::FScope::~FScope()
+{
+    Handle.Release();
+}
+
+FOnnxResidencyHandle::~FOnnxResidencyHandle()
+{
+    if (bRegistered)
+    {
+        FOnnxResidencyManager::Get().UnregisterHandle(this);
+    }
+}
+
+void FOnnxResidencyHandle::Register(const FString& InName, FLoadFunction InLoad, FReleaseFunction InRelease, int64 InResidentBytes)
+{
+    name_ = InName;
+    load_ = MoveTemp(InLoad);
+    release_ = MoveTemp(InRelease);
+    bResident_ = true;
+    residentBytes_ = InResidentBytes;
+    lastUseTime_ = FPlatformTime::Seconds();
+
+    if (!bRegistered)
+    {
+        bRegistered = true;
+        FOnnxResidencyManager::Get().RegisterHandle(this);
+    }
+    FOnnxResidencyManager::Get().EnforceBudget(this);
+}
+
+void FOnnxResidencyHandle::SetResidentBytes(int64 Bytes)
+{
+    residentBytes_ = Bytes;
+}
+
+void FOnnxResidencyHandle::RunExclusive(TFunctionRef<void(bool bResident)> Fn)
+{
+    FScopeLock Lock(&stateMutex_);
+
+    // 持有锁之后Acquire不会再放入新的请求，只需等待进行中的请求结束
+    while (useCount_ > 0)
+    {
+        FPlatformProcess::SleepNoStats(0.0005f);
+    }
+    Fn(bResident_);
+}
+
+FOnnxResidencyStats FOnnxResidencyHandle::GetStats() const
+{
+    FScopeLock Lock(&stateMutex_);
+
+    FOnnxResidencyStats Stats;
+    Stats.Name = name_;
+    Stats.bResident = bResident_;
+    Stats.ResidentBytes = bResident_ ? residentBytes_.load() : 0;
+    Stats.NumEvictions = numEvictions_;
+    Stats.NumReloads = numReloads_;
+    Stats.SecondsSinceLastUse = static_cast<float>(FPlatformTime::Seconds() - lastUseTime_);
+    return Stats;
+}
+
+bool FOnnxResidencyHandle::Acquire()
+{
+    bool bReloaded = false;
+    {
+        FScopeLock Lock(&stateMutex_);
+
+        // 先标记为使用中，此后管理器不会再驱逐
+        ++useCount_;
+        lastUseTime_ = FPlatformTime::Seconds();
+
+        if (!bResident_ && bRegistered)
+        {
+            UE_LOG(LogTemp, Log, TEXT("Residency: reloading %s"), *name_);
+            if (!load_ || !load_())
+            {
+                UE_LOG(LogTemp, Error, TEXT("Residency: failed to reload %s"), *name_);
+                return false;
+            }
+            bResident_ = true;
+            bReloaded = true;
+            ++numReloads_;
+            ++FOnnxResidencyManager::Get().totalReloads_;
+        }
+    }
+
+    // 新加载的模型可能使总量超出预算，驱逐其他空闲模型
+    if (bReloaded)
+    {
+        FOnnxResidencyManager::Get().EnforceBudget(this);
+    }
+    return true;
+}
+
+void FOnnxResidencyHandle::Release()
+{
+    lastUseTime_ = FPlatformTime::Seconds();
+    --useCount_;
+}
+
+bool FOnnxResidencyHandle::TryEvict()
+{
+    if (!stateMutex_.TryLock())
+    {
+        return false;
+    }
+
+    bool bEvicted = false;
+    if (bResident_ && useCount_ == 0 && release_)
+    {
+        release_();
+        bResident_ = false;
+        bEvicted = true;
+        ++numEvictions_;
+    }
+
+    stateMutex_.Unlock();
+    return bEvicted;
+}
+
+FOnnxResidencyManager& FOnnxResidencyManager::Get()
+{
+    static FOnnxResidencyManager Manager;
+    return Manager;
+}
+
+FOnnxResidencyManager::FOnnxResidencyManager()
+{
+    int32 BudgetMB = 0;
+    if (GConfig)
+    {
+        GConfig->GetInt(TEXT("OnnxRuntime"), TEXT("ResidencyBudgetMB"), BudgetMB, GEngineIni);
+    }
+    BudgetMB = FOnnxTuning::GetResidencyBudgetMB(BudgetMB);
+    budgetBytes_ = int64(FMath::Max(0, BudgetMB)) * 1024 * 1024;
+}
+
+void FOnnxResidencyManager::SetBudgetBytes(int64 Bytes)
+{
+    budgetBytes_ = FMath::Max<int64>(0, Bytes);
+    EnforceBudget();
+}
+
+int64 FOnnxResidencyManager::GetResidentBytes() const
+{
+    FScopeLock Lock(&mutex_);
+
+    int64 Total = 0;
+    for (const FOnnxResidencyHandle* Handle : handles_)
+    {
+        if (Handle->bResident_)
+        {
+            Total += Handle->residentBytes_;
+        }
+    }
+    return Total;
+}
+
+void FOnnxResidencyManager::EnforceBudget(const FOnnxResidencyHandle* Excluding)
+{
+    const int64 Budget = budgetBytes_;
+    if (Budget <= 0)
+    {
+        return;
+    }
+
+    FScopeLock Lock(&mutex_);
+
+    int64 Total = 0;
+    TArray<FOnnxResidencyHandle*> Candidates;
+    for (FOnnxResidencyHandle* Handle : handles_)
+    {
+        if (Handle->bResident_)
+        {
+            Total += Handle->residentBytes_;
+            if (Handle != Excluding)
+            {
+                Candidates.Add(Handle);
+            }
+        }
+    }
+
+    // 最久未使用的排在前面
+    Candidates.Sort([](const FOnnxResidencyHandle& A, const FOnnxResidencyHandle& B)
+    {
+        return A.lastUseTime_ < B.lastUseTime_;
+    });
+
+    for (FOnnxResidencyHandle* Handle : Candidates)
+    {
+        if (Total <= Budget)
+        {
+            break;
+        }
+
+        const int64 Bytes = Handle->residentBytes_;
+        if (Handle->TryEvict())
+        {
+            Total -= Bytes;
+            ++totalEvictions_;
+            UE_LOG(LogTemp, Log, TEXT("Residency: evicted %s (%.1f MB), resident %.1f / %.1f MB"),
+                   *Handle->name_, Bytes / (1024.0 * 1024.0), Total / (1024.0 * 1024.0), Budget / (1024.0 * 1024.0));
+        }
+    }
+
+    if (Total > Budget)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Residency: %.1f MB resident exceeds the %.1f MB budget, remaining models are in use"),
+               Total / (1024.0 * 1024.0), Budget / (1024.0 * 1024.0));
+    }
+}
+
+int32 FOnnxResidencyManager::EvictIdle(double IdleSeconds)
+{
+    FScopeLock Lock(&mutex_);
+
+    const double Now = FPlatformTime::Seconds();
+    int32 NumEvicted = 0;
+    for (FOnnxResidencyHandle* Handle : handles_)
+    {
+        if (Handle->bResident_ && Now - Handle->lastUseTime_ >= IdleSeconds && Handle->TryEvict())
+        {
+            ++NumEvicted;
+            ++totalEvictions_;
+            UE_LOG(LogTemp, Log, TEXT("Residency: evicted idle %s"), *Handle->name_);
+        }
+    }
+    return NumEvicted;
+}
+
+TArray<FOnnxResidencyStats> FOnnxResidencyManager::GetStats() const
+{
+    FScopeLock Lock(&mutex_);
+
+    TArray<FOnnxResidencyStats> Stats;
+    for (const FOnnxResidencyHandle* Handle : handles_)
+    {
+        Stats.Add(Handle->GetStats());
+    }
+    return Stats;
+}
+
+void FOnnxResidencyManager::LogStats() const
+{
+    const TArray<FOnnxResidencyStats> Stats = GetStats();
+
+    UE_LOG(LogTemp, Log, TEXT("=== ONNX model residency: %.1f MB resident, budget %.1f MB, %d evictions, %d reloads ==="),
+           GetResidentBytes() / (1024.0 * 1024.0), budgetBytes_ / (1024.0 * 1024.0), GetTotalEvictions(), GetTotalReloads());
+    for (const FOnnxResidencyStats& Entry : Stats)
+    {
+        UE_LOG(LogTemp, Log, TEXT("%s: %s, %.1f MB, evictions=%d, reloads=%d, idle=%.1fs"),
+               *Entry.Name, Entry.bResident ? TEXT("resident") : TEXT("evicted"), Entry.ResidentBytes / (1024.0 * 1024.0),
+               Entry.NumEvictions, Entry.NumReloads, Entry.SecondsSinceLastUse);
+    }
+}
+
+int64 FOnnxResidencyManager::GetProcessUsedPhysical()
+{
+    return static_cast<int64>(FPlatformMemory::GetStats().UsedPhysical);
+}
+
+void FOnnxResidencyManager::RegisterHandle(FOnnxResidencyHandle* Handle)
+{
+    FScopeLock Lock(&mutex_);
+    handles_.AddUnique(Handle);
+}
+
+void FOnnxResidencyManager::UnregisterHandle(FOnnxResidencyHandle* Handle)
+{
+    FScopeLock Lock(&mutex_);
+    handles_.Remove(Handle);
+}
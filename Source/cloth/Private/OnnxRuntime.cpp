@@ -0,0 +1,714 @@
+// OnnxRuntime.cpp
+
+#include "OnnxRuntime.h"
+#include "OnnxSessionSettings.h"
+#include "OnnxCoreSessionConfig.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "Interfaces/IPluginManager.h"
+#include "Misc/ConfigCacheIni.h"
+#include "Misc/OutputDevice.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+#include "onnxruntime_session_options_config_keys.h"
+
+#include <atomic>
+
+#if PLATFORM_WINDOWS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#include <windows.h>
+#include "Windows/HideWindowsPlatformTypes.h"
+#elif PLATFORM_LINUX
+#include <dlfcn.h>
+#include <pthread.h>
+#include <time.h>
+#endif
+
+TUniquePtr<FOnnxRuntime> FOnnxRuntime::Instance;
+
+namespace
+{
+    FCriticalSection GOnnxRuntimeInstanceMutex;
+
+    // API加载状态：0未加载，1成功，-1失败（失败后不再重试，避免每次使用都重复报错）
+    std::atomic<int32> GOnnxApiState{0};
+    FCriticalSection GOnnxApiMutex;
+
+    // 启动耗时分解
+    FCriticalSection GOnnxStartupMutex;
+    FOnnxRuntimeStartupStats GOnnxStartupStats;
+    double GOnnxModuleStartupTime = 0.0;
+
+    // 逐个保留统计的已退出工作线程数，更早退出的线程合并为一项（会话反复重建时线程数没有上限）
+    constexpr int32 MaxFinishedThreadStats = 256;
+
+    // 定位并加载插件自带的onnxruntime动态库，返回实际加载的路径
+    FString LoadOrtLibrary()
+    {
+#if PLATFORM_WINDOWS
+        // onnxruntime.dll是延迟加载的：先从插件目录显式加载，之后第一次调用ORT导出函数时直接使用已加载的模块，
+        // 而不会按搜索路径找到其他版本（例如引擎NNE自带的旧版本）
+        if (!GetModuleHandleW(L"onnxruntime.dll"))
+        {
+            TSharedPtr<IPlugin> plugin = IPluginManager::Get().FindPlugin(TEXT("UE5OnnxRuntime"));
+            if (plugin.IsValid())
+            {
+                const FString libDir = FPaths::ConvertRelativePathToFull(FPaths::Combine(plugin->GetBaseDir(), TEXT("ThirdParty"), TEXT("OnnxRuntime"), TEXT("lib")));
+                FPlatformProcess::PushDllDirectory(*libDir);
+                FPlatformProcess::GetDllHandle(*FPaths::Combine(libDir, TEXT("onnxruntime.dll")));
+                FPlatformProcess::PopDllDirectory(*libDir);
+            }
+        }
+
+        HMODULE module = GetModuleHandleW(L"onnxruntime.dll");
+        if (module)
+        {
+            TCHAR modulePath[MAX_PATH];
+            if (GetModuleFileName(module, modulePath, MAX_PATH))
+            {
+                return modulePath;
+            }
+        }
+#elif PLATFORM_LINUX
+        // libonnxruntime.so随进程加载，这里只查询它的位置
+        Dl_info info;
+        if (dladdr(reinterpret_cast<void*>(&OrtGetApiBase), &info) && info.dli_fname)
+        {
+            return UTF8_TO_TCHAR(info.dli_fname);
+        }
+#endif
+        return FString();
+    }
+
+    void LogStartupTiming(FOutputDevice& Ar, const FOnnxRuntimeStartupStats& Stats)
+    {
+        auto FormatMs = [](double Ms) { return Ms >= 0.0 ? FString::Printf(TEXT("%.2f ms"), Ms) : FString(TEXT("n/a")); };
+
+        Ar.Logf(TEXT("=== ONNX Runtime startup ==="));
+        Ar.Logf(TEXT("Version: %s (%s)"), Stats.Version.IsEmpty() ? TEXT("not loaded") : *Stats.Version,
+                Stats.LibraryPath.IsEmpty() ? TEXT("unknown path") : *Stats.LibraryPath);
+        Ar.Logf(TEXT("Module startup to first use: %s"),
+                Stats.ModuleStartupToFirstUseSeconds >= 0.0 ? *FString::Printf(TEXT("%.3f s"), Stats.ModuleStartupToFirstUseSeconds) : TEXT("n/a"));
+        Ar.Logf(TEXT("Library load: %s"), *FormatMs(Stats.DllLoadMs));
+        Ar.Logf(TEXT("Env creation: %s"), *FormatMs(Stats.EnvCreateMs));
+        Ar.Logf(TEXT("First session: %s%s"), *FormatMs(Stats.FirstSessionMs),
+                Stats.FirstSessionName.IsEmpty() ? TEXT("") : *FString::Printf(TEXT(" (%s)"), *Stats.FirstSessionName));
+    }
+
+    FAutoConsoleCommandWithOutputDevice GOnnxStartupTimingCommand(
+        TEXT("onnx.StartupTiming"),
+        TEXT("Prints the ONNX Runtime startup breakdown: library load, Env creation and first session."),
+        FConsoleCommandWithOutputDeviceDelegate::CreateStatic(&FOnnxRuntime::LogStartupStats));
+
+    // 读取单个线程CPU时间的平台封装（可以在其他线程上查询）
+    struct FThreadCpuClock
+    {
+#if PLATFORM_WINDOWS
+        HANDLE ThreadHandle = nullptr;
+#elif PLATFORM_LINUX
+        clockid_t ClockId = 0;
+        bool bValid = false;
+#endif
+
+        // 必须在目标线程上调用
+        void CaptureCurrentThread()
+        {
+#if PLATFORM_WINDOWS
+            DuplicateHandle(GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(), &ThreadHandle,
+                            THREAD_QUERY_LIMITED_INFORMATION, FALSE, 0);
+#elif PLATFORM_LINUX
+            bValid = pthread_getcpuclockid(pthread_self(), &ClockId) == 0;
+#endif
+        }
+
+        double ReadSeconds() const
+        {
+#if PLATFORM_WINDOWS
+            FILETIME CreationTime, ExitTime, KernelTime, UserTime;
+            if (ThreadHandle && GetThreadTimes(ThreadHandle, &CreationTime, &ExitTime, &KernelTime, &UserTime))
+            {
+                const uint64 Kernel = (uint64(KernelTime.dwHighDateTime) << 32) | KernelTime.dwLowDateTime;
+                const uint64 User = (uint64(UserTime.dwHighDateTime) << 32) | UserTime.dwLowDateTime;
+                return double(Kernel + User) * 1e-7;
+            }
+#elif PLATFORM_LINUX
+            timespec Time;
+            if (bValid && clock_gettime(ClockId, &Time) == 0)
+            {
+                return double(Time.tv_sec) + double(Time.tv_nsec) * 1e-9;
+            }
+#endif
+            return -1.0;
+        }
+
+        void Release()
+        {
+#if PLATFORM_WINDOWS
+            if (ThreadHandle)
+            {
+                CloseHandle(ThreadHandle);
+                ThreadHandle = nullptr;
+            }
+#elif PLATFORM_LINUX
+            bValid = false;
+#endif
+        }
+    };
+}
+
+/**
+ * FOnnxWorkerThread
+ * 承载一个ORT工作线程主循环的FRunnable
+ */
+class FOnnxWorkerThread : public FRunnable
+{
+public:
+    FOnnxWorkerThread(FOnnxRuntime* InOwner, int32 InIndex, OrtThreadWorkerFn InWorkerFn, void* InWorkerParam)
+        : Owner(InOwner)
+        , Index(InIndex)
+        , Name(FString::Printf(TEXT("ONNX Worker %d"), InIndex))
+        , WorkerFn(InWorkerFn)
+        , WorkerParam(InWorkerParam)
+    {
+    }
+
+    virtual ~FOnnxWorkerThread() override
+    {
+        CpuClock.Release();
+    }
+
+    virtual uint32 Run() override
+    {
+        CpuClock.CaptureCurrentThread();
+        StartTime = FPlatformTime::Seconds();
+        bStarted = true;
+
+        // ORT的工作循环，直到线程池关闭才返回
+        WorkerFn(WorkerParam);
+
+        FinalBusySeconds = CpuClock.ReadSeconds();
+        EndTime = FPlatformTime::Seconds();
+        bFinished = true;
+        return 0;
+    }
+
+    FOnnxWorkerThreadStats GetStats() const
+    {
+        FOnnxWorkerThreadStats Stats;
+        Stats.Name = Name;
+        Stats.Index = Index;
+        if (!bStarted)
+        {
+            Stats.bRunning = true;
+            Stats.WallSeconds = 0.0;
+            Stats.BusySeconds = 0.0;
+            return Stats;
+        }
+
+        Stats.bRunning = !bFinished;
+        Stats.WallSeconds = (bFinished ? EndTime : FPlatformTime::Seconds()) - StartTime;
+        Stats.BusySeconds = GetBusySeconds();
+        return Stats;
+    }
+
+    double GetBusySeconds() const
+    {
+        if (!bStarted)
+        {
+            return 0.0;
+        }
+        return bFinished ? FinalBusySeconds : CpuClock.ReadSeconds();
+    }
+
+    FOnnxRuntime* Owner;
+    int32 Index;
+    FString Name;
+    OrtThreadWorkerFn WorkerFn;
+    void* WorkerParam;
+    FRunnableThread* Thread = nullptr;
+
+private:
+    FThreadCpuClock CpuClock;
+    double StartTime = 0.0;
+    double EndTime = 0.0;
+    double FinalBusySeconds = -1.0;
+    std::atomic<bool> bStarted{false};
+    std::atomic<bool> bFinished{false};
+};
+
+void FOnnxThreadingSettings::LoadFromConfig()
+{
+    if (!GConfig)
+    {
+        return;
+    }
+
+    const TCHAR* Section = TEXT("OnnxRuntime");
+    GConfig->GetBool(Section, TEXT("bUseGlobalThreadPools"), bUseGlobalThreadPools, GEngineIni);
+    GConfig->GetInt(Section, TEXT("GlobalIntraOpThreads"), GlobalIntraOpThreads, GEngineIni);
+    GConfig->GetInt(Section, TEXT("GlobalInterOpThreads"), GlobalInterOpThreads, GEngineIni);
+    GConfig->GetBool(Section, TEXT("bGlobalAllowSpinning"), bGlobalAllowSpinning, GEngineIni);
+    GConfig->GetString(Section, TEXT("IntraOpThreadAffinities"), IntraOpThreadAffinities, GEngineIni);
+
+    FString AffinityMaskString;
+    if (GConfig->GetString(Section, TEXT("WorkerAffinityMask"), AffinityMaskString, GEngineIni) && !AffinityMaskString.IsEmpty())
+    {
+        WorkerAffinityMask = FCString::Strtoui64(*AffinityMaskString, nullptr, 0);
+    }
+}
+
+FOnnxRuntime& FOnnxRuntime::Get()
+{
+    FScopeLock Lock(&GOnnxRuntimeInstanceMutex);
+    if (!Instance.IsValid())
+    {
+        Instance.Reset(new FOnnxRuntime());
+    }
+    return *Instance;
+}
+
+void FOnnxRuntime::Shutdown()
+{
+    FScopeLock Lock(&GOnnxRuntimeInstanceMutex);
+    Instance.Reset();
+}
+
+bool FOnnxRuntime::LoadApi()
+{
+    const int32 state = GOnnxApiState.load(std::memory_order_acquire);
+    if (state != 0)
+    {
+        return state > 0;
+    }
+
+    FScopeLock Lock(&GOnnxApiMutex);
+    if (GOnnxApiState.load(std::memory_order_relaxed) != 0)
+    {
+        return GOnnxApiState.load(std::memory_order_relaxed) > 0;
+    }
+
+    const double startTime = FPlatformTime::Seconds();
+    const FString libraryPath = LoadOrtLibrary();
+
+    const OrtApiBase* apiBase = OrtGetApiBase();
+    const OrtApi* api = apiBase ? apiBase->GetApi(ORT_API_VERSION) : nullptr;
+    if (!api)
+    {
+        // 加载的动态库比头文件旧（通常是搜索路径上的其他ORT版本）
+        UE_LOG(LogTemp, Error, TEXT("ONNX Runtime API %d is not available (loaded: %s, version %s)"), ORT_API_VERSION,
+               libraryPath.IsEmpty() ? TEXT("unknown") : *libraryPath,
+               apiBase ? UTF8_TO_TCHAR(apiBase->GetVersionString()) : TEXT("unknown"));
+        GOnnxApiState.store(-1, std::memory_order_release);
+        return false;
+    }
+
+    // C++ API的指针每个二进制各有一份：本模块和OnnxCore都要设置
+#ifdef ORT_API_MANUAL_INIT
+    Ort::InitApi(api);
+#endif
+    OnnxCore::InitializeApi(api);
+
+    const double endTime = FPlatformTime::Seconds();
+    {
+        FScopeLock StatsLock(&GOnnxStartupMutex);
+        GOnnxStartupStats.Version = UTF8_TO_TCHAR(apiBase->GetVersionString());
+        GOnnxStartupStats.LibraryPath = libraryPath;
+        GOnnxStartupStats.DllLoadMs = (endTime - startTime) * 1000.0;
+        if (GOnnxModuleStartupTime > 0.0)
+        {
+            GOnnxStartupStats.ModuleStartupToFirstUseSeconds = startTime - GOnnxModuleStartupTime;
+        }
+    }
+
+    UE_LOG(LogTemp, Log, TEXT("ONNX Runtime %s loaded in %.2f ms (API %d, %s)"), UTF8_TO_TCHAR(apiBase->GetVersionString()),
+           (endTime - startTime) * 1000.0, ORT_API_VERSION, libraryPath.IsEmpty() ? TEXT("unknown path") : *libraryPath);
+
+    GOnnxApiState.store(1, std::memory_order_release);
+    return true;
+}
+
+void FOnnxRuntime::NoteModuleStartup()
+{
+    FScopeLock Lock(&GOnnxStartupMutex);
+    GOnnxModuleStartupTime = FPlatformTime::Seconds();
+}
+
+void FOnnxRuntime::ReportSessionCreated(const FString& Name, double Seconds)
+{
+    FOnnxRuntimeStartupStats stats;
+    {
+        FScopeLock Lock(&GOnnxStartupMutex);
+        if (GOnnxStartupStats.FirstSessionMs >= 0.0)
+        {
+            return;
+        }
+        GOnnxStartupStats.FirstSessionMs = Seconds * 1000.0;
+        GOnnxStartupStats.FirstSessionName = Name;
+        stats = GOnnxStartupStats;
+    }
+
+    LogStartupTiming(*GLog, stats);
+}
+
+FOnnxRuntimeStartupStats FOnnxRuntime::GetStartupStats()
+{
+    FScopeLock Lock(&GOnnxStartupMutex);
+    return GOnnxStartupStats;
+}
+
+void FOnnxRuntime::LogStartupStats(FOutputDevice& Ar)
+{
+    LogStartupTiming(Ar, GetStartupStats());
+}
+
+FOnnxRuntime::FOnnxRuntime()
+{
+    threadingSettings_.LoadFromConfig();
+    memorySettings_.LoadFromConfig();
+    defaultThreadOptions_.Runtime = this;
+    lowPriorityThreadOptions_.Runtime = this;
+    lowPriorityThreadOptions_.Priority = TPri_BelowNormal;
+
+    // 第一次使用ORT：此前模块启动时不加载动态库。加载失败（库缺失或版本不对）时不创建Env，
+    // 编辑器和服务器继续运行，所有入口经由IsAvailable()报告错误
+    if (!LoadApi())
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to load ONNX Runtime, ONNX inference is unavailable"));
+        return;
+    }
+
+    const double envStartTime = FPlatformTime::Seconds();
+    if (threadingSettings_.bUseGlobalThreadPools)
+    {
+        // 用ThreadingOptions创建Env会立即创建全局线程池，它们同样走我们的线程钩子
+        Ort::ThreadingOptions threadingOptions;
+        threadingOptions.SetGlobalIntraOpNumThreads(threadingSettings_.GlobalIntraOpThreads);
+        threadingOptions.SetGlobalInterOpNumThreads(threadingSettings_.GlobalInterOpThreads);
+        threadingOptions.SetGlobalSpinControl(threadingSettings_.bGlobalAllowSpinning ? 1 : 0);
+        threadingOptions.SetGlobalCustomCreateThreadFn(&FOnnxRuntime::CreateThreadHook);
+        threadingOptions.SetGlobalCustomThreadCreationOptions(&defaultThreadOptions_);
+        threadingOptions.SetGlobalCustomJoinThreadFn(&FOnnxRuntime::JoinThreadHook);
+        env_ = MakeUnique<Ort::Env>(threadingOptions, ORT_LOGGING_LEVEL_WARNING, "UEOnnxRuntime");
+    }
+    else
+    {
+        // 每个会话使用自己的线程池（由ConfigureSessionOptions设置钩子），不创建用不到的全局线程池
+        env_ = MakeUnique<Ort::Env>(ORT_LOGGING_LEVEL_WARNING, "UEOnnxRuntime");
+    }
+
+    // ORT的CPU分配改由FMemory提供，使推理内存出现在LLM和memreport中
+    if (memorySettings_.bUseUnrealAllocator)
+    {
+        bUnrealAllocator_ = FOnnxMemory::RegisterWithEnv(*env_, memorySettings_);
+    }
+
+    const double envMs = (FPlatformTime::Seconds() - envStartTime) * 1000.0;
+    {
+        FScopeLock Lock(&GOnnxStartupMutex);
+        GOnnxStartupStats.EnvCreateMs = envMs;
+    }
+
+    if (threadingSettings_.bUseGlobalThreadPools)
+    {
+        UE_LOG(LogTemp, Log, TEXT("ONNX Runtime environment created in %.2f ms (global pools: intra=%d, inter=%d, affinity=0x%llx)"),
+               envMs, threadingSettings_.GlobalIntraOpThreads, threadingSettings_.GlobalInterOpThreads, threadingSettings_.WorkerAffinityMask);
+    }
+    else
+    {
+        UE_LOG(LogTemp, Log, TEXT("ONNX Runtime environment created in %.2f ms (per-session thread pools, affinity=0x%llx)"),
+               envMs, threadingSettings_.WorkerAffinityMask);
+    }
+}
+
+FOnnxRuntime::~FOnnxRuntime()
+{
+    // 释放Env会关闭全局线程池，线程通过JoinThreadHook退出
+    env_.Reset();
+    LogWorkerThreadStats();
+
+    // 会话都已释放，归还插件分配器缓存的空闲块
+    FOnnxMemory::TrimCache();
+}
+
+std::basic_string<ORTCHAR_T> FOnnxRuntime::ToOrtString(const FString& Value)
+{
+#ifdef _WIN32
+    return std::wstring(TCHAR_TO_WCHAR(*Value));
+#else
+    return std::string(TCHAR_TO_UTF8(*Value));
+#endif
+}
+
+void FOnnxRuntime::ConfigureSessionOptions(Ort::SessionOptions& SessionOptions, const FOnnxSessionSettings& Settings) const
+{
+    // 使用向Env注册的分配器，而不是会话自己的arena
+    if (bUnrealAllocator_)
+    {
+        SessionOptions.AddConfigEntry(kOrtSessionOptionsConfigUseEnvAllocators, "1");
+    }
+
+    if (threadingSettings_.bUseGlobalThreadPools)
+    {
+        // 使用Env级别的全局线程池，线程已经由Env的钩子创建
+        SessionOptions.DisablePerSessionThreads();
+        return;
+    }
+
+    // 会话自己的线程池同样使用具名的FRunnable线程。ORT经由钩子创建线程时忽略session.intra_op_thread_affinities，
+    // 逐线程亲和性（NUMA副本绑定到所在节点）和后台会话的低优先级由钩子设置；无法用掩码表示时不使用钩子，由ORT自己应用亲和性
+    const FString& affinities = Settings.IntraOpThreadAffinities.IsEmpty() ? threadingSettings_.IntraOpThreadAffinities : Settings.IntraOpThreadAffinities;
+    FThreadCreationOptions* threadOptions = FindOrAddThreadOptions(affinities, Settings.bLowPriorityThreads);
+    if (!threadOptions)
+    {
+        return;
+    }
+
+    SessionOptions.SetCustomCreateThreadFn(&FOnnxRuntime::CreateThreadHook);
+    SessionOptions.SetCustomThreadCreationOptions(threadOptions);
+    SessionOptions.SetCustomJoinThreadFn(&FOnnxRuntime::JoinThreadHook);
+}
+
+FOnnxRuntime::FThreadCreationOptions* FOnnxRuntime::FindOrAddThreadOptions(const FString& Affinities, bool bLowPriority) const
+{
+    if (Affinities.IsEmpty())
+    {
+        return const_cast<FThreadCreationOptions*>(bLowPriority ? &lowPriorityThreadOptions_ : &defaultThreadOptions_);
+    }
+
+    const FString key = bLowPriority ? Affinities + TEXT("|low") : Affinities;
+    FScopeLock Lock(&threadsMutex_);
+    if (const TUniquePtr<FThreadCreationOptions>* existing = threadOptions_.Find(key))
+    {
+        return existing->Get();
+    }
+
+    // 格式与ORT相同："1,2;3-4"，分号分隔各线程，CPU编号从1开始，支持范围
+    TArray<uint64> threadMasks;
+    TArray<FString> threadGroups;
+    Affinities.ParseIntoArray(threadGroups, TEXT(";"));
+    for (const FString& group : threadGroups)
+    {
+        uint64 mask = 0;
+        TArray<FString> items;
+        group.ParseIntoArray(items, TEXT(","));
+        for (const FString& item : items)
+        {
+            FString firstText;
+            FString lastText;
+            if (!item.Split(TEXT("-"), &firstText, &lastText))
+            {
+                firstText = lastText = item;
+            }
+
+            const int32 first = FCString::Atoi(*firstText.TrimStartAndEnd());
+            const int32 last = FCString::Atoi(*lastText.TrimStartAndEnd());
+            for (int32 cpu = first; cpu <= last; ++cpu)
+            {
+                if (cpu < 1 || cpu > 64)
+                {
+                    UE_LOG(LogTemp, Warning, TEXT("ONNX thread affinities \"%s\" use CPU %d, which a thread affinity mask cannot express; ONNX Runtime applies them to unnamed threads instead"),
+                           *Affinities, cpu);
+                    return nullptr;
+                }
+                mask |= uint64(1) << (cpu - 1);
+            }
+        }
+        threadMasks.Add(mask);
+    }
+
+    TUniquePtr<FThreadCreationOptions> options = MakeUnique<FThreadCreationOptions>();
+    options->Runtime = const_cast<FOnnxRuntime*>(this);
+    options->ThreadMasks = MoveTemp(threadMasks);
+    options->Priority = bLowPriority ? TPri_BelowNormal : TPri_Normal;
+    FThreadCreationOptions* result = options.Get();
+    threadOptions_.Add(key, MoveTemp(options));
+    return result;
+}
+
+OrtCustomThreadHandle FOnnxRuntime::CreateThreadHook(void* Options, OrtThreadWorkerFn WorkerFn, void* WorkerParam)
+{
+    FThreadCreationOptions* CreationOptions = static_cast<FThreadCreationOptions*>(Options);
+    check(CreationOptions && CreationOptions->Runtime);
+    FOnnxRuntime* Runtime = CreationOptions->Runtime;
+
+    int32 ThreadIndex;
+    {
+        FScopeLock Lock(&Runtime->threadsMutex_);
+        ThreadIndex = Runtime->nextThreadIndex_++;
+    }
+
+    FOnnxWorkerThread* Worker = new FOnnxWorkerThread(Runtime, ThreadIndex, WorkerFn, WorkerParam);
+    // 会话的逐线程亲和性优先（线程按创建顺序取用，超出时循环），其次是所有工作线程共用的掩码
+    uint64 AffinityMask = Runtime->threadingSettings_.WorkerAffinityMask;
+    if (CreationOptions->ThreadMasks.Num() > 0)
+    {
+        const uint32 ThreadSlot = CreationOptions->NextThread++ % CreationOptions->ThreadMasks.Num();
+        AffinityMask = CreationOptions->ThreadMasks[ThreadSlot];
+    }
+    if (AffinityMask == 0)
+    {
+        AffinityMask = FPlatformAffinity::GetNoAffinityMask();
+    }
+    Worker->Thread = FRunnableThread::Create(Worker, *Worker->Name, 0, CreationOptions->Priority, AffinityMask);
+    if (!Worker->Thread)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to create ONNX worker thread %s"), *Worker->Name);
+        delete Worker;
+        return nullptr;
+    }
+
+    {
+        FScopeLock Lock(&Runtime->threadsMutex_);
+        Runtime->liveThreads_.Add(Worker);
+    }
+
+    return reinterpret_cast<OrtCustomThreadHandle>(Worker);
+}
+
+void FOnnxRuntime::JoinThreadHook(OrtCustomThreadHandle Handle)
+{
+    FOnnxWorkerThread* Worker = reinterpret_cast<FOnnxWorkerThread*>(const_cast<OrtCustomHandleType*>(Handle));
+    if (!Worker)
+    {
+        return;
+    }
+
+    Worker->Thread->WaitForCompletion();
+
+    // 不能通过Instance查找：Env在FOnnxRuntime析构期间释放时Instance已经被置空
+    FOnnxRuntime* Runtime = Worker->Owner;
+    {
+        FScopeLock Lock(&Runtime->threadsMutex_);
+        Runtime->liveThreads_.Remove(Worker);
+        Runtime->finishedThreadStats_.Add(Worker->GetStats());
+        if (Runtime->finishedThreadStats_.Num() > MaxFinishedThreadStats)
+        {
+            Runtime->FoldFinishedThreadStats(Runtime->finishedThreadStats_[0]);
+            Runtime->finishedThreadStats_.RemoveAt(0);
+        }
+    }
+
+    delete Worker->Thread;
+    delete Worker;
+}
+
+void FOnnxRuntime::FoldFinishedThreadStats(const FOnnxWorkerThreadStats& Stat)
+{
+    if (numFoldedThreads_ == 0)
+    {
+        foldedThreadStats_.BusySeconds = 0.0;
+    }
+    ++numFoldedThreads_;
+    foldedFirstIndex_ = FMath::Min(foldedFirstIndex_, Stat.Index);
+    foldedLastIndex_ = FMath::Max(foldedLastIndex_, Stat.Index);
+
+    foldedThreadStats_.Name = FString::Printf(TEXT("%d earlier exited threads"), numFoldedThreads_);
+    foldedThreadStats_.WallSeconds += Stat.WallSeconds;
+    foldedThreadStats_.BusySeconds = (foldedThreadStats_.BusySeconds >= 0.0 && Stat.BusySeconds >= 0.0) ? foldedThreadStats_.BusySeconds + Stat.BusySeconds : -1.0;
+}
+
+TArray<FOnnxWorkerThreadStats> FOnnxRuntime::GetWorkerThreadStats() const
+{
+    FScopeLock Lock(&threadsMutex_);
+
+    TArray<FOnnxWorkerThreadStats> Stats;
+    if (numFoldedThreads_ > 0)
+    {
+        Stats.Add(foldedThreadStats_);
+    }
+    Stats.Append(finishedThreadStats_);
+    for (const FOnnxWorkerThread* Worker : liveThreads_)
+    {
+        Stats.Add(Worker->GetStats());
+    }
+    return Stats;
+}
+
+int32 FOnnxRuntime::GetNextWorkerThreadIndex() const
+{
+    FScopeLock Lock(&threadsMutex_);
+    return nextThreadIndex_;
+}
+
+double FOnnxRuntime::GetWorkerCpuSeconds(int32 FirstIndex, int32 EndIndex) const
+{
+    // 基准测试在每次Run前后调用，不复制线程名称
+    FScopeLock Lock(&threadsMutex_);
+
+    // 合并后的旧线程只能整体计入：区间覆盖它们全部时才计入（整个线程池的统计），否则它们不属于区间内的会话
+    double Total = 0.0;
+    if (numFoldedThreads_ > 0 && foldedFirstIndex_ >= FirstIndex && foldedLastIndex_ < EndIndex)
+    {
+        if (foldedThreadStats_.BusySeconds < 0.0)
+        {
+            return -1.0;
+        }
+        Total += foldedThreadStats_.BusySeconds;
+    }
+    for (const FOnnxWorkerThreadStats& Stat : finishedThreadStats_)
+    {
+        if (Stat.Index >= FirstIndex && Stat.Index < EndIndex)
+        {
+            if (Stat.BusySeconds < 0.0)
+            {
+                return -1.0;
+            }
+            Total += Stat.BusySeconds;
+        }
+    }
+    for (const FOnnxWorkerThread* Worker : liveThreads_)
+    {
+        if (Worker->Index >= FirstIndex && Worker->Index < EndIndex)
+        {
+            const double BusySeconds = Worker->GetBusySeconds();
+            if (BusySeconds < 0.0)
+            {
+                return -1.0;
+            }
+            Total += BusySeconds;
+        }
+    }
+    return Total;
+}
+
+double FOnnxRuntime::GetCurrentThreadCpuSeconds()
+{
+#if PLATFORM_WINDOWS
+    FILETIME CreationTime, ExitTime, KernelTime, UserTime;
+    if (GetThreadTimes(GetCurrentThread(), &CreationTime, &ExitTime, &KernelTime, &UserTime))
+    {
+        const uint64 Kernel = (uint64(KernelTime.dwHighDateTime) << 32) | KernelTime.dwLowDateTime;
+        const uint64 User = (uint64(UserTime.dwHighDateTime) << 32) | UserTime.dwLowDateTime;
+        return double(Kernel + User) * 1e-7;
+    }
+#elif PLATFORM_LINUX
+    timespec Time;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &Time) == 0)
+    {
+        return double(Time.tv_sec) + double(Time.tv_nsec) * 1e-9;
+    }
+#endif
+    return -1.0;
+}
+
+void FOnnxRuntime::LogWorkerThreadStats() const
+{
+    const TArray<FOnnxWorkerThreadStats> Stats = GetWorkerThreadStats();
+    int32 NumThreads;
+    {
+        FScopeLock Lock(&threadsMutex_);
+        NumThreads = liveThreads_.Num() + finishedThreadStats_.Num() + numFoldedThreads_;
+    }
+    UE_LOG(LogTemp, Log, TEXT("=== ONNX worker threads: %d ==="), NumThreads);
+
+    for (const FOnnxWorkerThreadStats& Stat : Stats)
+    {
+        const double Utilization = (Stat.WallSeconds > 0.0 && Stat.BusySeconds >= 0.0) ? Stat.BusySeconds / Stat.WallSeconds * 100.0 : 0.0;
+        UE_LOG(LogTemp, Log, TEXT("%s: %s, wall=%.3fs, busy=%.3fs, idle=%.3fs, utilization=%.1f%%"),
+               *Stat.Name, Stat.bRunning ? TEXT("running") : TEXT("exited"),
+               Stat.WallSeconds, Stat.BusySeconds, Stat.GetIdleSeconds(), Utilization);
+    }
+}
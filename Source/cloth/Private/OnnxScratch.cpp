@@ -0,0 +1,282 @@
+// OnnxScratch.cpp
+
+#include "OnnxScratch.h"
+#include "OnnxHalf.h"
+#include "HAL/MemoryBase.h"
+
+namespace
+{
+    std::atomic<int64> GTotalSteadyStateViolations{0};
+
+#if ONNX_TRACK_ALLOCATIONS
+    // 当前线程上嵌套的统计作用域数，以及作用域内的分配次数
+    thread_local int32 GTrackingDepth = 0;
+    thread_local int64 GThreadAllocations = 0;
+
+    /**
+     * 包装GMalloc的计数代理：只在统计作用域内计数，其余调用原样转发。
+     * 安装之前由原分配器分配的内存仍由原分配器释放，因为所有调用最终都转发给它。
+     */
+    class FOnnxCountingMalloc final : public FMalloc
+    {
+    public:
+        explicit FOnnxCountingMalloc(FMalloc* InInner)
+            : Inner(InInner)
+        {
+        }
+
+        virtual void* Malloc(SIZE_T Size, uint32 Alignment) override
+        {
+            Count();
+            return Inner->Malloc(Size, Alignment);
+        }
+
+        virtual void* TryMalloc(SIZE_T Size, uint32 Alignment) override
+        {
+            Count();
+            return Inner->TryMalloc(Size, Alignment);
+        }
+
+        virtual void* Realloc(void* Ptr, SIZE_T NewSize, uint32 Alignment) override
+        {
+            // 任何大小变化都可能移动内存块，按一次分配计
+            if (NewSize > 0)
+            {
+                Count();
+            }
+            return Inner->Realloc(Ptr, NewSize, Alignment);
+        }
+
+        virtual void* TryRealloc(void* Ptr, SIZE_T NewSize, uint32 Alignment) override
+        {
+            if (NewSize > 0)
+            {
+                Count();
+            }
+            return Inner->TryRealloc(Ptr, NewSize, Alignment);
+        }
+
+        virtual void Free(void* Ptr) override { Inner->Free(Ptr); }
+        virtual SIZE_T QuantizeSize(SIZE_T Size, uint32 Alignment) override { return Inner->QuantizeSize(Size, Alignment); }
+        virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override { return Inner->GetAllocationSize(Original, SizeOut); }
+        virtual void Trim(bool bTrimThreadCaches) override { Inner->Trim(bTrimThreadCaches); }
+        virtual void SetupTLSCachesOnCurrentThread() override { Inner->SetupTLSCachesOnCurrentThread(); }
+        virtual void ClearAndDisableTLSCachesOnCurrentThread() override { Inner->ClearAndDisableTLSCachesOnCurrentThread(); }
+        virtual void InitializeStatsMetadata() override { Inner->InitializeStatsMetadata(); }
+        virtual void UpdateStats() override { Inner->UpdateStats(); }
+        virtual void GetAllocatorStats(FGenericMemoryStats& OutStats) override { Inner->GetAllocatorStats(OutStats); }
+        virtual void DumpAllocatorStats(FOutputDevice& Ar) override { Inner->DumpAllocatorStats(Ar); }
+        virtual bool IsInternallyThreadSafe() const override { return Inner->IsInternallyThreadSafe(); }
+        virtual bool ValidateHeap() override { return Inner->ValidateHeap(); }
+        virtual const TCHAR* GetDescriptiveName() override { return TEXT("OnnxCountingMalloc"); }
+
+    private:
+        static void Count()
+        {
+            if (GTrackingDepth > 0)
+            {
+                ++GThreadAllocations;
+            }
+        }
+
+        FMalloc* Inner;
+    };
+
+    bool GCountingMallocInstalled = false;
+#endif
+}
+
+bool FOnnxAllocationCounter::IsEnabled()
+{
+    return ONNX_TRACK_ALLOCATIONS != 0;
+}
+
+void FOnnxAllocationCounter::InstallTracking()
+{
+#if ONNX_TRACK_ALLOCATIONS
+    check(IsInGameThread());
+    if (GCountingMallocInstalled)
+    {
+        return;
+    }
+    GCountingMallocInstalled = true;
+
+    // 代理一直保留（其他线程可能仍持有经由它分配的内存）。替换发生在模块启动时，
+    // 此时还没有推理线程；引擎的其他线程在替换前后分别经由原分配器或代理分配，两者最终都转发到同一个分配器，
+    // 内存屏障保证其他线程读到新指针时代理已经构造完成
+    check(GMalloc);
+    FMalloc* proxy = new FOnnxCountingMalloc(GMalloc);
+    FPlatformMisc::MemoryBarrier();
+    GMalloc = proxy;
+    UE_LOG(LogTemp, Log, TEXT("ONNX allocation tracking enabled"));
+#endif
+}
+
+void FOnnxAllocationCounter::Record(int64 NumAllocations, const TCHAR* Name)
+{
+    const int64 runIndex = numRuns_++;
+    lastRunAllocations_ = NumAllocations;
+
+    if (runIndex < warmupEndRun_ || NumAllocations == 0)
+    {
+        return;
+    }
+
+    ++numSteadyStateViolations_;
+    ++GTotalSteadyStateViolations;
+
+    int64 currentMax = maxSteadyStateAllocations_.load();
+    while (NumAllocations > currentMax && !maxSteadyStateAllocations_.compare_exchange_weak(currentMax, NumAllocations))
+    {
+    }
+
+    if (!bWarned_.exchange(true))
+    {
+        UE_LOG(LogTemp, Warning, TEXT("%s: %lld heap allocations in steady-state request %lld (expected 0)"), Name, NumAllocations, runIndex + 1);
+    }
+}
+
+FOnnxAllocationStats FOnnxAllocationCounter::GetStats() const
+{
+    FOnnxAllocationStats Stats;
+    Stats.NumRuns = numRuns_;
+    Stats.LastRunAllocations = lastRunAllocations_;
+    Stats.MaxSteadyStateAllocations = maxSteadyStateAllocations_;
+    Stats.NumSteadyStateViolations = numSteadyStateViolations_;
+    return Stats;
+}
+
+void FOnnxAllocationCounter::Reset()
+{
+    numRuns_ = 0;
+    warmupEndRun_ = WarmupRuns;
+    lastRunAllocations_ = 0;
+    maxSteadyStateAllocations_ = 0;
+    numSteadyStateViolations_ = 0;
+    bWarned_ = false;
+}
+
+void FOnnxAllocationCounter::RestartWarmup()
+{
+    warmupEndRun_ = numRuns_.load() + WarmupRuns;
+}
+
+int64 FOnnxAllocationCounter::GetTotalSteadyStateViolations()
+{
+    return GTotalSteadyStateViolations;
+}
+
+FOnnxAllocationCounter::FRunScope::FRunScope(FOnnxAllocationCounter& InCounter, const TCHAR* InName)
+    : Counter(InCounter)
+    , Name(InName)
+{
+#if ONNX_TRACK_ALLOCATIONS
+    ++GTrackingDepth;
+    StartCount = GThreadAllocations;
+#endif
+}
+
+FOnnxAllocationCounter::FRunScope::~FRunScope()
+{
+#if ONNX_TRACK_ALLOCATIONS
+    const int64 numAllocations = GThreadAllocations - StartCount;
+    --GTrackingDepth;
+    Counter.Record(numAllocations, Name);
+#endif
+}
+
+FOnnxAllocationCounter::FUntrackedScope::FUntrackedScope()
+{
+#if ONNX_TRACK_ALLOCATIONS
+    SavedDepth = GTrackingDepth;
+    GTrackingDepth = 0;
+#endif
+}
+
+FOnnxAllocationCounter::FUntrackedScope::~FUntrackedScope()
+{
+#if ONNX_TRACK_ALLOCATIONS
+    GTrackingDepth = SavedDepth;
+#endif
+}
+
+int64 FOnnxOutputSlot::GetElementCount() const
+{
+    int64 count = 1;
+    for (int64 dim : Shape)
+    {
+        count *= dim;
+    }
+    return count;
+}
+
+bool FOnnxOutputSlot::Capture(const Ort::Value& Output)
+{
+    Reset();
+    if (!Output.IsTensor())
+    {
+        return false;
+    }
+
+    Ort::TensorTypeAndShapeInfo info = Output.GetTensorTypeAndShapeInfo();
+    const ONNXTensorElementDataType elementType = info.GetElementType();
+    if (elementType != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT && elementType != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16)
+    {
+        return false;
+    }
+
+    for (int64_t dim : info.GetShape())
+    {
+        Shape.Add(dim);
+    }
+    Type = elementType;
+    return true;
+}
+
+Ort::Value FOnnxOutputSlot::Bind(const Ort::MemoryInfo& MemoryInfo, TArray<float>& Dst)
+{
+    const int64 count = GetElementCount();
+    const int64_t* shape = reinterpret_cast<const int64_t*>(Shape.GetData());
+    if (Type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT)
+    {
+        Dst.SetNumUninitialized(count);
+        return Ort::Value::CreateTensor<float>(MemoryInfo, Dst.GetData(), count, shape, Shape.Num());
+    }
+    HalfScratch.SetNumUninitialized(count);
+    return Ort::Value::CreateTensor(MemoryInfo, HalfScratch.GetData(), count * sizeof(uint16), shape, Shape.Num(), ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16);
+}
+
+Ort::Value FOnnxOutputSlot::Bind(const Ort::MemoryInfo& MemoryInfo, TArray<uint16>& Dst)
+{
+    const int64 count = GetElementCount();
+    const int64_t* shape = reinterpret_cast<const int64_t*>(Shape.GetData());
+    if (Type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16)
+    {
+        Dst.SetNumUninitialized(count);
+        return Ort::Value::CreateTensor(MemoryInfo, Dst.GetData(), count * sizeof(uint16), shape, Shape.Num(), ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16);
+    }
+    FloatScratch.SetNumUninitialized(count);
+    return Ort::Value::CreateTensor<float>(MemoryInfo, FloatScratch.GetData(), count, shape, Shape.Num());
+}
+
+void FOnnxOutputSlot::Finish(TArray<float>& Dst) const
+{
+    if (Type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16)
+    {
+        FOnnxHalf::ConvertToFloat(HalfScratch, Dst);
+    }
+}
+
+void FOnnxOutputSlot::Finish(TArray<uint16>& Dst) const
+{
+    if (Type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT)
+    {
+        FOnnxHalf::ConvertToHalf(FloatScratch, Dst);
+    }
+}
+
+void FOnnxOutputSlot::Reset()
+{
+    Shape.Reset();
+    Type = ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+}
@@ -0,0 +1,76 @@
+// OnnxSessionSettings.cpp
+
+#include "OnnxSessionSettings.h"
+#include "OnnxRuntime.h"
+#include "OnnxExecutionProviders.h"
+
+OnnxCore::FSessionConfig FOnnxSessionSettings::ToCoreConfig() const
+{
+    OnnxCore::FSessionConfig Config;
+    Config.IntraOpThreads = GetEffectiveIntraOpThreads();
+    Config.InterOpThreads = InterOpThreads;
+    Config.bParallel = ExecutionMode == EOnnxExecutionMode::Parallel;
+
+    switch (SpinMode)
+    {
+    case EOnnxSpinMode::SpinThenStop: Config.SpinMode = OnnxCore::ESpinMode::SpinThenStop; break;
+    case EOnnxSpinMode::NoSpin:       Config.SpinMode = OnnxCore::ESpinMode::NoSpin; break;
+    case EOnnxSpinMode::Default:
+    default:                          Config.SpinMode = OnnxCore::ESpinMode::Default; break;
+    }
+
+    // 未单独配置逐线程亲和性时使用全局配置（线程配置在ORT加载失败时也已读取，这里不需要Env）
+    const FString& Affinities = IntraOpThreadAffinities.IsEmpty()
+        ? FOnnxRuntime::Get().GetThreadingSettings().IntraOpThreadAffinities
+        : IntraOpThreadAffinities;
+    Config.IntraOpThreadAffinities = TCHAR_TO_UTF8(*Affinities);
+
+    Quantization.ApplyTo(Config);
+    return Config;
+}
+
+int32 FOnnxSessionSettings::GetEffectiveIntraOpThreads() const
+{
+    return bLowPriorityThreads ? FMath::Max(1, IntraOpThreads / 2) : IntraOpThreads;
+}
+
+void FOnnxSessionSettings::ApplyTo(Ort::SessionOptions& SessionOptions) const
+{
+    // 线程、执行模式、自旋策略和量化选项由OnnxCore写入
+    ToCoreConfig().ApplyTo(SessionOptions);
+
+    // 不可用的EP会抛出Ort::Exception，由调用方回退到默认CPU EP
+    FOnnxExecutionProviders::AppendTo(SessionOptions, ExecutionProvider, GetEffectiveIntraOpThreads());
+}
+
+void FOnnxQuantizationSettings::ApplyTo(OnnxCore::FSessionConfig& Config) const
+{
+    Config.bDisableQDQFusion = bDisableQDQFusion;
+    Config.bEnableQDQCleanup = bEnableQDQCleanup;
+    Config.bDisableDoubleQDQRemover = bDisableDoubleQDQRemover;
+    Config.bAvx2PrecisionMode = bAvx2PrecisionMode;
+    Config.MatMulNBitsAccuracyLevel = MatMulNBitsAccuracyLevel;
+}
+
+FString FOnnxSessionSettings::ToString() const
+{
+    const UEnum* SpinEnum = StaticEnum<EOnnxSpinMode>();
+    const FString SpinName = SpinEnum ? SpinEnum->GetNameStringByValue(static_cast<int64>(SpinMode)) : TEXT("?");
+
+    FString Result = ExecutionMode == EOnnxExecutionMode::Parallel
+        ? FString::Printf(TEXT("intra=%d, inter=%d, parallel, spin=%s"), IntraOpThreads, InterOpThreads, *SpinName)
+        : FString::Printf(TEXT("intra=%d, spin=%s"), IntraOpThreads, *SpinName);
+    if (ExecutionProvider != EOnnxExecutionProvider::CPU)
+    {
+        Result += FString::Printf(TEXT(", ep=%s"), FOnnxExecutionProviders::GetDisplayName(ExecutionProvider));
+    }
+    if (ReplicasPerNumaNode > 0)
+    {
+        Result += FString::Printf(TEXT(", replicas/node=%d"), ReplicasPerNumaNode);
+    }
+    if (bLowPriorityThreads)
+    {
+        Result += FString::Printf(TEXT(", low priority (intra=%d)"), GetEffectiveIntraOpThreads());
+    }
+    return Result;
+}
@@ -0,0 +1,203 @@
+// OnnxShadow.cpp
+
+#include "OnnxShadow.h"
+#include "OnnxTuning.h"
+#include "Async/Async.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/ScopeLock.h"
+
+namespace
+{
+    // 保留用于计算P95的最近延迟差样本数
+    constexpr int32 MaxLatencySamples = 4096;
+}
+
+FString FOnnxShadowReport::ToString() const
+{
+    FString Result = FString::Printf(TEXT("compared=%d dropped=%d failed=%d production=%.2fms candidate=%.2fms delta=%+.2fms (p95 %+.2fms) relL2=%.4f (max %.4f)"),
+                                     NumCompared, NumDropped, NumFailed, ProductionMeanMs, CandidateMeanMs,
+                                     MeanLatencyDeltaMs, P95LatencyDeltaMs, MeanRelativeL2, MaxRelativeL2);
+    if (MeanMaskIoU >= 0.0f)
+    {
+        Result += FString::Printf(TEXT(" maskIoU=%.4f (min %.4f)"), MeanMaskIoU, MinMaskIoU);
+    }
+    return Result;
+}
+
+FOnnxShadowRunner::FOnnxShadowRunner(const FOnnxShadowConfig& InConfig)
+    : config_(InConfig)
+{
+    config_.MaxInFlight = FMath::Max(1, config_.MaxInFlight);
+}
+
+FOnnxShadowRunner::~FOnnxShadowRunner()
+{
+    // 等待进行中的影子任务，它们引用了候选模型和本对象
+    while (inFlight_ > 0)
+    {
+        FPlatformProcess::Sleep(0.001f);
+    }
+}
+
+bool FOnnxShadowRunner::ShouldMirror()
+{
+    // onnx.Shadow.SampleRate可以在运行时覆盖配置的采样率
+    if (!config_.bEnabled || FMath::FRand() >= FOnnxTuning::GetShadowSampleRate(config_.SampleRate))
+    {
+        return false;
+    }
+
+    // 占用一个影子名额，已满时丢弃（不排队，避免影子流量堆积）
+    int32 current = inFlight_.load();
+    do
+    {
+        if (current >= config_.MaxInFlight)
+        {
+            ++numDropped_;
+            return false;
+        }
+    }
+    while (!inFlight_.compare_exchange_weak(current, current + 1));
+
+    return true;
+}
+
+void FOnnxShadowRunner::Submit(double ProductionSeconds, FCandidateJob Job)
+{
+    // 后台线程上的低优先级任务，排在其他后台任务之后，不与游戏线程和生产推理争抢工作线程
+    AsyncTask(ENamedThreads::SetTaskPriority(ENamedThreads::AnyBackgroundThreadNormalTask, ENamedThreads::LowTaskPriority), [this, ProductionSeconds, Job = MoveTemp(Job)]()
+    {
+        FOnnxShadowSample Sample;
+        Sample.ProductionSeconds = ProductionSeconds;
+        Job(Sample);
+
+        RecordSample(Sample);
+        --inFlight_;
+    });
+}
+
+void FOnnxShadowRunner::RecordSample(const FOnnxShadowSample& Sample)
+{
+    FScopeLock Lock(&statsMutex_);
+
+    if (!Sample.bSucceeded || Sample.RelativeL2 < 0.0f)
+    {
+        ++numFailed_;
+        return;
+    }
+
+    ++numCompared_;
+    sumProductionSeconds_ += Sample.ProductionSeconds;
+    sumCandidateSeconds_ += Sample.CandidateSeconds;
+    sumRelativeL2_ += Sample.RelativeL2;
+    maxRelativeL2_ = FMath::Max(maxRelativeL2_, Sample.RelativeL2);
+
+    if (Sample.MaskIoU >= 0.0f)
+    {
+        ++numMaskSamples_;
+        sumMaskIoU_ += Sample.MaskIoU;
+        minMaskIoU_ = FMath::Min(minMaskIoU_, Sample.MaskIoU);
+    }
+
+    const float DeltaMs = static_cast<float>((Sample.CandidateSeconds - Sample.ProductionSeconds) * 1000.0);
+    if (latencyDeltasMs_.Num() < MaxLatencySamples)
+    {
+        latencyDeltasMs_.Add(DeltaMs);
+    }
+    else
+    {
+        latencyDeltasMs_[deltaCursor_] = DeltaMs;
+        deltaCursor_ = (deltaCursor_ + 1) % MaxLatencySamples;
+    }
+}
+
+FOnnxShadowReport FOnnxShadowRunner::GetReport() const
+{
+    FScopeLock Lock(&statsMutex_);
+
+    FOnnxShadowReport Report;
+    Report.NumCompared = numCompared_;
+    Report.NumDropped = numDropped_;
+    Report.NumFailed = numFailed_;
+
+    if (numCompared_ > 0)
+    {
+        Report.ProductionMeanMs = static_cast<float>(sumProductionSeconds_ * 1000.0 / numCompared_);
+        Report.CandidateMeanMs = static_cast<float>(sumCandidateSeconds_ * 1000.0 / numCompared_);
+        Report.MeanLatencyDeltaMs = Report.CandidateMeanMs - Report.ProductionMeanMs;
+        Report.MeanRelativeL2 = static_cast<float>(sumRelativeL2_ / numCompared_);
+        Report.MaxRelativeL2 = maxRelativeL2_;
+
+        TArray<float> Sorted = latencyDeltasMs_;
+        Sorted.Sort();
+        Report.P95LatencyDeltaMs = Sorted[FMath::Min(Sorted.Num() - 1, FMath::FloorToInt(Sorted.Num() * 0.95f))];
+    }
+
+    if (numMaskSamples_ > 0)
+    {
+        Report.MeanMaskIoU = static_cast<float>(sumMaskIoU_ / numMaskSamples_);
+        Report.MinMaskIoU = minMaskIoU_;
+    }
+    return Report;
+}
+
+void FOnnxShadowRunner::LogReport() const
+{
+    UE_LOG(LogTemp, Log, TEXT("Shadow comparison: %s"), *GetReport().ToString());
+}
+
+void FOnnxShadowRunner::ResetReport()
+{
+    FScopeLock Lock(&statsMutex_);
+
+    numDropped_ = 0;
+    numCompared_ = 0;
+    numFailed_ = 0;
+    sumProductionSeconds_ = 0.0;
+    sumCandidateSeconds_ = 0.0;
+    sumRelativeL2_ = 0.0;
+    maxRelativeL2_ = 0.0f;
+    numMaskSamples_ = 0;
+    sumMaskIoU_ = 0.0;
+    minMaskIoU_ = 1.0f;
+    latencyDeltasMs_.Reset();
+    deltaCursor_ = 0;
+}
+
+float FOnnxShadowRunner::ComputeRelativeL2(const TArray<float>& Candidate, const TArray<float>& Production)
+{
+    if (Candidate.Num() != Production.Num())
+    {
+        return -1.0f;
+    }
+
+    double DiffSquared = 0.0;
+    double NormSquared = 0.0;
+    for (int32 i = 0; i < Production.Num(); ++i)
+    {
+        const double Diff = double(Candidate[i]) - double(Production[i]);
+        DiffSquared += Diff * Diff;
+        NormSquared += double(Production[i]) * double(Production[i]);
+    }
+    return static_cast<float>(FMath::Sqrt(DiffSquared) / FMath::Max(FMath::Sqrt(NormSquared), 1e-12));
+}
+
+float FOnnxShadowRunner::ComputeMaskIoU(const TArray<float>& Candidate, const TArray<float>& Production, float Threshold)
+{
+    if (Candidate.Num() != Production.Num())
+    {
+        return 0.0f;
+    }
+
+    int64 Intersection = 0;
+    int64 Union = 0;
+    for (int32 i = 0; i < Production.Num(); ++i)
+    {
+        const bool bCandidate = Candidate[i] > Threshold;
+        const bool bProduction = Production[i] > Threshold;
+        Intersection += (bCandidate && bProduction) ? 1 : 0;
+        Union += (bCandidate || bProduction) ? 1 : 0;
+    }
+    return Union > 0 ? static_cast<float>(double(Intersection) / double(Union)) : 1.0f;
+}
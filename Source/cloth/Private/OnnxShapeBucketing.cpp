@@ -0,0 +1,415 @@
+// OnnxShapeBucketing.cpp
+
+#include "OnnxShapeBucketing.h"
+#include "Misc/ScopeLock.h"
+
+// 形状以TArray<int64>保存，传给ORT时按int64_t解释
+static_assert(sizeof(int64) == sizeof(int64_t), "int64 and int64_t must have the same size");
+
+namespace
+{
+    const int64_t* ToOrtShape(TConstArrayView<int64> Shape)
+    {
+        return reinterpret_cast<const int64_t*>(Shape.GetData());
+    }
+
+    int64 GetElementCount(TConstArrayView<int64> Shape)
+    {
+        int64 Count = 1;
+        for (int64 Dim : Shape)
+        {
+            Count *= Dim;
+        }
+        return Count;
+    }
+
+    bool ShapesEqual(TConstArrayView<int64> A, TConstArrayView<int64> B)
+    {
+        return A.Num() == B.Num() && FMemory::Memcmp(A.GetData(), B.GetData(), A.Num() * sizeof(int64)) == 0;
+    }
+
+    FString MakeBucketKey(TConstArrayView<int64> Shape)
+    {
+        TArray<FString> Dims;
+        for (int64 Dim : Shape)
+        {
+            Dims.Add(LexToString(Dim));
+        }
+        return FString::Join(Dims, TEXT("x"));
+    }
+
+    size_t GetMaskElementSize(ONNXTensorElementDataType Type)
+    {
+        switch (Type)
+        {
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64: return sizeof(int64);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32: return sizeof(int32);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT: return sizeof(float);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL:  return sizeof(bool);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8: return sizeof(uint8);
+        default:                                  return 0;
+        }
+    }
+
+    // 持有桶的使用权，异常时也能释放
+    struct FBucketUseGuard
+    {
+        FCriticalSection& Lock;
+        ~FBucketUseGuard() { Lock.Unlock(); }
+    };
+}
+
+void FOnnxShapeBucketCache::Initialize(const FOnnxShapeBucketingPolicy& InPolicy, Ort::Session& Session,
+                                       ONNXTensorElementDataType InputType, ONNXTensorElementDataType OutputType)
+{
+    Reset();
+    policy_ = InPolicy;
+    maskInputName_.clear();
+    maskElementType_ = ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+    maskRank_ = 0;
+
+    // 桶的输入/输出缓冲区都是float，其他类型的模型按原形状运行（由调用方负责类型转换）
+    if (policy_.bEnabled && (InputType != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT || OutputType != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT))
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Shape bucketing is disabled: only float32 inputs and outputs are supported (input type %d, output type %d)"),
+               static_cast<int32>(InputType), static_cast<int32>(OutputType));
+        policy_.bEnabled = false;
+        return;
+    }
+
+    for (FOnnxBucketedDimension& Dimension : policy_.Dimensions)
+    {
+        Dimension.BucketSizes.Sort();
+        maskRank_ = FMath::Max(maskRank_, Dimension.InputAxis + 1);
+    }
+
+    if (!IsEnabled() || policy_.MaskInputName.IsEmpty())
+    {
+        return;
+    }
+
+    Ort::AllocatorWithDefaultOptions allocator;
+    for (size_t i = 0; i < Session.GetInputCount(); ++i)
+    {
+        auto inputName = Session.GetInputNameAllocated(i, allocator);
+        if (policy_.MaskInputName != UTF8_TO_TCHAR(inputName.get()))
+        {
+            continue;
+        }
+
+        // TypeInfo持有元数据，必须比tensorInfo活得更久
+        Ort::TypeInfo typeInfo = Session.GetInputTypeInfo(i);
+        auto tensorInfo = typeInfo.GetTensorTypeAndShapeInfo();
+        const ONNXTensorElementDataType elementType = tensorInfo.GetElementType();
+        if (GetMaskElementSize(elementType) == 0)
+        {
+            UE_LOG(LogTemp, Warning, TEXT("Shape bucketing: unsupported element type %d for mask input %s"),
+                   static_cast<int32>(elementType), *policy_.MaskInputName);
+            return;
+        }
+
+        maskInputName_ = inputName.get();
+        maskElementType_ = elementType;
+        maskRank_ = FMath::Max(maskRank_, static_cast<int32>(tensorInfo.GetDimensionsCount()));
+        return;
+    }
+
+    UE_LOG(LogTemp, Warning, TEXT("Shape bucketing: mask input %s not found in the model"), *policy_.MaskInputName);
+}
+
+bool FOnnxShapeBucketCache::ComputeBucketShape(TConstArrayView<int64> Shape, FOnnxInlineShape& OutBucketShape) const
+{
+    OutBucketShape.Reset();
+    OutBucketShape.Append(Shape.GetData(), Shape.Num());
+    bool bInBucket = false;
+
+    for (const FOnnxBucketedDimension& Dimension : policy_.Dimensions)
+    {
+        if (!Shape.IsValidIndex(Dimension.InputAxis) || Dimension.BucketSizes.Num() == 0)
+        {
+            continue;
+        }
+
+        // 超出最大桶的维度保留实际大小会让每个不同的形状都创建一个新桶，整个请求改为不分桶
+        const int64 Actual = Shape[Dimension.InputAxis];
+        if (Actual > Dimension.BucketSizes.Last())
+        {
+            return false;
+        }
+
+        for (int32 BucketSize : Dimension.BucketSizes)
+        {
+            if (BucketSize >= Actual)
+            {
+                OutBucketShape[Dimension.InputAxis] = BucketSize;
+                bInBucket = true;
+                break;
+            }
+        }
+    }
+
+    return bInBucket;
+}
+
+FOnnxShapeBucket& FOnnxShapeBucketCache::FindOrCreateBucket(TConstArrayView<int64> BucketShape)
+{
+    FScopeLock Lock(&bucketsMutex_);
+
+    for (const TUniquePtr<FOnnxShapeBucket>& Existing : buckets_)
+    {
+        if (ShapesEqual(Existing->InputShape, BucketShape))
+        {
+            return *Existing;
+        }
+    }
+
+    TUniquePtr<FOnnxShapeBucket> Bucket = MakeUnique<FOnnxShapeBucket>();
+    Bucket->InputShape = TArray<int64>(BucketShape.GetData(), BucketShape.Num());
+    Bucket->InputBuffer.SetNumZeroed(GetElementCount(BucketShape));
+
+    Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+    Bucket->InputTensors[0] = Ort::Value::CreateTensor<float>(memoryInfo, Bucket->InputBuffer.GetData(), Bucket->InputBuffer.Num(),
+                                                          ToOrtShape(BucketShape), BucketShape.Num());
+
+    if (!maskInputName_.empty())
+    {
+        for (int32 Axis = 0; Axis < FMath::Min(maskRank_, BucketShape.Num()); ++Axis)
+        {
+            Bucket->MaskShape.Add(BucketShape[Axis]);
+        }
+        const size_t MaskBytes = GetElementCount(Bucket->MaskShape) * GetMaskElementSize(maskElementType_);
+        Bucket->MaskBuffer.SetNumZeroed(MaskBytes);
+        Bucket->InputTensors[1] = Ort::Value::CreateTensor(memoryInfo, Bucket->MaskBuffer.GetData(), MaskBytes,
+                                                      ToOrtShape(Bucket->MaskShape), Bucket->MaskShape.Num(), maskElementType_);
+    }
+
+    UE_LOG(LogTemp, Log, TEXT("Shape bucketing: created bucket %s"), *MakeBucketKey(BucketShape));
+
+    FOnnxShapeBucket& Result = *Bucket;
+    buckets_.Add(MoveTemp(Bucket));
+    return Result;
+}
+
+void FOnnxShapeBucketCache::FillMask(FOnnxShapeBucket& Bucket, TConstArrayView<int64> ActualShape) const
+{
+    const int32 Rank = Bucket.MaskShape.Num();
+    const int64 Count = GetElementCount(Bucket.MaskShape);
+    uint8* Data = Bucket.MaskBuffer.GetData();
+
+    FOnnxInlineShape Index;
+    Index.SetNumZeroed(Rank);
+
+    for (int64 Flat = 0; Flat < Count; ++Flat)
+    {
+        bool bValid = true;
+        for (int32 Axis = 0; Axis < Rank && bValid; ++Axis)
+        {
+            bValid = Index[Axis] < ActualShape[Axis];
+        }
+
+        switch (maskElementType_)
+        {
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64: reinterpret_cast<int64*>(Data)[Flat] = bValid ? 1 : 0; break;
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32: reinterpret_cast<int32*>(Data)[Flat] = bValid ? 1 : 0; break;
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT: reinterpret_cast<float*>(Data)[Flat] = bValid ? 1.0f : 0.0f; break;
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL:  reinterpret_cast<bool*>(Data)[Flat] = bValid; break;
+        default:                                  Data[Flat] = bValid ? 1 : 0; break;
+        }
+
+        // 行主序递增下标
+        for (int32 Axis = Rank - 1; Axis >= 0; --Axis)
+        {
+            if (++Index[Axis] < Bucket.MaskShape[Axis])
+            {
+                break;
+            }
+            Index[Axis] = 0;
+        }
+    }
+}
+
+bool FOnnxShapeBucketCache::TryRun(Ort::Session& Session, const char* InputName, const char* OutputName,
+                                   const TArray<float>& InputData, TConstArrayView<int64> InputShape,
+                                   TArray<float>& OutputData, TArray<int64>& OutputShape)
+{
+    FOnnxInlineShape BucketShape;
+    if (!IsEnabled() || InputData.Num() != GetElementCount(InputShape) || !ComputeBucketShape(InputShape, BucketShape))
+    {
+        return false;
+    }
+
+    FOnnxShapeBucket& Bucket = FindOrCreateBucket(BucketShape);
+    if (!Bucket.InUse.TryLock())
+    {
+        return false;
+    }
+    FBucketUseGuard Guard{Bucket.InUse};
+
+    // 填充输入
+    if (ShapesEqual(BucketShape, InputShape))
+    {
+        FMemory::Memcpy(Bucket.InputBuffer.GetData(), InputData.GetData(), InputData.Num() * sizeof(float));
+    }
+    else
+    {
+        for (float& Value : Bucket.InputBuffer)
+        {
+            Value = policy_.PaddingValue;
+        }
+        CopyRegion(InputData.GetData(), InputShape, Bucket.InputBuffer.GetData(), BucketShape, InputShape);
+    }
+
+    const char* inputNames[2] = { InputName, maskInputName_.c_str() };
+    const Ort::Value* inputs = Bucket.InputTensors;
+    size_t inputCount = 1;
+    if (!maskInputName_.empty())
+    {
+        FillMask(Bucket, InputShape);
+        inputCount = 2;
+    }
+
+    Ort::RunOptions runOptions{nullptr};
+    bool bRan = false;
+    if (Bucket.OutputTensor)
+    {
+        try
+        {
+            Session.Run(runOptions, inputNames, inputs, inputCount, &OutputName, &Bucket.OutputTensor, 1);
+            bRan = true;
+        }
+        catch (const Ort::Exception& e)
+        {
+            // 同一个桶的输出形状随数据变化：预分配的输出不再适用，本次和以后都由ORT分配输出。
+            // 真正的错误会在下面的重新运行中再次抛出
+            UE_LOG(LogTemp, Warning, TEXT("Shape bucketing: preallocated output of bucket %s rejected, using ORT-allocated outputs: %s"),
+                   *MakeBucketKey(BucketShape), UTF8_TO_TCHAR(e.what()));
+            Bucket.OutputTensor = Ort::Value(nullptr);
+            Bucket.OutputBuffer.Empty();
+            Bucket.bVariableOutputShape = true;
+        }
+    }
+    if (!bRan)
+    {
+        // 由ORT分配输出；首次运行后按实际形状预分配该桶的输出缓冲区
+        std::vector<Ort::Value> outputs = Session.Run(runOptions, inputNames, inputs, inputCount, &OutputName, 1);
+        if (outputs.empty() || !outputs[0].IsTensor())
+        {
+            return false;
+        }
+        if (outputs[0].GetTensorTypeAndShapeInfo().GetElementType() != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT)
+        {
+            UE_LOG(LogTemp, Error, TEXT("Shape bucketing: output %s is not a float32 tensor"), UTF8_TO_TCHAR(OutputName));
+            return false;
+        }
+
+        const std::vector<int64_t> shape = outputs[0].GetTensorTypeAndShapeInfo().GetShape();
+        Bucket.OutputShape.Reset();
+        for (int64_t dim : shape)
+        {
+            Bucket.OutputShape.Add(dim);
+        }
+        Bucket.OutputBuffer.SetNumUninitialized(GetElementCount(Bucket.OutputShape));
+        FMemory::Memcpy(Bucket.OutputBuffer.GetData(), outputs[0].GetTensorData<float>(), Bucket.OutputBuffer.Num() * sizeof(float));
+
+        if (!Bucket.bVariableOutputShape)
+        {
+            Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+            Bucket.OutputTensor = Ort::Value::CreateTensor<float>(memoryInfo, Bucket.OutputBuffer.GetData(), Bucket.OutputBuffer.Num(),
+                                                                  ToOrtShape(Bucket.OutputShape), Bucket.OutputShape.Num());
+        }
+    }
+    ++Bucket.NumRuns;
+
+    // 把输出裁剪回实际形状
+    OutputShape.Reset();
+    OutputShape.Append(Bucket.OutputShape);
+    for (const FOnnxBucketedDimension& Dimension : policy_.Dimensions)
+    {
+        const int32 OutputAxis = Dimension.OutputAxis >= 0 ? Dimension.OutputAxis : Dimension.InputAxis;
+        if (OutputShape.IsValidIndex(OutputAxis) && InputShape.IsValidIndex(Dimension.InputAxis) && BucketShape[Dimension.InputAxis] > 0)
+        {
+            OutputShape[OutputAxis] = Bucket.OutputShape[OutputAxis] * InputShape[Dimension.InputAxis] / BucketShape[Dimension.InputAxis];
+        }
+    }
+
+    OutputData.SetNumUninitialized(GetElementCount(OutputShape));
+    CopyRegion(Bucket.OutputBuffer.GetData(), Bucket.OutputShape, OutputData.GetData(), OutputShape, OutputShape);
+    return true;
+}
+
+void FOnnxShapeBucketCache::Reset()
+{
+    FScopeLock Lock(&bucketsMutex_);
+    buckets_.Empty();
+}
+
+int32 FOnnxShapeBucketCache::GetNumBuckets() const
+{
+    FScopeLock Lock(&bucketsMutex_);
+    return buckets_.Num();
+}
+
+int64 FOnnxShapeBucketCache::GetBufferBytes() const
+{
+    FScopeLock Lock(&bucketsMutex_);
+
+    int64 Bytes = 0;
+    for (const TUniquePtr<FOnnxShapeBucket>& Bucket : buckets_)
+    {
+        Bytes += Bucket->InputBuffer.Num() * sizeof(float) + Bucket->MaskBuffer.Num() + Bucket->OutputBuffer.Num() * sizeof(float);
+    }
+    return Bytes;
+}
+
+void FOnnxShapeBucketCache::CopyRegion(const float* Src, TConstArrayView<int64> SrcShape, float* Dst, TConstArrayView<int64> DstShape, TConstArrayView<int64> Region)
+{
+    const int32 Rank = Region.Num();
+    if (Rank == 0)
+    {
+        *Dst = *Src;
+        return;
+    }
+
+    // 行主序的步长
+    FOnnxInlineShape SrcStrides, DstStrides;
+    SrcStrides.SetNum(Rank);
+    DstStrides.SetNum(Rank);
+    int64 SrcStride = 1, DstStride = 1;
+    for (int32 Axis = Rank - 1; Axis >= 0; --Axis)
+    {
+        SrcStrides[Axis] = SrcStride;
+        DstStrides[Axis] = DstStride;
+        SrcStride *= SrcShape[Axis];
+        DstStride *= DstShape[Axis];
+    }
+
+    // 逐行复制最后一个维度
+    const int64 RowLength = Region[Rank - 1];
+    int64 NumRows = 1;
+    for (int32 Axis = 0; Axis < Rank - 1; ++Axis)
+    {
+        NumRows *= Region[Axis];
+    }
+
+    FOnnxInlineShape Index;
+    Index.SetNumZeroed(Rank);
+    for (int64 Row = 0; Row < NumRows; ++Row)
+    {
+        int64 SrcOffset = 0, DstOffset = 0;
+        for (int32 Axis = 0; Axis < Rank - 1; ++Axis)
+        {
+            SrcOffset += Index[Axis] * SrcStrides[Axis];
+            DstOffset += Index[Axis] * DstStrides[Axis];
+        }
+        FMemory::Memcpy(Dst + DstOffset, Src + SrcOffset, RowLength * sizeof(float));
+
+        for (int32 Axis = Rank - 2; Axis >= 0; --Axis)
+        {
+            if (++Index[Axis] < Region[Axis])
+            {
+                break;
+            }
+            Index[Axis] = 0;
+        }
+    }
+}
@@ -0,0 +1,208 @@
+// OnnxStatefulSession.cpp
+
+#include "OnnxStatefulSession.h"
+#include "OnnxHalf.h"
+#include "Misc/ScopeLock.h"
+
+bool FOnnxStateBindings::Initialize(const TArray<FOnnxStateTensorPair>& InPairs, Ort::Session& Session)
+{
+    FScopeLock Lock(&mutex_);
+
+    states_.Reset();
+    current_ = 0;
+    stepCount_ = 0;
+
+    Ort::AllocatorWithDefaultOptions allocator;
+    auto findIndex = [&allocator](size_t Count, auto GetName, const FString& Name) -> int32
+    {
+        for (size_t i = 0; i < Count; ++i)
+        {
+            auto name = GetName(i, allocator);
+            if (Name == UTF8_TO_TCHAR(name.get()))
+            {
+                return static_cast<int32>(i);
+            }
+        }
+        return INDEX_NONE;
+    };
+
+    TArray<TUniquePtr<FState>> newStates;
+    for (const FOnnxStateTensorPair& Pair : InPairs)
+    {
+        const int32 inputIndex = findIndex(Session.GetInputCount(),
+            [&Session](size_t i, OrtAllocator* a) { return Session.GetInputNameAllocated(i, a); }, Pair.InputName);
+        const int32 outputIndex = findIndex(Session.GetOutputCount(),
+            [&Session](size_t i, OrtAllocator* a) { return Session.GetOutputNameAllocated(i, a); }, Pair.OutputName);
+        if (inputIndex == INDEX_NONE || outputIndex == INDEX_NONE)
+        {
+            UE_LOG(LogTemp, Error, TEXT("Stateful session: state pair %s -> %s not found in the model"), *Pair.InputName, *Pair.OutputName);
+            return false;
+        }
+
+        Ort::TypeInfo typeInfo = Session.GetInputTypeInfo(inputIndex);
+        auto inputInfo = typeInfo.GetTensorTypeAndShapeInfo();
+        if (inputInfo.GetElementType() != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT)
+        {
+            UE_LOG(LogTemp, Error, TEXT("Stateful session: state input %s is not a float tensor"), *Pair.InputName);
+            return false;
+        }
+
+        FState& State = *newStates.Add_GetRef(MakeUnique<FState>());
+        State.Pair = Pair;
+        State.InputNameUtf8 = TCHAR_TO_UTF8(*Pair.InputName);
+        State.OutputNameUtf8 = TCHAR_TO_UTF8(*Pair.OutputName);
+
+        if (Pair.Shape.Num() > 0)
+        {
+            State.Shape.assign(Pair.Shape.GetData(), Pair.Shape.GetData() + Pair.Shape.Num());
+        }
+        else
+        {
+            State.Shape = inputInfo.GetShape();
+            for (int64_t& dim : State.Shape)
+            {
+                dim = dim < 0 ? 1 : dim;
+            }
+        }
+
+        int64 elementCount = 1;
+        for (int64_t dim : State.Shape)
+        {
+            elementCount *= dim;
+        }
+
+        Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+        for (int32 i = 0; i < 2; ++i)
+        {
+            State.Buffers[i].Init(Pair.InitialValue, elementCount);
+            State.Tensors[i] = Ort::Value::CreateTensor<float>(memoryInfo, State.Buffers[i].GetData(), State.Buffers[i].Num(),
+                                                               State.Shape.data(), State.Shape.size());
+        }
+
+        UE_LOG(LogTemp, Log, TEXT("Stateful session: bound state %s -> %s (%lld elements)"), *Pair.InputName, *Pair.OutputName, elementCount);
+    }
+
+    states_ = MoveTemp(newStates);
+    return true;
+}
+
+bool FOnnxStateBindings::IsStateInput(const FString& Name) const
+{
+    return states_.ContainsByPredicate([&Name](const TUniquePtr<FState>& State) { return State->Pair.InputName == Name; });
+}
+
+bool FOnnxStateBindings::IsStateOutput(const FString& Name) const
+{
+    return states_.ContainsByPredicate([&Name](const TUniquePtr<FState>& State) { return State->Pair.OutputName == Name; });
+}
+
+bool FOnnxStateBindings::Run(Ort::Session& Session, const char* InputName, const Ort::Value& InputTensor,
+                             const char* OutputName, TArray<float>& OutputData, TArray<int64>* OutOutputShape)
+{
+    FScopeLock Lock(&mutex_);
+
+    const int32 next = 1 - current_;
+
+    // C API的Run接受OrtValue指针数组，状态张量可以直接引用而不需要移动到连续的Ort::Value数组中
+    TArray<const char*, TInlineAllocator<8>> inputNames;
+    TArray<const OrtValue*, TInlineAllocator<8>> inputValues;
+    TArray<const char*, TInlineAllocator<8>> outputNames;
+    TArray<OrtValue*, TInlineAllocator<8>> outputValues;
+
+    inputNames.Add(InputName);
+    inputValues.Add(InputTensor);
+    outputNames.Add(OutputName);
+    outputValues.Add(nullptr); // 普通输出由ORT分配
+
+    for (const TUniquePtr<FState>& State : states_)
+    {
+        inputNames.Add(State->InputNameUtf8.c_str());
+        inputValues.Add(State->Tensors[current_]);
+        outputNames.Add(State->OutputNameUtf8.c_str());
+        outputValues.Add(State->Tensors[next]); // 下一步状态直接写入另一个缓冲区
+    }
+
+    Ort::ThrowOnError(Ort::GetApi().Run(Session, nullptr, inputNames.GetData(), inputValues.GetData(), inputValues.Num(),
+                                        outputNames.GetData(), outputNames.Num(), outputValues.GetData()));
+
+    Ort::Value output(outputValues[0]);
+    if (!output || !output.IsTensor())
+    {
+        return false;
+    }
+
+    // 普通输出可以是fp16（状态张量本身只支持float）
+    Ort::TensorTypeAndShapeInfo outputInfo = output.GetTensorTypeAndShapeInfo();
+    if (!FOnnxHalf::CopyToFloat(output, OutputData))
+    {
+        return false;
+    }
+
+    if (OutOutputShape)
+    {
+        OutOutputShape->Reset();
+        for (int64_t dim : outputInfo.GetShape())
+        {
+            OutOutputShape->Add(dim);
+        }
+    }
+
+    current_ = next;
+    ++stepCount_;
+    return true;
+}
+
+void FOnnxStateBindings::Reset()
+{
+    FScopeLock Lock(&mutex_);
+
+    for (const TUniquePtr<FState>& State : states_)
+    {
+        for (float& Value : State->Buffers[current_])
+        {
+            Value = State->Pair.InitialValue;
+        }
+    }
+    stepCount_ = 0;
+}
+
+FOnnxStateSnapshot FOnnxStateBindings::Snapshot() const
+{
+    FScopeLock Lock(&mutex_);
+
+    FOnnxStateSnapshot Result;
+    Result.StepCount = stepCount_;
+    for (const TUniquePtr<FState>& State : states_)
+    {
+        FOnnxStateTensorData& Tensor = Result.Tensors.AddDefaulted_GetRef();
+        Tensor.InputName = State->Pair.InputName;
+        Tensor.Data = State->Buffers[current_];
+    }
+    return Result;
+}
+
+bool FOnnxStateBindings::Restore(const FOnnxStateSnapshot& InSnapshot)
+{
+    FScopeLock Lock(&mutex_);
+
+    // 先整体校验，避免部分恢复
+    TArray<const FOnnxStateTensorData*> Sources;
+    for (const TUniquePtr<FState>& State : states_)
+    {
+        const FOnnxStateTensorData* Source = InSnapshot.Tensors.FindByPredicate(
+            [&State](const FOnnxStateTensorData& Tensor) { return Tensor.InputName == State->Pair.InputName; });
+        if (!Source || Source->Data.Num() != State->Buffers[current_].Num())
+        {
+            UE_LOG(LogTemp, Error, TEXT("Stateful session: snapshot does not match state %s"), *State->Pair.InputName);
+            return false;
+        }
+        Sources.Add(Source);
+    }
+
+    for (int32 i = 0; i < states_.Num(); ++i)
+    {
+        FMemory::Memcpy(states_[i]->Buffers[current_].GetData(), Sources[i]->Data.GetData(), Sources[i]->Data.Num() * sizeof(float));
+    }
+    stepCount_ = InSnapshot.StepCount;
+    return true;
+}
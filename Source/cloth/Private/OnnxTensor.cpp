@@ -0,0 +1,479 @@
+// OnnxTensor.cpp
+
+#include "OnnxTensor.h"
+#include "OnnxHalf.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/ConfigCacheIni.h"
+#include "Misc/OutputDevice.h"
+#include "Misc/ScopeLock.h"
+
+/**
+ * 张量的存储：池化的块，或接管的Ort::Value。外部内存的视图没有存储对象
+ */
+struct FOnnxTensorStorage
+{
+    void* Block = nullptr;
+    int64 BlockBytes = 0;
+    Ort::Value Adopted{nullptr};
+
+    ~FOnnxTensorStorage()
+    {
+        if (Block)
+        {
+            FOnnxTensorPool::Get().Free(Block, BlockBytes);
+        }
+    }
+};
+
+namespace
+{
+    // 最小的块：小张量（标量、形状、提示点）也按缓存行的整数倍分配
+    constexpr int64 MinBlockBytes = 256;
+
+    FAutoConsoleCommandWithOutputDevice GOnnxTensorPoolCommand(
+        TEXT("onnx.TensorPool"),
+        TEXT("Prints the tensor pool statistics and the cached blocks per size class."),
+        FConsoleCommandWithOutputDeviceDelegate::CreateLambda([](FOutputDevice& Ar)
+        {
+            FOnnxTensorPool::Get().Dump(Ar);
+        }));
+
+    FAutoConsoleCommand GOnnxTensorPoolTrimCommand(
+        TEXT("onnx.TensorPool.Trim"),
+        TEXT("Frees all cached blocks of the tensor pool."),
+        FConsoleCommandDelegate::CreateLambda([]()
+        {
+            FOnnxTensorPool::Get().Trim();
+        }));
+}
+
+// ---------------------------------------------------------------------------
+// FOnnxTensor
+// ---------------------------------------------------------------------------
+
+FOnnxTensor FOnnxTensor::Allocate(EOnnxTensorType Type, TConstArrayView<int64> Shape, bool bZeroed)
+{
+    const int64 count = GetElementCount(Shape);
+    if (count < 0)
+    {
+        UE_LOG(LogTemp, Error, TEXT("FOnnxTensor::Allocate: shape has dynamic dimensions"));
+        return FOnnxTensor();
+    }
+
+    const int64 bytes = count * GetElementSize(Type);
+    TSharedPtr<FOnnxTensorStorage, ESPMode::ThreadSafe> storage = MakeShared<FOnnxTensorStorage, ESPMode::ThreadSafe>();
+    storage->Block = FOnnxTensorPool::Get().Allocate(bytes, storage->BlockBytes);
+    if (bZeroed)
+    {
+        FMemory::Memzero(storage->Block, bytes);
+    }
+
+    FOnnxTensor tensor;
+    tensor.data_ = static_cast<uint8*>(storage->Block);
+    tensor.storage_ = MoveTemp(storage);
+    tensor.shape_ = Shape;
+    tensor.type_ = Type;
+    return tensor;
+}
+
+FOnnxTensor FOnnxTensor::FromArray(TConstArrayView<float> Data, TConstArrayView<int64> Shape)
+{
+    if (GetElementCount(Shape) != Data.Num())
+    {
+        UE_LOG(LogTemp, Error, TEXT("FOnnxTensor::FromArray: %d elements do not match the shape (%lld elements)"), Data.Num(), GetElementCount(Shape));
+        return FOnnxTensor();
+    }
+
+    FOnnxTensor tensor = Allocate(EOnnxTensorType::Float, Shape);
+    if (tensor.IsValid())
+    {
+        FMemory::Memcpy(tensor.data_, Data.GetData(), Data.Num() * sizeof(float));
+    }
+    return tensor;
+}
+
+FOnnxTensor FOnnxTensor::Wrap(void* Data, EOnnxTensorType Type, TConstArrayView<int64> Shape)
+{
+    if (!Data || GetElementCount(Shape) < 0)
+    {
+        UE_LOG(LogTemp, Error, TEXT("FOnnxTensor::Wrap: no data or the shape has dynamic dimensions"));
+        return FOnnxTensor();
+    }
+
+    FOnnxTensor tensor;
+    tensor.data_ = static_cast<uint8*>(Data);
+    tensor.shape_ = Shape;
+    tensor.type_ = Type;
+    return tensor;
+}
+
+FOnnxTensor FOnnxTensor::Wrap(TArrayView<float> Data, TConstArrayView<int64> Shape)
+{
+    if (GetElementCount(Shape) != Data.Num())
+    {
+        UE_LOG(LogTemp, Error, TEXT("FOnnxTensor::Wrap: %d elements do not match the shape (%lld elements)"), Data.Num(), GetElementCount(Shape));
+        return FOnnxTensor();
+    }
+    return Wrap(Data.GetData(), EOnnxTensorType::Float, Shape);
+}
+
+FOnnxTensor FOnnxTensor::AdoptOrtValue(Ort::Value& Value)
+{
+    if (static_cast<const OrtValue*>(Value) == nullptr || !Value.IsTensor())
+    {
+        return FOnnxTensor();
+    }
+
+    Ort::TensorTypeAndShapeInfo info = Value.GetTensorTypeAndShapeInfo();
+    EOnnxTensorType type;
+    if (!FromOrtType(info.GetElementType(), type))
+    {
+        return FOnnxTensor();
+    }
+
+    FOnnxTensor tensor;
+    tensor.type_ = type;
+    for (int64_t dim : info.GetShape())
+    {
+        tensor.shape_.Add(dim);
+    }
+    tensor.data_ = static_cast<uint8*>(Value.GetTensorMutableRawData());
+
+    TSharedPtr<FOnnxTensorStorage, ESPMode::ThreadSafe> storage = MakeShared<FOnnxTensorStorage, ESPMode::ThreadSafe>();
+    storage->Adopted = std::move(Value);
+    tensor.storage_ = MoveTemp(storage);
+    return tensor;
+}
+
+bool FOnnxTensor::IsView() const
+{
+    return data_ && !storage_.IsValid();
+}
+
+int64 FOnnxTensor::GetElementCount() const
+{
+    return data_ ? GetElementCount(shape_) : 0;
+}
+
+int64 FOnnxTensor::GetElementCount(TConstArrayView<int64> Shape)
+{
+    int64 count = 1;
+    for (int64 dim : Shape)
+    {
+        if (dim < 0)
+        {
+            return -1;
+        }
+        count *= dim;
+    }
+    return count;
+}
+
+FOnnxTensor FOnnxTensor::Slice(int64 Start, int64 Count) const
+{
+    if (!IsValid() || shape_.Num() == 0 || Start < 0 || Count < 0 || Start + Count > shape_[0])
+    {
+        UE_LOG(LogTemp, Error, TEXT("FOnnxTensor::Slice: [%lld, %lld) is out of range"), Start, Start + Count);
+        return FOnnxTensor();
+    }
+
+    const int64 rowElements = shape_[0] > 0 ? GetElementCount() / shape_[0] : 0;
+    FOnnxTensor slice = *this;
+    slice.data_ = data_ + Start * rowElements * GetElementSize(type_);
+    slice.shape_[0] = Count;
+    return slice;
+}
+
+FOnnxTensor FOnnxTensor::Reshape(TConstArrayView<int64> NewShape) const
+{
+    if (!IsValid())
+    {
+        return FOnnxTensor();
+    }
+
+    // 唯一的-1维度由元素数推算
+    FOnnxInlineShape shape(NewShape);
+    int32 inferredIndex = INDEX_NONE;
+    int64 knownCount = 1;
+    for (int32 i = 0; i < shape.Num(); ++i)
+    {
+        if (shape[i] == -1 && inferredIndex == INDEX_NONE)
+        {
+            inferredIndex = i;
+        }
+        else if (shape[i] < 0)
+        {
+            inferredIndex = INDEX_NONE;
+            knownCount = -1;
+            break;
+        }
+        else
+        {
+            knownCount *= shape[i];
+        }
+    }
+
+    const int64 count = GetElementCount();
+    if (inferredIndex != INDEX_NONE && knownCount > 0 && count % knownCount == 0)
+    {
+        shape[inferredIndex] = count / knownCount;
+        knownCount = count;
+    }
+    if (knownCount != count)
+    {
+        UE_LOG(LogTemp, Error, TEXT("FOnnxTensor::Reshape: new shape does not have %lld elements"), count);
+        return FOnnxTensor();
+    }
+
+    FOnnxTensor reshaped = *this;
+    reshaped.shape_ = MoveTemp(shape);
+    return reshaped;
+}
+
+FOnnxTensor FOnnxTensor::Clone() const
+{
+    if (!IsValid())
+    {
+        return FOnnxTensor();
+    }
+
+    FOnnxTensor copy = Allocate(type_, shape_);
+    if (copy.IsValid())
+    {
+        FMemory::Memcpy(copy.data_, data_, GetSizeBytes());
+    }
+    return copy;
+}
+
+FOnnxTensor FOnnxTensor::ConvertTo(EOnnxTensorType NewType) const
+{
+    if (!IsValid() || NewType == type_)
+    {
+        return *this;
+    }
+
+    if (type_ == EOnnxTensorType::Float && NewType == EOnnxTensorType::Half)
+    {
+        FOnnxTensor converted = Allocate(NewType, shape_);
+        FOnnxHalf::ConvertToHalf(reinterpret_cast<const float*>(data_), reinterpret_cast<uint16*>(converted.data_), GetElementCount());
+        return converted;
+    }
+    if (type_ == EOnnxTensorType::Half && NewType == EOnnxTensorType::Float)
+    {
+        FOnnxTensor converted = Allocate(NewType, shape_);
+        FOnnxHalf::ConvertToFloat(reinterpret_cast<const uint16*>(data_), reinterpret_cast<float*>(converted.data_), GetElementCount());
+        return converted;
+    }
+
+    UE_LOG(LogTemp, Error, TEXT("FOnnxTensor::ConvertTo: only conversions between Float and Half are supported"));
+    return FOnnxTensor();
+}
+
+bool FOnnxTensor::CopyToFloat(TArray<float>& OutData) const
+{
+    const int64 count = GetElementCount();
+    if (type_ == EOnnxTensorType::Float)
+    {
+        OutData.SetNumUninitialized(count);
+        FMemory::Memcpy(OutData.GetData(), data_, count * sizeof(float));
+        return true;
+    }
+    if (type_ == EOnnxTensorType::Half)
+    {
+        OutData.SetNumUninitialized(count);
+        FOnnxHalf::ConvertToFloat(reinterpret_cast<const uint16*>(data_), OutData.GetData(), count);
+        return true;
+    }
+    return false;
+}
+
+Ort::Value FOnnxTensor::ToOrtValue() const
+{
+    check(IsValid());
+
+    // 张量引用存储本身，ORT不会复制也不会释放它
+    Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+    return Ort::Value::CreateTensor(memoryInfo, data_, GetSizeBytes(), reinterpret_cast<const int64_t*>(shape_.GetData()), shape_.Num(), GetOrtType());
+}
+
+int32 FOnnxTensor::GetElementSize(EOnnxTensorType Type)
+{
+    switch (Type)
+    {
+    case EOnnxTensorType::Float:
+    case EOnnxTensorType::Int32:
+        return 4;
+    case EOnnxTensorType::Half:
+        return 2;
+    case EOnnxTensorType::Int64:
+        return 8;
+    case EOnnxTensorType::UInt8:
+        return 1;
+    }
+    return 0;
+}
+
+ONNXTensorElementDataType FOnnxTensor::ToOrtType(EOnnxTensorType Type)
+{
+    switch (Type)
+    {
+    case EOnnxTensorType::Float:
+        return ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+    case EOnnxTensorType::Half:
+        return ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16;
+    case EOnnxTensorType::Int64:
+        return ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64;
+    case EOnnxTensorType::Int32:
+        return ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32;
+    case EOnnxTensorType::UInt8:
+        return ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8;
+    }
+    return ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+}
+
+bool FOnnxTensor::FromOrtType(ONNXTensorElementDataType OrtType, EOnnxTensorType& OutType)
+{
+    switch (OrtType)
+    {
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
+        OutType = EOnnxTensorType::Float;
+        return true;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16:
+        OutType = EOnnxTensorType::Half;
+        return true;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64:
+        OutType = EOnnxTensorType::Int64;
+        return true;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32:
+        OutType = EOnnxTensorType::Int32;
+        return true;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL:
+        OutType = EOnnxTensorType::UInt8;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// FOnnxTensorPool
+// ---------------------------------------------------------------------------
+
+FOnnxTensorPool& FOnnxTensorPool::Get()
+{
+    // 不析构：静态析构期间仍可能有张量归还块
+    static FOnnxTensorPool* Pool = new FOnnxTensorPool();
+    return *Pool;
+}
+
+FOnnxTensorPool::FOnnxTensorPool()
+{
+    int32 maxCachedMB = static_cast<int32>(maxCachedBytes_ / (1024 * 1024));
+    if (GConfig)
+    {
+        GConfig->GetInt(TEXT("OnnxRuntime"), TEXT("TensorPoolMaxCachedMB"), maxCachedMB, GEngineIni);
+    }
+    maxCachedBytes_ = FMath::Max(0, maxCachedMB) * int64(1024 * 1024);
+}
+
+int64 FOnnxTensorPool::GetBlockSize(int64 Bytes)
+{
+    // 每个二次幂区间(2^(n-1), 2^n]分为4个大小类
+    Bytes = FMath::Max(Bytes, MinBlockBytes);
+    const uint64 log = FMath::CeilLogTwo64(static_cast<uint64>(Bytes));
+    const int64 base = int64(1) << (log - 1);
+    const int64 step = base / 4;
+    return base + (Bytes - base + step - 1) / step * step;
+}
+
+void* FOnnxTensorPool::Allocate(int64 Bytes, int64& OutBlockBytes)
+{
+    OutBlockBytes = GetBlockSize(Bytes);
+    {
+        FScopeLock Lock(&mutex_);
+        liveBytes_ += OutBlockBytes;
+        peakLiveBytes_ = FMath::Max(peakLiveBytes_, liveBytes_);
+
+        TArray<void*>* blocks = freeBlocks_.Find(OutBlockBytes);
+        if (blocks && blocks->Num() > 0)
+        {
+            ++hits_;
+            cachedBytes_ -= OutBlockBytes;
+            return blocks->Pop(EAllowShrinking::No);
+        }
+        ++misses_;
+    }
+    return FMemory::Malloc(OutBlockBytes, Alignment);
+}
+
+void FOnnxTensorPool::Free(void* Block, int64 BlockBytes)
+{
+    {
+        FScopeLock Lock(&mutex_);
+        liveBytes_ -= BlockBytes;
+        if (cachedBytes_ + BlockBytes <= maxCachedBytes_)
+        {
+            freeBlocks_.FindOrAdd(BlockBytes).Add(Block);
+            cachedBytes_ += BlockBytes;
+            return;
+        }
+    }
+    FMemory::Free(Block);
+}
+
+void FOnnxTensorPool::Trim()
+{
+    TMap<int64, TArray<void*>> blocks;
+    {
+        FScopeLock Lock(&mutex_);
+        Swap(blocks, freeBlocks_);
+        cachedBytes_ = 0;
+    }
+
+    for (const TPair<int64, TArray<void*>>& pair : blocks)
+    {
+        for (void* block : pair.Value)
+        {
+            FMemory::Free(block);
+        }
+    }
+}
+
+FOnnxTensorPoolStats FOnnxTensorPool::GetStats() const
+{
+    FScopeLock Lock(&mutex_);
+
+    FOnnxTensorPoolStats stats;
+    for (const TPair<int64, TArray<void*>>& pair : freeBlocks_)
+    {
+        stats.NumCachedBlocks += pair.Value.Num();
+    }
+    stats.CachedBytes = cachedBytes_;
+    stats.LiveBytes = liveBytes_;
+    stats.PeakLiveBytes = peakLiveBytes_;
+    stats.Hits = hits_;
+    stats.Misses = misses_;
+    return stats;
+}
+
+void FOnnxTensorPool::Dump(FOutputDevice& Ar) const
+{
+    const FOnnxTensorPoolStats stats = GetStats();
+    Ar.Logf(TEXT("=== ONNX tensor pool: %.2f MB live (peak %.2f MB), %d cached blocks / %.2f MB (limit %.0f MB), %lld hits, %lld misses ==="),
+            stats.LiveBytes / (1024.0 * 1024.0), stats.PeakLiveBytes / (1024.0 * 1024.0), stats.NumCachedBlocks,
+            stats.CachedBytes / (1024.0 * 1024.0), maxCachedBytes_ / (1024.0 * 1024.0), stats.Hits, stats.Misses);
+
+    FScopeLock Lock(&mutex_);
+    TArray<int64> sizes;
+    freeBlocks_.GetKeys(sizes);
+    sizes.Sort();
+    for (int64 size : sizes)
+    {
+        const int32 numBlocks = freeBlocks_[size].Num();
+        if (numBlocks > 0)
+        {
+            Ar.Logf(TEXT("%10lld bytes: %d cached"), size, numBlocks);
+        }
+    }
+}
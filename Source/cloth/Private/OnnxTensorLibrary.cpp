@@ -0,0 +1,58 @@
+// OnnxTensorLibrary.cpp
+
+#include "OnnxTensorLibrary.h"
+
+FOnnxTensor UOnnxTensorLibrary::MakeTensor(const TArray<float>& Data, const TArray<int64>& Shape)
+{
+    return FOnnxTensor::FromArray(Data, Shape);
+}
+
+FOnnxTensor UOnnxTensorLibrary::MakeZeroTensor(EOnnxTensorType Type, const TArray<int64>& Shape)
+{
+    return FOnnxTensor::Allocate(Type, Shape, true);
+}
+
+bool UOnnxTensorLibrary::TensorToFloatArray(const FOnnxTensor& Tensor, TArray<float>& OutData)
+{
+    return Tensor.IsValid() && Tensor.CopyToFloat(OutData);
+}
+
+TArray<int64> UOnnxTensorLibrary::GetTensorShape(const FOnnxTensor& Tensor)
+{
+    return TArray<int64>(Tensor.GetShape());
+}
+
+int64 UOnnxTensorLibrary::GetTensorElementCount(const FOnnxTensor& Tensor)
+{
+    return Tensor.GetElementCount();
+}
+
+EOnnxTensorType UOnnxTensorLibrary::GetTensorType(const FOnnxTensor& Tensor)
+{
+    return Tensor.GetType();
+}
+
+bool UOnnxTensorLibrary::IsTensorValid(const FOnnxTensor& Tensor)
+{
+    return Tensor.IsValid();
+}
+
+FOnnxTensor UOnnxTensorLibrary::SliceTensor(const FOnnxTensor& Tensor, int64 Start, int64 Count)
+{
+    return Tensor.Slice(Start, Count);
+}
+
+FOnnxTensor UOnnxTensorLibrary::ReshapeTensor(const FOnnxTensor& Tensor, const TArray<int64>& NewShape)
+{
+    return Tensor.Reshape(NewShape);
+}
+
+FOnnxTensor UOnnxTensorLibrary::ConvertTensor(const FOnnxTensor& Tensor, EOnnxTensorType NewType)
+{
+    return Tensor.ConvertTo(NewType);
+}
+
+void UOnnxTensorLibrary::TrimTensorPool()
+{
+    FOnnxTensorPool::Get().Trim();
+}
@@ -0,0 +1,323 @@
+// OnnxTuning.cpp
+
+#include "OnnxTuning.h"
+#include "OnnxMemory.h"
+#include "OnnxResidency.h"
+#include "Async/Async.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformProcess.h"
+#include "Misc/ConfigCacheIni.h"
+#include "Misc/ScopeLock.h"
+
+namespace
+{
+    // 会话级变量
+    int32 GOnnxIntraOpThreads = 0;
+    int32 GOnnxInterOpThreads = -1;
+    int32 GOnnxExecutionMode = -1;
+    int32 GOnnxSpinMode = -1;
+    int32 GOnnxReplicasPerNumaNode = -1;
+
+    // 立即生效的变量
+    int32 GOnnxResidencyBudgetMB = -1;
+    int32 GOnnxMaxCachedChunkMB = -1;
+    float GOnnxShadowSampleRate = -1.0f;
+    int32 GOnnxSam2HalfPrecisionFeatures = -1;
+    float GOnnxRegistryGraceSeconds = -1.0f;
+
+    /**
+     * 已登记的模型实例。广播和注销持有同一把锁，注销之后不会再收到重建请求。
+     */
+    struct FListenerRegistry
+    {
+        FCriticalSection Mutex;
+        TArray<FOnnxTuningListener*> Listeners;
+    };
+
+    FListenerRegistry& GetRegistry()
+    {
+        static FListenerRegistry Registry;
+        return Registry;
+    }
+
+    void BroadcastRebuild(bool bForce)
+    {
+        FListenerRegistry& registry = GetRegistry();
+        FScopeLock Lock(&registry.Mutex);
+        for (FOnnxTuningListener* listener : registry.Listeners)
+        {
+            listener->RequestRebuild(bForce);
+        }
+    }
+
+    void OnInstanceVariableChanged(IConsoleVariable* /*Variable*/)
+    {
+        BroadcastRebuild(false);
+    }
+
+    void OnResidencyBudgetChanged(IConsoleVariable* /*Variable*/)
+    {
+        int32 budgetMB = 0;
+        if (GConfig)
+        {
+            GConfig->GetInt(TEXT("OnnxRuntime"), TEXT("ResidencyBudgetMB"), budgetMB, GEngineIni);
+        }
+        budgetMB = FMath::Max(0, FOnnxTuning::GetResidencyBudgetMB(budgetMB));
+        FOnnxResidencyManager::Get().SetBudgetBytes(static_cast<int64>(budgetMB) * 1024 * 1024);
+        UE_LOG(LogTemp, Log, TEXT("ONNX residency budget set to %d MB"), budgetMB);
+    }
+
+    void OnMaxCachedChunkChanged(IConsoleVariable* /*Variable*/)
+    {
+        // LoadFromConfig已经应用了变量，-1时得到配置文件的值
+        FOnnxMemorySettings settings;
+        settings.LoadFromConfig();
+        FOnnxMemory::SetMaxCachedChunkMB(settings.MaxCachedChunkMB);
+        UE_LOG(LogTemp, Log, TEXT("ONNX allocator chunk cache limit set to %d MB"), settings.MaxCachedChunkMB);
+    }
+
+    FAutoConsoleVariableRef CVarOnnxIntraOpThreads(
+        TEXT("onnx.IntraOpThreads"),
+        GOnnxIntraOpThreads,
+        TEXT("Overrides the intra-op thread count of every ONNX session (0 = use the asset/autotuned value). Sessions are rebuilt in the background."),
+        FConsoleVariableDelegate::CreateStatic(&OnInstanceVariableChanged),
+        ECVF_Scalability);
+
+    FAutoConsoleVariableRef CVarOnnxInterOpThreads(
+        TEXT("onnx.InterOpThreads"),
+        GOnnxInterOpThreads,
+        TEXT("Overrides the inter-op thread count of every ONNX session (-1 = use the asset value). Sessions are rebuilt in the background."),
+        FConsoleVariableDelegate::CreateStatic(&OnInstanceVariableChanged),
+        ECVF_Scalability);
+
+    FAutoConsoleVariableRef CVarOnnxExecutionMode(
+        TEXT("onnx.ExecutionMode"),
+        GOnnxExecutionMode,
+        TEXT("Overrides the graph execution mode: -1 = asset value, 0 = sequential, 1 = parallel. Sessions are rebuilt in the background."),
+        FConsoleVariableDelegate::CreateStatic(&OnInstanceVariableChanged),
+        ECVF_Default);
+
+    FAutoConsoleVariableRef CVarOnnxSpinMode(
+        TEXT("onnx.SpinMode"),
+        GOnnxSpinMode,
+        TEXT("Overrides thread pool spinning: -1 = asset value, 0 = default (always spin), 1 = spin during bursts then stop, 2 = no spinning. Sessions are rebuilt in the background."),
+        FConsoleVariableDelegate::CreateStatic(&OnInstanceVariableChanged),
+        ECVF_Scalability);
+
+    FAutoConsoleVariableRef CVarOnnxReplicasPerNumaNode(
+        TEXT("onnx.ReplicasPerNumaNode"),
+        GOnnxReplicasPerNumaNode,
+        TEXT("Overrides the number of session replicas per NUMA node (-1 = asset value, 0 = single session). Sessions are rebuilt in the background."),
+        FConsoleVariableDelegate::CreateStatic(&OnInstanceVariableChanged),
+        ECVF_Default);
+
+    FAutoConsoleVariableRef CVarOnnxResidencyBudgetMB(
+        TEXT("onnx.ResidencyBudgetMB"),
+        GOnnxResidencyBudgetMB,
+        TEXT("Overrides the model residency budget in MB (-1 = [OnnxRuntime] ResidencyBudgetMB, 0 = unlimited). Idle models over budget are evicted immediately."),
+        FConsoleVariableDelegate::CreateStatic(&OnResidencyBudgetChanged),
+        ECVF_Default);
+
+    FAutoConsoleVariableRef CVarOnnxMaxCachedChunkMB(
+        TEXT("onnx.MaxCachedChunkMB"),
+        GOnnxMaxCachedChunkMB,
+        TEXT("Overrides the free chunk cache limit of the ONNX allocator in MB (-1 = [OnnxRuntime] MaxCachedChunkMB)."),
+        FConsoleVariableDelegate::CreateStatic(&OnMaxCachedChunkChanged),
+        ECVF_Default);
+
+    FAutoConsoleVariableRef CVarOnnxShadowSampleRate(
+        TEXT("onnx.Shadow.SampleRate"),
+        GOnnxShadowSampleRate,
+        TEXT("Overrides the fraction of requests mirrored to shadow candidates (-1 = component setting)."),
+        ECVF_Default);
+
+    FAutoConsoleVariableRef CVarOnnxSam2HalfPrecisionFeatures(
+        TEXT("onnx.Sam2.HalfPrecisionFeatures"),
+        GOnnxSam2HalfPrecisionFeatures,
+        TEXT("Overrides the precision of cached SAM2 encoder features: -1 = component setting, 0 = fp32, 1 = fp16. Cached features are dropped on change."),
+        FConsoleVariableDelegate::CreateStatic(&OnInstanceVariableChanged),
+        ECVF_Scalability);
+
+    FAutoConsoleVariableRef CVarOnnxRegistryGraceSeconds(
+        TEXT("onnx.Registry.GraceSeconds"),
+        GOnnxRegistryGraceSeconds,
+        TEXT("Overrides how long the model registry keeps instances without handles, in seconds (-1 = [OnnxRuntime] ModelRegistryGraceSeconds)."),
+        ECVF_Default);
+
+    FAutoConsoleCommandWithOutputDevice GOnnxTuningCommand(
+        TEXT("onnx.Tuning"),
+        TEXT("Lists the onnx.* tuning variables and the current session settings of every model."),
+        FConsoleCommandWithOutputDeviceDelegate::CreateStatic(&FOnnxTuning::Dump));
+
+    FAutoConsoleCommand GOnnxRebuildSessionsCommand(
+        TEXT("onnx.RebuildSessions"),
+        TEXT("Rebuilds the sessions of every model in the background, even if no setting changed."),
+        FConsoleCommandDelegate::CreateLambda([]() { BroadcastRebuild(true); }));
+}
+
+FOnnxSessionSettings FOnnxTuning::ApplySessionOverrides(const FOnnxSessionSettings& Settings)
+{
+    FOnnxSessionSettings Result = Settings;
+    if (GOnnxIntraOpThreads > 0 && GOnnxIntraOpThreads != Result.IntraOpThreads)
+    {
+        // 亲和性列表的项数依赖线程数
+        Result.IntraOpThreads = GOnnxIntraOpThreads;
+        Result.IntraOpThreadAffinities.Empty();
+    }
+    if (GOnnxInterOpThreads >= 0)
+    {
+        Result.InterOpThreads = GOnnxInterOpThreads;
+    }
+    if (GOnnxExecutionMode >= 0 && GOnnxExecutionMode <= static_cast<int32>(EOnnxExecutionMode::Parallel))
+    {
+        Result.ExecutionMode = static_cast<EOnnxExecutionMode>(GOnnxExecutionMode);
+    }
+    if (GOnnxSpinMode >= 0 && GOnnxSpinMode <= static_cast<int32>(EOnnxSpinMode::NoSpin))
+    {
+        Result.SpinMode = static_cast<EOnnxSpinMode>(GOnnxSpinMode);
+    }
+    if (GOnnxReplicasPerNumaNode >= 0)
+    {
+        Result.ReplicasPerNumaNode = GOnnxReplicasPerNumaNode;
+    }
+    return Result;
+}
+
+bool FOnnxTuning::SessionSettingsEqual(const FOnnxSessionSettings& A, const FOnnxSessionSettings& B)
+{
+    return FOnnxSessionSettings::StaticStruct()->CompareScriptStruct(&A, &B, PPF_None);
+}
+
+int32 FOnnxTuning::GetResidencyBudgetMB(int32 Default)
+{
+    return GOnnxResidencyBudgetMB >= 0 ? GOnnxResidencyBudgetMB : Default;
+}
+
+int32 FOnnxTuning::GetMaxCachedChunkMB(int32 Default)
+{
+    return GOnnxMaxCachedChunkMB >= 0 ? GOnnxMaxCachedChunkMB : Default;
+}
+
+float FOnnxTuning::GetShadowSampleRate(float Default)
+{
+    return GOnnxShadowSampleRate >= 0.0f ? FMath::Min(GOnnxShadowSampleRate, 1.0f) : Default;
+}
+
+bool FOnnxTuning::GetSam2HalfPrecisionFeatures(bool Default)
+{
+    return GOnnxSam2HalfPrecisionFeatures >= 0 ? GOnnxSam2HalfPrecisionFeatures != 0 : Default;
+}
+
+float FOnnxTuning::GetRegistryGraceSeconds(float Default)
+{
+    return GOnnxRegistryGraceSeconds >= 0.0f ? GOnnxRegistryGraceSeconds : Default;
+}
+
+void FOnnxTuning::Dump(FOutputDevice& Ar)
+{
+    Ar.Logf(TEXT("=== ONNX tuning variables ==="));
+    Ar.Logf(TEXT("onnx.IntraOpThreads=%d onnx.InterOpThreads=%d onnx.ExecutionMode=%d onnx.SpinMode=%d onnx.ReplicasPerNumaNode=%d"),
+            GOnnxIntraOpThreads, GOnnxInterOpThreads, GOnnxExecutionMode, GOnnxSpinMode, GOnnxReplicasPerNumaNode);
+    Ar.Logf(TEXT("onnx.ResidencyBudgetMB=%d onnx.MaxCachedChunkMB=%d onnx.Shadow.SampleRate=%.3f onnx.Sam2.HalfPrecisionFeatures=%d onnx.Registry.GraceSeconds=%.1f"),
+            GOnnxResidencyBudgetMB, GOnnxMaxCachedChunkMB, GOnnxShadowSampleRate, GOnnxSam2HalfPrecisionFeatures, GOnnxRegistryGraceSeconds);
+    Ar.Logf(TEXT("Effective: residency budget %lld MB, chunk cache limit %d MB"),
+            FOnnxResidencyManager::Get().GetBudgetBytes() / (1024 * 1024), FOnnxMemory::GetMaxCachedChunkMB());
+
+    FListenerRegistry& registry = GetRegistry();
+    FScopeLock Lock(&registry.Mutex);
+    Ar.Logf(TEXT("%d models:"), registry.Listeners.Num());
+    for (const FOnnxTuningListener* listener : registry.Listeners)
+    {
+        Ar.Logf(TEXT("  %s%s: %s"), *listener->name_, listener->IsRunning() ? TEXT(" (rebuilding)") : TEXT(""),
+                listener->describe_ ? *listener->describe_() : TEXT(""));
+    }
+}
+
+FOnnxTuningListener::~FOnnxTuningListener()
+{
+    Unregister();
+}
+
+void FOnnxTuningListener::Register(const FString& InName, FRebuildFunction InRebuild, FDescribeFunction InDescribe)
+{
+    Unregister();
+
+    name_ = InName;
+    rebuild_ = MoveTemp(InRebuild);
+    describe_ = MoveTemp(InDescribe);
+
+    FListenerRegistry& registry = GetRegistry();
+    FScopeLock Lock(&registry.Mutex);
+    registry.Listeners.Add(this);
+    bRegistered_ = true;
+}
+
+void FOnnxTuningListener::Unregister()
+{
+    if (!bRegistered_)
+    {
+        return;
+    }
+
+    {
+        FListenerRegistry& registry = GetRegistry();
+        FScopeLock Lock(&registry.Mutex);
+        registry.Listeners.Remove(this);
+        bRegistered_ = false;
+    }
+
+    // 等待进行中的重建，它引用了所属实例的会话和配置
+    while (IsRunning())
+    {
+        FPlatformProcess::Sleep(0.001f);
+    }
+}
+
+bool FOnnxTuningListener::IsRunning() const
+{
+    FScopeLock Lock(&stateMutex_);
+    return bRunning_;
+}
+
+void FOnnxTuningListener::RequestRebuild(bool bForce)
+{
+    {
+        FScopeLock Lock(&stateMutex_);
+        bForcePending_ |= bForce;
+        bPending_ = true;
+
+        // 已有任务在执行时由它接着处理
+        if (bRunning_)
+        {
+            return;
+        }
+        bRunning_ = true;
+    }
+
+    // 低优先级后台线程：创建会话可能需要数秒，不占用游戏线程和推理线程
+    AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [this]()
+    {
+        RunPending();
+    });
+}
+
+void FOnnxTuningListener::RunPending()
+{
+    for (;;)
+    {
+        bool bForce = false;
+        {
+            // 没有新请求时在同一把锁下清除bRunning_，之后不再访问this
+            FScopeLock Lock(&stateMutex_);
+            if (!bPending_)
+            {
+                bRunning_ = false;
+                return;
+            }
+            bPending_ = false;
+            bForce = bForcePending_;
+            bForcePending_ = false;
+        }
+        rebuild_(bForce);
+    }
+}
@@ -0,0 +1,778 @@
+// OnnxWorkerPool.cpp
+
+#include "OnnxWorkerPool.h"
+#include "OnnxExecutionProviders.h"
+#include "OnnxRuntime.h"
+#include "Async/Async.h"
+#include "HAL/PlatformTime.h"
+#include "Interfaces/IPluginManager.h"
+#include "Misc/ConfigCacheIni.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+
+namespace
+{
+    // 工作进程加载模型的最长时间（大模型首次加载可能需要数十秒）
+    constexpr double StartupTimeoutSeconds = 120.0;
+
+    // 正常退出的等待时间，超时后强制结束
+    constexpr double ShutdownTimeoutSeconds = 2.0;
+
+    // 检查空闲进程的间隔
+    constexpr float RetireTickInterval = 1.0f;
+
+    // 同一进程内所有池共用的通道编号，保证共享内存名称唯一
+    std::atomic<int32> GNextChannelId{0};
+
+    int32 GetNumSlots(const FOnnxWorkerSettings& Settings)
+    {
+        return FMath::Clamp(Settings.SlotsPerWorker, 1, 64);
+    }
+}
+
+/**
+ * 一个工作进程和它的共享内存通道。请求持有引用，进程被移出池之后通道仍然有效，直到最后一个请求结束。
+ */
+struct FOnnxWorkerPool::FWorker
+{
+    int32 Index = 0;
+    FProcHandle Process;
+    uint32 ProcessId = 0;
+
+    // FProcHandle不是线程安全的，多个请求同时检查进程状态时需要加锁
+    FCriticalSection ProcessMutex;
+
+    OnnxCore::FSharedMemoryRegion Region;
+    OnnxCore::FWorkerChannelHeader* Header = nullptr;
+
+    // 占用的槽数（由池的mutex_保护修改）
+    std::atomic<int32> InFlight{0};
+    double LastUsedTime = 0.0;
+
+    ~FWorker()
+    {
+        if (Process.IsValid())
+        {
+            FPlatformProcess::CloseProc(Process);
+        }
+    }
+
+    bool IsRunning()
+    {
+        FScopeLock lock(&ProcessMutex);
+        return Process.IsValid() && FPlatformProcess::IsProcRunning(Process);
+    }
+};
+
+FOnnxWorkerPool::~FOnnxWorkerPool()
+{
+    Stop();
+}
+
+bool FOnnxWorkerPool::Start(const FString& InModelPath, const FOnnxSessionSettings& InSessionSettings, const FOnnxWorkerSettings& InWorkerSettings,
+                            const FString& InDisplayName)
+{
+    Stop();
+
+    // 会话在工作进程中，本进程只用ORT的张量引用共享内存，不需要Env
+    if (!FOnnxRuntime::LoadApi())
+    {
+        return false;
+    }
+
+    modelPath_ = FPaths::ConvertRelativePathToFull(InModelPath);
+    displayName_ = InDisplayName;
+    sessionSettings_ = InSessionSettings;
+    workerSettings_ = InWorkerSettings;
+    workerSettings_.MinWorkers = FMath::Max(1, workerSettings_.MinWorkers);
+    workerSettings_.MaxWorkers = FMath::Max(workerSettings_.MinWorkers, workerSettings_.MaxWorkers);
+    restartTimes_.Reset();
+
+    if (sessionSettings_.ExecutionProvider != EOnnxExecutionProvider::CPU)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("%s: ONNX workers only support the CPU execution provider, %s is ignored"), *displayName_,
+               FOnnxExecutionProviders::GetDisplayName(sessionSettings_.ExecutionProvider));
+        sessionSettings_.ExecutionProvider = EOnnxExecutionProvider::CPU;
+    }
+
+    const FString executable = GetWorkerExecutable();
+    if (!FPaths::FileExists(executable))
+    {
+        UE_LOG(LogTemp, Error, TEXT("%s: ONNX worker executable not found: %s (build Tools/OnnxWorker or set [OnnxRuntime] WorkerExecutable)"),
+               *displayName_, *executable);
+        return false;
+    }
+
+    bRunning_ = true;
+
+    // 常驻进程在调用线程上依次启动，与进程内模式在构造时创建会话一致
+    for (int32 i = 0; i < workerSettings_.MinWorkers; ++i)
+    {
+        FWorkerPtr worker = SpawnWorker(i, sessionSettings_);
+        if (!worker)
+        {
+            // 第一个进程就失败说明模型或配置有问题，不再继续；之后的失败由扩容补上
+            if (workers_.Num() == 0)
+            {
+                bRunning_ = false;
+                return false;
+            }
+            break;
+        }
+
+        FScopeLock lock(&mutex_);
+        worker->LastUsedTime = FPlatformTime::Seconds();
+        workers_.Add(worker);
+    }
+
+    // 扩容出的进程在没有请求之后也要退出，不能只在请求结束时检查
+    if (workerSettings_.MaxWorkers > workerSettings_.MinWorkers)
+    {
+        retireTickerHandle_ = FTSTicker::GetCoreTicker().AddTicker(
+            FTickerDelegate::CreateRaw(this, &FOnnxWorkerPool::TickRetire), RetireTickInterval);
+    }
+
+    UE_LOG(LogTemp, Log, TEXT("%s: started %d ONNX worker(s) (max %d, %d slots of %d MB each)"), *displayName_, workers_.Num(),
+           workerSettings_.MaxWorkers, GetNumSlots(workerSettings_), workerSettings_.SlotSizeMB);
+    return true;
+}
+
+void FOnnxWorkerPool::Stop()
+{
+    bRunning_ = false;
+
+    if (retireTickerHandle_.IsValid())
+    {
+        FTSTicker::GetCoreTicker().RemoveTicker(retireTickerHandle_);
+        retireTickerHandle_.Reset();
+    }
+
+    // 后台启动的进程检查bRunning_后放弃等待
+    while (numStarting_ > 0)
+    {
+        FPlatformProcess::Sleep(0.001f);
+    }
+
+    TArray<FWorkerPtr> workers;
+    {
+        FScopeLock lock(&mutex_);
+        workers = MoveTemp(workers_);
+        workers_.Reset();
+    }
+
+    // 进行中的请求持有工作进程的引用，等它们结束后再关闭
+    while (numInFlight_ > 0)
+    {
+        FPlatformProcess::Sleep(0.001f);
+    }
+
+    for (const FWorkerPtr& worker : workers)
+    {
+        StopWorker(*worker, true);
+    }
+    if (workers.Num() > 0)
+    {
+        UE_LOG(LogTemp, Log, TEXT("%s: stopped %d ONNX worker(s)"), *displayName_, workers.Num());
+    }
+}
+
+int32 FOnnxWorkerPool::FindInput(const char* Name) const
+{
+    return inputs_.IndexOfByPredicate([Name](const OnnxCore::FWorkerNodeInfo& Info) { return FCStringAnsi::Strcmp(Info.Name, Name) == 0; });
+}
+
+int32 FOnnxWorkerPool::FindOutput(const char* Name) const
+{
+    return outputs_.IndexOfByPredicate([Name](const OnnxCore::FWorkerNodeInfo& Info) { return FCStringAnsi::Strcmp(Info.Name, Name) == 0; });
+}
+
+FOnnxWorkerPoolStats FOnnxWorkerPool::GetStats() const
+{
+    FOnnxWorkerPoolStats stats;
+    {
+        FScopeLock lock(&mutex_);
+        stats.NumWorkers = workers_.Num();
+    }
+    stats.NumStarting = numStarting_;
+    stats.NumInFlight = numInFlight_;
+    stats.CompletedRequests = completedRequests_;
+    stats.FailedRequests = failedRequests_;
+    stats.Restarts = restarts_;
+    stats.Retired = retired_;
+    return stats;
+}
+
+void FOnnxWorkerPool::Restart(const FOnnxSessionSettings& InSessionSettings)
+{
+    if (!bRunning_)
+    {
+        return;
+    }
+
+    FOnnxSessionSettings settings = InSessionSettings;
+    settings.ExecutionProvider = EOnnxExecutionProvider::CPU;
+
+    TArray<int32> indices;
+    {
+        FScopeLock lock(&mutex_);
+        sessionSettings_ = settings;
+        for (const FWorkerPtr& worker : workers_)
+        {
+            indices.Add(worker->Index);
+        }
+    }
+
+    // 先按新配置启动替换进程，旧进程在换出之后处理完已占用的槽再退出，请求不会中断
+    for (int32 index : indices)
+    {
+        FWorkerPtr replacement = SpawnWorker(index, settings);
+        if (!replacement)
+        {
+            UE_LOG(LogTemp, Error, TEXT("%s: failed to restart ONNX worker %d with the new settings, keeping the current one"), *displayName_, index);
+            continue;
+        }
+
+        FWorkerPtr previous;
+        {
+            FScopeLock lock(&mutex_);
+            const int32 slot = workers_.IndexOfByPredicate([index](const FWorkerPtr& Worker) { return Worker->Index == index; });
+            replacement->LastUsedTime = FPlatformTime::Seconds();
+            if (slot == INDEX_NONE)
+            {
+                workers_.Add(replacement);
+            }
+            else
+            {
+                previous = workers_[slot];
+                workers_[slot] = replacement;
+            }
+        }
+
+        if (previous)
+        {
+            while (previous->InFlight > 0)
+            {
+                FPlatformProcess::Sleep(0.001f);
+            }
+            StopWorker(*previous, true);
+        }
+    }
+    UE_LOG(LogTemp, Log, TEXT("%s: restarted ONNX workers (%s)"), *displayName_, *settings.ToString());
+}
+
+FString FOnnxWorkerPool::GetWorkerExecutable()
+{
+    FString executable;
+    if (GConfig && GConfig->GetString(TEXT("OnnxRuntime"), TEXT("WorkerExecutable"), executable, GEngineIni) && !executable.IsEmpty())
+    {
+        return FPaths::IsRelative(executable) ? FPaths::ConvertRelativePathToFull(FPaths::ProjectDir(), executable) : executable;
+    }
+
+    TSharedPtr<IPlugin> plugin = IPluginManager::Get().FindPlugin(TEXT("UE5OnnxRuntime"));
+    const FString baseDir = plugin.IsValid() ? plugin->GetBaseDir() : FPaths::Combine(FPaths::ProjectPluginsDir(), TEXT("UE5OnnxRuntime"));
+#if PLATFORM_WINDOWS
+    const TCHAR* fileName = TEXT("OnnxWorker.exe");
+#else
+    const TCHAR* fileName = TEXT("OnnxWorker");
+#endif
+    return FPaths::ConvertRelativePathToFull(FPaths::Combine(baseDir, TEXT("Binaries"), FPlatformProcess::GetBinariesSubdirectory(), fileName));
+}
+
+FString FOnnxWorkerPool::BuildArguments(const FString& ChannelName, int32 WorkerIndex, const FOnnxSessionSettings& Settings) const
+{
+    // 参数与Tools/OnnxWorker的命令行一一对应
+    const OnnxCore::FSessionConfig config = Settings.ToCoreConfig();
+    FString args = FString::Printf(TEXT("--channel %s --model \"%s\" --parent %u --threads %d --spin %s"), *ChannelName, *modelPath_,
+                                   FPlatformProcess::GetCurrentProcessId(), config.IntraOpThreads, UTF8_TO_TCHAR(OnnxCore::GetSpinModeName(config.SpinMode)));
+    if (config.bParallel)
+    {
+        args += FString::Printf(TEXT(" --parallel --inter %d"), config.InterOpThreads);
+    }
+    if (!config.IntraOpThreadAffinities.empty())
+    {
+        args += FString::Printf(TEXT(" --affinities \"%s\""), UTF8_TO_TCHAR(config.IntraOpThreadAffinities.c_str()));
+    }
+    if (config.bDisableQDQFusion)
+    {
+        args += TEXT(" --disable-qdq-fusion");
+    }
+    if (config.bEnableQDQCleanup)
+    {
+        args += TEXT(" --qdq-cleanup");
+    }
+    if (config.bDisableDoubleQDQRemover)
+    {
+        args += TEXT(" --disable-double-qdq-remover");
+    }
+    if (config.bAvx2PrecisionMode)
+    {
+        args += TEXT(" --avx2-precision");
+    }
+    if (config.MatMulNBitsAccuracyLevel > 0)
+    {
+        args += FString::Printf(TEXT(" --matmul-nbits-accuracy %d"), config.MatMulNBitsAccuracyLevel);
+    }
+    if (workerSettings_.CpuSets.Num() > 0)
+    {
+        const FString cpus = workerSettings_.CpuSets[WorkerIndex % workerSettings_.CpuSets.Num()].Replace(TEXT(" "), TEXT(""));
+        if (!cpus.IsEmpty())
+        {
+            args += TEXT(" --cpus ") + cpus;
+        }
+    }
+    return args;
+}
+
+FOnnxWorkerPool::FWorkerPtr FOnnxWorkerPool::SpawnWorker(int32 WorkerIndex, const FOnnxSessionSettings& Settings)
+{
+    FWorkerPtr worker = MakeShared<FWorker, ESPMode::ThreadSafe>();
+    worker->Index = WorkerIndex;
+
+    const FString channelName = FString::Printf(TEXT("onnxw-%u-%d"), FPlatformProcess::GetCurrentProcessId(), ++GNextChannelId);
+    const uint64 slotBytes = uint64(FMath::Max(1, workerSettings_.SlotSizeMB)) * 1024 * 1024;
+    const uint32 numSlots = GetNumSlots(workerSettings_);
+
+    std::string error;
+    if (!worker->Region.Create(TCHAR_TO_UTF8(*channelName), OnnxCore::GetWorkerChannelBytes(numSlots, slotBytes), error))
+    {
+        UE_LOG(LogTemp, Error, TEXT("%s: failed to create ONNX worker channel: %s"), *displayName_, UTF8_TO_TCHAR(error.c_str()));
+        return nullptr;
+    }
+    worker->Header = OnnxCore::InitializeWorkerChannel(worker->Region.GetData(), numSlots, slotBytes);
+
+    const FString executable = GetWorkerExecutable();
+    const FString args = BuildArguments(channelName, WorkerIndex, Settings);
+    worker->Process = FPlatformProcess::CreateProc(*executable, *args, false, true, true, &worker->ProcessId, 0, nullptr, nullptr);
+    if (!worker->Process.IsValid())
+    {
+        UE_LOG(LogTemp, Error, TEXT("%s: failed to launch ONNX worker: %s %s"), *displayName_, *executable, *args);
+        return nullptr;
+    }
+
+    // 等待加载完成：进程退出、超时或池被停止时放弃
+    const double startTime = FPlatformTime::Seconds();
+    uint32 state = static_cast<uint32>(OnnxCore::EWorkerState::Starting);
+    const TCHAR* failure = nullptr;
+    for (;;)
+    {
+        state = worker->Header->WorkerState.load(std::memory_order_acquire);
+        if (state != static_cast<uint32>(OnnxCore::EWorkerState::Starting))
+        {
+            break;
+        }
+        if (!worker->IsRunning())
+        {
+            failure = TEXT("exited during startup");
+            break;
+        }
+        if (!bRunning_)
+        {
+            failure = TEXT("cancelled");
+            break;
+        }
+        if (FPlatformTime::Seconds() - startTime > StartupTimeoutSeconds)
+        {
+            failure = TEXT("timed out loading the model");
+            break;
+        }
+        OnnxCore::WaitForChange(worker->Region, worker->Header->WorkerState, state, 100);
+    }
+
+    // 工作进程已经映射了通道（或者不会再映射），名称不再需要，任何一方崩溃都不会留下残留
+    worker->Region.Unlink();
+
+    if (!failure && state != static_cast<uint32>(OnnxCore::EWorkerState::Ready))
+    {
+        failure = TEXT("failed to load the model");
+    }
+    if (failure)
+    {
+        UE_LOG(LogTemp, Error, TEXT("%s: ONNX worker %d %s: %s"), *displayName_, WorkerIndex, failure, UTF8_TO_TCHAR(worker->Header->Error));
+        StopWorker(*worker, false);
+        return nullptr;
+    }
+
+    // 第一个就绪的进程提供模型元数据（所有进程加载同一个模型）
+    {
+        FScopeLock lock(&mutex_);
+        if (inputs_.Num() == 0 && outputs_.Num() == 0)
+        {
+            inputs_.Append(worker->Header->Inputs, worker->Header->NumInputs);
+            outputs_.Append(worker->Header->Outputs, worker->Header->NumOutputs);
+        }
+    }
+
+    UE_LOG(LogTemp, Log, TEXT("%s: ONNX worker %d ready in %.2f s (pid %u, %s)"), *displayName_, WorkerIndex,
+           FPlatformTime::Seconds() - startTime, worker->ProcessId, *Settings.ToString());
+    return worker;
+}
+
+void FOnnxWorkerPool::StopWorker(FWorker& Worker, bool bGraceful)
+{
+    if (bGraceful && Worker.Header)
+    {
+        Worker.Header->bShutdown.store(1, std::memory_order_release);
+        Worker.Header->Doorbell.fetch_add(1, std::memory_order_release);
+        OnnxCore::WakeAll(Worker.Region, Worker.Header->Doorbell);
+
+        const double startTime = FPlatformTime::Seconds();
+        while (Worker.IsRunning() && FPlatformTime::Seconds() - startTime < ShutdownTimeoutSeconds)
+        {
+            FPlatformProcess::Sleep(0.005f);
+        }
+    }
+
+    FScopeLock lock(&Worker.ProcessMutex);
+    if (Worker.Process.IsValid() && FPlatformProcess::IsProcRunning(Worker.Process))
+    {
+        FPlatformProcess::TerminateProc(Worker.Process, true);
+        FPlatformProcess::WaitForProc(Worker.Process);
+    }
+}
+
+void FOnnxWorkerPool::SpawnInBackground(int32 WorkerIndex)
+{
+    ++numStarting_;
+    startingIndices_.Add(WorkerIndex);
+    const FOnnxSessionSettings settings = sessionSettings_;
+
+    // 加载模型可能需要数秒，不占用请求线程；Stop等待numStarting_归零，this在任务期间有效
+    AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [this, WorkerIndex, settings]()
+    {
+        FWorkerPtr worker = SpawnWorker(WorkerIndex, settings);
+        {
+            FScopeLock lock(&mutex_);
+            startingIndices_.Remove(WorkerIndex);
+            if (worker && bRunning_)
+            {
+                worker->LastUsedTime = FPlatformTime::Seconds();
+                workers_.Add(worker);
+                worker.Reset();
+            }
+        }
+        if (worker)
+        {
+            StopWorker(*worker, true);
+        }
+        --numStarting_;
+    });
+}
+
+int32 FOnnxWorkerPool::AllocateWorkerIndex() const
+{
+    for (int32 index = 0;; ++index)
+    {
+        const bool bUsed = startingIndices_.Contains(index) ||
+            workers_.ContainsByPredicate([index](const FWorkerPtr& Worker) { return Worker->Index == index; });
+        if (!bUsed)
+        {
+            return index;
+        }
+    }
+}
+
+FOnnxWorkerPool::FWorkerPtr FOnnxWorkerPool::AcquireWorker()
+{
+    const double startTime = FPlatformTime::Seconds();
+    const int32 numSlots = GetNumSlots(workerSettings_);
+
+    for (;;)
+    {
+        {
+            FScopeLock lock(&mutex_);
+            if (!bRunning_)
+            {
+                return nullptr;
+            }
+
+            FWorkerPtr best;
+            for (const FWorkerPtr& worker : workers_)
+            {
+                if (!best || worker->InFlight < best->InFlight)
+                {
+                    best = worker;
+                }
+            }
+
+            // 所有进程都有请求在处理时扩容，新进程就绪之前请求照常排队
+            const bool bAllBusy = !best || best->InFlight > 0;
+            if (bAllBusy && workers_.Num() + numStarting_ < workerSettings_.MaxWorkers)
+            {
+                SpawnInBackground(AllocateWorkerIndex());
+            }
+
+            if (best && best->InFlight < numSlots)
+            {
+                ++best->InFlight;
+                ++numInFlight_;
+                return best;
+            }
+
+            // 没有进程，也没有正在启动的进程（达到重启上限）
+            if (workers_.Num() == 0 && numStarting_ == 0)
+            {
+                return nullptr;
+            }
+        }
+
+        if (FPlatformTime::Seconds() - startTime > workerSettings_.RequestTimeoutSeconds)
+        {
+            return nullptr;
+        }
+        FPlatformProcess::Sleep(0.0005f);
+    }
+}
+
+void FOnnxWorkerPool::ReleaseWorker(const FWorkerPtr& Worker)
+{
+    {
+        FScopeLock lock(&mutex_);
+        --Worker->InFlight;
+        Worker->LastUsedTime = FPlatformTime::Seconds();
+    }
+    --numInFlight_;
+    RetireIdleWorkers();
+}
+
+void FOnnxWorkerPool::HandleWorkerFailure(const FWorkerPtr& Worker, const TCHAR* Reason)
+{
+    bool bReplace = false;
+    {
+        FScopeLock lock(&mutex_);
+        if (workers_.Remove(Worker) == 0)
+        {
+            // 同一进程上的其他请求已经处理过
+            return;
+        }
+
+        const double now = FPlatformTime::Seconds();
+        restartTimes_.RemoveAll([now](double Time) { return now - Time > 60.0; });
+        if (bRunning_ && restartTimes_.Num() < workerSettings_.MaxRestartsPerMinute)
+        {
+            restartTimes_.Add(now);
+            ++restarts_;
+            bReplace = true;
+            SpawnInBackground(Worker->Index);
+        }
+    }
+
+    if (bReplace)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("%s: ONNX worker %d (pid %u) %s, restarting"), *displayName_, Worker->Index, Worker->ProcessId, Reason);
+    }
+    else
+    {
+        UE_LOG(LogTemp, Error, TEXT("%s: ONNX worker %d (pid %u) %s, restart limit of %d per minute reached"), *displayName_, Worker->Index,
+               Worker->ProcessId, Reason, workerSettings_.MaxRestartsPerMinute);
+    }
+    StopWorker(*Worker, false);
+}
+
+void FOnnxWorkerPool::RetireIdleWorkers()
+{
+    FWorkerPtr retired;
+    {
+        FScopeLock lock(&mutex_);
+        if (workers_.Num() <= workerSettings_.MinWorkers)
+        {
+            return;
+        }
+
+        const double now = FPlatformTime::Seconds();
+        for (int32 i = workers_.Num() - 1; i >= 0; --i)
+        {
+            if (workers_[i]->InFlight == 0 && now - workers_[i]->LastUsedTime > workerSettings_.IdleSecondsBeforeRetire)
+            {
+                retired = workers_[i];
+                workers_.RemoveAt(i);
+                ++retired_;
+                break;
+            }
+        }
+    }
+
+    if (retired)
+    {
+        // 正常退出需要等待进程结束，放到后台，不阻塞请求线程
+        UE_LOG(LogTemp, Log, TEXT("%s: retiring idle ONNX worker %d (pid %u)"), *displayName_, retired->Index, retired->ProcessId);
+        AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [retired]()
+        {
+            StopWorker(*retired, true);
+        });
+    }
+}
+
+bool FOnnxWorkerPool::TickRetire(float DeltaTime)
+{
+    if (bRunning_)
+    {
+        RetireIdleWorkers();
+    }
+    return true;
+}
+
+FOnnxWorkerPool::FRequest::FRequest(FOnnxWorkerPool& InPool)
+    : pool_(InPool)
+{
+    worker_ = pool_.AcquireWorker();
+    if (!worker_)
+    {
+        UE_LOG(LogTemp, Error, TEXT("%s: no ONNX worker available"), *pool_.displayName_);
+        return;
+    }
+
+    // 占用的槽位数不超过槽数，这里一定能找到空闲的槽
+    OnnxCore::FWorkerChannelHeader* header = worker_->Header;
+    for (uint32 i = 0; i < header->NumSlots; ++i)
+    {
+        OnnxCore::FWorkerSlot* slot = OnnxCore::GetWorkerSlot(header, i);
+        uint32 expected = static_cast<uint32>(OnnxCore::EWorkerSlotState::Free);
+        if (slot->State.compare_exchange_strong(expected, static_cast<uint32>(OnnxCore::EWorkerSlotState::Writing), std::memory_order_acq_rel))
+        {
+            slot->NumInputs = 0;
+            slot->NumOutputs = 0;
+            slot->OutputMask = 0;
+            slot->Error[0] = '\0';
+            slot_ = slot;
+            data_ = OnnxCore::GetWorkerSlotData(header, i);
+            return;
+        }
+    }
+
+    UE_LOG(LogTemp, Error, TEXT("%s: no free slot on ONNX worker %d"), *pool_.displayName_, worker_->Index);
+}
+
+FOnnxWorkerPool::FRequest::~FRequest()
+{
+    if (slot_)
+    {
+        slot_->State.store(static_cast<uint32>(OnnxCore::EWorkerSlotState::Free), std::memory_order_release);
+    }
+    if (worker_)
+    {
+        pool_.ReleaseWorker(worker_);
+    }
+}
+
+void* FOnnxWorkerPool::FRequest::AddInput(int32 Index, ONNXTensorElementDataType Type, TConstArrayView<int64> Shape)
+{
+    if (!slot_ || bExecuted_ || slot_->NumInputs >= uint32(OnnxCore::MaxWorkerTensors) || Index < 0 || Index >= pool_.GetNumInputs())
+    {
+        return nullptr;
+    }
+
+    OnnxCore::FWorkerTensorDesc& desc = slot_->Inputs[slot_->NumInputs];
+    if (!OnnxCore::AllocateWorkerTensor(worker_->Header->SlotDataBytes, used_, Type, reinterpret_cast<const int64_t*>(Shape.GetData()), Shape.Num(), desc))
+    {
+        UE_LOG(LogTemp, Error, TEXT("%s: input %s does not fit into the %d MB worker slot (increase SlotSizeMB)"), *pool_.displayName_,
+               UTF8_TO_TCHAR(pool_.GetInputInfo(Index).Name), pool_.workerSettings_.SlotSizeMB);
+        return nullptr;
+    }
+    desc.Index = Index;
+    ++slot_->NumInputs;
+    return data_ + desc.Offset;
+}
+
+bool FOnnxWorkerPool::FRequest::AddInput(int32 Index, const Ort::Value& Value)
+{
+    Ort::TensorTypeAndShapeInfo info = Value.GetTensorTypeAndShapeInfo();
+    const std::vector<int64_t> shape = info.GetShape();
+    void* dest = AddInput(Index, info.GetElementType(), TConstArrayView<int64>(reinterpret_cast<const int64*>(shape.data()), shape.size()));
+    if (!dest)
+    {
+        return false;
+    }
+    FMemory::Memcpy(dest, Value.GetTensorRawData(), slot_->Inputs[slot_->NumInputs - 1].Bytes);
+    return true;
+}
+
+void FOnnxWorkerPool::FRequest::SetOutputMask(uint64 Mask)
+{
+    if (slot_)
+    {
+        slot_->OutputMask = Mask;
+    }
+}
+
+bool FOnnxWorkerPool::FRequest::Execute()
+{
+    if (!slot_ || bExecuted_)
+    {
+        return false;
+    }
+    bExecuted_ = true;
+
+    // 提交：槽的内容先于状态对工作进程可见，然后敲门铃唤醒它
+    OnnxCore::FWorkerChannelHeader* header = worker_->Header;
+    slot_->Sequence = header->NextSequence.fetch_add(1, std::memory_order_relaxed);
+    slot_->State.store(static_cast<uint32>(OnnxCore::EWorkerSlotState::Submitted), std::memory_order_release);
+    header->Doorbell.fetch_add(1, std::memory_order_release);
+    OnnxCore::WakeAll(worker_->Region, header->Doorbell);
+
+    // 等待完成；每次醒来检查进程是否还在、是否超时
+    const double startTime = FPlatformTime::Seconds();
+    for (;;)
+    {
+        const uint32 state = slot_->State.load(std::memory_order_acquire);
+        if (state == static_cast<uint32>(OnnxCore::EWorkerSlotState::Done))
+        {
+            ++pool_.completedRequests_;
+            return true;
+        }
+        if (state == static_cast<uint32>(OnnxCore::EWorkerSlotState::Failed))
+        {
+            // 模型报错（例如输入形状不对），工作进程本身正常
+            ++pool_.failedRequests_;
+            UE_LOG(LogTemp, Error, TEXT("%s: ONNX worker request failed: %s"), *pool_.displayName_, UTF8_TO_TCHAR(slot_->Error));
+            return false;
+        }
+        if (!worker_->IsRunning())
+        {
+            ++pool_.failedRequests_;
+            pool_.HandleWorkerFailure(worker_, TEXT("exited while running a request"));
+            return false;
+        }
+        if (FPlatformTime::Seconds() - startTime > pool_.workerSettings_.RequestTimeoutSeconds)
+        {
+            ++pool_.failedRequests_;
+            pool_.HandleWorkerFailure(worker_, TEXT("timed out"));
+            return false;
+        }
+        OnnxCore::WaitForChange(worker_->Region, slot_->State, state, 50);
+    }
+}
+
+int32 FOnnxWorkerPool::FRequest::GetNumOutputs() const
+{
+    return slot_ && bExecuted_ ? static_cast<int32>(slot_->NumOutputs) : 0;
+}
+
+int32 FOnnxWorkerPool::FRequest::GetOutputIndex(int32 i) const
+{
+    return slot_->Outputs[i].Index;
+}
+
+int32 FOnnxWorkerPool::FRequest::FindOutput(int32 OutputIndex) const
+{
+    for (int32 i = 0; i < GetNumOutputs(); ++i)
+    {
+        if (slot_->Outputs[i].Index == OutputIndex)
+        {
+            return i;
+        }
+    }
+    return INDEX_NONE;
+}
+
+Ort::Value FOnnxWorkerPool::FRequest::GetOutput(int32 i) const
+{
+    const OnnxCore::FWorkerTensorDesc& desc = slot_->Outputs[i];
+    Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU);
+    return Ort::Value::CreateTensor(memoryInfo, data_ + desc.Offset, desc.Bytes, desc.Dims, desc.NumDims,
+                                    static_cast<ONNXTensorElementDataType>(desc.ElementType));
+}
+
+double FOnnxWorkerPool::FRequest::GetRunMs() const
+{
+    return slot_ ? slot_->RunMs : 0.0;
+}
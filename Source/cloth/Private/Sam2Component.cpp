@@ -5,6 +5,11 @@
 #include "Engine/Texture2D.h"
 #include "TextureResource.h"
 #include "HAL/PlatformFilemanager.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/FileManager.h"
+#include "ImageLoadHelper.h"
+#include "OnnxAutotuner.h"
+#include "OnnxPrepackedWeights.h"
 
 // 定义锁定常量（兼容不同UE版本）
 #ifndef LOCK_READ_ONLY
@@ -21,7 +26,8 @@ USam2Component::USam2Component()
 
 USam2Component::~USam2Component()
 {
-    // TUniquePtr自动清理
+    // 候选实例是子类成员，会先于基类的ShadowRunner析构，需要在这里先等待影子任务
+    ResetShadow();
 }
 
 void USam2Component::BeginPlay()
@@ -55,20 +61,25 @@ bool USam2Component::InitializeSam2Model()
 {
     try
     {
-        // 构造完整的模型路径
-        FString ProjectDir = FPaths::ProjectDir();
-        FString FullEncoderPath = FPaths::Combine(ProjectDir, Sam2EncoderPath);
-        FString FullDecoderPath = FPaths::Combine(ProjectDir, Sam2DecoderPath);
+        // 按选择策略决定加载的变体，构造完整的模型路径
+        const bool bValidated = Sam2VariantSelection.Policy == EOnnxVariantPolicy::Validated;
+        Sam2Precision = FOnnxModelVariants::ResolvePrecision(Sam2VariantSelection, GetAvailableSam2Variants(), bValidated ? MakeSam2VariantKey() : FString());
+
+        FString FullEncoderPath;
+        FString FullDecoderPath;
+        GetSam2VariantPaths(Sam2Precision, FullEncoderPath, FullDecoderPath);
 
         UE_LOG(LogTemp, Log, TEXT("Initializing SAM2 with Encoder: %s, Decoder: %s"), 
                *FullEncoderPath, *FullDecoderPath);
 
-        Sam2Instance = MakeUnique<FSam2ModelInstance>(FullEncoderPath, FullDecoderPath);
+        Sam2Instance = MakeShared<FSam2ModelInstance, ESPMode::ThreadSafe>(FullEncoderPath, FullDecoderPath, Sam2EncoderSettings, Sam2DecoderSettings, bHalfPrecisionFeatures, Sam2WorkerSettings);
 
         if (Sam2Instance && Sam2Instance->IsInitialized())
         {
             bIsInitialized = true;
             UE_LOG(LogTemp, Log, TEXT("SAM2 Component initialized successfully"));
+
+            InitializeShadow();
             return true;
         }
         else
@@ -97,6 +108,251 @@ bool USam2Component::IsInitialized() const
     return bIsInitialized && Sam2Instance && Sam2Instance->IsInitialized();
 }
 
+TFunction<TArray<FOnnxBenchmarkResult>()> USam2Component::MakeSpinBenchmarkJob(const FOnnxBenchmarkParams& Params, int32 IntraOpThreads) const
+{
+    if (!Sam2Instance || !Sam2Instance->IsInitialized())
+    {
+        UE_LOG(LogTemp, Error, TEXT("SAM2 instance not initialized"));
+        return nullptr;
+    }
+
+    TSharedPtr<FSam2ModelInstance, ESPMode::ThreadSafe> Instance = Sam2Instance;
+    return [Instance, Params, IntraOpThreads]() { return Instance->BenchmarkSpinModes(Params, IntraOpThreads); };
+}
+
+FOnnxResidencyStats USam2Component::GetResidencyStats() const
+{
+    return Sam2Instance ? Sam2Instance->GetResidencyStats() : FOnnxResidencyStats();
+}
+
+FOnnxAllocationStats USam2Component::GetAllocationStats() const
+{
+    return Sam2Instance ? Sam2Instance->GetAllocationStats() : FOnnxAllocationStats();
+}
+
+bool USam2Component::StartCapture(const FString& FilePath, const FOnnxCaptureConfig& Config)
+{
+    if (!Sam2Instance || !Sam2Instance->IsInitialized())
+    {
+        UE_LOG(LogTemp, Error, TEXT("SAM2 Component not initialized"));
+        return false;
+    }
+    return Sam2Instance->StartCapture(FilePath, Config);
+}
+
+void USam2Component::StopCapture()
+{
+    if (Sam2Instance)
+    {
+        Sam2Instance->StopCapture();
+    }
+}
+
+EOnnxExecutionProvider USam2Component::GetExecutionProvider() const
+{
+    // 编码器是卷积密集的部分，以它的EP为准
+    return Sam2Instance ? Sam2Instance->GetEncoderSettings().ExecutionProvider : EOnnxExecutionProvider::CPU;
+}
+
+TArray<FOnnxBenchmarkResult> USam2Component::AutotuneThreading(int32 Iterations, bool bTuneReplicas)
+{
+    if (!Sam2Instance || !Sam2Instance->IsInitialized())
+    {
+        UE_LOG(LogTemp, Error, TEXT("SAM2 instance not initialized"));
+        return TArray<FOnnxBenchmarkResult>();
+    }
+
+    FOnnxBenchmarkParams Params = FOnnxAutotuner::MakeDefaultParams();
+    Params.Iterations = FMath::Max(1, Iterations);
+
+    FOnnxAutotuneGrid Grid;
+    if (bTuneReplicas)
+    {
+        Grid.ReplicasPerNumaNode = { 1, 2, 4 };
+    }
+
+    TArray<FOnnxBenchmarkResult> Results;
+    for (const FOnnxAutotuneResult& Tuned : Sam2Instance->Autotune(Grid, Params))
+    {
+        Results.Append(Tuned.Results);
+    }
+
+    // 重新创建实例以应用保存的配置
+    ResetShadow();
+    Sam2Instance.Reset();
+    bIsInitialized = false;
+    InitializeModel();
+    return Results;
+}
+
+EOnnxModelPrecision USam2Component::GetModelPrecision() const
+{
+    return Sam2Instance ? Sam2Precision : EOnnxModelPrecision::FP32;
+}
+
+bool USam2Component::GetSam2VariantPaths(EOnnxModelPrecision Precision, FString& OutEncoderPath, FString& OutDecoderPath) const
+{
+    const FString ProjectDir = FPaths::ProjectDir();
+    OutEncoderPath = FPaths::Combine(ProjectDir, Sam2EncoderPath);
+    OutDecoderPath = FPaths::Combine(ProjectDir, Sam2DecoderPath);
+    if (Precision == EOnnxModelPrecision::FP32)
+    {
+        return true;
+    }
+
+    for (const FOnnxModelVariant& Variant : Sam2Variants)
+    {
+        if (Variant.Precision != Precision)
+        {
+            continue;
+        }
+
+        // 只量化编码器（卷积密集的部分）或只量化解码器都是常见的做法
+        const FString EncoderPath = Variant.ModelPath.IsEmpty() ? OutEncoderPath : FOnnxModelVariants::GetFullPath(Variant.ModelPath);
+        const FString DecoderPath = Variant.DecoderPath.IsEmpty() ? OutDecoderPath : FOnnxModelVariants::GetFullPath(Variant.DecoderPath);
+        if (FPaths::FileExists(EncoderPath) && FPaths::FileExists(DecoderPath))
+        {
+            OutEncoderPath = EncoderPath;
+            OutDecoderPath = DecoderPath;
+            return true;
+        }
+    }
+    return false;
+}
+
+TArray<EOnnxModelPrecision> USam2Component::GetAvailableSam2Variants() const
+{
+    TArray<EOnnxModelPrecision> Available;
+    FString EncoderPath;
+    FString DecoderPath;
+    for (const FOnnxModelVariant& Variant : Sam2Variants)
+    {
+        if (Variant.Precision != EOnnxModelPrecision::FP32 && GetSam2VariantPaths(Variant.Precision, EncoderPath, DecoderPath))
+        {
+            Available.AddUnique(Variant.Precision);
+        }
+    }
+    return Available;
+}
+
+FString USam2Component::MakeSam2VariantKey() const
+{
+    const FString FullEncoderPath = FPaths::Combine(FPaths::ProjectDir(), Sam2EncoderPath);
+    return FOnnxAutotuner::MakeModelKey(FPaths::GetBaseFilename(FullEncoderPath) + TEXT("_Variant"), FOnnxPrepackedWeightsRegistry::ComputeModelHash(FullEncoderPath));
+}
+
+TArray<FOnnxVariantReport> USam2Component::CompareModelVariants(const FString& SampleFolder, int32 Iterations)
+{
+    TArray<FOnnxVariantReport> Reports;
+
+    // 样本图像，提示点固定为图像中心的前景点
+    const FString FullFolder = FOnnxModelVariants::GetFullPath(SampleFolder);
+    TArray<FString> Files;
+    for (const TCHAR* Extension : { TEXT("*.png"), TEXT("*.jpg"), TEXT("*.jpeg") })
+    {
+        IFileManager::Get().FindFiles(Files, *FPaths::Combine(FullFolder, Extension), true, false);
+    }
+    Files.Sort();
+
+    TArray<FSam2Input> Samples;
+    for (const FString& File : Files)
+    {
+        FSam2Input Input;
+        UTexture2D* Texture = UImageLoadHelper::LoadTextureFromFile(FPaths::Combine(FullFolder, File));
+        if (!Texture || !SetImageFromTexture(Texture, Input))
+        {
+            UE_LOG(LogTemp, Warning, TEXT("Skipping sample image %s"), *File);
+            continue;
+        }
+        Input.PromptPoints.Add(FVector2D(0.5, 0.5));
+        Input.PromptLabels.Add(1);
+        Samples.Add(MoveTemp(Input));
+    }
+
+    if (Samples.Num() == 0)
+    {
+        UE_LOG(LogTemp, Error, TEXT("No sample images found in %s"), *FullFolder);
+        return Reports;
+    }
+
+    // 比较期间释放当前实例，避免多份模型同时驻留
+    const bool bWasInitialized = bIsInitialized;
+    ResetShadow();
+    Sam2Instance.Reset();
+    bIsInitialized = false;
+
+    TArray<EOnnxModelPrecision> Precisions = { EOnnxModelPrecision::FP32 };
+    Precisions.Append(GetAvailableSam2Variants());
+
+    Iterations = FMath::Max(1, Iterations);
+    TArray<TArray<float>> ReferenceMasks;
+
+    for (EOnnxModelPrecision Precision : Precisions)
+    {
+        FOnnxVariantReport& Report = Reports.AddDefaulted_GetRef();
+        Report.Precision = Precision;
+
+        FString EncoderPath;
+        FString DecoderPath;
+        GetSam2VariantPaths(Precision, EncoderPath, DecoderPath);
+        Report.ModelPath = FPaths::GetCleanFilename(EncoderPath) + TEXT(" + ") + FPaths::GetCleanFilename(DecoderPath);
+
+        FSam2ModelInstance Instance(EncoderPath, DecoderPath, Sam2EncoderSettings, Sam2DecoderSettings, bHalfPrecisionFeatures);
+        if (!Instance.IsInitialized())
+        {
+            UE_LOG(LogTemp, Error, TEXT("Failed to load SAM2 %s variant"), FOnnxModelVariants::GetDisplayName(Precision));
+            continue;
+        }
+
+        FOnnxVariantErrorStats Stats;
+        bool bSucceeded = true;
+        for (int32 SampleIndex = 0; SampleIndex < Samples.Num() && bSucceeded; ++SampleIndex)
+        {
+            // 第一次运行同时作为预热并获取掩码
+            FSam2Output Output;
+            if (!Instance.RunInference(Samples[SampleIndex], Output))
+            {
+                bSucceeded = false;
+                break;
+            }
+
+            const double StartTime = FPlatformTime::Seconds();
+            for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+            {
+                FSam2Output Discarded;
+                Instance.RunInference(Samples[SampleIndex], Discarded);
+            }
+            Stats.SumSeconds += (FPlatformTime::Seconds() - StartTime) / Iterations;
+            ++Stats.NumSamples;
+
+            if (Precision == EOnnxModelPrecision::FP32)
+            {
+                ReferenceMasks.Add(MoveTemp(Output.MaskData));
+            }
+            else if (ReferenceMasks.IsValidIndex(SampleIndex) && Stats.AddOutput(Output.MaskData, ReferenceMasks[SampleIndex]))
+            {
+                Stats.AddMask(Output.MaskData, ReferenceMasks[SampleIndex], Sam2VariantSelection.MaskThreshold);
+            }
+            else
+            {
+                bSucceeded = false;
+            }
+        }
+
+        Report.bSucceeded = bSucceeded;
+        Stats.FillReport(Report);
+    }
+
+    FOnnxModelVariants::FinalizeReports(Reports, Sam2VariantSelection, MakeSam2VariantKey(), true);
+    FOnnxModelVariants::LogReports(Reports);
+
+    if (bWasInitialized)
+    {
+        InitializeModel();
+    }
+    return Reports;
+}
+
 bool USam2Component::RunSam2Segmentation(const FSam2Input& Input, FSam2Output& Output)
 {
     if (!Sam2Instance || !Sam2Instance->IsInitialized())
@@ -105,7 +361,88 @@ bool USam2Component::RunSam2Segmentation(const FSam2Input& Input, FSam2Output& O
         return false;
     }
 
-    return Sam2Instance->RunInference(Input, Output);
+    const double StartTime = FPlatformTime::Seconds();
+    if (!Sam2Instance->RunInference(Input, Output))
+    {
+        return false;
+    }
+
+    if (ShadowRunner && ShadowRunner->ShouldMirror())
+    {
+        const double ProductionSeconds = FPlatformTime::Seconds() - StartTime;
+        FSam2ModelInstance* Candidate = ShadowSam2Instance.Get();
+        const float MaskThreshold = ShadowConfig.MaskThreshold;
+        ShadowRunner->Submit(ProductionSeconds, [Candidate, MaskThreshold, CandidateInput = Input, Production = Output.MaskData](FOnnxShadowSample& Sample)
+        {
+            FSam2Output CandidateOutput;
+            const double CandidateStart = FPlatformTime::Seconds();
+            Sample.bSucceeded = Candidate->RunInference(CandidateInput, CandidateOutput);
+            Sample.CandidateSeconds = FPlatformTime::Seconds() - CandidateStart;
+            if (Sample.bSucceeded)
+            {
+                Sample.RelativeL2 = FOnnxShadowRunner::ComputeRelativeL2(CandidateOutput.MaskData, Production);
+                if (Sample.RelativeL2 >= 0.0f)
+                {
+                    Sample.MaskIoU = FOnnxShadowRunner::ComputeMaskIoU(CandidateOutput.MaskData, Production, MaskThreshold);
+                }
+            }
+        });
+    }
+    return true;
+}
+
+void USam2Component::InitializeShadow()
+{
+    if (!ShadowConfig.bEnabled)
+    {
+        return;
+    }
+
+    if (ShadowConfig.CandidateSam2EncoderPath.IsEmpty() && ShadowConfig.CandidateSam2DecoderPath.IsEmpty())
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Shadow mode enabled but no candidate SAM2 encoder/decoder specified"));
+        return;
+    }
+
+    try
+    {
+        // 只替换其中一个模型时另一个沿用生产路径
+        const FString ProjectDir = FPaths::ProjectDir();
+        const FString EncoderPath = FPaths::Combine(ProjectDir, ShadowConfig.CandidateSam2EncoderPath.IsEmpty() ? Sam2EncoderPath : ShadowConfig.CandidateSam2EncoderPath);
+        const FString DecoderPath = FPaths::Combine(ProjectDir, ShadowConfig.CandidateSam2DecoderPath.IsEmpty() ? Sam2DecoderPath : ShadowConfig.CandidateSam2DecoderPath);
+
+        // 候选会话使用减半的低优先级线程，不与生产编码器/解码器争抢CPU
+        FOnnxSessionSettings CandidateEncoderSettings = Sam2EncoderSettings;
+        FOnnxSessionSettings CandidateDecoderSettings = Sam2DecoderSettings;
+        CandidateEncoderSettings.bLowPriorityThreads = true;
+        CandidateDecoderSettings.bLowPriorityThreads = true;
+
+        TUniquePtr<FSam2ModelInstance> Candidate = MakeUnique<FSam2ModelInstance>(EncoderPath, DecoderPath, CandidateEncoderSettings, CandidateDecoderSettings, bHalfPrecisionFeatures, Sam2WorkerSettings);
+        if (!Candidate->IsInitialized())
+        {
+            UE_LOG(LogTemp, Warning, TEXT("Failed to initialize shadow SAM2 candidate"));
+            return;
+        }
+
+        // SAM2实例的缓冲区不支持并发推理，同一时刻只允许一个影子请求
+        FOnnxShadowConfig RunnerConfig = ShadowConfig;
+        RunnerConfig.MaxInFlight = 1;
+
+        ShadowSam2Instance = MoveTemp(Candidate);
+        ShadowRunner = MakeUnique<FOnnxShadowRunner>(RunnerConfig);
+        UE_LOG(LogTemp, Log, TEXT("SAM2 shadow mode enabled (sample rate %.2f)"), ShadowConfig.SampleRate);
+    }
+    catch (const std::exception& e)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Exception creating shadow SAM2 candidate: %s"), UTF8_TO_TCHAR(e.what()));
+        ShadowSam2Instance.Reset();
+    }
+}
+
+void USam2Component::ResetShadow()
+{
+    Super::ResetShadow();
+    ShadowSam2Instance.Reset();
 }
 
 bool USam2Component::SetImageFromTexture(UTexture2D* Texture, FSam2Input& Sam2Input)
@@ -122,10 +459,29 @@ bool USam2Component::SetImageFromTexture(UTexture2D* Texture, FSam2Input& Sam2In
     {
         Sam2Input.ImageWidth = Width;
         Sam2Input.ImageHeight = Height;
+        // 有效的图像张量优先于ImageData
+        Sam2Input.Image = FOnnxTensor();
     }
     return bSuccess;
 }
 
+bool USam2Component::SetImageFromTensor(const FOnnxTensor& Tensor, FSam2Input& Sam2Input)
+{
+    const TConstArrayView<int64> Shape = Tensor.GetShape();
+    const bool bValidRank = Shape.Num() == 3 || (Shape.Num() == 4 && Shape[0] == 1);
+    if (Tensor.GetType() != EOnnxTensorType::Float || !bValidRank || Shape.Last() != 3)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Image tensor must be a Float tensor with shape {Height, Width, 3} or {1, Height, Width, 3}"));
+        return false;
+    }
+
+    Sam2Input.Image = Tensor;
+    Sam2Input.ImageHeight = static_cast<int32>(Shape[Shape.Num() - 3]);
+    Sam2Input.ImageWidth = static_cast<int32>(Shape[Shape.Num() - 2]);
+    Sam2Input.ImageData.Empty();
+    return true;
+}
+
 void USam2Component::AddPromptPoint(FSam2Input& Sam2Input, FVector2D Point, bool bIsForeground)
 {
     Sam2Input.PromptPoints.Add(Point);
@@ -3,6 +3,14 @@
 #include "Sam2ModelInstance.h"
 #include "HAL/PlatformFilemanager.h"
 #include "Interfaces/IPluginManager.h"
+#include "OnnxRuntime.h"
+#include "OnnxAutotuner.h"
+#include "OnnxExecutionProviders.h"
+#include "HAL/FileManager.h"
+#include "OnnxHalf.h"
+#include "Misc/Paths.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/ScopeLock.h"
 
 // 包含ONNX Runtime的实现头文件
 #if PLATFORM_WINDOWS && PLATFORM_64BITS
@@ -13,27 +21,182 @@
 #include "Windows/HideWindowsPlatformTypes.h"
 #endif
 
-FSam2ModelInstance::FSam2ModelInstance(const FString& EncoderPath, const FString& DecoderPath)
+namespace
+{
+    // 解码器输入（顺序与RunDecoder中创建张量的顺序一致）
+    const char* const DecoderInputNames[] = {
+        "image_embed", "high_res_feats_0", "high_res_feats_1", "point_coords",
+        "point_labels", "mask_input", "has_mask_input", "orig_im_size"
+    };
+    static_assert(UE_ARRAY_COUNT(DecoderInputNames) == FSam2ModelInstance::NumDecoderInputs, "Decoder input count mismatch");
+
+    const char* const EncoderOutputNames[] = {"high_res_feats_0", "high_res_feats_1", "image_embed"};
+    const char* const DecoderOutputNames[] = {"masks", "iou_predictions"};
+
+    // 固定的输入形状
+    const int64_t ImageShape[] = {1, 3, 1024, 1024};
+    const int64_t ImageEmbedShape[] = {1, 256, 64, 64};
+    const int64_t HighResFeats0Shape[] = {1, 32, 256, 256};
+    const int64_t HighResFeats1Shape[] = {1, 64, 128, 128};
+    const int64_t MaskInputShape[] = {1, 1, 256, 256};
+    const int64_t HasMaskInputShape[] = {1};
+    const int64_t OrigImSizeShape[] = {2};
+
+    TConstArrayView<int64> MakeShapeView(const int64_t* Shape, int32 NumDims)
+    {
+        return TConstArrayView<int64>(reinterpret_cast<const int64*>(Shape), NumDims);
+    }
+
+    // 把float数据写入工作进程请求的一个输入（Type为FLOAT16时在写入时转换）
+    bool AddWorkerInput(FOnnxWorkerPool::FRequest& Request, int32 Index, ONNXTensorElementDataType Type,
+                        const float* Data, int32 Count, TConstArrayView<int64> Shape)
+    {
+        void* Dest = Request.AddInput(Index, Type, Shape);
+        if (!Dest)
+        {
+            return false;
+        }
+        if (Type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16)
+        {
+            FOnnxHalf::ConvertToHalf(Data, static_cast<uint16*>(Dest), Count);
+        }
+        else
+        {
+            FMemory::Memcpy(Dest, Data, Count * sizeof(float));
+        }
+        return true;
+    }
+
+    // 把编码器输出（共享内存中的张量）写入解码器请求，精度不同时转换
+    bool AddWorkerFeature(FOnnxWorkerPool::FRequest& Request, int32 Index, ONNXTensorElementDataType Type, const Ort::Value& Feature)
+    {
+        Ort::TensorTypeAndShapeInfo Info = Feature.GetTensorTypeAndShapeInfo();
+        const ONNXTensorElementDataType SourceType = Info.GetElementType();
+        if (SourceType == Type)
+        {
+            return Request.AddInput(Index, Feature);
+        }
+
+        const std::vector<int64_t> Shape = Info.GetShape();
+        void* Dest = Request.AddInput(Index, Type, MakeShapeView(Shape.data(), static_cast<int32>(Shape.size())));
+        if (!Dest)
+        {
+            return false;
+        }
+        const int64 Count = Info.GetElementCount();
+        if (SourceType == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT && Type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16)
+        {
+            FOnnxHalf::ConvertToHalf(Feature.GetTensorData<float>(), static_cast<uint16*>(Dest), Count);
+            return true;
+        }
+        if (SourceType == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16 && Type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT)
+        {
+            FOnnxHalf::ConvertToFloat(static_cast<const uint16*>(Feature.GetTensorRawData()), static_cast<float*>(Dest), Count);
+            return true;
+        }
+        UE_LOG(LogTemp, Error, TEXT("SAM2: unsupported encoder output type %d"), static_cast<int32>(SourceType));
+        return false;
+    }
+}
+
+FSam2ModelInstance::FSam2ModelInstance(const FString& EncoderPath, const FString& DecoderPath,
+                                       const FOnnxSessionSettings& InEncoderSettings, const FOnnxSessionSettings& InDecoderSettings,
+                                       bool bInHalfPrecisionFeatures, const FOnnxWorkerSettings& InWorkerSettings)
     : EncoderModelPath(EncoderPath)
     , DecoderModelPath(DecoderPath)
+    , EncoderSettings(InEncoderSettings)
+    , DecoderSettings(InDecoderSettings)
     , bIsInitialized(false)
     , bHasCachedFeatures(false)
+    , bHalfPrecisionFeatures(FOnnxTuning::GetSam2HalfPrecisionFeatures(bInHalfPrecisionFeatures))
+    , bBaseHalfPrecisionFeatures(bInHalfPrecisionFeatures)
 {
+    // 解码器的常量输入只创建一次，推理时直接引用
+    MaskInput.SetNumZeroed(1 * 1 * 256 * 256);
+    HasMaskInput = {0.0f};
+    OrigImSize = {1024, 1024};
+
+    // 编码器和解码器的ORT分配都记到本实例名下
+    MemoryOwner.Register(FString::Printf(TEXT("SAM2 (%s)"), *FPaths::GetBaseFilename(EncoderPath)));
+
     UE_LOG(LogTemp, Log, TEXT("Creating FSam2ModelInstance..."));
     UE_LOG(LogTemp, Log, TEXT("Encoder Path: %s"), *EncoderPath);
     UE_LOG(LogTemp, Log, TEXT("Decoder Path: %s"), *DecoderPath);
 
+    // 特征缓存和常量输入张量同样是Ort对象，需要ORT已加载
+    if (!FOnnxRuntime::LoadApi())
+    {
+        return;
+    }
+
     try
     {
-        // 创建ONNX环境
-        Env = MakeUnique<Ort::Env>(ORT_LOGGING_LEVEL_WARNING, "SAM2Model");
-        UE_LOG(LogTemp, Log, TEXT("ONNX Environment created"));
+        // 进程外模式：会话在工作进程中创建，本进程不加载模型
+        if (InWorkerSettings.bEnabled)
+        {
+            if (!InitializeWorkers(InWorkerSettings))
+            {
+                UE_LOG(LogTemp, Error, TEXT("Failed to start SAM2 ONNX workers"));
+                EncoderWorkers.Reset();
+                DecoderWorkers.Reset();
+                return;
+            }
+            bIsInitialized = true;
+            UE_LOG(LogTemp, Log, TEXT("SAM2 Model Instance initialized with ONNX workers"));
+
+            // 会话级控制台变量变化时按新配置逐个替换工作进程
+            Tuning.Register(FString::Printf(TEXT("SAM2 (%s)"), *FPaths::GetBaseFilename(EncoderModelPath)),
+                            [this](bool bForce)
+                            {
+                                FOnnxSessionSettings NewEncoderSettings;
+                                FOnnxSessionSettings NewDecoderSettings;
+                                ComputeOverriddenSettings(NewEncoderSettings, NewDecoderSettings);
+                                const bool bEncoderChanged = bForce || !FOnnxTuning::SessionSettingsEqual(NewEncoderSettings, GetEncoderSettings());
+                                const bool bDecoderChanged = bForce || !FOnnxTuning::SessionSettingsEqual(NewDecoderSettings, GetDecoderSettings());
+                                SetSessionSettings(NewEncoderSettings, NewDecoderSettings);
+                                if (bEncoderChanged)
+                                {
+                                    EncoderWorkers->Restart(NewEncoderSettings);
+                                }
+                                if (bDecoderChanged)
+                                {
+                                    DecoderWorkers->Restart(NewDecoderSettings);
+                                }
+                            },
+                            [this]() { return FString::Printf(TEXT("workers: encoder %s, decoder %s"), *GetEncoderSettings().ToString(), *GetDecoderSettings().ToString()); });
+            return;
+        }
+
+        const int64 memoryBefore = FOnnxResidencyManager::GetProcessUsedPhysical();
 
         // 初始化编码器和解码器
         if (InitializeEncoder() && InitializeDecoder())
         {
+            CacheInputTypes();
             bIsInitialized = true;
             UE_LOG(LogTemp, Log, TEXT("SAM2 Model Instance initialized successfully"));
+
+            // 登记到驻留管理器：空闲时会话和缓存的特征都可以被释放，下次推理时重新加载
+            SessionBytes = FMath::Max(FOnnxResidencyManager::GetProcessUsedPhysical() - memoryBefore, GetModelFileBytes());
+            Residency.Register(FString::Printf(TEXT("SAM2 (%s)"), *FPaths::GetBaseFilename(EncoderModelPath)),
+                               [this]() { return ReloadSessions(); }, [this]() { ReleaseSessions(); }, SessionBytes);
+
+            // 会话级控制台变量或特征精度变化时在后台重建
+            Tuning.Register(FString::Printf(TEXT("SAM2 (%s)"), *FPaths::GetBaseFilename(EncoderModelPath)),
+                            [this](bool bForce)
+                            {
+                                RunPendingAutotune();
+                                RebuildSessions(bForce);
+                            },
+                            [this]() { return FString::Printf(TEXT("encoder %s, decoder %s, %s features"), *GetEncoderSettings().ToString(),
+                                                              *GetDecoderSettings().ToString(), bHalfPrecisionFeatures ? TEXT("fp16") : TEXT("fp32")); });
+
+            // EP选择和首次调优在后台进行，选出的配置不同时经由RebuildSessions换入
+            if (bEncoderAutotunePending || bDecoderAutotunePending)
+            {
+                UE_LOG(LogTemp, Log, TEXT("SAM2: selecting execution providers / tuning in the background"));
+                Tuning.RequestRebuild(false);
+            }
         }
         else
         {
@@ -55,6 +218,12 @@ FSam2ModelInstance::FSam2ModelInstance(const FString& EncoderPath, const FString
 FSam2ModelInstance::~FSam2ModelInstance()
 {
     UE_LOG(LogTemp, Log, TEXT("Destroying FSam2ModelInstance"));
+
+    // 先停止后台重建，它引用了会话和驻留句柄；进行中的调优不再创建新会话
+    bShuttingDown = true;
+    Tuning.Unregister();
+    EncoderWorkers.Reset();
+    DecoderWorkers.Reset();
 }
 
 bool FSam2ModelInstance::IsInitialized() const
@@ -72,14 +241,28 @@ bool FSam2ModelInstance::InitializeEncoder()
             return false;
         }
 
-        // 创建会话选项
-        Ort::SessionOptions sessionOptions;
-        sessionOptions.SetIntraOpNumThreads(1);
+        // 应用本机已保存的EP选择和调优结果，还需要测试时推迟到后台
+        bool bNeedsTuning = false;
+        EncoderSettings = FOnnxAutotuner::ResolveCachedSettings(GetModelKey(EncoderModelPath), EncoderSettings, bNeedsTuning);
+        bEncoderAutotunePending = bNeedsTuning;
+        BaseEncoderSettings = EncoderSettings;
+        EncoderSettings = FOnnxTuning::ApplySessionOverrides(BaseEncoderSettings);
 
         // 创建编码器会话
-        EncoderSession = MakeUnique<Ort::Session>(*Env, *EncoderModelPath, sessionOptions);
+        EncoderSession = CreateEncoderSession(EncoderSettings);
+        if (!EncoderSession && EncoderSettings.ExecutionProvider != EOnnxExecutionProvider::CPU)
+        {
+            UE_LOG(LogTemp, Warning, TEXT("Falling back to the default CPU execution provider"));
+            EncoderSettings.ExecutionProvider = EOnnxExecutionProvider::CPU;
+            BaseEncoderSettings.ExecutionProvider = EOnnxExecutionProvider::CPU;
+            EncoderSession = CreateEncoderSession(EncoderSettings);
+        }
+        if (!EncoderSession)
+        {
+            return false;
+        }
         
-        UE_LOG(LogTemp, Log, TEXT("Encoder session created successfully"));
+        UE_LOG(LogTemp, Log, TEXT("Encoder session created successfully (%s)"), *EncoderSettings.ToString());
 
         // 获取编码器输入输出信息
         size_t numInputNodes = EncoderSession->GetInputCount();
@@ -101,6 +284,8 @@ bool FSam2ModelInstance::InitializeEncoder()
             UE_LOG(LogTemp, Log, TEXT("Encoder Output %d: %s"), i, UTF8_TO_TCHAR(outputName.get()));
         }
 
+        CreateEncoderPool();
+
         return true;
     }
     catch (const Ort::Exception& e)
@@ -120,14 +305,28 @@ bool FSam2ModelInstance::InitializeDecoder()
             return false;
         }
 
-        // 创建会话选项
-        Ort::SessionOptions sessionOptions;
-        sessionOptions.SetIntraOpNumThreads(1);
+        // 应用本机已保存的EP选择和调优结果，还需要测试时推迟到后台
+        bool bNeedsTuning = false;
+        DecoderSettings = FOnnxAutotuner::ResolveCachedSettings(GetModelKey(DecoderModelPath), DecoderSettings, bNeedsTuning);
+        bDecoderAutotunePending = bNeedsTuning;
+        BaseDecoderSettings = DecoderSettings;
+        DecoderSettings = FOnnxTuning::ApplySessionOverrides(BaseDecoderSettings);
 
         // 创建解码器会话
-        DecoderSession = MakeUnique<Ort::Session>(*Env, *DecoderModelPath, sessionOptions);
+        DecoderSession = CreateDecoderSession(DecoderSettings);
+        if (!DecoderSession && DecoderSettings.ExecutionProvider != EOnnxExecutionProvider::CPU)
+        {
+            UE_LOG(LogTemp, Warning, TEXT("Falling back to the default CPU execution provider"));
+            DecoderSettings.ExecutionProvider = EOnnxExecutionProvider::CPU;
+            BaseDecoderSettings.ExecutionProvider = EOnnxExecutionProvider::CPU;
+            DecoderSession = CreateDecoderSession(DecoderSettings);
+        }
+        if (!DecoderSession)
+        {
+            return false;
+        }
         
-        UE_LOG(LogTemp, Log, TEXT("Decoder session created successfully"));
+        UE_LOG(LogTemp, Log, TEXT("Decoder session created successfully (%s)"), *DecoderSettings.ToString());
 
         // 获取解码器输入输出信息
         size_t numInputNodes = DecoderSession->GetInputCount();
@@ -158,6 +357,523 @@ bool FSam2ModelInstance::InitializeDecoder()
     }
 }
 
+bool FSam2ModelInstance::InitializeWorkers(const FOnnxWorkerSettings& WorkerSettings)
+{
+    // 不做自动调优：调优结果针对进程内会话，工作进程只应用资产配置和控制台变量
+    BaseEncoderSettings = EncoderSettings;
+    BaseDecoderSettings = DecoderSettings;
+    EncoderSettings = FOnnxTuning::ApplySessionOverrides(BaseEncoderSettings);
+    DecoderSettings = FOnnxTuning::ApplySessionOverrides(BaseDecoderSettings);
+
+    EncoderWorkers = MakeUnique<FOnnxWorkerPool>();
+    DecoderWorkers = MakeUnique<FOnnxWorkerPool>();
+    if (!EncoderWorkers->Start(EncoderModelPath, EncoderSettings, WorkerSettings, TEXT("SAM2 Encoder")) ||
+        !DecoderWorkers->Start(DecoderModelPath, DecoderSettings, WorkerSettings, TEXT("SAM2 Decoder")))
+    {
+        return false;
+    }
+
+    const int32 ImageIndex = EncoderWorkers->FindInput("image");
+    if (ImageIndex == INDEX_NONE)
+    {
+        UE_LOG(LogTemp, Error, TEXT("SAM2 encoder has no image input"));
+        return false;
+    }
+    EncoderImageType = static_cast<ONNXTensorElementDataType>(EncoderWorkers->GetInputInfo(ImageIndex).ElementType);
+
+    DecoderInputTypes.SetNum(NumDecoderInputs);
+    for (int32 i = 0; i < NumDecoderInputs; ++i)
+    {
+        const int32 Index = DecoderWorkers->FindInput(DecoderInputNames[i]);
+        if (Index == INDEX_NONE)
+        {
+            UE_LOG(LogTemp, Error, TEXT("SAM2 decoder has no %s input"), UTF8_TO_TCHAR(DecoderInputNames[i]));
+            return false;
+        }
+        DecoderInputTypes[i] = static_cast<ONNXTensorElementDataType>(DecoderWorkers->GetInputInfo(Index).ElementType);
+    }
+    return true;
+}
+
+FOnnxWorkerPoolStats FSam2ModelInstance::GetEncoderWorkerStats() const
+{
+    return EncoderWorkers ? EncoderWorkers->GetStats() : FOnnxWorkerPoolStats();
+}
+
+FOnnxWorkerPoolStats FSam2ModelInstance::GetDecoderWorkerStats() const
+{
+    return DecoderWorkers ? DecoderWorkers->GetStats() : FOnnxWorkerPoolStats();
+}
+
+TUniquePtr<Ort::Session> FSam2ModelInstance::CreateModelSession(const FString& ModelPath, const FOnnxSessionSettings& Settings,
+                                                                 FOnnxPrepackedWeightsPtr& PrepackedWeights,
+                                                                 TArray<FOnnxMappedExternalFilePtr>& ExternalData)
+{
+    try
+    {
+        FOnnxMemoryOwner::FScope memoryScope(MemoryOwner);
+
+        // 共享运行时必须先于任何Ort对象创建（第一次使用时在这里加载ORT）
+        FOnnxRuntime& runtime = FOnnxRuntime::Get();
+        if (!runtime.IsAvailable())
+        {
+            return nullptr;
+        }
+
+        // 创建会话选项：插件线程策略 + 模型自身的配置
+        Ort::SessionOptions sessionOptions;
+        runtime.ConfigureSessionOptions(sessionOptions, Settings);
+        Settings.ApplyTo(sessionOptions);
+
+        // 模型旁的外部数据文件以内存映射方式注入（重复创建时复用已有映射）
+        TArray<FOnnxMappedExternalFilePtr> mappings;
+        if (!FOnnxExternalDataRegistry::ApplyToSessionOptions(sessionOptions,
+                FOnnxExternalDataRegistry::FindExternalDataFiles(ModelPath), mappings))
+        {
+            UE_LOG(LogTemp, Error, TEXT("Failed to map external data for %s"), *ModelPath);
+            return nullptr;
+        }
+        if (ExternalData.Num() == 0)
+        {
+            ExternalData = MoveTemp(mappings);
+        }
+
+        // 同一模型的所有会话共享预打包权重
+        if (!PrepackedWeights.IsValid())
+        {
+            PrepackedWeights = FOnnxPrepackedWeightsRegistry::FindOrCreate(
+                FOnnxPrepackedWeightsRegistry::ComputeModelHash(ModelPath));
+        }
+
+        const std::basic_string<ORTCHAR_T> ortPath = FOnnxRuntime::ToOrtString(ModelPath);
+        const double startTime = FPlatformTime::Seconds();
+        TUniquePtr<Ort::Session> session = PrepackedWeights.IsValid()
+            ? MakeUnique<Ort::Session>(runtime.GetEnv(), ortPath.c_str(), sessionOptions, PrepackedWeights->Get())
+            : MakeUnique<Ort::Session>(runtime.GetEnv(), ortPath.c_str(), sessionOptions);
+        FOnnxRuntime::ReportSessionCreated(FPaths::GetBaseFilename(ModelPath), FPlatformTime::Seconds() - startTime);
+        return session;
+    }
+    catch (const Ort::Exception& e)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to create session for %s (%s): %s"), *ModelPath, *Settings.ToString(), UTF8_TO_TCHAR(e.what()));
+        return nullptr;
+    }
+}
+
+void FSam2ModelInstance::RunPendingAutotune()
+{
+    const bool bTuneEncoder = bEncoderAutotunePending.exchange(false);
+    const bool bTuneDecoder = bDecoderAutotunePending.exchange(false);
+    if (!bTuneEncoder && !bTuneDecoder)
+    {
+        return;
+    }
+
+    FOnnxSessionSettings Encoder;
+    FOnnxSessionSettings Decoder;
+    {
+        FScopeLock Lock(&SettingsMutex);
+        Encoder = BaseEncoderSettings;
+        Decoder = BaseDecoderSettings;
+    }
+
+    if (bTuneEncoder)
+    {
+        Encoder = FOnnxAutotuner::ResolveSettings(GetModelKey(EncoderModelPath), Encoder,
+            [this](const FOnnxSessionSettings& Settings)
+            {
+                return bShuttingDown ? TUniquePtr<Ort::Session>() : CreateEncoderSession(Settings);
+            }, FOnnxAutotuner::MakeDefaultParams());
+    }
+    if (bTuneDecoder && !bShuttingDown)
+    {
+        Decoder = FOnnxAutotuner::ResolveSettings(GetModelKey(DecoderModelPath), Decoder,
+            [this](const FOnnxSessionSettings& Settings)
+            {
+                return bShuttingDown ? TUniquePtr<Ort::Session>() : CreateDecoderSession(Settings);
+            }, MakeDecoderBenchmarkParams(FOnnxAutotuner::MakeDefaultParams()));
+    }
+    if (bShuttingDown)
+    {
+        return;
+    }
+
+    FScopeLock Lock(&SettingsMutex);
+    BaseEncoderSettings = Encoder;
+    BaseDecoderSettings = Decoder;
+}
+
+FOnnxSessionSettings FSam2ModelInstance::GetEncoderSettings() const
+{
+    FScopeLock Lock(&SettingsMutex);
+    return EncoderSettings;
+}
+
+FOnnxSessionSettings FSam2ModelInstance::GetDecoderSettings() const
+{
+    FScopeLock Lock(&SettingsMutex);
+    return DecoderSettings;
+}
+
+void FSam2ModelInstance::SetSessionSettings(const FOnnxSessionSettings& NewEncoderSettings, const FOnnxSessionSettings& NewDecoderSettings)
+{
+    FScopeLock Lock(&SettingsMutex);
+    EncoderSettings = NewEncoderSettings;
+    DecoderSettings = NewDecoderSettings;
+}
+
+void FSam2ModelInstance::ComputeOverriddenSettings(FOnnxSessionSettings& OutEncoderSettings, FOnnxSessionSettings& OutDecoderSettings) const
+{
+    {
+        FScopeLock Lock(&SettingsMutex);
+        OutEncoderSettings = BaseEncoderSettings;
+        OutDecoderSettings = BaseDecoderSettings;
+    }
+    OutEncoderSettings = FOnnxTuning::ApplySessionOverrides(OutEncoderSettings);
+    OutDecoderSettings = FOnnxTuning::ApplySessionOverrides(OutDecoderSettings);
+}
+
+void FSam2ModelInstance::CreateEncoderPool()
+{
+    // 编码器是最重的部分，按NUMA节点复制，请求路由到调用线程所在节点的副本
+    const FOnnxSessionSettings Settings = GetEncoderSettings();
+    if (Settings.ReplicasPerNumaNode > 0)
+    {
+        EncoderPool = MakeUnique<FOnnxNumaSessionPool>();
+        if (!EncoderPool->Initialize([this](const FOnnxSessionSettings& ReplicaSettings) { return CreateEncoderSession(ReplicaSettings); },
+                                     Settings, Settings.ReplicasPerNumaNode, FOnnxBenchmarkParams(), TEXT("SAM2 Encoder")))
+        {
+            UE_LOG(LogTemp, Warning, TEXT("SAM2 encoder NUMA replicas unavailable, using a single session"));
+            EncoderPool.Reset();
+        }
+    }
+}
+
+bool FSam2ModelInstance::ReloadSessions()
+{
+    const int64 memoryBefore = FOnnxResidencyManager::GetProcessUsedPhysical();
+
+    // 配置（包括EP回退）在首次初始化时已经确定，这里直接按最终配置创建
+    EncoderSession = CreateEncoderSession(GetEncoderSettings());
+    DecoderSession = CreateDecoderSession(GetDecoderSettings());
+    if (!EncoderSession || !DecoderSession)
+    {
+        ReleaseSessions();
+        return false;
+    }
+    CreateEncoderPool();
+
+    SessionBytes = FMath::Max(FOnnxResidencyManager::GetProcessUsedPhysical() - memoryBefore, GetModelFileBytes());
+    Residency.SetResidentBytes(SessionBytes + GetCachedFeatureBytes());
+    return true;
+}
+
+void FSam2ModelInstance::ReleaseSessions()
+{
+    EncoderPool.Reset();
+    EncoderSession.Reset();
+    DecoderSession.Reset();
+
+    // 其他实例仍在使用同一模型时预打包权重会继续保留
+    EncoderPrepackedWeights.Reset();
+    DecoderPrepackedWeights.Reset();
+
+    // RunInference每次都会重新编码图像，缓存和暂存区可以直接丢弃，重新加载后再预热
+    CachedImageEmbed.Empty();
+    CachedHighResFeats0.Empty();
+    CachedHighResFeats1.Empty();
+    bHasCachedFeatures = false;
+
+    ImageScratch.Empty();
+    HalfImageScratch.Empty();
+    for (TArray<float>& Scratch : FeatureFloatScratch)
+    {
+        Scratch.Empty();
+    }
+    for (TArray<uint16>& Scratch : DecoderHalfScratch)
+    {
+        Scratch.Empty();
+    }
+    for (FOnnxOutputSlot& Slot : EncoderOutputSlots)
+    {
+        Slot.FloatScratch.Empty();
+        Slot.HalfScratch.Empty();
+    }
+    Allocations.RestartWarmup();
+
+    UE_LOG(LogTemp, Log, TEXT("Released SAM2 sessions and cached features"));
+}
+
+void FSam2ModelInstance::RebuildSessions(bool bForce)
+{
+    FOnnxSessionSettings NewEncoderSettings;
+    FOnnxSessionSettings NewDecoderSettings;
+    ComputeOverriddenSettings(NewEncoderSettings, NewDecoderSettings);
+    const bool bNewHalfPrecision = FOnnxTuning::GetSam2HalfPrecisionFeatures(bBaseHalfPrecisionFeatures);
+
+    const bool bSessionsChanged = bForce || !FOnnxTuning::SessionSettingsEqual(NewEncoderSettings, GetEncoderSettings()) ||
+                                  !FOnnxTuning::SessionSettingsEqual(NewDecoderSettings, GetDecoderSettings());
+    const bool bPrecisionChanged = bNewHalfPrecision != bHalfPrecisionFeatures;
+    if (!bSessionsChanged && !bPrecisionChanged)
+    {
+        return;
+    }
+
+    // 只切换特征精度，或者模型已被驱逐（下次加载时按新配置创建）时不需要创建会话
+    if (!bSessionsChanged || !Residency.GetStats().bResident)
+    {
+        bool bDone = false;
+        Residency.RunExclusive([&](bool bResident)
+        {
+            if (bPrecisionChanged)
+            {
+                bHalfPrecisionFeatures = bNewHalfPrecision;
+                DropCachedFeatures();
+            }
+            if (!bSessionsChanged || !bResident)
+            {
+                SetSessionSettings(NewEncoderSettings, NewDecoderSettings);
+                bDone = true;
+            }
+        });
+        if (bDone)
+        {
+            UE_LOG(LogTemp, Log, TEXT("SAM2 tuning applied: %s features"), bHalfPrecisionFeatures ? TEXT("fp16") : TEXT("fp32"));
+            return;
+        }
+    }
+
+    UE_LOG(LogTemp, Log, TEXT("Rebuilding SAM2 sessions in the background (encoder %s, decoder %s)"),
+           *NewEncoderSettings.ToString(), *NewDecoderSettings.ToString());
+    const double StartTime = FPlatformTime::Seconds();
+
+    // 创建期间持有驻留作用域，防止预打包权重被驱逐释放；请求照常使用旧会话
+    TUniquePtr<Ort::Session> NewEncoder;
+    TUniquePtr<Ort::Session> NewDecoder;
+    TUniquePtr<FOnnxNumaSessionPool> NewPool;
+    {
+        FOnnxResidencyHandle::FScope ResidencyScope(Residency);
+        if (!ResidencyScope.IsResident())
+        {
+            return;
+        }
+
+        NewEncoder = CreateEncoderSession(NewEncoderSettings);
+        NewDecoder = CreateDecoderSession(NewDecoderSettings);
+        if (!NewEncoder || !NewDecoder)
+        {
+            UE_LOG(LogTemp, Error, TEXT("Failed to rebuild SAM2 sessions, keeping the current ones"));
+
+            // 新选出的EP无法创建会话时留在当前EP上，之后的重建不再尝试它
+            const FOnnxSessionSettings CurrentEncoder = GetEncoderSettings();
+            const FOnnxSessionSettings CurrentDecoder = GetDecoderSettings();
+            FScopeLock Lock(&SettingsMutex);
+            if (!NewEncoder)
+            {
+                BaseEncoderSettings.ExecutionProvider = CurrentEncoder.ExecutionProvider;
+            }
+            if (!NewDecoder)
+            {
+                BaseDecoderSettings.ExecutionProvider = CurrentDecoder.ExecutionProvider;
+            }
+            return;
+        }
+
+        if (NewEncoderSettings.ReplicasPerNumaNode > 0)
+        {
+            NewPool = MakeUnique<FOnnxNumaSessionPool>();
+            if (!NewPool->Initialize([this](const FOnnxSessionSettings& Settings) { return CreateEncoderSession(Settings); },
+                                     NewEncoderSettings, NewEncoderSettings.ReplicasPerNumaNode, FOnnxBenchmarkParams(), TEXT("SAM2 Encoder")))
+            {
+                UE_LOG(LogTemp, Warning, TEXT("SAM2 encoder NUMA replicas unavailable, using a single session"));
+                NewPool.Reset();
+            }
+        }
+    }
+
+    const EOnnxExecutionProvider OldProvider = GetEncoderSettings().ExecutionProvider;
+    if (NewEncoderSettings.ExecutionProvider != OldProvider)
+    {
+        UE_LOG(LogTemp, Log, TEXT("Switching the SAM2 encoder from the %s to the %s execution provider"),
+               FOnnxExecutionProviders::GetDisplayName(OldProvider), FOnnxExecutionProviders::GetDisplayName(NewEncoderSettings.ExecutionProvider));
+    }
+
+    // 排空进行中的请求后换入；缓存的特征与会话配置无关，继续有效
+    Residency.RunExclusive([&](bool bResident)
+    {
+        SetSessionSettings(NewEncoderSettings, NewDecoderSettings);
+        if (bPrecisionChanged)
+        {
+            bHalfPrecisionFeatures = bNewHalfPrecision;
+            DropCachedFeatures();
+        }
+        if (bResident)
+        {
+            Swap(EncoderSession, NewEncoder);
+            Swap(DecoderSession, NewDecoder);
+            Swap(EncoderPool, NewPool);
+            for (FOnnxOutputSlot& Slot : EncoderOutputSlots)
+            {
+                Slot.Reset();
+            }
+            for (FOnnxOutputSlot& Slot : DecoderOutputSlots)
+            {
+                Slot.Reset();
+            }
+            Allocations.RestartWarmup();
+        }
+    });
+
+    // 旧会话在锁外释放
+    NewPool.Reset();
+    NewEncoder.Reset();
+    NewDecoder.Reset();
+    UE_LOG(LogTemp, Log, TEXT("Rebuilt SAM2 sessions in %.2f s"), FPlatformTime::Seconds() - StartTime);
+}
+
+void FSam2ModelInstance::DropCachedFeatures()
+{
+    // 下次推理时按当前精度重新编码
+    CachedImageEmbed.Empty();
+    CachedHighResFeats0.Empty();
+    CachedHighResFeats1.Empty();
+    bHasCachedFeatures = false;
+    Allocations.RestartWarmup();
+    Residency.SetResidentBytes(SessionBytes);
+}
+
+int64 FSam2ModelInstance::GetCachedFeatureBytes() const
+{
+    return CachedImageEmbed.GetBytes() + CachedHighResFeats0.GetBytes() + CachedHighResFeats1.GetBytes();
+}
+
+int64 FSam2ModelInstance::GetModelFileBytes() const
+{
+    return FMath::Max<int64>(0, IFileManager::Get().FileSize(*EncoderModelPath)) + FMath::Max<int64>(0, IFileManager::Get().FileSize(*DecoderModelPath));
+}
+
+bool FSam2ModelInstance::StartCapture(const FString& FilePath, const FOnnxCaptureConfig& Config)
+{
+    if (!bIsInitialized)
+    {
+        UE_LOG(LogTemp, Error, TEXT("SAM2: cannot capture, model is not initialized"));
+        return false;
+    }
+    if (EncoderWorkers)
+    {
+        UE_LOG(LogTemp, Error, TEXT("SAM2: capture is not supported with ONNX workers"));
+        return false;
+    }
+
+    // 编码器和解码器各为一个模型，记录按运行顺序交错
+    TArray<FOnnxCaptureModel> Models;
+    FOnnxCaptureModel& Encoder = Models.AddDefaulted_GetRef();
+    Encoder.Role = TEXT("encoder");
+    Encoder.Source = FPaths::ConvertRelativePathToFull(EncoderModelPath);
+    Encoder.Settings = GetEncoderSettings();
+    for (const char* Name : EncoderOutputNames)
+    {
+        Encoder.OutputNames.Add(UTF8_TO_TCHAR(Name));
+    }
+
+    FOnnxCaptureModel& Decoder = Models.AddDefaulted_GetRef();
+    Decoder.Role = TEXT("decoder");
+    Decoder.Source = FPaths::ConvertRelativePathToFull(DecoderModelPath);
+    Decoder.Settings = GetDecoderSettings();
+    for (const char* Name : DecoderOutputNames)
+    {
+        Decoder.OutputNames.Add(UTF8_TO_TCHAR(Name));
+    }
+
+    return Capture.Open(FOnnxCaptureWriter::ResolvePath(FilePath, TEXT("SAM2_") + FPaths::GetBaseFilename(EncoderModelPath)), Models, Config);
+}
+
+void FSam2ModelInstance::StopCapture()
+{
+    Capture.Close();
+}
+
+FOnnxResidencyStats FSam2ModelInstance::GetResidencyStats() const
+{
+    return Residency.GetStats();
+}
+
+TUniquePtr<Ort::Session> FSam2ModelInstance::CreateEncoderSession(const FOnnxSessionSettings& Settings)
+{
+    return CreateModelSession(EncoderModelPath, Settings, EncoderPrepackedWeights, EncoderExternalData);
+}
+
+TUniquePtr<Ort::Session> FSam2ModelInstance::CreateDecoderSession(const FOnnxSessionSettings& Settings)
+{
+    return CreateModelSession(DecoderModelPath, Settings, DecoderPrepackedWeights, DecoderExternalData);
+}
+
+TArray<FOnnxNumaNodeStats> FSam2ModelInstance::GetEncoderNumaNodeStats() const
+{
+    return EncoderPool ? EncoderPool->GetNodeStats() : TArray<FOnnxNumaNodeStats>();
+}
+
+TArray<FOnnxBenchmarkResult> FSam2ModelInstance::BenchmarkSpinModes(const FOnnxBenchmarkParams& Params, int32 IntraOpThreads)
+{
+    FOnnxSessionSettings encoderBase = GetEncoderSettings();
+    FOnnxSessionSettings decoderBase = GetDecoderSettings();
+    if (IntraOpThreads > 0)
+    {
+        encoderBase.IntraOpThreads = IntraOpThreads;
+        decoderBase.IntraOpThreads = IntraOpThreads;
+    }
+
+    TArray<FOnnxBenchmarkResult> results = FOnnxBenchmark::BenchmarkSpinModes(
+        [this](const FOnnxSessionSettings& Settings) { return CreateEncoderSession(Settings); }, encoderBase, Params, TEXT("SAM2 Encoder"));
+
+    results.Append(FOnnxBenchmark::BenchmarkSpinModes(
+        [this](const FOnnxSessionSettings& Settings) { return CreateDecoderSession(Settings); }, decoderBase,
+        MakeDecoderBenchmarkParams(Params), TEXT("SAM2 Decoder")));
+
+    FOnnxBenchmark::LogResults(results);
+    return results;
+}
+
+TArray<FOnnxAutotuneResult> FSam2ModelInstance::Autotune(const FOnnxAutotuneGrid& Grid, const FOnnxBenchmarkParams& Params)
+{
+    TArray<FOnnxAutotuneResult> results;
+
+    results.Add(FOnnxAutotuner::TuneAndSave(
+        [this](const FOnnxSessionSettings& Settings) { return CreateEncoderSession(Settings); }, GetEncoderSettings(), Grid, Params,
+        GetModelKey(EncoderModelPath)));
+
+    results.Add(FOnnxAutotuner::TuneAndSave(
+        [this](const FOnnxSessionSettings& Settings) { return CreateDecoderSession(Settings); }, GetDecoderSettings(), Grid,
+        MakeDecoderBenchmarkParams(Params), GetModelKey(DecoderModelPath)));
+
+    for (const FOnnxAutotuneResult& result : results)
+    {
+        FOnnxBenchmark::LogResults(result.Results);
+    }
+    return results;
+}
+
+FString FSam2ModelInstance::GetModelKey(const FString& ModelPath)
+{
+    return FOnnxAutotuner::MakeModelKey(FPaths::GetBaseFilename(ModelPath), FOnnxPrepackedWeightsRegistry::ComputeModelHash(ModelPath));
+}
+
+FOnnxBenchmarkParams FSam2ModelInstance::MakeDecoderBenchmarkParams(const FOnnxBenchmarkParams& Params)
+{
+    // 解码器的合成输入需要真实的原图尺寸，否则会输出1x1掩码
+    FOnnxBenchmarkParams decoderParams = Params;
+    decoderParams.InputCustomizer = [](FOnnxBenchmarkInputs& Inputs)
+    {
+        if (Ort::Value* origSize = Inputs.FindInput("orig_im_size"))
+        {
+            int32* data = origSize->GetTensorMutableData<int32>();
+            data[0] = 1024;
+            data[1] = 1024;
+        }
+    };
+    return decoderParams;
+}
+
 bool FSam2ModelInstance::RunInference(const FSam2Input& Input, FSam2Output& Output)
 {
     if (!bIsInitialized)
@@ -166,9 +882,27 @@ bool FSam2ModelInstance::RunInference(const FSam2Input& Input, FSam2Output& Outp
         return false;
     }
 
-    if (Input.ImageData.Num() == 0)
+    TConstArrayView<float> ImagePixels;
+    int32 ImageWidth = 0;
+    int32 ImageHeight = 0;
+    if (!GetInputImage(Input, ImagePixels, ImageWidth, ImageHeight))
     {
-        UE_LOG(LogTemp, Error, TEXT("Input image data is empty"));
+        return false;
+    }
+
+    FOnnxAllocationCounter::FRunScope allocationScope(Allocations, TEXT("FSam2ModelInstance::RunInference"));
+    FOnnxMemoryOwner::FScope memoryScope(MemoryOwner);
+
+    if (EncoderWorkers)
+    {
+        return RunOnWorkers(Input, ImagePixels, ImageWidth, ImageHeight, Output);
+    }
+
+    // 确保会话驻留（被驱逐过时重新加载），推理期间不会被驱逐
+    FOnnxResidencyHandle::FScope residencyScope(Residency);
+    if (!residencyScope.IsResident())
+    {
+        UE_LOG(LogTemp, Error, TEXT("SAM2 sessions could not be reloaded"));
         return false;
     }
 
@@ -178,32 +912,32 @@ bool FSam2ModelInstance::RunInference(const FSam2Input& Input, FSam2Output& Outp
         return false;
     }
 
-    UE_LOG(LogTemp, Log, TEXT("Running SAM2 inference with %d prompt points"), Input.PromptPoints.Num());
+    // 每次请求的日志使用Verbose：默认不输出时不会格式化，也就不会分配
+    UE_LOG(LogTemp, Verbose, TEXT("Running SAM2 inference with %d prompt points"), Input.PromptPoints.Num());
 
     try
     {
-        // 步骤1: 预处理图像
-        TArray<float> ProcessedImageData;
+        // 步骤1: 预处理图像（写入复用的暂存区）
         float Scale;
         int32 XOffset, YOffset;
 
-        if (!PreprocessImage(Input.ImageData, Input.ImageWidth, Input.ImageHeight,
-                           ProcessedImageData, Scale, XOffset, YOffset))
+        if (!PreprocessImage(ImagePixels, ImageWidth, ImageHeight,
+                           ImageScratch, Scale, XOffset, YOffset))
         {
             UE_LOG(LogTemp, Error, TEXT("Image preprocessing failed"));
             return false;
         }
 
         // 步骤2: 运行编码器
-        if (!RunEncoder(ProcessedImageData))
+        if (!RunEncoder(ImageScratch))
         {
             UE_LOG(LogTemp, Error, TEXT("Encoder inference failed"));
             return false;
         }
 
         // 步骤3: 设置输出参数用于后处理
-        Output.OriginalWidth = Input.ImageWidth;
-        Output.OriginalHeight = Input.ImageHeight;
+        Output.OriginalWidth = ImageWidth;
+        Output.OriginalHeight = ImageHeight;
         Output.Scale = Scale;
         Output.XOffset = XOffset;
         Output.YOffset = YOffset;
@@ -215,7 +949,7 @@ bool FSam2ModelInstance::RunInference(const FSam2Input& Input, FSam2Output& Outp
             return false;
         }
 
-        UE_LOG(LogTemp, Log, TEXT("SAM2 inference completed successfully"));
+        UE_LOG(LogTemp, Verbose, TEXT("SAM2 inference completed successfully"));
         return true;
     }
     catch (const Ort::Exception& e)
@@ -230,113 +964,195 @@ bool FSam2ModelInstance::RunInference(const FSam2Input& Input, FSam2Output& Outp
     }
 }
 
-bool FSam2ModelInstance::PreprocessImage(const TArray<float>& InputImageData, int32 InputWidth, int32 InputHeight,
-                                        TArray<float>& ProcessedImageData, float& OutScale, int32& OutXOffset, int32& OutYOffset)
+bool FSam2ModelInstance::RunOnWorkers(const FSam2Input& Input, TConstArrayView<float> ImagePixels, int32 ImageWidth, int32 ImageHeight, FSam2Output& Output)
 {
-    if (InputImageData.Num() != InputWidth * InputHeight * 3)
+    if (Input.PromptPoints.Num() == 0)
     {
-        UE_LOG(LogTemp, Error, TEXT("Input image data size mismatch: expected %d, got %d"), 
-               InputWidth * InputHeight * 3, InputImageData.Num());
+        UE_LOG(LogTemp, Warning, TEXT("No prompt points provided"));
         return false;
     }
 
-    const int32 TargetSize = 1024;
-    
-    // 计算缩放比例，保持宽高比
-    float ScaleW = float(TargetSize) / float(InputWidth);
-    float ScaleH = float(TargetSize) / float(InputHeight);
-    OutScale = FMath::Min(ScaleW, ScaleH);
-    
-    int32 NewWidth = FMath::RoundToInt(InputWidth * OutScale);
-    int32 NewHeight = FMath::RoundToInt(InputHeight * OutScale);
-    
-    // 计算居中偏移
-    OutXOffset = (TargetSize - NewWidth) / 2;
-    OutYOffset = (TargetSize - NewHeight) / 2;
+    try
+    {
+        const OnnxCore::Sam2::FLetterbox Letterbox = OnnxCore::Sam2::ComputeLetterbox(ImageWidth, ImageHeight);
+        Output.OriginalWidth = ImageWidth;
+        Output.OriginalHeight = ImageHeight;
+        Output.Scale = Letterbox.Scale;
+        Output.XOffset = Letterbox.XOffset;
+        Output.YOffset = Letterbox.YOffset;
+
+        // 编码器：预处理直接写入共享内存中的输入，fp16编码器经由暂存区转换
+        FOnnxWorkerPool::FRequest EncoderRequest(*EncoderWorkers);
+        if (!EncoderRequest.IsValid())
+        {
+            return false;
+        }
+        void* Image = EncoderRequest.AddInput(EncoderWorkers->FindInput("image"), EncoderImageType, MakeShapeView(ImageShape, UE_ARRAY_COUNT(ImageShape)));
+        if (!Image)
+        {
+            return false;
+        }
+        if (EncoderImageType == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16)
+        {
+            ImageScratch.SetNumUninitialized(3 * OnnxCore::Sam2::ImageSize * OnnxCore::Sam2::ImageSize);
+            OnnxCore::Sam2::PreprocessImage(ImagePixels.GetData(), ImageWidth, ImageHeight, Letterbox, ImageScratch.GetData());
+            FOnnxHalf::ConvertToHalf(ImageScratch.GetData(), static_cast<uint16*>(Image), ImageScratch.Num());
+        }
+        else
+        {
+            OnnxCore::Sam2::PreprocessImage(ImagePixels.GetData(), ImageWidth, ImageHeight, Letterbox, static_cast<float*>(Image));
+        }
+        if (!EncoderRequest.Execute())
+        {
+            UE_LOG(LogTemp, Error, TEXT("Encoder inference failed"));
+            return false;
+        }
 
-    UE_LOG(LogTemp, Log, TEXT("Image preprocessing: %dx%d -> %dx%d, scale=%.3f, offset=(%d,%d)"), 
-           InputWidth, InputHeight, NewWidth, NewHeight, OutScale, OutXOffset, OutYOffset);
+        // 解码器：编码器的三个特征从编码器的槽复制到解码器的槽（两个工作进程池之间唯一的一次复制）
+        FOnnxWorkerPool::FRequest DecoderRequest(*DecoderWorkers);
+        if (!DecoderRequest.IsValid())
+        {
+            return false;
+        }
+        for (int32 i = 0; i < 3; ++i)
+        {
+            const int32 Position = EncoderRequest.FindOutput(EncoderWorkers->FindOutput(DecoderInputNames[i]));
+            if (Position == INDEX_NONE ||
+                !AddWorkerFeature(DecoderRequest, DecoderWorkers->FindInput(DecoderInputNames[i]), DecoderInputTypes[i], EncoderRequest.GetOutput(Position)))
+            {
+                UE_LOG(LogTemp, Error, TEXT("SAM2: failed to pass %s to the decoder"), UTF8_TO_TCHAR(DecoderInputNames[i]));
+                return false;
+            }
+        }
 
-    // 创建1024x1024的画布
-    ProcessedImageData.Empty(TargetSize * TargetSize * 3);
-    ProcessedImageData.AddZeroed(TargetSize * TargetSize * 3);
+        TransformPromptPoints(Input.PromptPoints, ImageWidth, ImageHeight,
+                              Output.Scale, Output.XOffset, Output.YOffset, PointCoordsScratch);
+        PointLabelsScratch.Reset(Input.PromptLabels.Num());
+        for (int32 Label : Input.PromptLabels)
+        {
+            PointLabelsScratch.Add(static_cast<float>(Label));
+        }
 
-    // 双线性插值缩放并放置到画布中央
-    for (int32 y = 0; y < NewHeight; ++y)
-    {
-        for (int32 x = 0; x < NewWidth; ++x)
+        const int64_t CoordsShape[] = {1, static_cast<int64_t>(Input.PromptPoints.Num()), 2};
+        const int64_t LabelsShape[] = {1, static_cast<int64_t>(Input.PromptLabels.Num())};
+        const TArray<float>* FloatInputs[] = {&PointCoordsScratch, &PointLabelsScratch, &MaskInput, &HasMaskInput};
+        const TConstArrayView<int64> FloatShapes[] = {
+            MakeShapeView(CoordsShape, UE_ARRAY_COUNT(CoordsShape)), MakeShapeView(LabelsShape, UE_ARRAY_COUNT(LabelsShape)),
+            MakeShapeView(MaskInputShape, UE_ARRAY_COUNT(MaskInputShape)), MakeShapeView(HasMaskInputShape, UE_ARRAY_COUNT(HasMaskInputShape))
+        };
+        for (int32 i = 0; i < 4; ++i)
         {
-            // 源坐标
-            float SrcX = x / OutScale;
-            float SrcY = y / OutScale;
+            if (!AddWorkerInput(DecoderRequest, DecoderWorkers->FindInput(DecoderInputNames[3 + i]), DecoderInputTypes[3 + i],
+                                FloatInputs[i]->GetData(), FloatInputs[i]->Num(), FloatShapes[i]))
+            {
+                return false;
+            }
+        }
 
-            int32 SrcX0 = FMath::FloorToInt(SrcX);
-            int32 SrcY0 = FMath::FloorToInt(SrcY);
-            int32 SrcX1 = FMath::Min(SrcX0 + 1, InputWidth - 1);
-            int32 SrcY1 = FMath::Min(SrcY0 + 1, InputHeight - 1);
+        void* OrigSize = DecoderRequest.AddInput(DecoderWorkers->FindInput(DecoderInputNames[7]), ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32,
+                                                 MakeShapeView(OrigImSizeShape, UE_ARRAY_COUNT(OrigImSizeShape)));
+        if (!OrigSize)
+        {
+            return false;
+        }
+        FMemory::Memcpy(OrigSize, OrigImSize.GetData(), OrigImSize.Num() * sizeof(int32));
 
-            float WeightX = SrcX - SrcX0;
-            float WeightY = SrcY - SrcY0;
+        if (!DecoderRequest.Execute())
+        {
+            UE_LOG(LogTemp, Error, TEXT("Decoder inference failed"));
+            return false;
+        }
 
-            // 目标坐标
-            int32 DstX = x + OutXOffset;
-            int32 DstY = y + OutYOffset;
+        // 掩码和IoU从共享内存读取（fp16解码器的输出在这里转换回float）
+        const int32 MasksPosition = DecoderRequest.FindOutput(DecoderWorkers->FindOutput(DecoderOutputNames[0]));
+        const int32 IouPosition = DecoderRequest.FindOutput(DecoderWorkers->FindOutput(DecoderOutputNames[1]));
+        if (MasksPosition == INDEX_NONE || IouPosition == INDEX_NONE ||
+            !FOnnxHalf::CopyToFloat(DecoderRequest.GetOutput(MasksPosition), Output.MaskData) ||
+            !FOnnxHalf::CopyToFloat(DecoderRequest.GetOutput(IouPosition), Output.IouScores))
+        {
+            UE_LOG(LogTemp, Error, TEXT("Decoder returned unexpected outputs"));
+            return false;
+        }
 
-            if (DstX >= 0 && DstX < TargetSize && DstY >= 0 && DstY < TargetSize)
-            {
-                int32 DstIndex = (DstY * TargetSize + DstX) * 3;
+        ApplySigmoid(Output.MaskData);
+        Output.NumMasks = 1;
+        Output.MaskWidth = 1024;
+        Output.MaskHeight = 1024;
 
-                for (int32 c = 0; c < 3; ++c)
-                {
-                    // 双线性插值
-                    float P00 = InputImageData[(SrcY0 * InputWidth + SrcX0) * 3 + c];
-                    float P01 = InputImageData[(SrcY0 * InputWidth + SrcX1) * 3 + c];
-                    float P10 = InputImageData[(SrcY1 * InputWidth + SrcX0) * 3 + c];
-                    float P11 = InputImageData[(SrcY1 * InputWidth + SrcX1) * 3 + c];
-
-                    float InterpolatedValue = P00 * (1 - WeightX) * (1 - WeightY) +
-                                            P01 * WeightX * (1 - WeightY) +
-                                            P10 * (1 - WeightX) * WeightY +
-                                            P11 * WeightX * WeightY;
-
-                    ProcessedImageData[DstIndex + c] = InterpolatedValue;
-                }
-            }
-        }
+        UE_LOG(LogTemp, Verbose, TEXT("SAM2 worker inference completed (encoder %.2f ms, decoder %.2f ms)"),
+               EncoderRequest.GetRunMs(), DecoderRequest.GetRunMs());
+        return true;
     }
+    catch (const Ort::Exception& e)
+    {
+        UE_LOG(LogTemp, Error, TEXT("ONNX Runtime error during worker inference: %s"), UTF8_TO_TCHAR(e.what()));
+        return false;
+    }
+}
 
-    // ImageNet标准化
-    const float Mean[3] = {0.485f, 0.456f, 0.406f};
-    const float Std[3] = {0.229f, 0.224f, 0.225f};
-
-    for (int32 i = 0; i < TargetSize * TargetSize; ++i)
+bool FSam2ModelInstance::GetInputImage(const FSam2Input& Input, TConstArrayView<float>& OutPixels, int32& OutWidth, int32& OutHeight)
+{
+    if (Input.Image.IsValid())
     {
-        for (int32 c = 0; c < 3; ++c)
+        // 接受{H, W, 3}或带批次维度的{1, H, W, 3}
+        const TConstArrayView<int64> Shape = Input.Image.GetShape();
+        const bool bValidRank = Shape.Num() == 3 || (Shape.Num() == 4 && Shape[0] == 1);
+        if (!bValidRank || Shape.Last() != 3 || Shape[Shape.Num() - 3] <= 0 || Shape[Shape.Num() - 2] <= 0)
+        {
+            UE_LOG(LogTemp, Error, TEXT("Input image tensor must have shape {Height, Width, 3} or {1, Height, Width, 3}"));
+            return false;
+        }
+
+        OutPixels = Input.Image.GetData<const float>();
+        if (OutPixels.Num() == 0)
         {
-            int32 Index = i * 3 + c;
-            ProcessedImageData[Index] = (ProcessedImageData[Index] - Mean[c]) / Std[c];
+            UE_LOG(LogTemp, Error, TEXT("Input image tensor must be a Float tensor"));
+            return false;
         }
+        OutHeight = static_cast<int32>(Shape[Shape.Num() - 3]);
+        OutWidth = static_cast<int32>(Shape[Shape.Num() - 2]);
+        return true;
     }
 
-    // 转换为NCHW格式（ONNX期望的格式）
-    TArray<float> NCHWData;
-    NCHWData.Empty(TargetSize * TargetSize * 3);
-    NCHWData.AddUninitialized(TargetSize * TargetSize * 3);
+    if (Input.ImageData.Num() == 0)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Input image data is empty"));
+        return false;
+    }
+    if (Input.ImageData.Num() != Input.ImageWidth * Input.ImageHeight * 3)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Input image data size mismatch: expected %d, got %d"),
+               Input.ImageWidth * Input.ImageHeight * 3, Input.ImageData.Num());
+        return false;
+    }
 
-    for (int32 c = 0; c < 3; ++c)
+    OutPixels = Input.ImageData;
+    OutWidth = Input.ImageWidth;
+    OutHeight = Input.ImageHeight;
+    return true;
+}
+
+bool FSam2ModelInstance::PreprocessImage(TConstArrayView<float> InputImageData, int32 InputWidth, int32 InputHeight,
+                                        TArray<float>& ProcessedImageData, float& OutScale, int32& OutXOffset, int32& OutYOffset)
+{
+    if (InputImageData.Num() != InputWidth * InputHeight * 3)
     {
-        for (int32 h = 0; h < TargetSize; ++h)
-        {
-            for (int32 w = 0; w < TargetSize; ++w)
-            {
-                int32 HWCIndex = (h * TargetSize + w) * 3 + c;
-                int32 NCHWIndex = c * TargetSize * TargetSize + h * TargetSize + w;
-                NCHWData[NCHWIndex] = ProcessedImageData[HWCIndex];
-            }
-        }
+        UE_LOG(LogTemp, Error, TEXT("Input image data size mismatch: expected %d, got %d"), 
+               InputWidth * InputHeight * 3, InputImageData.Num());
+        return false;
     }
 
-    ProcessedImageData = MoveTemp(NCHWData);
+    const OnnxCore::Sam2::FLetterbox Letterbox = OnnxCore::Sam2::ComputeLetterbox(InputWidth, InputHeight);
+    OutScale = Letterbox.Scale;
+    OutXOffset = Letterbox.XOffset;
+    OutYOffset = Letterbox.YOffset;
+
+    UE_LOG(LogTemp, Verbose, TEXT("Image preprocessing: %dx%d -> %dx%d, scale=%.3f, offset=(%d,%d)"), 
+           InputWidth, InputHeight, Letterbox.ScaledWidth, Letterbox.ScaledHeight, OutScale, OutXOffset, OutYOffset);
+
+    // 缩放、标准化和NCHW重排由OnnxCore完成
+    ProcessedImageData.SetNumUninitialized(3 * OnnxCore::Sam2::ImageSize * OnnxCore::Sam2::ImageSize);
+    OnnxCore::Sam2::PreprocessImage(InputImageData.GetData(), InputWidth, InputHeight, Letterbox, ProcessedImageData.GetData());
     return true;
 }
 
@@ -344,63 +1160,84 @@ bool FSam2ModelInstance::RunEncoder(const TArray<float>& ImageData)
 {
     try
     {
-        Ort::AllocatorWithDefaultOptions allocator;
+        Ort::MemoryInfo memInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
 
-        // 创建输入张量 [1, 3, 1024, 1024]
-        std::vector<int64_t> inputShape = {1, 3, 1024, 1024};
-        Ort::Value inputTensor = CreateTensor(ImageData, inputShape);
+        // 创建输入张量 [1, 3, 1024, 1024]，fp16编码器在这里转换
+        Ort::Value inputTensor = CreateTensor(ImageData, ImageShape, UE_ARRAY_COUNT(ImageShape), EncoderImageType, HalfImageScratch);
 
         // 输入名称
         const char* inputNames[] = {"image"};
 
-        // 输出名称
-        const char* outputNames[] = {"high_res_feats_0", "high_res_feats_1", "image_embed"};
+        // 录制编码器实际收到的张量（作用域结束时写入）
+        FOnnxCaptureWriter::FRunScope captureScope(Capture, 0, inputNames, &inputTensor, 1);
+
+        // NUMA副本组启用时使用调用线程所在节点的副本
+        TOptional<FOnnxNumaSessionPool::FLease> lease;
+        if (EncoderPool)
+        {
+            lease.Emplace(EncoderPool->Acquire());
+        }
+        Ort::Session& session = lease.IsSet() ? lease->GetSession() : *EncoderSession;
 
-        // 运行推理
-        auto outputs = EncoderSession->Run(Ort::RunOptions{nullptr}, inputNames, &inputTensor, 1, outputNames, 3);
+        // 编码器输出依次为 high_res_feats_0: [1, 32, 256, 256], high_res_feats_1: [1, 64, 128, 128], image_embed: [1, 256, 64, 64]
+        FSam2CachedFeature* features[] = {&CachedHighResFeats0, &CachedHighResFeats1, &CachedImageEmbed};
+        bHasCachedFeatures = false;
 
+        // 预热之后编码器直接写入特征缓存（缓存精度与输出类型不同时经由暂存区转换）
+        if (EncoderOutputSlots[0].IsReady())
+        {
+            try
+            {
+                Ort::Value outputTensors[] = {
+                    BindFeature(memInfo, EncoderOutputSlots[0], *features[0]),
+                    BindFeature(memInfo, EncoderOutputSlots[1], *features[1]),
+                    BindFeature(memInfo, EncoderOutputSlots[2], *features[2])
+                };
+                session.Run(Ort::RunOptions{nullptr}, inputNames, &inputTensor, 1, EncoderOutputNames, outputTensors, 3);
+                for (int32 i = 0; i < 3; ++i)
+                {
+                    FinishFeature(EncoderOutputSlots[i], *features[i]);
+                }
+                bHasCachedFeatures = true;
+                captureScope.SetSucceeded();
+                return true;
+            }
+            catch (const Ort::Exception& e)
+            {
+                // 输出形状与预热时不同（例如换了模型），改由ORT分配并重新记录
+                UE_LOG(LogTemp, Warning, TEXT("Preallocated encoder outputs rejected, re-capturing: %s"), UTF8_TO_TCHAR(e.what()));
+                for (FOnnxOutputSlot& Slot : EncoderOutputSlots)
+                {
+                    Slot.Reset();
+                }
+            }
+        }
+
+        // 预热运行：由ORT分配输出，存入缓存并记录输出形状
+        std::vector<Ort::Value> outputs = session.Run(Ort::RunOptions{nullptr}, inputNames, &inputTensor, 1, EncoderOutputNames, 3);
         if (outputs.size() != 3)
         {
             UE_LOG(LogTemp, Error, TEXT("Encoder returned unexpected number of outputs: %d"), outputs.size());
             return false;
         }
 
-        // 缓存编码器输出
-        // high_res_feats_0: [1, 32, 256, 256]
-        auto& feats0Tensor = outputs[0];
-        auto feats0Shape = feats0Tensor.GetTensorTypeAndShapeInfo();
-        float* feats0Data = feats0Tensor.GetTensorMutableData<float>();
-        size_t feats0Size = feats0Shape.GetElementCount();
-
-        CachedHighResFeats0.Empty(feats0Size);
-        CachedHighResFeats0.AddUninitialized(feats0Size);
-        FMemory::Memcpy(CachedHighResFeats0.GetData(), feats0Data, feats0Size * sizeof(float));
-
-        // high_res_feats_1: [1, 64, 128, 128]
-        auto& feats1Tensor = outputs[1];
-        auto feats1Shape = feats1Tensor.GetTensorTypeAndShapeInfo();
-        float* feats1Data = feats1Tensor.GetTensorMutableData<float>();
-        size_t feats1Size = feats1Shape.GetElementCount();
-
-        CachedHighResFeats1.Empty(feats1Size);
-        CachedHighResFeats1.AddUninitialized(feats1Size);
-        FMemory::Memcpy(CachedHighResFeats1.GetData(), feats1Data, feats1Size * sizeof(float));
-
-        // image_embed: [1, 256, 64, 64]
-        auto& embedTensor = outputs[2];
-        auto embedShape = embedTensor.GetTensorTypeAndShapeInfo();
-        float* embedData = embedTensor.GetTensorMutableData<float>();
-        size_t embedSize = embedShape.GetElementCount();
-
-        CachedImageEmbed.Empty(embedSize);
-        CachedImageEmbed.AddUninitialized(embedSize);
-        FMemory::Memcpy(CachedImageEmbed.GetData(), embedData, embedSize * sizeof(float));
+        // 缓存编码器输出（fp16模式下转换为fp16存储）
+        for (int32 i = 0; i < 3; ++i)
+        {
+            if (!StoreFeature(outputs[i], *features[i]))
+            {
+                return false;
+            }
+            EncoderOutputSlots[i].Capture(outputs[i]);
+        }
 
         bHasCachedFeatures = true;
+        Residency.SetResidentBytes(SessionBytes + GetCachedFeatureBytes());
 
         UE_LOG(LogTemp, Log, TEXT("Encoder inference completed, cached features: feats0=%d, feats1=%d, embed=%d"), 
                CachedHighResFeats0.Num(), CachedHighResFeats1.Num(), CachedImageEmbed.Num());
 
+        captureScope.SetSucceeded();
         return true;
     }
     catch (const Ort::Exception& e)
@@ -420,115 +1257,109 @@ bool FSam2ModelInstance::RunDecoder(const FSam2Input& Input, FSam2Output& Output
 
     try
     {
-        Ort::AllocatorWithDefaultOptions allocator;
+        Ort::MemoryInfo memInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+
+        // 准备解码器输入数据（缓存与解码器输入的精度不一致时使用暂存区转换）
 
-        // 准备解码器输入数据
-        
         // 1. image_embed [1, 256, 64, 64]
-        std::vector<int64_t> embedShape = {1, 256, 64, 64};
-        Ort::Value embedTensor = CreateTensor(CachedImageEmbed, embedShape);
+        Ort::Value embedTensor = CreateTensor(CachedImageEmbed, ImageEmbedShape, UE_ARRAY_COUNT(ImageEmbedShape), DecoderInputTypes[0],
+                                              FeatureFloatScratch[0], DecoderHalfScratch[0]);
 
         // 2. high_res_feats_0 [1, 32, 256, 256]
-        std::vector<int64_t> feats0Shape = {1, 32, 256, 256};
-        Ort::Value feats0Tensor = CreateTensor(CachedHighResFeats0, feats0Shape);
+        Ort::Value feats0Tensor = CreateTensor(CachedHighResFeats0, HighResFeats0Shape, UE_ARRAY_COUNT(HighResFeats0Shape), DecoderInputTypes[1],
+                                               FeatureFloatScratch[1], DecoderHalfScratch[1]);
 
         // 3. high_res_feats_1 [1, 64, 128, 128]
-        std::vector<int64_t> feats1Shape = {1, 64, 128, 128};
-        Ort::Value feats1Tensor = CreateTensor(CachedHighResFeats1, feats1Shape);
+        Ort::Value feats1Tensor = CreateTensor(CachedHighResFeats1, HighResFeats1Shape, UE_ARRAY_COUNT(HighResFeats1Shape), DecoderInputTypes[2],
+                                               FeatureFloatScratch[2], DecoderHalfScratch[2]);
 
         // 4. point_coords [1, N, 2] - 转换提示点坐标
-        TArray<float> PointCoords;
-        TransformPromptPoints(Input.PromptPoints, Input.ImageWidth, Input.ImageHeight, 
-                             Output.Scale, Output.XOffset, Output.YOffset, PointCoords);
+        TransformPromptPoints(Input.PromptPoints, Output.OriginalWidth, Output.OriginalHeight, 
+                             Output.Scale, Output.XOffset, Output.YOffset, PointCoordsScratch);
         
-        std::vector<int64_t> coordsShape = {1, static_cast<int64_t>(Input.PromptPoints.Num()), 2};
-        Ort::Value coordsTensor = CreateTensor(PointCoords, coordsShape);
+        const int64_t coordsShape[] = {1, static_cast<int64_t>(Input.PromptPoints.Num()), 2};
+        Ort::Value coordsTensor = CreateTensor(PointCoordsScratch, coordsShape, UE_ARRAY_COUNT(coordsShape), DecoderInputTypes[3], DecoderHalfScratch[3]);
 
         // 5. point_labels [1, N]
-        TArray<float> PointLabels;
+        PointLabelsScratch.Reset(Input.PromptLabels.Num());
         for (int32 Label : Input.PromptLabels)
         {
-            PointLabels.Add(static_cast<float>(Label));
+            PointLabelsScratch.Add(static_cast<float>(Label));
         }
-        std::vector<int64_t> labelsShape = {1, static_cast<int64_t>(Input.PromptLabels.Num())};
-        Ort::Value labelsTensor = CreateTensor(PointLabels, labelsShape);
+        const int64_t labelsShape[] = {1, static_cast<int64_t>(Input.PromptLabels.Num())};
+        Ort::Value labelsTensor = CreateTensor(PointLabelsScratch, labelsShape, UE_ARRAY_COUNT(labelsShape), DecoderInputTypes[4], DecoderHalfScratch[4]);
 
         // 6. mask_input [1, 1, 256, 256] - 全零
-        TArray<float> MaskInput;
-        MaskInput.AddZeroed(1 * 1 * 256 * 256);
-        std::vector<int64_t> maskShape = {1, 1, 256, 256};
-        Ort::Value maskTensor = CreateTensor(MaskInput, maskShape);
+        Ort::Value maskTensor = CreateTensor(MaskInput, MaskInputShape, UE_ARRAY_COUNT(MaskInputShape), DecoderInputTypes[5], DecoderHalfScratch[5]);
 
         // 7. has_mask_input [1] - 值为0
-        TArray<float> HasMaskInput = {0.0f};
-        std::vector<int64_t> hasMaskShape = {1};
-        Ort::Value hasMaskTensor = CreateTensor(HasMaskInput, hasMaskShape);
+        Ort::Value hasMaskTensor = CreateTensor(HasMaskInput, HasMaskInputShape, UE_ARRAY_COUNT(HasMaskInputShape), DecoderInputTypes[6], DecoderHalfScratch[6]);
 
         // 8. orig_im_size [2] - 强制为[1024, 1024]
-        TArray<int32> OrigImSize = {1024, 1024};
-        std::vector<int64_t> origSizeShape = {2};
-        Ort::Value origSizeTensor = CreateTensor(OrigImSize, origSizeShape);
-
-        // 准备输入数组
-        std::vector<Ort::Value> inputs;
-        inputs.push_back(std::move(embedTensor));
-        inputs.push_back(std::move(feats0Tensor));
-        inputs.push_back(std::move(feats1Tensor));
-        inputs.push_back(std::move(coordsTensor));
-        inputs.push_back(std::move(labelsTensor));
-        inputs.push_back(std::move(maskTensor));
-        inputs.push_back(std::move(hasMaskTensor));
-        inputs.push_back(std::move(origSizeTensor));
+        Ort::Value origSizeTensor = CreateTensor(OrigImSize, OrigImSizeShape, UE_ARRAY_COUNT(OrigImSizeShape));
 
-        // 输入名称
-        const char* inputNames[] = {
-            "image_embed", "high_res_feats_0", "high_res_feats_1", "point_coords",
-            "point_labels", "mask_input", "has_mask_input", "orig_im_size"
+        // 准备输入数组（栈上的固定数组，顺序与DecoderInputNames一致）
+        Ort::Value inputs[NumDecoderInputs] = {
+            std::move(embedTensor), std::move(feats0Tensor), std::move(feats1Tensor), std::move(coordsTensor),
+            std::move(labelsTensor), std::move(maskTensor), std::move(hasMaskTensor), std::move(origSizeTensor)
         };
+        FOnnxCaptureWriter::FRunScope captureScope(Capture, 1, DecoderInputNames, inputs, NumDecoderInputs);
 
-        // 输出名称
-        const char* outputNames[] = {"masks", "iou_predictions"};
-
-        // 运行推理
-        auto outputs = DecoderSession->Run(Ort::RunOptions{nullptr}, inputNames, inputs.data(), 8, outputNames, 2);
-
-        if (outputs.size() != 2)
+        // 运行推理：预热之后输出直接写入Output（fp16解码器的输出经由暂存区转换回float）
+        bool bDecoded = false;
+        if (DecoderOutputSlots[0].IsReady())
         {
-            UE_LOG(LogTemp, Error, TEXT("Decoder returned unexpected number of outputs: %d"), outputs.size());
-            return false;
+            try
+            {
+                Ort::Value outputTensors[] = {
+                    DecoderOutputSlots[0].Bind(memInfo, Output.MaskData),
+                    DecoderOutputSlots[1].Bind(memInfo, Output.IouScores)
+                };
+                DecoderSession->Run(Ort::RunOptions{nullptr}, DecoderInputNames, inputs, NumDecoderInputs, DecoderOutputNames, outputTensors, 2);
+                DecoderOutputSlots[0].Finish(Output.MaskData);
+                DecoderOutputSlots[1].Finish(Output.IouScores);
+                bDecoded = true;
+            }
+            catch (const Ort::Exception& e)
+            {
+                UE_LOG(LogTemp, Warning, TEXT("Preallocated decoder outputs rejected, re-capturing: %s"), UTF8_TO_TCHAR(e.what()));
+                DecoderOutputSlots[0].Reset();
+                DecoderOutputSlots[1].Reset();
+            }
         }
 
-        // 处理掩码输出 [1, 1, 1024, 1024]
-        auto& masksTensor = outputs[0];
-        auto masksShape = masksTensor.GetTensorTypeAndShapeInfo();
-        float* masksData = masksTensor.GetTensorMutableData<float>();
-        size_t masksSize = masksShape.GetElementCount();
+        if (!bDecoded)
+        {
+            // 预热运行：由ORT分配输出，复制到Output并记录输出形状
+            auto outputs = DecoderSession->Run(Ort::RunOptions{nullptr}, DecoderInputNames, inputs, NumDecoderInputs, DecoderOutputNames, 2);
 
-        Output.MaskData.Empty(masksSize);
-        Output.MaskData.AddUninitialized(masksSize);
-        FMemory::Memcpy(Output.MaskData.GetData(), masksData, masksSize * sizeof(float));
+            if (outputs.size() != 2)
+            {
+                UE_LOG(LogTemp, Error, TEXT("Decoder returned unexpected number of outputs: %d"), outputs.size());
+                return false;
+            }
+
+            // 掩码输出 [1, 1, 1024, 1024] 和IoU输出 [1, 1]（fp16解码器的输出在这里转换回float）
+            if (!FOnnxHalf::CopyToFloat(outputs[0], Output.MaskData) || !FOnnxHalf::CopyToFloat(outputs[1], Output.IouScores))
+            {
+                return false;
+            }
+            DecoderOutputSlots[0].Capture(outputs[0]);
+            DecoderOutputSlots[1].Capture(outputs[1]);
+        }
 
         // 应用sigmoid激活
         ApplySigmoid(Output.MaskData);
 
-        // 处理IoU输出 [1, 1]
-        auto& iouTensor = outputs[1];
-        auto iouShape = iouTensor.GetTensorTypeAndShapeInfo();
-        float* iouData = iouTensor.GetTensorMutableData<float>();
-        size_t iouSize = iouShape.GetElementCount();
-
-        Output.IouScores.Empty(iouSize);
-        Output.IouScores.AddUninitialized(iouSize);
-        FMemory::Memcpy(Output.IouScores.GetData(), iouData, iouSize * sizeof(float));
-
         // 设置输出元数据
         Output.NumMasks = 1;  // SAM2通常输出1个掩码
         Output.MaskWidth = 1024;
         Output.MaskHeight = 1024;
 
-        UE_LOG(LogTemp, Log, TEXT("Decoder inference completed, mask size=%d, IoU=%.3f"), 
+        UE_LOG(LogTemp, Verbose, TEXT("Decoder inference completed, mask size=%d, IoU=%.3f"), 
                Output.MaskData.Num(), Output.IouScores.Num() > 0 ? Output.IouScores[0] : 0.0f);
 
+        captureScope.SetSucceeded();
         return true;
     }
     catch (const Ort::Exception& e)
@@ -538,111 +1369,126 @@ bool FSam2ModelInstance::RunDecoder(const FSam2Input& Input, FSam2Output& Output
     }
 }
 
-Ort::Value FSam2ModelInstance::CreateTensor(const TArray<float>& Data, const std::vector<int64_t>& Shape)
+Ort::Value FSam2ModelInstance::CreateTensor(const TArray<float>& Data, const int64_t* Shape, size_t NumDims, ONNXTensorElementDataType Type, TArray<uint16>& Scratch)
 {
     Ort::MemoryInfo memInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
-    return Ort::Value::CreateTensor<float>(memInfo, const_cast<float*>(Data.GetData()), Data.Num(), Shape.data(), Shape.size());
+    return FOnnxHalf::CreateTensor(memInfo, Data.GetData(), Data.Num(), Shape, NumDims, Type, Scratch);
 }
 
-Ort::Value FSam2ModelInstance::CreateTensor(const TArray<int32>& Data, const std::vector<int64_t>& Shape)
+Ort::Value FSam2ModelInstance::CreateTensor(const FSam2CachedFeature& Feature, const int64_t* Shape, size_t NumDims, ONNXTensorElementDataType Type,
+                                            TArray<float>& FloatScratch, TArray<uint16>& HalfScratch)
 {
+    // 缓存与解码器输入精度相同时直接引用缓存，不复制
     Ort::MemoryInfo memInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
-    return Ort::Value::CreateTensor<int32_t>(memInfo, const_cast<int32_t*>(Data.GetData()), Data.Num(), Shape.data(), Shape.size());
+    return Feature.Half.Num() > 0
+        ? FOnnxHalf::CreateTensor(memInfo, Feature.Half.GetData(), Feature.Half.Num(), Shape, NumDims, Type, FloatScratch)
+        : FOnnxHalf::CreateTensor(memInfo, Feature.Float.GetData(), Feature.Float.Num(), Shape, NumDims, Type, HalfScratch);
 }
 
-void FSam2ModelInstance::TransformPromptPoints(const TArray<FVector2D>& InputPoints, int32 InputWidth, int32 InputHeight,
-                                              float Scale, int32 XOffset, int32 YOffset, TArray<float>& OutputCoords)
+Ort::Value FSam2ModelInstance::BindFeature(const Ort::MemoryInfo& MemoryInfo, FOnnxOutputSlot& Slot, FSam2CachedFeature& Feature) const
 {
-    OutputCoords.Empty(InputPoints.Num() * 2);
-
-    for (const FVector2D& Point : InputPoints)
+    if (bHalfPrecisionFeatures)
     {
-        // 将相对坐标转换为画布坐标
-        float CanvasX = XOffset + Point.X * InputWidth * Scale;
-        float CanvasY = YOffset + Point.Y * InputHeight * Scale;
-
-        // 确保坐标在有效范围内
-        CanvasX = FMath::Clamp(CanvasX, 0.0f, 1024.0f);
-        CanvasY = FMath::Clamp(CanvasY, 0.0f, 1024.0f);
-
-        OutputCoords.Add(CanvasX);
-        OutputCoords.Add(CanvasY);
-
-        UE_LOG(LogTemp, Log, TEXT("Transformed point (%.3f, %.3f) -> (%.3f, %.3f)"), 
-               Point.X, Point.Y, CanvasX, CanvasY);
+        Feature.Float.Empty();
+        return Slot.Bind(MemoryInfo, Feature.Half);
     }
+    Feature.Half.Empty();
+    return Slot.Bind(MemoryInfo, Feature.Float);
 }
 
-void FSam2ModelInstance::ApplySigmoid(TArray<float>& Data)
+void FSam2ModelInstance::FinishFeature(const FOnnxOutputSlot& Slot, FSam2CachedFeature& Feature) const
 {
-    for (float& Value : Data)
+    if (bHalfPrecisionFeatures)
+    {
+        Slot.Finish(Feature.Half);
+    }
+    else
     {
-        Value = 1.0f / (1.0f + FMath::Exp(-Value));
+        Slot.Finish(Feature.Float);
     }
 }
 
-bool FSam2ModelInstance::PostprocessMask(const TArray<float>& MaskData, int32 OriginalWidth, int32 OriginalHeight,
-                                        float Scale, int32 XOffset, int32 YOffset, TArray<uint8>& FinalMask)
+void FSam2ModelInstance::CacheInputTypes()
 {
-    if (MaskData.Num() != 1024 * 1024)
+    EncoderImageType = FOnnxHalf::GetInputElementType(*EncoderSession, "image");
+
+    DecoderInputTypes.SetNum(NumDecoderInputs);
+    for (int32 i = 0; i < NumDecoderInputs; ++i)
     {
-        UE_LOG(LogTemp, Error, TEXT("Invalid mask data size: %d"), MaskData.Num());
-        return false;
+        DecoderInputTypes[i] = FOnnxHalf::GetInputElementType(*DecoderSession, DecoderInputNames[i]);
     }
 
-    // 二值化掩码
-    TArray<uint8> BinaryMask;
-    BinaryMask.Empty(MaskData.Num());
-    for (float Value : MaskData)
+    UE_LOG(LogTemp, Log, TEXT("SAM2 precision: encoder input %s, decoder features %s, cached features %s"),
+           EncoderImageType == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16 ? TEXT("fp16") : TEXT("fp32"),
+           DecoderInputTypes[0] == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16 ? TEXT("fp16") : TEXT("fp32"),
+           bHalfPrecisionFeatures ? TEXT("fp16") : TEXT("fp32"));
+}
+
+bool FSam2ModelInstance::StoreFeature(const Ort::Value& Tensor, FSam2CachedFeature& OutFeature) const
+{
+    if (bHalfPrecisionFeatures)
     {
-        BinaryMask.Add(Value > 0.5f ? 255 : 0);
+        OutFeature.Float.Empty();
+        return FOnnxHalf::CopyToHalf(Tensor, OutFeature.Half);
     }
+    OutFeature.Half.Empty();
+    return FOnnxHalf::CopyToFloat(Tensor, OutFeature.Float);
+}
 
-    // 提取有效区域
-    int32 ScaledWidth = FMath::RoundToInt(OriginalWidth * Scale);
-    int32 ScaledHeight = FMath::RoundToInt(OriginalHeight * Scale);
+Ort::Value FSam2ModelInstance::CreateTensor(const TArray<int32>& Data, const int64_t* Shape, size_t NumDims)
+{
+    Ort::MemoryInfo memInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+    return Ort::Value::CreateTensor<int32_t>(memInfo, const_cast<int32_t*>(Data.GetData()), Data.Num(), Shape, NumDims);
+}
 
-    TArray<uint8> RegionMask;
-    RegionMask.Empty(ScaledWidth * ScaledHeight);
+void FSam2ModelInstance::TransformPromptPoints(const TArray<FVector2D>& InputPoints, int32 InputWidth, int32 InputHeight,
+                                              float Scale, int32 XOffset, int32 YOffset, TArray<float>& OutputCoords)
+{
+    OutputCoords.SetNumUninitialized(InputPoints.Num() * 2);
 
-    for (int32 y = 0; y < ScaledHeight; ++y)
+    const OnnxCore::Sam2::FLetterbox Letterbox = MakeLetterbox(InputWidth, InputHeight, Scale, XOffset, YOffset);
+    for (int32 i = 0; i < InputPoints.Num(); ++i)
     {
-        for (int32 x = 0; x < ScaledWidth; ++x)
-        {
-            int32 CanvasX = x + XOffset;
-            int32 CanvasY = y + YOffset;
+        const FVector2D& Point = InputPoints[i];
+        OnnxCore::Sam2::TransformPoint(Point.X, Point.Y, InputWidth, InputHeight, Letterbox, OutputCoords[i * 2], OutputCoords[i * 2 + 1]);
 
-            if (CanvasX >= 0 && CanvasX < 1024 && CanvasY >= 0 && CanvasY < 1024)
-            {
-                RegionMask.Add(BinaryMask[CanvasY * 1024 + CanvasX]);
-            }
-            else
-            {
-                RegionMask.Add(0);
-            }
-        }
+        UE_LOG(LogTemp, Verbose, TEXT("Transformed point (%.3f, %.3f) -> (%.3f, %.3f)"), 
+               Point.X, Point.Y, OutputCoords[i * 2], OutputCoords[i * 2 + 1]);
     }
+}
 
-    // 缩放回原始尺寸（使用最近邻插值）
-    FinalMask.Empty(OriginalWidth * OriginalHeight);
-    FinalMask.AddZeroed(OriginalWidth * OriginalHeight);
-
-    float InvScaleX = float(ScaledWidth) / float(OriginalWidth);
-    float InvScaleY = float(ScaledHeight) / float(OriginalHeight);
+void FSam2ModelInstance::ApplySigmoid(TArray<float>& Data)
+{
+    OnnxCore::Sam2::ApplySigmoid(Data.GetData(), Data.Num());
+}
 
-    for (int32 y = 0; y < OriginalHeight; ++y)
+bool FSam2ModelInstance::PostprocessMask(const TArray<float>& MaskData, int32 OriginalWidth, int32 OriginalHeight,
+                                        float Scale, int32 XOffset, int32 YOffset, TArray<uint8>& FinalMask)
+{
+    if (MaskData.Num() != OnnxCore::Sam2::ImageSize * OnnxCore::Sam2::ImageSize)
     {
-        for (int32 x = 0; x < OriginalWidth; ++x)
-        {
-            int32 SrcX = FMath::Min(FMath::RoundToInt(x * InvScaleX), ScaledWidth - 1);
-            int32 SrcY = FMath::Min(FMath::RoundToInt(y * InvScaleY), ScaledHeight - 1);
-
-            FinalMask[y * OriginalWidth + x] = RegionMask[SrcY * ScaledWidth + SrcX];
-        }
+        UE_LOG(LogTemp, Error, TEXT("Invalid mask data size: %d"), MaskData.Num());
+        return false;
     }
 
-    UE_LOG(LogTemp, Log, TEXT("Mask postprocessing completed: %dx%d -> %dx%d -> %dx%d"), 
-           1024, 1024, ScaledWidth, ScaledHeight, OriginalWidth, OriginalHeight);
+    const OnnxCore::Sam2::FLetterbox Letterbox = MakeLetterbox(OriginalWidth, OriginalHeight, Scale, XOffset, YOffset);
+    FinalMask.SetNumUninitialized(OriginalWidth * OriginalHeight);
+    OnnxCore::Sam2::PostprocessMask(MaskData.GetData(), OriginalWidth, OriginalHeight, Letterbox, FinalMask.GetData());
+
+    UE_LOG(LogTemp, Verbose, TEXT("Mask postprocessing completed: %dx%d -> %dx%d -> %dx%d"), 
+           1024, 1024, Letterbox.ScaledWidth, Letterbox.ScaledHeight, OriginalWidth, OriginalHeight);
 
     return true;
-}
\ No newline at end of file
+}
+
+OnnxCore::Sam2::FLetterbox FSam2ModelInstance::MakeLetterbox(int32 Width, int32 Height, float Scale, int32 XOffset, int32 YOffset)
+{
+    // 调用方传入的是预处理时记录的缩放和偏移，有效区域的大小按同样的方式取整
+    OnnxCore::Sam2::FLetterbox Letterbox;
+    Letterbox.Scale = Scale;
+    Letterbox.XOffset = XOffset;
+    Letterbox.YOffset = YOffset;
+    Letterbox.ScaledWidth = FMath::RoundToInt(Width * Scale);
+    Letterbox.ScaledHeight = FMath::RoundToInt(Height * Scale);
+    return Letterbox;
+}
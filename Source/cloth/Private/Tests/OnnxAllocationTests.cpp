@@ -0,0 +1,144 @@
+// OnnxAllocationTests.cpp
+
+#include "Misc/AutomationTest.h"
+#include "OnnxModelAsset.h"
+#include "OnnxModelInstance.h"
+#include "OnnxScratch.h"
+#include "UObject/Package.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace
+{
+    // 稳定状态下运行的请求数
+    constexpr int32 SteadyStateRuns = 16;
+
+    // 模型的元素数
+    constexpr int64 ModelElements = 64;
+
+    // 手写protobuf：测试不依赖磁盘上的模型文件
+    void AppendVarint(TArray<uint8>& Out, uint64 Value)
+    {
+        while (Value >= 0x80)
+        {
+            Out.Add(static_cast<uint8>(Value | 0x80));
+            Value >>= 7;
+        }
+        Out.Add(static_cast<uint8>(Value));
+    }
+
+    void AppendInt(TArray<uint8>& Out, uint32 Field, uint64 Value)
+    {
+        AppendVarint(Out, Field << 3);
+        AppendVarint(Out, Value);
+    }
+
+    void AppendBytes(TArray<uint8>& Out, uint32 Field, const TArray<uint8>& Bytes)
+    {
+        AppendVarint(Out, (Field << 3) | 2);
+        AppendVarint(Out, Bytes.Num());
+        Out.Append(Bytes);
+    }
+
+    void AppendString(TArray<uint8>& Out, uint32 Field, const char* Value)
+    {
+        const int32 length = FCStringAnsi::Strlen(Value);
+        AppendVarint(Out, (Field << 3) | 2);
+        AppendVarint(Out, length);
+        Out.Append(reinterpret_cast<const uint8*>(Value), length);
+    }
+
+    // ValueInfoProto：float张量，形状{Elements}
+    TArray<uint8> MakeValueInfo(const char* Name, int64 Elements)
+    {
+        TArray<uint8> dim;
+        AppendInt(dim, 1, Elements);
+        TArray<uint8> shape;
+        AppendBytes(shape, 1, dim);
+        TArray<uint8> tensorType;
+        AppendInt(tensorType, 1, ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT);
+        AppendBytes(tensorType, 2, shape);
+        TArray<uint8> type;
+        AppendBytes(type, 1, tensorType);
+
+        TArray<uint8> valueInfo;
+        AppendString(valueInfo, 1, Name);
+        AppendBytes(valueInfo, 2, type);
+        return valueInfo;
+    }
+
+    // 单个Relu节点的模型 y = Relu(x)
+    TArray<uint8> MakeReluModel(int64 Elements)
+    {
+        TArray<uint8> node;
+        AppendString(node, 1, "x");
+        AppendString(node, 2, "y");
+        AppendString(node, 4, "Relu");
+
+        TArray<uint8> graph;
+        AppendBytes(graph, 1, node);
+        AppendString(graph, 2, "relu");
+        AppendBytes(graph, 11, MakeValueInfo("x", Elements));
+        AppendBytes(graph, 12, MakeValueInfo("y", Elements));
+
+        TArray<uint8> opset;
+        AppendString(opset, 1, "");
+        AppendInt(opset, 2, 13);
+
+        TArray<uint8> model;
+        AppendInt(model, 1, 8);
+        AppendBytes(model, 7, graph);
+        AppendBytes(model, 8, opset);
+        return model;
+    }
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOnnxSteadyStateAllocationTest, "Onnx.Allocations.SteadyState",
+                                 EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FOnnxSteadyStateAllocationTest::RunTest(const FString& Parameters)
+{
+    if (!FOnnxAllocationCounter::IsEnabled())
+    {
+        AddInfo(TEXT("Allocation tracking is disabled in this build (ONNX_TRACK_ALLOCATIONS=0)"));
+        return true;
+    }
+
+    UOnnxModelAsset* asset = NewObject<UOnnxModelAsset>(GetTransientPackage());
+    asset->modelData_ = MakeReluModel(ModelElements);
+
+    FOnnxModelInstance instance(asset);
+    if (!TestTrue(TEXT("Model instance initialized"), instance.IsInitialized()))
+    {
+        return false;
+    }
+
+    TArray<float> input;
+    input.SetNumUninitialized(ModelElements);
+    for (int32 i = 0; i < input.Num(); ++i)
+    {
+        input[i] = static_cast<float>(i) - ModelElements / 2;
+    }
+    TArray<float> output;
+
+    // 预热：按实际大小增长暂存缓冲区、记录输出形状
+    for (int64 i = 0; i < FOnnxAllocationCounter::WarmupRuns; ++i)
+    {
+        TestTrue(TEXT("Warm-up run succeeded"), instance.Run(input, output));
+    }
+
+    const int64 violationsBefore = FOnnxAllocationCounter::GetTotalSteadyStateViolations();
+    for (int32 i = 0; i < SteadyStateRuns; ++i)
+    {
+        TestTrue(TEXT("Steady-state run succeeded"), instance.Run(input, output));
+    }
+
+    const FOnnxAllocationStats stats = instance.GetAllocationStats();
+    TestEqual(TEXT("Steady-state runs without heap allocations"), FOnnxAllocationCounter::GetTotalSteadyStateViolations(), violationsBefore);
+    TestEqual(TEXT("Max allocations per steady-state run"), stats.MaxSteadyStateAllocations, int64(0));
+    TestEqual(TEXT("Output element count"), output.Num(), static_cast<int32>(ModelElements));
+    TestEqual(TEXT("Relu output"), output[0], 0.0f);
+    return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
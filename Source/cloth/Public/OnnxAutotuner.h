@@ -0,0 +1,104 @@
+// OnnxAutotuner.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "OnnxSessionSettings.h"
+#include "OnnxBenchmark.h"
+#include "OnnxModelVariants.h"
+
+/**
+ * 自动调优的搜索空间
+ */
+struct CLOTH_API FOnnxAutotuneGrid
+{
+	// 候选的算子内线程数，为空时使用1,2,4,...直到物理核心数
+	TArray<int32> IntraOpThreads;
+
+	// Parallel模式下候选的算子间线程数
+	TArray<int32> InterOpThreads = { 2 };
+
+	// 候选的执行模式
+	TArray<EOnnxExecutionMode> ExecutionModes = { EOnnxExecutionMode::Sequential, EOnnxExecutionMode::Parallel };
+
+	// 候选的每NUMA节点副本数（按并发吞吐量评估），为空时不调整副本数
+	TArray<int32> ReplicasPerNumaNode;
+
+	// 副本数的吞吐量至少要比单会话提升这么多才会被采用
+	float MinReplicaSpeedup = 1.1f;
+
+	// 展开IntraOpThreads的默认值
+	TArray<int32> GetIntraOpCandidates() const;
+};
+
+/**
+ * 一次调优的结果
+ */
+struct CLOTH_API FOnnxAutotuneResult
+{
+	bool bSucceeded = false;
+
+	// 最佳配置（已合并到传入的基础配置上）
+	FOnnxSessionSettings BestSettings;
+
+	// 最佳配置的测试结果
+	FOnnxBenchmarkResult BestResult;
+
+	// 所有候选配置的测试结果
+	TArray<FOnnxBenchmarkResult> Results;
+};
+
+/**
+ * FOnnxAutotuner
+ * 按模型和本机CPU调优线程配置：用真实形状的合成输入测试一组配置，
+ * 把最佳结果保存到Saved/Onnx/Autotune/<CPU型号_核心数>.ini，并在创建会话时自动应用。
+ */
+class CLOTH_API FOnnxAutotuner
+{
+public:
+	// 本机标识：CPU型号 + 物理核心数 + 逻辑核心数
+	static FString GetMachineKey();
+
+	// 本机调优结果文件
+	static FString GetResultsFilePath();
+
+	// 模型标识：名称 + 内容哈希（模型更新后旧结果自动失效）
+	static FString MakeModelKey(const FString& ModelName, const FString& ModelHash);
+
+	// 读取本机对该模型的调优结果并合并到InOutSettings，没有结果时返回false
+	static bool FindTunedSettings(const FString& ModelKey, FOnnxSessionSettings& InOutSettings);
+
+	// 保存调优结果
+	static bool SaveTunedSettings(const FString& ModelKey, const FOnnxSessionSettings& Settings, const FOnnxBenchmarkResult& Result);
+
+	// 读取/保存本机为该模型选择的执行提供程序
+	static bool FindSelectedProvider(const FString& ModelKey, EOnnxExecutionProvider& OutProvider);
+	static bool SaveSelectedProvider(const FString& ModelKey, EOnnxExecutionProvider Provider, const FOnnxBenchmarkResult& Result);
+
+	// 读取/保存本机比较后选择的量化变体
+	static bool FindSelectedVariant(const FString& Key, EOnnxModelPrecision& OutPrecision);
+	static bool SaveSelectedVariant(const FString& Key, const FOnnxVariantReport& Report);
+
+	// 测试Grid中的所有配置并返回最佳配置（不保存）
+	static FOnnxAutotuneResult Tune(const FOnnxSessionFactory& Factory, const FOnnxSessionSettings& BaseSettings,
+									const FOnnxAutotuneGrid& Grid, const FOnnxBenchmarkParams& Params, const FString& Label);
+
+	// 调优并保存
+	static FOnnxAutotuneResult TuneAndSave(const FOnnxSessionFactory& Factory, const FOnnxSessionSettings& BaseSettings,
+										   const FOnnxAutotuneGrid& Grid, const FOnnxBenchmarkParams& Params, const FString& ModelKey);
+
+	// 不做任何测试的配置：已保存的执行提供程序选择和线程调优结果，没有时使用Settings中的值。
+	// 还需要测试EP或首次调优时bOutNeedsTuning为true，调用方先用返回的配置创建会话，再在后台线程上调用ResolveSettings
+	static FOnnxSessionSettings ResolveCachedSettings(const FString& ModelKey, const FOnnxSessionSettings& Settings, bool& bOutNeedsTuning);
+
+	// 决定创建会话时实际使用的配置：先按偏好列表选择执行提供程序，再按Settings.AutotuneMode应用（或首次执行）线程调优。
+	// 可能运行数秒到数分钟的测试，只在后台线程上调用
+	static FOnnxSessionSettings ResolveSettings(const FString& ModelKey, const FOnnxSessionSettings& Settings,
+												const FOnnxSessionFactory& Factory, const FOnnxBenchmarkParams& Params);
+
+	// 调优时使用的默认测试参数（不含空闲间隔，只比较延迟）
+	static FOnnxBenchmarkParams MakeDefaultParams();
+
+private:
+	static FCriticalSection Mutex;
+};
@@ -0,0 +1,143 @@
+// OnnxBenchmark.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "OnnxSessionSettings.h"
+#include "OnnxCoreBenchmark.h"
+
+// 包含ONNX Runtime的实现头文件
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#endif
+#include "onnxruntime_cxx_api.h"
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
+
+#include <string>
+#include <vector>
+
+#include "OnnxBenchmark.generated.h"
+
+/**
+ * 单个会话配置的基准测试结果
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxBenchmarkResult
+{
+	GENERATED_BODY()
+
+	// 配置描述
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Benchmark")
+	FString Label;
+
+	// 测试时使用的会话配置
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Benchmark")
+	FOnnxSessionSettings Settings;
+
+	// 计时的Run次数
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Benchmark")
+	int32 Iterations = 0;
+
+	// 单次Run延迟（毫秒）
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Benchmark")
+	float MeanLatencyMs = 0.0f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Benchmark")
+	float P50LatencyMs = 0.0f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Benchmark")
+	float P95LatencyMs = 0.0f;
+
+	// 每次请求（Run加上之后的空闲间隔）消耗的CPU时间（毫秒）
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Benchmark")
+	float CpuMsPerRequest = 0.0f;
+
+	// CPU时间只统计了被测会话的ORT工作线程和调用线程；为false时是整个进程的CPU时间，
+	// 包括游戏线程、渲染线程和其他模型（会话的线程不经过插件的线程钩子时，例如非CPU EP）
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Benchmark")
+	bool bPerThreadCpu = false;
+
+	// 空闲间隔中被消耗的CPU时间占比（自旋浪费的CPU），以单核百分比计
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Benchmark")
+	float IdleCpuPercent = 0.0f;
+
+	// 吞吐量（每秒Run次数，不含空闲间隔）
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Benchmark")
+	float RunsPerSecond = 0.0f;
+
+	// 测试是否成功完成
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Benchmark")
+	bool bSucceeded = false;
+
+	FString ToString() const;
+};
+
+// 基准测试用的输入张量集合（与引擎无关的OnnxCore和独立的OnnxPerf工具共用）
+typedef OnnxCore::FInputSet FOnnxBenchmarkInputs;
+
+/**
+ * 基准测试参数
+ */
+struct CLOTH_API FOnnxBenchmarkParams
+{
+	// 预热次数（不计时）
+	int32 WarmupIterations = 5;
+
+	// 计时次数
+	int32 Iterations = 50;
+
+	// 两次请求之间的空闲间隔（秒），模拟交互式请求；自旋的CPU开销就体现在这段时间里
+	double IdleGapSeconds = 0.016;
+
+	// 动态维度（-1）的替换值
+	int64 DynamicDimValue = 1;
+
+	// 按输入名称覆盖形状
+	TMap<FString, TArray<int64>> ShapeOverrides;
+
+	// 合成输入生成后的自定义修改（例如把SAM2的orig_im_size设为真实值）
+	TFunction<void(FOnnxBenchmarkInputs&)> InputCustomizer;
+};
+
+// 根据会话配置创建会话的工厂
+typedef TFunction<TUniquePtr<Ort::Session>(const FOnnxSessionSettings&)> FOnnxSessionFactory;
+
+/**
+ * FOnnxBenchmark
+ * 会话配置的基准测试工具：用真实形状的合成输入测量延迟与CPU时间的权衡。
+ */
+class CLOTH_API FOnnxBenchmark
+{
+public:
+	// 当前进程累计消耗的CPU时间（秒），不支持的平台返回-1
+	static double GetProcessCpuSeconds();
+
+	// 张量元素的字节大小，不支持的类型返回0
+	static size_t GetElementSize(ONNXTensorElementDataType Type);
+
+	// 延迟样本的分位数（Fraction为0~1），没有样本时返回0
+	static float Percentile(TArray<double> Values, double Fraction);
+
+	// 按会话的输入元数据生成合成输入（浮点为[0,1)随机数，整数为1）
+	static bool MakeSyntheticInputs(Ort::Session& Session, const FOnnxBenchmarkParams& Params, FOnnxBenchmarkInputs& OutInputs);
+
+	// 对一个已创建的会话进行测试。CpuClock为空时CPU时间按整个进程统计
+	static FOnnxBenchmarkResult RunSession(Ort::Session& Session, const FOnnxBenchmarkParams& Params, const FString& Label,
+										   TFunction<double()> CpuClock = nullptr);
+
+	// 多个会话同时运行（每个会话一个并发请求流，不含空闲间隔），RunsPerSecond为总吞吐量
+	static FOnnxBenchmarkResult RunConcurrent(const TArray<Ort::Session*>& Sessions, const FOnnxBenchmarkParams& Params, const FString& Label);
+
+	// 用工厂依次创建各个配置的会话并测试。CPU时间按会话自己的ORT工作线程加上调用线程统计（见bPerThreadCpu）
+	static TArray<FOnnxBenchmarkResult> RunConfigurations(const FOnnxSessionFactory& Factory, const TArray<FOnnxSessionSettings>& Configurations,
+														  const FOnnxBenchmarkParams& Params, const FString& LabelPrefix = FString());
+
+	// 在BaseSettings基础上测试所有自旋策略
+	static TArray<FOnnxBenchmarkResult> BenchmarkSpinModes(const FOnnxSessionFactory& Factory, const FOnnxSessionSettings& BaseSettings,
+														   const FOnnxBenchmarkParams& Params, const FString& LabelPrefix = FString());
+
+	// 将结果以表格形式输出到日志
+	static void LogResults(const TArray<FOnnxBenchmarkResult>& Results);
+};
@@ -0,0 +1,287 @@
+// OnnxCapture.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "OnnxSessionSettings.h"
+
+// 包含ONNX Runtime的实现头文件
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#endif
+#include "onnxruntime_cxx_api.h"
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
+
+#include <atomic>
+
+#include "OnnxCapture.generated.h"
+
+class IFileHandle;
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/**
+ * 录制配置
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxCaptureConfig
+{
+	GENERATED_BODY()
+
+	// 被录制的请求比例
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Capture", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float SampleRate = 1.0f;
+
+	// 达到记录数或文件大小上限后停止录制（文件保持有效）
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Capture", meta = (ClampMin = "1"))
+	int32 MaxRecords = 1000;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Capture", meta = (ClampMin = "1"))
+	int32 MaxFileMB = 2048;
+};
+
+/**
+ * 一个模型在回放中的延迟分布
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxReplayResult
+{
+	GENERATED_BODY()
+
+	// 模型在捕获中的角色（model / encoder / decoder）和来源
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Capture")
+	FString Role;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Capture")
+	FString Source;
+
+	// 回放使用的会话配置
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Capture")
+	FOnnxSessionSettings Settings;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Capture")
+	int32 NumRecords = 0;
+
+	// 计时的运行次数和失败次数
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Capture")
+	int32 NumRuns = 0;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Capture")
+	int32 NumFailed = 0;
+
+	// 回放的延迟（毫秒，只含Run）
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Capture")
+	float MeanLatencyMs = 0.0f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Capture")
+	float P50LatencyMs = 0.0f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Capture")
+	float P90LatencyMs = 0.0f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Capture")
+	float P99LatencyMs = 0.0f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Capture")
+	float MaxLatencyMs = 0.0f;
+
+	// 录制时测得的延迟（毫秒，含张量准备和输出复制）
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Capture")
+	float RecordedMeanLatencyMs = 0.0f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Capture")
+	float RecordedP50LatencyMs = 0.0f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Capture")
+	float RecordedP99LatencyMs = 0.0f;
+
+	FString ToString() const;
+};
+
+/**
+ * 录制中的一个输入张量。写入时引用调用方的数据，读取时引用映射的捕获文件。
+ */
+struct CLOTH_API FOnnxCaptureTensorView
+{
+	const char* Name = nullptr;
+	ONNXTensorElementDataType Type = ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+	TConstArrayView<int64> Shape;
+	const void* Data = nullptr;
+	int64 NumBytes = 0;
+};
+
+/**
+ * 捕获中的一个模型（会话）：回放时按来源和配置重新创建会话
+ */
+struct CLOTH_API FOnnxCaptureModel
+{
+	FString Role;
+
+	// 模型资产的对象路径或.onnx文件的完整路径
+	FString Source;
+	bool bSourceIsAsset = false;
+
+	FOnnxSessionSettings Settings;
+
+	// 录制时请求的输出
+	TArray<FString> OutputNames;
+};
+
+/**
+ * 捕获中的一次运行
+ */
+struct CLOTH_API FOnnxCaptureRecord
+{
+	int32 ModelIndex = 0;
+
+	// 距离录制开始的时间（秒）
+	double TimestampSeconds = 0.0;
+
+	double LatencyMs = 0.0;
+	bool bSucceeded = false;
+
+	TArray<FOnnxCaptureTensorView> Inputs;
+};
+
+/**
+ * FOnnxCaptureWriter
+ * 把推理输入（张量、形状、类型）、会话配置和延迟写入紧凑的二进制捕获文件。
+ * 张量数据按64字节对齐，回放时直接内存映射文件并引用其中的数据，不需要反序列化。
+ * 未录制时FRunScope只检查一个原子标志；录制本身的分配不计入请求的分配统计。
+ */
+class CLOTH_API FOnnxCaptureWriter
+{
+public:
+	FOnnxCaptureWriter() = default;
+	~FOnnxCaptureWriter();
+
+	FOnnxCaptureWriter(const FOnnxCaptureWriter&) = delete;
+	FOnnxCaptureWriter& operator=(const FOnnxCaptureWriter&) = delete;
+
+	// 捕获文件路径：为空时在Saved/Onnx/Captures下按BaseName和时间生成，相对路径按同一目录解析
+	static FString ResolvePath(const FString& FilePath, const FString& BaseName);
+
+	// 创建捕获文件并写入模型表，已在录制时先结束之前的录制
+	bool Open(const FString& FilePath, const TArray<FOnnxCaptureModel>& Models, const FOnnxCaptureConfig& InConfig);
+	void Close();
+
+	bool IsOpen() const { return bOpen_; }
+	FString GetFilePath() const;
+	int32 GetNumRecords() const { return numRecords_; }
+
+	// 本次请求是否被采样（未录制或达到上限时返回false）
+	bool ShouldSample();
+
+	// 追加一条记录，线程安全
+	void Append(int32 ModelIndex, TConstArrayView<FOnnxCaptureTensorView> Inputs, double LatencyMs, bool bSucceeded);
+
+	/**
+	 * 一次运行的录制作用域：构造时开始计时，析构时（包括提前返回和异常）写入记录。
+	 * 输入必须在作用域结束之前保持有效；成功的运行需要调用SetSucceeded。
+	 */
+	class CLOTH_API FRunScope
+	{
+	public:
+		// 直接录制传给Session::Run的张量
+		FRunScope(FOnnxCaptureWriter& InWriter, int32 InModelIndex, const char* const* InNames, const Ort::Value* InValues, int32 InNumInputs);
+
+		// 录制调用方提供的张量
+		FRunScope(FOnnxCaptureWriter& InWriter, int32 InModelIndex, TConstArrayView<FOnnxCaptureTensorView> InTensors);
+
+		~FRunScope();
+
+		FRunScope(const FRunScope&) = delete;
+		FRunScope& operator=(const FRunScope&) = delete;
+
+		void SetSucceeded(bool bInSucceeded = true) { bSucceeded = bInSucceeded; }
+
+	private:
+		// 未被采样时为nullptr
+		FOnnxCaptureWriter* Writer;
+		int32 ModelIndex;
+		const char* const* Names = nullptr;
+		const Ort::Value* Values = nullptr;
+		int32 NumInputs = 0;
+		TConstArrayView<FOnnxCaptureTensorView> Tensors;
+		double StartTime = 0.0;
+		bool bSucceeded = false;
+	};
+
+private:
+	mutable FCriticalSection mutex_;
+	IFileHandle* file_ = nullptr;
+	FString filePath_;
+	FOnnxCaptureConfig config_;
+	double startTime_ = 0.0;
+
+	std::atomic<bool> bOpen_{false};
+	std::atomic<int32> numRecords_{0};
+	std::atomic<int64> numBytes_{0};
+};
+
+/**
+ * FOnnxCaptureReader
+ * 内存映射捕获文件并解析模型表和记录。张量数据直接引用映射的内存，Reader必须比使用它们的张量活得更久。
+ * 文件末尾被截断的记录（例如录制进程崩溃）会被忽略。
+ */
+class CLOTH_API FOnnxCaptureReader
+{
+public:
+	FOnnxCaptureReader() = default;
+	~FOnnxCaptureReader();
+
+	FOnnxCaptureReader(const FOnnxCaptureReader&) = delete;
+	FOnnxCaptureReader& operator=(const FOnnxCaptureReader&) = delete;
+
+	bool Open(const FString& FilePath);
+	void Close();
+
+	const TArray<FOnnxCaptureModel>& GetModels() const { return models_; }
+	const TArray<FOnnxCaptureRecord>& GetRecords() const { return records_; }
+
+private:
+	IMappedFileHandle* handle_ = nullptr;
+	IMappedFileRegion* region_ = nullptr;
+	TArray<FOnnxCaptureModel> models_;
+	TArray<FOnnxCaptureRecord> records_;
+};
+
+/**
+ * 回放参数
+ */
+struct CLOTH_API FOnnxReplayParams
+{
+	// 每个模型开始计时前预热运行的记录数
+	int32 WarmupRuns = 3;
+
+	// 所有记录重复回放的遍数
+	int32 Passes = 1;
+
+	// 最多回放的记录数，0表示全部
+	int32 MaxRecords = 0;
+
+	// 使用录制时的会话配置，否则使用Settings
+	bool bUseRecordedSettings = true;
+	FOnnxSessionSettings Settings;
+
+	// 大于0时覆盖会话的IntraOpThreads（比较不同线程数下的同一组输入）
+	int32 IntraOpThreads = 0;
+};
+
+/**
+ * FOnnxCaptureReplay
+ * 按捕获中的模型来源和会话配置重新创建会话，以全速（记录之间没有间隔）重新运行录制的输入，报告延迟分布。
+ * 由OnnxReplay命令行工具（UOnnxReplayCommandlet）调用，也可以在编辑器中直接使用。
+ */
+class CLOTH_API FOnnxCaptureReplay
+{
+public:
+	// 每个模型一项结果，无法打开捕获时返回空数组
+	static TArray<FOnnxReplayResult> Replay(const FString& CapturePath, const FOnnxReplayParams& Params);
+
+	// 将结果以表格形式输出到日志
+	static void LogResults(const TArray<FOnnxReplayResult>& Results);
+};
@@ -6,12 +6,19 @@
 #include "Components/ActorComponent.h"
 #include "OnnxModelAsset.h"
 #include "OnnxModelInstance.h"
+#include "OnnxModelRegistry.h"
+#include "OnnxBenchmark.h"
+#include "OnnxGeneration.h"
+#include "OnnxShadow.h"
 #include "OnnxComponent.generated.h"
 
 // Forward declarations
 class UOnnxModelAsset;
 class FOnnxModelInstance;
 
+// 异步基准测试完成时在游戏线程上调用（测试无法开始时Results为空）
+DECLARE_DYNAMIC_DELEGATE_OneParam(FOnOnnxBenchmarkCompleted, const TArray<FOnnxBenchmarkResult>&, Results);
+
 /**
  * 通用ONNX张量数据结构
  */
@@ -69,6 +76,24 @@ public:
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Model")
     FString ModelFilePath;
 
+    // 通过模型注册表与使用同一模型和配置的其他组件共享实例（会话只创建一次，关卡切换后在宽限期内复用）。
+    // 有状态模型（StateTensors非空）总是使用独占的实例。录制、调优等操作作用于共享实例的所有使用者。
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Model")
+    bool bShareModelInstance = true;
+
+    // 有状态模型（GRU控制器、流式音频等）在调用之间传递的状态输入/输出对。
+    // 非空时状态保持绑定在实例内部，RunInference只需要提供新的输入。
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Model|State")
+    TArray<FOnnxStateTensorPair> StateTensors;
+
+    // 仅解码器Transformer模型的输入输出命名和KV缓存长度（用于GenerateTokens）
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Model|Generation")
+    FOnnxGeneratorConfig GenerationConfig;
+
+    // 影子模式：把一部分请求镜像给候选模型并比较延迟和输出，候选结果不会返回
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Model|Shadow")
+    FOnnxShadowConfig ShadowConfig;
+
     // === 核心接口 ===
 
     // 初始化ONNX模型
@@ -79,6 +104,14 @@ public:
     UFUNCTION(BlueprintCallable, Category = "ONNX Inference")
     virtual bool RunInference(const TArray<float>& InputData, TArray<float>& OutputData);
 
+    // 以张量运行推理：张量直接作为ORT的输入/输出，不经过float数组（见FOnnxModelInstance::Run）
+    UFUNCTION(BlueprintCallable, Category = "ONNX Inference")
+    virtual bool RunInferenceTensor(const FOnnxTensor& Input, FOnnxTensor& Output);
+
+    // 运行推理并获取指定名称的输出（例如资产extraOutputs_中暴露的骨干网络特征图）
+    UFUNCTION(BlueprintCallable, Category = "ONNX Inference")
+    virtual bool RunInferenceForOutput(const TArray<float>& InputData, const FString& OutputName, TArray<float>& OutputData);
+
     // 检查是否已初始化
     UFUNCTION(BlueprintCallable, Category = "ONNX Inference")
     virtual bool IsInitialized() const;
@@ -98,13 +131,106 @@ public:
     UFUNCTION(BlueprintCallable, Category = "ONNX Inference")
     void Reset();
 
+    // 把状态张量恢复为初始值（例如开始新的音频流）
+    UFUNCTION(BlueprintCallable, Category = "ONNX State")
+    void ResetState();
+
+    // 保存当前状态
+    UFUNCTION(BlueprintCallable, Category = "ONNX State")
+    FOnnxStateSnapshot SnapshotState() const;
+
+    // 从快照恢复状态，快照与模型的状态张量不匹配时返回false
+    UFUNCTION(BlueprintCallable, Category = "ONNX State")
+    bool RestoreState(const FOnnxStateSnapshot& Snapshot);
+
+    // 自回归生成：从提示词ID生成新的词ID（分词由调用方处理），KV缓存在调用之间复用
+    UFUNCTION(BlueprintCallable, Category = "ONNX Generation")
+    bool GenerateTokens(const TArray<int64>& PromptTokens, const FOnnxGenerationParams& Params, TArray<int64>& OutTokens, FOnnxGenerationStats& OutStats);
+
+    // C++接口：批量生成并流式回调每个词
+    FOnnxGenerator* GetGenerator();
+
+    // 基准测试：比较各个自旋策略的延迟与CPU占用，用于为模型挑选SpinMode。测试在后台线程上运行（需要数秒），
+    // 结束后在游戏线程上调用OnCompleted；CPU时间按被测会话的ORT线程统计（见FOnnxBenchmarkResult::bPerThreadCpu）。
+    // IdleGapMs模拟交互式请求之间的空闲间隔，IntraOpThreads<=0时沿用模型当前配置
+    UFUNCTION(BlueprintCallable, Category = "ONNX Benchmark")
+    void BenchmarkSpinModesAsync(const FOnOnnxBenchmarkCompleted& OnCompleted, int32 Iterations = 50, float IdleGapMs = 16.0f, int32 IntraOpThreads = 0);
+
+    // 同步版本（C++和命令行工具），阻塞调用线程直到测试结束
+    TArray<FOnnxBenchmarkResult> BenchmarkSpinModes(int32 Iterations = 50, float IdleGapMs = 16.0f, int32 IntraOpThreads = 0);
+
+    // 模型的驻留统计（驻留内存、被驱逐和重新加载的次数）
+    UFUNCTION(BlueprintCallable, Category = "ONNX Model Info")
+    virtual FOnnxResidencyStats GetResidencyStats() const;
+
+    // 推理的堆分配统计：预热之后每次请求应为0（只在Debug/Development构建中统计）
+    UFUNCTION(BlueprintCallable, Category = "ONNX Model Info")
+    virtual FOnnxAllocationStats GetAllocationStats() const;
+
+    // 加载时选定的执行提供程序
+    UFUNCTION(BlueprintCallable, Category = "ONNX Model Info")
+    virtual EOnnxExecutionProvider GetExecutionProvider() const;
+
+    // 自动调优：在本机上测试一组线程数/执行模式（可选副本数），把最佳配置保存到Saved/并立即重新加载模型应用
+    UFUNCTION(BlueprintCallable, Category = "ONNX Benchmark")
+    virtual TArray<FOnnxBenchmarkResult> AutotuneThreading(int32 Iterations = 20, bool bTuneReplicas = false);
+
+    // 在样本文件夹（.npy/.bin）上比较模型资产的FP32基准和各个量化变体，报告加速比和输出误差；
+    // 资产使用Validated策略时记录最快的通过变体并立即重新加载模型应用
+    UFUNCTION(BlueprintCallable, Category = "ONNX Benchmark")
+    virtual TArray<FOnnxVariantReport> CompareModelVariants(const FString& SampleFolder, int32 Iterations = 10);
+
+    // 加载的模型变体精度
+    UFUNCTION(BlueprintCallable, Category = "ONNX Model Info")
+    virtual EOnnxModelPrecision GetModelPrecision() const;
+
+    // 影子模式的比较报告（未启用时全部为0）
+    UFUNCTION(BlueprintCallable, Category = "ONNX Shadow")
+    FOnnxShadowReport GetShadowReport() const;
+
+    // 清空影子比较统计，例如切换候选模型配置之后
+    UFUNCTION(BlueprintCallable, Category = "ONNX Shadow")
+    void ResetShadowReport();
+
+    // 把推理输入录制到捕获文件（FilePath为空时在Saved/Onnx/Captures下生成），用-run=OnnxReplay离线回放
+    UFUNCTION(BlueprintCallable, Category = "ONNX Capture")
+    virtual bool StartCapture(const FString& FilePath, const FOnnxCaptureConfig& Config);
+
+    UFUNCTION(BlueprintCallable, Category = "ONNX Capture")
+    virtual void StopCapture();
+
 protected:
-    // ONNX模型实例
-    TUniquePtr<FOnnxModelInstance> ModelInstance;
+    // ONNX模型实例（共享时由模型注册表持有，这里是引用计数句柄）
+    FOnnxModelHandle ModelInstance;
+
+    // 引用ModelInstance的生成器（首次使用时创建），声明在其后以保证先析构
+    TUniquePtr<FOnnxGenerator> Generator;
+
+    // 影子模式的候选模型和调度器；调度器析构时等待进行中的影子任务，声明在候选模型之后以保证先析构
+    FOnnxModelHandle ShadowInstance;
+    TUniquePtr<FOnnxShadowRunner> ShadowRunner;
 
     // 初始化标志
     bool bIsInitialized = false;
 
+    // 异步基准测试进行中（同一组件同时只运行一个，只在游戏线程上访问）
+    bool bBenchmarkRunning = false;
+
+    // 在游戏线程上准备自旋策略测试的任务。任务持有实例的引用，测试期间组件重新初始化或销毁不影响它；实例不可用时返回空
+    virtual TFunction<TArray<FOnnxBenchmarkResult>()> MakeSpinBenchmarkJob(const FOnnxBenchmarkParams& Params, int32 IntraOpThreads) const;
+
     // 初始化模型实例（可被子类重写）
     virtual bool InitializeModel();
+
+    // 从模型注册表获取共享实例，或在bShared为false（或注册表不可用）时创建独占的实例
+    FOnnxModelHandle AcquireModelInstance(UOnnxModelAsset* Asset, const FString& Path, bool bShared) const;
+
+    // 丢弃注册表中本组件模型的共享实例，使调优或变体选择的结果在重新初始化时生效
+    void InvalidateSharedInstance() const;
+
+    // 按ShadowConfig创建候选模型（可被子类重写），失败时只记录警告，不影响生产模型
+    virtual void InitializeShadow();
+
+    // 停止影子模式：先等待进行中的影子任务，再释放候选模型
+    virtual void ResetShadow();
 };
\ No newline at end of file
@@ -0,0 +1,40 @@
+// OnnxExecutionProviders.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "OnnxSessionSettings.h"
+#include "OnnxBenchmark.h"
+
+/**
+ * FOnnxExecutionProviders
+ * CPU执行提供程序的探测、注册与选择。
+ * 偏好列表中当前ORT构建不支持的EP会被跳过；多个EP可用时在真实模型上测试，选择平均延迟最低的，
+ * 并把结果记录到本机的调优文件中，下次加载时直接使用。
+ */
+class CLOTH_API FOnnxExecutionProviders
+{
+public:
+	// 用于日志的名称
+	static const TCHAR* GetDisplayName(EOnnxExecutionProvider Provider);
+
+	// Ort::GetAvailableProviders()返回的名称，例如"XnnpackExecutionProvider"
+	static const char* GetOrtProviderName(EOnnxExecutionProvider Provider);
+
+	// 当前ORT构建是否包含该EP
+	static bool IsAvailable(EOnnxExecutionProvider Provider);
+
+	// 把EP注册到会话选项；默认CPU EP不需要注册。EP不可用时抛出Ort::Exception。
+	static void AppendTo(Ort::SessionOptions& SessionOptions, EOnnxExecutionProvider Provider, int32 NumThreads);
+
+	// 不做测试的选择：已保存的选择或唯一可用的候选。需要测试才能决定时返回Settings.ExecutionProvider
+	// （不可用时为CPU）并把bOutNeedsBenchmark设为true，由调用方在后台线程上调用SelectProvider
+	static FOnnxSessionSettings SelectCachedProvider(const FString& ModelKey, const FOnnxSessionSettings& Settings, bool& bOutNeedsBenchmark);
+
+	// 按Settings.ExecutionProviderPreference选择EP，返回写入了ExecutionProvider的配置。
+	// 多个EP可用且没有已保存的选择时会在真实模型上测试（可能需要数秒），不要在游戏线程上调用。
+	// bIgnoreSaved为true时忽略已保存的选择，重新测试。OutResults可选地返回各EP的测试结果。
+	static FOnnxSessionSettings SelectProvider(const FString& ModelKey, const FOnnxSessionSettings& Settings,
+											   const FOnnxSessionFactory& Factory, const FOnnxBenchmarkParams& Params,
+											   bool bIgnoreSaved = false, TArray<FOnnxBenchmarkResult>* OutResults = nullptr);
+};
@@ -0,0 +1,73 @@
+// OnnxExternalData.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+
+// 包含ONNX Runtime的实现头文件
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#endif
+#include "onnxruntime_cxx_api.h"
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/**
+ * FOnnxMappedExternalFile
+ * 一个以只读方式内存映射的ONNX外部数据文件（.onnx.data等）。
+ * 映射在最后一个持有者释放时解除，使用它的会话必须先于它销毁。
+ */
+class CLOTH_API FOnnxMappedExternalFile
+{
+public:
+	FOnnxMappedExternalFile(const FString& InFullPath, IMappedFileHandle* InHandle, IMappedFileRegion* InRegion);
+	~FOnnxMappedExternalFile();
+
+	const uint8* GetData() const;
+	int64 GetSize() const;
+	const FString& GetFullPath() const { return fullPath_; }
+
+private:
+	FOnnxMappedExternalFile(const FOnnxMappedExternalFile&) = delete;
+	FOnnxMappedExternalFile& operator=(const FOnnxMappedExternalFile&) = delete;
+
+	FString fullPath_;
+	IMappedFileHandle* handle_ = nullptr;
+	IMappedFileRegion* region_ = nullptr;
+};
+
+typedef TSharedPtr<FOnnxMappedExternalFile, ESPMode::ThreadSafe> FOnnxMappedExternalFilePtr;
+
+/**
+ * FOnnxExternalDataRegistry
+ * 外部初始化器文件的全局映射表。
+ * 共享同一骨干网络权重文件的多个模型/会话只会映射一次，所有会话的张量都指向同一块映射内存，
+ * 既减少常驻内存，也省去了每个会话各自读取权重文件的I/O。
+ */
+class CLOTH_API FOnnxExternalDataRegistry
+{
+public:
+	// 查找或映射指定的外部数据文件。失败时返回nullptr。
+	static FOnnxMappedExternalFilePtr FindOrMap(const FString& FilePath);
+
+	// 在模型旁边查找常见命名的外部数据文件（model.onnx.data、model.data、model.onnx_data）。
+	static TArray<FString> FindExternalDataFiles(const FString& ModelPath);
+
+	// 映射给定的外部数据文件并通过AddExternalInitializersFromFilesInMemory注入会话选项。
+	// 模型中引用的文件名为各文件的文件名部分。映射结果追加到OutMappings，调用者需保证其生命周期长于会话。
+	static bool ApplyToSessionOptions(Ort::SessionOptions& SessionOptions, const TArray<FString>& FilePaths,
+									  TArray<FOnnxMappedExternalFilePtr>& OutMappings);
+
+	// 当前映射的文件数量和总字节数（用于统计）。
+	static int32 GetNumMappedFiles();
+	static int64 GetMappedBytes();
+
+private:
+	static FCriticalSection Mutex;
+	static TMap<FString, TWeakPtr<FOnnxMappedExternalFile, ESPMode::ThreadSafe>> MappedFiles;
+};
@@ -0,0 +1,218 @@
+// OnnxGeneration.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "Math/RandomStream.h"
+
+// 包含ONNX Runtime的实现头文件
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#endif
+#include "onnxruntime_cxx_api.h"
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
+
+#include <string>
+#include <vector>
+
+#include "OnnxGeneration.generated.h"
+
+class FOnnxModelInstance;
+
+/**
+ * 仅解码器Transformer模型的输入/输出命名（默认与Optimum导出的带KV缓存的模型一致）
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxGeneratorConfig
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Generation")
+	FString InputIdsName = TEXT("input_ids");
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Generation")
+	FString AttentionMaskName = TEXT("attention_mask");
+
+	// 模型没有该输入时忽略
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Generation")
+	FString PositionIdsName = TEXT("position_ids");
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Generation")
+	FString LogitsName = TEXT("logits");
+
+	// 过去/当前KV张量的名称前缀，去掉前缀后的部分相同的输入输出成对（例如past_key_values.0.key <-> present.0.key）
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Generation")
+	FString PastPrefix = TEXT("past_key_values.");
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Generation")
+	FString PresentPrefix = TEXT("present.");
+
+	// KV缓存的最大序列长度（提示 + 生成），决定预分配的缓存大小
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Generation", meta = (ClampMin = "1"))
+	int32 MaxSequenceLength = 512;
+};
+
+/**
+ * 采样参数
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxGenerationParams
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Generation", meta = (ClampMin = "1"))
+	int32 MaxNewTokens = 64;
+
+	// <=0时贪心解码
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Generation", meta = (ClampMin = "0.0"))
+	float Temperature = 1.0f;
+
+	// 只在概率最高的TopK个词中采样，0表示不限制
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Generation", meta = (ClampMin = "0"))
+	int32 TopK = 0;
+
+	// 只在累计概率达到TopP的最小词集合中采样，1表示不限制
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Generation", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float TopP = 1.0f;
+
+	// 遇到这些词（例如EOS）时结束，停止词本身不输出
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Generation")
+	TArray<int64> StopTokens;
+
+	// 批量生成时已结束的序列使用的填充词
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Generation")
+	int64 PadTokenId = 0;
+
+	// 随机种子，0表示每次不同
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Generation")
+	int32 Seed = 0;
+};
+
+/**
+ * 生成统计
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxGenerationStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Generation")
+	int32 BatchSize = 0;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Generation")
+	int32 PromptTokens = 0;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Generation")
+	int32 GeneratedTokens = 0;
+
+	// 从开始到第一个词采样完成（预填充）的时间
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Generation")
+	float TimeToFirstTokenMs = 0.0f;
+
+	// 首词之后的解码速度（批量时为整个批次的总速度）
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Generation")
+	float TokensPerSecond = 0.0f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Generation")
+	float TotalMs = 0.0f;
+
+	FString ToString() const;
+};
+
+/**
+ * 一个生成请求（一段对话）
+ */
+struct CLOTH_API FOnnxGenerationRequest
+{
+	TArray<int64> PromptTokens;
+	FOnnxGenerationParams Params;
+
+	// 输出
+	TArray<int64> OutputTokens;
+	FOnnxGenerationStats Stats;
+};
+
+/**
+ * 流式回调：每采样一个词调用一次，返回false结束该序列
+ */
+typedef TFunction<bool(int32 SequenceIndex, int64 Token)> FOnnxTokenCallback;
+
+/**
+ * FOnnxGenerator
+ * 仅解码器Transformer模型的自回归生成。
+ * 每层的KV缓存按最大序列长度预分配两个缓冲区，通过IoBinding绑定：本步的past输入引用一个缓冲区，
+ * present输出直接写入另一个缓冲区，下一步交换角色，整个生成过程中KV缓存不会重新分配或复制。
+ * 多个请求可以组成一个批次一起生成（左填充并生成相应的注意力掩码）。
+ * 分词不在这里处理，输入输出都是词ID。
+ */
+class CLOTH_API FOnnxGenerator
+{
+public:
+	FOnnxGenerator(FOnnxModelInstance& InInstance, const FOnnxGeneratorConfig& InConfig = FOnnxGeneratorConfig());
+
+	// 从会话元数据中识别输入输出和KV张量，失败时返回false
+	bool Initialize();
+
+	bool IsInitialized() const { return bInitialized_; }
+
+	/**
+	 * 对一批请求进行生成，结果写回每个请求。批次中的所有请求共享一次预填充和每一步的解码Run。
+	 * OnToken在调用线程上按生成顺序调用。
+	 */
+	bool Generate(TArray<FOnnxGenerationRequest>& Requests, const FOnnxTokenCallback& OnToken = nullptr);
+
+	// 单个请求的便捷版本
+	bool Generate(const TArray<int64>& PromptTokens, const FOnnxGenerationParams& Params, TArray<int64>& OutTokens,
+				  FOnnxGenerationStats* OutStats = nullptr, const FOnnxTokenCallback& OnToken = nullptr);
+
+	// 最近一次生成的批次统计
+	FOnnxGenerationStats GetLastStats() const;
+
+	// 预分配的KV缓存大小
+	int64 GetCacheBytes() const;
+
+	// 从logits中采样一个词。Scratch用于避免每步分配。
+	static int64 SampleToken(const float* Logits, int64 VocabSize, const FOnnxGenerationParams& Params,
+							 FRandomStream& Random, TArray<TPair<float, int32>>& Scratch);
+
+private:
+	struct FKvTensor
+	{
+		std::string PastName;
+		std::string PresentName;
+		int64 NumHeads = 0;
+		int64 HeadDim = 0;
+
+		// 乒乓缓冲区，容量为 Batch * NumHeads * MaxSequenceLength * HeadDim
+		TArray<float> Buffers[2];
+	};
+
+	bool GenerateBatch(Ort::Session& Session, TArray<FOnnxGenerationRequest>& Requests, const FOnnxTokenCallback& OnToken);
+
+	// 按批次大小确保KV缓存容量
+	void EnsureCapacity(int32 BatchSize);
+
+	FOnnxModelInstance& instance_;
+	FOnnxGeneratorConfig config_;
+
+	std::string inputIdsName_;
+	std::string attentionMaskName_;
+	std::string positionIdsName_; // 模型没有该输入时为空
+	std::string logitsName_;
+	int64 vocabSize_ = 0;
+
+	TArray<TUniquePtr<FKvTensor>> kvTensors_;
+	int32 capacityBatch_ = 0;
+
+	// 解码阶段的logits缓冲区 [Batch, 1, Vocab]
+	TArray<float> logitsBuffer_;
+
+	FOnnxGenerationStats lastStats_;
+	bool bInitialized_ = false;
+
+	// 缓存在调用之间共享，同一时间只进行一次生成
+	mutable FCriticalSection mutex_;
+};
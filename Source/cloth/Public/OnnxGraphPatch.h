@@ -0,0 +1,79 @@
+// OnnxGraphPatch.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * 流水线的一个阶段：图中连续的一段节点，以及跨阶段传递的张量
+ */
+struct CLOTH_API FOnnxGraphStage
+{
+	// 阶段内第一个和最后一个节点的序号（含），节点按图中的拓扑顺序编号
+	int32 FirstNode = 0;
+	int32 LastNode = 0;
+
+	// 阶段的输入：原模型的输入或之前阶段产生的张量（初始值不算输入，每个阶段带着自己用到的权重）
+	TArray<FString> Inputs;
+
+	// 阶段的输出：之后阶段用到的张量和原模型的输出
+	TArray<FString> Outputs;
+
+	// 阶段内初始值的字节数，用于平衡各阶段的计算量
+	int64 WeightBytes = 0;
+};
+
+/**
+ * 模型的阶段划分
+ */
+struct CLOTH_API FOnnxGraphStagePlan
+{
+	TArray<FOnnxGraphStage> Stages;
+
+	// 原模型的输入和输出（按图中的顺序，不包括初始值）
+	TArray<FString> Inputs;
+	TArray<FString> Outputs;
+};
+
+/**
+ * 中间张量的类型，元素类型与ONNXTensorElementDataType的取值相同，维度为-1表示动态
+ */
+struct CLOTH_API FOnnxGraphTensorType
+{
+	int32 ElementType = 0;
+	TArray<int64> Shape;
+};
+
+/**
+ * FOnnxGraphPatch
+ * 在加载时修改序列化的ONNX模型（ModelProto）：把内部节点的输出暴露为图输出，或把模型切分为流水线阶段。
+ * 直接在protobuf线格式上操作，不依赖protobuf库：只重写GraphProto中的节点、初始值、输入和输出字段，其余字段原样保留。
+ * 暴露为图输出的张量不会被ORT的图优化融合掉。
+ */
+class CLOTH_API FOnnxGraphPatch
+{
+public:
+	/**
+	 * 把OutputNames（内部节点产生的张量名）添加为图输出。
+	 * bReplaceOutputs为true时只保留这些输出（特征提取模式），并裁剪掉不参与计算它们的节点和不再使用的图输入，
+	 * 不需要的头部网络不再消耗计算；图中含有子图（If/Loop等）时只替换输出、不裁剪节点。
+	 * 名称不存在或模型无法解析时返回false，OutError描述原因。
+	 */
+	static bool ExposeOutputs(const TArray<uint8>& ModelData, const TArray<FString>& OutputNames, bool bReplaceOutputs,
+							  TArray<uint8>& OutPatchedData, FString& OutError);
+
+	/**
+	 * 把模型按节点边界划分为流水线阶段。SplitNodes为节点名称（或节点产生的张量名），每个阶段在其中一个节点之后结束；
+	 * SplitNodes为空时按初始值字节数（权重量近似计算量）均分为NumStages个阶段。
+	 * 含有子图（If/Loop等）的模型无法划分：子图可以隐式引用外层的张量。
+	 */
+	static bool PlanStages(const TArray<uint8>& ModelData, const TArray<FString>& SplitNodes, int32 NumStages,
+						   FOnnxGraphStagePlan& OutPlan, FString& OutError);
+
+	/**
+	 * 生成一个阶段的子模型：只保留阶段内的节点和它们用到的初始值，阶段的输入/输出成为子模型的图输入/输出。
+	 * 原模型的输入沿用原有的类型信息，中间张量的类型由InputTypes提供（通常来自之前阶段会话的输出元数据）。
+	 */
+	static bool ExtractStage(const TArray<uint8>& ModelData, const FOnnxGraphStage& Stage, const TMap<FString, FOnnxGraphTensorType>& InputTypes,
+							 TArray<uint8>& OutStageData, FString& OutError);
+};
@@ -0,0 +1,50 @@
+// OnnxHalf.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// 包含ONNX Runtime的实现头文件
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#endif
+#include "onnxruntime_cxx_api.h"
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
+
+/**
+ * FOnnxHalf
+ * float32与float16（IEEE 754半精度，按uint16存储）之间的转换，以及按模型期望的元素类型创建/读取张量。
+ * x86-64上CPU支持F16C时每次转换8个元素，否则逐元素使用Ort::Float16_t（舍入到最近偶数，与F16C一致）。
+ * 转换是单次顺序遍历，带宽与一次memcpy相当，不会抵消fp16减半的内存占用和带宽。
+ */
+class CLOTH_API FOnnxHalf
+{
+public:
+	// 当前CPU是否支持F16C（以及保存YMM寄存器所需的AVX/OSXSAVE），结果在首次调用时缓存
+	static bool IsF16CSupported();
+
+	// 批量转换，Src与Dst不能重叠
+	static void ConvertToHalf(const float* Src, uint16* Dst, int64 Count);
+	static void ConvertToFloat(const uint16* Src, float* Dst, int64 Count);
+
+	static void ConvertToHalf(const TArray<float>& Src, TArray<uint16>& Dst);
+	static void ConvertToFloat(const TArray<uint16>& Src, TArray<float>& Dst);
+
+	// 会话中某个输入的元素类型，找不到时返回UNDEFINED
+	static ONNXTensorElementDataType GetInputElementType(const Ort::Session& Session, const char* Name);
+
+	// 从float数据创建Type（FLOAT或FLOAT16）类型的张量。类型相同时直接引用Data，
+	// 需要转换时写入Scratch并引用它，Data/Scratch都必须在Run结束之前保持有效
+	static Ort::Value CreateTensor(const Ort::MemoryInfo& MemoryInfo, const float* Data, int64 Count,
+								   const int64_t* Shape, size_t NumDims, ONNXTensorElementDataType Type, TArray<uint16>& Scratch);
+
+	// 从fp16数据创建Type类型的张量，规则同上
+	static Ort::Value CreateTensor(const Ort::MemoryInfo& MemoryInfo, const uint16* Data, int64 Count,
+								   const int64_t* Shape, size_t NumDims, ONNXTensorElementDataType Type, TArray<float>& Scratch);
+
+	// 把FLOAT或FLOAT16张量读取为float / fp16，其他类型返回false
+	static bool CopyToFloat(const Ort::Value& Tensor, TArray<float>& OutData);
+	static bool CopyToHalf(const Ort::Value& Tensor, TArray<uint16>& OutData);
+};
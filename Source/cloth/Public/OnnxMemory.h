@@ -0,0 +1,129 @@
+// OnnxMemory.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// 包含ONNX Runtime的实现头文件
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#endif
+#include "onnxruntime_cxx_api.h"
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
+
+/**
+ * 插件分配器的配置，从引擎配置文件的[OnnxRuntime]段读取：
+ *   bUseUnrealAllocator=True
+ *   bUseHugePages=False
+ *   LargeBlockKB=1024
+ *   MaxCachedChunkMB=256
+ */
+struct CLOTH_API FOnnxMemorySettings
+{
+	// 是否向Env注册经由FMemory的分配器（会话通过session.use_env_allocators使用它）
+	bool bUseUnrealAllocator = true;
+
+	// 仅Linux：大块内存按2MB对齐映射并建议内核使用透明大页
+	bool bUseHugePages = false;
+
+	// 不小于该大小的分配按块缓存复用（特征图、权重等），更小的分配直接交给FMemory
+	int32 LargeBlockKB = 1024;
+
+	// 空闲大块的缓存上限，超出时直接归还系统
+	int32 MaxCachedChunkMB = 256;
+
+	void LoadFromConfig();
+};
+
+/**
+ * 一个模型（或共享部分）经由插件分配器的内存统计
+ */
+struct CLOTH_API FOnnxMemoryStats
+{
+	FString Name;
+
+	// 当前持有的字节数（请求的大小，不含对齐和块的取整）
+	int64 CurrentBytes = 0;
+
+	// 历史峰值
+	int64 PeakBytes = 0;
+
+	// 累计分配次数
+	int64 NumAllocations = 0;
+};
+
+/**
+ * FOnnxMemoryOwner
+ * 模型实例在插件分配器中的登记项。创建会话和推理时通过FScope把当前线程上的ORT分配记到该模型名下，
+ * 作用域之外（或ORT工作线程上）的分配记为共享部分。析构时自动注销，尚未释放的内存继续按原名称统计。
+ */
+class CLOTH_API FOnnxMemoryOwner
+{
+public:
+	FOnnxMemoryOwner() = default;
+	~FOnnxMemoryOwner();
+
+	FOnnxMemoryOwner(const FOnnxMemoryOwner&) = delete;
+	FOnnxMemoryOwner& operator=(const FOnnxMemoryOwner&) = delete;
+
+	void Register(const FString& Name);
+	void Unregister();
+
+	bool IsRegistered() const { return id_ != 0; }
+	FOnnxMemoryStats GetStats() const;
+
+	/**
+	 * 把当前线程上的ORT分配记到Owner名下，可以嵌套（析构时恢复外层的归属）
+	 */
+	class CLOTH_API FScope
+	{
+	public:
+		explicit FScope(const FOnnxMemoryOwner& Owner);
+		~FScope();
+
+		FScope(const FScope&) = delete;
+		FScope& operator=(const FScope&) = delete;
+
+	private:
+		int32 PreviousId;
+	};
+
+private:
+	int32 id_ = 0;
+};
+
+/**
+ * FOnnxMemory
+ * 向插件的Ort::Env注册的OrtAllocator：所有分配经由FMemory并带"ONNX" LLM标签，使推理内存出现在LLM和memreport中。
+ * 大块分配按块大小缓存复用，替代ORT默认的arena；Linux上可选用透明大页映射大块，减少数MB特征图的TLB缺失。
+ * 逐模型的统计通过控制台命令onnx.MemReport输出，插件的Config/DefaultEngine.ini把该命令加入[MemReportCommands]，memreport时一并输出。
+ */
+class CLOTH_API FOnnxMemory
+{
+public:
+	// 向Env注册分配器（FOnnxRuntime创建Env时调用），失败时会话继续使用ORT自己的分配器
+	static bool RegisterWithEnv(Ort::Env& Env, const FOnnxMemorySettings& Settings);
+
+	// 分配器是否已注册
+	static bool IsRegistered();
+
+	// 所有登记过且仍持有内存的模型，第一项为共享部分
+	static TArray<FOnnxMemoryStats> GetOwnerStats();
+
+	// 插件分配器当前持有的总字节数，以及缓存的空闲块和大页映射的字节数
+	static int64 GetTotalBytes();
+	static int64 GetCachedChunkBytes();
+	static int64 GetHugePageBytes();
+
+	// 归还所有缓存的空闲块（Env释放后调用）
+	static void TrimCache();
+
+	// 运行时调整空闲块缓存的上限（onnx.MaxCachedChunkMB）
+	static void SetMaxCachedChunkMB(int32 MaxCachedChunkMB);
+	static int32 GetMaxCachedChunkMB();
+
+	// 输出逐模型的统计（onnx.MemReport / memreport）
+	static void Dump(FOutputDevice& Ar);
+};
@@ -4,6 +4,11 @@
 
 #include "CoreMinimal.h"
 #include "Engine/DataAsset.h"
+#include "OnnxSessionSettings.h"
+#include "OnnxShapeBucketing.h"
+#include "OnnxModelVariants.h"
+#include "OnnxWorkerPool.h"
+#include "OnnxPipeline.h"
 #include "OnnxModelAsset.generated.h"
 
 /**
@@ -28,6 +33,45 @@ public:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Model")
 	TArray<uint8> modelData_;
 
+	// 模型引用的外部数据文件（相对项目目录的路径）。
+	// 这些文件会被内存映射一次，并在所有引用它们的会话之间共享。留空时在模型文件旁自动查找。
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "ONNX Model")
+	TArray<FString> externalDataFiles_;
+
+	// 创建会话时使用的配置（线程数、自旋策略等）
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Model|Session")
+	FOnnxSessionSettings sessionSettings_;
+
+	// 需要额外暴露的内部张量名称（例如骨干网络的特征图），加载时修改图把它们添加为模型输出，
+	// 不需要再单独导出一个.onnx文件
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Model|Outputs")
+	TArray<FString> extraOutputs_;
+
+	// 特征提取模式：只保留extraOutputs_作为输出，并裁剪掉不参与计算它们的节点（例如不需要的头部网络）
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Model|Outputs")
+	bool bExtraOutputsOnly_ = false;
+
+	// 动态形状模型的分桶策略：把可变维度填充到少数几个固定大小
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Model|Session")
+	FOnnxShapeBucketingPolicy shapeBucketing_;
+
+	// 同一模型的量化变体（QDQ int8、4位仅权重等），资产本身的模型作为FP32基准
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Model|Variants")
+	TArray<FOnnxModelVariant> variants_;
+
+	// 加载时选择哪个变体，以及比较时的精度阈值
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Model|Variants")
+	FOnnxVariantSelection variantSelection_;
+
+	// 进程外推理：在本地工作进程中运行会话（隔离ORT的崩溃和线程池），不支持有状态模式和分桶
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Model|Workers")
+	FOnnxWorkerSettings workerSettings_;
+
+	// 流水线并行：把模型切分为阶段子会话，连续的请求在各阶段上同时执行（用FOnnxModelInstance::RunAsync提交），
+	// 不支持有状态模式、分桶和NUMA副本，同时启用进程外推理时以进程外推理为准
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Model|Pipeline")
+	FOnnxPipelineSettings pipelineSettings_;
+
 	// --- 元数据 (可以由自定义的导入器或编辑器工具填充) ---
 
 	// 模型的输入节点名称。
@@ -12,9 +12,34 @@
 #if PLATFORM_WINDOWS && PLATFORM_64BITS
 #include "Windows/HideWindowsPlatformTypes.h"
 #endif
+#include "OnnxPrepackedWeights.h"
+#include "OnnxExternalData.h"
+#include "OnnxSessionSettings.h"
+#include "OnnxBenchmark.h"
+#include "OnnxNuma.h"
+#include "OnnxAutotuner.h"
+#include "OnnxResidency.h"
+#include "OnnxShapeBucketing.h"
+#include "OnnxStatefulSession.h"
+#include "OnnxModelVariants.h"
+#include "OnnxScratch.h"
+#include "OnnxMemory.h"
+#include "OnnxCapture.h"
+#include "OnnxTuning.h"
+#include "OnnxWorkerPool.h"
+#include "OnnxPipeline.h"
+#include "OnnxTensor.h"
+#include "HAL/CriticalSection.h"
+#include "UObject/WeakObjectPtrTemplates.h"
+
+#include <atomic>
+
 // Forward-declare our asset class
 class UOnnxModelAsset;
 
+// RunAsync的完成回调（流水线模式下在阶段线程上调用）
+typedef TFunction<void(bool bSucceeded, TArray<float>& OutputData, TArray<int64>& OutputShape)> FOnnxRunCallback;
+
 /**
  * FOnnxModelInstance
  * 一个非UObject的C++类，用于封装ONNX Runtime会话。
@@ -24,9 +49,12 @@ class CLOTH_API FOnnxModelInstance
 {
 public:
 	// 构造函数：从给定的资产创建实例。
-	FOnnxModelInstance(UOnnxModelAsset* InModelAsset);
+	// 资产中有模型字节时优先使用，否则使用InModelPath，两者都为空时回退到默认模型。
+	// 资产声明了量化变体时按其选择策略加载变体，InPrecision可以强制指定精度（比较变体时使用）。
+	// bInLowPriority用于影子候选模型等后台实例：会话使用减半的低优先级线程（见FOnnxSessionSettings::bLowPriorityThreads）。
+	FOnnxModelInstance(UOnnxModelAsset* InModelAsset, const FString& InModelPath = FString(), TOptional<EOnnxModelPrecision> InPrecision = TOptional<EOnnxModelPrecision>(), bool bInLowPriority = false);
 
-	// 析构函数：清理Ort::Session和Ort::Env。
+	// 析构函数：清理Ort::Session（Ort::Env由FOnnxRuntime共享持有）。
 	~FOnnxModelInstance();
 
 	
@@ -38,24 +66,239 @@ public:
 	// 在实际使用中，您需要将其扩展以使其更通用。
 	bool Run(const TArray<float>& InputData, TArray<float>& OutputData);
 
+	// 按显式的输入形状运行推理，可选地返回输出形状。
+	// 资产启用了分桶策略时，输入会被填充到所属的桶，输出裁剪回实际形状。
+	bool Run(const TArray<float>& InputData, const TArray<int64>& InputShape, TArray<float>& OutputData, TArray<int64>* OutOutputShape = nullptr);
+
+	// 以张量运行：输入直接作为ORT张量（类型与模型输入不同时先在Float/Half之间转换），
+	// 输出形状静态时写入池化的张量，否则接管ORT分配的输出，两种情况都不经过float数组。
+	// 工作进程、流水线、有状态和分桶模式按float数组交换数据，这些模式下经由数组运行。
+	bool Run(const FOnnxTensor& Input, FOnnxTensor& OutOutput);
+
+	// 异步运行：启用流水线时复制输入后提交并立即返回，连续提交的请求在各阶段上同时执行；
+	// 未启用流水线时同步运行后在调用线程上调用OnComplete
+	void RunAsync(const TArray<float>& InputData, const TArray<int64>& InputShape, FOnnxRunCallback&& OnComplete);
+
+	// 有状态模式：声明在调用之间传递的状态输入/输出对，之后Run只需要提供普通输入。
+	// 传入空数组关闭有状态模式。名称不存在或类型不支持时返回false。
+	bool SetStateTensors(const TArray<FOnnxStateTensorPair>& Pairs);
+	bool IsStateful() const { return stateBindings_.IsEnabled(); }
+
+	// 把状态恢复为初始值 / 保存 / 从快照恢复
+	void ResetState();
+	FOnnxStateSnapshot SnapshotState() const;
+	bool RestoreState(const FOnnxStateSnapshot& Snapshot);
+
+	// 按名称获取指定的输出（包括资产extraOutputs_中暴露的内部张量），只计算这些输出。
+	// OutShapes可选地返回每个输出的形状。
+	bool RunOutputs(const TArray<float>& InputData, const TArray<int64>& InputShape, const TArray<FString>& OutputNames,
+					TArray<TArray<float>>& OutOutputs, TArray<TArray<int64>>* OutShapes = nullptr);
+
+	// 根据模型的输入形状推算数据的形状：唯一的动态维度由元素数决定，其余动态维度取1
+	TArray<int64> InferInputShape(int32 NumElements) const;
+
+	// Run的分配统计（预热之后应为0，只在启用ONNX_TRACK_ALLOCATIONS的构建中统计）
+	FOnnxAllocationStats GetAllocationStats() const { return allocations_.GetStats(); }
+
+	// 经由插件分配器的ORT内存（权重、中间张量和输出）
+	FOnnxMemoryStats GetMemoryStats() const { return memoryOwner_.GetStats(); }
+
+	// 把Run的输入录制到捕获文件（FilePath为空时在Saved/Onnx/Captures下生成），用OnnxReplay命令行工具回放。
+	// 有状态模型不支持录制（状态张量不在记录中）。
+	bool StartCapture(const FString& FilePath, const FOnnxCaptureConfig& Config);
+	void StopCapture();
+	bool IsCapturing() const { return capture_.IsOpen(); }
+
+	// 分桶缓存（桶数量、预分配缓冲区大小）
+	const FOnnxShapeBucketCache& GetShapeBucketCache() const { return bucketCache_; }
+
+	// 在驻留作用域内使用会话（启用NUMA副本组时为调用线程所在节点的副本）。
+	// 会话不可用时返回false；Fn抛出的Ort::Exception由调用方处理。
+	bool WithSession(TFunctionRef<void(Ort::Session&)> Fn);
+
+	// 用给定配置为同一个模型创建一个新会话（共享预打包权重和外部数据映射）。失败时返回nullptr。
+	// ModelData非空时从这些字节创建（流水线阶段的子模型）。
+	TUniquePtr<Ort::Session> CreateSession(const FOnnxSessionSettings& Settings, const TArray<uint8>* ModelData = nullptr) const;
+
+	// 当前会话使用的配置（副本：控制台变量变化时配置在后台线程上更新）
+	FOnnxSessionSettings GetSessionSettings() const;
+
+	// 加载的模型变体精度
+	EOnnxModelPrecision GetPrecision() const { return precision_; }
+
+	// 对所有自旋策略做基准测试，比较延迟与CPU占用。IntraOpThreads<=0时沿用当前配置。
+	TArray<FOnnxBenchmarkResult> BenchmarkSpinModes(const FOnnxBenchmarkParams& Params, int32 IntraOpThreads = 0) const;
+
+	// 在本机上调优线程配置并保存到Saved/，结果在下次创建会话时生效
+	FOnnxAutotuneResult Autotune(const FOnnxAutotuneGrid& Grid, const FOnnxBenchmarkParams& Params) const;
+
+	// 驻留统计（驻留内存、驱逐和重新加载次数）
+	FOnnxResidencyStats GetResidencyStats() const;
+
+	// NUMA副本组的逐节点统计（未启用ReplicasPerNumaNode时为空）
+	TArray<FOnnxNumaNodeStats> GetNumaNodeStats() const;
+	void LogNumaNodeStats() const;
+
+	// 资产启用了workerSettings_时推理在工作进程中运行，本进程不持有会话
+	bool IsUsingWorkers() const { return workers_.IsValid(); }
+	FOnnxWorkerPoolStats GetWorkerStats() const;
+
+	// 资产启用了pipelineSettings_时模型按阶段切分，每个阶段在自己的线程上运行
+	bool IsPipelined() const { return GetPipeline().IsValid(); }
+	FOnnxPipelineStats GetPipelineStats() const;
 
 private:
 	
 	// 禁用复制以防止TUniquePtr的所有权问题。
 	FOnnxModelInstance(const FOnnxModelInstance&) = delete;
 	FOnnxModelInstance& operator=(const FOnnxModelInstance&) = delete;
+
+	// 创建/释放会话（初始化以及被驻留管理器驱逐、重新加载时调用）
+	bool LoadSessions();
+	void ReleaseSessions();
+
+	// 按当前的onnx.*控制台变量在后台线程上重建会话，排空进行中的请求后换入
+	void RebuildSessions(bool bForce);
+
+	// 在settingsMutex_下更新配置；控制台变量变化后重新计算的配置
+	void SetSessionSettings(const FOnnxSessionSettings& Settings);
+	FOnnxSessionSettings ComputeOverriddenSettings() const;
+
+	// 构造时推迟的EP选择和首次调优：在重建回调的后台线程上执行，结果写入baseSettings_后由RebuildSessions换入
+	void RunPendingAutotune();
+
+	// 缓存普通输入/输出的名称和形状（跳过状态张量）
+	void CacheNodeMetadata();
+
+	// 由输入形状推算输出形状（输出的每个维度都是固定大小或与某个输入维度同名），含数据相关的维度时返回false
+	bool PredictOutputShape(TConstArrayView<int64> InputShape, FOnnxInlineShape& OutShape) const;
+
+	// 两个Run重载的公共实现（调用方负责分配统计作用域）
+	void InferInputShape(int32 NumElements, FOnnxInlineShape& OutShape) const;
+	FOnnxCaptureTensorView MakeCaptureInput(const TArray<float>& InputData, TConstArrayView<int64> InputShape) const;
+	bool RunInternal(const TArray<float>& InputData, TConstArrayView<int64> InputShape, TArray<float>& OutputData, TArray<int64>* OutOutputShape);
+
+	// 进程外模式：启动工作进程池并从中缓存输入/输出元数据
+	bool StartWorkers(const FOnnxWorkerSettings& WorkerSettings);
+
+	// 进程外模式的Run：输入写入共享内存，OnOutput按OutputIndices的顺序读取每个输出（引用共享内存，回调返回后失效）
+	bool RunOnWorker(const TArray<float>& InputData, TConstArrayView<int64> InputShape, TConstArrayView<int32> OutputIndices,
+					 TFunctionRef<bool(int32 Position, const Ort::Value& Output)> OnOutput);
+
+	// 流水线模式：按给定配置切分模型并创建阶段会话（控制台变量变化时重新创建后整体换入）
+	bool StartPipeline(const FOnnxPipelineSettings& PipelineSettings);
+	TSharedPtr<FOnnxPipeline, ESPMode::ThreadSafe> BuildPipeline(const FOnnxSessionSettings& Settings) const;
+	TSharedPtr<FOnnxPipeline, ESPMode::ThreadSafe> GetPipeline() const;
+
+	// 流水线请求的输入张量持有自己的数据（请求在阶段线程上执行，不能引用调用方的数组）
+	bool CreatePipelineInput(const TArray<float>& InputData, TConstArrayView<int64> InputShape, std::vector<Ort::Value>& OutInputs) const;
+
+	// 流水线模式的Run：同步等待请求离开流水线，OnOutput按OutputIndices的顺序读取每个输出
+	bool RunOnPipeline(const TArray<float>& InputData, TConstArrayView<int64> InputShape, TConstArrayView<int32> OutputIndices,
+					   TFunctionRef<bool(int32 Position, const Ort::Value& Output)> OnOutput);
 	
-	// ONNX运行时环境。
-	TUniquePtr<Ort::Env> env_{nullptr};
+	// 按模型内容哈希共享的预打包权重容器，声明在session_之前以保证它比会话活得更久。
+	FOnnxPrepackedWeightsPtr prepackedWeights_;
+
+	// 会话引用的内存映射外部数据文件，同样必须比session_活得更久。
+	TArray<FOnnxMappedExternalFilePtr> externalData_;
 
 	// ONNX运行时会话，代表加载的模型。
 	TUniquePtr<Ort::Session> session_{nullptr};
 
+	// 按NUMA节点分组的会话副本（ReplicasPerNumaNode>0时启用，Run优先使用调用线程所在节点的副本）
+	TUniquePtr<FOnnxNumaSessionPool> numaPool_;
+
+	// 模型来源：资产（从内存加载）或文件路径（从内存加载时为空）。
+	TWeakObjectPtr<UOnnxModelAsset> modelAsset_;
+	FString modelPath_;
+
+	// 加载的变体精度（非FP32时modelPath_指向变体文件）
+	EOnnxModelPrecision precision_ = EOnnxModelPrecision::FP32;
+
+	// 暴露了内部输出的修改后的模型（资产声明了extraOutputs_时），为空时使用原始模型
+	TArray<uint8> patchedModelData_;
+
+	// 需要注入会话的外部数据文件
+	TArray<FString> externalDataFiles_;
+
+	// 会话配置（来自资产，合并了本机调优结果和控制台变量的覆盖）
+	FOnnxSessionSettings settings_;
+
+	// 覆盖之前的配置，控制台变量变化时从它重新计算
+	FOnnxSessionSettings baseSettings_;
+
+	// 保护settings_和baseSettings_：构造之后它们在重建会话的后台任务中更新，同时被其他线程读取
+	mutable FCriticalSection settingsMutex_;
+
+	// 调优结果的键（模型名称 + 内容哈希）
+	FString modelKey_;
+
+	// 模型内容哈希和用于日志的名称
+	FString modelHash_;
+	FString displayName_;
+
+	// 模型本身的字节数，以及最近一次加载时测得的驻留内存
+	int64 modelBytes_ = 0;
+	int64 residentBytes_ = 0;
+
 	// 从资产中缓存的模型元数据，以便快速访问。
 	FString inputNodeName_;
 	FString outputNodeName_;
 	TArray<int64> inputNodeDims_;
+
+	// 普通输入的元素类型（FLOAT或FLOAT16），FLOAT16时Run在创建张量时转换
+	ONNXTensorElementDataType inputElementType_ = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+	std::string inputNodeNameUtf8_;
+	std::string outputNodeNameUtf8_;
+
+	// 普通输出的元素类型和形状（含动态维度时为-1），张量Run在形状静态时预先分配输出
+	ONNXTensorElementDataType outputElementType_ = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+	TArray<int64> outputNodeDims_;
+
+	// 输出每个动态维度对应的输入维度下标（按符号维度名匹配），固定维度为INDEX_NONE；
+	// 为空表示输出形状无法由输入形状推算（数据相关或维度未命名），此时不使用outputSlot_
+	TArray<int32> outputDimInputAxes_;
 	
 	// 用于指示初始化是否成功的标志。
 	bool bIsInitialized_ = false;
+
+	// 动态形状的分桶缓存，每个桶持有预分配的输入/输出张量
+	FOnnxShapeBucketCache bucketCache_;
+
+	// 有状态模式的乒乓状态缓冲区（独立于会话，驱逐后保留）
+	FOnnxStateBindings stateBindings_;
+
+	// Run的暂存区：fp16输入的转换缓冲区，以及按推算的输出形状预分配的输出。
+	// 同一时间只给一个请求使用，并发请求（NUMA副本）退回到按需分配。
+	FCriticalSection scratchMutex_;
+	TArray<uint16> halfInputScratch_;
+	FOnnxOutputSlot outputSlot_;
+
+	// Run的分配统计
+	FOnnxAllocationCounter allocations_;
+
+	// 请求录制（未录制时只检查一个原子标志）
+	FOnnxCaptureWriter capture_;
+
+	// 进程外推理的工作进程池（未启用时为空）
+	TUniquePtr<FOnnxWorkerPool> workers_;
+
+	// 流水线模式的阶段会话（未启用时为空）。重建时整体替换，进行中的请求在旧流水线上完成
+	mutable FCriticalSection pipelineMutex_;
+	TSharedPtr<FOnnxPipeline, ESPMode::ThreadSafe> pipeline_;
+	FOnnxPipelineSettings pipelineSettings_;
+
+	// 调优变量的变化通知（析构函数先注销，等待进行中的后台重建）
+	FOnnxTuningListener tuning_;
+
+	// 构造时还需要测试EP或首次调优；析构开始后调优的会话工厂不再创建会话，让进行中的测试尽快结束
+	std::atomic<bool> bAutotunePending_{false};
+	std::atomic<bool> bShuttingDown_{false};
+
+	// 插件分配器中的登记项，创建会话和Run时的ORT分配记到本模型名下
+	FOnnxMemoryOwner memoryOwner_;
+
+	// 驻留管理器中的登记项，必须是最后一个成员（最先析构，之后不会再有驱逐回调）
+	FOnnxResidencyHandle residency_;
 };
\ No newline at end of file
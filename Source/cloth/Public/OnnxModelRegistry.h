@@ -0,0 +1,146 @@
+// OnnxModelRegistry.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "Containers/Ticker.h"
+#include "Async/Future.h"
+#include "Subsystems/EngineSubsystem.h"
+#include "UObject/WeakObjectPtrTemplates.h"
+#include "OnnxModelRegistry.generated.h"
+
+class FOnnxModelInstance;
+class UOnnxModelAsset;
+
+// 共享模型实例的引用计数句柄，最后一个句柄释放后实例在注册表中保留一段宽限期
+typedef TSharedPtr<FOnnxModelInstance, ESPMode::ThreadSafe> FOnnxModelHandle;
+
+/**
+ * 模型注册表的统计
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxModelRegistryStats
+{
+	GENERATED_BODY()
+
+	// 注册表中的模型实例数
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX Registry")
+	int32 NumModels = 0;
+
+	// 其中没有句柄、正在等待宽限期结束的实例数
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX Registry")
+	int32 NumIdle = 0;
+
+	// 组件等持有的句柄总数
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX Registry")
+	int32 NumHandles = 0;
+
+	// Acquire复用已有实例 / 创建新实例的次数
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX Registry")
+	int64 Hits = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX Registry")
+	int64 Misses = 0;
+
+	// 宽限期结束后释放的实例数
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX Registry")
+	int32 Expired = 0;
+};
+
+/**
+ * UOnnxModelRegistry
+ * 引擎级的模型实例注册表：按模型身份（资产路径或文件路径加上模型内容的哈希）和影响会话的配置共享FOnnxModelInstance，
+ * 同一模型的N个组件只创建一个会话，内存和加载时间不再随组件数量增长。
+ * 注册表随引擎存在，关卡切换和PIE重启不会销毁实例：没有句柄的实例保留宽限期
+ * （[OnnxRuntime] ModelRegistryGraceSeconds，onnx.Registry.GraceSeconds），期间再次获取直接复用。
+ *
+ * 共享实例的Run可以并发调用；状态张量、录制等会修改实例的操作对所有持有者可见，
+ * 需要独占实例（例如有状态模型）的调用方应直接创建FOnnxModelInstance。
+ */
+UCLASS()
+class CLOTH_API UOnnxModelRegistry : public UEngineSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	// 引擎尚未创建子系统（或已经关闭）时返回nullptr
+	static UOnnxModelRegistry* Get();
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	// 获取模型实例：资产优先，否则按ModelPath。相同模型和配置的请求返回同一个实例，创建失败时返回nullptr
+	FOnnxModelHandle Acquire(UOnnxModelAsset* Asset, const FString& ModelPath = FString());
+
+	// 丢弃模型的所有条目（资产被修改、调优或比较变体之后）：已有句柄继续使用旧实例，之后的Acquire创建新实例。
+	// 直接改写modelData_内容（不经过PostEditChange）的代码也需要调用它，资产模型字节的哈希按数组缓存
+	void Invalidate(UOnnxModelAsset* Asset, const FString& ModelPath = FString());
+
+	// 立即释放所有没有句柄的实例
+	UFUNCTION(BlueprintCallable, Category = "ONNX Registry")
+	void TrimIdle();
+
+	UFUNCTION(BlueprintCallable, Category = "ONNX Registry")
+	FOnnxModelRegistryStats GetStats() const;
+
+	// 输出每个实例的句柄数和空闲时间（onnx.Registry）
+	void Dump(FOutputDevice& Ar) const;
+
+private:
+	struct FEntry
+	{
+		FOnnxModelHandle Instance;
+		FString DisplayName;
+
+		// 用于Invalidate匹配
+		TWeakObjectPtr<UOnnxModelAsset> Asset;
+		FString ModelPath;
+
+		// 最后一个句柄释放的时间，仍有句柄时为0
+		double IdleSince = 0.0;
+	};
+
+	// 正在创建的实例：同一键的其他Acquire等待Future，创建期间不持有mutex_
+	struct FPendingEntry
+	{
+		TSharedFuture<FOnnxModelHandle> Future;
+		TWeakObjectPtr<UOnnxModelAsset> Asset;
+		FString ModelPath;
+
+		// 创建期间被Invalidate：实例只返回给发起创建的调用方，不进入注册表
+		bool bInvalidated = false;
+	};
+
+	// 资产模型字节的内容哈希，数组重新分配或大小变化时重新计算
+	struct FModelDataHash
+	{
+		const uint8* Data = nullptr;
+		int32 Num = 0;
+		FString Hash;
+	};
+
+	// 模型身份（内容哈希）+ 会话相关配置
+	FString MakeKey(UOnnxModelAsset* Asset, const FString& ModelPath);
+	FString GetModelDataHash(UOnnxModelAsset* Asset);
+
+	// 检查句柄数，释放宽限期已过的实例
+	bool Tick(float DeltaTime);
+
+	// 从注册表中取出要释放的实例（在锁外析构，会话析构可能需要等待后台重建）
+	void CollectExpired(double Now, float GraceSeconds, TArray<FOnnxModelHandle>& OutExpired);
+
+	mutable FCriticalSection mutex_;
+	TMap<FString, FEntry> entries_;
+	TMap<FString, FPendingEntry> pending_;
+	TMap<TWeakObjectPtr<UOnnxModelAsset>, FModelDataHash> modelDataHashes_;
+
+	FTSTicker::FDelegateHandle tickerHandle_;
+
+	// [OnnxRuntime] ModelRegistryGraceSeconds
+	float graceSeconds_ = 30.0f;
+
+	int64 hits_ = 0;
+	int64 misses_ = 0;
+	int32 expired_ = 0;
+};
@@ -0,0 +1,214 @@
+// OnnxModelVariants.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "OnnxModelVariants.generated.h"
+
+class UOnnxModelAsset;
+
+/**
+ * 模型变体的精度
+ */
+UENUM(BlueprintType)
+enum class EOnnxModelPrecision : uint8
+{
+	// 原始浮点模型（资产本身的模型，作为比较基准）
+	FP32		UMETA(DisplayName = "FP32 (Reference)"),
+
+	// QDQ格式的int8量化模型（权重和激活），CPU上由ORT融合为整数算子
+	QDQInt8		UMETA(DisplayName = "QDQ int8"),
+
+	// 4位仅权重量化（MatMulNBits），适合MatMul密集的Transformer模型
+	Int4Weights	UMETA(DisplayName = "4-bit Weight-Only (MatMulNBits)")
+};
+
+/**
+ * 变体的选择策略
+ */
+UENUM(BlueprintType)
+enum class EOnnxVariantPolicy : uint8
+{
+	// 始终使用浮点基准模型
+	Reference	UMETA(DisplayName = "Reference (FP32)"),
+
+	// 使用PreferredPrecisions中第一个存在的变体
+	Preferred	UMETA(DisplayName = "Preferred Precision"),
+
+	// 使用本机上一次比较中通过精度阈值且最快的变体，没有比较结果时使用基准模型
+	Validated	UMETA(DisplayName = "Fastest Validated")
+};
+
+/**
+ * 同一个模型的一个精度变体（与基准模型有相同的输入输出）
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxModelVariant
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Variant")
+	EOnnxModelPrecision Precision = EOnnxModelPrecision::QDQInt8;
+
+	// 变体的.onnx文件（相对项目目录）
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Variant")
+	FString ModelPath;
+
+	// SAM2解码器变体（相对项目目录），为空时沿用基准解码器；通用模型不使用
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Variant")
+	FString DecoderPath;
+};
+
+/**
+ * 变体的选择策略和精度阈值
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxVariantSelection
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Variant")
+	EOnnxVariantPolicy Policy = EOnnxVariantPolicy::Reference;
+
+	// Preferred策略的优先顺序
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Variant")
+	TArray<EOnnxModelPrecision> PreferredPrecisions = { EOnnxModelPrecision::QDQInt8, EOnnxModelPrecision::Int4Weights };
+
+	// 通过比较所允许的最大相对L2误差（所有样本中的最大值）
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Variant", meta = (ClampMin = "0.0"))
+	float MaxRelativeL2 = 0.05f;
+
+	// 通过比较所需的最小掩码IoU（仅SAM2）
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Variant", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float MinMaskIoU = 0.9f;
+
+	// 计算掩码IoU时的二值化阈值
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Variant")
+	float MaskThreshold = 0.5f;
+};
+
+/**
+ * 一个变体相对基准模型的比较结果
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxVariantReport
+{
+	GENERATED_BODY()
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Variant")
+	EOnnxModelPrecision Precision = EOnnxModelPrecision::FP32;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Variant")
+	FString ModelPath;
+
+	// 模型加载并在所有样本上运行成功
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Variant")
+	bool bSucceeded = false;
+
+	// 误差在阈值以内（基准模型始终通过）
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Variant")
+	bool bPassed = false;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Variant")
+	int32 NumSamples = 0;
+
+	// 每个样本的平均推理延迟（毫秒）
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Variant")
+	float MeanLatencyMs = 0.0f;
+
+	// 基准延迟 / 本变体延迟
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Variant")
+	float Speedup = 1.0f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Variant")
+	float MeanRelativeL2 = 0.0f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Variant")
+	float MaxRelativeL2 = 0.0f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Variant")
+	float MaxAbsError = 0.0f;
+
+	// 掩码IoU（仅SAM2），没有掩码时为-1
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Variant")
+	float MeanMaskIoU = -1.0f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Variant")
+	float MinMaskIoU = -1.0f;
+
+	FString ToString() const;
+};
+
+/**
+ * 比较时使用的一个样本输入
+ */
+struct CLOTH_API FOnnxSampleInput
+{
+	FString Name;
+	TArray<float> Data;
+
+	// .npy文件头中的形状；.bin文件为空，由模型的输入形状推算
+	TArray<int64> Shape;
+};
+
+/**
+ * 一个变体在比较过程中的误差累计
+ */
+struct CLOTH_API FOnnxVariantErrorStats
+{
+	int32 NumSamples = 0;
+	double SumSeconds = 0.0;
+	double SumRelativeL2 = 0.0;
+	float MaxRelativeL2 = 0.0f;
+	float MaxAbsError = 0.0f;
+	int32 NumMasks = 0;
+	double SumMaskIoU = 0.0;
+	float MinMaskIoU = 1.0f;
+
+	// 累计一个样本的输出误差，输出大小不一致时返回false
+	bool AddOutput(const TArray<float>& Output, const TArray<float>& Reference);
+	void AddMask(const TArray<float>& Mask, const TArray<float>& Reference, float Threshold);
+
+	// 写入报告中的延迟和误差字段
+	void FillReport(FOnnxVariantReport& Report) const;
+};
+
+/**
+ * FOnnxModelVariants
+ * 量化变体的选择与比较：在一组样本输入上依次运行基准模型和各个变体，报告加速比和输出误差，
+ * 并把通过精度阈值的最快变体记录到本机的调优文件中，供Validated策略使用。
+ */
+class CLOTH_API FOnnxModelVariants
+{
+public:
+	// 用于日志的名称
+	static const TCHAR* GetDisplayName(EOnnxModelPrecision Precision);
+
+	// 变体文件的完整路径（相对路径按项目目录解析）
+	static FString GetFullPath(const FString& Path);
+
+	// 资产中该精度的变体，FP32或文件不存在时返回nullptr
+	static const FOnnxModelVariant* FindVariant(const UOnnxModelAsset& Asset, EOnnxModelPrecision Precision);
+
+	// 按选择策略决定使用的精度。Available为存在的变体（不含FP32），Key为记录比较结果的键
+	static EOnnxModelPrecision ResolvePrecision(const FOnnxVariantSelection& Selection, const TArray<EOnnxModelPrecision>& Available, const FString& Key);
+
+	// 按资产的选择策略决定使用的精度
+	static EOnnxModelPrecision ResolvePrecision(const UOnnxModelAsset& Asset);
+
+	// 资产的比较结果键（资产名称 + 基准模型内容哈希）
+	static FString MakeSelectionKey(const UOnnxModelAsset& Asset);
+
+	// 读取文件夹中的样本输入：.npy（float32，C顺序）或原始小端float32的.bin
+	static bool LoadSamples(const FString& Folder, TArray<FOnnxSampleInput>& OutSamples);
+
+	// 在样本上比较资产的基准模型和所有变体。每个样本先运行一次获取输出，再计时Iterations次。
+	// bSaveSelection为true时把最快的通过变体记录到本机调优文件。第一项为基准模型。
+	static TArray<FOnnxVariantReport> Compare(UOnnxModelAsset* Asset, const FString& SampleFolder, int32 Iterations, bool bSaveSelection = true);
+
+	// 根据基准延迟和阈值填写Speedup/bPassed，bSaveSelection时记录最快的通过变体（Reports[0]为基准）
+	static void FinalizeReports(TArray<FOnnxVariantReport>& Reports, const FOnnxVariantSelection& Selection, const FString& Key, bool bSaveSelection);
+
+	// 将结果以表格形式输出到日志
+	static void LogReports(const TArray<FOnnxVariantReport>& Reports);
+};
@@ -0,0 +1,159 @@
+// OnnxNuma.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "OnnxSessionSettings.h"
+#include "OnnxBenchmark.h"
+
+// 包含ONNX Runtime的实现头文件
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#endif
+#include "onnxruntime_cxx_api.h"
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
+
+#include <atomic>
+
+/**
+ * 一个NUMA节点
+ */
+struct CLOTH_API FOnnxNumaNode
+{
+	int32 NodeId = 0;
+
+	// 属于该节点的逻辑CPU编号（从0开始）
+	TArray<int32> Cpus;
+
+	// 用于FRunnableThread的亲和性掩码（只覆盖前64个CPU，节点的CPU全部>=64时为0）
+	uint64 GetAffinityMask() const;
+
+	// 生成session.intra_op_thread_affinities字符串：NumThreads-1个线程都绑定到本节点的CPU（ORT的CPU编号从1开始）
+	FString MakeIntraOpThreadAffinities(int32 NumThreads) const;
+};
+
+/**
+ * FOnnxNumaTopology
+ * NUMA拓扑探测。Linux上读取/sys/devices/system/node，其他平台视为单节点。
+ */
+class CLOTH_API FOnnxNumaTopology
+{
+public:
+	static const FOnnxNumaTopology& Get();
+
+	const TArray<FOnnxNumaNode>& GetNodes() const { return nodes_; }
+	int32 GetNumNodes() const { return nodes_.Num(); }
+
+	// 调用线程当前所在的节点索引（GetNodes()中的下标），无法判断时返回0
+	int32 GetCurrentNodeIndex() const;
+
+private:
+	FOnnxNumaTopology();
+
+	TArray<FOnnxNumaNode> nodes_;
+	TMap<int32, int32> cpuToNodeIndex_;
+};
+
+/**
+ * 单个NUMA节点上的会话副本组统计
+ */
+struct CLOTH_API FOnnxNumaNodeStats
+{
+	int32 NodeId = 0;
+	int32 NumReplicas = 0;
+
+	// 在本节点副本上完成的请求数，以及其中来自其他节点调用线程的请求数
+	int64 NumRequests = 0;
+	int64 NumRemoteRequests = 0;
+
+	// 副本忙碌的总时间（秒）
+	double BusySeconds = 0.0;
+
+	// 自池创建以来的吞吐量（请求/秒）
+	double RequestsPerSecond = 0.0;
+
+	// 单次请求平均耗时（毫秒）
+	double MeanLatencyMs = 0.0;
+};
+
+/**
+ * FOnnxNumaSessionPool
+ * 每个NUMA节点一组会话副本。
+ * 副本在绑定到该节点的线程上创建并预热，因此初始化器和内存池都在该节点上首次触碰；
+ * 副本的ORT线程通过intra_op_thread_affinities绑定到该节点的CPU。
+ * Acquire优先返回调用线程所在节点的空闲副本，都忙时再借用其他节点的副本。
+ */
+class CLOTH_API FOnnxNumaSessionPool
+{
+public:
+	struct FReplica
+	{
+		TUniquePtr<Ort::Session> Session;
+		int32 NodeIndex = 0;
+		FCriticalSection InUse;
+	};
+
+	/**
+	 * 会话租约：析构时归还副本并记录耗时
+	 */
+	class CLOTH_API FLease
+	{
+	public:
+		FLease() = default;
+		FLease(FOnnxNumaSessionPool* InPool, FReplica* InReplica, int32 InCallerNode);
+		FLease(FLease&& Other);
+		~FLease();
+
+		bool IsValid() const { return replica_ != nullptr; }
+		Ort::Session& GetSession() const { return *replica_->Session; }
+		int32 GetNodeIndex() const { return replica_->NodeIndex; }
+
+	private:
+		FLease(const FLease&) = delete;
+		FLease& operator=(const FLease&) = delete;
+
+		FOnnxNumaSessionPool* pool_ = nullptr;
+		FReplica* replica_ = nullptr;
+		int32 callerNode_ = 0;
+		double startTime_ = 0.0;
+	};
+
+	FOnnxNumaSessionPool() = default;
+	~FOnnxNumaSessionPool();
+
+	// 在每个NUMA节点上创建ReplicasPerNode个副本。WarmupParams用于生成首次触碰内存的预热输入。
+	bool Initialize(const FOnnxSessionFactory& Factory, const FOnnxSessionSettings& BaseSettings,
+					int32 ReplicasPerNode, const FOnnxBenchmarkParams& WarmupParams, const FString& PoolName);
+
+	bool IsInitialized() const { return replicas_.Num() > 0; }
+	int32 GetNumReplicas() const { return replicas_.Num(); }
+
+	// 获取一个副本，优先使用调用线程所在节点的副本
+	FLease Acquire();
+
+	// 各节点统计
+	TArray<FOnnxNumaNodeStats> GetNodeStats() const;
+	void LogNodeStats() const;
+
+private:
+	FOnnxNumaSessionPool(const FOnnxNumaSessionPool&) = delete;
+	FOnnxNumaSessionPool& operator=(const FOnnxNumaSessionPool&) = delete;
+
+	void Release(FReplica* Replica, int32 CallerNode, double Seconds);
+
+	FString poolName_;
+	TArray<TUniquePtr<FReplica>> replicas_;
+
+	// 按节点分组的副本下标
+	TArray<TArray<int32>> replicasByNode_;
+
+	// 各节点的轮询起点，分散同一节点上的并发请求
+	TArray<TUniquePtr<std::atomic<uint32>>> nextReplica_;
+
+	mutable FCriticalSection statsMutex_;
+	TArray<FOnnxNumaNodeStats> nodeStats_;
+	double creationTime_ = 0.0;
+};
@@ -0,0 +1,203 @@
+// OnnxPipeline.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "HAL/Event.h"
+#include "Containers/Queue.h"
+#include "OnnxSessionSettings.h"
+#include "OnnxGraphPatch.h"
+
+// 包含ONNX Runtime的实现头文件
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#endif
+#include "onnxruntime_cxx_api.h"
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "OnnxPipeline.generated.h"
+
+class FRunnableThread;
+
+/**
+ * 流水线并行的配置（资产上一份）
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxPipelineSettings
+{
+	GENERATED_BODY()
+
+	// 把模型在节点边界处切分成多个阶段子会话，每个阶段在自己的线程上用自己的线程预算运行，
+	// 连续的请求在不同阶段上同时执行（第一张图像进入第二阶段时第二张图像已经开始第一阶段），
+	// 提高连续图像流的吞吐。单个请求的延迟基本不变（每个阶段的线程更少，阶段之间多一次交接）。
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX|Pipeline")
+	bool bEnabled = false;
+
+	// 切分点：节点名称或节点产生的张量名称，切分发生在该节点之后。为空时按权重大小自动均分为NumStages段
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX|Pipeline", meta = (EditCondition = "bEnabled"))
+	TArray<FString> SplitNodes;
+
+	// 自动切分的阶段数（指定了SplitNodes时由切分点决定）
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX|Pipeline", meta = (ClampMin = "2", ClampMax = "16", EditCondition = "bEnabled"))
+	int32 NumStages = 2;
+
+	// 每个阶段的算子内线程数，缺少或<=0的项把会话的线程数（为1时为物理核心数）平均分给各阶段
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX|Pipeline", meta = (EditCondition = "bEnabled"))
+	TArray<int32> StageIntraOpThreads;
+
+	// 同时在流水线中的请求数，达到后提交等待最早的请求完成
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX|Pipeline", meta = (ClampMin = "1", ClampMax = "64", EditCondition = "bEnabled"))
+	int32 MaxInFlight = 4;
+};
+
+/**
+ * 流水线单个阶段的统计
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxPipelineStageStats
+{
+	GENERATED_BODY()
+
+	// 阶段包含的节点数和权重大小
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX|Pipeline")
+	int32 NumNodes = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX|Pipeline")
+	float WeightMB = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX|Pipeline")
+	int32 IntraOpThreads = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX|Pipeline")
+	int64 Completed = 0;
+
+	// 阶段Run的平均耗时
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX|Pipeline")
+	float MeanRunMs = 0.0f;
+
+	// 流水线启动以来阶段线程忙碌的时间比例，最高的阶段决定吞吐
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX|Pipeline")
+	float Utilization = 0.0f;
+};
+
+/**
+ * 流水线的统计
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxPipelineStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX|Pipeline")
+	TArray<FOnnxPipelineStageStats> Stages;
+
+	// 进行中的请求数
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX|Pipeline")
+	int32 NumInFlight = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX|Pipeline")
+	int64 CompletedRequests = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX|Pipeline")
+	int64 FailedRequests = 0;
+
+	// 从提交到完成的平均延迟
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX|Pipeline")
+	float MeanLatencyMs = 0.0f;
+
+	// 启动以来每秒完成的请求数
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX|Pipeline")
+	float RequestsPerSecond = 0.0f;
+};
+
+// 请求完成时在最后一个阶段的线程上调用，Outputs按GetOutputName的顺序（失败时为空）
+typedef TFunction<void(bool bSucceeded, std::vector<Ort::Value>& Outputs)> FOnnxPipelineCallback;
+
+// 用给定配置从阶段模型的字节创建会话（由模型实例提供，共享会话选项、外部数据和预打包权重）
+typedef TFunction<TUniquePtr<Ort::Session>(const FOnnxSessionSettings& Settings, const TArray<uint8>& StageModelData)> FOnnxPipelineSessionFactory;
+
+/**
+ * FOnnxPipeline
+ * 把一个模型切分为若干阶段子会话，按流水线方式执行请求。每个阶段有一个专用线程和请求队列，
+ * 阶段之间以Ort::Value交接激活（不复制），某个张量在最后一个使用它的阶段之后即被释放。
+ */
+class CLOTH_API FOnnxPipeline
+{
+public:
+	FOnnxPipeline() = default;
+	~FOnnxPipeline();
+
+	FOnnxPipeline(const FOnnxPipeline&) = delete;
+	FOnnxPipeline& operator=(const FOnnxPipeline&) = delete;
+
+	// 切分模型并依次创建各阶段的会话（后面阶段的输入类型取自前面阶段的输出），然后启动阶段线程。
+	// 模型无法切分或任一阶段的会话创建失败时返回false。
+	bool Start(const TArray<uint8>& ModelData, const FOnnxSessionSettings& Settings, const FOnnxPipelineSettings& PipelineSettings,
+			   const FString& InDisplayName, const FOnnxPipelineSessionFactory& CreateSession);
+
+	// 排空进行中的请求并结束阶段线程
+	void Stop();
+
+	bool IsRunning() const { return bRunning_; }
+	int32 GetNumStages() const { return stages_.Num(); }
+
+	// 模型的输入/输出（不包括作为图输入列出的初始值），按名称查找时找不到返回INDEX_NONE
+	int32 GetNumInputs() const { return inputNames_.Num(); }
+	int32 GetNumOutputs() const { return outputNames_.Num(); }
+	const std::string& GetInputName(int32 Index) const { return inputNames_[Index]; }
+	const std::string& GetOutputName(int32 Index) const { return outputNames_[Index]; }
+	const FOnnxGraphTensorType& GetInputType(int32 Index) const { return inputTypes_[Index]; }
+	int32 FindInput(const char* Name) const;
+	int32 FindOutput(const char* Name) const;
+
+	// 提交一个请求，Inputs按GetInputName的顺序。进行中的请求达到MaxInFlight时等待，
+	// 流水线未运行时立即以失败调用OnComplete
+	void Submit(std::vector<Ort::Value>&& Inputs, FOnnxPipelineCallback&& OnComplete);
+
+	// 提交并等待完成
+	bool Run(std::vector<Ort::Value>&& Inputs, std::vector<Ort::Value>& OutOutputs);
+
+	FOnnxPipelineStats GetStats() const;
+
+private:
+	struct FRequest;
+	struct FStage;
+	class FStageThread;
+
+	// 阶段线程的主循环
+	void RunStage(int32 StageIndex);
+
+	// 请求离开流水线（完成或失败）
+	void Complete(FRequest* Request, bool bSucceeded);
+
+	FString displayName_;
+	TArray<TUniquePtr<FStage>> stages_;
+
+	std::vector<std::string> inputNames_;
+	std::vector<std::string> outputNames_;
+	TArray<FOnnxGraphTensorType> inputTypes_;
+
+	// 每个请求携带的张量槽数，以及模型输入/输出所在的槽
+	int32 numSlots_ = 0;
+	TArray<int32> inputSlots_;
+	TArray<int32> outputSlots_;
+
+	// 进行中的请求数达到上限时提交方在这里等待
+	int32 maxInFlight_ = 4;
+	FEvent* slotFreedEvent_ = nullptr;
+
+	double startTime_ = 0.0;
+	std::atomic<int32> numInFlight_{0};
+	std::atomic<int64> completedRequests_{0};
+	std::atomic<int64> failedRequests_{0};
+	std::atomic<int64> totalLatencyMicros_{0};
+	std::atomic<bool> bRunning_{false};
+	std::atomic<bool> bStopping_{false};
+};
@@ -0,0 +1,73 @@
+// OnnxPrepackedWeights.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+
+// 包含ONNX Runtime的实现头文件
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#endif
+#include "onnxruntime_cxx_api.h"
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
+
+/**
+ * FOnnxPrepackedWeightsContainer
+ * 对OrtPrepackedWeightsContainer的RAII封装。
+ * 同一个容器传给多个Ort::Session时，GEMM/Conv等算子预打包后的权重只保存一份。
+ */
+class CLOTH_API FOnnxPrepackedWeightsContainer
+{
+public:
+	FOnnxPrepackedWeightsContainer();
+	~FOnnxPrepackedWeightsContainer();
+
+	// 获取底层的ORT容器指针，用于创建会话。
+	OrtPrepackedWeightsContainer* Get() const { return container_; }
+
+private:
+	FOnnxPrepackedWeightsContainer(const FOnnxPrepackedWeightsContainer&) = delete;
+	FOnnxPrepackedWeightsContainer& operator=(const FOnnxPrepackedWeightsContainer&) = delete;
+
+	OrtPrepackedWeightsContainer* container_ = nullptr;
+};
+
+typedef TSharedPtr<FOnnxPrepackedWeightsContainer, ESPMode::ThreadSafe> FOnnxPrepackedWeightsPtr;
+
+/**
+ * FOnnxPrepackedWeightsRegistry
+ * 按模型内容哈希共享预打包权重容器的全局注册表。
+ * 同一模型的所有会话（无论由哪个组件创建）都会拿到同一个容器，N个副本只占用约一份预打包权重。
+ * 注册表只持有弱引用，最后一个会话释放后容器随之销毁。
+ */
+class CLOTH_API FOnnxPrepackedWeightsRegistry
+{
+public:
+	// 计算模型文件的内容哈希（按路径、大小和时间戳缓存，避免重复读取大文件）。
+	static FString ComputeModelHash(const FString& ModelPath);
+
+	// 计算内存中模型数据的内容哈希。
+	static FString ComputeModelHash(const TArray<uint8>& ModelData);
+
+	// 查找或创建指定模型哈希对应的共享容器。哈希为空时返回nullptr。
+	static FOnnxPrepackedWeightsPtr FindOrCreate(const FString& ModelHash);
+
+	// 当前仍然存活的共享容器数量（用于调试和统计）。
+	static int32 GetNumLiveContainers();
+
+private:
+	static FCriticalSection Mutex;
+	static TMap<FString, TWeakPtr<FOnnxPrepackedWeightsContainer, ESPMode::ThreadSafe>> Containers;
+
+	// 文件哈希缓存：路径 -> (大小, 时间戳, 哈希)
+	struct FFileHashEntry
+	{
+		int64 FileSize = 0;
+		FDateTime TimeStamp;
+		FString Hash;
+	};
+	static TMap<FString, FFileHashEntry> FileHashCache;
+};
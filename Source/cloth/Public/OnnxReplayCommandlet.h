@@ -0,0 +1,24 @@
+// OnnxReplayCommandlet.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "OnnxReplayCommandlet.generated.h"
+
+/**
+ * UOnnxReplayCommandlet
+ * 无界面地回放捕获文件并输出延迟分布，用于离线复现和基准测试：
+ *   UnrealEditor-Cmd <Project>.uproject -run=OnnxReplay -Capture=<file> [-Passes=N] [-Warmup=N] [-MaxRecords=N] [-Threads=N]
+ * 相对路径按Saved/Onnx/Captures解析。所有运行成功时返回0。
+ */
+UCLASS()
+class CLOTH_API UOnnxReplayCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UOnnxReplayCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,170 @@
+// OnnxResidency.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+
+#include <atomic>
+
+#include "OnnxResidency.generated.h"
+
+/**
+ * 单个模型的驻留统计
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxResidencyStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Residency")
+	FString Name;
+
+	// 当前是否驻留在内存中
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Residency")
+	bool bResident = false;
+
+	// 驻留时占用的内存（会话 + 缓存的特征），未驻留时为0
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Residency")
+	int64 ResidentBytes = 0;
+
+	// 被驱逐/重新加载的次数
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Residency")
+	int32 NumEvictions = 0;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Residency")
+	int32 NumReloads = 0;
+
+	// 距离上次使用的秒数
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Residency")
+	float SecondsSinceLastUse = 0.0f;
+};
+
+/**
+ * FOnnxResidencyHandle
+ * 模型在驻留管理器中的登记项。模型实例持有一个句柄，并提供加载/释放会话的回调；
+ * 每次推理前通过FScope确保会话驻留（被驱逐过则透明地重新加载），作用域内的模型不会被驱逐。
+ * 句柄应声明为所属类的最后一个成员，保证它最先析构、回调引用的成员仍然有效。
+ */
+class CLOTH_API FOnnxResidencyHandle
+{
+public:
+	// 创建会话等驻留状态，成功返回true
+	typedef TFunction<bool()> FLoadFunction;
+
+	// 释放会话和缓存
+	typedef TFunction<void()> FReleaseFunction;
+
+	/**
+	 * 使用作用域：构造时确保驻留并标记为使用中，析构时更新最近使用时间
+	 */
+	class CLOTH_API FScope
+	{
+	public:
+		explicit FScope(FOnnxResidencyHandle& InHandle);
+		~FScope();
+
+		// 会话是否可用（重新加载失败时为false）
+		bool IsResident() const { return bResident; }
+
+	private:
+		FScope(const FScope&) = delete;
+		FScope& operator=(const FScope&) = delete;
+
+		FOnnxResidencyHandle& Handle;
+		bool bResident = false;
+	};
+
+	FOnnxResidencyHandle() = default;
+	~FOnnxResidencyHandle();
+
+	// 登记到驻留管理器。调用时会话已经加载，随后会按预算驱逐其他模型。
+	void Register(const FString& InName, FLoadFunction InLoad, FReleaseFunction InRelease, int64 InResidentBytes);
+
+	bool IsRegistered() const { return bRegistered; }
+
+	// 更新驻留内存（例如缓存的编码器特征变化后）
+	void SetResidentBytes(int64 Bytes);
+
+	// 等待进行中的请求结束后在锁内执行Fn（新请求在此期间等待），用于换入在后台重建好的会话。
+	// Fn的参数表示会话当前是否驻留，未驻留时只需要更新配置，下次加载时生效。
+	void RunExclusive(TFunctionRef<void(bool bResident)> Fn);
+
+	FOnnxResidencyStats GetStats() const;
+
+private:
+	friend class FOnnxResidencyManager;
+
+	FOnnxResidencyHandle(const FOnnxResidencyHandle&) = delete;
+	FOnnxResidencyHandle& operator=(const FOnnxResidencyHandle&) = delete;
+
+	bool Acquire();
+	void Release();
+
+	// 空闲时释放会话，使用中或正在加载时返回false
+	bool TryEvict();
+
+	FString name_;
+	FLoadFunction load_;
+	FReleaseFunction release_;
+	bool bRegistered = false;
+
+	// 保护加载/释放
+	mutable FCriticalSection stateMutex_;
+	std::atomic<bool> bResident_{false};
+	std::atomic<int32> useCount_{0};
+	std::atomic<int64> residentBytes_{0};
+	std::atomic<double> lastUseTime_{0.0};
+	std::atomic<int32> numEvictions_{0};
+	std::atomic<int32> numReloads_{0};
+};
+
+/**
+ * FOnnxResidencyManager
+ * 全局模型驻留管理：统计所有已登记模型的驻留内存，超出预算时按最近最少使用的顺序驱逐空闲模型。
+ * 预算从引擎配置文件读取：
+ *   [OnnxRuntime]
+ *   ResidencyBudgetMB=0   ; 0表示不限制
+ */
+class CLOTH_API FOnnxResidencyManager
+{
+public:
+	static FOnnxResidencyManager& Get();
+
+	// 内存预算（字节），0表示不限制
+	int64 GetBudgetBytes() const { return budgetBytes_; }
+	void SetBudgetBytes(int64 Bytes);
+
+	// 当前所有驻留模型占用的内存
+	int64 GetResidentBytes() const;
+
+	// 驱逐空闲模型直到满足预算，Excluding不会被驱逐（通常是刚加载的模型）
+	void EnforceBudget(const FOnnxResidencyHandle* Excluding = nullptr);
+
+	// 驱逐空闲超过IdleSeconds的模型，返回驱逐数量
+	int32 EvictIdle(double IdleSeconds);
+
+	// 累计的驱逐/重新加载次数
+	int32 GetTotalEvictions() const { return totalEvictions_; }
+	int32 GetTotalReloads() const { return totalReloads_; }
+
+	TArray<FOnnxResidencyStats> GetStats() const;
+	void LogStats() const;
+
+	// 测量加载会话前后进程物理内存的增量
+	static int64 GetProcessUsedPhysical();
+
+private:
+	friend class FOnnxResidencyHandle;
+
+	FOnnxResidencyManager();
+
+	void RegisterHandle(FOnnxResidencyHandle* Handle);
+	void UnregisterHandle(FOnnxResidencyHandle* Handle);
+
+	mutable FCriticalSection mutex_;
+	TArray<FOnnxResidencyHandle*> handles_;
+	std::atomic<int64> budgetBytes_{0};
+	std::atomic<int32> totalEvictions_{0};
+	std::atomic<int32> totalReloads_{0};
+};
@@ -0,0 +1,211 @@
+// OnnxRuntime.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "OnnxMemory.h"
+
+// 包含ONNX Runtime的实现头文件
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#endif
+#include "onnxruntime_cxx_api.h"
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
+
+#include <atomic>
+#include <string>
+
+class FOnnxWorkerThread;
+struct FOnnxSessionSettings;
+
+/**
+ * ORT工作线程的统计信息
+ */
+struct CLOTH_API FOnnxWorkerThreadStats
+{
+	// 线程名称（与Unreal Insights中显示的一致）
+	FString Name;
+
+	// 创建顺序（线程名称中的编号），用于区分某个会话创建的线程
+	int32 Index = -1;
+
+	// 线程存活的墙钟时间（秒）
+	double WallSeconds = 0.0;
+
+	// 线程实际消耗的CPU时间（秒），不支持的平台上为-1
+	double BusySeconds = -1.0;
+
+	// 线程是否仍在运行
+	bool bRunning = false;
+
+	// 空闲时间 = 墙钟时间 - CPU时间
+	double GetIdleSeconds() const { return BusySeconds >= 0.0 ? FMath::Max(0.0, WallSeconds - BusySeconds) : -1.0; }
+};
+
+/**
+ * ORT线程配置，从引擎配置文件的[OnnxRuntime]段读取：
+ *   bUseGlobalThreadPools=False
+ *   GlobalIntraOpThreads=0
+ *   GlobalInterOpThreads=0
+ *   bGlobalAllowSpinning=True
+ *   WorkerAffinityMask=0x0
+ *   IntraOpThreadAffinities=
+ */
+struct CLOTH_API FOnnxThreadingSettings
+{
+	// 是否让所有会话共享Env级别的全局线程池（关闭时每个会话使用自己的线程池）
+	bool bUseGlobalThreadPools = false;
+
+	// 全局线程池大小，0表示由ORT决定
+	int32 GlobalIntraOpThreads = 0;
+	int32 GlobalInterOpThreads = 0;
+
+	// 全局线程池是否在空闲时自旋（每个会话自己的线程池由FOnnxSessionSettings::SpinMode控制）
+	bool bGlobalAllowSpinning = true;
+
+	// 所有ORT工作线程的CPU亲和性掩码，0表示不限制
+	uint64 WorkerAffinityMask = 0;
+
+	// 透传给session.intra_op_thread_affinities的逐线程亲和性，例如"1,2;3,4"
+	FString IntraOpThreadAffinities;
+
+	void LoadFromConfig();
+};
+
+/**
+ * ORT启动耗时的分解（未发生或平台上无法测量的项为-1）
+ */
+struct CLOTH_API FOnnxRuntimeStartupStats
+{
+	// 模块启动到第一次使用ORT的间隔（秒）
+	double ModuleStartupToFirstUseSeconds = -1.0;
+
+	// 加载onnxruntime动态库并解析API的耗时（Linux上动态库随进程加载，只包含API解析）
+	double DllLoadMs = -1.0;
+
+	// 创建共享Ort::Env（包括全局线程池和插件分配器）的耗时
+	double EnvCreateMs = -1.0;
+
+	// 第一个会话的创建耗时以及它的名称
+	double FirstSessionMs = -1.0;
+	FString FirstSessionName;
+
+	// 实际加载的ORT版本和动态库路径
+	FString Version;
+	FString LibraryPath;
+};
+
+/**
+ * FOnnxRuntime
+ * 插件共享的ONNX Runtime运行时：持有唯一的Ort::Env，并通过自定义线程创建钩子
+ * 把ORT的工作线程创建为具名的FRunnable线程，以便Unreal Insights识别、引擎控制其亲和性，并统计线程利用率。
+ */
+class CLOTH_API FOnnxRuntime
+{
+public:
+	// 获取全局运行时（首次调用时创建）。ORT加载失败时运行时仍然存在但没有Env，使用Ort::类型之前先检查IsAvailable()
+	static FOnnxRuntime& Get();
+
+	// 释放全局运行时（模块卸载时调用，此时所有会话必须已经释放）
+	static void Shutdown();
+
+	// 加载ORT动态库并初始化C++ API（只执行一次，线程安全）。模块启动时不加载ORT，
+	// 所有使用Ort::类型的入口（会话、张量、工作进程池）必须先调用它或Get()。失败时返回false
+	static bool LoadApi();
+
+	// 记录模块启动时间，作为启动耗时分解的起点
+	static void NoteModuleStartup();
+
+	// 报告一个会话的创建耗时，只有第一个会话会被记录并输出完整的启动耗时分解
+	static void ReportSessionCreated(const FString& Name, double Seconds);
+
+	// 启动耗时分解（onnx.StartupTiming）
+	static FOnnxRuntimeStartupStats GetStartupStats();
+	static void LogStartupStats(FOutputDevice& Ar);
+
+	~FOnnxRuntime();
+
+	// 文件路径转换为ORT的路径字符串（Windows上为宽字符，其他平台为UTF-8）
+	static std::basic_string<ORTCHAR_T> ToOrtString(const FString& Value);
+
+	// ORT已加载并且Env创建成功
+	bool IsAvailable() const { return env_.IsValid(); }
+
+	// 插件中所有会话共享的ORT环境（只在IsAvailable()时有效）
+	Ort::Env& GetEnv() { check(env_.IsValid()); return *env_; }
+
+	const FOnnxThreadingSettings& GetThreadingSettings() const { return threadingSettings_; }
+	const FOnnxMemorySettings& GetMemorySettings() const { return memorySettings_; }
+
+	// 会话是否使用向Env注册的插件分配器（FOnnxMemory）
+	bool UsesUnrealAllocator() const { return bUnrealAllocator_; }
+
+	// 为会话选项应用插件的线程策略（线程创建钩子、全局线程池）和分配器。
+	// ORT经由线程钩子创建线程时不应用session.intra_op_thread_affinities，会话的逐线程亲和性由钩子在创建线程时设置
+	void ConfigureSessionOptions(Ort::SessionOptions& SessionOptions, const FOnnxSessionSettings& Settings) const;
+
+	// 获取所有ORT工作线程（包括已退出的）的忙碌/空闲统计，较早退出的线程合并为第一项（Index为-1）
+	TArray<FOnnxWorkerThreadStats> GetWorkerThreadStats() const;
+
+	// 下一个工作线程的编号：创建会话前后各取一次，区间内的线程属于这个会话的线程池
+	int32 GetNextWorkerThreadIndex() const;
+
+	// 编号在[FirstIndex, EndIndex)内的工作线程（包括已退出的）累计的CPU时间（秒），不支持的平台返回-1
+	double GetWorkerCpuSeconds(int32 FirstIndex = 0, int32 EndIndex = MAX_int32) const;
+
+	// 调用线程累计的CPU时间（秒），不支持的平台返回-1。会话的Run在调用线程上也参与计算
+	static double GetCurrentThreadCpuSeconds();
+
+	// 将线程统计输出到日志
+	void LogWorkerThreadStats() const;
+
+private:
+	FOnnxRuntime();
+	FOnnxRuntime(const FOnnxRuntime&) = delete;
+	FOnnxRuntime& operator=(const FOnnxRuntime&) = delete;
+
+	// 线程钩子的创建选项：逐线程的亲和性掩码（为空时使用WorkerAffinityMask），线程按创建顺序依次取用；后台会话的线程使用较低的优先级
+	struct FThreadCreationOptions
+	{
+		FOnnxRuntime* Runtime = nullptr;
+		TArray<uint64> ThreadMasks;
+		EThreadPriority Priority = TPri_Normal;
+		std::atomic<uint32> NextThread{0};
+	};
+
+	// 按亲和性字符串和优先级取得（首次使用时创建）线程钩子的创建选项，字符串中有无法用64位掩码表示的CPU时返回nullptr
+	FThreadCreationOptions* FindOrAddThreadOptions(const FString& Affinities, bool bLowPriority) const;
+
+	// ORT线程钩子
+	static OrtCustomThreadHandle CreateThreadHook(void* Options, OrtThreadWorkerFn WorkerFn, void* WorkerParam);
+	static void JoinThreadHook(OrtCustomThreadHandle Handle);
+
+	FOnnxThreadingSettings threadingSettings_;
+	FOnnxMemorySettings memorySettings_;
+
+	TUniquePtr<Ort::Env> env_;
+	bool bUnrealAllocator_ = false;
+
+	// 把超出保留数量的已退出线程累加到合并项（在threadsMutex_下调用）
+	void FoldFinishedThreadStats(const FOnnxWorkerThreadStats& Stat);
+
+	// 存活的工作线程和最近退出线程的统计，更早退出的线程只保留合并后的总计和编号范围
+	mutable FCriticalSection threadsMutex_;
+	TArray<FOnnxWorkerThread*> liveThreads_;
+	TArray<FOnnxWorkerThreadStats> finishedThreadStats_;
+	FOnnxWorkerThreadStats foldedThreadStats_;
+	int32 numFoldedThreads_ = 0;
+	int32 foldedFirstIndex_ = MAX_int32;
+	int32 foldedLastIndex_ = -1;
+	int32 nextThreadIndex_ = 0;
+
+	// 线程钩子的创建选项，按亲和性字符串和优先级共享，与运行时同生命周期（ORT只在创建线程池时使用它们）
+	FThreadCreationOptions defaultThreadOptions_;
+	FThreadCreationOptions lowPriorityThreadOptions_;
+	mutable TMap<FString, TUniquePtr<FThreadCreationOptions>> threadOptions_;
+
+	static TUniquePtr<FOnnxRuntime> Instance;
+};
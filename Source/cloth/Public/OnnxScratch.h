@@ -0,0 +1,152 @@
+// OnnxScratch.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// 包含ONNX Runtime的实现头文件
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#endif
+#include "onnxruntime_cxx_api.h"
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
+
+#include <atomic>
+
+#include "OnnxScratch.generated.h"
+
+// 统计每次推理在调用线程上经由FMemory的堆分配（包括std容器，模块的operator new也走FMemory）。
+// 统计需要在模块启动时用计数代理替换GMalloc，默认只在Debug构建中启用；
+// Development构建需要时在Build.cs中定义ONNX_TRACK_ALLOCATIONS=1。
+#ifndef ONNX_TRACK_ALLOCATIONS
+#define ONNX_TRACK_ALLOCATIONS UE_BUILD_DEBUG
+#endif
+
+// 推理路径上的小形状数组，内联存储不分配堆内存
+using FOnnxInlineShape = TArray<int64, TInlineAllocator<8>>;
+
+/**
+ * 一个推理实例的分配统计
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxAllocationStats
+{
+	GENERATED_BODY()
+
+	// 统计过的请求数（包括预热）
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Allocations")
+	int64 NumRuns = 0;
+
+	// 最近一次请求的分配次数
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Allocations")
+	int64 LastRunAllocations = 0;
+
+	// 预热之后单次请求的最大分配次数，稳定状态下应为0
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Allocations")
+	int64 MaxSteadyStateAllocations = 0;
+
+	// 预热之后发生了分配的请求数
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Allocations")
+	int64 NumSteadyStateViolations = 0;
+};
+
+/**
+ * FOnnxAllocationCounter
+ * 一个推理实例的分配计数（可以被多个线程同时更新）。
+ * 前WarmupRuns次请求用于按实际大小增长暂存缓冲区、记录输出形状，之后的请求不应再有任何分配。
+ */
+class CLOTH_API FOnnxAllocationCounter
+{
+public:
+	static constexpr int64 WarmupRuns = 2;
+
+	// 本次构建是否统计分配
+	static bool IsEnabled();
+
+	// 安装计数代理（模块启动时调用一次，未启用时为空操作）。安装之前的请求不计数
+	static void InstallTracking();
+
+	// 记录一次请求的分配次数，稳定状态下出现分配时报警（每个实例只报警一次）
+	void Record(int64 NumAllocations, const TCHAR* Name);
+
+	FOnnxAllocationStats GetStats() const;
+	void Reset();
+
+	// 会话或缓存被释放之后重新预热（驻留管理器驱逐后的重新加载不算稳定状态）
+	void RestartWarmup();
+
+	// 所有实例在稳定状态下出现分配的请求总数，自动化测试用它断言稳定状态无分配
+	static int64 GetTotalSteadyStateViolations();
+
+	/**
+	 * 一次请求的统计作用域：构造时开始统计当前线程的分配，析构时记入计数器。
+	 * 未启用时为空操作。ORT自己的分配（会话内部的arena，或经由插件分配器的分配）不计入。
+	 */
+	class CLOTH_API FRunScope
+	{
+	public:
+		FRunScope(FOnnxAllocationCounter& InCounter, const TCHAR* InName);
+		~FRunScope();
+
+	private:
+		FOnnxAllocationCounter& Counter;
+		const TCHAR* Name;
+		int64 StartCount = 0;
+	};
+
+	/**
+	 * 暂停统计的作用域：ORT经由插件分配器（FOnnxMemory）的内部分配不属于请求本身的分配，不计入。
+	 * 未启用时为空操作。
+	 */
+	class CLOTH_API FUntrackedScope
+	{
+	public:
+		FUntrackedScope();
+		~FUntrackedScope();
+
+	private:
+		int32 SavedDepth = 0;
+	};
+
+private:
+	std::atomic<int64> numRuns_{0};
+	std::atomic<int64> warmupEndRun_{WarmupRuns};
+	std::atomic<int64> lastRunAllocations_{0};
+	std::atomic<int64> maxSteadyStateAllocations_{0};
+	std::atomic<int64> numSteadyStateViolations_{0};
+	std::atomic<bool> bWarned_{false};
+};
+
+/**
+ * FOnnxOutputSlot
+ * 一个预分配的模型输出：预热运行后记录输出的形状和元素类型，之后的运行把输出直接写入调用方的缓冲区。
+ * 目标类型与输出类型一致（float->float，fp16->fp16）时零复制，否则经由暂存区转换。
+ */
+struct CLOTH_API FOnnxOutputSlot
+{
+	TArray<int64> Shape;
+	ONNXTensorElementDataType Type = ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+
+	// 类型不一致时ORT写入的暂存区
+	TArray<float> FloatScratch;
+	TArray<uint16> HalfScratch;
+
+	bool IsReady() const { return Type != ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED; }
+	int64 GetElementCount() const;
+
+	// 从预热运行的输出记录形状和类型（只支持FLOAT/FLOAT16），不支持时返回false
+	bool Capture(const Ort::Value& Output);
+
+	// 创建写入Dst的输出张量，Dst按输出大小调整（容量足够时不重新分配）
+	Ort::Value Bind(const Ort::MemoryInfo& MemoryInfo, TArray<float>& Dst);
+	Ort::Value Bind(const Ort::MemoryInfo& MemoryInfo, TArray<uint16>& Dst);
+
+	// 运行之后把暂存区转换到Dst（类型一致时为空操作）
+	void Finish(TArray<float>& Dst) const;
+	void Finish(TArray<uint16>& Dst) const;
+
+	// 忘记形状（输出形状改变或运行失败时），下次重新预热
+	void Reset();
+};
@@ -0,0 +1,182 @@
+// OnnxSessionSettings.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// 包含ONNX Runtime的实现头文件
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#endif
+#include "onnxruntime_cxx_api.h"
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
+
+#include "OnnxCoreSessionConfig.h"
+
+#include "OnnxSessionSettings.generated.h"
+
+/**
+ * ORT线程池在Run结束后的自旋策略
+ */
+UENUM(BlueprintType)
+enum class EOnnxSpinMode : uint8
+{
+	// ORT默认行为：工作线程在Run之后继续自旋等待，延迟最低但会持续占用CPU
+	Default			UMETA(DisplayName = "Default (Always Spin)"),
+
+	// 交互式突发：Run期间允许自旋，最后一个并发Run返回后立即停止自旋（session.force_spinning_stop）
+	SpinThenStop	UMETA(DisplayName = "Spin During Burst, Stop After Run"),
+
+	// 完全不自旋：空闲线程立即阻塞，把CPU让给游戏线程、渲染线程和任务图
+	NoSpin			UMETA(DisplayName = "No Spinning")
+};
+
+/**
+ * 图的执行模式
+ */
+UENUM(BlueprintType)
+enum class EOnnxExecutionMode : uint8
+{
+	// 顺序执行各个节点，只使用算子内并行
+	Sequential	UMETA(DisplayName = "Sequential"),
+
+	// 并行执行图中相互独立的分支（使用InterOpThreads）
+	Parallel	UMETA(DisplayName = "Parallel")
+};
+
+/**
+ * CPU执行提供程序（EP）
+ */
+UENUM(BlueprintType)
+enum class EOnnxExecutionProvider : uint8
+{
+	// ORT默认的CPU EP（始终可用）
+	CPU			UMETA(DisplayName = "Default CPU"),
+
+	// XNNPACK：针对移动端/ARM和x86的卷积与矩阵乘优化
+	XNNPACK		UMETA(DisplayName = "XNNPACK"),
+
+	// oneDNN（DNNL）：针对Intel CPU的卷积优化
+	OneDNN		UMETA(DisplayName = "oneDNN"),
+
+	// OpenVINO的CPU设备
+	OpenVINO	UMETA(DisplayName = "OpenVINO (CPU)")
+};
+
+/**
+ * 本机自动调优结果的使用方式
+ */
+UENUM(BlueprintType)
+enum class EOnnxAutotuneMode : uint8
+{
+	// 始终使用这里手动填写的配置
+	Off					UMETA(DisplayName = "Off"),
+
+	// 如果本机已有调优结果则自动应用
+	ApplyIfAvailable	UMETA(DisplayName = "Apply If Available"),
+
+	// 本机没有调优结果时在首次加载时调优并保存
+	TuneOnFirstLaunch	UMETA(DisplayName = "Tune On First Launch")
+};
+
+/**
+ * 量化（QDQ / MatMulNBits）模型相关的会话配置
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxQuantizationSettings
+{
+	GENERATED_BODY()
+
+	// 关闭QDQ融合（session.disable_quant_qdq），Q/DQ节点按浮点算子执行，仅用于排查精度问题
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Session|Quantization")
+	bool bDisableQDQFusion = false;
+
+	// QDQ处理完成后移除剩余的Q->DQ对（session.enable_quant_qdq_cleanup），更快但可能影响精度
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Session|Quantization")
+	bool bEnableQDQCleanup = false;
+
+	// 保留Q->(DQ->Q)->DQ中间的冗余节点（session.disable_double_qdq_remover）
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Session|Quantization")
+	bool bDisableDoubleQDQRemover = false;
+
+	// x64上改用较慢但不会溢出的U8U8矩阵乘（session.x64quantprecision），没有VNNI的AVX2/AVX512 CPU上U8S8模型精度下降时使用
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Session|Quantization")
+	bool bAvx2PrecisionMode = false;
+
+	// DQ + MatMul融合为MatMulNBits时的计算精度（session.qdq_matmulnbits_accuracy_level）：
+	// 0为ORT默认（4），1=fp32，2=fp16，3=bf16，4=int8
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Session|Quantization", meta = (ClampMin = "0", ClampMax = "4"))
+	int32 MatMulNBitsAccuracyLevel = 0;
+
+	// 写入OnnxCore的会话配置，由它应用到会话选项（只写入与ORT默认值不同的项）
+	void ApplyTo(OnnxCore::FSessionConfig& Config) const;
+};
+
+/**
+ * 每个模型的会话配置
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxSessionSettings
+{
+	GENERATED_BODY()
+
+	// 算子内并行线程数（1表示不创建线程池）
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Session", meta = (ClampMin = "1"))
+	int32 IntraOpThreads = 1;
+
+	// 算子间并行线程数，仅在Parallel模式下生效，0表示由ORT决定
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Session", meta = (ClampMin = "0"))
+	int32 InterOpThreads = 0;
+
+	// 图的执行模式
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Session")
+	EOnnxExecutionMode ExecutionMode = EOnnxExecutionMode::Sequential;
+
+	// 线程池自旋策略
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Session")
+	EOnnxSpinMode SpinMode = EOnnxSpinMode::Default;
+
+	// 实际使用的执行提供程序（按偏好列表选择后写入）
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Session|Execution Provider")
+	EOnnxExecutionProvider ExecutionProvider = EOnnxExecutionProvider::CPU;
+
+	// 执行提供程序偏好列表：加载时跳过当前ORT构建不支持的EP，多个可用时在真实模型上测试并选择最快的；为空时直接使用ExecutionProvider
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Session|Execution Provider")
+	TArray<EOnnxExecutionProvider> ExecutionProviderPreference;
+
+	// 每个NUMA节点创建的会话副本数，0表示不按NUMA节点分组（只创建一个会话）
+	// 每组副本的线程绑定到对应节点，内存在该节点上首次触碰，请求优先路由到调用线程所在节点的副本
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Session|NUMA", meta = (ClampMin = "0"))
+	int32 ReplicasPerNumaNode = 0;
+
+	// 逐线程亲和性（session.intra_op_thread_affinities），为空时使用全局配置；NUMA分组时自动生成
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Session", AdvancedDisplay)
+	FString IntraOpThreadAffinities;
+
+	// 后台会话（影子候选模型）：算子内线程数减半，会话自己的线程以低于正常的优先级运行，不与生产会话争抢CPU
+	// 使用全局线程池时线程由所有会话共享，只有减少线程数这一项生效
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Session", AdvancedDisplay)
+	bool bLowPriorityThreads = false;
+
+	// 本机自动调优结果（Saved/Onnx/Autotune.ini）的使用方式，应用时覆盖线程数、执行模式、自旋策略和副本数
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Session|Autotune")
+	EOnnxAutotuneMode AutotuneMode = EOnnxAutotuneMode::ApplyIfAvailable;
+
+	// 量化模型的会话配置（对浮点模型没有影响）
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Session|Quantization")
+	FOnnxQuantizationSettings Quantization;
+
+	// 实际使用的算子内线程数（后台会话减半，至少为1）
+	int32 GetEffectiveIntraOpThreads() const;
+
+	// 将配置应用到会话选项
+	void ApplyTo(Ort::SessionOptions& SessionOptions) const;
+
+	// 转换为与引擎无关的OnnxCore配置（解析全局线程亲和性，不包含执行提供程序）
+	OnnxCore::FSessionConfig ToCoreConfig() const;
+
+	// 用于日志和报告的简短描述
+	FString ToString() const;
+};
@@ -0,0 +1,174 @@
+// OnnxShadow.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+
+#include <atomic>
+
+#include "OnnxShadow.generated.h"
+
+class UOnnxModelAsset;
+
+/**
+ * 影子模式配置：把一部分线上请求镜像给候选模型，在低优先级线程上运行并与生产模型比较。
+ * 候选模型的结果永远不会返回给调用方。
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxShadowConfig
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Shadow")
+	bool bEnabled = false;
+
+	// 候选模型（通用组件）：资产优先，否则使用文件路径
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Shadow", meta = (EditCondition = "bEnabled"))
+	UOnnxModelAsset* CandidateModel = nullptr;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Shadow", meta = (EditCondition = "bEnabled"))
+	FString CandidateModelPath;
+
+	// 候选SAM2编码器/解码器（SAM2组件，相对项目目录）
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Shadow", meta = (EditCondition = "bEnabled"))
+	FString CandidateSam2EncoderPath;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Shadow", meta = (EditCondition = "bEnabled"))
+	FString CandidateSam2DecoderPath;
+
+	// 被镜像的请求比例
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Shadow", meta = (EditCondition = "bEnabled", ClampMin = "0.0", ClampMax = "1.0"))
+	float SampleRate = 0.1f;
+
+	// 同时在运行的影子请求上限，超过时丢弃新的镜像请求而不是排队（SAM2固定为1）
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Shadow", meta = (EditCondition = "bEnabled", ClampMin = "1"))
+	int32 MaxInFlight = 1;
+
+	// 计算掩码IoU时的二值化阈值（SAM2输出为sigmoid后的概率）
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Shadow", meta = (EditCondition = "bEnabled"))
+	float MaskThreshold = 0.5f;
+};
+
+/**
+ * 影子比较报告
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxShadowReport
+{
+	GENERATED_BODY()
+
+	// 完成比较的请求数
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Shadow")
+	int32 NumCompared = 0;
+
+	// 被采样但因为影子请求已满而丢弃的请求数
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Shadow")
+	int32 NumDropped = 0;
+
+	// 候选模型运行失败、输出大小不一致或输出无法按float比较的请求数
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Shadow")
+	int32 NumFailed = 0;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Shadow")
+	float ProductionMeanMs = 0.0f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Shadow")
+	float CandidateMeanMs = 0.0f;
+
+	// 候选 - 生产的延迟差（毫秒），正值表示候选更慢
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Shadow")
+	float MeanLatencyDeltaMs = 0.0f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Shadow")
+	float P95LatencyDeltaMs = 0.0f;
+
+	// 输出的相对L2差异 ||candidate - production|| / ||production||
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Shadow")
+	float MeanRelativeL2 = 0.0f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Shadow")
+	float MaxRelativeL2 = 0.0f;
+
+	// 掩码IoU（仅SAM2），没有掩码样本时为-1
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Shadow")
+	float MeanMaskIoU = -1.0f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ONNX Shadow")
+	float MinMaskIoU = -1.0f;
+
+	FString ToString() const;
+};
+
+/**
+ * 一次影子比较的结果
+ */
+struct CLOTH_API FOnnxShadowSample
+{
+	bool bSucceeded = false;
+	double ProductionSeconds = 0.0;
+	double CandidateSeconds = 0.0;
+	float RelativeL2 = 0.0f;
+
+	// 负值表示没有掩码
+	float MaskIoU = -1.0f;
+};
+
+/**
+ * FOnnxShadowRunner
+ * 影子模式的调度与统计：按采样率决定是否镜像请求，在低优先级后台线程上运行候选任务，汇总延迟差和输出差异。
+ * 析构时等待所有进行中的影子任务完成，候选模型必须在它之后销毁。
+ */
+class CLOTH_API FOnnxShadowRunner
+{
+public:
+	// 候选任务：在后台线程上运行候选模型并填写Sample（ProductionSeconds已经填好）
+	typedef TFunction<void(FOnnxShadowSample& Sample)> FCandidateJob;
+
+	explicit FOnnxShadowRunner(const FOnnxShadowConfig& InConfig);
+	~FOnnxShadowRunner();
+
+	// 当前请求是否应该被镜像。返回true时调用方必须随后调用Submit。
+	bool ShouldMirror();
+
+	// 提交候选任务（输入输出需要由任务自己持有副本）
+	void Submit(double ProductionSeconds, FCandidateJob Job);
+
+	FOnnxShadowReport GetReport() const;
+	void LogReport() const;
+	void ResetReport();
+
+	const FOnnxShadowConfig& GetConfig() const { return config_; }
+
+	// 相对L2差异，大小不一致时返回负值
+	static float ComputeRelativeL2(const TArray<float>& Candidate, const TArray<float>& Production);
+
+	// 按阈值二值化后的IoU，两者都为空时为1
+	static float ComputeMaskIoU(const TArray<float>& Candidate, const TArray<float>& Production, float Threshold);
+
+private:
+	FOnnxShadowRunner(const FOnnxShadowRunner&) = delete;
+	FOnnxShadowRunner& operator=(const FOnnxShadowRunner&) = delete;
+
+	void RecordSample(const FOnnxShadowSample& Sample);
+
+	FOnnxShadowConfig config_;
+	std::atomic<int32> inFlight_{0};
+	std::atomic<int32> numDropped_{0};
+
+	// 汇总统计
+	mutable FCriticalSection statsMutex_;
+	int32 numCompared_ = 0;
+	int32 numFailed_ = 0;
+	double sumProductionSeconds_ = 0.0;
+	double sumCandidateSeconds_ = 0.0;
+	double sumRelativeL2_ = 0.0;
+	float maxRelativeL2_ = 0.0f;
+	int32 numMaskSamples_ = 0;
+	double sumMaskIoU_ = 0.0;
+	float minMaskIoU_ = 1.0f;
+
+	// 最近的延迟差（毫秒，环形缓冲区），用于计算P95
+	TArray<float> latencyDeltasMs_;
+	int32 deltaCursor_ = 0;
+};
@@ -0,0 +1,145 @@
+// OnnxShapeBucketing.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+
+// 包含ONNX Runtime的实现头文件
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#endif
+#include "onnxruntime_cxx_api.h"
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
+
+#include <string>
+
+#include "OnnxScratch.h"
+#include "OnnxShapeBucketing.generated.h"
+
+/**
+ * 一个按桶对齐的动态维度
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxBucketedDimension
+{
+	GENERATED_BODY()
+
+	// 输入张量上的维度下标
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Bucketing", meta = (ClampMin = "0"))
+	int32 InputAxis = 1;
+
+	// 输出张量上对应的维度下标，-1表示与InputAxis相同；输出按比例裁剪回实际大小
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Bucketing", meta = (ClampMin = "-1"))
+	int32 OutputAxis = -1;
+
+	// 桶大小（升序），输入会被填充到不小于实际大小的最小桶；超过最大桶的请求不分桶，按原形状运行
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Bucketing")
+	TArray<int32> BucketSizes;
+};
+
+/**
+ * 动态形状模型的分桶策略：让输入形状只在少数几个桶之间变化，
+ * 使ORT的内存规划可以复用，每个桶保留自己预分配的输入/输出缓冲区。
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxShapeBucketingPolicy
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Bucketing")
+	bool bEnabled = false;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Bucketing", meta = (EditCondition = "bEnabled"))
+	TArray<FOnnxBucketedDimension> Dimensions;
+
+	// 填充区域的值
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Bucketing", meta = (EditCondition = "bEnabled"))
+	float PaddingValue = 0.0f;
+
+	// 模型的掩码输入名称（例如attention_mask），为空时不提供掩码。
+	// 掩码形状为填充后输入形状的前(最大InputAxis+1)维，有效位置为1，填充位置为0。
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX Bucketing", meta = (EditCondition = "bEnabled"))
+	FString MaskInputName;
+};
+
+/**
+ * 一个桶的预分配缓冲区
+ */
+struct CLOTH_API FOnnxShapeBucket
+{
+	TArray<int64> InputShape;
+	TArray<float> InputBuffer;
+
+	TArray<int64> MaskShape;
+	TArray<uint8> MaskBuffer;
+
+	// 按Run的要求连续存放：[0]为输入张量，[1]为掩码张量（有掩码时）
+	Ort::Value InputTensors[2] = { Ort::Value(nullptr), Ort::Value(nullptr) };
+
+	// 首次运行后按实际输出形状分配
+	TArray<int64> OutputShape;
+	TArray<float> OutputBuffer;
+	Ort::Value OutputTensor{nullptr};
+
+	// 输出形状随数据变化（预分配的输出曾被ORT拒绝），之后该桶总是由ORT分配输出
+	bool bVariableOutputShape = false;
+
+	// 同一时间只有一个请求能使用该桶的缓冲区
+	FCriticalSection InUse;
+
+	int64 NumRuns = 0;
+};
+
+/**
+ * FOnnxShapeBucketCache
+ * 分桶策略的运行时部分：选择桶、填充输入、生成掩码、运行并把输出裁剪回实际形状。
+ */
+class CLOTH_API FOnnxShapeBucketCache
+{
+public:
+	// 根据策略和会话的输入元数据初始化（会话只用于查询掩码输入的类型）。
+	// 分桶只支持float32的输入和输出，InputType/OutputType是模型普通输入/输出的元素类型，其他类型时关闭分桶
+	void Initialize(const FOnnxShapeBucketingPolicy& InPolicy, Ort::Session& Session,
+					ONNXTensorElementDataType InputType, ONNXTensorElementDataType OutputType);
+
+	bool IsEnabled() const { return policy_.bEnabled && policy_.Dimensions.Num() > 0; }
+
+	// 计算实际形状所属的桶。任何一个分桶维度超出它的最大桶时返回false（按原形状运行，不创建新桶）
+	bool ComputeBucketShape(TConstArrayView<int64> Shape, FOnnxInlineShape& OutBucketShape) const;
+
+	/**
+	 * 以分桶方式运行单输入单输出的浮点模型。
+	 * 不适用（不需要分桶，或该桶的缓冲区正被其他请求使用）时返回false，调用方应按原形状运行。
+	 * ORT错误以Ort::Exception抛出。
+	 */
+	bool TryRun(Ort::Session& Session, const char* InputName, const char* OutputName,
+				const TArray<float>& InputData, TConstArrayView<int64> InputShape,
+				TArray<float>& OutputData, TArray<int64>& OutputShape);
+
+	// 释放所有桶的缓冲区
+	void Reset();
+
+	int32 GetNumBuckets() const;
+	int64 GetBufferBytes() const;
+
+	// 在两个行主序张量之间复制Region大小的左上角区域
+	static void CopyRegion(const float* Src, TConstArrayView<int64> SrcShape, float* Dst, TConstArrayView<int64> DstShape, TConstArrayView<int64> Region);
+
+private:
+	FOnnxShapeBucket& FindOrCreateBucket(TConstArrayView<int64> BucketShape);
+	void FillMask(FOnnxShapeBucket& Bucket, TConstArrayView<int64> ActualShape) const;
+
+	FOnnxShapeBucketingPolicy policy_;
+
+	// 掩码输入（模型中存在时）
+	std::string maskInputName_;
+	ONNXTensorElementDataType maskElementType_ = ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+	int32 maskRank_ = 0;
+
+	// 桶的数量很少，按形状线性查找，推理路径上不需要构造查找键
+	mutable FCriticalSection bucketsMutex_;
+	TArray<TUniquePtr<FOnnxShapeBucket>> buckets_;
+};
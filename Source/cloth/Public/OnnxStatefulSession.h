@@ -0,0 +1,135 @@
+// OnnxStatefulSession.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+
+// 包含ONNX Runtime的实现头文件
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#endif
+#include "onnxruntime_cxx_api.h"
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
+
+#include <string>
+#include <vector>
+
+#include "OnnxStatefulSession.generated.h"
+
+/**
+ * 一对在调用之间传递的状态张量（例如GRU的h_in/h_out）
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxStateTensorPair
+{
+	GENERATED_BODY()
+
+	// 接收上一步状态的模型输入
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX State")
+	FString InputName;
+
+	// 产生下一步状态的模型输出
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX State")
+	FString OutputName;
+
+	// 状态形状，为空时从模型元数据读取（动态维度取1）
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX State")
+	TArray<int32> Shape;
+
+	// 重置时的初始值
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX State")
+	float InitialValue = 0.0f;
+};
+
+/**
+ * 单个状态张量的快照数据
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxStateTensorData
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX State")
+	FString InputName;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX State")
+	TArray<float> Data;
+};
+
+/**
+ * 所有状态张量在某一步的快照，可以用于回退或在实例之间复制状态
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxStateSnapshot
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX State")
+	TArray<FOnnxStateTensorData> Tensors;
+
+	// 快照时已经执行的步数
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX State")
+	int64 StepCount = 0;
+};
+
+/**
+ * FOnnxStateBindings
+ * 有状态模型的状态张量绑定。每个状态持有两个预分配的缓冲区并绑定为Ort::Value：
+ * 一个作为本步的状态输入，另一个作为本步的状态输出，运行后交换角色（乒乓），
+ * 因此每一步只需要提供新的输入，状态不经过TArray拷贝。
+ * 状态缓冲区独立于会话，会话被驻留管理器驱逐并重新加载后状态仍然保留。
+ */
+class CLOTH_API FOnnxStateBindings
+{
+public:
+	// 根据会话的元数据分配状态缓冲区，名称不存在或类型不是float时返回false
+	bool Initialize(const TArray<FOnnxStateTensorPair>& InPairs, Ort::Session& Session);
+
+	bool IsEnabled() const { return states_.Num() > 0; }
+
+	// 是否是状态输入/输出（用于确定模型的普通输入/输出）
+	bool IsStateInput(const FString& Name) const;
+	bool IsStateOutput(const FString& Name) const;
+
+	/**
+	 * 运行一步：普通输入 + 当前状态 -> 普通输出 + 下一步状态，然后交换缓冲区。
+	 * ORT错误以Ort::Exception抛出，失败时状态保持不变。
+	 */
+	bool Run(Ort::Session& Session, const char* InputName, const Ort::Value& InputTensor,
+			 const char* OutputName, TArray<float>& OutputData, TArray<int64>* OutOutputShape);
+
+	// 把所有状态恢复为初始值
+	void Reset();
+
+	FOnnxStateSnapshot Snapshot() const;
+
+	// 从快照恢复，名称或大小不匹配时返回false且不修改任何状态
+	bool Restore(const FOnnxStateSnapshot& InSnapshot);
+
+	int64 GetStepCount() const { return stepCount_; }
+
+private:
+	struct FState
+	{
+		FOnnxStateTensorPair Pair;
+		std::string InputNameUtf8;
+		std::string OutputNameUtf8;
+		std::vector<int64_t> Shape;
+
+		// 乒乓缓冲区及绑定在其上的张量
+		TArray<float> Buffers[2];
+		Ort::Value Tensors[2] = { Ort::Value(nullptr), Ort::Value(nullptr) };
+	};
+
+	TArray<TUniquePtr<FState>> states_;
+
+	// 当前作为状态输入的缓冲区下标
+	int32 current_ = 0;
+	int64 stepCount_ = 0;
+
+	// 状态在调用之间共享，同一时间只能运行一步
+	mutable FCriticalSection mutex_;
+};
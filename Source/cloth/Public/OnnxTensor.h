@@ -0,0 +1,205 @@
+// OnnxTensor.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "OnnxScratch.h"
+
+// 包含ONNX Runtime的实现头文件
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#endif
+#include "onnxruntime_cxx_api.h"
+#if PLATFORM_WINDOWS && PLATFORM_64BITS
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
+
+#include <type_traits>
+
+#include "OnnxTensor.generated.h"
+
+/**
+ * 张量的元素类型
+ */
+UENUM(BlueprintType)
+enum class EOnnxTensorType : uint8
+{
+	Float,
+	Half,
+	Int64,
+	Int32,
+	UInt8
+};
+
+// 张量存储（池化的块、接管的Ort::Value或外部内存），在OnnxTensor.cpp中定义
+struct FOnnxTensorStorage;
+
+/**
+ * FOnnxTensor
+ * 带形状和元素类型的张量，用于在API边界上传递数据而不复制。
+ * 存储按引用计数共享：复制、切片和改变形状都只复制句柄；Allocate/Clone从FOnnxTensorPool取得64字节对齐的块，
+ * 最后一个引用释放时块回到池中。ToOrtValue直接引用存储，AdoptOrtValue接管ORT分配的输出，两个方向都不复制。
+ * Wrap创建引用外部内存的非拥有视图，调用方保证内存比所有引用它的张量活得更久。
+ *
+ * 数据按共享语义访问：多个句柄可能引用同一块存储，需要独立修改时先Clone。
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxTensor
+{
+	GENERATED_BODY()
+
+public:
+	FOnnxTensor() = default;
+
+	// 从池中分配（内容未初始化，bZeroed为true时清零）
+	static FOnnxTensor Allocate(EOnnxTensorType Type, TConstArrayView<int64> Shape, bool bZeroed = false);
+
+	// 分配并复制数据，元素数必须与形状一致
+	static FOnnxTensor FromArray(TConstArrayView<float> Data, TConstArrayView<int64> Shape);
+
+	// 引用外部内存的非拥有视图
+	static FOnnxTensor Wrap(void* Data, EOnnxTensorType Type, TConstArrayView<int64> Shape);
+	static FOnnxTensor Wrap(TArrayView<float> Data, TConstArrayView<int64> Shape);
+
+	// 接管Ort::Value（通常是Run的输出），不复制。不是张量或元素类型不支持时返回无效张量，Value保持不变
+	static FOnnxTensor AdoptOrtValue(Ort::Value& Value);
+
+	bool IsValid() const { return data_ != nullptr; }
+
+	// 是否引用外部内存（Wrap创建，或从这样的张量切片）
+	bool IsView() const;
+
+	EOnnxTensorType GetType() const { return type_; }
+	ONNXTensorElementDataType GetOrtType() const { return ToOrtType(type_); }
+	TConstArrayView<int64> GetShape() const { return shape_; }
+	int64 GetElementCount() const;
+	int64 GetSizeBytes() const { return GetElementCount() * GetElementSize(type_); }
+
+	// 原始数据；类型化访问在类型不匹配时返回空视图
+	void* GetRawData() const { return data_; }
+	template <typename T> TArrayView<T> GetData() const;
+
+	// 沿第一维取[Start, Start + Count)，与原张量共享存储
+	FOnnxTensor Slice(int64 Start, int64 Count) const;
+
+	// 改变形状（元素数必须相同，可以有一个-1由元素数推算），与原张量共享存储
+	FOnnxTensor Reshape(TConstArrayView<int64> NewShape) const;
+
+	// 复制到新分配的池化存储
+	FOnnxTensor Clone() const;
+
+	// 转换元素类型（只支持Float与Half之间），类型相同时返回共享存储的自身
+	FOnnxTensor ConvertTo(EOnnxTensorType NewType) const;
+
+	// 读取为float（Half会被转换），其他类型返回false
+	bool CopyToFloat(TArray<float>& OutData) const;
+
+	// 引用本张量存储的Ort::Value，张量（或它的任何副本）必须比Ort::Value活得更久
+	Ort::Value ToOrtValue() const;
+
+	// 元素类型的字节数，以及与ORT元素类型的对应（FromOrtType在类型不支持时返回false）
+	static int32 GetElementSize(EOnnxTensorType Type);
+	static ONNXTensorElementDataType ToOrtType(EOnnxTensorType Type);
+	static bool FromOrtType(ONNXTensorElementDataType OrtType, EOnnxTensorType& OutType);
+
+	// 形状的元素数，含负数维度时返回-1
+	static int64 GetElementCount(TConstArrayView<int64> Shape);
+
+private:
+	TSharedPtr<FOnnxTensorStorage, ESPMode::ThreadSafe> storage_;
+	uint8* data_ = nullptr;
+	FOnnxInlineShape shape_;
+	EOnnxTensorType type_ = EOnnxTensorType::Float;
+};
+
+template <typename T>
+TArrayView<T> FOnnxTensor::GetData() const
+{
+	static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8, "unsupported tensor element type");
+
+	bool bMatches = false;
+	if constexpr (std::is_same_v<std::remove_const_t<T>, float>)
+	{
+		bMatches = type_ == EOnnxTensorType::Float;
+	}
+	else if constexpr (std::is_same_v<std::remove_const_t<T>, uint16>)
+	{
+		bMatches = type_ == EOnnxTensorType::Half;
+	}
+	else if constexpr (std::is_same_v<std::remove_const_t<T>, int64>)
+	{
+		bMatches = type_ == EOnnxTensorType::Int64;
+	}
+	else if constexpr (std::is_same_v<std::remove_const_t<T>, int32>)
+	{
+		bMatches = type_ == EOnnxTensorType::Int32;
+	}
+	else if constexpr (std::is_same_v<std::remove_const_t<T>, uint8>)
+	{
+		bMatches = type_ == EOnnxTensorType::UInt8;
+	}
+	return bMatches && data_ ? TArrayView<T>(reinterpret_cast<T*>(data_), static_cast<int32>(GetElementCount())) : TArrayView<T>();
+}
+
+/**
+ * 张量池的统计
+ */
+struct CLOTH_API FOnnxTensorPoolStats
+{
+	// 池中空闲的块数和字节数
+	int32 NumCachedBlocks = 0;
+	int64 CachedBytes = 0;
+
+	// 正在被张量使用的字节数（按大小类取整后）及其峰值
+	int64 LiveBytes = 0;
+	int64 PeakLiveBytes = 0;
+
+	// 分配命中空闲块 / 需要新分配的次数
+	int64 Hits = 0;
+	int64 Misses = 0;
+};
+
+/**
+ * FOnnxTensorPool
+ * 张量存储的按大小分类的块池。请求的大小向上取整到大小类（每个二次幂区间4个类，浪费不超过25%），
+ * 释放的块按大小类缓存，同一大小的张量在稳定状态下不再分配。块经由FMemory分配，按64字节对齐（AVX-512的向量宽度）。
+ * 空闲块超过[OnnxRuntime] TensorPoolMaxCachedMB（默认256）时直接释放。
+ */
+class CLOTH_API FOnnxTensorPool
+{
+public:
+	static constexpr int64 Alignment = 64;
+
+	static FOnnxTensorPool& Get();
+
+	// 分配至少Bytes字节的块，OutBlockBytes返回块的实际大小（释放时传回）
+	void* Allocate(int64 Bytes, int64& OutBlockBytes);
+	void Free(void* Block, int64 BlockBytes);
+
+	// 释放所有空闲块
+	void Trim();
+
+	FOnnxTensorPoolStats GetStats() const;
+
+	// 输出统计和每个大小类的空闲块（onnx.TensorPool）
+	void Dump(FOutputDevice& Ar) const;
+
+	// Bytes所属大小类的块大小
+	static int64 GetBlockSize(int64 Bytes);
+
+private:
+	FOnnxTensorPool();
+
+	mutable FCriticalSection mutex_;
+
+	// 块大小 -> 空闲块
+	TMap<int64, TArray<void*>> freeBlocks_;
+
+	int64 maxCachedBytes_ = 256 * 1024 * 1024;
+	int64 cachedBytes_ = 0;
+	int64 liveBytes_ = 0;
+	int64 peakLiveBytes_ = 0;
+	int64 hits_ = 0;
+	int64 misses_ = 0;
+};
@@ -0,0 +1,59 @@
+// OnnxTensorLibrary.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "OnnxTensor.h"
+#include "OnnxTensorLibrary.generated.h"
+
+/**
+ * UOnnxTensorLibrary
+ * FOnnxTensor的蓝图函数：创建、读取、切片和改变形状。张量按引用共享存储，切片和改变形状不复制数据。
+ */
+UCLASS()
+class CLOTH_API UOnnxTensorLibrary : public UBlueprintFunctionLibrary
+{
+	GENERATED_BODY()
+
+public:
+	// 从float数组创建张量（复制数据），元素数与形状不一致时返回无效张量
+	UFUNCTION(BlueprintCallable, Category = "ONNX Tensor")
+	static FOnnxTensor MakeTensor(const TArray<float>& Data, const TArray<int64>& Shape);
+
+	// 创建清零的张量
+	UFUNCTION(BlueprintCallable, Category = "ONNX Tensor")
+	static FOnnxTensor MakeZeroTensor(EOnnxTensorType Type, const TArray<int64>& Shape);
+
+	// 读取为float数组（Half会被转换），其他类型返回false
+	UFUNCTION(BlueprintCallable, Category = "ONNX Tensor")
+	static bool TensorToFloatArray(const FOnnxTensor& Tensor, TArray<float>& OutData);
+
+	UFUNCTION(BlueprintPure, Category = "ONNX Tensor")
+	static TArray<int64> GetTensorShape(const FOnnxTensor& Tensor);
+
+	UFUNCTION(BlueprintPure, Category = "ONNX Tensor")
+	static int64 GetTensorElementCount(const FOnnxTensor& Tensor);
+
+	UFUNCTION(BlueprintPure, Category = "ONNX Tensor")
+	static EOnnxTensorType GetTensorType(const FOnnxTensor& Tensor);
+
+	UFUNCTION(BlueprintPure, Category = "ONNX Tensor")
+	static bool IsTensorValid(const FOnnxTensor& Tensor);
+
+	// 沿第一维取[Start, Start + Count)，与原张量共享存储
+	UFUNCTION(BlueprintCallable, Category = "ONNX Tensor")
+	static FOnnxTensor SliceTensor(const FOnnxTensor& Tensor, int64 Start, int64 Count);
+
+	// 改变形状（可以有一个-1），与原张量共享存储
+	UFUNCTION(BlueprintCallable, Category = "ONNX Tensor")
+	static FOnnxTensor ReshapeTensor(const FOnnxTensor& Tensor, const TArray<int64>& NewShape);
+
+	// 在Float与Half之间转换
+	UFUNCTION(BlueprintCallable, Category = "ONNX Tensor")
+	static FOnnxTensor ConvertTensor(const FOnnxTensor& Tensor, EOnnxTensorType NewType);
+
+	// 释放张量池中的空闲块（例如关卡切换之后）
+	UFUNCTION(BlueprintCallable, Category = "ONNX Tensor")
+	static void TrimTensorPool();
+};
@@ -0,0 +1,106 @@
+// OnnxTuning.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "OnnxSessionSettings.h"
+
+/**
+ * FOnnxTuning
+ * 运行时调优用的onnx.*控制台变量，不需要重新编译或重启即可在线上服务器上做性能A/B测试。
+ *
+ * 会话级变量（变化后各模型在后台线程上按新配置重建会话，排空进行中的请求后换入）：
+ *   onnx.IntraOpThreads       算子内线程数，0表示沿用资产/调优配置
+ *   onnx.InterOpThreads       算子间线程数，-1表示沿用
+ *   onnx.ExecutionMode        -1沿用，0 Sequential，1 Parallel
+ *   onnx.SpinMode             -1沿用，0 Default，1 SpinThenStop，2 NoSpin
+ *   onnx.ReplicasPerNumaNode  -1沿用，0关闭NUMA副本组
+ *
+ * 立即生效的变量（-1表示沿用配置文件/组件的设置）：
+ *   onnx.ResidencyBudgetMB          模型驻留预算
+ *   onnx.MaxCachedChunkMB           插件分配器的空闲块缓存上限
+ *   onnx.Shadow.SampleRate          影子模式的采样率
+ *   onnx.Sam2.HalfPrecisionFeatures SAM2编码器特征的缓存精度（0 fp32，1 fp16），切换时丢弃已缓存的特征
+ *   onnx.Registry.GraceSeconds      模型注册表中没有句柄的实例保留多久
+ *
+ * 控制台命令：onnx.Tuning 输出变量和每个模型当前的配置，onnx.RebuildSessions 强制重建所有会话。
+ *
+ * 线程数、自旋策略和SAM2特征精度带ECVF_Scalability标志，可以写在Scalability.ini的分组中，
+ * 所有变量都可以由设备配置文件设置：
+ *   [EffectsQuality@0]
+ *   onnx.IntraOpThreads=2
+ *   onnx.Sam2.HalfPrecisionFeatures=1
+ *
+ *   [LinuxServer DeviceProfile]
+ *   +CVars=onnx.IntraOpThreads=8
+ *   +CVars=onnx.SpinMode=2
+ */
+class CLOTH_API FOnnxTuning
+{
+public:
+	// 把会话级变量覆盖到Settings上（未设置的变量不修改对应项）
+	static FOnnxSessionSettings ApplySessionOverrides(const FOnnxSessionSettings& Settings);
+
+	// 两份配置创建的会话是否相同
+	static bool SessionSettingsEqual(const FOnnxSessionSettings& A, const FOnnxSessionSettings& B);
+
+	// 立即生效的变量：未设置时返回Default
+	static int32 GetResidencyBudgetMB(int32 Default);
+	static int32 GetMaxCachedChunkMB(int32 Default);
+	static float GetShadowSampleRate(float Default);
+	static bool GetSam2HalfPrecisionFeatures(bool Default);
+	static float GetRegistryGraceSeconds(float Default);
+
+	// 输出变量的当前值和每个已登记模型的配置（onnx.Tuning）
+	static void Dump(FOutputDevice& Ar);
+};
+
+/**
+ * FOnnxTuningListener
+ * 模型实例在调优变量通知中的登记项。会话级变量或SAM2特征精度变化时，在后台线程上调用重建回调；
+ * 同一登记项的回调不会并发，执行期间的多次变化合并为一次（回调读取的总是最新的值）。
+ * 所属实例的析构函数必须先调用Unregister，它会等待进行中的回调完成。
+ */
+class CLOTH_API FOnnxTuningListener
+{
+public:
+	// 按当前变量重建会话；bForce为true时（onnx.RebuildSessions）配置未变化也重建
+	typedef TFunction<void(bool bForce)> FRebuildFunction;
+
+	// 当前配置的简短描述（onnx.Tuning）
+	typedef TFunction<FString()> FDescribeFunction;
+
+	FOnnxTuningListener() = default;
+	~FOnnxTuningListener();
+
+	FOnnxTuningListener(const FOnnxTuningListener&) = delete;
+	FOnnxTuningListener& operator=(const FOnnxTuningListener&) = delete;
+
+	void Register(const FString& InName, FRebuildFunction InRebuild, FDescribeFunction InDescribe);
+	void Unregister();
+
+	bool IsRegistered() const { return bRegistered_; }
+
+	// 请求一次后台重建
+	void RequestRebuild(bool bForce);
+
+private:
+	friend class FOnnxTuning;
+
+	void RunPending();
+
+	FString name_;
+	FRebuildFunction rebuild_;
+	FDescribeFunction describe_;
+	bool bRegistered_ = false;
+
+	bool IsRunning() const;
+
+	// 以下三个标志只在stateMutex_下读写：检查是否还有请求和清除bRunning_必须是一步，
+	// 否则Unregister可能在后台任务最后一次读取bPending_之前返回并释放登记项
+	mutable FCriticalSection stateMutex_;
+	bool bPending_ = false;
+	bool bForcePending_ = false;
+	bool bRunning_ = false;
+};
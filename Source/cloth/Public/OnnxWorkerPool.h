@@ -0,0 +1,239 @@
+// OnnxWorkerPool.h
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+#include "HAL/CriticalSection.h"
+#include "HAL/PlatformProcess.h"
+#include "OnnxSessionSettings.h"
+#include "OnnxCoreWorkerChannel.h"
+#include "OnnxWorkerPool.generated.h"
+
+/**
+ * 进程外推理的配置（资产和SAM2组件上各一份）
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxWorkerSettings
+{
+	GENERATED_BODY()
+
+	// 在本地工作进程（OnnxWorker）中运行推理：ORT崩溃或内存耗尽只结束工作进程，它会被自动重启，
+	// 工作进程的线程池也与引擎的线程完全隔离。会话在工作进程中创建，只支持CPU执行提供程序。
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX|Workers")
+	bool bEnabled = false;
+
+	// 常驻的工作进程数
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX|Workers", meta = (ClampMin = "1", EditCondition = "bEnabled"))
+	int32 MinWorkers = 1;
+
+	// 所有工作进程都在处理请求时按需增加，最多到这个数量
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX|Workers", meta = (ClampMin = "1", EditCondition = "bEnabled"))
+	int32 MaxWorkers = 2;
+
+	// 每个工作进程可以排队的请求数（共享内存中的槽数）
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX|Workers", meta = (ClampMin = "1", ClampMax = "64", EditCondition = "bEnabled"))
+	int32 SlotsPerWorker = 2;
+
+	// 每个槽的数据区大小，必须能容纳一次请求的全部输入（以及全部输出）
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX|Workers", meta = (ClampMin = "1", EditCondition = "bEnabled"))
+	int32 SlotSizeMB = 64;
+
+	// 超过MinWorkers的工作进程空闲这么久之后退出
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX|Workers", meta = (ClampMin = "0", EditCondition = "bEnabled"))
+	float IdleSecondsBeforeRetire = 30.0f;
+
+	// 单个请求的超时，超时的工作进程视为挂起，结束后重启
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX|Workers", meta = (ClampMin = "0.1", EditCondition = "bEnabled"))
+	float RequestTimeoutSeconds = 30.0f;
+
+	// 一分钟内最多重启的次数，超过后不再重启（模型本身有问题时避免反复崩溃）
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX|Workers", meta = (ClampMin = "0", EditCondition = "bEnabled"))
+	int32 MaxRestartsPerMinute = 5;
+
+	// 每个工作进程绑定的CPU集合（"0-3"、"4-7,12"），第i个工作进程使用第i % N项，为空时不绑定。只在Linux上生效。
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ONNX|Workers", meta = (EditCondition = "bEnabled"))
+	TArray<FString> CpuSets;
+};
+
+/**
+ * 工作进程池的统计
+ */
+USTRUCT(BlueprintType)
+struct CLOTH_API FOnnxWorkerPoolStats
+{
+	GENERATED_BODY()
+
+	// 当前就绪的工作进程数
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX|Workers")
+	int32 NumWorkers = 0;
+
+	// 正在启动的工作进程数
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX|Workers")
+	int32 NumStarting = 0;
+
+	// 进行中的请求数
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX|Workers")
+	int32 NumInFlight = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX|Workers")
+	int64 CompletedRequests = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX|Workers")
+	int64 FailedRequests = 0;
+
+	// 崩溃或超时后的重启次数
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX|Workers")
+	int32 Restarts = 0;
+
+	// 空闲退出的次数
+	UPROPERTY(BlueprintReadOnly, Category = "ONNX|Workers")
+	int32 Retired = 0;
+};
+
+/**
+ * FOnnxWorkerPool
+ * 同一个模型的一组本地工作进程。每个工作进程有一个共享内存通道，请求直接在通道的槽中读写张量。
+ * 请求分派给进行中请求最少的工作进程；所有进程都忙时在后台启动新进程（最多MaxWorkers），
+ * 多余的进程空闲一段时间后退出。崩溃、加载失败或请求超时的进程被结束并在后台重启。
+ */
+class CLOTH_API FOnnxWorkerPool
+{
+	struct FWorker;
+	typedef TSharedPtr<FWorker, ESPMode::ThreadSafe> FWorkerPtr;
+
+public:
+	FOnnxWorkerPool() = default;
+	~FOnnxWorkerPool();
+
+	FOnnxWorkerPool(const FOnnxWorkerPool&) = delete;
+	FOnnxWorkerPool& operator=(const FOnnxWorkerPool&) = delete;
+
+	// 启动MinWorkers个工作进程并等待它们加载模型（工作进程按路径加载，ORT在模型旁查找外部数据）。
+	// 工作进程可执行文件不存在或第一个进程加载失败时返回false。
+	bool Start(const FString& InModelPath, const FOnnxSessionSettings& InSessionSettings, const FOnnxWorkerSettings& InWorkerSettings,
+			   const FString& InDisplayName);
+
+	// 结束所有工作进程（等待进行中的请求和后台启动完成）
+	void Stop();
+
+	bool IsRunning() const { return bRunning_; }
+
+	// 模型的输入/输出元数据（来自第一个就绪的工作进程），按名称查找时找不到返回INDEX_NONE
+	int32 GetNumInputs() const { return inputs_.Num(); }
+	int32 GetNumOutputs() const { return outputs_.Num(); }
+	const OnnxCore::FWorkerNodeInfo& GetInputInfo(int32 Index) const { return inputs_[Index]; }
+	const OnnxCore::FWorkerNodeInfo& GetOutputInfo(int32 Index) const { return outputs_[Index]; }
+	int32 FindInput(const char* Name) const;
+	int32 FindOutput(const char* Name) const;
+
+	FOnnxWorkerPoolStats GetStats() const;
+
+	// 会话配置变化（onnx.*控制台变量）后按新配置逐个替换工作进程
+	void Restart(const FOnnxSessionSettings& InSessionSettings);
+
+	// 工作进程可执行文件：[OnnxRuntime] WorkerExecutable（Engine.ini，相对项目目录），默认为插件Binaries/<平台>/下的OnnxWorker
+	static FString GetWorkerExecutable();
+
+	/**
+	 * 一次请求。构造时在一个工作进程上占用一个槽（所有槽都忙时等待），析构时归还。
+	 * 输入直接写入共享内存（AddInput返回写入地址），Execute之后的输出同样直接引用共享内存。
+	 */
+	class CLOTH_API FRequest
+	{
+	public:
+		explicit FRequest(FOnnxWorkerPool& InPool);
+		~FRequest();
+
+		FRequest(const FRequest&) = delete;
+		FRequest& operator=(const FRequest&) = delete;
+
+		// 占用槽失败（没有可用的工作进程或等待超时）时为false
+		bool IsValid() const { return slot_ != nullptr; }
+
+		// 在槽中为模型的第Index个输入分配空间，返回写入地址；空间不足时返回nullptr
+		void* AddInput(int32 Index, ONNXTensorElementDataType Type, TConstArrayView<int64> Shape);
+
+		// 把已有张量复制到槽中
+		bool AddInput(int32 Index, const Ort::Value& Value);
+
+		// 只计算这些输出（按序号的位掩码），默认计算全部
+		void SetOutputMask(uint64 Mask);
+
+		// 提交并等待结果。工作进程报错、崩溃或超时时返回false，崩溃或超时的进程会被重启
+		bool Execute();
+
+		// Execute成功后的输出：序号（对应GetOutputInfo）和直接引用共享内存的张量，请求析构后失效
+		int32 GetNumOutputs() const;
+		int32 GetOutputIndex(int32 i) const;
+		Ort::Value GetOutput(int32 i) const;
+
+		// 按模型输出序号查找，找不到时返回INDEX_NONE
+		int32 FindOutput(int32 OutputIndex) const;
+
+		// 工作进程内Run的耗时
+		double GetRunMs() const;
+
+	private:
+		FOnnxWorkerPool& pool_;
+		FWorkerPtr worker_;
+		OnnxCore::FWorkerSlot* slot_ = nullptr;
+		uint8* data_ = nullptr;
+		uint64 used_ = 0;
+		bool bExecuted_ = false;
+	};
+
+private:
+	friend class FRequest;
+
+	// 创建通道并启动一个工作进程，等待它加载完成（阻塞，可能需要数秒）
+	FWorkerPtr SpawnWorker(int32 WorkerIndex, const FOnnxSessionSettings& Settings);
+	static void StopWorker(FWorker& Worker, bool bGraceful);
+
+	// 在后台启动一个工作进程（扩容或替换崩溃的进程），调用方持有mutex_
+	void SpawnInBackground(int32 WorkerIndex);
+
+	// 未被使用的最小工作进程序号（决定CpuSets中的项），调用方持有mutex_
+	int32 AllocateWorkerIndex() const;
+
+	// 选择进行中请求最少的就绪进程并占用一个槽位，必要时触发扩容
+	FWorkerPtr AcquireWorker();
+	void ReleaseWorker(const FWorkerPtr& Worker);
+
+	// 崩溃或超时：从池中移除并结束进程，按重启限制在后台替换
+	void HandleWorkerFailure(const FWorkerPtr& Worker, const TCHAR* Reason);
+
+	// 结束空闲超时的多余进程（请求结束时和定时器上检查，池空闲之后也会缩回MinWorkers）
+	void RetireIdleWorkers();
+	bool TickRetire(float DeltaTime);
+
+	FString BuildArguments(const FString& ChannelName, int32 WorkerIndex, const FOnnxSessionSettings& Settings) const;
+
+	mutable FCriticalSection mutex_;
+	TArray<FWorkerPtr> workers_;
+
+	FString modelPath_;
+	FString displayName_;
+	FOnnxSessionSettings sessionSettings_;
+	FOnnxWorkerSettings workerSettings_;
+
+	TArray<OnnxCore::FWorkerNodeInfo> inputs_;
+	TArray<OnnxCore::FWorkerNodeInfo> outputs_;
+
+	// 最近一分钟内的重启时间
+	TArray<double> restartTimes_;
+
+	// 正在后台启动的工作进程序号
+	TArray<int32> startingIndices_;
+
+	// 检查空闲进程的定时器（MaxWorkers大于MinWorkers时注册）
+	FTSTicker::FDelegateHandle retireTickerHandle_;
+
+	std::atomic<int32> numStarting_{0};
+	std::atomic<int32> numInFlight_{0};
+	std::atomic<int64> completedRequests_{0};
+	std::atomic<int64> failedRequests_{0};
+	std::atomic<int32> restarts_{0};
+	std::atomic<int32> retired_{0};
+	std::atomic<bool> bRunning_{false};
+};
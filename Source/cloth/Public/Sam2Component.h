@@ -41,6 +41,30 @@ public:
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SAM2 Settings")
     FString Sam2DecoderPath = TEXT("Content/Model/sam2_hiera_tiny_decoder.onnx");
 
+    // SAM2 Encoder会话配置
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SAM2 Settings")
+    FOnnxSessionSettings Sam2EncoderSettings;
+
+    // SAM2 Decoder会话配置
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SAM2 Settings")
+    FOnnxSessionSettings Sam2DecoderSettings;
+
+    // 以fp16缓存编码器特征（约8MB减半为4MB），fp16导出的解码器直接使用，否则在解码时转换回float
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SAM2 Settings")
+    bool bHalfPrecisionFeatures = false;
+
+    // 在本地工作进程中运行编码器和解码器（各一个工作进程池），编码器的预处理直接写入共享内存
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SAM2 Settings|Workers")
+    FOnnxWorkerSettings Sam2WorkerSettings;
+
+    // SAM2量化变体：ModelPath为编码器，DecoderPath为解码器（为空时沿用上面的基准路径）
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SAM2 Settings|Variants")
+    TArray<FOnnxModelVariant> Sam2Variants;
+
+    // 加载时选择哪个变体，以及比较时的精度阈值（掩码IoU以FP32基准为准）
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SAM2 Settings|Variants")
+    FOnnxVariantSelection Sam2VariantSelection;
+
     // === SAM2专用接口 ===
 
     // SAM2图像分割推理
@@ -51,6 +75,11 @@ public:
     UFUNCTION(BlueprintCallable, Category = "SAM2 Segmentation")
     bool SetImageFromTexture(UTexture2D* Texture, FSam2Input& Sam2Input);
 
+    // 用HWC的Float张量（{Height, Width, 3}或{1, Height, Width, 3}）作为输入图像，推理时直接读取张量存储；
+    // 同时释放ImageData，避免保留默认预分配的1024x1024图像
+    UFUNCTION(BlueprintCallable, Category = "SAM2 Segmentation")
+    bool SetImageFromTensor(const FOnnxTensor& Tensor, UPARAM(ref) FSam2Input& Sam2Input);
+
     // 添加提示点到SAM2输入
     UFUNCTION(BlueprintCallable, Category = "SAM2 Segmentation")
     void AddPromptPoint(UPARAM(ref) FSam2Input& Sam2Input, FVector2D Point, bool bIsForeground = true);
@@ -71,18 +100,47 @@ public:
 
     virtual bool RunInference(const TArray<float>& InputData, TArray<float>& OutputData) override;
     virtual bool IsInitialized() const override;
+    virtual TArray<FOnnxBenchmarkResult> AutotuneThreading(int32 Iterations = 20, bool bTuneReplicas = false) override;
+    virtual EOnnxExecutionProvider GetExecutionProvider() const override;
+    virtual FOnnxResidencyStats GetResidencyStats() const override;
+    virtual FOnnxAllocationStats GetAllocationStats() const override;
+    virtual EOnnxModelPrecision GetModelPrecision() const override;
+    virtual bool StartCapture(const FString& FilePath, const FOnnxCaptureConfig& Config) override;
+    virtual void StopCapture() override;
+
+    // 在样本图像文件夹（.png/.jpg，提示点为图像中心）上比较FP32基准和各个变体的延迟、掩码L2误差和IoU
+    virtual TArray<FOnnxVariantReport> CompareModelVariants(const FString& SampleFolder, int32 Iterations = 10) override;
 
 protected:
-    // SAM2特定推理实例
-    TUniquePtr<FSam2ModelInstance> Sam2Instance;
+    // SAM2特定推理实例（异步基准测试的任务也持有引用）
+    TSharedPtr<FSam2ModelInstance, ESPMode::ThreadSafe> Sam2Instance;
+
+    // 影子模式的候选SAM2实例（由基类的ShadowRunner调度）
+    TUniquePtr<FSam2ModelInstance> ShadowSam2Instance;
+
+    // 加载的变体精度
+    EOnnxModelPrecision Sam2Precision = EOnnxModelPrecision::FP32;
+
+    virtual TFunction<TArray<FOnnxBenchmarkResult>()> MakeSpinBenchmarkJob(const FOnnxBenchmarkParams& Params, int32 IntraOpThreads) const override;
 
     // 重写基类的初始化方法
     virtual bool InitializeModel() override;
+    virtual void InitializeShadow() override;
+    virtual void ResetShadow() override;
 
 private:
     // 初始化SAM2模型
     bool InitializeSam2Model();
 
+    // 变体的编码器/解码器完整路径，变体不存在时返回false
+    bool GetSam2VariantPaths(EOnnxModelPrecision Precision, FString& OutEncoderPath, FString& OutDecoderPath) const;
+
+    // 文件存在的变体精度（不含FP32）
+    TArray<EOnnxModelPrecision> GetAvailableSam2Variants() const;
+
+    // 记录比较结果的键（编码器名称 + 内容哈希）
+    FString MakeSam2VariantKey() const;
+
     // 将UTexture2D转换为浮点数组
     bool ConvertTextureToFloatArray(UTexture2D* Texture, TArray<float>& ImageData, int32& Width, int32& Height);
 };
\ No newline at end of file
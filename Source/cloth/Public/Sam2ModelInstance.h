@@ -13,6 +13,22 @@
 #if PLATFORM_WINDOWS && PLATFORM_64BITS
 #include "Windows/HideWindowsPlatformTypes.h"
 #endif
+#include "OnnxPrepackedWeights.h"
+#include "OnnxExternalData.h"
+#include "OnnxSessionSettings.h"
+#include "OnnxBenchmark.h"
+#include "OnnxNuma.h"
+#include "OnnxAutotuner.h"
+#include "OnnxResidency.h"
+#include "OnnxScratch.h"
+#include "OnnxMemory.h"
+#include "OnnxCapture.h"
+#include "OnnxTuning.h"
+#include "OnnxWorkerPool.h"
+#include "OnnxCoreSam2.h"
+#include "OnnxTensor.h"
+
+#include <atomic>
 
 #include "Sam2ModelInstance.generated.h"
 
@@ -28,6 +44,11 @@ struct CLOTH_API FSam2Input
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SAM2 Input")
 	TArray<float> ImageData;
 
+	// 图像张量，HWC格式的Float张量，形状{Height, Width, 3}或{1, Height, Width, 3}。
+	// 有效时代替ImageData、ImageWidth和ImageHeight，预处理直接读取张量存储而不复制
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SAM2 Input")
+	FOnnxTensor Image;
+
 	// 图像尺寸
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SAM2 Input")
 	int32 ImageWidth = 1024;
@@ -116,6 +137,46 @@ struct CLOTH_API FSam2Output
 
 		return SingleMask;
 	}
+
+	// 指定掩码的张量视图（形状{MaskHeight, MaskWidth}），引用MaskData而不复制，
+	// 在MaskData被下一次推理改写或释放之前有效
+	FOnnxTensor GetMaskView(int32 MaskIndex)
+	{
+		const int32 MaskSize = MaskWidth * MaskHeight;
+		if (MaskIndex < 0 || MaskIndex >= NumMasks || (MaskIndex + 1) * MaskSize > MaskData.Num())
+		{
+			return FOnnxTensor();
+		}
+
+		const int64 Shape[] = { MaskHeight, MaskWidth };
+		return FOnnxTensor::Wrap(MakeArrayView(MaskData.GetData() + MaskIndex * MaskSize, MaskSize), Shape);
+	}
+
+	// 所有掩码的张量视图（形状{NumMasks, MaskHeight, MaskWidth}），与GetMaskView一样引用MaskData而不复制
+	FOnnxTensor GetMasksView()
+	{
+		const int32 MaskSize = MaskWidth * MaskHeight;
+		if (NumMasks <= 0 || NumMasks * MaskSize > MaskData.Num())
+		{
+			return FOnnxTensor();
+		}
+
+		const int64 Shape[] = { NumMasks, MaskHeight, MaskWidth };
+		return FOnnxTensor::Wrap(MakeArrayView(MaskData.GetData(), NumMasks * MaskSize), Shape);
+	}
+};
+
+/**
+ * 缓存的一个编码器特征，按配置以float32或fp16存储（两者只有一个非空）
+ */
+struct CLOTH_API FSam2CachedFeature
+{
+	TArray<float> Float;
+	TArray<uint16> Half;
+
+	int32 Num() const { return Float.Num() + Half.Num(); }
+	int64 GetBytes() const { return int64(Float.Num()) * sizeof(float) + int64(Half.Num()) * sizeof(uint16); }
+	void Empty() { Float.Empty(); Half.Empty(); }
 };
 
 /**
@@ -126,65 +187,234 @@ class CLOTH_API FSam2ModelInstance
 {
 public:
 	// 构造函数：从给定的encoder和decoder模型路径创建实例
-	FSam2ModelInstance(const FString& EncoderPath, const FString& DecoderPath);
-
-	// 析构函数：清理ONNX Runtime会话和环境
+	// bInHalfPrecisionFeatures为true时缓存的编码器特征以fp16存储，内存占用减半；
+	// 解码器接受fp16输入时直接使用，否则在创建张量时转换
+	// InWorkerSettings启用时编码器和解码器在本地工作进程中运行（不缓存特征，不登记驻留管理）
+	FSam2ModelInstance(const FString& EncoderPath, const FString& DecoderPath,
+					   const FOnnxSessionSettings& InEncoderSettings = FOnnxSessionSettings(),
+					   const FOnnxSessionSettings& InDecoderSettings = FOnnxSessionSettings(),
+					   bool bInHalfPrecisionFeatures = false,
+					   const FOnnxWorkerSettings& InWorkerSettings = FOnnxWorkerSettings());
+
+	// 析构函数：清理ONNX Runtime会话（环境由FOnnxRuntime共享持有）
 	~FSam2ModelInstance();
 
 	// 检查SAM2模型是否已成功初始化
 	bool IsInitialized() const;
 
-	// 运行SAM2推理
+	// 运行SAM2推理。预热之后（输出复用同一个FSam2Output时）不再分配堆内存
 	bool RunInference(const FSam2Input& Input, FSam2Output& Output);
 
-	// 图像预处理：将任意尺寸图像转换为1024x1024标准化格式
-	bool PreprocessImage(const TArray<float>& InputImageData, int32 InputWidth, int32 InputHeight,
+	// 图像预处理：将任意尺寸图像转换为1024x1024标准化的NCHW格式（ProcessedImageData容量足够时不重新分配）
+	bool PreprocessImage(TConstArrayView<float> InputImageData, int32 InputWidth, int32 InputHeight,
 						 TArray<float>& ProcessedImageData, float& OutScale, int32& OutXOffset, int32& OutYOffset);
 
-	// 掩码后处理：将1024x1024掩码转换回原始图像尺寸
+	// 掩码后处理：将1024x1024掩码二值化并转换回原始图像尺寸（不分配中间缓冲区）
 	bool PostprocessMask(const TArray<float>& MaskData, int32 OriginalWidth, int32 OriginalHeight,
 						 float Scale, int32 XOffset, int32 YOffset, TArray<uint8>& FinalMask);
 
+	// 用给定配置为编码器/解码器创建新会话（共享预打包权重和外部数据映射）
+	TUniquePtr<Ort::Session> CreateEncoderSession(const FOnnxSessionSettings& Settings);
+	TUniquePtr<Ort::Session> CreateDecoderSession(const FOnnxSessionSettings& Settings);
+
+	// 对编码器和解码器的所有自旋策略做基准测试。IntraOpThreads<=0时沿用当前配置。
+	TArray<FOnnxBenchmarkResult> BenchmarkSpinModes(const FOnnxBenchmarkParams& Params, int32 IntraOpThreads = 0);
+
+	// 在本机上调优编码器和解码器的线程配置并保存到Saved/，结果在下次创建会话时生效
+	TArray<FOnnxAutotuneResult> Autotune(const FOnnxAutotuneGrid& Grid, const FOnnxBenchmarkParams& Params);
+
+	// 实际使用的会话配置（包含选定的执行提供程序）。返回副本：控制台变量变化时配置在后台线程上更新
+	FOnnxSessionSettings GetEncoderSettings() const;
+	FOnnxSessionSettings GetDecoderSettings() const;
+
+	// 驻留统计（驻留内存、驱逐和重新加载次数）
+	FOnnxResidencyStats GetResidencyStats() const;
+
+	// 编码器NUMA副本组的逐节点统计
+	TArray<FOnnxNumaNodeStats> GetEncoderNumaNodeStats() const;
+
+	// RunInference的分配统计（预热之后应为0，只在启用ONNX_TRACK_ALLOCATIONS的构建中统计）
+	FOnnxAllocationStats GetAllocationStats() const { return Allocations.GetStats(); }
+
+	// 经由插件分配器的ORT内存（编码器和解码器的权重、中间张量和输出）
+	FOnnxMemoryStats GetMemoryStats() const { return MemoryOwner.GetStats(); }
+
+	// 把编码器和解码器的输入录制到同一个捕获文件（FilePath为空时在Saved/Onnx/Captures下生成）
+	bool StartCapture(const FString& FilePath, const FOnnxCaptureConfig& Config);
+	void StopCapture();
+	bool IsCapturing() const { return Capture.IsOpen(); }
+
+	// 进程外模式的工作进程池统计（未启用时为默认值）
+	bool IsUsingWorkers() const { return EncoderWorkers.IsValid(); }
+	FOnnxWorkerPoolStats GetEncoderWorkerStats() const;
+	FOnnxWorkerPoolStats GetDecoderWorkerStats() const;
+
+	// 解码器的输入数量
+	static constexpr int32 NumDecoderInputs = 8;
+
 private:
 	// 禁用复制
 	FSam2ModelInstance(const FSam2ModelInstance&) = delete;
 	FSam2ModelInstance& operator=(const FSam2ModelInstance&) = delete;
 
-	// ONNX Runtime环境
-	TUniquePtr<Ort::Env> Env;
+	// 按模型内容哈希共享的预打包权重容器（多个组件加载同一模型时只保留一份预打包权重）
+	// 必须声明在会话之前，保证析构时会话先释放
+	FOnnxPrepackedWeightsPtr EncoderPrepackedWeights;
+	FOnnxPrepackedWeightsPtr DecoderPrepackedWeights;
+
+	// 内存映射的外部数据文件（共享骨干网络权重的SAM2变体只映射一次）
+	TArray<FOnnxMappedExternalFilePtr> EncoderExternalData;
+	TArray<FOnnxMappedExternalFilePtr> DecoderExternalData;
 
 	// Encoder会话
 	TUniquePtr<Ort::Session> EncoderSession;
 
+	// 按NUMA节点分组的编码器副本（EncoderSettings.ReplicasPerNumaNode>0时启用）
+	TUniquePtr<FOnnxNumaSessionPool> EncoderPool;
+
 	// Decoder会话
 	TUniquePtr<Ort::Session> DecoderSession;
 
+	// 进程外模式的编码器/解码器工作进程池（未启用时为空，此时使用上面的会话）
+	TUniquePtr<FOnnxWorkerPool> EncoderWorkers;
+	TUniquePtr<FOnnxWorkerPool> DecoderWorkers;
+
 	// 模型路径
 	FString EncoderModelPath;
 	FString DecoderModelPath;
 
+	// 会话配置（合并了本机调优结果和控制台变量的覆盖）
+	FOnnxSessionSettings EncoderSettings;
+	FOnnxSessionSettings DecoderSettings;
+
+	// 覆盖之前的配置，控制台变量变化时从它重新计算
+	FOnnxSessionSettings BaseEncoderSettings;
+	FOnnxSessionSettings BaseDecoderSettings;
+
+	// 保护以上四份配置：构造之后它们在重建会话的后台任务中更新，同时被其他线程读取
+	mutable FCriticalSection SettingsMutex;
+
+	// 在SettingsMutex下更新配置；控制台变量变化后重新计算的配置
+	void SetSessionSettings(const FOnnxSessionSettings& NewEncoderSettings, const FOnnxSessionSettings& NewDecoderSettings);
+	void ComputeOverriddenSettings(FOnnxSessionSettings& OutEncoderSettings, FOnnxSessionSettings& OutDecoderSettings) const;
+
 	// 初始化标志
 	bool bIsInitialized = false;
 
 	// 缓存的编码器输出（用于同一图像的多次推理）
-	TArray<float> CachedImageEmbed;
-	TArray<float> CachedHighResFeats0;
-	TArray<float> CachedHighResFeats1;
+	FSam2CachedFeature CachedImageEmbed;
+	FSam2CachedFeature CachedHighResFeats0;
+	FSam2CachedFeature CachedHighResFeats1;
 	bool bHasCachedFeatures = false;
 
+	// 以fp16缓存编码器特征（onnx.Sam2.HalfPrecisionFeatures可以覆盖组件的设置）
+	bool bHalfPrecisionFeatures = false;
+	bool bBaseHalfPrecisionFeatures = false;
+
+	// 模型期望的浮点输入类型（FLOAT或FLOAT16），fp16导出的模型在创建张量时转换
+	ONNXTensorElementDataType EncoderImageType = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+	TArray<ONNXTensorElementDataType> DecoderInputTypes;
+
+	// 会话本身的驻留内存（最近一次加载时测得）
+	int64 SessionBytes = 0;
+
+	// 推理暂存区：预热时按实际大小增长，之后每次请求复用（同一实例的请求按顺序执行）
+	TArray<float> ImageScratch;
+	TArray<uint16> HalfImageScratch;
+	TArray<float> PointCoordsScratch;
+	TArray<float> PointLabelsScratch;
+	TArray<float> FeatureFloatScratch[3];
+	TArray<uint16> DecoderHalfScratch[NumDecoderInputs];
+
+	// 解码器的常量输入（全零的mask_input、has_mask_input=0、orig_im_size=[1024, 1024]），构造时创建一次
+	TArray<float> MaskInput;
+	TArray<float> HasMaskInput;
+	TArray<int32> OrigImSize;
+
+	// 预热后记录的输出形状：编码器直接写入特征缓存，解码器直接写入FSam2Output
+	FOnnxOutputSlot EncoderOutputSlots[3];
+	FOnnxOutputSlot DecoderOutputSlots[2];
+
+	// RunInference的分配统计
+	FOnnxAllocationCounter Allocations;
+
+	// 插件分配器中的登记项，创建会话和推理时的ORT分配记到本模型名下
+	FOnnxMemoryOwner MemoryOwner;
+
+	// 请求录制（模型0为编码器，1为解码器）
+	FOnnxCaptureWriter Capture;
+
+	// 调优变量的变化通知（析构函数先注销，等待进行中的后台重建）
+	FOnnxTuningListener Tuning;
+
+	// 构造时推迟的EP选择和首次调优；析构开始后调优的会话工厂不再创建会话
+	std::atomic<bool> bEncoderAutotunePending{false};
+	std::atomic<bool> bDecoderAutotunePending{false};
+	std::atomic<bool> bShuttingDown{false};
+
 	// 内部初始化函数
 	bool InitializeEncoder();
 	bool InitializeDecoder();
 
+	// 进程外模式：启动编码器和解码器的工作进程池，从元数据中查询输入类型
+	bool InitializeWorkers(const FOnnxWorkerSettings& WorkerSettings);
+
+	// 创建会话的公共实现
+	TUniquePtr<Ort::Session> CreateModelSession(const FString& ModelPath, const FOnnxSessionSettings& Settings,
+												FOnnxPrepackedWeightsPtr& PrepackedWeights,
+												TArray<FOnnxMappedExternalFilePtr>& ExternalData);
+
+	// 按最终配置重新创建/释放会话（驻留管理器驱逐和重新加载时调用）
+	bool ReloadSessions();
+	void ReleaseSessions();
+
+	// 按当前的onnx.*控制台变量在后台线程上重建会话或切换特征精度，排空进行中的请求后换入
+	void RebuildSessions(bool bForce);
+	void DropCachedFeatures();
+
+	// 在重建回调的后台线程上完成推迟的EP选择和首次调优，结果写入基础配置后由RebuildSessions换入
+	void RunPendingAutotune();
+	void CreateEncoderPool();
+
+	// 缓存的编码器特征和模型文件的字节数
+	int64 GetCachedFeatureBytes() const;
+	int64 GetModelFileBytes() const;
+
+	// 调优结果的键（模型文件名 + 内容哈希）
+	static FString GetModelKey(const FString& ModelPath);
+
+	// 解码器基准测试参数（把orig_im_size设为真实尺寸）
+	static FOnnxBenchmarkParams MakeDecoderBenchmarkParams(const FOnnxBenchmarkParams& Params);
+
+	// 输入图像的像素和尺寸：Image有效时引用张量存储，否则引用ImageData
+	static bool GetInputImage(const FSam2Input& Input, TConstArrayView<float>& OutPixels, int32& OutWidth, int32& OutHeight);
+
 	// 运行编码器
 	bool RunEncoder(const TArray<float>& ImageData);
 
 	// 运行解码器
 	bool RunDecoder(const FSam2Input& Input, FSam2Output& Output);
 
-	// 创建ONNX Runtime张量
-	Ort::Value CreateTensor(const TArray<float>& Data, const std::vector<int64_t>& Shape);
-	Ort::Value CreateTensor(const TArray<int32>& Data, const std::vector<int64_t>& Shape);
+	// 进程外模式的推理：预处理直接写入编码器的共享内存槽，编码器输出复制到解码器的槽
+	bool RunOnWorkers(const FSam2Input& Input, TConstArrayView<float> ImagePixels, int32 ImageWidth, int32 ImageHeight, FSam2Output& Output);
+
+	// 查询编码器/解码器浮点输入的元素类型
+	void CacheInputTypes();
+
+	// 把预热运行的编码器输出存入缓存（按bHalfPrecisionFeatures转换）
+	bool StoreFeature(const Ort::Value& Tensor, FSam2CachedFeature& OutFeature) const;
+
+	// 编码器输出绑定到特征缓存 / 运行之后完成转换
+	Ort::Value BindFeature(const Ort::MemoryInfo& MemoryInfo, FOnnxOutputSlot& Slot, FSam2CachedFeature& Feature) const;
+	void FinishFeature(const FOnnxOutputSlot& Slot, FSam2CachedFeature& Feature) const;
+
+	// 创建ONNX Runtime张量（张量直接引用Data，Data必须在Run结束之前保持有效）
+	Ort::Value CreateTensor(const TArray<int32>& Data, const int64_t* Shape, size_t NumDims);
+
+	// 按模型期望的类型创建浮点张量，需要转换时使用Scratch（必须在Run结束之前保持有效）
+	Ort::Value CreateTensor(const TArray<float>& Data, const int64_t* Shape, size_t NumDims, ONNXTensorElementDataType Type, TArray<uint16>& Scratch);
+	Ort::Value CreateTensor(const FSam2CachedFeature& Feature, const int64_t* Shape, size_t NumDims, ONNXTensorElementDataType Type,
+							TArray<float>& FloatScratch, TArray<uint16>& HalfScratch);
 
 	// 辅助函数：坐标转换
 	void TransformPromptPoints(const TArray<FVector2D>& InputPoints, int32 InputWidth, int32 InputHeight,
@@ -192,4 +422,10 @@ private:
 
 	// 辅助函数：应用sigmoid
 	void ApplySigmoid(TArray<float>& Data);
+
+	// 由预处理记录的缩放和偏移还原画布上的有效区域
+	static OnnxCore::Sam2::FLetterbox MakeLetterbox(int32 Width, int32 Height, float Scale, int32 XOffset, int32 YOffset);
+
+	// 驻留管理器中的登记项，必须是最后一个成员（最先析构，之后不会再有驱逐回调）
+	FOnnxResidencyHandle Residency;
 };
\ No newline at end of file
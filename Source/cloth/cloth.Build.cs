@@ -9,22 +9,6 @@ public class cloth : ModuleRules
 	{
         PCHUsage = ModuleRules.PCHUsageMode.UseExplicitOrSharedPCHs;
 
-        // ʹ���Լ���ONNX Runtime 1.20�汾����NNE�汾ƥ�䣩
-        string OnnxRuntimePath = Path.Combine(PluginDirectory, "ThirdParty", "OnnxRuntime");
-        string includePath = Path.Combine(OnnxRuntimePath, "include");
-        PublicIncludePaths.AddRange(new string[] { includePath });
-
-        // ����ONNX Runtime���ļ�
-        string libPath = Path.Combine(OnnxRuntimePath, "lib");
-        PublicAdditionalLibraries.Add(Path.Combine(libPath, "onnxruntime.lib"));
-
-        // ��������ʱDLL����
-        RuntimeDependencies.Add(Path.Combine(libPath, "onnxruntime.dll"));
-        RuntimeDependencies.Add(Path.Combine(libPath, "onnxruntime_providers_shared.dll"));
-
-        // �����ӳټ���DLL
-        PublicDelayLoadDLLs.Add("onnxruntime.dll");
-        PublicDelayLoadDLLs.Add("onnxruntime_providers_shared.dll");
         PrivateIncludePaths.AddRange(
             new string[] {
 				// ... add other private include paths required here ...
@@ -38,7 +22,9 @@ public class cloth : ModuleRules
                 "Core",
                 "CoreUObject",
                 "Engine",
-                "Projects"
+                "Projects",
+                // 与引擎无关的推理核心，同时提供ONNX Runtime的包含路径和链接库
+                "OnnxCore"
 				// ... add other public dependencies that you statically link with here ...
 			}
             );
@@ -0,0 +1,366 @@
+// OnnxPerf.cpp
+// 与引擎无关的命令行基准测试工具：加载模型，生成或读取输入，按线程配置测量延迟和吞吐量。
+
+#include "OnnxCoreBenchmark.h"
+#include "OnnxCoreSessionConfig.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+namespace
+{
+    struct FOptions
+    {
+        std::string ModelPath;
+        std::vector<int32_t> IntraOpThreads;
+        std::vector<OnnxCore::ESpinMode> SpinModes;
+        std::vector<int32_t> Streams;
+        int32_t InterOpThreads = 0;
+        bool bParallel = false;
+        OnnxCore::FSyntheticInputParams Inputs;
+        std::vector<std::pair<std::string, std::string>> InputFiles;
+        OnnxCore::FBenchmarkParams Benchmark;
+        bool bCsv = false;
+    };
+
+    void PrintUsage()
+    {
+        std::printf(
+            "Usage: OnnxPerf --model <model.onnx> [options]\n"
+            "\n"
+            "  --threads 1,2,4,8        intra-op thread counts to sweep (default: 1,2,4,... up to the core count)\n"
+            "  --spin default,stop,none spin modes to sweep (default: default)\n"
+            "  --streams 1,2,4          concurrent request streams on one session (default: 1)\n"
+            "  --parallel               parallel execution mode\n"
+            "  --inter <n>              inter-op threads in parallel mode (default: 0, ORT decides)\n"
+            "  --warmup <n>             untimed runs per configuration (default: 5)\n"
+            "  --iterations <n>         timed runs per configuration and stream (default: 50)\n"
+            "  --idle-ms <ms>           idle gap between single-stream runs, exposes spinning CPU (default: 0)\n"
+            "  --dim <n>                value for dynamic dimensions (default: 1)\n"
+            "  --shape <name>=1x3x224x224  shape override for one input (repeatable)\n"
+            "  --input <name>=<file>    raw little-endian tensor data for one input (repeatable)\n"
+            "  --csv                    print CSV instead of a table\n");
+    }
+
+    bool ParseIntList(const char* Text, std::vector<int32_t>& Out)
+    {
+        Out.clear();
+        const char* Cursor = Text;
+        while (*Cursor)
+        {
+            char* End = nullptr;
+            const long Value = std::strtol(Cursor, &End, 10);
+            if (End == Cursor || Value <= 0)
+            {
+                return false;
+            }
+            Out.push_back(static_cast<int32_t>(Value));
+            Cursor = *End == ',' ? End + 1 : End;
+            if (*End != ',' && *End != '\0')
+            {
+                return false;
+            }
+        }
+        return !Out.empty();
+    }
+
+    bool ParseShape(const std::string& Text, std::vector<int64_t>& Out)
+    {
+        Out.clear();
+        size_t Begin = 0;
+        while (Begin <= Text.size())
+        {
+            const size_t End = Text.find('x', Begin);
+            const std::string Dim = Text.substr(Begin, End == std::string::npos ? std::string::npos : End - Begin);
+            char* DimEnd = nullptr;
+            const long long Value = std::strtoll(Dim.c_str(), &DimEnd, 10);
+            if (Dim.empty() || *DimEnd != '\0' || Value <= 0)
+            {
+                return false;
+            }
+            Out.push_back(Value);
+            if (End == std::string::npos)
+            {
+                break;
+            }
+            Begin = End + 1;
+        }
+        return !Out.empty();
+    }
+
+    // name=value形式的参数
+    bool SplitAssignment(const char* Text, std::string& OutName, std::string& OutValue)
+    {
+        const char* Equals = std::strchr(Text, '=');
+        if (!Equals || Equals == Text || Equals[1] == '\0')
+        {
+            return false;
+        }
+        OutName.assign(Text, Equals);
+        OutValue.assign(Equals + 1);
+        return true;
+    }
+
+    bool ParseOptions(int Argc, char** Argv, FOptions& Options)
+    {
+        for (int i = 1; i < Argc; ++i)
+        {
+            const std::string Arg = Argv[i];
+            const char* Value = i + 1 < Argc ? Argv[i + 1] : nullptr;
+            auto NeedValue = [&]()
+            {
+                if (!Value)
+                {
+                    std::fprintf(stderr, "Missing value for %s\n", Arg.c_str());
+                    return false;
+                }
+                ++i;
+                return true;
+            };
+
+            if (Arg == "--help" || Arg == "-h")
+            {
+                return false;
+            }
+            else if (Arg == "--parallel")
+            {
+                Options.bParallel = true;
+            }
+            else if (Arg == "--csv")
+            {
+                Options.bCsv = true;
+            }
+            else if (!NeedValue())
+            {
+                return false;
+            }
+            else if (Arg == "--model")
+            {
+                Options.ModelPath = Value;
+            }
+            else if (Arg == "--threads" || Arg == "--streams")
+            {
+                if (!ParseIntList(Value, Arg == "--threads" ? Options.IntraOpThreads : Options.Streams))
+                {
+                    std::fprintf(stderr, "Invalid list for %s: %s\n", Arg.c_str(), Value);
+                    return false;
+                }
+            }
+            else if (Arg == "--spin")
+            {
+                Options.SpinModes.clear();
+                std::string List = Value;
+                size_t Begin = 0;
+                while (Begin <= List.size())
+                {
+                    const size_t End = List.find(',', Begin);
+                    OnnxCore::ESpinMode Mode;
+                    if (!OnnxCore::ParseSpinMode(List.substr(Begin, End == std::string::npos ? std::string::npos : End - Begin), Mode))
+                    {
+                        std::fprintf(stderr, "Invalid spin mode list: %s (expected default, stop or none)\n", Value);
+                        return false;
+                    }
+                    Options.SpinModes.push_back(Mode);
+                    if (End == std::string::npos)
+                    {
+                        break;
+                    }
+                    Begin = End + 1;
+                }
+            }
+            else if (Arg == "--inter")
+            {
+                Options.InterOpThreads = std::max(0, std::atoi(Value));
+            }
+            else if (Arg == "--warmup")
+            {
+                Options.Benchmark.WarmupIterations = std::max(0, std::atoi(Value));
+            }
+            else if (Arg == "--iterations")
+            {
+                Options.Benchmark.Iterations = std::max(1, std::atoi(Value));
+            }
+            else if (Arg == "--idle-ms")
+            {
+                Options.Benchmark.IdleGapSeconds = std::max(0.0, std::atof(Value) / 1000.0);
+            }
+            else if (Arg == "--dim")
+            {
+                Options.Inputs.DynamicDimValue = std::max<int64_t>(1, std::atoll(Value));
+            }
+            else if (Arg == "--shape")
+            {
+                std::string Name, ShapeText;
+                std::vector<int64_t> Shape;
+                if (!SplitAssignment(Value, Name, ShapeText) || !ParseShape(ShapeText, Shape))
+                {
+                    std::fprintf(stderr, "Invalid shape override: %s (expected name=1x3x224x224)\n", Value);
+                    return false;
+                }
+                Options.Inputs.ShapeOverrides[Name] = Shape;
+            }
+            else if (Arg == "--input")
+            {
+                std::string Name, File;
+                if (!SplitAssignment(Value, Name, File))
+                {
+                    std::fprintf(stderr, "Invalid input file: %s (expected name=path)\n", Value);
+                    return false;
+                }
+                Options.InputFiles.emplace_back(Name, File);
+            }
+            else
+            {
+                std::fprintf(stderr, "Unknown option %s\n", Arg.c_str());
+                return false;
+            }
+        }
+
+        if (Options.ModelPath.empty())
+        {
+            std::fprintf(stderr, "--model is required\n");
+            return false;
+        }
+
+        // 默认按2的幂扫描到物理核数附近
+        if (Options.IntraOpThreads.empty())
+        {
+            const int32_t Cores = std::max(1u, std::thread::hardware_concurrency());
+            for (int32_t Threads = 1; Threads < Cores; Threads *= 2)
+            {
+                Options.IntraOpThreads.push_back(Threads);
+            }
+            Options.IntraOpThreads.push_back(Cores);
+        }
+        if (Options.SpinModes.empty())
+        {
+            Options.SpinModes.push_back(OnnxCore::ESpinMode::Default);
+        }
+        if (Options.Streams.empty())
+        {
+            Options.Streams.push_back(1);
+        }
+        return true;
+    }
+
+    void PrintHeader(bool bCsv)
+    {
+        if (bCsv)
+        {
+            std::printf("config,streams,runs,mean_ms,p50_ms,p90_ms,p99_ms,max_ms,runs_per_s,cpu_ms_per_run,idle_cpu_pct\n");
+        }
+        else
+        {
+            std::printf("%-36s %7s %9s %9s %9s %9s %9s %10s %9s %8s\n",
+                        "config", "streams", "mean ms", "p50 ms", "p90 ms", "p99 ms", "max ms", "runs/s", "cpu/run", "idle%");
+        }
+    }
+
+    void PrintResult(bool bCsv, const std::string& Label, int32_t Streams, const OnnxCore::FBenchmarkResult& Result)
+    {
+        if (!Result.bSucceeded)
+        {
+            std::printf(bCsv ? "\"%s\",%d,FAILED: %s\n" : "%-36s %7d FAILED: %s\n", Label.c_str(), Streams, Result.Error.c_str());
+            return;
+        }
+
+        const OnnxCore::FLatencySummary& Latency = Result.Latency;
+        if (bCsv)
+        {
+            std::printf("\"%s\",%d,%lld,%.3f,%.3f,%.3f,%.3f,%.3f,%.1f,%.3f,%.1f\n", Label.c_str(), Streams, static_cast<long long>(Latency.Count),
+                        Latency.MeanMs, Latency.P50Ms, Latency.P90Ms, Latency.P99Ms, Latency.MaxMs,
+                        Result.RunsPerSecond, Result.CpuMsPerRequest, Result.IdleCpuPercent);
+        }
+        else
+        {
+            std::printf("%-36s %7d %9.3f %9.3f %9.3f %9.3f %9.3f %10.1f %9.3f %8.1f\n", Label.c_str(), Streams,
+                        Latency.MeanMs, Latency.P50Ms, Latency.P90Ms, Latency.P99Ms, Latency.MaxMs,
+                        Result.RunsPerSecond, Result.CpuMsPerRequest, Result.IdleCpuPercent);
+        }
+        std::fflush(stdout);
+    }
+}
+
+int main(int Argc, char** Argv)
+{
+    FOptions Options;
+    if (!ParseOptions(Argc, Argv, Options))
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    try
+    {
+        Ort::Env Env(ORT_LOGGING_LEVEL_WARNING, "OnnxPerf");
+        bool bAllSucceeded = true;
+        bool bPrintedHeader = false;
+
+        for (OnnxCore::ESpinMode SpinMode : Options.SpinModes)
+        {
+            for (int32_t IntraOpThreads : Options.IntraOpThreads)
+            {
+                OnnxCore::FSessionConfig Config;
+                Config.IntraOpThreads = IntraOpThreads;
+                Config.InterOpThreads = Options.InterOpThreads;
+                Config.bParallel = Options.bParallel;
+                Config.SpinMode = SpinMode;
+                const std::string Label = Config.ToString();
+
+                // 每个配置一个新会话，输入按会话的元数据生成（文件输入覆盖合成数据）
+                Ort::Session Session = OnnxCore::CreateSession(Env, Options.ModelPath, Config);
+
+                OnnxCore::FInputSet Inputs;
+                std::string Error;
+                if (!OnnxCore::MakeSyntheticInputs(Session, Options.Inputs, Inputs, Error))
+                {
+                    std::fprintf(stderr, "%s\n", Error.c_str());
+                    return 1;
+                }
+                for (const auto& InputFile : Options.InputFiles)
+                {
+                    if (!OnnxCore::LoadInputData(Inputs, InputFile.first, InputFile.second, Error))
+                    {
+                        std::fprintf(stderr, "%s\n", Error.c_str());
+                        return 1;
+                    }
+                }
+
+                if (!bPrintedHeader)
+                {
+                    std::printf("model: %s\n\n", Options.ModelPath.c_str());
+                    PrintHeader(Options.bCsv);
+                    bPrintedHeader = true;
+                }
+
+                for (int32_t Streams : Options.Streams)
+                {
+                    // 单个请求流时测量延迟和自旋开销；多个流共享同一个会话测量吞吐量
+                    OnnxCore::FBenchmarkResult Result;
+                    if (Streams == 1)
+                    {
+                        Result = OnnxCore::RunBenchmark(Session, Inputs, Options.Benchmark);
+                    }
+                    else
+                    {
+                        const std::vector<Ort::Session*> Sessions(Streams, &Session);
+                        Result = OnnxCore::RunConcurrentBenchmark(Sessions, Inputs, Options.Benchmark);
+                    }
+                    bAllSucceeded &= Result.bSucceeded;
+                    PrintResult(Options.bCsv, Label, Streams, Result);
+                }
+            }
+        }
+
+        return bAllSucceeded ? 0 : 1;
+    }
+    catch (const Ort::Exception& e)
+    {
+        std::fprintf(stderr, "ONNX Runtime error: %s\n", e.what());
+        return 1;
+    }
+}
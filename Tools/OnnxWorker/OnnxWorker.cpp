@@ -0,0 +1,362 @@
+// OnnxWorker.cpp
+// 进程外推理的工作进程：加载一个模型，通过宿主创建的共享内存通道接收请求。
+// 输入张量在共享页面上原地包装成Ort::Value，输出写回同一个槽，宿主原地读取。
+// 宿主进程退出时工作进程随之退出；崩溃或挂起由宿主的FOnnxWorkerPool发现并重启。
+
+#include "OnnxCoreSessionConfig.h"
+#include "OnnxCoreWorkerChannel.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/prctl.h>
+#endif
+
+namespace
+{
+    struct FOptions
+    {
+        std::string ChannelName;
+        std::string ModelPath;
+        int64_t ParentPid = 0;
+        OnnxCore::FSessionConfig Config;
+        std::vector<int32_t> Cpus;
+    };
+
+    void PrintUsage()
+    {
+        std::printf(
+            "Usage: OnnxWorker --channel <name> --model <model.onnx> [options]\n"
+            "\n"
+            "  --parent <pid>               exit when this process is gone\n"
+            "  --threads <n>                intra-op threads (default: 1)\n"
+            "  --inter <n>                  inter-op threads in parallel mode (default: 0, ORT decides)\n"
+            "  --parallel                   parallel execution mode\n"
+            "  --spin default|stop|none     spin mode (default: default)\n"
+            "  --affinities <list>          session.intra_op_thread_affinities\n"
+            "  --cpus 0-3,8                 pin the whole process to these CPUs (Linux)\n"
+            "  --disable-qdq-fusion, --qdq-cleanup, --disable-double-qdq-remover, --avx2-precision\n"
+            "  --matmul-nbits-accuracy <n>  quantized model options\n");
+    }
+
+    // 0-3,8,10-11形式的CPU列表
+    bool ParseCpuList(const char* Text, std::vector<int32_t>& Out)
+    {
+        Out.clear();
+        const char* Cursor = Text;
+        while (*Cursor)
+        {
+            char* End = nullptr;
+            const long First = std::strtol(Cursor, &End, 10);
+            if (End == Cursor || First < 0)
+            {
+                return false;
+            }
+            long Last = First;
+            if (*End == '-')
+            {
+                Cursor = End + 1;
+                Last = std::strtol(Cursor, &End, 10);
+                if (End == Cursor || Last < First)
+                {
+                    return false;
+                }
+            }
+            for (long Cpu = First; Cpu <= Last; ++Cpu)
+            {
+                Out.push_back(static_cast<int32_t>(Cpu));
+            }
+            if (*End != ',' && *End != '\0')
+            {
+                return false;
+            }
+            Cursor = *End == ',' ? End + 1 : End;
+        }
+        return !Out.empty();
+    }
+
+    bool ParseOptions(int Argc, char** Argv, FOptions& Options)
+    {
+        OnnxCore::FSessionConfig& Config = Options.Config;
+        for (int i = 1; i < Argc; ++i)
+        {
+            const std::string Arg = Argv[i];
+            const char* Value = i + 1 < Argc ? Argv[i + 1] : nullptr;
+            auto NeedValue = [&]()
+            {
+                if (!Value)
+                {
+                    std::fprintf(stderr, "Missing value for %s\n", Arg.c_str());
+                    return false;
+                }
+                ++i;
+                return true;
+            };
+
+            if (Arg == "--help" || Arg == "-h")
+            {
+                return false;
+            }
+            else if (Arg == "--parallel")
+            {
+                Config.bParallel = true;
+            }
+            else if (Arg == "--disable-qdq-fusion")
+            {
+                Config.bDisableQDQFusion = true;
+            }
+            else if (Arg == "--qdq-cleanup")
+            {
+                Config.bEnableQDQCleanup = true;
+            }
+            else if (Arg == "--disable-double-qdq-remover")
+            {
+                Config.bDisableDoubleQDQRemover = true;
+            }
+            else if (Arg == "--avx2-precision")
+            {
+                Config.bAvx2PrecisionMode = true;
+            }
+            else if (!NeedValue())
+            {
+                return false;
+            }
+            else if (Arg == "--channel")
+            {
+                Options.ChannelName = Value;
+            }
+            else if (Arg == "--model")
+            {
+                Options.ModelPath = Value;
+            }
+            else if (Arg == "--parent")
+            {
+                Options.ParentPid = std::atoll(Value);
+            }
+            else if (Arg == "--threads")
+            {
+                Config.IntraOpThreads = std::max(1, std::atoi(Value));
+            }
+            else if (Arg == "--inter")
+            {
+                Config.InterOpThreads = std::max(0, std::atoi(Value));
+            }
+            else if (Arg == "--spin")
+            {
+                if (!OnnxCore::ParseSpinMode(Value, Config.SpinMode))
+                {
+                    std::fprintf(stderr, "Invalid spin mode: %s (expected default, stop or none)\n", Value);
+                    return false;
+                }
+            }
+            else if (Arg == "--affinities")
+            {
+                Config.IntraOpThreadAffinities = Value;
+            }
+            else if (Arg == "--cpus")
+            {
+                if (!ParseCpuList(Value, Options.Cpus))
+                {
+                    std::fprintf(stderr, "Invalid CPU list: %s (expected 0-3,8)\n", Value);
+                    return false;
+                }
+            }
+            else if (Arg == "--matmul-nbits-accuracy")
+            {
+                Config.MatMulNBitsAccuracyLevel = std::max(0, std::atoi(Value));
+            }
+            else
+            {
+                std::fprintf(stderr, "Unknown option %s\n", Arg.c_str());
+                return false;
+            }
+        }
+
+        if (Options.ChannelName.empty() || Options.ModelPath.empty())
+        {
+            std::fprintf(stderr, "--channel and --model are required\n");
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * 宿主进程的存活检查
+     */
+    class FParentWatch
+    {
+    public:
+        explicit FParentWatch(int64_t InPid)
+            : Pid(InPid)
+        {
+#ifdef _WIN32
+            if (Pid > 0)
+            {
+                Handle = OpenProcess(SYNCHRONIZE, FALSE, static_cast<DWORD>(Pid));
+            }
+#elif defined(__linux__)
+            // 宿主进程退出（包括崩溃）时由内核发送SIGTERM；设置之前宿主已经退出的情况由IsAlive发现
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+        }
+
+        ~FParentWatch()
+        {
+#ifdef _WIN32
+            if (Handle)
+            {
+                CloseHandle(Handle);
+            }
+#endif
+        }
+
+        bool IsAlive() const
+        {
+            if (Pid <= 0)
+            {
+                return true;
+            }
+#ifdef _WIN32
+            return Handle && WaitForSingleObject(Handle, 0) == WAIT_TIMEOUT;
+#else
+            return getppid() == static_cast<pid_t>(Pid) || kill(static_cast<pid_t>(Pid), 0) == 0;
+#endif
+        }
+
+    private:
+        int64_t Pid;
+#ifdef _WIN32
+        HANDLE Handle = nullptr;
+#endif
+    };
+
+    void PinToCpus(const std::vector<int32_t>& Cpus)
+    {
+        if (Cpus.empty())
+        {
+            return;
+        }
+#if defined(__linux__)
+        // 在创建会话之前绑定，ORT线程池的线程继承进程的CPU集合
+        cpu_set_t Set;
+        CPU_ZERO(&Set);
+        for (int32_t Cpu : Cpus)
+        {
+            if (Cpu < CPU_SETSIZE)
+            {
+                CPU_SET(Cpu, &Set);
+            }
+        }
+        if (sched_setaffinity(0, sizeof(Set), &Set) != 0)
+        {
+            std::fprintf(stderr, "sched_setaffinity failed: %s\n", std::strerror(errno));
+        }
+#else
+        std::fprintf(stderr, "--cpus is only supported on Linux, ignored\n");
+#endif
+    }
+
+    int32_t GetProcessId()
+    {
+#ifdef _WIN32
+        return static_cast<int32_t>(GetCurrentProcessId());
+#else
+        return static_cast<int32_t>(getpid());
+#endif
+    }
+
+    int Fail(const OnnxCore::FSharedMemoryRegion& Region, OnnxCore::FWorkerChannelHeader* Header, const std::string& Message)
+    {
+        std::fprintf(stderr, "%s\n", Message.c_str());
+        OnnxCore::CopyWorkerString(Header->Error, sizeof(Header->Error), Message.c_str());
+        Header->WorkerState.store(static_cast<uint32_t>(OnnxCore::EWorkerState::Failed), std::memory_order_release);
+        OnnxCore::WakeAll(Region, Header->WorkerState);
+        return 1;
+    }
+}
+
+int main(int Argc, char** Argv)
+{
+    FOptions Options;
+    if (!ParseOptions(Argc, Argv, Options))
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    const FParentWatch Parent(Options.ParentPid);
+    PinToCpus(Options.Cpus);
+
+    OnnxCore::FSharedMemoryRegion Region;
+    std::string Error;
+    if (!Region.Open(Options.ChannelName, Error))
+    {
+        std::fprintf(stderr, "Cannot open worker channel %s: %s\n", Options.ChannelName.c_str(), Error.c_str());
+        return 1;
+    }
+    OnnxCore::FWorkerChannelHeader* Header = OnnxCore::ValidateWorkerChannel(Region.GetData(), Region.GetSize(), Error);
+    if (!Header)
+    {
+        std::fprintf(stderr, "Invalid worker channel %s: %s\n", Options.ChannelName.c_str(), Error.c_str());
+        return 1;
+    }
+    Header->WorkerPid = GetProcessId();
+
+    try
+    {
+        // 每个工作进程只有这一个会话，线程池与宿主进程和其他工作进程完全隔离
+        Ort::Env Env(ORT_LOGGING_LEVEL_WARNING, "OnnxWorker");
+        Ort::Session Session = OnnxCore::CreateSession(Env, Options.ModelPath, Options.Config);
+        if (!OnnxCore::PublishWorkerModel(Session, Header, Error))
+        {
+            return Fail(Region, Header, Error);
+        }
+
+        Header->WorkerState.store(static_cast<uint32_t>(OnnxCore::EWorkerState::Ready), std::memory_order_release);
+        OnnxCore::WakeAll(Region, Header->WorkerState);
+
+        while (!Header->bShutdown.load(std::memory_order_acquire))
+        {
+            // 先读门铃再检查槽：之后提交的请求会改变门铃，等待立即返回
+            const uint32_t Doorbell = Header->Doorbell.load(std::memory_order_acquire);
+            const int32_t SlotIndex = OnnxCore::AcquireSubmittedSlot(Header);
+            if (SlotIndex >= 0)
+            {
+                OnnxCore::ProcessWorkerSlot(Session, Region, Header, SlotIndex);
+                continue;
+            }
+
+            if (!Parent.IsAlive())
+            {
+                break;
+            }
+            OnnxCore::WaitForChange(Region, Header->Doorbell, Doorbell, 100);
+        }
+    }
+    catch (const Ort::Exception& e)
+    {
+        return Fail(Region, Header, std::string("ONNX Runtime error: ") + e.what());
+    }
+
+    Header->WorkerState.store(static_cast<uint32_t>(OnnxCore::EWorkerState::Exited), std::memory_order_release);
+    OnnxCore::WakeAll(Region, Header->WorkerState);
+    return 0;
+}